@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <brain_indexer/index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A set of ids: those in `[low, high)` which, optionally, are also in a list.
+ *
+ *  By default every id is selected.
+ */
+class IdSelection {
+  public:
+    /// \brief Restrict the selection to `[low, high)`.
+    inline void restrict_to_range(identifier_t low, identifier_t high);
+
+    /// \brief Restrict the selection to `ids`, which can be in any order.
+    inline void restrict_to(std::vector<identifier_t> ids);
+
+    /// \brief Is every id selected.
+    inline bool selects_all() const {
+        return !has_ids_ && low_ == 0 && high_ == std::numeric_limits<identifier_t>::max();
+    }
+
+    inline bool contains(identifier_t id) const;
+
+  private:
+    identifier_t low_ = 0;
+    identifier_t high_ = std::numeric_limits<identifier_t>::max();
+    bool has_ids_ = false;
+    std::vector<identifier_t> ids_;
+};
+
+
+/** \brief Selects elements by their attributes rather than their geometry.
+ *
+ *  The filter is evaluated for every candidate inside the traversal, see
+ *  `find_intersecting_filtered`; hence, elements which don't match are
+ *  never copied into the result. The restrictions are combined by `and`:
+ *
+ *    - the section type, of `Segment`; somas have `SectionType::soma` and
+ *      all other elements `SectionType::undefined`;
+ *    - the gid, of `Soma` and `Segment`; and the `post_gid` of synapses;
+ *    - the `pre_gid` and `post_gid` of synapses.
+ *
+ *  Elements which don't have a restricted attribute, e.g. the `pre_gid` of a
+ *  segment, don't match. For example, axon segments of two cells:
+ *
+ *      auto filter = AttributeFilter()
+ *          .section_types({SectionType::axon})
+ *          .gids({gid1, gid2});
+ */
+class AttributeFilter {
+  public:
+    /// \brief Only elements with one of the section types in `types`.
+    inline AttributeFilter& section_types(const std::vector<SectionType>& types);
+
+    /// \brief Only elements with gid in `[low, high)`.
+    inline AttributeFilter& gid_range(identifier_t low, identifier_t high) {
+        gid_.restrict_to_range(low, high);
+        return *this;
+    }
+
+    /// \brief Only elements with one of the `gids`.
+    inline AttributeFilter& gids(std::vector<identifier_t> gids) {
+        gid_.restrict_to(std::move(gids));
+        return *this;
+    }
+
+    /// \brief Only synapses with `pre_gid` in `[low, high)`.
+    inline AttributeFilter& pre_gid_range(identifier_t low, identifier_t high) {
+        pre_gid_.restrict_to_range(low, high);
+        return *this;
+    }
+
+    /// \brief Only synapses with one of the `pre_gids`.
+    inline AttributeFilter& pre_gids(std::vector<identifier_t> pre_gids) {
+        pre_gid_.restrict_to(std::move(pre_gids));
+        return *this;
+    }
+
+    /// \brief Only synapses with `post_gid` in `[low, high)`.
+    inline AttributeFilter& post_gid_range(identifier_t low, identifier_t high) {
+        post_gid_.restrict_to_range(low, high);
+        return *this;
+    }
+
+    /// \brief Only synapses with one of the `post_gids`.
+    inline AttributeFilter& post_gids(std::vector<identifier_t> post_gids) {
+        post_gid_.restrict_to(std::move(post_gids));
+        return *this;
+    }
+
+    /// \brief Does every element match.
+    inline bool selects_all() const {
+        return section_type_mask_ == all_section_types && gid_.selects_all()
+               && pre_gid_.selects_all() && post_gid_.selects_all();
+    }
+
+    /// \brief Does `value` match.
+    template <class T>
+    inline bool operator()(const T& value) const;
+
+    template <class... Ts>
+    inline bool operator()(const boost::variant<Ts...>& value) const {
+        return boost::apply_visitor([this](const auto& v) { return (*this)(v); }, value);
+    }
+
+  private:
+    static constexpr std::uint32_t all_section_types = ~std::uint32_t(0);
+
+    std::uint32_t section_type_mask_ = all_section_types;
+    IdSelection gid_;
+    IdSelection pre_gid_;
+    IdSelection post_gid_;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/attribute_filter.hpp"
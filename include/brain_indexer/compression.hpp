@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <brain_indexer/native_rtree.hpp>
+#include <brain_indexer/point3d.hpp>
+
+
+namespace brain_indexer {
+
+/// \brief Trees are stored exactly as written by `save_rtree`.
+struct NoCompression {
+    static constexpr auto name = "none";
+};
+
+#if SI_ZSTD == 1
+/** \brief Trees are compressed with zstd.
+ *
+ *  Before compressing, the bytes are shuffled with a stride of
+ *  `sizeof(CoordType)`, see `detail::shuffle_bytes`. This groups e.g. the
+ *  sign and exponent bytes of the coordinates, which compress much better
+ *  than the interleaved bytes.
+ *
+ *  Requires building with `SI_ZSTD`.
+ */
+struct ZstdCompression {
+    static constexpr auto name = "zstd";
+    static constexpr std::uint64_t codec_id = 1;
+
+    /// The compression level; low levels decompress the fastest.
+    static constexpr int level = 3;
+
+    static inline std::string compress(const std::string& raw);
+};
+#endif
+
+/** \brief Write `tree` to `os` compressed with `Codec`.
+ *
+ *  The tree is serialized with `save_rtree` and then written as a single
+ *  self-describing block, i.e. the reader doesn't need to know the codec.
+ *  With `NoCompression` this is the same as `save_rtree`.
+ */
+template <class Codec, class Tree>
+inline void save_compressed_rtree(const Tree& tree, std::ostream& os);
+
+/** \brief Read a tree written by `save_compressed_rtree` or `save_rtree`.
+ *
+ *  \throws std::runtime_error if the tree was compressed with a codec this
+ *  build doesn't support.
+ */
+template <class Tree>
+inline void load_compressed_rtree(Tree& tree, std::istream& is);
+
+/** \brief Does `is` start with a compressed block.
+ *
+ *  The position of the stream is left unchanged.
+ */
+inline bool is_compressed_block(std::istream& is);
+
+
+namespace detail {
+
+/** \brief Transpose the bytes of `data` with the given stride.
+ *
+ *  Byte `b` of element `i` is moved to `b * n_elements + i`. Trailing bytes
+ *  which don't form a whole element are kept as they are.
+ */
+inline std::string shuffle_bytes(const std::string& data, size_t stride);
+
+/// \brief The inverse of `shuffle_bytes`.
+inline std::string unshuffle_bytes(const std::string& data, size_t stride);
+
+} // namespace detail
+
+} // namespace brain_indexer
+
+#include "detail/compression.hpp"
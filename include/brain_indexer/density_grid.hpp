@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+
+namespace brain_indexer {
+
+/// \brief How `density_grid` attributes the elements to the cells.
+enum class DensityAccuracy {
+    /// Every element in the grid is visited.
+    exact,
+    /// Nodes no larger than a cell are estimated, rather than visited.
+    approximate
+};
+
+/** \brief The number and total length of the elements in each cell of a regular grid.
+ *
+ *  The grid divides `box` into `resolution[0] x resolution[1] x resolution[2]`
+ *  cells of equal size, stored with `z` varying fastest, see `cell_index`.
+ *  An element belongs to the cell which contains the center of its bounding
+ *  box; the upper faces of `box` belong to the last cells.
+ */
+struct DensityGrid {
+    inline DensityGrid() = default;
+
+    /// \throws std::invalid_argument if the resolution is `0` along any axis.
+    inline DensityGrid(const Box3D& box, const std::array<size_t, 3>& resolution);
+
+    inline size_t n_cells() const {
+        return counts.size();
+    }
+
+    inline Point3D cell_size() const;
+
+    inline size_t cell_index(size_t i, size_t j, size_t k) const {
+        return (i * resolution[1] + j) * resolution[2] + k;
+    }
+
+    /// \brief The cell which contains `p`; false if `p` is outside of `box`.
+    inline bool find_cell(const Point3D& p, size_t& cell) const;
+
+    /// \brief The number of elements per unit volume of every cell.
+    inline std::vector<double> densities() const;
+
+    /// \brief Adds the counts and lengths of `other`, which must have the same cells.
+    inline DensityGrid& operator+=(const DensityGrid& other);
+
+    Box3D box;
+    std::array<size_t, 3> resolution = {0, 0, 0};
+
+    /// \brief The number of elements of every cell.
+    std::vector<size_t> counts;
+
+    /// \brief The sum of `characteristic_length` of the elements, e.g. the lengths of segments.
+    std::vector<double> lengths;
+};
+
+/** \brief The number and total length of the elements of `index` on a grid.
+ *
+ *  With `DensityAccuracy::exact` every element in `box` is visited. With
+ *  `DensityAccuracy::approximate`, a node which lies in `box` and is no
+ *  larger than a cell isn't descended: all its elements are attributed to
+ *  the cell containing the center of the node; hence an element can be off
+ *  by one cell. The count is that of the node, as in `find_level_of_detail`.
+ *  The length is estimated from the mean length of the elements in the
+ *  leftmost leaf below the node. For a multi-index, such subtrees aren't
+ *  loaded at all; their length is estimated from the mean length of all
+ *  other elements.
+ *
+ *  The nodes are split across `n_threads` threads, each of which adds to
+ *  its own copy of the grid. The subtrees of a multi-index are loaded one
+ *  after the other.
+ *
+ *  The index can be an `IndexTree`, a `PackedIndexTree` or a
+ *  `MultiIndexTree`.
+ */
+template <class Index>
+inline DensityGrid density_grid(const Index& index,
+                                const Box3D& box,
+                                const std::array<size_t, 3>& resolution,
+                                DensityAccuracy accuracy = DensityAccuracy::exact,
+                                size_t n_threads = 1);
+
+}  // namespace brain_indexer
+
+#include "detail/density_grid.hpp"
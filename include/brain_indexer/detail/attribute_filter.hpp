@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+namespace brain_indexer {
+
+namespace detail {
+
+template <class T, class Enable = void>
+struct has_section_type_attribute : std::false_type {};
+
+template <class T>
+struct has_section_type_attribute<
+    T, std::void_t<decltype(std::declval<const T&>().section_type())>> : std::true_type {};
+
+template <class T, class Enable = void>
+struct has_gid_attribute : std::false_type {};
+
+template <class T>
+struct has_gid_attribute<T, std::void_t<decltype(std::declval<const T&>().gid())>>
+    : std::true_type {};
+
+template <class T, class Enable = void>
+struct has_synapse_attributes : std::false_type {};
+
+template <class T>
+struct has_synapse_attributes<T, std::void_t<decltype(std::declval<const T&>().pre_gid()),
+                                             decltype(std::declval<const T&>().post_gid())>>
+    : std::true_type {};
+
+template <class T>
+inline SectionType section_type_attribute(const T& value) {
+    if constexpr (has_section_type_attribute<T>::value) {
+        return value.section_type();
+    } else if constexpr (std::is_same<T, Soma>::value) {
+        return SectionType::soma;
+    } else {
+        return SectionType::undefined;
+    }
+}
+
+inline std::uint32_t section_type_bit(SectionType section_type) {
+    return std::uint32_t(1) << static_cast<unsigned>(section_type);
+}
+
+}  // namespace detail
+
+
+inline void IdSelection::restrict_to_range(identifier_t low, identifier_t high) {
+    low_ = std::max(low_, low);
+    high_ = std::min(high_, high);
+}
+
+inline void IdSelection::restrict_to(std::vector<identifier_t> ids) {
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    if(has_ids_) {
+        auto common = std::vector<identifier_t>{};
+        std::set_intersection(ids_.begin(), ids_.end(), ids.begin(), ids.end(),
+                              std::back_inserter(common));
+        ids = std::move(common);
+    }
+
+    ids_ = std::move(ids);
+    has_ids_ = true;
+}
+
+inline bool IdSelection::contains(identifier_t id) const {
+    if(id < low_ || id >= high_) {
+        return false;
+    }
+
+    return !has_ids_ || std::binary_search(ids_.begin(), ids_.end(), id);
+}
+
+
+inline AttributeFilter& AttributeFilter::section_types(const std::vector<SectionType>& types) {
+    std::uint32_t mask = 0;
+    for(auto section_type : types) {
+        mask |= detail::section_type_bit(section_type);
+    }
+
+    section_type_mask_ &= mask;
+    return *this;
+}
+
+template <class T>
+inline bool AttributeFilter::operator()(const T& value) const {
+    if((section_type_mask_ & detail::section_type_bit(detail::section_type_attribute(value))) == 0) {
+        return false;
+    }
+
+    if constexpr (detail::has_synapse_attributes<T>::value) {
+        return gid_.contains(value.post_gid())
+               && post_gid_.contains(value.post_gid())
+               && pre_gid_.contains(value.pre_gid());
+    } else if constexpr (detail::has_gid_attribute<T>::value) {
+        return gid_.contains(value.gid())
+               && pre_gid_.selects_all()
+               && post_gid_.selects_all();
+    } else {
+        return gid_.selects_all() && pre_gid_.selects_all() && post_gid_.selects_all();
+    }
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+#include <boost/interprocess/streams/bufferstream.hpp>
+
+#if SI_ZSTD == 1
+#include <zstd.h>
+#endif
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief Header of the blocks written by `save_compressed_rtree`.
+struct CompressedBlockHeader {
+    static constexpr std::uint64_t current_version = 1;
+
+    char magic[8];
+    std::uint64_t version;
+    std::uint64_t codec_id;
+    std::uint64_t shuffle_stride;
+    std::uint64_t n_raw_bytes;
+    std::uint64_t n_compressed_bytes;
+};
+
+static constexpr char compressed_block_magic[8] = {'S', 'I', 'C', 'O', 'M', 'P', 'R', 'S'};
+
+
+inline std::string shuffle_bytes(const std::string& data, size_t stride) {
+    auto shuffled = data;
+    auto n_elements = data.size() / stride;
+
+    for(size_t i = 0; i < n_elements; ++i) {
+        for(size_t b = 0; b < stride; ++b) {
+            shuffled[b * n_elements + i] = data[i * stride + b];
+        }
+    }
+
+    return shuffled;
+}
+
+inline std::string unshuffle_bytes(const std::string& data, size_t stride) {
+    auto unshuffled = data;
+    auto n_elements = data.size() / stride;
+
+    for(size_t i = 0; i < n_elements; ++i) {
+        for(size_t b = 0; b < stride; ++b) {
+            unshuffled[i * stride + b] = data[b * n_elements + i];
+        }
+    }
+
+    return unshuffled;
+}
+
+inline std::runtime_error invalid_compressed_block(const std::string& reason) {
+    return std::runtime_error("Invalid compressed block: " + reason);
+}
+
+#if SI_ZSTD == 1
+inline std::string zstd_decompress(const std::string& compressed, size_t n_raw_bytes) {
+    auto raw = std::string(n_raw_bytes, '\0');
+    auto n_bytes = ZSTD_decompress(raw.data(), raw.size(),
+                                   compressed.data(), compressed.size());
+
+    if(ZSTD_isError(n_bytes)) {
+        throw invalid_compressed_block(ZSTD_getErrorName(n_bytes));
+    }
+
+    if(n_bytes != n_raw_bytes) {
+        throw invalid_compressed_block("wrong decompressed size");
+    }
+
+    return raw;
+}
+#endif
+
+/// \brief Read a block written by `save_compressed_rtree` and decompress it.
+inline std::string read_compressed_block(std::istream& is) {
+    using header_t = CompressedBlockHeader;
+
+    auto header = header_t{};
+    if(!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw invalid_compressed_block("the header is truncated");
+    }
+
+    if(std::memcmp(header.magic, compressed_block_magic, sizeof(header.magic)) != 0) {
+        throw invalid_compressed_block("wrong magic number");
+    }
+
+    if(header.version != header_t::current_version) {
+        throw invalid_compressed_block("unsupported version " + std::to_string(header.version));
+    }
+
+    if(header.shuffle_stride == 0) {
+        throw invalid_compressed_block("invalid shuffle stride");
+    }
+
+    auto compressed = std::string(header.n_compressed_bytes, '\0');
+    if(!is.read(compressed.data(), std::streamsize(compressed.size()))) {
+        throw invalid_compressed_block("the data is truncated");
+    }
+
+#if SI_ZSTD == 1
+    if(header.codec_id == ZstdCompression::codec_id) {
+        auto shuffled = zstd_decompress(compressed, header.n_raw_bytes);
+        return unshuffle_bytes(shuffled, header.shuffle_stride);
+    }
+#endif
+
+    auto msg = boost::format(
+        "unsupported codec %d. Was BrainIndexer built without compression, e.g. SI_ZSTD?"
+    ) % header.codec_id;
+    throw invalid_compressed_block(msg.str());
+}
+
+} // namespace detail
+
+
+#if SI_ZSTD == 1
+inline std::string ZstdCompression::compress(const std::string& raw) {
+    auto compressed = std::string(ZSTD_compressBound(raw.size()), '\0');
+    auto n_bytes = ZSTD_compress(compressed.data(), compressed.size(),
+                                 raw.data(), raw.size(),
+                                 level);
+
+    if(ZSTD_isError(n_bytes)) {
+        throw std::runtime_error(std::string("zstd failed: ") + ZSTD_getErrorName(n_bytes));
+    }
+
+    compressed.resize(n_bytes);
+    return compressed;
+}
+#endif
+
+
+template <class Codec, class Tree>
+inline void save_compressed_rtree(const Tree& tree, std::ostream& os) {
+    if constexpr (std::is_same<Codec, NoCompression>::value) {
+        save_rtree(tree, os);
+    } else {
+        using header_t = detail::CompressedBlockHeader;
+
+        auto oss = std::ostringstream{};
+        save_rtree(tree, oss);
+        auto raw = oss.str();
+
+        auto stride = sizeof(CoordType);
+        auto compressed = Codec::compress(detail::shuffle_bytes(raw, stride));
+
+        auto header = header_t{};
+        std::memcpy(header.magic, detail::compressed_block_magic, sizeof(header.magic));
+        header.version = header_t::current_version;
+        header.codec_id = Codec::codec_id;
+        header.shuffle_stride = stride;
+        header.n_raw_bytes = raw.size();
+        header.n_compressed_bytes = compressed.size();
+
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(compressed.data(), std::streamsize(compressed.size()));
+
+        if(!os) {
+            throw std::runtime_error("Failed to write compressed R-tree.");
+        }
+    }
+}
+
+
+template <class Tree>
+inline void load_compressed_rtree(Tree& tree, std::istream& is) {
+    if(!is_compressed_block(is)) {
+        load_rtree(tree, is);
+        return;
+    }
+
+    auto raw = detail::read_compressed_block(is);
+    boost::interprocess::ibufferstream ibs(raw.data(), raw.size());
+    load_rtree(tree, ibs);
+}
+
+
+inline bool is_compressed_block(std::istream& is) {
+    auto position = is.tellg();
+
+    char magic[sizeof(detail::compressed_block_magic)] = {};
+    is.read(magic, sizeof(magic));
+    auto is_compressed = bool(is)
+        && std::memcmp(magic, detail::compressed_block_magic, sizeof(magic)) == 0;
+
+    is.clear();
+    is.seekg(position);
+
+    return is_compressed;
+}
+
+} // namespace brain_indexer
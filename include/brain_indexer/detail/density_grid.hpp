@@ -0,0 +1,360 @@
+#pragma once
+
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/detail/tree_nodes.hpp>
+#include <brain_indexer/level_of_detail.hpp>
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+
+inline DensityGrid::DensityGrid(const Box3D& box, const std::array<size_t, 3>& resolution)
+    : box(box)
+    , resolution(resolution) {
+    if(resolution[0] == 0 || resolution[1] == 0 || resolution[2] == 0) {
+        throw std::invalid_argument("The resolution of a density grid must be positive.");
+    }
+
+    auto n_cells = resolution[0] * resolution[1] * resolution[2];
+    counts.assign(n_cells, 0);
+    lengths.assign(n_cells, 0.0);
+}
+
+inline Point3D DensityGrid::cell_size() const {
+    auto extent = detail::coordinates(Point3Dx(box.max_corner()) - box.min_corner());
+    return Point3D{extent[0] / CoordType(resolution[0]),
+                   extent[1] / CoordType(resolution[1]),
+                   extent[2] / CoordType(resolution[2])};
+}
+
+inline bool DensityGrid::find_cell(const Point3D& p, size_t& cell) const {
+    auto x = detail::coordinates(p);
+    auto low = detail::coordinates(box.min_corner());
+    auto high = detail::coordinates(box.max_corner());
+    auto size = detail::coordinates(cell_size());
+
+    size_t ijk[3];
+    for(size_t d = 0; d < 3; ++d) {
+        if(!(x[d] >= low[d] && x[d] <= high[d])) {
+            return false;
+        }
+
+        auto i = size[d] > 0 ? size_t(std::floor((x[d] - low[d]) / size[d])) : size_t(0);
+        ijk[d] = std::min(i, resolution[d] - 1);
+    }
+
+    cell = cell_index(ijk[0], ijk[1], ijk[2]);
+    return true;
+}
+
+inline std::vector<double> DensityGrid::densities() const {
+    auto size = detail::coordinates(cell_size());
+    auto cell_volume = double(size[0]) * double(size[1]) * double(size[2]);
+
+    auto result = std::vector<double>(n_cells(), 0.0);
+    if(cell_volume > 0) {
+        for(size_t i = 0; i < n_cells(); ++i) {
+            result[i] = double(counts[i]) / cell_volume;
+        }
+    }
+
+    return result;
+}
+
+inline DensityGrid& DensityGrid::operator+=(const DensityGrid& other) {
+    for(size_t i = 0; i < n_cells(); ++i) {
+        counts[i] += other.counts[i];
+        lengths[i] += other.lengths[i];
+    }
+
+    return *this;
+}
+
+
+namespace detail {
+
+template <class T, class Enable = void>
+struct has_characteristic_length : std::false_type {};
+
+template <class T>
+struct has_characteristic_length<
+    T, std::void_t<decltype(characteristic_length(std::declval<const T&>()))>>
+    : std::true_type {};
+
+/// \brief The `characteristic_length` of `value`; `0` if it doesn't have one, e.g. a point.
+template <class T>
+inline double element_length(const T& value) {
+    if constexpr (has_characteristic_length<T>::value) {
+        return double(characteristic_length(value));
+    } else {
+        return 0.0;
+    }
+}
+
+inline Point3D box_center(const Box3D& box) {
+    auto center = Point3D{};
+    bg::centroid(box, center);
+    return center;
+}
+
+/// \brief Is `box` estimated as a whole, see `DensityAccuracy::approximate`.
+inline bool is_density_estimated(const DensityGrid& grid,
+                                 const Box3D& box,
+                                 DensityAccuracy accuracy) {
+    if(accuracy != DensityAccuracy::approximate || !bg::covered_by(box, grid.box)) {
+        return false;
+    }
+
+    auto extent = detail::coordinates(Point3Dx(box.max_corner()) - box.min_corner());
+    auto size = detail::coordinates(grid.cell_size());
+    return extent[0] <= size[0] && extent[1] <= size[1] && extent[2] <= size[2];
+}
+
+/// \brief Adds `count` elements of total `length` at `p`.
+inline void add_to_density_grid(DensityGrid& grid, const Point3D& p, size_t count, double length) {
+    size_t cell = 0;
+    if(grid.find_cell(p, cell)) {
+        grid.counts[cell] += count;
+        grid.lengths[cell] += length;
+    }
+}
+
+/// \brief The mean `element_length` of the values in the leftmost leaf below `n`.
+template <class Nodes>
+inline double leftmost_mean_length(const Nodes& nodes, typename Nodes::node_type n) {
+    while(!nodes.is_leaf(n)) {
+        bool is_first = true;
+        nodes.for_each_child(n, [&](const Box3D& /* box */, const auto& child) {
+            if(is_first) {
+                n = child;
+                is_first = false;
+            }
+        });
+    }
+
+    size_t count = 0;
+    double length = 0.0;
+    nodes.for_each_value(n, [&](const auto& value) {
+        length += element_length(value);
+        ++count;
+    });
+
+    return count == 0 ? 0.0 : length / double(count);
+}
+
+
+/// \brief Adds the elements of one tree to a `DensityGrid`, see `density_grid`.
+template <class Nodes>
+class DensityGridTraversal {
+  public:
+    using node_type = typename Nodes::node_type;
+    using value_type = typename Nodes::value_type;
+
+    inline DensityGridTraversal(const Nodes& nodes, DensityAccuracy accuracy)
+        : nodes_(nodes)
+        , accuracy_(accuracy) {}
+
+    inline void visit(const node_type& node, const Box3D& box, DensityGrid& grid) const {
+        if(!bg::intersects(box, grid.box)) {
+            return;
+        }
+
+        if(is_density_estimated(grid, box, accuracy_)) {
+            auto count = count_values_below(nodes_, node, CountValues{});
+            auto length = double(count) * leftmost_mean_length(nodes_, node);
+            add_to_density_grid(grid, box_center(box), count, length);
+        } else if(nodes_.is_leaf(node)) {
+            nodes_.for_each_value(node, [&grid](const value_type& value) {
+                auto center = box_center(Box3D(bgi::indexable<value_type>{}(value)));
+                add_to_density_grid(grid, center, 1, element_length(value));
+            });
+        } else {
+            nodes_.for_each_child(node, [this, &grid](const Box3D& child_box,
+                                                      const node_type& child) {
+                visit(child, child_box, grid);
+            });
+        }
+    }
+
+    /** \brief Adds all elements to `partials`, one grid per thread.
+     *
+     *  The tree is split into at least `4 * n_threads` nodes, where
+     *  possible; which are visited in parallel. Every task borrows one of
+     *  the grids for as long as it runs.
+     */
+    inline void visit_all(std::vector<DensityGrid>& partials) const {
+        if(nodes_.empty()) {
+            return;
+        }
+
+        const auto& grid = partials.front();
+        auto n_threads = partials.size();
+
+        auto level = std::vector<std::pair<Box3D, node_type>>{{nodes_.bounds(), nodes_.root()}};
+        auto next = std::vector<std::pair<Box3D, node_type>>{};
+        bool is_expanded = true;
+        while(is_expanded && level.size() < 4 * n_threads) {
+            is_expanded = false;
+            next.clear();
+            for(const auto& [box, node] : level) {
+                if(!bg::intersects(box, grid.box)) {
+                    continue;
+                }
+
+                if(nodes_.is_leaf(node) || is_density_estimated(grid, box, accuracy_)) {
+                    next.emplace_back(box, node);
+                } else {
+                    nodes_.for_each_child(node, [&next](const Box3D& child_box,
+                                                        const node_type& child) {
+                        next.emplace_back(child_box, child);
+                    });
+                    is_expanded = true;
+                }
+            }
+            std::swap(level, next);
+        }
+
+        auto free_grids = std::vector<size_t>{};
+        for(size_t i = 0; i < n_threads; ++i) {
+            free_grids.push_back(i);
+        }
+        std::mutex mutex;
+
+        util::parallel_for(level.size(), n_threads, [&](size_t k) {
+            size_t i = 0;
+            {
+                auto guard = std::lock_guard<std::mutex>(mutex);
+                i = free_grids.back();
+                free_grids.pop_back();
+            }
+
+            visit(level[k].second, level[k].first, partials[i]);
+
+            auto guard = std::lock_guard<std::mutex>(mutex);
+            free_grids.push_back(i);
+        });
+    }
+
+  private:
+    const Nodes& nodes_;
+    DensityAccuracy accuracy_;
+};
+
+template <class Nodes>
+inline void add_tree_to_density_grid(const Nodes& nodes,
+                                     DensityAccuracy accuracy,
+                                     std::vector<DensityGrid>& partials) {
+    DensityGridTraversal<Nodes>(nodes, accuracy).visit_all(partials);
+}
+
+inline DensityGrid sum_density_grids(std::vector<DensityGrid>& partials) {
+    auto grid = std::move(partials.front());
+    for(size_t i = 1; i < partials.size(); ++i) {
+        grid += partials[i];
+    }
+
+    return grid;
+}
+
+
+/// \brief `density_grid` of a multi-index.
+struct MultiIndexDensityGrid {
+    /** \brief Subtrees which are estimated as a whole aren't loaded.
+     *
+     *  Their length is estimated from the mean length of all other
+     *  elements; if there are none, from the first estimated subtree.
+     */
+    template <class T, class SubtreeCache>
+    static inline DensityGrid compute(const MultiIndexTree<T, SubtreeCache>& index,
+                                      const DensityGrid& empty_grid,
+                                      DensityAccuracy accuracy,
+                                      size_t n_threads) {
+        using subtree_id_type = typename MultiIndexTree<T, SubtreeCache>::toptree_type::value_type;
+
+        auto to_load = std::vector<subtree_id_type>{};
+        auto estimated = std::vector<subtree_id_type>{};
+        for(const auto& subtree : index.top_rtree) {
+            auto box = Box3D(subtree.bounding_box());
+            if(!bg::intersects(box, empty_grid.box)) {
+                continue;
+            }
+
+            if(is_density_estimated(empty_grid, box, accuracy)) {
+                estimated.push_back(subtree);
+            } else {
+                to_load.push_back(subtree);
+            }
+        }
+
+        auto partials = std::vector<DensityGrid>(std::max(n_threads, size_t(1)), empty_grid);
+        index.for_each_subtree(to_load, [&](const auto& subtree) {
+            add_tree_to_density_grid(make_tree_nodes(subtree), accuracy, partials);
+        });
+        auto grid = sum_density_grids(partials);
+
+        if(!estimated.empty()) {
+            size_t total_count = 0;
+            double total_length = 0.0;
+            for(size_t i = 0; i < grid.n_cells(); ++i) {
+                total_count += grid.counts[i];
+                total_length += grid.lengths[i];
+            }
+
+            auto mean_length = total_count == 0 ? 0.0 : total_length / double(total_count);
+            if(total_count == 0) {
+                const auto& subtree = index.load_subtree(estimated.front());
+                auto nodes = make_tree_nodes(deref_subtree(subtree));
+                if(!nodes.empty()) {
+                    mean_length = leftmost_mean_length(nodes, nodes.root());
+                }
+            }
+
+            for(const auto& subtree : estimated) {
+                auto center = box_center(Box3D(subtree.bounding_box()));
+                add_to_density_grid(grid, center, subtree.n_elements,
+                                    double(subtree.n_elements) * mean_length);
+            }
+        }
+
+        ++index.query_count;
+        return grid;
+    }
+};
+
+
+template <class Index>
+inline DensityGrid density_grid_impl(const Index& index,
+                                     const DensityGrid& empty_grid,
+                                     DensityAccuracy accuracy,
+                                     size_t n_threads) {
+    auto partials = std::vector<DensityGrid>(std::max(n_threads, size_t(1)), empty_grid);
+    add_tree_to_density_grid(make_tree_nodes(index), accuracy, partials);
+    return sum_density_grids(partials);
+}
+
+template <class T, class SubtreeCache>
+inline DensityGrid density_grid_impl(const MultiIndexTree<T, SubtreeCache>& index,
+                                     const DensityGrid& empty_grid,
+                                     DensityAccuracy accuracy,
+                                     size_t n_threads) {
+    return MultiIndexDensityGrid::compute(index, empty_grid, accuracy, n_threads);
+}
+
+}  // namespace detail
+
+
+template <class Index>
+inline DensityGrid density_grid(const Index& index,
+                                const Box3D& box,
+                                const std::array<size_t, 3>& resolution,
+                                DensityAccuracy accuracy,
+                                size_t n_threads) {
+    return detail::density_grid_impl(index, DensityGrid(box, resolution), accuracy, n_threads);
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace brain_indexer {
+
+inline StreamingHistogram::StreamingHistogram(std::vector<CoordType> bins)
+    : bins_(std::move(bins))
+    , counts_(bins_.size(), 0ul) {
+    if(bins_.empty()) {
+        throw std::invalid_argument("A histogram needs at least one bin.");
+    }
+}
+
+inline StreamingHistogram StreamingHistogram::log10(CoordType log10_low,
+                                                    CoordType log10_high,
+                                                    size_t bins_per_decade) {
+    auto histogram = StreamingHistogram(log10_bins(log10_low, log10_high, bins_per_decade));
+    histogram.log10_low_ = log10_low;
+    histogram.bins_per_decade_ = bins_per_decade;
+
+    return histogram;
+}
+
+inline size_t StreamingHistogram::find_bin(CoordType x) const {
+    auto n_bins = bins_.size();
+    if(bins_per_decade_ == 0) {
+        auto it = std::upper_bound(bins_.begin(), bins_.end(), x);
+        return std::min(size_t(it - bins_.begin()), n_bins - 1);
+    }
+
+    size_t i = 0;
+    if(x > CoordType(0)) {
+        auto k = std::floor((std::log10(double(x)) - double(log10_low_)) * double(bins_per_decade_));
+        i = k < 0.0 ? 0 : size_t(std::min(k + 1.0, double(n_bins - 1)));
+    }
+
+    // The logarithm is rounded; which can put `x` next to the right bin.
+    while(i > 0 && x < bins_[i-1]) {
+        --i;
+    }
+    while(i + 1 < n_bins && !(x < bins_[i])) {
+        ++i;
+    }
+
+    return i;
+}
+
+inline void StreamingHistogram::add(CoordType x) {
+    ++counts_[find_bin(x)];
+}
+
+inline void StreamingHistogram::reduce(MPI_Comm comm) {
+    auto mpi_rank = mpi::rank(comm);
+
+    MPI_Reduce(
+        (mpi_rank == 0) ? MPI_IN_PLACE : counts_.data(),
+        counts_.data(),
+        util::safe_integer_cast<int>(counts_.size()),
+        mpi::datatype<size_t>(),
+        MPI_SUM,
+        0,
+        comm
+    );
+
+    if(mpi_rank != 0) {
+        std::fill(counts_.begin(), counts_.end(), 0ul);
+    }
+}
+
+
+template <class Storage, class... Reducers>
+inline void reduce_elements(const Storage& storage, MPI_Comm comm, Reducers&... reducers) {
+    auto top_tree = storage.load_top_tree();
+
+    // The ids needn't be contiguous, e.g. after `remove_from_multi_index`.
+    // Every rank reads the same top-level tree; hence, the same order.
+    auto subtrees = std::vector<IndexedSubtreeBox>(top_tree.begin(), top_tree.end());
+    auto n_elements = std::vector<size_t>{};
+    n_elements.reserve(subtrees.size());
+    for(const auto& subtree : subtrees) {
+        n_elements.push_back(subtree.n_elements);
+    }
+
+    auto comm_size = size_t(mpi::size(comm));
+    auto comm_rank = size_t(mpi::rank(comm));
+    auto chunk = util::balanced_chunks(n_elements, comm_size, comm_rank);
+
+    auto load_async = [&storage, &subtrees](size_t i) {
+        auto subtree_id = subtrees[i].id;
+        return std::async(std::launch::async, [&storage, subtree_id]() {
+            return storage.load_subtree(subtree_id);
+        });
+    };
+
+    using subtree_type = typename Storage::subtree_type;
+    auto next = std::future<subtree_type>{};
+    if(chunk.low < chunk.high) {
+        next = load_async(chunk.low);
+    }
+
+    for(size_t i = chunk.low; i < chunk.high; ++i) {
+        log_info("loading: %d", subtrees[i].id);
+        auto subtree = next.get();
+        if(i + 1 < chunk.high) {
+            next = load_async(i + 1);
+        }
+
+        for(const auto& value : subtree) {
+            (reducers(value), ...);
+        }
+    }
+
+    (reducers.reduce(comm), ...);
+}
+
+
+inline std::vector<size_t> histogram(const std::vector<CoordType>& bins,
+                                     const std::vector<CoordType>& data,
+                                     MPI_Comm comm) {
+
+    auto histogram = StreamingHistogram(bins);
+    for(auto x : data) {
+        histogram.add(x);
+    }
+    histogram.reduce(comm);
+
+    return (mpi::rank(comm) == 0) ? histogram.counts() : std::vector<size_t>{};
+}
+
+
+inline std::vector<CoordType> log10_bins(CoordType log10_low,
+                                         CoordType log10_high,
+                                         size_t bins_per_decade) {
+
+    auto n_decades = log10_high - log10_low;
+    auto n_bins = 2 + bins_per_decade * n_decades;
+    auto bin_width = CoordType(1.0) / bins_per_decade;
+    auto bins = std::vector<CoordType>(n_bins);
+
+    for(size_t i = 0; i < n_bins-1; ++i) {
+        bins[i] = std::pow(
+            CoordType(10.0),
+            CoordType(log10_low + i * bin_width)
+        );
+    }
+    bins[n_bins-1] = std::numeric_limits<CoordType>::max();
+
+    return bins;
+}
+
+
+inline void segment_length_histogram(const std::string &output_dir, MPI_Comm comm) {
+    auto reducer = make_histogram_reducer(
+        StreamingHistogram::log10(CoordType(-8), CoordType(6), 4ul),
+        [](const MorphoEntry& value) { return characteristic_length(value); }
+    );
+    auto storage = open_multi_index_storage<NativeStorageT<MorphoEntry>>(output_dir);
+    reduce_elements(storage, comm, reducer);
+
+    MPI_Barrier(comm);
+
+    if(mpi::rank(comm) == 0) {
+        const auto& bins = reducer.histogram().bins();
+        const auto& counts = reducer.histogram().counts();
+
+        std::cout << std::setprecision(4) << std::scientific;
+        std::cout << "[      -inf, " << bins[0] << "): " << counts[0] << "\n";
+        for(size_t i = 1; i < bins.size()-1; ++i) {
+            std::cout << "[" << bins[i-1] << ", " << bins[i] << "): "  << counts[i] << "\n";
+        }
+        std::cout << "[" << bins[bins.size()-2] << ",        inf): " << counts.back() << "\n";
+    }
+}
+
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief A query, sent to the owner of a subtree it touches.
+template <class ShapeT>
+struct RoutedQuery {
+    std::uint64_t query;
+    ShapeT shape;
+};
+
+/// \brief A match, sent back to the rank which issued the query.
+template <class T>
+struct RoutedMatch {
+    std::uint64_t query;
+    T value;
+};
+
+/** \brief Sends `send_counts[k]` consecutive entries of `send` to rank `k`.
+ *
+ *  The entries are sent as raw bytes; `recv_counts` is set to the number of
+ *  entries received from every rank.
+ */
+template <class Value>
+inline std::vector<Value> exchange_routed(const std::vector<Value>& send,
+                                          const std::vector<int>& send_counts,
+                                          std::vector<int>& recv_counts,
+                                          MPI_Comm comm) {
+    mpi::assert_counts_are_safe(send_counts, "exchange_routed");
+    recv_counts = mpi::exchange_counts(send_counts, comm);
+
+    auto send_offsets = mpi::offsets_from_counts(send_counts);
+    auto recv_offsets = mpi::offsets_from_counts(recv_counts);
+
+    auto mpi_value = mpi::Datatype(mpi::create_contiguous_datatype<Value>());
+    auto received = std::vector<Value>(size_t(recv_offsets.back()));
+    MPI_Alltoallv(
+        send.data(), send_counts.data(), send_offsets.data(), *mpi_value,
+        received.data(), recv_counts.data(), recv_offsets.data(), *mpi_value,
+        comm
+    );
+
+    return received;
+}
+
+}  // namespace detail
+
+
+template <class T, class SubtreeCache>
+DistributedMultiIndexTree<T, SubtreeCache>::DistributedMultiIndexTree(
+    const std::string& output_dir,
+    size_t max_cached_bytes,
+    MPI_Comm comm)
+    : index_(output_dir, max_cached_bytes)
+    , comm_(comm) {
+
+    auto subtree_ids = std::vector<size_t>{};
+    for(const auto& subtree : index_.top_rtree) {
+        subtree_ids.push_back(size_t(subtree.id));
+    }
+    std::sort(subtree_ids.begin(), subtree_ids.end());
+
+    auto comm_size = mpi::size(comm);
+    auto comm_rank = mpi::rank(comm);
+    for(int rank = 0; rank < comm_size; ++rank) {
+        auto range = util::balanced_chunks(subtree_ids.size(), size_t(comm_size), size_t(rank));
+        for(size_t k = range.low; k < range.high; ++k) {
+            owners_[subtree_ids[k]] = rank;
+            if(rank == comm_rank) {
+                local_subtrees_.push_back(subtree_ids[k]);
+            }
+        }
+    }
+}
+
+
+template <class T, class SubtreeCache>
+template <typename GeometryMode, typename ShapeT>
+inline detail::batch_query_result<T>
+DistributedMultiIndexTree<T, SubtreeCache>::find_intersecting_batch(
+    const std::vector<ShapeT>& shapes,
+    size_t n_threads,
+    query_fields_t fields) const {
+
+    using subtree_id_type = typename index_type::toptree_type::value_type;
+
+    static_assert(std::is_trivially_copyable<ShapeT>::value,
+                  "The shapes are sent as raw bytes.");
+
+    auto comm_size = mpi::size(comm_);
+    auto comm_rank = mpi::rank(comm_);
+
+    // Every query is sent once to each owner of a subtree it touches.
+    auto destinations = std::vector<std::pair<int, size_t>>{};
+    auto touched = std::vector<subtree_id_type>{};
+    auto owners = std::vector<int>{};
+    for(size_t i = 0; i < shapes.size(); ++i) {
+        touched.clear();
+        index_.top_rtree.query(
+            bgi::intersects(bgi::indexable<ShapeT>{}(shapes[i]))
+            && bgi::satisfies(detail::GeometryIntersects<GeometryMode, ShapeT>{shapes[i]}),
+            std::back_inserter(touched)
+        );
+
+        owners.clear();
+        for(const auto& subtree_id : touched) {
+            owners.push_back(owner(size_t(subtree_id.id)));
+        }
+        std::sort(owners.begin(), owners.end());
+        owners.erase(std::unique(owners.begin(), owners.end()), owners.end());
+
+        for(auto rank : owners) {
+            destinations.emplace_back(rank, i);
+        }
+    }
+    std::sort(destinations.begin(), destinations.end());
+
+    auto send_counts = std::vector<int>(size_t(comm_size), 0);
+    auto queries = std::vector<detail::RoutedQuery<ShapeT>>{};
+    queries.reserve(destinations.size());
+    for(const auto& [rank, i] : destinations) {
+        ++send_counts[size_t(rank)];
+        queries.push_back(detail::RoutedQuery<ShapeT>{std::uint64_t(i), shapes[i]});
+    }
+
+    auto recv_counts = std::vector<int>{};
+    auto received = detail::exchange_routed(queries, send_counts, recv_counts, comm_);
+
+    // The queries of all ranks are answered together, but only in the
+    // subtrees owned by this rank.
+    auto local_shapes = std::vector<ShapeT>{};
+    local_shapes.reserve(received.size());
+    for(const auto& query : received) {
+        local_shapes.push_back(query.shape);
+    }
+
+    auto chunk_matches = [&]() {
+        auto stats_scope = index_.query_stats_scope(local_shapes.size());
+        return index_.template find_intersecting_batch_matches<GeometryMode>(
+            local_shapes,
+            [this, comm_rank](size_t subtree_id) { return owner(subtree_id) == comm_rank; },
+            n_threads
+        );
+    }();
+
+    // The matches are sent back to the rank which issued the query.
+    auto recv_offsets = mpi::offsets_from_counts(recv_counts);
+    auto source_of = std::vector<int>(received.size());
+    for(int rank = 0; rank < comm_size; ++rank) {
+        std::fill(source_of.begin() + recv_offsets[size_t(rank)],
+                  source_of.begin() + recv_offsets[size_t(rank) + 1],
+                  rank);
+    }
+
+    auto reply_counts = std::vector<int>(size_t(comm_size), 0);
+    for(const auto& matches : chunk_matches) {
+        for(const auto& match : matches) {
+            ++reply_counts[size_t(source_of[match.first])];
+        }
+    }
+
+    auto reply_offsets = mpi::offsets_from_counts(reply_counts);
+    auto replies = std::vector<detail::RoutedMatch<T>>(size_t(reply_offsets.back()));
+    for(const auto& matches : chunk_matches) {
+        for(const auto& [k, value] : matches) {
+            auto& next = reply_offsets[size_t(source_of[k])];
+            replies[size_t(next++)] = detail::RoutedMatch<T>{received[k].query, value};
+        }
+    }
+    chunk_matches.clear();
+
+    auto n_matches_per_rank = std::vector<int>{};
+    auto results = detail::exchange_routed(replies, reply_counts, n_matches_per_rank, comm_);
+
+    auto local_matches = std::vector<std::vector<std::pair<size_t, T>>>(1);
+    local_matches[0].reserve(results.size());
+    for(const auto& result : results) {
+        local_matches[0].emplace_back(size_t(result.query), result.value);
+    }
+
+    return detail::make_batch_query_result(shapes.size(), local_matches, fields);
+}
+
+}  // namespace brain_indexer
@@ -3,6 +3,10 @@
 
 #include <brain_indexer/distributed_sort_tile_recursion.hpp>
 
+#include <stdexcept>
+
+#include <boost/format.hpp>
+
 namespace brain_indexer {
 
 
@@ -98,25 +102,41 @@ inline std::vector<int> factorize(int n, const std::vector<int>& p){
 }
 
 inline bool is_valid_comm_size(int comm_size) {
-    return is_factorizable(comm_size, {2, 3, 5});
+    return comm_size >= 1;
+}
+
+inline std::vector<int> prime_factors(int n) {
+    auto factors = std::vector<int>{};
+    for(int p = 2; p <= n / p; ++p) {
+        while(n % p == 0) {
+            factors.push_back(p);
+            n = n / p;
+        }
+    }
+
+    if(n > 1) {
+        factors.push_back(n);
+    }
+
+    return factors;
 }
 
 inline std::array<int, 3> rank_distribution(int comm_size) {
-    assert(is_valid_comm_size(comm_size));
+    if(!is_valid_comm_size(comm_size)) {
+        auto msg = boost::format("Invalid MPI communicator size: %d") % comm_size;
+        throw std::invalid_argument(msg.str());
+    }
 
-    auto primes = std::vector<int>{5, 3, 2};
-    auto decomp = factorize(comm_size, primes);
+    auto factors = prime_factors(comm_size);
 
     auto dist = std::array<int, 3>{1, 1, 1};
-    for (int k = 0; k < 3; ++k) {
-        for(int i = 0; i < decomp[k]; ++i) {
-            auto m = std::min(dist[0], std::min(dist[1], dist[2]));
-
-            for(int l = 0; l < 3; ++l) {
-                if(dist[l] == m) {
-                    dist[l] *= primes[k];
-                    break;
-                }
+    for(auto it = factors.rbegin(); it != factors.rend(); ++it) {
+        auto m = std::min(dist[0], std::min(dist[1], dist[2]));
+
+        for(int l = 0; l < 3; ++l) {
+            if(dist[l] == m) {
+                dist[l] *= *it;
+                break;
             }
         }
     }
@@ -138,20 +158,59 @@ inline TwoLevelSTRParams two_level_str_heuristic(size_t n_elements,
 }
 
 
-template <typename Value, typename GetCoordinate>
+template <typename Value, typename GetCoordinate, class Weight>
 void distributed_sort_tile_recursion(std::vector<Value>& values,
                                      const DistributedSTRParams& str_params,
-                                     MPI_Comm mpi_comm) {
+                                     MPI_Comm mpi_comm,
+                                     const Weight& weight) {
     using STR = DistributedSortTileRecursion<Value, GetCoordinate, 0ul>;
-    return STR::apply(values, str_params, mpi_comm);
+    return STR::apply(values, str_params, mpi_comm, weight);
+}
+
+
+template <class Storage>
+inline AsyncSubtreeWriter<Storage>::AsyncSubtreeWriter(const Storage& storage)
+    : storage(storage) {}
+
+template <class Storage>
+inline AsyncSubtreeWriter<Storage>::~AsyncSubtreeWriter() {
+    try {
+        wait();
+    } catch(...) {
+        // The subtree is lost either way; and we might be unwinding already.
+    }
+}
+
+template <class Storage>
+inline void AsyncSubtreeWriter<Storage>::save(subtree_type subtree, size_t subtree_id) {
+    wait();
+
+    // `Storage::save_tree` checks for signals, which is a no-op on any thread
+    // but the one holding the GIL.
+    pending = std::async(
+        std::launch::async,
+        [this, subtree = std::move(subtree), subtree_id]() {
+            storage.save_subtree(subtree, subtree_id);
+        }
+    );
 }
 
+template <class Storage>
+inline void AsyncSubtreeWriter<Storage>::wait() {
+    if(pending.valid()) {
+        // Invalidates `pending`, even if it throws.
+        pending.get();
+    }
+}
 
-template <class GetCenterCoordinate, class Storage, class Value>
+
+template <class GetCenterCoordinate, class Storage, class Value, class Weight>
 void distributed_partition(const Storage& storage,
                            std::vector<Value>& values,
                            const TwoLevelSTRParams& str_params,
-                           MPI_Comm comm) {
+                           MPI_Comm comm,
+                           size_t n_threads,
+                           const Weight& weight) {
 
     if(values.size() < 10ul * mpi::size(comm)) {
         // If needed we need to carefully check that this will work. A
@@ -163,11 +222,14 @@ void distributed_partition(const Storage& storage,
     distributed_sort_tile_recursion<Value, GetCenterCoordinate>(
         values,
         str_params.distributed,
-        comm
+        comm,
+        weight
     );
 
     auto serial_str_params = SerialSTRParams{values.size(), str_params.local.n_parts_per_dim};
-    serial_sort_tile_recursion<Value, GetCenterCoordinate>(values, serial_str_params);
+    parallel_sort_tile_recursion<Value, GetCenterCoordinate>(
+        values, serial_str_params, n_threads
+    );
 
     auto mpi_rank = mpi::rank(comm);
 
@@ -176,6 +238,7 @@ void distributed_partition(const Storage& storage,
     auto local_bounding_boxes = std::vector<IndexedSubtreeBox>();
     local_bounding_boxes.reserve(n_serial_parts);
 
+    auto writer = AsyncSubtreeWriter<Storage>(storage);
     for (size_t k = 0; k < n_serial_parts; ++k) {
         util::check_signals();
         auto subtree = typename Storage::subtree_type(
@@ -184,10 +247,11 @@ void distributed_partition(const Storage& storage,
         );
 
         auto k_part = size_t(mpi_rank) * n_serial_parts + k;
-        storage.save_subtree(subtree, k_part);
-
         local_bounding_boxes.push_back(IndexedSubtreeBox(k_part, subtree.size(), subtree.bounds()));
+
+        writer.save(std::move(subtree), k_part);
     }
+    writer.wait();
 
     util::check_signals();
     auto bounding_boxes = gather_bounding_boxes(local_bounding_boxes, comm);
@@ -204,14 +268,20 @@ void distributed_partition(const Storage& storage,
 
 
 template <typename Value, typename GetCoordinate, size_t dim>
+template <class Weight>
 void DistributedSortTileRecursion<Value, GetCoordinate, dim>::apply(
     std::vector<Value>& values,
     const DistributedSTRParams& str_params,
-    MPI_Comm mpi_comm) {
+    MPI_Comm mpi_comm,
+    const Weight& weight) {
 
     if constexpr (dim < 3) {
         util::check_signals();
-        DistributedMemorySorter<Value, Key>::sort_and_balance(values, mpi_comm);
+        if constexpr (std::is_same<Weight, UnitWeight>::value) {
+            DistributedMemorySorter<Value, Key>::sort_and_balance_once(values, mpi_comm);
+        } else {
+            DistributedMemorySorter<Value, Key>::sort_and_balance(values, mpi_comm, weight);
+        }
 
         if(dim == 2) {
             return;
@@ -223,7 +293,7 @@ void DistributedSortTileRecursion<Value, GetCoordinate, dim>::apply(
         auto sub_comm = mpi::comm_split(mpi_comm, color, k_rank_in_slice);
 
         // 2. Let them do STR.
-        STR<dim+1>::apply(values, str_params, *sub_comm);
+        STR<dim+1>::apply(values, str_params, *sub_comm, weight);
     }
 }
 
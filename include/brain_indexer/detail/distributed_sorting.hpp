@@ -1,5 +1,7 @@
 #pragma once
 
+#include <type_traits>
+
 namespace brain_indexer {
 
 /// \brief Compute the total number of elements across all MPI ranks.
@@ -25,6 +27,38 @@ void node_local_sort(const BeginIt &begin_it, const EndIt &end_it) {
 }
 
 
+namespace detail {
+
+/// \brief Maps a key to an integer with the same order.
+template <class KeyedType>
+inline std::uint64_t ordered_key_bits(KeyedType key) {
+    static_assert(std::is_arithmetic<KeyedType>::value, "The keys must be numbers.");
+
+    if constexpr (std::is_floating_point<KeyedType>::value) {
+        using bits_type = std::conditional_t<sizeof(KeyedType) == 4, std::uint32_t, std::uint64_t>;
+        static_assert(sizeof(KeyedType) == sizeof(bits_type), "Unsupported floating point type.");
+
+        // `-0.0` compares equal to `0.0`, hence they must map to the same bits.
+        if(key == KeyedType(0)) {
+            key = KeyedType(0);
+        }
+
+        // Negative numbers are ordered in reverse, and before all
+        // positive numbers.
+        auto bits = bits_type{};
+        std::memcpy(&bits, &key, sizeof(key));
+        constexpr auto sign = bits_type(1) << (8 * sizeof(bits_type) - 1);
+        return std::uint64_t((bits & sign) != 0 ? ~bits : (bits | sign));
+    } else if constexpr (std::is_signed<KeyedType>::value) {
+        return std::uint64_t(std::int64_t(key)) ^ (std::uint64_t(1) << 63);
+    } else {
+        return std::uint64_t(key);
+    }
+}
+
+}  // namespace detail
+
+
 template<class T, class Key>
 DistributedMemorySorter<T, Key>::DistributedMemorySorter() {
     MPI_Type_contiguous(sizeof(Value), MPI_BYTE, &mpi_value_);
@@ -51,7 +85,6 @@ template<class T, class Key>
 auto DistributedMemorySorter<T, Key>::balance(const Values &values, MPI_Comm comm)
 -> Values {
 
-    auto comm_size = mpi::size(comm);
     auto mpi_rank = mpi::rank(comm);
 
     // We now start working toward exchanging the data using an
@@ -67,6 +100,352 @@ auto DistributedMemorySorter<T, Key>::balance(const Values &values, MPI_Comm com
     //         send to every MPI rank:
     auto send_counts = mpi::compute_balance_send_counts(counts_per_rank, mpi_rank);
 
+    return redistribute(values, send_counts, comm);
+}
+
+
+template<class T, class Key>
+void DistributedMemorySorter<T, Key>::sort_and_balance_once(Values &values,
+                                                            MPI_Comm comm,
+                                                            size_t max_message_size) {
+    auto cmp = [](const Value &a, const Value &b) {
+        return Key::compare(a, b);
+    };
+    node_local_sort(values.begin(), values.end(), cmp);
+
+    DistributedMemorySorter <T, Key> dms;
+    auto split = dms.find_balanced_splits(values, comm);
+    values = dms.exchange_and_merge(values, split, max_message_size, comm);
+}
+
+
+template<class T, class Key>
+auto DistributedMemorySorter<T, Key>::find_balanced_splits(const Values &sorted,
+                                                           MPI_Comm comm)
+-> std::vector<size_t> {
+
+    using detail::ordered_key_bits;
+
+    auto comm_size = size_t(mpi::size(comm));
+    auto n_local = sorted.size();
+
+    // Part `i` must start after `targets[i]` values.
+    auto n_total = sum_local_counts(n_local, comm);
+    auto targets = std::vector<size_t>(comm_size + 1, 0ul);
+    auto balanced_counts = util::balanced_chunk_sizes(n_total, comm_size);
+    std::partial_sum(balanced_counts.begin(), balanced_counts.end(), targets.begin() + 1);
+
+    // The number of local values with a key of at most `bits`.
+    auto count_at_most = [&sorted](std::uint64_t bits) -> std::uint64_t {
+        auto it = std::partition_point(sorted.begin(), sorted.end(), [bits](const Value &v) {
+            return ordered_key_bits(Key::apply(v)) <= bits;
+        });
+        return std::uint64_t(it - sorted.begin());
+    };
+
+    // For every boundary find the smallest key, such that at least
+    // `targets[i]` values have a key of at most that key. All boundaries are
+    // bisected at once; hence, there are at most 64 rounds.
+    auto n_splits = comm_size - 1;
+    auto low = std::vector<std::uint64_t>(n_splits, 0ul);
+    auto high = std::vector<std::uint64_t>(n_splits, std::numeric_limits<std::uint64_t>::max());
+    auto mid = std::vector<std::uint64_t>(n_splits);
+    auto counts = std::vector<std::uint64_t>(n_splits);
+
+    auto is_done = [&]() {
+        for(size_t i = 0; i < n_splits; ++i) {
+            if(low[i] < high[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    while(!is_done()) {
+        for(size_t i = 0; i < n_splits; ++i) {
+            mid[i] = low[i] + (high[i] - low[i]) / 2;
+            counts[i] = count_at_most(mid[i]);
+        }
+
+        MPI_Allreduce(MPI_IN_PLACE, counts.data(), int(n_splits), MPI_UINT64_T, MPI_SUM, comm);
+
+        for(size_t i = 0; i < n_splits; ++i) {
+            if(low[i] < high[i]) {
+                if(counts[i] >= targets[i+1]) {
+                    high[i] = mid[i];
+                } else {
+                    low[i] = mid[i] + 1;
+                }
+            }
+        }
+    }
+
+    // Values with a key below the splitter always precede the boundary; those
+    // with the same key as the splitter are assigned in the order of the ranks.
+    auto n_less = std::vector<std::uint64_t>(n_splits);
+    auto n_equal = std::vector<std::uint64_t>(n_splits);
+    for(size_t i = 0; i < n_splits; ++i) {
+        n_less[i] = low[i] == 0 ? 0 : count_at_most(low[i] - 1);
+        n_equal[i] = count_at_most(low[i]) - n_less[i];
+    }
+
+    auto global_n_less = n_less;
+    auto n_equal_before = std::vector<std::uint64_t>(n_splits, 0ul);
+    MPI_Allreduce(MPI_IN_PLACE, global_n_less.data(), int(n_splits), MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Exscan(n_equal.data(), n_equal_before.data(), int(n_splits), MPI_UINT64_T, MPI_SUM, comm);
+    if(mpi::rank(comm) == 0) {
+        // The value of `MPI_Exscan` on rank 0 is undefined.
+        std::fill(n_equal_before.begin(), n_equal_before.end(), 0ul);
+    }
+
+    auto split = std::vector<size_t>(comm_size + 1, 0ul);
+    for(size_t i = 0; i < n_splits; ++i) {
+        auto n_missing = targets[i+1] - global_n_less[i];
+        auto n_taken = n_missing > n_equal_before[i]
+            ? std::min(n_missing - n_equal_before[i], n_equal[i])
+            : std::uint64_t(0);
+
+        split[i+1] = size_t(n_less[i] + n_taken);
+    }
+    split[comm_size] = n_local;
+
+    return split;
+}
+
+
+template<class T, class Key>
+auto DistributedMemorySorter<T, Key>::exchange_and_merge(const Values &sorted,
+                                                         const std::vector<size_t> &split,
+                                                         size_t max_message_size,
+                                                         MPI_Comm comm) -> Values {
+
+    auto comm_size = size_t(mpi::size(comm));
+    auto mpi_rank = size_t(mpi::rank(comm));
+
+    auto send_counts = std::vector<size_t>(comm_size);
+    for(size_t i = 0; i < comm_size; ++i) {
+        send_counts[i] = split[i+1] - split[i];
+    }
+
+    // Unlike `mpi::exchange_counts`, the counts are `size_t`.
+    auto recv_counts = std::vector<size_t>(comm_size);
+    MPI_Alltoall(send_counts.data(), 1, MPI_SIZE_T, recv_counts.data(), 1, MPI_SIZE_T, comm);
+
+    auto recv_offsets = std::vector<size_t>(comm_size + 1, 0ul);
+    std::partial_sum(recv_counts.begin(), recv_counts.end(), recv_offsets.begin() + 1);
+
+    auto received = Values(recv_offsets[comm_size]);
+
+    auto chunk_size = std::max(size_t(1), std::min(
+        max_message_size / sizeof(Value),
+        size_t(std::numeric_limits<int>::max())
+    ));
+    auto n_chunks = [chunk_size](size_t count) {
+        return (count + chunk_size - 1) / chunk_size;
+    };
+
+    // The received buckets are merged in a binary tree: once both halves of
+    // a node have arrived, they're merged into the node.
+    auto n_levels = size_t(0);
+    while((size_t(1) << n_levels) < comm_size) {
+        ++n_levels;
+    }
+
+    auto is_complete = std::vector<std::vector<char>>(n_levels + 1);
+    for(size_t level = 0; level <= n_levels; ++level) {
+        is_complete[level].resize(((comm_size - 1) >> level) + 1, 0);
+    }
+
+    auto cmp = [](const Value &a, const Value &b) {
+        return Key::compare(a, b);
+    };
+
+    auto offset_of = [&](size_t level, size_t node) {
+        return recv_offsets[std::min(node << level, comm_size)];
+    };
+
+    auto on_bucket_received = [&](size_t source) {
+        auto node = source;
+        is_complete[0][node] = 1;
+
+        for(size_t level = 0; level < n_levels; ++level) {
+            auto sibling = node ^ 1;
+            auto has_sibling = (sibling << level) < comm_size;
+            if(has_sibling && !is_complete[level][sibling]) {
+                return;
+            }
+
+            auto left = std::min(node, sibling);
+            if(has_sibling) {
+                std::inplace_merge(received.begin() + offset_of(level, left),
+                                   received.begin() + offset_of(level, left + 1),
+                                   received.begin() + offset_of(level, left + 2),
+                                   cmp);
+            }
+
+            node = node / 2;
+            is_complete[level + 1][node] = 1;
+        }
+    };
+
+    auto recv_requests = std::vector<MPI_Request>{};
+    auto recv_sources = std::vector<size_t>{};
+    auto n_pending_chunks = std::vector<size_t>(comm_size, 0ul);
+
+    for(size_t source = 0; source < comm_size; ++source) {
+        if(source == mpi_rank) {
+            continue;
+        }
+
+        for(size_t k = 0; k < n_chunks(recv_counts[source]); ++k) {
+            auto offset = k * chunk_size;
+            auto count = std::min(chunk_size, recv_counts[source] - offset);
+
+            recv_requests.emplace_back();
+            recv_sources.push_back(source);
+            ++n_pending_chunks[source];
+            MPI_Irecv(received.data() + recv_offsets[source] + offset,
+                      int(count), mpi_value_,
+                      int(source), int(k), comm, &recv_requests.back());
+        }
+    }
+
+    auto send_requests = std::vector<MPI_Request>{};
+    for(size_t dest = 0; dest < comm_size; ++dest) {
+        if(dest == mpi_rank) {
+            continue;
+        }
+
+        for(size_t k = 0; k < n_chunks(send_counts[dest]); ++k) {
+            auto offset = k * chunk_size;
+            auto count = std::min(chunk_size, send_counts[dest] - offset);
+
+            send_requests.emplace_back();
+            MPI_Isend(sorted.data() + split[dest] + offset,
+                      int(count), mpi_value_,
+                      int(dest), int(k), comm, &send_requests.back());
+        }
+    }
+
+    std::copy(sorted.begin() + split[mpi_rank],
+              sorted.begin() + split[mpi_rank + 1],
+              received.begin() + recv_offsets[mpi_rank]);
+
+    for(size_t source = 0; source < comm_size; ++source) {
+        if(n_pending_chunks[source] == 0) {
+            on_bucket_received(source);
+        }
+    }
+
+    for(size_t n_done = 0; n_done < recv_requests.size(); ++n_done) {
+        int index = MPI_UNDEFINED;
+        MPI_Waitany(int(recv_requests.size()), recv_requests.data(), &index, MPI_STATUS_IGNORE);
+
+        auto source = recv_sources[size_t(index)];
+        if(--n_pending_chunks[source] == 0) {
+            on_bucket_received(source);
+        }
+    }
+
+    MPI_Waitall(int(send_requests.size()), send_requests.data(), MPI_STATUSES_IGNORE);
+
+    return received;
+}
+
+
+template<class T, class Key>
+template<class Weight>
+void DistributedMemorySorter<T, Key>::sort_and_balance(Values &values,
+                                                       MPI_Comm comm,
+                                                       const Weight &weight) {
+    DistributedMemorySorter <T, Key> dms;
+    dms.sort(values, comm);
+    values = dms.balance(values, comm, weight);
+}
+
+
+template<class T, class Key>
+template<class Weight>
+auto DistributedMemorySorter<T, Key>::balance(const Values &values,
+                                              MPI_Comm comm,
+                                              const Weight &weight) -> Values {
+
+    auto comm_size = size_t(mpi::size(comm));
+    auto mpi_rank = mpi::rank(comm);
+
+    // The cumulative weight of the local elements, i.e. `prefix[i]` is the
+    // weight of the first `i` elements.
+    auto prefix = std::vector<double>(values.size() + 1, 0.0);
+    int is_invalid = 0;
+    for(size_t i = 0; i < values.size(); ++i) {
+        auto w = double(weight(values[i]));
+        is_invalid |= int(!(w >= 0.0));
+        prefix[i+1] = prefix[i] + w;
+    }
+
+    // Every rank must throw, otherwise the others would wait forever.
+    MPI_Allreduce(MPI_IN_PLACE, &is_invalid, 1, MPI_INT, MPI_LOR, comm);
+    if(is_invalid) {
+        throw std::invalid_argument("The weights must be non-negative.");
+    }
+
+    double local_weight = prefix.back();
+    double weight_start = 0.0;
+    double total_weight = 0.0;
+    MPI_Exscan(&local_weight, &weight_start, 1, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(&local_weight, &total_weight, 1, MPI_DOUBLE, MPI_SUM, comm);
+    if(mpi_rank == 0) {
+        // The value of `MPI_Exscan` on rank 0 is undefined.
+        weight_start = 0.0;
+    }
+
+    if(!(total_weight > 0.0)) {
+        return balance(values, comm);
+    }
+
+    auto counts_per_rank = mpi::exchange_local_counts(values.size(), comm);
+    auto n_total = std::accumulate(counts_per_rank.begin(), counts_per_rank.end(), 0ul);
+    auto local_start = std::accumulate(counts_per_rank.begin(),
+                                       counts_per_rank.begin() + mpi_rank,
+                                       0ul);
+
+    // Rank `i` starts after the last element whose cumulative weight is at
+    // most `i * total_weight / comm_size`. Every rank counts those elements
+    // among its own.
+    auto boundaries = std::vector<size_t>(comm_size + 1, 0ul);
+    for(size_t i = 1; i < comm_size; ++i) {
+        auto target = total_weight * double(i) / double(comm_size) - weight_start;
+        auto it = std::upper_bound(prefix.begin() + 1, prefix.end(), target);
+        boundaries[i] = size_t(it - (prefix.begin() + 1));
+    }
+    MPI_Allreduce(MPI_IN_PLACE, boundaries.data(), int(comm_size), MPI_SIZE_T, MPI_SUM, comm);
+    boundaries[comm_size] = n_total;
+
+    // Heavy elements would leave some ranks empty, which STR can't handle.
+    if(n_total >= comm_size) {
+        for(size_t i = 1; i < comm_size; ++i) {
+            boundaries[i] = std::max(boundaries[i], boundaries[i-1] + 1);
+        }
+        for(size_t i = comm_size - 1; i > 0; --i) {
+            boundaries[i] = std::min(boundaries[i], boundaries[i+1] - 1);
+        }
+    }
+
+    auto send_counts = mpi::compute_send_counts(
+        boundaries, local_start, local_start + values.size()
+    );
+
+    return redistribute(values, send_counts, comm);
+}
+
+
+template<class T, class Key>
+auto DistributedMemorySorter<T, Key>::redistribute(const Values &values,
+                                                   const std::vector<int> &send_counts,
+                                                   MPI_Comm comm) -> Values {
+
+    auto comm_size = mpi::size(comm);
+
     // Obtain the number of elements this MPI rank receives.
     auto recv_counts = mpi::exchange_counts(send_counts, comm);
 
@@ -0,0 +1,325 @@
+#pragma once
+
+#include "../eviction_policies.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include <boost/format.hpp>
+
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+
+inline double
+UsageRateMetaData::usage_rate(size_t query_count) const {
+    if (query_count == load_generation_) {
+        // These were loaded during this query. Try not to evict these. However,
+        // it's safe to evict these since the subtree that will be queried next
+        // will be loaded after this eviction; and therefore can't be evicted
+        // before it's ever used.
+        return std::numeric_limits<double>::max();
+    }
+
+    return double(access_count()) / double(incache_count(query_count));
+}
+
+inline size_t
+UsageRateMetaData::access_count() const {
+    return previous_access_count_ + current_access_count_;
+}
+
+inline size_t
+UsageRateMetaData::incache_count(size_t query_count) const {
+    return (query_count - load_generation_ + 1) + previous_age_;
+}
+
+inline size_t
+UsageRateMetaData::eviction_count() const {
+    return eviction_count_;
+}
+
+inline void
+UsageRateMetaData::on_query() {
+    ++current_access_count_;
+}
+
+inline void
+UsageRateMetaData::on_load(size_t query_count) {
+    load_generation_ = query_count;
+    current_access_count_ = 1;
+}
+
+inline void
+UsageRateMetaData::on_evict(size_t query_count) {
+    previous_access_count_ += current_access_count_;
+    previous_age_ = query_count - load_generation_ + 1;
+
+    current_access_count_ = 0;
+    eviction_count_ += 1;
+}
+
+
+inline EvictionPolicyKind eviction_policy_from_string(const std::string& name) {
+    if(name == "usage_rate") {
+        return EvictionPolicyKind::usage_rate;
+    }
+    if(name == "lru") {
+        return EvictionPolicyKind::lru;
+    }
+    if(name == "clock") {
+        return EvictionPolicyKind::clock;
+    }
+    if(name == "cost_aware") {
+        return EvictionPolicyKind::cost_aware;
+    }
+
+    auto msg = boost::format("Unknown eviction policy: '%s'.") % name.c_str();
+    throw std::invalid_argument(msg.str());
+}
+
+
+inline void
+UsageRateEvictionPolicy::on_load(size_t id,
+                                 size_t /* n_bytes */,
+                                 std::optional<double> /* load_seconds */,
+                                 size_t /* query_count */) {
+    positions[id] = cached_ids.size();
+    cached_ids.push_back(id);
+}
+
+inline void
+UsageRateEvictionPolicy::on_query(size_t /* id */, size_t /* query_count */) {
+    // The access counts are part of the meta data.
+}
+
+inline void
+UsageRateEvictionPolicy::select_victims(const EvictionMetaData& meta_data,
+                                        size_t query_count,
+                                        size_t n,
+                                        std::vector<size_t>& victims) {
+    candidates.clear();
+    for(auto id : cached_ids) {
+        candidates.emplace_back(meta_data.at(id).usage_rate(query_count), id);
+    }
+
+    // Only the lowest `n` need to be found, which doesn't require sorting
+    // all of them.
+    n = std::min(n, candidates.size());
+    auto middle = candidates.begin() + util::integer_cast<std::ptrdiff_t>(n);
+    if(n < candidates.size()) {
+        std::nth_element(candidates.begin(), middle, candidates.end());
+    }
+    std::sort(candidates.begin(), middle);
+
+    for(size_t k = 0; k < n; ++k) {
+        auto id = candidates[k].second;
+
+        // Swap with the last, to remove it in O(1).
+        auto i = positions.at(id);
+        cached_ids[i] = cached_ids.back();
+        positions[cached_ids[i]] = i;
+        cached_ids.pop_back();
+        positions.erase(id);
+
+        victims.push_back(id);
+    }
+}
+
+
+inline void
+LRUEvictionPolicy::on_load(size_t id,
+                           size_t /* n_bytes */,
+                           std::optional<double> /* load_seconds */,
+                           size_t /* query_count */) {
+    order.push_front(id);
+    positions[id] = order.begin();
+}
+
+inline void
+LRUEvictionPolicy::on_query(size_t id, size_t /* query_count */) {
+    order.splice(order.begin(), order, positions.at(id));
+}
+
+inline void
+LRUEvictionPolicy::select_victims(const EvictionMetaData& /* meta_data */,
+                                  size_t /* query_count */,
+                                  size_t n,
+                                  std::vector<size_t>& victims) {
+    for(size_t k = 0; k < n && !order.empty(); ++k) {
+        auto id = order.back();
+        order.pop_back();
+        positions.erase(id);
+
+        victims.push_back(id);
+    }
+}
+
+
+inline void
+ClockEvictionPolicy::on_load(size_t id,
+                             size_t /* n_bytes */,
+                             std::optional<double> /* load_seconds */,
+                             size_t /* query_count */) {
+    // New subtrees are referenced; otherwise they could be evicted before
+    // they're ever queried.
+    auto slot = Slot{id, true, true};
+
+    if(free_slots.empty()) {
+        positions[id] = slots.size();
+        slots.push_back(slot);
+    } else {
+        auto i = free_slots.back();
+        free_slots.pop_back();
+
+        positions[id] = i;
+        slots[i] = slot;
+    }
+}
+
+inline void
+ClockEvictionPolicy::on_query(size_t id, size_t /* query_count */) {
+    slots[positions.at(id)].is_referenced = true;
+}
+
+inline void
+ClockEvictionPolicy::select_victims(const EvictionMetaData& /* meta_data */,
+                                    size_t /* query_count */,
+                                    size_t n,
+                                    std::vector<size_t>& victims) {
+    n = std::min(n, positions.size());
+
+    // After one revolution every subtree has lost its reference bit. Hence,
+    // this takes at most two revolutions per victim.
+    for(size_t k = 0; k < n; ++hand) {
+        if(hand >= slots.size()) {
+            hand = 0;
+        }
+
+        auto& slot = slots[hand];
+        if(!slot.is_occupied) {
+            continue;
+        }
+
+        if(slot.is_referenced) {
+            slot.is_referenced = false;
+            continue;
+        }
+
+        slot.is_occupied = false;
+        positions.erase(slot.id);
+        free_slots.push_back(hand);
+
+        victims.push_back(slot.id);
+        ++k;
+    }
+}
+
+
+inline void
+CostAwareEvictionPolicy::on_load(size_t id,
+                                 size_t n_bytes,
+                                 std::optional<double> load_seconds,
+                                 size_t /* query_count */) {
+    auto size = double(std::max(n_bytes, size_t(1)));
+
+    double cost;
+    if(load_seconds) {
+        cost = *load_seconds;
+        total_load_seconds += cost;
+        total_loaded_bytes += size;
+    } else if(total_loaded_bytes > 0.0) {
+        cost = size * total_load_seconds / total_loaded_bytes;
+    } else {
+        // Without any measurement, all bytes cost the same.
+        cost = size;
+    }
+
+    auto state = State{inflation + cost / size, cost / size};
+    queue.emplace(state.priority, id);
+    states[id] = state;
+}
+
+inline void
+CostAwareEvictionPolicy::on_query(size_t id, size_t /* query_count */) {
+    auto& state = states.at(id);
+
+    queue.erase({state.priority, id});
+    state.priority = inflation + state.cost_per_byte;
+    queue.emplace(state.priority, id);
+}
+
+inline void
+CostAwareEvictionPolicy::select_victims(const EvictionMetaData& /* meta_data */,
+                                        size_t /* query_count */,
+                                        size_t n,
+                                        std::vector<size_t>& victims) {
+    for(size_t k = 0; k < n && !queue.empty(); ++k) {
+        auto [priority, id] = *queue.begin();
+        queue.erase(queue.begin());
+        states.erase(id);
+
+        inflation = priority;
+        victims.push_back(id);
+    }
+}
+
+
+inline SelectableEvictionPolicy::SelectableEvictionPolicy(EvictionPolicyKind kind) {
+    switch(kind) {
+        case EvictionPolicyKind::usage_rate:
+            policy = UsageRateEvictionPolicy{};
+            break;
+        case EvictionPolicyKind::lru:
+            policy = LRUEvictionPolicy{};
+            break;
+        case EvictionPolicyKind::clock:
+            policy = ClockEvictionPolicy{};
+            break;
+        case EvictionPolicyKind::cost_aware:
+            policy = CostAwareEvictionPolicy{};
+            break;
+        default:
+            throw std::invalid_argument("Unknown eviction policy.");
+    }
+}
+
+inline void
+SelectableEvictionPolicy::on_load(size_t id,
+                                  size_t n_bytes,
+                                  std::optional<double> load_seconds,
+                                  size_t query_count) {
+    std::visit([&](auto& p) { p.on_load(id, n_bytes, load_seconds, query_count); }, policy);
+}
+
+inline void
+SelectableEvictionPolicy::on_query(size_t id, size_t query_count) {
+    std::visit([&](auto& p) { p.on_query(id, query_count); }, policy);
+}
+
+inline void
+SelectableEvictionPolicy::select_victims(const EvictionMetaData& meta_data,
+                                         size_t query_count,
+                                         size_t n,
+                                         std::vector<size_t>& victims) {
+    std::visit([&](auto& p) { p.select_victims(meta_data, query_count, n, victims); }, policy);
+}
+
+
+namespace detail {
+
+/// \brief The policy selected by `kind`, if `Policy` is selected at runtime.
+template <class Policy>
+inline Policy make_eviction_policy(EvictionPolicyKind kind) {
+    if constexpr (std::is_constructible<Policy, EvictionPolicyKind>::value) {
+        return Policy(kind);
+    } else {
+        return Policy{};
+    }
+}
+
+}  // namespace detail
+
+}  // namespace brain_indexer
@@ -0,0 +1,444 @@
+#pragma once
+#if SI_MPI == 1
+
+#include "../external_sort_tile_recursion.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+
+#include <brain_indexer/meta_data.hpp>
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief STR coordinate accessor for plain points, e.g. samples.
+struct GetPointCoordinate {
+    template <size_t dim>
+    inline static CoordType apply(const Point3Dx& point) {
+        return point.get<dim>();
+    }
+};
+
+template <class GetCoordinate, class Value>
+inline Point3Dx str_centroid(const Value& value) {
+    return Point3Dx{GetCoordinate::template apply<0>(value),
+                    GetCoordinate::template apply<1>(value),
+                    GetCoordinate::template apply<2>(value)};
+}
+
+template <class Value>
+inline void append_values(const std::string& filename, const Value* values, size_t n_values) {
+    auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::app);
+    ofs.write(reinterpret_cast<const char*>(values), std::streamsize(n_values * sizeof(Value)));
+
+    if(!ofs) {
+        auto msg = boost::format("Failed to write to: %s") % filename.c_str();
+        throw std::runtime_error(msg.str());
+    }
+}
+
+template <class Value>
+inline std::vector<Value> read_values(const std::string& filename) {
+    auto n_values = std::filesystem::file_size(filename) / sizeof(Value);
+    auto values = std::vector<Value>(n_values);
+
+    auto ifs = util::open_ifstream(filename, std::ios::binary);
+    ifs.read(reinterpret_cast<char*>(values.data()), std::streamsize(n_values * sizeof(Value)));
+
+    return values;
+}
+
+/// \brief The index of the slab which contains `x`; `lower[0]` is ignored.
+inline size_t find_slab(const CoordType* lower, size_t n_slabs, CoordType x) {
+    return size_t(std::upper_bound(lower + 1, lower + n_slabs, x) - (lower + 1));
+}
+
+}  // namespace detail
+
+
+template <class Value, class GetCoordinate>
+inline SpilledRuns<Value, GetCoordinate>::SpilledRuns(std::string scratch_dir, std::string prefix)
+    : scratch_dir_(std::move(scratch_dir)), prefix_(std::move(prefix)) {}
+
+
+template <class Value, class GetCoordinate>
+inline void SpilledRuns<Value, GetCoordinate>::spill(std::vector<Value>& values) {
+    using Key = STRKey<GetCoordinate, 0>;
+    std::sort(values.begin(), values.end(), [](const Value& a, const Value& b) {
+        return Key::compare(a, b);
+    });
+
+    auto filename = join_path(
+        scratch_dir_, prefix_ + "_" + std::to_string(filenames_.size()) + ".bin"
+    );
+
+    std::filesystem::remove(filename);
+    detail::append_values(filename, values.data(), values.size());
+
+    filenames_.push_back(filename);
+    run_sizes_.push_back(values.size());
+
+    values.clear();
+}
+
+
+template <class Value, class GetCoordinate>
+inline void SpilledRuns<Value, GetCoordinate>::read(size_t k,
+                                                    size_t offset,
+                                                    size_t count,
+                                                    std::vector<Value>& values) const {
+    if(offset + count > run_sizes_[k]) {
+        throw std::out_of_range("Reading past the end of a run.");
+    }
+
+    auto n_values = values.size();
+    values.resize(n_values + count);
+
+    auto ifs = util::open_ifstream(filenames_[k], std::ios::binary);
+    ifs.seekg(std::streamoff(offset * sizeof(Value)));
+    ifs.read(reinterpret_cast<char*>(values.data() + n_values),
+             std::streamsize(count * sizeof(Value)));
+
+    if(!ifs) {
+        auto msg = boost::format("Failed to read from: %s") % filenames_[k].c_str();
+        throw std::runtime_error(msg.str());
+    }
+}
+
+
+template <class Value, class GetCoordinate>
+inline void SpilledRuns<Value, GetCoordinate>::remove() {
+    for(const auto& filename : filenames_) {
+        std::filesystem::remove(filename);
+    }
+
+    filenames_.clear();
+    run_sizes_.clear();
+}
+
+
+template <class Value, class GetCoordinate>
+inline size_t SpilledRuns<Value, GetCoordinate>::size() const {
+    return std::accumulate(run_sizes_.begin(), run_sizes_.end(), size_t(0));
+}
+
+
+template <class Value, class GetCoordinate>
+inline size_t SpilledRuns<Value, GetCoordinate>::n_runs() const {
+    return run_sizes_.size();
+}
+
+
+template <class Value, class GetCoordinate>
+inline size_t SpilledRuns<Value, GetCoordinate>::run_size(size_t k) const {
+    return run_sizes_[k];
+}
+
+
+inline size_t STRSplitters::n_parts() const {
+    return n_parts_per_dim[0] * n_parts_per_dim[1] * n_parts_per_dim[2];
+}
+
+
+inline size_t STRSplitters::part(const Point3Dx& centroid) const {
+    auto [n0, n1, n2] = n_parts_per_dim;
+
+    auto i = detail::find_slab(x.data(), n0, centroid.get<0>());
+    auto j = detail::find_slab(y.data() + i * n1, n1, centroid.get<1>());
+    auto k = detail::find_slab(z.data() + (i * n1 + j) * n2, n2, centroid.get<2>());
+
+    return k + n2 * (j + n1 * i);
+}
+
+
+inline STRSplitters compute_str_splitters(std::vector<Point3Dx> samples,
+                                          const std::array<size_t, 3>& n_parts_per_dim) {
+    auto splitters = STRSplitters{n_parts_per_dim, {}, {}, {}};
+    if(samples.size() < splitters.n_parts()) {
+        auto msg = boost::format("Too few samples: %d for %d parts.")
+            % samples.size() % splitters.n_parts();
+        throw std::runtime_error(msg.str());
+    }
+
+    auto sort = [&samples](const util::Range& range, auto key) {
+        using Key = decltype(key);
+        std::sort(samples.begin() + std::ptrdiff_t(range.low),
+                  samples.begin() + std::ptrdiff_t(range.high),
+                  [](const Point3Dx& a, const Point3Dx& b) { return Key::compare(a, b); });
+    };
+
+    // The same slabs as `SerialSortTileRecursion`; the splitters are the
+    // smallest coordinates of each slab.
+    auto [n0, n1, n2] = n_parts_per_dim;
+    auto all = util::Range{0, samples.size()};
+    sort(all, STRKey<detail::GetPointCoordinate, 0>{});
+
+    for(size_t i = 0; i < n0; ++i) {
+        auto i_range = util::balanced_chunks(all, n0, i);
+        splitters.x.push_back(samples[i_range.low].get<0>());
+        sort(i_range, STRKey<detail::GetPointCoordinate, 1>{});
+
+        for(size_t j = 0; j < n1; ++j) {
+            auto j_range = util::balanced_chunks(i_range, n1, j);
+            splitters.y.push_back(samples[j_range.low].get<1>());
+            sort(j_range, STRKey<detail::GetPointCoordinate, 2>{});
+
+            for(size_t k = 0; k < n2; ++k) {
+                auto k_range = util::balanced_chunks(j_range, n2, k);
+                splitters.z.push_back(samples[k_range.low].get<2>());
+            }
+        }
+    }
+
+    return splitters;
+}
+
+
+namespace detail {
+
+/// \brief A regular sample of `n_samples` elements of all runs.
+template <class GetCoordinate, class Value>
+inline std::vector<Point3Dx> sample_spilled_runs(const SpilledRuns<Value, GetCoordinate>& runs,
+                                                 size_t n_samples) {
+    auto n_values = runs.size();
+    auto samples = std::vector<Point3Dx>{};
+    samples.reserve(n_samples);
+
+    auto buffer = std::vector<Value>{};
+    size_t run_begin = 0;
+    size_t k = 0;
+    for(size_t i = 0; i < n_samples; ++i) {
+        auto index = i * n_values / n_samples;
+        while(index >= run_begin + runs.run_size(k)) {
+            run_begin += runs.run_size(k);
+            ++k;
+        }
+
+        buffer.clear();
+        runs.read(k, index - run_begin, 1, buffer);
+        samples.push_back(str_centroid<GetCoordinate>(buffer[0]));
+    }
+
+    return samples;
+}
+
+inline std::vector<Point3Dx> allgather_samples(const std::vector<Point3Dx>& local_samples,
+                                               MPI_Comm comm) {
+    auto n_ranks = mpi::size(comm);
+    auto mpi_point = mpi::Datatype(mpi::create_contiguous_datatype<Point3Dx>());
+
+    auto n_local = util::safe_integer_cast<int>(local_samples.size());
+    auto counts = std::vector<int>(size_t(n_ranks));
+    MPI_Allgather(&n_local, 1, MPI_INT, counts.data(), 1, MPI_INT, comm);
+    auto offsets = mpi::offsets_from_counts(counts);
+
+    auto samples = std::vector<Point3Dx>(size_t(offsets[size_t(n_ranks)]));
+    MPI_Allgatherv(
+        (void *) local_samples.data(), n_local, *mpi_point,
+        (void *) samples.data(), counts.data(), offsets.data(), *mpi_point,
+        comm
+    );
+
+    return samples;
+}
+
+}  // namespace detail
+
+
+template <class GetCenterCoordinate, class Storage, class Value>
+void external_distributed_partition(const Storage& storage,
+                                    SpilledRuns<Value, GetCenterCoordinate>& runs,
+                                    const std::string& scratch_dir,
+                                    size_t max_elements_per_part,
+                                    size_t max_elements_in_memory,
+                                    MPI_Comm comm) {
+
+    auto n_ranks = mpi::size(comm);
+    auto mpi_rank = mpi::rank(comm);
+
+    size_t n_local = runs.size();
+    size_t n_total = 0;
+    MPI_Allreduce(&n_local, &n_total, 1, MPI_SIZE_T, MPI_SUM, comm);
+
+    // Every rank should own at least one part.
+    auto n_values_per_rank = (n_total + size_t(n_ranks) - 1) / size_t(n_ranks);
+    auto str_params = SerialSTRParams::from_heuristic(
+        n_total, std::max<size_t>(1, std::min(max_elements_per_part, n_values_per_rank))
+    );
+    auto n_parts = str_params.n_parts();
+
+    // 1. Sample.
+    util::check_signals();
+    auto n_samples = std::min(n_total, 256 * n_parts);
+    auto n_local_samples = n_total == 0 ? 0 : n_local * n_samples / n_total;
+    auto splitters = compute_str_splitters(
+        detail::allgather_samples(
+            detail::sample_spilled_runs(runs, n_local_samples), comm
+        ),
+        str_params.n_parts_per_dim
+    );
+
+    // 2. Send every element to the owner of its part.
+    auto owners = std::vector<int>(n_parts);
+    for(int r = 0; r < n_ranks; ++r) {
+        auto [low, high] = util::balanced_chunks(n_parts, size_t(n_ranks), size_t(r));
+        std::fill(owners.begin() + std::ptrdiff_t(low), owners.begin() + std::ptrdiff_t(high), r);
+    }
+    auto owned_parts = util::balanced_chunks(n_parts, size_t(n_ranks), size_t(mpi_rank));
+
+    auto part_filename = [&scratch_dir](size_t p) {
+        return join_path(scratch_dir, "part_" + std::to_string(p) + ".bin");
+    };
+
+    for(size_t p = owned_parts.low; p < owned_parts.high; ++p) {
+        std::filesystem::remove(part_filename(p));
+    }
+
+    auto part_of = [&splitters](const Value& value) {
+        return splitters.part(detail::str_centroid<GetCenterCoordinate>(value));
+    };
+
+    // The chunk, the send buffer and the received elements.
+    auto chunk_size = std::max<size_t>(1, max_elements_in_memory / 3);
+    auto mpi_value = mpi::Datatype(mpi::create_contiguous_datatype<Value>());
+
+    auto n_runs = runs.n_runs();
+    auto n_consumed = std::vector<size_t>(n_runs, 0);
+    auto n_remaining = n_local;
+
+    auto chunk = std::vector<Value>{};
+    auto send_buffer = std::vector<Value>{};
+    auto received = std::vector<Value>{};
+    auto parts = std::vector<size_t>{};
+    auto order = std::vector<size_t>{};
+
+    while(true) {
+        util::check_signals();
+
+        chunk.clear();
+        for(size_t k = 0; k < n_runs; ++k) {
+            auto run_size = runs.run_size(k);
+            if(n_consumed[k] == run_size) {
+                continue;
+            }
+
+            auto n_take = std::min(run_size - n_consumed[k],
+                                   (run_size * chunk_size + n_local - 1) / n_local);
+            auto begin = (run_size * size_t(mpi_rank) / size_t(n_ranks) + n_consumed[k]) % run_size;
+            auto n_first = std::min(n_take, run_size - begin);
+
+            runs.read(k, begin, n_first, chunk);
+            if(n_first < n_take) {
+                runs.read(k, 0, n_take - n_first, chunk);
+            }
+
+            n_consumed[k] += n_take;
+            n_remaining -= n_take;
+        }
+
+        auto send_counts = std::vector<int>(size_t(n_ranks), 0);
+        parts.resize(chunk.size());
+        for(size_t i = 0; i < chunk.size(); ++i) {
+            parts[i] = part_of(chunk[i]);
+            ++send_counts[size_t(owners[parts[i]])];
+        }
+
+        auto recv_counts = mpi::exchange_counts(send_counts, comm);
+        auto send_offsets = mpi::offsets_from_counts(send_counts);
+        auto recv_offsets = mpi::offsets_from_counts(recv_counts);
+
+        send_buffer.resize(chunk.size());
+        auto next = send_offsets;
+        for(size_t i = 0; i < chunk.size(); ++i) {
+            send_buffer[size_t(next[size_t(owners[parts[i]])]++)] = chunk[i];
+        }
+
+        received.resize(size_t(recv_offsets[size_t(n_ranks)]));
+        MPI_Alltoallv(
+            send_buffer.data(), send_counts.data(), send_offsets.data(), *mpi_value,
+            received.data(), recv_counts.data(), recv_offsets.data(), *mpi_value,
+            comm
+        );
+
+        // Append the received elements to the file of their part.
+        auto part_offsets = std::vector<size_t>(owned_parts.high - owned_parts.low + 1, 0);
+        parts.resize(received.size());
+        for(size_t i = 0; i < received.size(); ++i) {
+            parts[i] = part_of(received[i]) - owned_parts.low;
+            ++part_offsets[parts[i] + 1];
+        }
+        std::partial_sum(part_offsets.begin(), part_offsets.end(), part_offsets.begin());
+
+        send_buffer.resize(received.size());
+        auto next_in_part = part_offsets;
+        for(size_t i = 0; i < received.size(); ++i) {
+            send_buffer[next_in_part[parts[i]]++] = received[i];
+        }
+
+        for(size_t p = 0; p + 1 < part_offsets.size(); ++p) {
+            auto n_values = part_offsets[p + 1] - part_offsets[p];
+            if(n_values > 0) {
+                detail::append_values(part_filename(owned_parts.low + p),
+                                      send_buffer.data() + part_offsets[p],
+                                      n_values);
+            }
+        }
+
+        int is_done = n_remaining == 0;
+        MPI_Allreduce(MPI_IN_PLACE, &is_done, 1, MPI_INT, MPI_LAND, comm);
+        if(is_done) {
+            break;
+        }
+    }
+
+    runs.remove();
+    chunk = {};
+    send_buffer = {};
+    received = {};
+
+    // 3. Build the subtrees.
+    auto local_bounding_boxes = std::vector<IndexedSubtreeBox>();
+    auto writer = AsyncSubtreeWriter<Storage>(storage);
+    for(size_t p = owned_parts.low; p < owned_parts.high; ++p) {
+        util::check_signals();
+
+        auto filename = part_filename(p);
+        if(!std::filesystem::exists(filename)) {
+            continue;
+        }
+
+        auto values = detail::read_values<Value>(filename);
+        std::filesystem::remove(filename);
+
+        auto subtree = typename Storage::subtree_type(
+            values.data(), values.data() + values.size()
+        );
+        values = {};
+
+        local_bounding_boxes.push_back(IndexedSubtreeBox(p, subtree.size(), subtree.bounds()));
+        writer.save(std::move(subtree), p);
+    }
+    writer.wait();
+
+    util::check_signals();
+    auto bounding_boxes = gather_bounding_boxes(local_bounding_boxes, comm);
+
+    if(mpi_rank == 0) {
+        auto top_level_tree = typename Storage::toptree_type(
+            bounding_boxes.begin(),
+            bounding_boxes.end()
+        );
+
+        storage.save_top_tree(top_level_tree);
+    }
+}
+
+}
+
+#endif
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
 #include "../geometries.hpp"
 
 namespace brain_indexer {
@@ -326,6 +330,580 @@ inline bool Cylinder::contains(Point3D const& p) const {
 }
 
 
+namespace detail {
+
+using Interval = std::pair<CoordType, CoordType>;
+
+/// \brief The interval covered by `box` when projected onto `axis`.
+inline Interval project_box(const Box3D& box, const Point3D& axis) {
+    auto center = (Point3Dx(box.min_corner()) + box.max_corner()) * CoordType(0.5);
+    auto half_size = (Point3Dx(box.max_corner()) - box.min_corner()) * CoordType(0.5);
+
+    auto mid = center.dot(axis);
+    auto radius = half_size.dot(Point3Dx(axis).abs());
+    return {mid - radius, mid + radius};
+}
+
+/// \brief The interval covered by `obb` when projected onto `axis`.
+inline Interval project_box(const OrientedBox& obb, const Point3D& axis) {
+    auto mid = Point3Dx(obb.center).dot(axis);
+    auto radius = obb.half_extents.get<0>() * std::abs(Point3Dx(obb.axes[0]).dot(axis))
+                + obb.half_extents.get<1>() * std::abs(Point3Dx(obb.axes[1]).dot(axis))
+                + obb.half_extents.get<2>() * std::abs(Point3Dx(obb.axes[2]).dot(axis));
+    return {mid - radius, mid + radius};
+}
+
+/// \brief The interval covered by the convex hull of `points` when projected onto `axis`.
+inline Interval project_points(const std::vector<Point3D>& points, const Point3D& axis) {
+    auto low = std::numeric_limits<CoordType>::max();
+    auto high = std::numeric_limits<CoordType>::lowest();
+    for(const auto& p : points) {
+        auto x = Point3Dx(p).dot(axis);
+        low = std::min(low, x);
+        high = std::max(high, x);
+    }
+    return {low, high};
+}
+
+inline bool is_disjoint(const Interval& a, const Interval& b) {
+    return a.second < b.first || b.second < a.first;
+}
+
+/// \brief The unit vectors along the coordinate axes.
+inline const std::array<Point3D, 3>& coordinate_axes() {
+    static const auto axes = std::array<Point3D, 3>{
+        Point3D{1.0, 0.0, 0.0}, Point3D{0.0, 1.0, 0.0}, Point3D{0.0, 0.0, 1.0}
+    };
+    return axes;
+}
+
+/** \brief Is any of the axes `u[i] x v[j]` a separating axis of `a` and `b`.
+ *
+ *  These are the axes of the separating-axis test which aren't face normals;
+ *  `project_a` and `project_b` project the two convex shapes onto an axis.
+ *  Axes which are nearly zero, i.e. of parallel edges, are skipped.
+ */
+template <class U, class V, class ProjectA, class ProjectB>
+inline bool has_separating_edge_axis(const U& u,
+                                     const V& v,
+                                     const ProjectA& project_a,
+                                     const ProjectB& project_b) {
+    for(const auto& ui : u) {
+        for(const auto& vj : v) {
+            auto axis = Point3Dx(Point3Dx(ui).cross(vj));
+            if(axis.norm_sq() < CoordType(1e-12) * Point3Dx(ui).norm_sq() * Point3Dx(vj).norm_sq()) {
+                continue;
+            }
+
+            if(is_disjoint(project_a(axis), project_b(axis))) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+}  // namespace detail
+
+
+inline Box3D OrientedBox::bounding_box() const {
+    auto extent = Point3Dx(axes[0]).abs() * half_extents.get<0>()
+                + Point3Dx(axes[1]).abs() * half_extents.get<1>()
+                + Point3Dx(axes[2]).abs() * half_extents.get<2>();
+
+    return Box3D(Point3Dx(center) - extent, Point3Dx(center) + extent);
+}
+
+inline Point3D OrientedBox::to_local(const Point3D& p) const {
+    auto d = Point3Dx(p) - center;
+    return Point3D{d.dot(axes[0]), d.dot(axes[1]), d.dot(axes[2])};
+}
+
+inline bool OrientedBox::intersects(Box3D const& b) const {
+    // Separating-axis test with the 15 candidate axes: the face normals of
+    // either box and the cross products of their edges. Along the coordinate
+    // axes the oriented box covers exactly its bounding box.
+    if(!bg::intersects(bounding_box(), b)) {
+        return false;
+    }
+
+    for(const auto& axis : axes) {
+        if(detail::is_disjoint(detail::project_box(*this, axis), detail::project_box(b, axis))) {
+            return false;
+        }
+    }
+
+    return !detail::has_separating_edge_axis(
+        axes,
+        detail::coordinate_axes(),
+        [this](const Point3D& axis) { return detail::project_box(*this, axis); },
+        [&b](const Point3D& axis) { return detail::project_box(b, axis); }
+    );
+}
+
+inline bool OrientedBox::intersects(Sphere const& s) const {
+    return Sphere{to_local(s.centroid), s.radius}.intersects(local_box());
+}
+
+inline bool OrientedBox::intersects(Cylinder const& c) const {
+    return Cylinder{to_local(c.p1), to_local(c.p2), c.radius}.intersects(local_box());
+}
+
+inline bool OrientedBox::intersects(Point3D const& p) const {
+    return contains(p);
+}
+
+inline bool OrientedBox::contains(Point3D const& p) const {
+    return bg::covered_by(to_local(p), local_box());
+}
+
+inline bool strictly_contains(const OrientedBox& query_shape, const Box3D& box) {
+    auto center = (Point3Dx(box.min_corner()) + box.max_corner()) * CoordType(0.5);
+    auto half_size = (Point3Dx(box.max_corner()) - box.min_corner()) * CoordType(0.5);
+
+    auto local = Point3Dx(query_shape.to_local(center));
+    const auto& h = query_shape.half_extents;
+    const auto& axes = query_shape.axes;
+    return std::abs(local.get<0>()) + half_size.dot(Point3Dx(axes[0]).abs()) < h.get<0>()
+        && std::abs(local.get<1>()) + half_size.dot(Point3Dx(axes[1]).abs()) < h.get<1>()
+        && std::abs(local.get<2>()) + half_size.dot(Point3Dx(axes[2]).abs()) < h.get<2>();
+}
+
+
+inline ConvexPolytope::ConvexPolytope(const std::vector<HalfSpace>& half_spaces) {
+    for(const auto& half_space : half_spaces) {
+        auto norm = Point3Dx(half_space.normal).norm();
+        if(!(norm > CoordType(0))) {
+            throw std::invalid_argument("The normal of a half-space must not be zero.");
+        }
+        half_spaces_.push_back(HalfSpace{Point3Dx(half_space.normal) / norm,
+                                         half_space.offset / norm});
+    }
+
+    // The vertices are the points where three of the planes meet, which are
+    // in all half-spaces. They're computed in double precision; and points
+    // closer than `tolerance` are considered the same.
+    using vec_t = std::array<double, 3>;
+    auto to_vec = [](const Point3D& p) {
+        return vec_t{double(p.get<0>()), double(p.get<1>()), double(p.get<2>())};
+    };
+    auto dot = [](const vec_t& a, const vec_t& b) {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    };
+    auto cross = [](const vec_t& a, const vec_t& b) {
+        return vec_t{a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    };
+
+    const auto n_planes = half_spaces_.size();
+    auto normals = std::vector<vec_t>{};
+    auto scale = 1.0;
+    for(const auto& half_space : half_spaces_) {
+        normals.push_back(to_vec(half_space.normal));
+        scale = std::max(scale, std::abs(double(half_space.offset)));
+    }
+    const auto tolerance = 1e-5 * scale;
+
+    auto vertices = std::vector<vec_t>{};
+    auto active_planes = std::vector<std::vector<size_t>>{};
+    for(size_t i = 0; i < n_planes; ++i) {
+        for(size_t j = i + 1; j < n_planes; ++j) {
+            for(size_t k = j + 1; k < n_planes; ++k) {
+                auto jk = cross(normals[j], normals[k]);
+                auto det = dot(normals[i], jk);
+                if(std::abs(det) < 1e-9) {
+                    continue;
+                }
+
+                // Cramer's rule.
+                auto ki = cross(normals[k], normals[i]);
+                auto ij = cross(normals[i], normals[j]);
+                auto x = vec_t{};
+                for(size_t d = 0; d < 3; ++d) {
+                    x[d] = (half_spaces_[i].offset * jk[d] + half_spaces_[j].offset * ki[d]
+                            + half_spaces_[k].offset * ij[d]) / det;
+                }
+
+                auto active = std::vector<size_t>{};
+                bool is_inside = true;
+                for(size_t l = 0; l < n_planes && is_inside; ++l) {
+                    auto distance = dot(normals[l], x) - half_spaces_[l].offset;
+                    is_inside = distance <= tolerance;
+                    if(std::abs(distance) <= tolerance) {
+                        active.push_back(l);
+                    }
+                }
+
+                auto is_new = [&](const vec_t& v) {
+                    auto d = vec_t{v[0] - x[0], v[1] - x[1], v[2] - x[2]};
+                    return dot(d, d) > tolerance * tolerance;
+                };
+
+                if(is_inside && std::all_of(vertices.begin(), vertices.end(), is_new)) {
+                    vertices.push_back(x);
+                    active_planes.push_back(std::move(active));
+                }
+            }
+        }
+    }
+
+    // Two vertices are joined by an edge if they lie on two common planes.
+    auto degrees = std::vector<size_t>(vertices.size(), 0);
+    for(size_t a = 0; a < vertices.size(); ++a) {
+        for(size_t b = a + 1; b < vertices.size(); ++b) {
+            size_t n_common = 0;
+            for(auto l : active_planes[a]) {
+                n_common += size_t(std::count(active_planes[b].begin(), active_planes[b].end(), l));
+            }
+
+            if(n_common >= 2) {
+                edges_.emplace_back(a, b);
+                ++degrees[a];
+                ++degrees[b];
+            }
+        }
+    }
+
+    // In a bounded polytope, every vertex has at least three edges.
+    auto is_bounded = vertices.size() >= 4
+                      && std::all_of(degrees.begin(), degrees.end(), [](size_t degree) {
+                             return degree >= 3;
+                         });
+    if(!is_bounded) {
+        throw std::invalid_argument(
+            "The half-spaces must bound a polytope with a non-empty interior.");
+    }
+
+    for(const auto& v : vertices) {
+        vertices_.push_back(Point3D{CoordType(v[0]), CoordType(v[1]), CoordType(v[2])});
+    }
+
+    // Parallel edges give the same axes in the separating-axis test.
+    for(const auto& [a, b] : edges_) {
+        auto direction = Point3Dx(vertices_[b]) - vertices_[a];
+        direction = direction / direction.norm();
+
+        auto is_parallel = [&direction](const Point3D& other) {
+            return Point3Dx(direction.cross(other)).norm_sq() < CoordType(1e-10);
+        };
+        if(std::none_of(edge_directions_.begin(), edge_directions_.end(), is_parallel)) {
+            edge_directions_.push_back(direction);
+        }
+    }
+
+    auto low = vertices_[0];
+    auto high = vertices_[0];
+    for(const auto& v : vertices_) {
+        low = min(low, v);
+        high = max(high, v);
+    }
+    bounding_box_ = Box3D(low, high);
+}
+
+inline ConvexPolytope::ConvexPolytope(const OrientedBox& box)
+    : ConvexPolytope([&box]() {
+        const auto& h = box.half_extents;
+        auto half_extents = std::array<CoordType, 3>{h.get<0>(), h.get<1>(), h.get<2>()};
+
+        auto half_spaces = std::vector<HalfSpace>{};
+        for(size_t k = 0; k < 3; ++k) {
+            auto offset = Point3Dx(box.center).dot(box.axes[k]);
+            half_spaces.push_back(HalfSpace{box.axes[k], offset + half_extents[k]});
+            half_spaces.push_back(HalfSpace{Point3Dx(box.axes[k]) * CoordType(-1),
+                                            half_extents[k] - offset});
+        }
+        return half_spaces;
+    }()) {}
+
+inline CoordType ConvexPolytope::distance_sq(const Point3D& p) const {
+    if(contains(p)) {
+        return CoordType(0);
+    }
+
+    // The closest point is either inside one of the faces, i.e. the
+    // projection onto its plane; or on one of the edges.
+    auto tolerance = CoordType(1e-5) * std::max(CoordType(1), Point3Dx(p).abs().maximum());
+    auto best = std::numeric_limits<CoordType>::max();
+    for(const auto& face : half_spaces_) {
+        auto distance = Point3Dx(face.normal).dot(p) - face.offset;
+        if(distance <= 0 || distance * distance >= best) {
+            continue;
+        }
+
+        auto projected = Point3Dx(p) - Point3Dx(face.normal) * distance;
+        auto is_on_face = std::all_of(half_spaces_.begin(), half_spaces_.end(), [&](const auto& h) {
+            return projected.dot(h.normal) <= h.offset + tolerance;
+        });
+
+        if(is_on_face) {
+            best = distance * distance;
+        }
+    }
+
+    for(const auto& [a, b] : edges_) {
+        auto closest = project_point_onto_segment(vertices_[a],
+                                                  Point3Dx(vertices_[b]) - vertices_[a],
+                                                  p);
+        best = std::min(best, closest.dist_sq(p));
+    }
+
+    return best;
+}
+
+inline bool ConvexPolytope::intersects(Box3D const& b) const {
+    // Separating-axis test. The candidate axes are the coordinate axes, the
+    // face normals of the polytope and the cross products of its edges with
+    // the coordinate axes.
+    if(!bg::intersects(bounding_box_, b)) {
+        return false;
+    }
+
+    for(const auto& face : half_spaces_) {
+        if(detail::project_box(b, face.normal).first > face.offset) {
+            return false;
+        }
+    }
+
+    return !detail::has_separating_edge_axis(
+        edge_directions_,
+        detail::coordinate_axes(),
+        [this](const Point3D& axis) { return detail::project_points(vertices_, axis); },
+        [&b](const Point3D& axis) { return detail::project_box(b, axis); }
+    );
+}
+
+inline bool ConvexPolytope::intersects(Sphere const& s) const {
+    return distance_sq(s.centroid) <= s.radius * s.radius;
+}
+
+inline bool ConvexPolytope::intersects(Cylinder const& c) const {
+    // We're approximating the cylinder as a capsule. It intersects if its
+    // axis passes through the polytope; or else, if the distance between
+    // the axis and the surface is at most the radius. The closest point of
+    // the axis is either one of its end points or closest to an edge.
+    auto t_low = CoordType(0);
+    auto t_high = CoordType(1);
+    for(const auto& face : half_spaces_) {
+        auto f1 = Point3Dx(face.normal).dot(c.p1) - face.offset;
+        auto f2 = Point3Dx(face.normal).dot(c.p2) - face.offset;
+
+        if(f1 > c.radius && f2 > c.radius) {
+            return false;
+        }
+
+        if(f1 > 0 && f2 > 0) {
+            t_low = CoordType(1);
+            t_high = CoordType(0);
+        } else if(f1 > 0) {
+            t_low = std::max(t_low, f1 / (f1 - f2));
+        } else if(f2 > 0) {
+            t_high = std::min(t_high, f1 / (f1 - f2));
+        }
+    }
+
+    if(t_low <= t_high) {
+        return true;
+    }
+
+    auto radius_sq = c.radius * c.radius;
+    if(distance_sq(c.p1) <= radius_sq || distance_sq(c.p2) <= radius_sq) {
+        return true;
+    }
+
+    return std::any_of(edges_.begin(), edges_.end(), [&](const auto& edge) {
+        return detail::square_distance_segment_segment(
+                   vertices_[edge.first], vertices_[edge.second], c.p1, c.p2) <= radius_sq;
+    });
+}
+
+inline bool ConvexPolytope::intersects(Point3D const& p) const {
+    return contains(p);
+}
+
+inline bool ConvexPolytope::contains(Point3D const& p) const {
+    return std::all_of(half_spaces_.begin(), half_spaces_.end(), [&p](const auto& h) {
+        return Point3Dx(h.normal).dot(p) <= h.offset;
+    });
+}
+
+inline bool strictly_contains(const ConvexPolytope& query_shape, const Box3D& box) {
+    const auto& half_spaces = query_shape.half_spaces();
+    return std::all_of(half_spaces.begin(), half_spaces.end(), [&box](const auto& h) {
+        return detail::project_box(box, h.normal).second < h.offset;
+    });
+}
+
+
+inline VoxelMask::VoxelMask(const Point3D& origin,
+                            const Point3D& voxel_size,
+                            const shape_type& shape,
+                            const std::uint8_t* mask)
+    : origin_(origin), voxel_size_(voxel_size), shape_(shape) {
+    if(!(voxel_size.get<0>() > 0 && voxel_size.get<1>() > 0 && voxel_size.get<2>() > 0)) {
+        throw std::invalid_argument("The voxel size must be positive.");
+    }
+
+    auto [nx, ny, nz] = shape;
+    if(nx * ny * nz > size_t(std::numeric_limits<std::uint32_t>::max())) {
+        throw std::invalid_argument("The mask has too many voxels.");
+    }
+
+    // Unsigned arithmetic wraps around; the sums are correct nevertheless.
+    summed_volume_.assign((nx + 1) * (ny + 1) * (nz + 1), 0);
+    auto sv = [this, ny = ny, nz = nz](size_t i, size_t j, size_t k) -> std::uint32_t& {
+        return summed_volume_[(i * (ny + 1) + j) * (nz + 1) + k];
+    };
+
+    auto low = shape_type{nx, ny, nz};
+    auto high = shape_type{0, 0, 0};
+    for(size_t i = 0; i < nx; ++i) {
+        for(size_t j = 0; j < ny; ++j) {
+            for(size_t k = 0; k < nz; ++k) {
+                auto is_set = std::uint32_t(mask[(i * ny + j) * nz + k] != 0);
+                sv(i + 1, j + 1, k + 1) = is_set
+                    + sv(i, j + 1, k + 1) + sv(i + 1, j, k + 1) + sv(i + 1, j + 1, k)
+                    - sv(i, j, k + 1) - sv(i, j + 1, k) - sv(i + 1, j, k)
+                    + sv(i, j, k);
+
+                if(is_set) {
+                    low = {std::min(low[0], i), std::min(low[1], j), std::min(low[2], k)};
+                    high = {std::max(high[0], i + 1),
+                            std::max(high[1], j + 1),
+                            std::max(high[2], k + 1)};
+                }
+            }
+        }
+    }
+
+    if(low[0] < high[0]) {
+        bounding_box_ = Box3D(voxel_box(low[0], low[1], low[2]).min_corner(),
+                              voxel_box(high[0] - 1, high[1] - 1, high[2] - 1).max_corner());
+    } else {
+        bounding_box_ = Box3D(origin_, origin_);
+    }
+}
+
+inline bool VoxelMask::is_set(size_t i, size_t j, size_t k) const {
+    return count(VoxelRange{{i, j, k}, {i + 1, j + 1, k + 1}}) != 0;
+}
+
+inline size_t VoxelMask::count(Box3D const& b) const {
+    auto range = VoxelRange{};
+    return voxel_range(b, range) ? count(range) : 0;
+}
+
+inline bool VoxelMask::covers(Box3D const& b) const {
+    auto upper = Point3Dx(origin_) + Point3Dx(voxel_size_) * Point3D{CoordType(shape_[0]),
+                                                                      CoordType(shape_[1]),
+                                                                      CoordType(shape_[2])};
+    auto range = VoxelRange{};
+    return bg::covered_by(b, Box3D(origin_, upper))
+        && voxel_range(b, range)
+        && count(range) == range.size();
+}
+
+inline bool VoxelMask::intersects(Box3D const& b) const {
+    return count(b) != 0;
+}
+
+inline bool VoxelMask::intersects(Sphere const& s) const {
+    return intersects_voxels(s);
+}
+
+inline bool VoxelMask::intersects(Cylinder const& c) const {
+    return intersects_voxels(c);
+}
+
+inline bool VoxelMask::intersects(Point3D const& p) const {
+    return contains(p);
+}
+
+inline bool VoxelMask::contains(Point3D const& p) const {
+    auto range = VoxelRange{};
+    return voxel_range(Box3D(p, p), range) && count(range) != 0;
+}
+
+inline bool VoxelMask::voxel_range(Box3D const& b, VoxelRange& range) const {
+    const auto& b_min = b.min_corner();
+    const auto& b_max = b.max_corner();
+    auto low = std::array<CoordType, 3>{b_min.get<0>(), b_min.get<1>(), b_min.get<2>()};
+    auto high = std::array<CoordType, 3>{b_max.get<0>(), b_max.get<1>(), b_max.get<2>()};
+    auto o = std::array<CoordType, 3>{origin_.get<0>(), origin_.get<1>(), origin_.get<2>()};
+    auto h = std::array<CoordType, 3>{
+        voxel_size_.get<0>(), voxel_size_.get<1>(), voxel_size_.get<2>()
+    };
+
+    for(size_t d = 0; d < 3; ++d) {
+        auto t_low = std::floor((low[d] - o[d]) / h[d]);
+        auto t_high = std::floor((high[d] - o[d]) / h[d]);
+        auto n = CoordType(shape_[d]);
+
+        if(t_high < 0 || t_low >= n) {
+            return false;
+        }
+
+        range.low[d] = size_t(std::max(t_low, CoordType(0)));
+        range.high[d] = size_t(std::min(t_high, n - 1)) + 1;
+    }
+
+    return true;
+}
+
+inline size_t VoxelMask::count(const VoxelRange& range) const {
+    auto ny = shape_[1];
+    auto nz = shape_[2];
+    auto sv = [this, ny, nz](size_t i, size_t j, size_t k) {
+        return summed_volume_[(i * (ny + 1) + j) * (nz + 1) + k];
+    };
+
+    const auto& l = range.low;
+    const auto& u = range.high;
+    return std::uint32_t(sv(u[0], u[1], u[2])
+                         - sv(l[0], u[1], u[2]) - sv(u[0], l[1], u[2]) - sv(u[0], u[1], l[2])
+                         + sv(u[0], l[1], l[2]) + sv(l[0], u[1], l[2]) + sv(l[0], l[1], u[2])
+                         - sv(l[0], l[1], l[2]));
+}
+
+inline Box3D VoxelMask::voxel_box(size_t i, size_t j, size_t k) const {
+    auto h = Point3Dx(voxel_size_);
+    auto low = Point3Dx(origin_) + h * Point3D{CoordType(i), CoordType(j), CoordType(k)};
+    return Box3D(low, low + h);
+}
+
+template <class ShapeT>
+inline bool VoxelMask::intersects_voxels(ShapeT const& shape) const {
+    auto range = VoxelRange{};
+    auto box = shape.bounding_box();
+    if(!voxel_range(box, range)) {
+        return false;
+    }
+
+    auto n_set = count(range);
+    if(n_set == 0) {
+        return false;
+    }
+
+    // The shape lies in set voxels; and it isn't empty.
+    if(covers(box)) {
+        return true;
+    }
+
+    // Otherwise, every set voxel in the range is tested; a shape which
+    // intersects only some of them may touch any one of them.
+    for(size_t i = range.low[0]; i < range.high[0]; ++i) {
+        for(size_t j = range.low[1]; j < range.high[1]; ++j) {
+            for(size_t k = range.low[2]; k < range.high[2]; ++k) {
+                if(is_set(i, j, k) && shape.intersects(voxel_box(i, j, k))) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+
 // String representation
 
 inline std::ostream& operator<<(std::ostream& os, const Sphere& s) {
@@ -338,6 +916,19 @@ inline std::ostream& operator<<(std::ostream& os, const Cylinder& c) {
                  "radius=" << boost::format("%.3g") % c.radius << ')';
 }
 
+inline std::ostream& operator<<(std::ostream& os, const OrientedBox& b) {
+    return os << "OrientedBox(center=" << b.center << ", "
+                 "axes=(" << b.axes[0] << ", " << b.axes[1] << ", " << b.axes[2] << "), "
+                 "half_extents=" << b.half_extents << ')';
+}
+
+inline std::ostream& operator<<(std::ostream& os, const VoxelMask& m) {
+    const auto& shape = m.shape();
+    return os << "VoxelMask(origin=" << m.origin() << ", "
+                 "voxel_size=" << m.voxel_size() << ", "
+                 "shape=(" << shape[0] << ", " << shape[1] << ", " << shape[2] << "))";
+}
+
 }  // namespace brain_indexer
 
 namespace boost { namespace geometry { namespace model {
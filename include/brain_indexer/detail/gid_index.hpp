@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <type_traits>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief Header of the file written by `GidIndex::write`.
+struct GidIndexHeader {
+    static constexpr std::uint64_t current_version = 1;
+
+    char magic[8];
+    std::uint64_t version;
+    std::uint64_t entry_size;
+    std::uint64_t n_gids;
+    std::uint64_t n_entries;
+};
+
+static constexpr char gid_index_magic[8] = {'S', 'I', 'G', 'I', 'D', 'I', 'D', 'X'};
+
+inline std::string default_gid_index_relpath() {
+    return "gid_index.bin";
+}
+
+inline std::runtime_error invalid_gid_index(const std::string& reason) {
+    return std::runtime_error("Invalid gid index: " + reason);
+}
+
+template <class T>
+inline void write_gid_index_array(std::ostream& os, const std::vector<T>& array) {
+    os.write(reinterpret_cast<const char*>(array.data()),
+             std::streamsize(array.size() * sizeof(T)));
+}
+
+template <class T>
+inline std::vector<T> read_gid_index_array(std::istream& is, size_t n) {
+    auto array = std::vector<T>(n);
+    is.read(reinterpret_cast<char*>(array.data()), std::streamsize(n * sizeof(T)));
+
+    return array;
+}
+
+template <class T, class Enable = void>
+struct has_gid_method : std::false_type {};
+
+template <class T>
+struct has_gid_method<T, std::void_t<decltype(std::declval<const T&>().gid())>>
+    : std::true_type {};
+
+/** \brief Copies the elements of `gid` from the runs `[first, last)` of `subtree`.
+ *
+ *  If the subtree can be indexed by position, the runs are copied directly.
+ *  Otherwise, the subtree is queried once with the bounding box of all runs.
+ */
+template <class T, class SubTree>
+inline void append_gid_runs(const SubTree& subtree,
+                            const GidIndexEntry* first,
+                            const GidIndexEntry* last,
+                            identifier_t gid,
+                            std::vector<T>& values) {
+    using iterator = decltype(subtree.begin());
+    using category = typename std::iterator_traits<iterator>::iterator_category;
+
+    if constexpr (std::is_base_of<std::random_access_iterator_tag, category>::value) {
+        for(auto it = first; it != last; ++it) {
+            values.insert(values.end(),
+                          subtree.begin() + std::ptrdiff_t(it->first),
+                          subtree.begin() + std::ptrdiff_t(it->last));
+        }
+    } else {
+        auto bounds = first->bounds;
+        for(auto it = first; it != last; ++it) {
+            bg::expand(bounds, it->bounds);
+        }
+
+        subtree.query(
+            bgi::intersects(bounds) && bgi::satisfies([gid](const T& value) {
+                return element_gid(value) == gid;
+            }),
+            std::back_inserter(values)
+        );
+    }
+}
+
+/// \brief `get_by_gid` of a multi-index.
+struct MultiIndexGidQuery {
+    template <class T, class SubtreeCache>
+    static inline std::vector<T> get(const MultiIndexTree<T, SubtreeCache>& index,
+                                     const GidIndex& gid_index,
+                                     identifier_t gid) {
+        auto values = std::vector<T>{};
+
+        auto [first, last] = gid_index.entries(gid);
+        while(first != last) {
+            util::check_signals();
+
+            auto subtree_end = std::find_if(first, last, [first](const GidIndexEntry& entry) {
+                return entry.subtree_id != first->subtree_id;
+            });
+
+            auto subtree_id = IndexedSubtreeBox(first->subtree_id, first->subtree_size, first->bounds);
+            const auto& subtree = index.load_subtree(subtree_id);
+            append_gid_runs(deref_subtree(subtree), first, subtree_end, gid, values);
+
+            first = subtree_end;
+        }
+
+        return values;
+    }
+};
+
+/// \brief Record the gid index in the meta data of the multi-index in `output_dir`.
+inline void add_gid_index_to_meta_data(const std::string& output_dir, const std::string& relpath) {
+    auto meta_data_path = deduce_meta_data_path(output_dir);
+    auto meta_data = read_meta_data(meta_data_path);
+    meta_data[MetaDataConstants::multi_index_key][MetaDataConstants::gid_index_path_key] = relpath;
+    write_meta_data(meta_data_path, meta_data);
+}
+
+}  // namespace detail
+
+
+inline GidIndex::GidIndex(std::vector<GidIndexRun> runs) {
+    std::sort(runs.begin(), runs.end(), [](const GidIndexRun& a, const GidIndexRun& b) {
+        return std::tie(a.gid, a.entry.subtree_id, a.entry.first)
+               < std::tie(b.gid, b.entry.subtree_id, b.entry.first);
+    });
+
+    entries_.reserve(runs.size());
+    for(const auto& run : runs) {
+        if(gids_.empty() || gids_.back() != run.gid) {
+            gids_.push_back(run.gid);
+            offsets_.push_back(entries_.size());
+        }
+        entries_.push_back(run.entry);
+    }
+    offsets_.push_back(entries_.size());
+}
+
+
+inline std::pair<const GidIndexEntry*, const GidIndexEntry*>
+GidIndex::entries(identifier_t gid) const {
+    auto it = std::lower_bound(gids_.begin(), gids_.end(), gid);
+    if(it == gids_.end() || *it != gid) {
+        return {nullptr, nullptr};
+    }
+
+    auto k = size_t(it - gids_.begin());
+    return {entries_.data() + offsets_[k], entries_.data() + offsets_[k + 1]};
+}
+
+
+inline std::vector<size_t> GidIndex::subtree_ids(identifier_t gid) const {
+    auto ids = std::vector<size_t>{};
+
+    auto [first, last] = entries(gid);
+    for(auto it = first; it != last; ++it) {
+        if(ids.empty() || ids.back() != it->subtree_id) {
+            ids.push_back(it->subtree_id);
+        }
+    }
+
+    return ids;
+}
+
+
+inline void GidIndex::write(const std::string& filename) const {
+    using header_t = detail::GidIndexHeader;
+
+    auto header = header_t{};
+    std::memcpy(header.magic, detail::gid_index_magic, sizeof(header.magic));
+    header.version = header_t::current_version;
+    header.entry_size = sizeof(GidIndexEntry);
+    header.n_gids = gids_.size();
+    header.n_entries = entries_.size();
+
+    auto os = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    detail::write_gid_index_array(os, gids_);
+    detail::write_gid_index_array(os, offsets_);
+    detail::write_gid_index_array(os, entries_);
+
+    if(!os) {
+        throw std::runtime_error("Failed to write gid index: " + filename);
+    }
+}
+
+
+inline GidIndex GidIndex::read(const std::string& filename) {
+    using header_t = detail::GidIndexHeader;
+
+    auto is = util::open_ifstream(filename, std::ios::binary);
+
+    auto header = header_t{};
+    if(!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw detail::invalid_gid_index("the header is truncated");
+    }
+
+    if(std::memcmp(header.magic, detail::gid_index_magic, sizeof(header.magic)) != 0) {
+        throw detail::invalid_gid_index("wrong magic number");
+    }
+
+    if(header.version != header_t::current_version) {
+        throw detail::invalid_gid_index("unsupported version " + std::to_string(header.version));
+    }
+
+    if(header.entry_size != sizeof(GidIndexEntry)) {
+        throw detail::invalid_gid_index("the entries don't match");
+    }
+
+    auto gid_index = GidIndex{};
+    gid_index.gids_ = detail::read_gid_index_array<identifier_t>(is, header.n_gids);
+    gid_index.offsets_ = detail::read_gid_index_array<std::uint64_t>(is, header.n_gids + 1);
+    gid_index.entries_ = detail::read_gid_index_array<GidIndexEntry>(is, header.n_entries);
+    if(!is) {
+        throw detail::invalid_gid_index("the arrays are truncated");
+    }
+
+    if(gid_index.offsets_.front() != 0 || gid_index.offsets_.back() != header.n_entries
+       || !std::is_sorted(gid_index.offsets_.begin(), gid_index.offsets_.end())) {
+        throw detail::invalid_gid_index("inconsistent offsets");
+    }
+
+    return gid_index;
+}
+
+
+template <class T>
+inline identifier_t element_gid(const T& value) {
+    if constexpr (detail::has_gid_method<T>::value) {
+        return value.gid();
+    } else {
+        return value.post_gid();
+    }
+}
+
+template <class... Ts>
+inline identifier_t element_gid(const boost::variant<Ts...>& value) {
+    return boost::apply_visitor([](const auto& v) { return element_gid(v); }, value);
+}
+
+
+template <class SubTree>
+inline void collect_gid_runs(const SubTree& subtree,
+                             size_t subtree_id,
+                             std::vector<GidIndexRun>& runs) {
+    using value_type = typename SubTree::value_type;
+
+    auto n_before = runs.size();
+    std::uint64_t position = 0;
+    for(const auto& value : subtree) {
+        auto gid = element_gid(value);
+        Box3D box = bgi::indexable<value_type>{}(value);
+
+        if(runs.size() > n_before && runs.back().gid == gid) {
+            auto& entry = runs.back().entry;
+            entry.last = position + 1;
+            bg::expand(entry.bounds, box);
+        } else {
+            runs.push_back(GidIndexRun{
+                gid, GidIndexEntry{subtree_id, subtree.size(), position, position + 1, box}
+            });
+        }
+
+        ++position;
+    }
+}
+
+
+template <class Storage>
+inline GidIndex build_gid_index(const Storage& storage) {
+    auto runs = std::vector<GidIndexRun>{};
+    for(const auto& subtree_box : storage.load_top_tree()) {
+        util::check_signals();
+        collect_gid_runs(storage.load_subtree(subtree_box.id), subtree_box.id, runs);
+    }
+
+    return GidIndex(std::move(runs));
+}
+
+
+template <class Value, class Storage>
+inline void write_gid_index(const std::string& output_dir) {
+    static_assert(std::is_same<typename Storage::subtree_type::value_type, Value>::value,
+                  "The values must be of the same type as those in the subtrees.");
+
+    auto storage = open_multi_index_storage<Storage>(output_dir);
+    auto gid_index = build_gid_index(storage);
+
+    auto relpath = detail::default_gid_index_relpath();
+    gid_index.write(resolve_meta_data_path(output_dir, relpath));
+    detail::add_gid_index_to_meta_data(output_dir, relpath);
+}
+
+
+#if SI_MPI == 1
+template <class Value, class Storage>
+inline void write_gid_index(const std::string& output_dir, MPI_Comm comm) {
+    static_assert(std::is_same<typename Storage::subtree_type::value_type, Value>::value,
+                  "The values must be of the same type as those in the subtrees.");
+
+    auto comm_rank = size_t(mpi::rank(comm));
+    auto comm_size = size_t(mpi::size(comm));
+
+    // Every rank reads the same top-level tree; hence, the subtrees are
+    // visited in the same order on all ranks.
+    auto storage = open_multi_index_storage<Storage>(output_dir);
+    auto runs = std::vector<GidIndexRun>{};
+    size_t k = 0;
+    for(const auto& subtree_box : storage.load_top_tree()) {
+        if(k++ % comm_size == comm_rank) {
+            util::check_signals();
+            collect_gid_runs(storage.load_subtree(subtree_box.id), subtree_box.id, runs);
+        }
+    }
+
+    auto mpi_run = mpi::Datatype(mpi::create_contiguous_datatype<GidIndexRun>());
+    auto recv_counts = mpi::gather_counts(runs.size(), comm);
+    auto n_send = util::safe_integer_cast<int>(runs.size());
+
+    if(comm_rank == 0) {
+        auto recv_offsets = mpi::offsets_from_counts(recv_counts);
+        auto all_runs = std::vector<GidIndexRun>(
+            std::accumulate(recv_counts.begin(), recv_counts.end(), size_t(0))
+        );
+
+        MPI_Gatherv(
+            (void *)runs.data(), n_send, *mpi_run,
+            (void *)all_runs.data(), recv_counts.data(), recv_offsets.data(), *mpi_run,
+            /* root = */ 0,
+            comm
+        );
+
+        auto relpath = detail::default_gid_index_relpath();
+        GidIndex(std::move(all_runs)).write(resolve_meta_data_path(output_dir, relpath));
+        detail::add_gid_index_to_meta_data(output_dir, relpath);
+    } else {
+        MPI_Gatherv(
+            (void *)runs.data(), n_send, *mpi_run,
+            nullptr, nullptr, nullptr, MPI_DATATYPE_NULL,
+            /* root = */ 0,
+            comm
+        );
+    }
+
+    MPI_Barrier(comm);
+}
+#endif
+
+
+inline bool has_gid_index(const std::string& output_dir) {
+    auto meta_data = read_meta_data(output_dir);
+    const auto& section = meta_data[MetaDataConstants::multi_index_key];
+    return section.is_object() && section.contains(MetaDataConstants::gid_index_path_key);
+}
+
+
+inline GidIndex open_gid_index(const std::string& output_dir) {
+    auto meta_data = read_meta_data(output_dir);
+    const auto& section = meta_data[MetaDataConstants::multi_index_key];
+    if(!section.is_object() || !section.contains(MetaDataConstants::gid_index_path_key)) {
+        throw std::runtime_error("The multi-index has no gid index: " + output_dir);
+    }
+
+    auto relpath = section[MetaDataConstants::gid_index_path_key].get<std::string>();
+    return GidIndex::read(resolve_meta_data_path(output_dir, relpath));
+}
+
+
+template <class T, class SubtreeCache>
+inline std::vector<T> get_by_gid(const MultiIndexTree<T, SubtreeCache>& index,
+                                 const GidIndex& gid_index,
+                                 identifier_t gid) {
+    return detail::MultiIndexGidQuery::get(index, gid_index, gid);
+}
+
+}  // namespace brain_indexer
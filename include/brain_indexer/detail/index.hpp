@@ -2,13 +2,16 @@
 
 #include "../index.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/archive/binary_oarchive.hpp>
 #include <boost/iterator/function_output_iterator.hpp>
 
+#include <brain_indexer/native_rtree.hpp>
+
 #include "output_iterators.hpp"
 
 namespace brain_indexer {
@@ -66,6 +69,30 @@ inline std::string value_to_element_type<Synapse>() {
 }
 
 
+namespace detail {
+
+/** \brief The filter of `find_intersecting_filtered`.
+ *
+ *  The top-level tree of a multi-index is queried with the same predicates
+ *  as its subtrees; and any subtree might contain elements which pass.
+ */
+template <typename Filter>
+struct ElementFilter {
+    const Filter& filter;
+
+    template <typename Value>
+    inline bool operator()(const Value& value) const {
+        if constexpr (std::is_same<Value, IndexedSubtreeBox>::value) {
+            return true;
+        } else {
+            return filter(value);
+        }
+    }
+};
+
+}  // namespace detail
+
+
 /////////////////////////////////////////
 // class IndexTree
 /////////////////////////////////////////
@@ -76,13 +103,30 @@ inline void IndexTreeMixin<Derived, T>::find_intersecting(const ShapeT& shape,
                                                           const OutputIt& iter) const {
 
     const auto &derived = static_cast<const Derived&>(*this);
+    auto stats_scope = query_stats_scope();
+
     // Using a callback makes the query slightly faster than using qbegin()...qend()
-    auto real_intersects = [&shape](const auto &v) {
-        return geometry_intersects(shape, v, GeometryMode{});
-    };
+    derived.query(detail::intersects_predicate<GeometryMode, T>(shape), iter);
+}
+
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT, typename Filter, typename OutputIt>
+inline void IndexTreeMixin<Derived, T>::find_intersecting_filtered(const ShapeT& shape,
+                                                                   const Filter& filter,
+                                                                   const OutputIt& iter) const {
+
+    const auto &derived = static_cast<const Derived&>(*this);
+    auto stats_scope = query_stats_scope();
+
+    // The filter is a separate predicate; it's cheaper than the exact test, and
+    // `satisfies(real_intersects)` can still prune nodes, e.g. of an `OrientedBox`.
+    auto real_intersects = detail::GeometryIntersects<GeometryMode, ShapeT>{shape};
 
     derived.query(
-        bgi::intersects(bgi::indexable<ShapeT>{}(shape)) && bgi::satisfies(real_intersects),
+        bgi::intersects(bgi::indexable<ShapeT>{}(shape))
+            && bgi::satisfies(detail::ElementFilter<Filter>{filter})
+            && bgi::satisfies(real_intersects),
         iter);
 }
 
@@ -92,14 +136,95 @@ inline void IndexTreeMixin<Derived, T>::find_intersecting(const ShapeT& shape,
 template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline decltype(auto) 
-IndexTreeMixin<Derived, T>::find_intersecting_np(const ShapeT& shape) const {
+IndexTreeMixin<Derived, T>::find_intersecting_np(const ShapeT& shape,
+                                                 query_fields_t fields) const {
     using getter_t = iter_entry_getter<T>;
     typename getter_t::result_t result;
+    result.fields = fields;
     find_intersecting<GeometryMode>(shape, getter_t(result));
     return result;
 }
 
 
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT, typename Filter>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_intersecting_filtered_np(const ShapeT& shape,
+                                                          const Filter& filter,
+                                                          query_fields_t fields) const {
+    using getter_t = iter_entry_getter<T>;
+    typename getter_t::result_t result;
+    result.fields = fields;
+    find_intersecting_filtered<GeometryMode>(shape, filter, getter_t(result));
+    return result;
+}
+
+
+template <typename Derived, typename T>
+template <typename GeometryMode, typename ShapeT>
+inline decltype(auto)
+IndexTreeMixin<Derived, T>::find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                    size_t n_threads,
+                                                    query_fields_t fields) const {
+    detail::batch_query_result<T> result;
+    result.values.fields = fields;
+    result.offsets.reserve(shapes.size() + 1);
+    result.offsets.push_back(0);
+
+    size_t n_found = 0;
+    auto getter = iter_entry_getter<T>(result.values);
+    auto append = [&getter, &n_found](const auto& element) {
+        getter = element;
+        ++n_found;
+    };
+
+    if(!supports_concurrent_queries<Derived>::value || n_threads <= 1 || shapes.size() <= 1) {
+        auto collector = boost::make_function_output_iterator(append);
+        for(const auto& shape : shapes) {
+            find_intersecting<GeometryMode>(shape, collector);
+            result.offsets.push_back(n_found);
+        }
+
+        return result;
+    }
+
+    // Several chunks per thread, such that threads which are done early can
+    // pick up work from threads that hit expensive queries.
+    auto n_queries = shapes.size();
+    auto n_chunks = std::min(n_queries, 8 * n_threads);
+
+    auto chunk_matches = std::vector<std::vector<T>>(n_chunks);
+    auto chunk_counts = std::vector<std::vector<size_t>>(n_chunks);
+
+    util::parallel_for(n_chunks, n_threads, [&](size_t k_chunk) {
+        auto range = util::balanced_chunks(n_queries, n_chunks, k_chunk);
+        auto& matches = chunk_matches[k_chunk];
+        auto& counts = chunk_counts[k_chunk];
+
+        counts.reserve(range.high - range.low);
+        for(size_t i = range.low; i < range.high; ++i) {
+            auto n_before = matches.size();
+            find_intersecting<GeometryMode>(shapes[i], std::back_inserter(matches));
+            counts.push_back(matches.size() - n_before);
+        }
+    });
+
+    for(size_t k_chunk = 0; k_chunk < n_chunks; ++k_chunk) {
+        auto matches = std::move(chunk_matches[k_chunk]);
+
+        size_t j = 0;
+        for(auto count : chunk_counts[k_chunk]) {
+            for(size_t l = 0; l < count; ++l, ++j) {
+                append(matches[j]);
+            }
+            result.offsets.push_back(n_found);
+        }
+    }
+
+    return result;
+}
+
+
 template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline size_t IndexTreeMixin<Derived, T>::count_intersecting(const ShapeT& shape) const {
@@ -116,15 +241,15 @@ template <typename Derived, typename T>
 template <typename GeometryMode, typename ShapeT>
 inline std::unordered_map<identifier_t, size_t>
 IndexTreeMixin<Derived, T>::count_intersecting_agg_gid(const ShapeT& shape) const {
-    std::unordered_map<identifier_t, size_t> counts;
+    util::FlatCounter<identifier_t> counts;
     auto counter = boost::make_function_output_iterator(
         [&counts](const auto& elem) {
-            counts[elem.post_gid()] += 1;
+            counts.add(elem.post_gid());
         }
     );
 
     find_intersecting<GeometryMode>(shape, counter);
-    return counts;
+    return counts.to_unordered_map();
 }
 
 template <typename Derived, typename T>
@@ -132,10 +257,13 @@ template <typename ShapeT>
 inline decltype(auto) IndexTreeMixin<Derived, T>::find_nearest(const ShapeT& shape,
                                                                unsigned k_neighbors) const {
     const auto& derived = static_cast<const Derived&>(*this);
+    auto stats_scope = query_stats_scope();
 
     using ids_getter = typename detail::id_getter_for<T>::type;
     std::vector<typename ids_getter::value_type> ids;
     derived.query(bgi::nearest(shape, k_neighbors), ids_getter(ids));
+
+    SI_QUERY_STATS_ADD(hits, ids.size());
     return ids;
 }
 
@@ -146,8 +274,7 @@ inline IndexTree<T, A>::IndexTree(const std::string& path) {
     auto filename = resolve_heavy_data_path(path, MetaDataConstants::in_memory_key);
 
     auto ifs = util::open_ifstream(filename, std::ios::binary);
-    boost::archive::binary_iarchive ia(ifs);
-    ia >> *this;
+    load_rtree(*this, ifs);
 }
 
 
@@ -158,8 +285,7 @@ inline void IndexTree<T, A>::dump(const std::string& index_path) const {
     auto heavy_data_relpath = "index.spi";
     auto filename = join_path(index_path, heavy_data_relpath);
     auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
-    boost::archive::binary_oarchive oa(ofs);
-    oa << *this;
+    save_rtree(*this, ofs);
 
     auto element_type = value_to_element_type<T>();
     auto meta_data = create_basic_meta_data(element_type);
@@ -177,15 +303,118 @@ inline void IndexTree<T, A>::dump(const std::string& index_path) const {
 template <typename T, typename A>
 template <typename GeometryMode, typename ShapeT>
 inline bool IndexTree<T, A>::is_intersecting(const ShapeT& shape) const {
-    auto real_intersects = [&shape](const auto& v) {
-        return geometry_intersects(shape, v, GeometryMode{});
-    };
+    auto stats_scope = this->query_stats_scope();
+    auto it = this->qbegin(detail::intersects_predicate<GeometryMode, T>(shape));
+
+    return it != this->qend();
+}
+
+
+namespace detail {
+
+/** \brief Counts the elements below `node` which intersect `shape`.
+ *
+ *  If `is_contained`, the node lies inside `shape` and every element is
+ *  counted; otherwise only nodes which lie inside `shape` skip the test.
+ */
+template <class GeometryMode, class MembersHolder, class ShapeT>
+inline size_t count_intersecting_below(typename MembersHolder::node_pointer node,
+                                       size_t level,
+                                       size_t leafs_level,
+                                       const ShapeT& shape,
+                                       bool is_contained) {
+    namespace rtree = bgi::detail::rtree;
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+    using value_type = typename MembersHolder::value_type;
+
+    if(level == leafs_level) {
+        const auto& elements = rtree::elements(rtree::get<leaf>(*node));
+        if(is_contained) {
+            SI_QUERY_STATS_ADD(hits, elements.size());
+            return elements.size();
+        }
+
+        const auto query_box = bgi::indexable<ShapeT>{}(shape);
+        size_t count = 0;
+        for(const auto& value : elements) {
+            if(!bg::intersects(query_box, bgi::indexable<value_type>{}(value))) {
+                continue;
+            }
 
-    auto it = this->qbegin(
-        bgi::intersects(bgi::indexable<ShapeT>{}(shape)) && bgi::satisfies(real_intersects)
+            if constexpr (is_decided_by_bounding_box<GeometryMode, ShapeT, value_type>()) {
+                ++count;
+            } else {
+                if(std::is_same<GeometryMode, BestEffortGeometry>::value) {
+                    SI_QUERY_STATS_ADD(exact_tests, 1);
+                }
+
+                if(geometry_intersects(shape, value, GeometryMode{})) {
+                    ++count;
+                }
+            }
+        }
+
+        SI_QUERY_STATS_ADD(nodes_visited, 1);
+        SI_QUERY_STATS_ADD(leaves_tested, 1);
+        SI_QUERY_STATS_ADD(hits, count);
+        return count;
+    }
+
+    const auto& elements = rtree::elements(rtree::get<internal_node>(*node));
+    if(!is_contained) {
+        SI_QUERY_STATS_ADD(nodes_visited, 1);
+    }
+
+    size_t count = 0;
+    for(const auto& [box, child] : elements) {
+        if(is_contained) {
+            count += count_intersecting_below<GeometryMode, MembersHolder>(
+                child, level + 1, leafs_level, shape, true
+            );
+        } else if(bg::intersects(bgi::indexable<ShapeT>{}(shape), box)
+                  && may_intersect(shape, box)) {
+            auto is_child_contained = std::is_same<GeometryMode, BoundingBoxGeometry>::value
+                                      && strictly_contains(shape, box);
+
+            count += count_intersecting_below<GeometryMode, MembersHolder>(
+                child, level + 1, leafs_level, shape, is_child_contained
+            );
+        }
+    }
+
+    return count;
+}
+
+/** \brief Counts the elements of `tree` which intersect `shape`.
+ *
+ *  Unlike a query, nodes which lie inside `shape` are counted without
+ *  testing their elements, if `GeometryMode` is `BoundingBoxGeometry`.
+ */
+template <class GeometryMode, class ShapeT, class... Args>
+inline size_t count_intersecting_rtree(const bgi::rtree<Args...>& tree, const ShapeT& shape) {
+    using view = bgi::detail::rtree::const_private_view<bgi::rtree<Args...>>;
+    using members_holder = typename view::members_holder;
+
+    view tree_view(tree);
+    const auto& members = tree_view.members();
+    if(members.values_count == 0) {
+        return 0;
+    }
+
+    return count_intersecting_below<GeometryMode, members_holder>(
+        members.root, 0, members.leafs_level, shape, false
     );
+}
 
-    return it != this->qend();
+}  // namespace detail
+
+
+template <typename T, typename A>
+template <typename GeometryMode, typename ShapeT>
+inline size_t IndexTree<T, A>::count_intersecting(const ShapeT& shape) const {
+    auto stats_scope = this->query_stats_scope();
+    return detail::count_intersecting_rtree<GeometryMode>(static_cast<const super&>(*this), shape);
 }
 
 
@@ -199,53 +428,235 @@ IndexTree<T, A>::find_intersecting_objs(const ShapeT& shape) const {
 }
 
 
+namespace detail {
+
+/// \brief The coordinates of `p`, to loop over the axes.
+inline std::array<CoordType, 3> coordinates(const Point3D& p) {
+    return {p.get<0>(), p.get<1>(), p.get<2>()};
+}
+
+/// \brief The extent of the bounding box of `shape` along every axis.
+template <class ShapeT>
+inline std::array<CoordType, 3> shape_extent(const ShapeT& shape) {
+    auto box = Box3D(bgi::indexable<ShapeT>{}(shape));
+    return coordinates(Point3Dx(box.max_corner()) - box.min_corner());
+}
+
+
+template <class T, class ShapeT>
+inline PlacementGrid<T, ShapeT>::PlacementGrid(const Box3D& region,
+                                               const ShapeT& shape,
+                                               std::vector<T> elements)
+    : shape_(shape)
+    , region_min_(coordinates(region.min_corner()))
+    , extent_(shape_extent(shape))
+    , pending_(std::move(elements)) {
+
+    auto region_max = coordinates(region.max_corner());
+    auto diff = std::array<CoordType, 3>{};
+    for(size_t d = 0; d < 3; ++d) {
+        diff[d] = region_max[d] - region_min_[d];
+    }
+
+    auto max_diff = *std::max_element(diff.begin(), diff.end());
+    auto min_extent = *std::min_element(extent_.begin(), extent_.end());
+    auto spacing = std::min(max_diff / 8,
+                            std::max(min_extent / 2, max_diff / CoordType(max_steps_per_dim)));
+
+    size_t n_positions = 1;
+    for(size_t d = 0; d < 3; ++d) {
+        n_steps_[d] = spacing > 0 ? std::max(size_t(1), size_t(diff[d] / spacing)) : 1;
+        step_[d] = diff[d] / CoordType(n_steps_[d]);
+        n_positions *= n_steps_[d];
+    }
+
+    occupied_.assign(n_positions, 0);
+
+    // The shape is kept at the first position.
+    auto shape_min = coordinates(Box3D(bgi::indexable<ShapeT>{}(shape)).min_corner());
+    shape_.translate(Point3D{region_min_[0] - shape_min[0],
+                             region_min_[1] - shape_min[1],
+                             region_min_[2] - shape_min[2]});
+
+    std::stable_sort(pending_.begin(), pending_.end(), [this](const T& a, const T& b) {
+        return first_slab(a) < first_slab(b);
+    });
+}
+
+template <class T, class ShapeT>
+inline size_t PlacementGrid<T, ShapeT>::first_slab(const T& value) const {
+    if(step_[0] <= 0) {
+        return 0;
+    }
+
+    auto box_min = Box3D(bgi::indexable<T>{}(value)).min_corner().template get<0>();
+    auto first = std::floor((box_min - extent_[0] - region_min_[0]) / step_[0]);
+
+    return size_t(std::max(first, CoordType(0)));
+}
+
+template <class T, class ShapeT>
+inline Point3D PlacementGrid<T, ShapeT>::offset(size_t position) const {
+    auto k = position % n_steps_[2];
+    auto j = (position / n_steps_[2]) % n_steps_[1];
+    auto i = position / (n_steps_[2] * n_steps_[1]);
+
+    return Point3D{CoordType(i) * step_[0], CoordType(j) * step_[1], CoordType(k) * step_[2]};
+}
+
+template <class T, class ShapeT>
+inline void PlacementGrid<T, ShapeT>::add(const T& value) {
+    auto box = Box3D(bgi::indexable<T>{}(value));
+    auto box_min = coordinates(box.min_corner());
+    auto box_max = coordinates(box.max_corner());
+
+    // The range of positions along every axis at which the bounding boxes
+    // might overlap; rounded outwards, the exact test follows.
+    auto low = std::array<size_t, 3>{};
+    auto high = std::array<size_t, 3>{};
+    for(size_t d = 0; d < 3; ++d) {
+        if(step_[d] <= 0) {
+            low[d] = 0;
+            high[d] = 0;
+            continue;
+        }
+
+        auto first = std::floor((box_min[d] - extent_[d] - region_min_[d]) / step_[d]);
+        auto last = std::ceil((box_max[d] - region_min_[d]) / step_[d]);
+        if(last < 0 || first > CoordType(n_steps_[d] - 1)) {
+            return;
+        }
+
+        low[d] = size_t(std::max(first, CoordType(0)));
+        high[d] = std::min(size_t(last), n_steps_[d] - 1);
+    }
+
+    for(size_t i = low[0]; i <= high[0]; ++i) {
+        for(size_t j = low[1]; j <= high[1]; ++j) {
+            for(size_t k = low[2]; k <= high[2]; ++k) {
+                auto position = (i * n_steps_[1] + j) * n_steps_[2] + k;
+                if(occupied_[position]) {
+                    continue;
+                }
+
+                auto moved = shape_;
+                moved.translate(offset(position));
+                occupied_[position] = bg::intersects(bgi::indexable<ShapeT>{}(moved), box)
+                                      && geometry_intersects(moved, value, BestEffortGeometry{});
+            }
+        }
+    }
+}
+
+template <class T, class ShapeT>
+inline bool PlacementGrid<T, ShapeT>::next_free(ShapeT& shape) {
+    auto slab_size = n_steps_[1] * n_steps_[2];
+    for(; first_free_ < occupied_.size(); ++first_free_) {
+        // Positions in this slab are final once all elements reaching it
+        // are rasterized.
+        auto slab = first_free_ / slab_size;
+        while(n_rasterized_ < pending_.size() && first_slab(pending_[n_rasterized_]) <= slab) {
+            add(pending_[n_rasterized_]);
+            ++n_rasterized_;
+        }
+
+        if(!occupied_[first_free_]) {
+            break;
+        }
+    }
+
+    if(first_free_ == occupied_.size()) {
+        return false;
+    }
+
+    auto target = Point3Dx{region_min_[0], region_min_[1], region_min_[2]} + offset(first_free_);
+    auto shape_min = Box3D(bgi::indexable<ShapeT>{}(shape)).min_corner();
+    shape.translate(target - shape_min);
+
+    return true;
+}
+
+}  // namespace detail
+
+
 template <typename T, typename A>
 template <typename ShapeT>
 inline bool IndexTree<T, A>::place(const Box3D& region, ShapeT& shape) {
-    // Align shape bbox to region bbox
-    const Box3D region_bbox = bgi::indexable<Box3D>{}(region);
-    const Box3D bbox = bgi::indexable<ShapeT>{}(shape);
-    Point3Dx offset = Point3Dx(region_bbox.min_corner()) - bbox.min_corner();
-    shape.translate(offset);
-
-    // Reset offsets. We require previous offset to make relative geometric translations
-    offset = {.0, .0, .0};
-    Point3Dx previous_offset{.0, .0, .0};
-
-    // Calc iteration step. We are doing at most 8 steps in each direction
-    // Worst case is user provides a cubic region and shape fits in the very end -> 512 iters
-    const Point3Dx diffs = Point3Dx(region_bbox.max_corner()) - region_bbox.min_corner();
-    const CoordType base_step = std::max(std::max(diffs.get<0>(), diffs.get<1>()), diffs.get<2>())
-                                / 8;
-    const int nsteps[] = {int(diffs.get<0>() / base_step),
-                          int(diffs.get<1>() / base_step),
-                          int(diffs.get<2>() / base_step)};
-    const CoordType step[] = {diffs.get<0>() / nsteps[0],
-                              diffs.get<1>() / nsteps[1],
-                              diffs.get<2>() / nsteps[2]};
-
-    // Loop and Test for each step
-    for (int x_i = 0; x_i < nsteps[0]; x_i++) {
-        offset.set<1>(0.);
-
-        for (int y_i = 0; y_i < nsteps[1]; y_i++) {
-            offset.set<2>(0.);
-
-            for (int z_i = 0; z_i < nsteps[2]; z_i++) {
-                shape.translate(offset - previous_offset);
-                if (!is_intersecting<BestEffortGeometry>(shape)) {
-                    this->insert(shape);
-                    return true;
+    auto shapes = std::vector<ShapeT>{shape};
+    auto is_placed = place_batch(region, shapes);
+    shape = shapes[0];
+
+    return is_placed[0];
+}
+
+
+template <typename T, typename A>
+template <typename ShapeT>
+inline std::vector<bool> IndexTree<T, A>::place_batch(const Box3D& region,
+                                                      std::vector<ShapeT>& shapes) {
+    // Any shape placed in `region` lies inside `domain`, hence only the
+    // elements intersecting `domain` can be in the way.
+    auto max_extent = Point3Dx{0, 0, 0};
+    for(const auto& shape : shapes) {
+        auto extent = detail::shape_extent(shape);
+        max_extent = max(max_extent, Point3D{extent[0], extent[1], extent[2]});
+    }
+    auto domain = Box3D{region.min_corner(), Point3Dx(region.max_corner()) + max_extent};
+
+    // The elements near the region are only queried once a shape doesn't
+    // fit at the first position; the shapes placed after that are added.
+    auto nearby = std::vector<T>{};
+    bool has_nearby = false;
+
+    auto grid = std::unique_ptr<detail::PlacementGrid<T, ShapeT>>{};
+    auto is_placed = std::vector<bool>(shapes.size(), false);
+    for(size_t i = 0; i < shapes.size(); ++i) {
+        auto& shape = shapes[i];
+
+        // Consecutive shapes of the same size share the grid. Otherwise, the
+        // first position of the grid is tried before building it.
+        if(grid == nullptr || grid->extent() != detail::shape_extent(shape)) {
+            grid = nullptr;
+
+            auto shape_min = Box3D(bgi::indexable<ShapeT>{}(shape)).min_corner();
+            shape.translate(Point3Dx(region.min_corner()) - shape_min);
+            is_placed[i] = !this->template is_intersecting<BestEffortGeometry>(shape);
+
+            if(!is_placed[i]) {
+                if(!has_nearby) {
+                    this->query(bgi::intersects(domain), std::back_inserter(nearby));
+                    has_nearby = true;
                 }
-                previous_offset = offset;
-                offset.set<2>(offset.get<2>() + step[2]);
+
+                grid = std::make_unique<detail::PlacementGrid<T, ShapeT>>(region, shape, nearby);
+            }
+        }
+
+        // The grid was computed for a shape of the same size, which might
+        // not be quite the same shape; hence the final test.
+        while(!is_placed[i] && grid->next_free(shape)) {
+            if(!this->template is_intersecting<BestEffortGeometry>(shape)) {
+                is_placed[i] = true;
+                break;
+            }
+
+            grid->mark_occupied();
+        }
+
+        if(is_placed[i]) {
+            this->insert(shape);
+
+            auto value = T(shape);
+            if(has_nearby) {
+                nearby.push_back(value);
+            }
+            if(grid != nullptr) {
+                grid->add(value);
             }
-            offset.set<1>(offset.get<1>() + step[1]);
         }
-        offset.set<0>(offset.get<0>() + step[0]);
     }
 
-    return false;
+    return is_placed;
 }
 
 
@@ -339,6 +750,9 @@ struct indexable_with_bounding_box {
 
 template<> struct indexable<Sphere> : public indexable_with_bounding_box<Sphere> {};
 template<> struct indexable<Cylinder> : public indexable_with_bounding_box<Cylinder> {};
+template<> struct indexable<OrientedBox> : public indexable_with_bounding_box<OrientedBox> {};
+template<> struct indexable<ConvexPolytope> : public indexable_with_bounding_box<ConvexPolytope> {};
+template<> struct indexable<VoxelMask> : public indexable_with_bounding_box<VoxelMask> {};
 template<> struct indexable<IndexedSphere> : public indexable_with_bounding_box<IndexedSphere> {};
 template<> struct indexable<Synapse> : public indexable_with_bounding_box<Synapse> {};
 template<> struct indexable<Soma> : public indexable_with_bounding_box<Soma> {};
@@ -370,6 +784,38 @@ struct indexable<boost::variant<VariantArgs...>> {
 };
 
 
+namespace detail {
+
+// A query by an oriented box, a polytope or a voxel mask is
+// `intersects(bounding_box)` and `satisfies(GeometryIntersects{shape})`. Here
+// the latter also prunes nodes, by `may_intersect(shape, node_box)`.
+struct region_bounds_check {
+    template <typename Predicate, typename Value, typename Box, typename Strategy>
+    static inline bool apply(Predicate const& p, Value const&, Box const& box, Strategy const&) {
+        return ::brain_indexer::may_intersect(p.fun.shape, box);
+    }
+};
+
+template <typename GeometryMode>
+struct predicate_check<
+    predicates::satisfies<::brain_indexer::detail::GeometryIntersects<GeometryMode, OrientedBox>,
+                          false>,
+    bounds_tag> : public region_bounds_check {};
+
+template <typename GeometryMode>
+struct predicate_check<
+    predicates::satisfies<::brain_indexer::detail::GeometryIntersects<GeometryMode, ConvexPolytope>,
+                          false>,
+    bounds_tag> : public region_bounds_check {};
+
+template <typename GeometryMode>
+struct predicate_check<
+    predicates::satisfies<::brain_indexer::detail::GeometryIntersects<GeometryMode, VoxelMask>,
+                          false>,
+    bounds_tag> : public region_bounds_check {};
+
+}  // namespace detail
+
 }  // namespace index
 }  // namespace geometry
 }  // namespace boost
@@ -2,6 +2,8 @@
 
 #include "../index_bulk_builder.hpp"
 
+#include <brain_indexer/query_ordering.hpp>
+
 namespace brain_indexer {
 
 template <class Value>
@@ -33,12 +35,59 @@ inline size_t IndexBulkBuilderBase<Value>::size() const {
 }
 
 
+template <class Value>
+inline void
+IndexBulkBuilderBase<Value>::sort_along_space_filling_curve(int n_bits, size_t n_threads) {
+    auto n_values = values_.size();
+    auto centroids = std::vector<Point3Dx>(n_values);
+    auto n_chunks = experimental::detail::ordering_chunk_count(n_values, n_threads);
+    util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+        auto [low, high] = util::balanced_chunks(n_values, n_chunks, k);
+        for(size_t i = low; i < high; ++i) {
+            centroids[i] = get_centroid(values_[i]);
+        }
+    });
+
+    auto order = experimental::space_filling_order(centroids, n_bits, n_threads);
+
+    auto sorted_values = std::vector<Value>{};
+    sorted_values.reserve(n_values);
+    for(auto i : order) {
+        sorted_values.push_back(std::move(values_[i]));
+    }
+
+    values_ = std::move(sorted_values);
+}
+
+
+namespace detail {
+
+template <class... Args>
+std::true_type is_bgi_rtree_impl(const bgi::rtree<Args...>*);
+
+std::false_type is_bgi_rtree_impl(const void*);
+
+/// \brief Is `Index` a `bgi::rtree`, or derived from one.
+template <class Index>
+using is_bgi_rtree = decltype(is_bgi_rtree_impl(std::declval<const Index*>()));
+
+} // namespace detail
+
+
 template <class Index, class Value>
-inline void IndexBulkBuilder<Index, Value>::finalize() {
+inline void IndexBulkBuilder<Index, Value>::finalize(size_t n_threads) {
     size_t n_values = this->values_.size();
     this->n_total_values_ = n_values;
 
-    index_ = Index(this->values_);
+    if constexpr (detail::is_bgi_rtree<Index>::value) {
+        auto index = Index{};
+        bulk_load_rtree(index, this->values_, n_threads);
+        index_ = std::move(index);
+    } else if constexpr (std::is_same<Index, PackedIndexTree<Value>>::value) {
+        index_ = Index(this->values_.begin(), this->values_.end(), PackedLeafFormat::full, n_threads);
+    } else {
+        index_ = Index(this->values_);
+    }
 }
 
 template <class Index, class Value>
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/detail/tree_nodes.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+template <class Nodes, class Enable = void>
+struct has_n_values_below : std::false_type {};
+
+template <class Nodes>
+struct has_n_values_below<Nodes,
+                          std::void_t<decltype(std::declval<const Nodes&>().n_values_below(
+                              std::declval<typename Nodes::node_type>()))>> : std::true_type {};
+
+/// \brief Every value is one element.
+struct CountValues {
+    template <class Value>
+    inline size_t operator()(const Value& /* value */) const {
+        return 1;
+    }
+};
+
+/// \brief The number of elements below `n`, where a value stands for `value_count(value)`.
+template <class Nodes, class ValueCount>
+inline size_t count_values_below(const Nodes& nodes,
+                                 const typename Nodes::node_type& n,
+                                 const ValueCount& value_count) {
+    constexpr bool counts_values = std::is_same<ValueCount, CountValues>::value;
+
+    if constexpr (counts_values && has_n_values_below<Nodes>::value) {
+        return nodes.n_values_below(n);
+    } else {
+        size_t count = 0;
+        if(nodes.is_leaf(n)) {
+            if constexpr (counts_values) {
+                count = nodes.n_values(n);
+            } else {
+                nodes.for_each_value(n, [&](const auto& value) {
+                    count += value_count(value);
+                });
+            }
+        } else {
+            nodes.for_each_child(n, [&](const Box3D& /* box */, const auto& child) {
+                count += count_values_below(nodes, child, value_count);
+            });
+        }
+
+        return count;
+    }
+}
+
+template <class Nodes>
+using level_of_detail_level = std::vector<std::pair<Box3D, typename Nodes::node_type>>;
+
+/** \brief The deepest level of one tree with at most `max_results` nodes intersecting `shape`.
+ *
+ *  All leaves are on the same level. Hence, once the level consists of
+ *  leaves, their values which intersect `shape` are appended to `values`,
+ *  if there are at most `max_results` of them.
+ *
+ *  \returns true if the values fit, and false if `level` is to be
+ *           summarized instead.
+ */
+template <class GeometryMode, class Nodes, class ShapeT>
+inline bool find_level_of_detail_tree(const Nodes& nodes,
+                                      const ShapeT& shape,
+                                      size_t max_results,
+                                      std::vector<typename Nodes::value_type>& values,
+                                      level_of_detail_level<Nodes>& level) {
+    using value_type = typename Nodes::value_type;
+
+    level.clear();
+    if(max_results == 0 || nodes.empty()) {
+        return true;
+    }
+
+    auto query_box = Box3D(bgi::indexable<ShapeT>{}(shape));
+    auto is_visible = [&shape, &query_box](const Box3D& box) {
+        return bg::intersects(query_box, box) && may_intersect(shape, box);
+    };
+
+    if(!is_visible(nodes.bounds())) {
+        return true;
+    }
+    level.emplace_back(nodes.bounds(), nodes.root());
+
+    auto next = level_of_detail_level<Nodes>{};
+    while(!level.empty() && !nodes.is_leaf(level.front().second)) {
+        next.clear();
+        for(const auto& [box, node] : level) {
+            nodes.for_each_child(node, [&](const Box3D& child_box, const auto& child) {
+                if(is_visible(child_box)) {
+                    next.emplace_back(child_box, child);
+                }
+            });
+        }
+
+        if(next.size() > max_results) {
+            return false;
+        }
+        std::swap(level, next);
+    }
+
+    auto is_hit = GeometryIntersects<GeometryMode, ShapeT>{shape};
+    auto n_before = values.size();
+    for(const auto& [box, node] : level) {
+        nodes.for_each_value(node, [&](const value_type& value) {
+            if(values.size() - n_before <= max_results
+               && bg::intersects(query_box, bgi::indexable<value_type>{}(value))
+               && is_hit(value)) {
+                values.push_back(value);
+            }
+        });
+
+        if(values.size() - n_before > max_results) {
+            values.erase(values.begin() + long(n_before), values.end());
+            return false;
+        }
+    }
+
+    level.clear();
+    return true;
+}
+
+template <class Nodes, class ValueCount>
+inline void append_node_summaries(const Nodes& nodes,
+                                  const level_of_detail_level<Nodes>& level,
+                                  const ValueCount& value_count,
+                                  std::vector<NodeSummary>& summaries) {
+    for(const auto& [box, node] : level) {
+        auto centroid = Point3D{};
+        bg::centroid(box, centroid);
+        auto count = count_values_below(nodes, node, value_count);
+        summaries.push_back(NodeSummary{box, centroid, count});
+    }
+}
+
+
+/// \brief `find_level_of_detail` of a multi-index.
+struct MultiIndexLevelOfDetailQuery {
+    template <class GeometryMode, class T, class SubtreeCache, class ShapeT>
+    static inline LevelOfDetail<T> find(const MultiIndexTree<T, SubtreeCache>& index,
+                                        const ShapeT& shape,
+                                        size_t max_results) {
+        using subtree_id_type = typename MultiIndexTree<T, SubtreeCache>::toptree_type::value_type;
+
+        auto result = LevelOfDetail<T>{};
+
+        // The subtrees are the values of the top tree.
+        auto top_nodes = make_tree_nodes(index.top_rtree);
+        auto top_level = level_of_detail_level<decltype(top_nodes)>{};
+        auto subtrees = std::vector<subtree_id_type>{};
+        if(!find_level_of_detail_tree<BoundingBoxGeometry>(
+               top_nodes, shape, max_results, subtrees, top_level)) {
+            auto n_elements = [](const subtree_id_type& subtree) {
+                return subtree.n_elements;
+            };
+            append_node_summaries(top_nodes, top_level, n_elements, result.nodes);
+
+            ++index.query_count;
+            return result;
+        }
+
+        // Every subtree gets one result, and the rest is split by size.
+        size_t n_total = 0;
+        for(const auto& subtree : subtrees) {
+            n_total += subtree.n_elements;
+        }
+
+        auto n_spare = static_cast<long double>(max_results - subtrees.size());
+        auto budgets = std::vector<size_t>{};
+        for(const auto& subtree : subtrees) {
+            auto share = n_total == 0
+                ? 0.0L
+                : n_spare * static_cast<long double>(subtree.n_elements)
+                      / static_cast<long double>(n_total);
+            budgets.push_back(1 + static_cast<size_t>(share));
+        }
+
+        // The budget a subtree doesn't use is passed on to the next one.
+        size_t k = 0;
+        size_t n_unused = 0;
+        index.for_each_subtree(subtrees, [&](const auto& subtree) {
+            auto budget = budgets[k] + n_unused;
+            auto n_before = result.size();
+
+            auto nodes = make_tree_nodes(subtree);
+            auto level = level_of_detail_level<decltype(nodes)>{};
+            if(!find_level_of_detail_tree<GeometryMode>(
+                   nodes, shape, budget, result.values, level)) {
+                append_node_summaries(nodes, level, CountValues{}, result.nodes);
+            }
+
+            n_unused = budget - (result.size() - n_before);
+            ++k;
+        });
+
+        ++index.query_count;
+        return result;
+    }
+};
+
+
+template <class GeometryMode, class Index, class ShapeT>
+inline LevelOfDetail<typename Index::value_type>
+find_level_of_detail_impl(const Index& index, const ShapeT& shape, size_t max_results) {
+    auto result = LevelOfDetail<typename Index::value_type>{};
+
+    auto nodes = make_tree_nodes(index);
+    auto level = level_of_detail_level<decltype(nodes)>{};
+    if(!find_level_of_detail_tree<GeometryMode>(nodes, shape, max_results, result.values, level)) {
+        append_node_summaries(nodes, level, CountValues{}, result.nodes);
+    }
+
+    return result;
+}
+
+template <class GeometryMode, class T, class SubtreeCache, class ShapeT>
+inline LevelOfDetail<T>
+find_level_of_detail_impl(const MultiIndexTree<T, SubtreeCache>& index,
+                          const ShapeT& shape,
+                          size_t max_results) {
+    return MultiIndexLevelOfDetailQuery::find<GeometryMode>(index, shape, max_results);
+}
+
+}  // namespace detail
+
+
+template <class GeometryMode, class Index, class ShapeT>
+inline LevelOfDetail<typename Index::value_type>
+find_level_of_detail(const Index& index, const ShapeT& shape, size_t max_results) {
+    return detail::find_level_of_detail_impl<GeometryMode>(index, shape, max_results);
+}
+
+}  // namespace brain_indexer
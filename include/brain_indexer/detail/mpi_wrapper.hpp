@@ -115,29 +115,38 @@ compute_balance_send_counts(const std::vector<size_t>& counts_per_rank, int mpi_
 
     auto balanced_count_per_rank = util::balanced_chunk_sizes(global_count, comm_size);
 
-    // Stores the number of values to be sent to each MPI rank.
-    auto send_counts = std::vector<int>(comm_size, 0);
-
     // Global index of beginning & end (exclusive) of the balanced chunk
     // of MPI rank `i`.
-    size_t balanced_start = 0ul, balanced_end = 0ul;
+    auto boundaries = std::vector<size_t>(comm_size + 1, 0ul);
+    std::partial_sum(balanced_count_per_rank.begin(),
+                     balanced_count_per_rank.end(),
+                     boundaries.begin() + 1);
+
+    return compute_send_counts(boundaries, local_start, local_end);
+}
 
-    // For every MPI rank compute if the balanced index interval overlaps
-    // with the current index interval stored on this MPI rank. The element
-    // be sent are the intersection of the two intervals
+
+inline std::vector<int>
+compute_send_counts(const std::vector<size_t>& boundaries, size_t local_start, size_t local_end) {
+    auto comm_size = boundaries.size() - 1;
+
+    // Stores the number of values to be sent to each MPI rank.
+    auto send_counts = std::vector<int>(comm_size, 0);
+
+    // For every MPI rank compute if its index interval overlaps with the
+    // current index interval stored on this MPI rank. The element be sent
+    // are the intersection of the two intervals
     //    [local_start, local_end)
-    //    [balanced_start, balanced_end)
+    //    [boundaries[i], boundaries[i+1])
     for (size_t i = 0ul; i < comm_size; i++) {
-        balanced_end += balanced_count_per_rank[i];
+        auto start = boundaries[i];
+        auto end = boundaries[i+1];
 
-        if (balanced_start < local_end && local_start < balanced_end) {
+        if (start < local_end && local_start < end) {
             send_counts[i] = util::safe_integer_cast<int>(
-                std::min(balanced_end, local_end)
-                - std::max(balanced_start, local_start)
+                std::min(end, local_end) - std::max(start, local_start)
             );
         }
-
-        balanced_start = balanced_end;
     }
 
     assert_counts_are_safe(send_counts, "kdwoi");
@@ -197,6 +206,13 @@ inline Comm comm_split(MPI_Comm comm, int color, int order) {
     return Comm{new_comm};
 }
 
+inline Comm comm_split_shared(MPI_Comm comm) {
+    MPI_Comm new_comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank(comm), MPI_INFO_NULL, &new_comm);
+
+    return Comm{new_comm};
+}
+
 inline Comm comm_shrink(MPI_Comm old_comm, int n_ranks) {
     assert(0 < n_ranks);
     assert(n_ranks <= size(old_comm));
@@ -3,6 +3,8 @@
 #include <brain_indexer/distributed_sort_tile_recursion.hpp>
 #include <brain_indexer/meta_data.hpp>
 
+#include <boost/interprocess/streams/bufferstream.hpp>
+
 namespace brain_indexer {
 
 template <class Derived, class TopTree, class SubTree, class Filenames>
@@ -10,6 +12,12 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::MultiIndexStorage(std::
     : output_dir(std::move(output_dir)) {
 }
 template <class Derived, class TopTree, class SubTree, class Filenames>
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::MultiIndexStorage(
+    std::string output_dir,
+    std::vector<std::string> base_dirs)
+    : output_dir(std::move(output_dir)), base_dirs(std::move(base_dirs)) {
+}
+template <class Derived, class TopTree, class SubTree, class Filenames>
 inline void
 MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::save_subtree(
     const SubTree& subtree,
@@ -48,7 +56,7 @@ inline SubTree
 MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_subtree(
     size_t subtree_id) const {
 
-    return load_subtree(output_dir, subtree_id);
+    return load_subtree_file(subtree_path(subtree_id));
 }
 
 template <class Derived, class TopTree, class SubTree, class Filenames>
@@ -57,9 +65,22 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_subtree(
     const std::string& output_dir,
     size_t subtree_id) {
 
-    return Derived::template load_tree<SubTree>(
-        Filenames::subtree(output_dir, subtree_id)
-    );
+    return load_subtree_file(Filenames::subtree(output_dir, subtree_id));
+}
+
+template <class Derived, class TopTree, class SubTree, class Filenames>
+inline SubTree
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_subtree_file(
+    const std::string& filename) {
+
+    auto start = std::chrono::steady_clock::now();
+    auto subtree = Derived::template load_tree<SubTree>(filename);
+
+    detail::record_subtree_load(start, [&filename]() {
+        return std::filesystem::file_size(filename);
+    });
+
+    return subtree;
 }
 
 template <class Derived, class TopTree, class SubTree, class Filenames>
@@ -76,26 +97,53 @@ MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::load_top_tree(
     return Derived::template load_tree<TopTree>(Filenames::top_tree(output_dir));
 }
 
-template <class TopTree, class SubTree>
+template <class Derived, class TopTree, class SubTree, class Filenames>
+inline std::string
+MultiIndexStorage<Derived, TopTree, SubTree, Filenames>::subtree_path(
+    size_t subtree_id) const {
+
+    auto filename = Filenames::subtree(output_dir, subtree_id);
+    if(base_dirs.empty() || std::filesystem::exists(filename)) {
+        return filename;
+    }
+
+    // The most recent version shadows the older ones.
+    for(const auto& base_dir : base_dirs) {
+        auto base_filename = Filenames::subtree(base_dir, subtree_id);
+        if(std::filesystem::exists(base_filename)) {
+            return base_filename;
+        }
+    }
+
+    return filename;
+}
+
+template <class TopTree, class SubTree, class Codec>
 inline
-NativeStorage<TopTree, SubTree>::NativeStorage(std::string output_dir)
+NativeStorage<TopTree, SubTree, Codec>::NativeStorage(std::string output_dir)
     : super(std::move(output_dir)) {}
 
+template <class TopTree, class SubTree, class Codec>
+inline
+NativeStorage<TopTree, SubTree, Codec>::NativeStorage(std::string output_dir,
+                                                      std::vector<std::string> base_dirs)
+    : super(std::move(output_dir), std::move(base_dirs)) {}
 
-template <class TopTree, class SubTree>
+
+template <class TopTree, class SubTree, class Codec>
 template <class RTree>
 inline void
-NativeStorage<TopTree, SubTree>::save_tree(const RTree& rtree,
+NativeStorage<TopTree, SubTree, Codec>::save_tree(const RTree& rtree,
                                            const std::string& filename) {
 
     save_tree_impl(rtree, filename);
     util::check_signals();
 }
 
-template <class TopTree, class SubTree>
+template <class TopTree, class SubTree, class Codec>
 template <class RTree>
 inline RTree
-NativeStorage<TopTree, SubTree>::load_tree(const std::string& filename) {
+NativeStorage<TopTree, SubTree, Codec>::load_tree(const std::string& filename) {
     RTree rtree;
     load_tree_impl(rtree, filename);
     util::check_signals();
@@ -103,85 +151,282 @@ NativeStorage<TopTree, SubTree>::load_tree(const std::string& filename) {
     return rtree;
 }
 
-template <class TopTree, class SubTree>
+template <class TopTree, class SubTree, class Codec>
 template <class... Args>
 inline void
-NativeStorage<TopTree, SubTree>::load_tree_impl(bgi::rtree<Args...>& tree,
+NativeStorage<TopTree, SubTree, Codec>::load_tree_impl(bgi::rtree<Args...>& tree,
                                                 const std::string& filename) {
     auto ifs = util::open_ifstream(filename, std::ios::binary);
-    boost::archive::binary_iarchive ia(ifs);
-    ia >> tree;
+    load_compressed_rtree(tree, ifs);
 }
 
-template <class TopTree, class SubTree>
+template <class TopTree, class SubTree, class Codec>
 template <class... Args>
 inline void
-NativeStorage<TopTree, SubTree>::save_tree_impl(const bgi::rtree<Args...>& tree,
+NativeStorage<TopTree, SubTree, Codec>::save_tree_impl(const bgi::rtree<Args...>& tree,
                                                 const std::string& filename) {
     auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
-    boost::archive::binary_oarchive oa(ofs);
-    oa << tree;
+    save_compressed_rtree<Codec>(tree, ofs);
 }
 
 
-template <class Storage>
-inline double
-UsageRateCache<Storage>::MetaData::usage_rate(size_t query_count) const {
-    if (query_count == load_generation_) {
-        // These were loaded during this query. Try not to evict these. However,
-        // it's safe to evict these since the subtree that will be queried next
-        // will be loaded after this eviction; and therefore can't be evicted
-        // before it's ever used.
-        return std::numeric_limits<double>::max();
+template <class TopTree, class SubTree>
+inline
+MemoryMappedStorage<TopTree, SubTree>::MemoryMappedStorage(std::string output_dir)
+    : super(std::move(output_dir)) {}
+
+template <class TopTree, class SubTree>
+inline
+MemoryMappedStorage<TopTree, SubTree>::MemoryMappedStorage(std::string output_dir,
+                                                           std::vector<std::string> base_dirs)
+    : super(std::move(output_dir), std::move(base_dirs)) {}
+
+
+template <class TopTree, class SubTree>
+template <class RTree>
+inline void
+MemoryMappedStorage<TopTree, SubTree>::save_tree(const RTree& rtree,
+                                                 const std::string& filename) {
+    if constexpr (detail::is_packed_rtree<RTree>::value) {
+        write_packed_rtree(rtree, filename);
+        util::check_signals();
+    } else {
+        NativeStorage<TopTree, SubTree>::save_tree(rtree, filename);
     }
+}
 
-    return double(access_count()) / double(incache_count(query_count));
+template <class TopTree, class SubTree>
+template <class RTree>
+inline RTree
+MemoryMappedStorage<TopTree, SubTree>::load_tree(const std::string& filename) {
+    if constexpr (detail::is_packed_rtree<RTree>::value) {
+        return RTree(map_packed_rtree<typename RTree::value_type>(filename));
+    } else {
+        return NativeStorage<TopTree, SubTree>::template load_tree<RTree>(filename);
+    }
 }
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::access_count() const {
-    return previous_access_count_ + current_access_count_;
+
+template <class TopTree, class SubTree>
+inline
+ContainerStorage<TopTree, SubTree>::ContainerStorage(std::string output_dir, size_t writer_id)
+    : output_dir(std::move(output_dir)), writer_id(writer_id) {}
+
+
+template <class TopTree, class SubTree>
+inline void ContainerStorage<TopTree, SubTree>::create_container() const {
+    auto lock = std::lock_guard<std::mutex>(writer->mutex);
+    open_writer();
 }
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::incache_count(size_t query_count) const {
-    return (query_count - load_generation_ + 1) + previous_age_;
+
+template <class TopTree, class SubTree>
+inline void ContainerStorage<TopTree, SubTree>::open_writer() const {
+    auto mode = std::ios::binary | std::ios::trunc;
+    writer->data = util::open_ofstream(ContainerFilenames::data(output_dir, writer_id), mode);
+    writer->offsets = util::open_ofstream(ContainerFilenames::offsets(output_dir, writer_id), mode);
 }
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::MetaData::eviction_count() const {
-    return eviction_count_;
+
+template <class TopTree, class SubTree>
+inline void ContainerStorage<TopTree, SubTree>::save_subtree(const SubTree& subtree,
+                                                             size_t subtree_id) const {
+    {
+        auto lock = std::lock_guard<std::mutex>(writer->mutex);
+        if(!writer->data.is_open()) {
+            open_writer();
+        }
+
+        auto& data = writer->data;
+        auto offset = std::uint64_t(data.tellp());
+        save_rtree(subtree, data);
+        auto n_bytes = std::uint64_t(data.tellp()) - offset;
+
+        // The record is only written once the subtree is complete; and both
+        // are flushed, such that other processes can read the container as
+        // soon as the index is finalized.
+        auto record = detail::ContainerRecord{subtree_id, offset, n_bytes};
+        writer->offsets.write(reinterpret_cast<const char*>(&record), sizeof(record));
+
+        data.flush();
+        writer->offsets.flush();
+        if(!data || !writer->offsets) {
+            auto msg = boost::format("Failed to write subtree %d to: %s")
+                % subtree_id % ContainerFilenames::data(output_dir, writer_id);
+            throw std::runtime_error(msg.str());
+        }
+    }
+
+    util::check_signals();
 }
 
-template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_query() {
-    ++current_access_count_;
+
+template <class TopTree, class SubTree>
+inline void ContainerStorage<TopTree, SubTree>::save_top_tree(const TopTree& tree) const {
+    NativeStorage<TopTree, SubTree>::save_tree(tree, ContainerFilenames::top_tree(output_dir));
 }
 
-template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_load(size_t query_count) {
-    load_generation_ = query_count;
-    current_access_count_ = 1;
+
+template <class TopTree, class SubTree>
+inline std::vector<size_t>
+ContainerStorage<TopTree, SubTree>::writer_ids(const std::string& output_dir) {
+    auto prefix = std::string("subtrees-");
+    auto suffix = std::string(".offsets");
+
+    auto ids = std::vector<size_t>{};
+    for(const auto& entry : std::filesystem::directory_iterator(output_dir)) {
+        auto basename = entry.path().filename().string();
+        if(basename.size() <= prefix.size() + suffix.size()
+           || basename.compare(0, prefix.size(), prefix) != 0
+           || entry.path().extension() != suffix) {
+            continue;
+        }
+
+        auto id_length = basename.size() - prefix.size() - suffix.size();
+        ids.push_back(std::stoull(basename.substr(prefix.size(), id_length)));
+    }
+
+    std::sort(ids.begin(), ids.end());
+    return ids;
 }
 
-template <class Storage>
-inline void
-UsageRateCache<Storage>::MetaData::on_evict(size_t query_count) {
-    previous_access_count_ += current_access_count_;
-    previous_age_ = query_count - load_generation_ + 1;
 
-    current_access_count_ = 0;
-    eviction_count_ += 1;
+template <class TopTree, class SubTree>
+inline size_t ContainerStorage<TopTree, SubTree>::next_writer_id(const std::string& output_dir) {
+    auto ids = writer_ids(output_dir);
+    return ids.empty() ? 0 : ids.back() + 1;
 }
 
 
-template <class Storage>
-UsageRateCache<Storage>::~UsageRateCache() {
+template <class TopTree, class SubTree>
+inline void ContainerStorage<TopTree, SubTree>::remove_containers(const std::string& output_dir,
+                                                                  size_t min_writer_id) {
+    for(auto id : writer_ids(output_dir)) {
+        if(id >= min_writer_id) {
+            std::filesystem::remove(ContainerFilenames::offsets(output_dir, id));
+            std::filesystem::remove(ContainerFilenames::data(output_dir, id));
+        }
+    }
+}
+
+
+template <class TopTree, class SubTree>
+inline void ContainerStorage<TopTree, SubTree>::open_reader() const {
+    std::call_once(reader->is_opened, [this]() {
+        // Later writers supersede earlier ones, hence they're read last.
+        for(auto id : writer_ids(output_dir)) {
+            auto offsets_filename = ContainerFilenames::offsets(output_dir, id);
+            auto n_table_bytes = std::filesystem::file_size(offsets_filename);
+            if(n_table_bytes % sizeof(detail::ContainerRecord) != 0) {
+                auto msg = boost::format("Invalid offset table: %s") % offsets_filename;
+                throw std::runtime_error(msg.str());
+            }
+
+            auto records = std::vector<detail::ContainerRecord>(
+                n_table_bytes / sizeof(detail::ContainerRecord)
+            );
+            if(records.empty()) {
+                continue;
+            }
+
+            auto ifs = util::open_ifstream(offsets_filename, std::ios::binary);
+            ifs.read(reinterpret_cast<char*>(records.data()), std::streamsize(n_table_bytes));
+
+            auto data_filename = ContainerFilenames::data(output_dir, id);
+            auto file = std::make_unique<detail::MappedFile>(data_filename);
+
+            for(const auto& record : records) {
+                if(record.offset + record.n_bytes > file->size()) {
+                    auto msg = boost::format("Subtree %d is outside of: %s")
+                        % record.subtree_id % data_filename;
+                    throw std::runtime_error(msg.str());
+                }
+
+                reader->locations[record.subtree_id] = detail::ContainerReader::Location{
+                    id, record.offset, record.n_bytes
+                };
+            }
+
+            reader->files.emplace(id, std::move(file));
+        }
+    });
+}
+
+
+template <class TopTree, class SubTree>
+inline SubTree ContainerStorage<TopTree, SubTree>::load_subtree(size_t subtree_id) const {
+    auto start = std::chrono::steady_clock::now();
+    open_reader();
+
+    auto it = reader->locations.find(subtree_id);
+    if(it == reader->locations.end()) {
+        auto msg = boost::format("Subtree %d isn't stored in: %s") % subtree_id % output_dir;
+        throw std::runtime_error(msg.str());
+    }
+
+    const auto& location = it->second;
+    const auto& file = reader->files.at(location.writer_id);
+
+    auto subtree = SubTree{};
+    {
+        auto is = boost::interprocess::ibufferstream(file->data() + location.offset,
+                                                     location.n_bytes);
+        load_rtree(subtree, static_cast<std::istream&>(is));
+    }
+    util::check_signals();
+
+    detail::record_subtree_load(start, [&location]() { return location.n_bytes; });
+    return subtree;
+}
+
+
+template <class TopTree, class SubTree>
+inline TopTree ContainerStorage<TopTree, SubTree>::load_top_tree() const {
+    return NativeStorage<TopTree, SubTree>::template load_tree<TopTree>(
+        ContainerFilenames::top_tree(output_dir)
+    );
+}
+
+
+namespace detail {
+
+template <class SubTree>
+struct has_counting_allocator : std::false_type {};
+
+template <class Value, class Params, class IndexableGetter, class EqualTo>
+struct has_counting_allocator<
+    bgi::rtree<Value, Params, IndexableGetter, EqualTo, util::CountingAllocator<Value>>>
+    : std::true_type {};
+
+template <class Value, class Params, class IndexableGetter, class EqualTo, class Placement>
+struct has_counting_allocator<
+    bgi::rtree<Value, Params, IndexableGetter, EqualTo, util::ArenaAllocator<Value, Placement>>>
+    : std::true_type {};
+
+} // namespace detail
+
+
+template <class SubTree>
+inline size_t subtree_resident_bytes(const SubTree& subtree) {
+    if constexpr (detail::is_packed_rtree<SubTree>::value) {
+        using node_type = typename SubTree::node_type;
+        using leaf_type = typename SubTree::leaf_type;
+        using value_type = typename SubTree::value_type;
+
+        return sizeof(SubTree)
+               + subtree.n_nodes() * sizeof(node_type)
+               + subtree.n_leaves() * sizeof(leaf_type)
+               + subtree.size() * sizeof(value_type);
+    } else if constexpr (detail::has_counting_allocator<SubTree>::value) {
+        return sizeof(SubTree) + subtree.get_allocator().allocated_bytes();
+    } else {
+        return sizeof(SubTree) + subtree.size() * sizeof(typename SubTree::value_type);
+    }
+}
+
+
+template <class Storage, class EvictionPolicy>
+UsageRateCache<Storage, EvictionPolicy>::~UsageRateCache() {
     auto should_write = util::read_boolean_environment_variable("SI_REPORT_USAGE_STATS");
 
     if(should_write) {
@@ -203,10 +448,10 @@ UsageRateCache<Storage>::~UsageRateCache() {
 }
 
 
-template <class Storage>
+template <class Storage, class EvictionPolicy>
 template<class SubtreeID>
 inline auto
-UsageRateCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t query_count)
+UsageRateCache<Storage, EvictionPolicy>::load_subtree(const SubtreeID& subtree_id, size_t query_count)
         -> const subtree_type& {
 
     most_recent_query_count = query_count;
@@ -216,251 +461,1592 @@ UsageRateCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t query_
     if (found == subtrees.end()) {
         evict_subtrees(subtree_id, query_count);
 
-        meta_data[id].on_load(query_count);
-        return subtrees[id] = storage.load_subtree(id);
+        auto start = std::chrono::steady_clock::now();
+        auto subtree = storage.load_subtree(id);
+        auto load_seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+
+        return emplace_subtree(id, std::move(subtree), load_seconds, query_count);
     }
 
     meta_data[id].on_query();
-    return found->second;
+    eviction_policy.on_query(id, query_count);
+    return found->second.subtree;
 }
 
-template <class Storage>
-inline size_t
-UsageRateCache<Storage>::cached_elements() const {
-    size_t n_cached_elements = 0ul;
-    for(const auto &[_, subtree] : subtrees) {
-        n_cached_elements += subtree.size();
+template <class Storage, class EvictionPolicy>
+template<class SubtreeID>
+inline auto
+UsageRateCache<Storage, EvictionPolicy>::insert_subtree(const SubtreeID& subtree_id,
+                                        subtree_type subtree,
+                                        size_t query_count)
+        -> const subtree_type& {
+
+    most_recent_query_count = query_count;
+    auto id = subtree_id.id;
+
+    const auto& found = subtrees.find(id);
+    if (found == subtrees.end()) {
+        evict_subtrees(subtree_id, query_count);
+        return emplace_subtree(id, std::move(subtree), std::nullopt, query_count);
     }
 
-    return n_cached_elements;
+    meta_data[id].on_query();
+    eviction_policy.on_query(id, query_count);
+    return found->second.subtree;
 }
 
+template <class Storage, class EvictionPolicy>
+inline auto
+UsageRateCache<Storage, EvictionPolicy>::emplace_subtree(size_t subtree_id,
+                                         subtree_type subtree,
+                                         std::optional<double> load_seconds,
+                                         size_t query_count)
+        -> const subtree_type& {
 
-template <class Storage>
+    meta_data[subtree_id].on_load(query_count);
+
+    auto n_elements = subtree.size();
+    auto n_bytes = subtree_resident_bytes(subtree);
+    auto& entry = subtrees.emplace(
+        subtree_id, Entry{std::move(subtree), n_elements, n_bytes}
+    ).first->second;
+
+    n_cached_elements += n_elements;
+    n_cached_bytes += n_bytes;
+    eviction_policy.on_load(subtree_id, n_bytes, load_seconds, query_count);
+
+    return entry.subtree;
+}
+
+template <class Storage, class EvictionPolicy>
+inline bool
+UsageRateCache<Storage, EvictionPolicy>::is_cached(size_t subtree_id) const {
+    return subtrees.find(subtree_id) != subtrees.end();
+}
+
+template <class Storage, class EvictionPolicy>
+inline std::vector<size_t>
+UsageRateCache<Storage, EvictionPolicy>::cached_subtree_ids() const {
+    auto ranked = std::vector<std::pair<double, size_t>>{};
+    for(const auto& [id, entry] : subtrees) {
+        ranked.emplace_back(-meta_data.at(id).usage_rate(most_recent_query_count), id);
+    }
+    std::sort(ranked.begin(), ranked.end());
+
+    auto ids = std::vector<size_t>{};
+    for(const auto& [_, id] : ranked) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+template <class Storage, class EvictionPolicy>
+inline bool
+UsageRateCache<Storage, EvictionPolicy>::has_room_for(size_t n_elements, size_t n_bytes) const {
+    return n_cached_elements + n_elements <= cache_params.max_cached_elements
+           && n_cached_bytes + n_bytes <= cache_params.max_cached_bytes;
+}
+
+template <class Storage, class EvictionPolicy>
+inline size_t
+UsageRateCache<Storage, EvictionPolicy>::estimated_bytes(size_t n_elements) const {
+    if(n_cached_elements == 0) {
+        return 0;
+    }
+
+    return size_t(double(n_elements) * double(n_cached_bytes) / double(n_cached_elements));
+}
+
+template <class Storage, class EvictionPolicy>
 template<class SubtreeID>
 inline void
-UsageRateCache<Storage>::evict_subtrees(const SubtreeID& subtree_id,
+UsageRateCache<Storage, EvictionPolicy>::evict_subtrees(const SubtreeID& subtree_id,
                                         size_t query_count) {
-    auto n_cached_elements = cached_elements();
     auto n_elements = subtree_id.n_elements;
-
-    if (n_cached_elements + n_elements <= cache_params.max_cached_elements) {
+    if (has_room_for(n_elements, estimated_bytes(n_elements))) {
         return;
     }
 
-    auto loaded_subtree_ids = subtree_ids_sorted_by_usage_rate(query_count);
+    auto n_evict = std::min(cache_params.max_evict, subtrees.size());
+    victims.clear();
+    eviction_policy.select_victims(meta_data, query_count, n_evict, victims);
 
-    auto n_evict = std::min(cache_params.max_evict, loaded_subtree_ids.size());
-    for (size_t k = 0; k < n_evict; ++k) {
-        size_t i = loaded_subtree_ids[k];
+    for (auto i : victims) {
         auto it = subtrees.find(i);
         if (it == subtrees.end()) {
             throw std::runtime_error("Failed to find a supposedly loaded subtree.");
         }
 
         meta_data[i].on_evict(query_count);
+        n_cached_elements -= it->second.n_elements;
+        n_cached_bytes -= it->second.n_bytes;
         subtrees.erase(it);
     }
 }
 
 
 template <class Storage>
-inline std::vector<size_t>
-UsageRateCache<Storage>::subtree_ids_sorted_by_usage_rate(size_t query_count) {
-    std::vector<size_t> loaded_subtree_ids;
-    loaded_subtree_ids.reserve(subtrees.size());
+ShardedUsageRateCache<Storage>::ShardedUsageRateCache()
+    : ShardedUsageRateCache(UsageRateCacheParams{}, Storage{}) {}
 
-    for (const auto& [id, _]: subtrees) {
-        loaded_subtree_ids.push_back(id);
-    }
 
-    std::sort(loaded_subtree_ids.begin(),
-              loaded_subtree_ids.end(),
-              [&](const auto& il, const auto& ir) {
-                  auto usage_rate_left = meta_data[il].usage_rate(query_count);
-                  auto usage_rate_right = meta_data[ir].usage_rate(query_count);
+template <class Storage>
+ShardedUsageRateCache<Storage>::ShardedUsageRateCache(const UsageRateCacheParams& cache_params,
+                                                      Storage storage,
+                                                      size_t n_shards)
+    : storage(std::move(storage))
+    , cache_params(cache_params)
+    , eviction_mutex(std::make_unique<std::mutex>())
+    , n_cached_elements(std::make_unique<std::atomic<size_t>>(0))
+    , n_cached_bytes(std::make_unique<std::atomic<size_t>>(0))
+    , most_recent_query_count(std::make_unique<std::atomic<size_t>>(0)) {
+
+    if(n_shards == 0) {
+        throw std::invalid_argument("ShardedUsageRateCache requires at least one shard.");
+    }
 
-                  return usage_rate_left < usage_rate_right;
-              });
+    if(cache_params.eviction_policy != EvictionPolicyKind::usage_rate) {
+        throw std::invalid_argument(
+            "ShardedUsageRateCache only supports the usage rate eviction policy."
+        );
+    }
 
-    return loaded_subtree_ids;
+    shards.reserve(n_shards);
+    for(size_t i = 0; i < n_shards; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
 }
 
 
-template <class SubtreeCache>
-MultiIndexTreeBase<SubtreeCache>::MultiIndexTreeBase(const storage_type& storage,
-                                                     SubtreeCache subtree_cache)
-    : top_rtree(storage.load_top_tree())
-    , subtree_cache(std::move(subtree_cache)) {
-}
+template <class Storage>
+ShardedUsageRateCache<Storage>::~ShardedUsageRateCache() {
+    if(shards.empty()) {
+        // Moved from.
+        return;
+    }
 
+    auto should_write = util::read_boolean_environment_variable("SI_REPORT_USAGE_STATS");
 
-template <class SubtreeCache>
-template <class Predicates, class OutIt>
-inline void
-MultiIndexTreeBase<SubtreeCache>::query(const Predicates& predicates,
-                                        const OutIt& it) const {
-    auto to_query = std::vector<typename toptree_type::value_type>();
-    top_rtree.query(predicates, std::back_inserter(to_query));
+    if(should_write) {
+        auto query_count = most_recent_query_count->load();
 
-    for (const auto& value: to_query) {
-        util::check_signals();
-        query_subtree(value, predicates, it);
-    }
+        nlohmann::json j;
+        for(const auto& shard : shards) {
+            for(const auto &[id, md] : shard->meta_data) {
+                j.push_back({
+                    { "id", id },
+                    { "access_count", md.access_count() },
+                    { "eviction_count", md.eviction_count() },
+                    { "incache_count", md.incache_count(query_count) },
+                    { "usage_rate", md.usage_rate(query_count) }
+                });
+            }
+        }
 
-    ++query_count;
+        auto filename = "si_cache_stats_" + util::iso_datetime_now() + ".json";
+        auto o = util::open_ofstream(filename);
+        o << std::setw(4) << j << std::endl;
+    }
 }
 
 
-template <class SubtreeCache>
-template <class SubtreeID, class Predicates, class OutIt>
-inline void
-MultiIndexTreeBase<SubtreeCache>::query_subtree(const SubtreeID& subtree_id,
-                                                const Predicates& predicates,
-                                                const OutIt& it) const {
+namespace detail {
 
-    const auto& subtree = load_subtree(subtree_id);
-    subtree.query(predicates, it);
+template <class SubTree>
+inline SharedSubtreeRegistry<SubTree>& SharedSubtreeRegistry<SubTree>::instance() {
+    static SharedSubtreeRegistry registry;
+    return registry;
 }
 
-
-template <class SubtreeCache>
-template <class SubtreeID>
+template <class SubTree>
+template <class Load>
 inline auto
-MultiIndexTreeBase<SubtreeCache>::load_subtree(const SubtreeID& subtree_id) const
-        -> const subtree_type& {
-    return subtree_cache.load_subtree(subtree_id, query_count);
-}
+SharedSubtreeRegistry<SubTree>::find_or_load(const std::string& filename, Load&& load)
+        -> subtree_handle {
+
+    auto k = key(filename);
+    {
+        auto guard = std::lock_guard<std::mutex>(mutex);
+        auto it = subtrees.find(k);
+        if(it != subtrees.end()) {
+            if(auto subtree = it->second.lock()) {
+                return subtree;
+            }
+        }
+    }
 
-template <typename T>
-MultiIndexTree<T>::MultiIndexTree(const std::string& output_dir, size_t max_cached_bytes)
-    : MultiIndexTree(
-        NativeStorageT<T>(
-            resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key)
-        ),
-        UsageRateCacheParams(max_cached_bytes / sizeof(value_type)))
-{}
+    // The file is read without holding the lock; concurrent loads of the
+    // same file are resolved by `insert_locked`.
+    auto subtree = std::make_shared<const SubTree>(load());
 
+    auto guard = std::lock_guard<std::mutex>(mutex);
+    return insert_locked(k, std::move(subtree));
+}
 
-template <typename T>
-MultiIndexTree<T>::MultiIndexTree(
-    const NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>& storage,
-    const UsageRateCacheParams& params)
-    : MultiIndexTree(storage, UsageRateCacheT<T>(params, storage))
-{}
+template <class SubTree>
+inline auto
+SharedSubtreeRegistry<SubTree>::insert(const std::string& filename, subtree_handle subtree)
+        -> subtree_handle {
 
+    auto k = key(filename);
+    auto guard = std::lock_guard<std::mutex>(mutex);
+    return insert_locked(k, std::move(subtree));
+}
 
-template <typename T>
-template <typename GeometryMode, typename ShapeT>
-inline bool
-MultiIndexTree<T>::is_intersecting(const ShapeT& shape) const {
-    auto inner_sweep = [&shape](const auto &tree) {
-        auto it = tree.qbegin(
-            bgi::intersects(bgi::indexable<ShapeT>{}(shape))
-            && bgi::satisfies([&shape](const auto& v) {
-                return geometry_intersects(shape, v, GeometryMode{});
-            })
-        );
+template <class SubTree>
+inline auto
+SharedSubtreeRegistry<SubTree>::insert_locked(const std::string& key, subtree_handle subtree)
+        -> subtree_handle {
 
-        return it != tree.qend();
-    };
+    auto& entry = subtrees[key];
+    if(auto shared = entry.lock()) {
+        return shared;
+    }
 
-    auto it = this->top_rtree.qbegin(
-        bgi::intersects(bgi::indexable<ShapeT>{}(shape))
-        && bgi::satisfies([&shape](const auto& v) {
-            return geometry_intersects(shape, v, GeometryMode{});
-        })
-    );
-    for(; it != this->top_rtree.qend(); ++it) {
-        const auto &tree = this->load_subtree(*it);
+    entry = subtree;
+    sweep();
+    return subtree;
+}
 
-        if(inner_sweep(tree)) {
-            return true;
-        }
+template <class SubTree>
+inline std::string SharedSubtreeRegistry<SubTree>::key(const std::string& filename) {
+    auto ec = std::error_code{};
+    auto path = std::filesystem::canonical(filename, ec);
+    if(ec) {
+        return filename;
     }
 
-    return false;
+    auto n_bytes = std::filesystem::file_size(path, ec);
+    auto mtime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    return path.string() + ":" + std::to_string(n_bytes) + ":" + std::to_string(mtime);
 }
 
+template <class SubTree>
+inline void SharedSubtreeRegistry<SubTree>::sweep() {
+    if(subtrees.size() < sweep_threshold) {
+        return;
+    }
 
-template <typename T>
-template <typename GeometryMode, typename ShapeT>
-inline auto
-MultiIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const
-    -> std::vector<value_type> {
+    for(auto it = subtrees.begin(); it != subtrees.end();) {
+        it = it->second.expired() ? subtrees.erase(it) : std::next(it);
+    }
 
-    std::vector<value_type> results;
-    this->template find_intersecting<GeometryMode>(shape, std::back_inserter(results));
-    return results;
+    // Amortizes the sweeps over the insertions.
+    sweep_threshold = std::max(size_t(64), 2 * subtrees.size());
 }
 
+}  // namespace detail
+
 
-template <size_t dim, typename Value>
-inline CoordType get_centroid_coordinate(const Value& value) {
-    return value.template get_centroid_coord<dim>();
+template <class Storage>
+inline auto
+ShardedUsageRateCache<Storage>::shard_for(size_t subtree_id) const -> Shard& {
+    return *shards[subtree_id % shards.size()];
 }
 
 
-template<size_t dim, typename... VariantArgs>
-inline CoordType get_centroid_coordinate(boost::variant<VariantArgs...> const& value) {
-    return boost::apply_visitor(
-        [](const auto& value) {
-            return value.template get_centroid_coord<dim>();
-        },
-        value
-    );
+template <class Storage>
+inline size_t
+ShardedUsageRateCache<Storage>::cached_elements() const {
+    return n_cached_elements->load();
 }
 
-#if SI_MPI == 1
-
-template <class Value>
-MultiIndexBulkBuilder<Value>::MultiIndexBulkBuilder(std::string output_dir)
-    : output_dir_(std::move(output_dir)),
-      index_reldir_("multi_index"),
-      index_dir_(join_path(output_dir_, index_reldir_)) {
 
-    util::ensure_valid_output_directory(index_dir_);
+template <class Storage>
+inline size_t
+ShardedUsageRateCache<Storage>::cached_bytes() const {
+    return n_cached_bytes->load();
 }
 
 
-template <class Value>
-inline void MultiIndexBulkBuilder<Value>::finalize(MPI_Comm comm) {
-    auto comm_size = mpi::size(comm);
-
-    size_t n_values = this->values_.size();
-    size_t n_total_values = 0;
+template <class Storage>
+inline std::vector<size_t>
+ShardedUsageRateCache<Storage>::cached_subtree_ids() const {
+    auto query_count = most_recent_query_count->load();
+    auto ranked = std::vector<std::pair<double, size_t>>{};
+    for(const auto& shard : shards) {
+        auto guard = std::lock_guard<std::mutex>(shard->mutex);
+        for(const auto& [id, entry] : shard->subtrees) {
+            auto status = entry.subtree.wait_for(std::chrono::seconds(0));
+            if(status == std::future_status::ready) {
+                ranked.emplace_back(-shard->meta_data.at(id).usage_rate(query_count), id);
+            }
+        }
+    }
+    std::sort(ranked.begin(), ranked.end());
+
+    auto ids = std::vector<size_t>{};
+    for(const auto& [_, id] : ranked) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+
+template <class Storage>
+inline bool
+ShardedUsageRateCache<Storage>::has_room_for(size_t n_elements, size_t n_bytes) const {
+    return cached_elements() + n_elements <= cache_params.max_cached_elements
+           && cached_bytes() + n_bytes <= cache_params.max_cached_bytes;
+}
+
+
+template <class Storage>
+inline size_t
+ShardedUsageRateCache<Storage>::estimated_bytes(size_t n_elements) const {
+    auto n_elements_cached = cached_elements();
+    if(n_elements_cached == 0) {
+        return 0;
+    }
+
+    return size_t(double(n_elements) * double(cached_bytes()) / double(n_elements_cached));
+}
+
+
+template <class Storage>
+inline void
+ShardedUsageRateCache<Storage>::update_cached_bytes(size_t subtree_id, size_t n_bytes) {
+    auto& shard = shard_for(subtree_id);
+
+    auto guard = std::lock_guard<std::mutex>(shard.mutex);
+    auto it = shard.subtrees.find(subtree_id);
+    if (it != shard.subtrees.end()) {
+        *n_cached_bytes += n_bytes;
+        *n_cached_bytes -= it->second.n_bytes;
+        it->second.n_bytes = n_bytes;
+    }
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline auto
+ShardedUsageRateCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t query_count)
+        -> subtree_handle {
+
+    most_recent_query_count->store(query_count);
+    auto id = subtree_id.id;
+    auto& shard = shard_for(id);
+
+    std::promise<subtree_handle> promise;
+    size_t n_bytes = 0;
+    {
+        auto lock = std::unique_lock<std::mutex>(shard.mutex);
+
+        const auto& found = shard.subtrees.find(id);
+        if (found != shard.subtrees.end()) {
+            shard.meta_data[id].on_query();
+            auto subtree = found->second.subtree;
+            lock.unlock();
+
+            // Only waits if another thread is still loading this subtree.
+            return subtree.get();
+        }
+
+        n_bytes = estimated_bytes(subtree_id.n_elements);
+
+        shard.meta_data[id].on_load(query_count);
+        shard.subtrees[id] = Entry{promise.get_future().share(), subtree_id.n_elements, n_bytes};
+    }
+
+    // Make room before reading the subtree, to not overshoot the budget.
+    *n_cached_elements += subtree_id.n_elements;
+    *n_cached_bytes += n_bytes;
+    evict_subtrees(query_count);
+
+    try {
+        auto handle = [this, id]() -> subtree_handle {
+            if constexpr (detail::has_subtree_path<Storage>::value) {
+                // Snapshots share the files of their unchanged subtrees.
+                auto& registry = detail::SharedSubtreeRegistry<subtree_type>::instance();
+                return registry.find_or_load(storage.subtree_path(id), [this, id]() {
+                    return storage.load_subtree(id);
+                });
+            } else {
+                return std::make_shared<const subtree_type>(storage.load_subtree(id));
+            }
+        }();
+
+        // Only subtrees which finished loading can be evicted. Hence, the
+        // entry is still there.
+        update_cached_bytes(id, subtree_resident_bytes(*handle));
+        promise.set_value(handle);
+        return handle;
+    }
+    catch(...) {
+        {
+            auto guard = std::lock_guard<std::mutex>(shard.mutex);
+            shard.subtrees.erase(id);
+        }
+        *n_cached_elements -= subtree_id.n_elements;
+        *n_cached_bytes -= n_bytes;
+
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline auto
+ShardedUsageRateCache<Storage>::insert_subtree(const SubtreeID& subtree_id,
+                                               subtree_type subtree,
+                                               size_t query_count)
+        -> subtree_handle {
+
+    most_recent_query_count->store(query_count);
+    auto id = subtree_id.id;
+    auto& shard = shard_for(id);
+
+    auto handle = subtree_handle(std::make_shared<const subtree_type>(std::move(subtree)));
+    if constexpr (detail::has_subtree_path<Storage>::value) {
+        auto& registry = detail::SharedSubtreeRegistry<subtree_type>::instance();
+        handle = registry.insert(storage.subtree_path(id), std::move(handle));
+    }
+    auto n_bytes = subtree_resident_bytes(*handle);
+    {
+        auto lock = std::unique_lock<std::mutex>(shard.mutex);
+
+        const auto& found = shard.subtrees.find(id);
+        if (found != shard.subtrees.end()) {
+            shard.meta_data[id].on_query();
+            auto cached = found->second.subtree;
+            lock.unlock();
+
+            return cached.get();
+        }
+
+        std::promise<subtree_handle> promise;
+        promise.set_value(handle);
+
+        shard.meta_data[id].on_load(query_count);
+        shard.subtrees[id] = Entry{promise.get_future().share(), subtree_id.n_elements, n_bytes};
+    }
+
+    *n_cached_elements += subtree_id.n_elements;
+    *n_cached_bytes += n_bytes;
+    evict_subtrees(query_count);
+
+    return handle;
+}
+
+
+template <class Storage>
+inline bool
+ShardedUsageRateCache<Storage>::is_cached(size_t subtree_id) const {
+    auto& shard = shard_for(subtree_id);
+
+    auto guard = std::lock_guard<std::mutex>(shard.mutex);
+    return shard.subtrees.find(subtree_id) != shard.subtrees.end();
+}
+
+
+template <class Storage>
+inline void
+ShardedUsageRateCache<Storage>::evict_subtrees(size_t query_count) {
+    if (cached_elements() <= cache_params.max_cached_elements
+        && cached_bytes() <= cache_params.max_cached_bytes) {
+        return;
+    }
+
+    // If another thread is already evicting, there's no need to evict more.
+    auto eviction_guard = std::unique_lock<std::mutex>(*eviction_mutex, std::try_to_lock);
+    if(!eviction_guard.owns_lock()) {
+        return;
+    }
+
+    auto candidates = std::vector<std::pair<double, size_t>>{};
+    for(const auto& shard : shards) {
+        auto guard = std::lock_guard<std::mutex>(shard->mutex);
+        for(const auto& [id, entry] : shard->subtrees) {
+            auto status = entry.subtree.wait_for(std::chrono::seconds(0));
+            if(status == std::future_status::ready) {
+                candidates.emplace_back(shard->meta_data[id].usage_rate(query_count), id);
+            }
+        }
+    }
+
+    auto n_evict = std::min(cache_params.max_evict, candidates.size());
+    std::partial_sort(candidates.begin(),
+                      candidates.begin() + util::integer_cast<std::ptrdiff_t>(n_evict),
+                      candidates.end());
+
+    for (size_t k = 0; k < n_evict; ++k) {
+        auto id = candidates[k].second;
+        auto& shard = shard_for(id);
+
+        auto guard = std::lock_guard<std::mutex>(shard.mutex);
+        auto it = shard.subtrees.find(id);
+        if (it == shard.subtrees.end()) {
+            // Another thread evicted it or failed to load it.
+            continue;
+        }
+
+        shard.meta_data[id].on_evict(query_count);
+        *n_cached_elements -= it->second.n_elements;
+        *n_cached_bytes -= it->second.n_bytes;
+        shard.subtrees.erase(it);
+    }
+}
+
+
+namespace detail {
+/// \brief Subtree caches hand out either references or ref-counted handles.
+template <class SubTree>
+inline const SubTree& deref_subtree(const SubTree& subtree) {
+    return subtree;
+}
+
+template <class SubTree>
+inline const SubTree& deref_subtree(const std::shared_ptr<const SubTree>& subtree) {
+    return *subtree;
+}
+
+/// \brief Does any element of `tree` satisfy `predicates`.
+template <class... Args, class Predicates>
+inline bool query_any(const bgi::rtree<Args...>& tree, const Predicates& predicates) {
+    return tree.qbegin(predicates) != tree.qend();
+}
+
+template <class T, class Predicates>
+inline bool query_any(const PackedRTree<T>& tree, const Predicates& predicates) {
+    return tree.query_any(predicates);
+}
+}
+
+
+inline void write_hot_set(const std::string& filename, const std::vector<size_t>& subtree_ids) {
+    auto j = nlohmann::json::array();
+    for(auto id : subtree_ids) {
+        j.push_back({{"id", id}});
+    }
+
+    auto o = util::open_ofstream(filename);
+    o << std::setw(4) << j << std::endl;
+}
+
+inline std::vector<size_t> read_hot_set(const std::string& filename) {
+    auto i = util::open_ifstream(filename);
+    auto j = nlohmann::json::parse(i);
+
+    auto ranked = std::vector<std::pair<double, size_t>>{};
+    for(const auto& entry : j) {
+        auto usage_rate = entry.value("usage_rate", 0.0);
+        ranked.emplace_back(-usage_rate, entry.at("id").get<size_t>());
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    auto ids = std::vector<size_t>{};
+    for(const auto& [_, id] : ranked) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+
+template <class SubtreeCache>
+MultiIndexTreeBase<SubtreeCache>::MultiIndexTreeBase(const storage_type& storage,
+                                                     SubtreeCache subtree_cache)
+    : storage(storage)
+    , top_rtree(storage.load_top_tree())
+    , subtree_cache(std::move(subtree_cache)) {
+}
+
+
+template <class SubtreeCache>
+MultiIndexTreeBase<SubtreeCache>::~MultiIndexTreeBase() {
+    if(hot_set_filename_.empty()) {
+        return;
+    }
+
+    try {
+        write_hot_set(hot_set_filename_, hot_set());
+    }
+    catch(const std::exception& e) {
+        log_warn("Failed to write the hot set '%s': %s", hot_set_filename_, e.what());
+    }
+}
+
+
+template <class SubtreeCache>
+inline size_t
+MultiIndexTreeBase<SubtreeCache>::warm_up(const std::vector<size_t>& subtree_ids,
+                                          size_t n_threads) const {
+    using subtree_id_type = typename toptree_type::value_type;
+
+    auto known = std::unordered_map<size_t, subtree_id_type>{};
+    for(const auto& subtree : top_rtree) {
+        known.emplace(subtree.id, subtree);
+    }
+
+    auto to_load = std::vector<subtree_id_type>{};
+    auto selected = std::unordered_set<size_t>{};
+    for(auto id : subtree_ids) {
+        auto it = known.find(id);
+        if(it != known.end() && !subtree_cache.is_cached(id) && selected.insert(id).second) {
+            to_load.push_back(it->second);
+        }
+    }
+
+    // The subtrees are read in batches of `n_threads`, such that the memory
+    // per element is known after the first batch.
+    auto batch_size = std::max(n_threads, size_t(1));
+    size_t n_loaded = 0;
+    for(size_t begin = 0; begin < to_load.size(); begin += batch_size) {
+        util::check_signals();
+
+        auto batch_end = std::min(begin + batch_size, to_load.size());
+        auto end = begin;
+        size_t n_elements = 0;
+        size_t n_bytes = 0;
+        for(; end < batch_end; ++end) {
+            auto n = to_load[end].n_elements;
+            auto bytes = subtree_cache.estimated_bytes(n);
+            if(!subtree_cache.has_room_for(n_elements + n, n_bytes + bytes)) {
+                break;
+            }
+
+            n_elements += n;
+            n_bytes += bytes;
+        }
+
+        auto loaded = std::vector<std::optional<subtree_type>>(end - begin);
+        util::parallel_for(end - begin, n_threads, [&](size_t k) {
+            loaded[k] = storage.load_subtree(to_load[begin + k].id);
+        });
+
+        for(size_t k = 0; k < loaded.size(); ++k) {
+            auto& subtree = *loaded[k];
+            if(!subtree_cache.has_room_for(subtree.size(), subtree_resident_bytes(subtree))) {
+                return n_loaded;
+            }
+
+            subtree_cache.insert_subtree(to_load[begin + k], std::move(subtree), query_count.load());
+            ++n_loaded;
+        }
+
+        if(end < batch_end) {
+            break;
+        }
+    }
+
+    return n_loaded;
+}
+
+
+template <class SubtreeCache>
+inline std::vector<size_t>
+MultiIndexTreeBase<SubtreeCache>::subtrees_intersecting(const std::vector<Box3D>& regions) const {
+    auto ids = std::vector<size_t>{};
+    auto selected = std::unordered_set<size_t>{};
+
+    auto found = std::vector<typename toptree_type::value_type>{};
+    for(const auto& region : regions) {
+        found.clear();
+        top_rtree.query(bgi::intersects(region), std::back_inserter(found));
+
+        for(const auto& subtree : found) {
+            if(selected.insert(subtree.id).second) {
+                ids.push_back(subtree.id);
+            }
+        }
+    }
+
+    return ids;
+}
+
+
+template <class SubtreeCache>
+template <class Predicates, class OutIt>
+inline void
+MultiIndexTreeBase<SubtreeCache>::query(const Predicates& predicates,
+                                        const OutIt& it) const {
+    // Sending the predicate to every subtree would return `k` values per
+    // subtree, rather than the `k` closest overall.
+    if constexpr (detail::is_nearest_predicate<Predicates>::value) {
+        query_nearest(predicates.point_or_relation, predicates.count, it);
+        return;
+    }
+
+    // Only the elements of the subtrees count towards the statistics.
+    auto to_query = std::vector<typename toptree_type::value_type>();
+    auto top_tree_stats = QueryStats{};
+    detail::with_query_stats(top_tree_stats, [&]() {
+        top_rtree.query(predicates, std::back_inserter(to_query));
+    });
+
+    for_each_subtree(to_query, [&predicates, &it](const auto& subtree) {
+        subtree.query(predicates, it);
+    });
+
+    ++query_count;
+}
+
+
+template <class SubtreeCache>
+template <class SubtreeID, class Visitor>
+inline void
+MultiIndexTreeBase<SubtreeCache>::for_each_subtree(const std::vector<SubtreeID>& to_visit,
+                                                   const Visitor& visitor) const {
+    auto n_subtrees = to_visit.size();
+
+    if (prefetch_depth_ == 0 || n_subtrees <= 1) {
+        for (const auto& value: to_visit) {
+            util::check_signals();
+            const auto& subtree = load_subtree(value);
+            visitor(detail::deref_subtree(subtree));
+        }
+
+        return;
+    }
+
+    // Only subtrees that aren't cached are read in the background. The
+    // destructor of the futures waits for any outstanding reads, e.g. if a
+    // query throws.
+    auto prefetched = std::vector<std::future<subtree_type>>(n_subtrees);
+    auto prefetch_stats = std::vector<QueryStats>(n_subtrees);
+    size_t n_prefetched = 0;
+
+    auto prefetch_until = [&](size_t k_end) {
+        for (; n_prefetched < std::min(k_end, n_subtrees); ++n_prefetched) {
+            auto id = to_visit[n_prefetched].id;
+            if (!subtree_cache.is_cached(id)) {
+                auto* stats = &prefetch_stats[n_prefetched];
+                prefetched[n_prefetched] = std::async(std::launch::async, [this, id, stats]() {
+                    return detail::with_query_stats(*stats, [this, id]() {
+                        return storage.load_subtree(id);
+                    });
+                });
+            }
+        }
+    };
+
+    for (size_t k = 0; k < n_subtrees; ++k) {
+        prefetch_until(k + 1 + prefetch_depth_);
+        util::check_signals();
+
+        if (prefetched[k].valid()) {
+            auto prefetched_subtree = prefetched[k].get();
+            detail::add_to_running_query(prefetch_stats[k]);
+
+            const auto& subtree = subtree_cache.insert_subtree(
+                to_visit[k], std::move(prefetched_subtree), query_count.load()
+            );
+            visitor(detail::deref_subtree(subtree));
+        }
+        else {
+            const auto& subtree = load_subtree(to_visit[k]);
+            visitor(detail::deref_subtree(subtree));
+        }
+    }
+}
+
+
+template <class SubtreeCache>
+template <class Geometry, class OutIt>
+inline void
+MultiIndexTreeBase<SubtreeCache>::query_nearest(const Geometry& geometry,
+                                                size_t k,
+                                                const OutIt& it) const {
+    using value_type = typename subtree_type::value_type;
+    using box_type = typename toptree_type::value_type;
+    using distance_t = typename bg::default_comparable_distance_result<Geometry, Box3D>::type;
+    using entry_t = std::pair<distance_t, value_type>;
+
+    if(k == 0 || top_rtree.empty()) {
+        return;
+    }
+
+    // The `k` closest values found so far, as a max-heap.
+    auto neighbors = std::vector<entry_t>{};
+    neighbors.reserve(k);
+
+    auto is_farther = [](const entry_t& a, const entry_t& b) {
+        return a.first < b.first;
+    };
+
+    auto is_candidate = [&neighbors, k](distance_t distance) {
+        return neighbors.size() < k || distance < neighbors.front().first;
+    };
+
+    // The top-level tree returns the subtrees in the order of their distance.
+    auto n_subtrees = static_cast<unsigned>(top_rtree.size());
+    auto candidates = std::vector<value_type>{};
+    for(auto box_it = top_rtree.qbegin(bgi::nearest(geometry, n_subtrees));
+        box_it != top_rtree.qend();
+        ++box_it) {
+
+        auto box_distance = distance_t(
+            bg::comparable_distance(geometry, bgi::indexable<box_type>{}(*box_it))
+        );
+        if(!is_candidate(box_distance)) {
+            break;
+        }
+
+        util::check_signals();
+
+        candidates.clear();
+        query_subtree(*box_it, bgi::nearest(geometry, unsigned(k)), std::back_inserter(candidates));
+
+        for(const auto& value : candidates) {
+            auto distance = distance_t(
+                bg::comparable_distance(geometry, bgi::indexable<value_type>{}(value))
+            );
+            if(!is_candidate(distance)) {
+                continue;
+            }
+
+            if(neighbors.size() == k) {
+                std::pop_heap(neighbors.begin(), neighbors.end(), is_farther);
+                neighbors.pop_back();
+            }
+            neighbors.emplace_back(distance, value);
+            std::push_heap(neighbors.begin(), neighbors.end(), is_farther);
+        }
+    }
+
+    std::sort_heap(neighbors.begin(), neighbors.end(), is_farther);
+
+    auto out = it;
+    for(const auto& neighbor : neighbors) {
+        *out = neighbor.second;
+        ++out;
+    }
+
+    ++query_count;
+}
+
+
+template <class SubtreeCache>
+template <class SubtreeID, class Predicates, class OutIt>
+inline void
+MultiIndexTreeBase<SubtreeCache>::query_subtree(const SubtreeID& subtree_id,
+                                                const Predicates& predicates,
+                                                const OutIt& it) const {
+
+    const auto& subtree = load_subtree(subtree_id);
+    detail::deref_subtree(subtree).query(predicates, it);
+}
+
+
+template <class SubtreeCache>
+template <class SubtreeID>
+inline decltype(auto)
+MultiIndexTreeBase<SubtreeCache>::load_subtree(const SubtreeID& subtree_id) const {
+    return subtree_cache.load_subtree(subtree_id, query_count.load());
+}
+
+template <typename T, typename SubtreeCache>
+MultiIndexTree<T, SubtreeCache>::MultiIndexTree(const std::string& output_dir,
+                                                size_t max_cached_bytes,
+                                                EvictionPolicyKind eviction_policy)
+    : MultiIndexTree(
+        open_multi_index_storage<typename SubtreeCache::storage_type>(output_dir),
+        [&]() {
+            auto params = UsageRateCacheParams::from_max_cached_bytes(max_cached_bytes);
+            params.eviction_policy = eviction_policy;
+            return params;
+        }())
+{}
+
+
+template <typename T, typename SubtreeCache>
+MultiIndexTree<T, SubtreeCache>::MultiIndexTree(
+    const typename SubtreeCache::storage_type& storage,
+    const UsageRateCacheParams& params)
+    : MultiIndexTree(storage, SubtreeCache(params, storage))
+{}
+
+
+namespace detail {
+
+template <class GeometryMode, class ShapeT, class... Args>
+inline size_t count_intersecting_subtree(const bgi::rtree<Args...>& subtree,
+                                         const ShapeT& shape) {
+    return count_intersecting_rtree<GeometryMode>(subtree, shape);
+}
+
+template <class GeometryMode, class ShapeT, class SubTree>
+inline size_t count_intersecting_subtree(const SubTree& subtree, const ShapeT& shape) {
+    size_t count = 0;
+    auto counter = boost::make_function_output_iterator(
+        [&count](const auto&) { ++count; }
+    );
+
+    using value_type = typename SubTree::value_type;
+    subtree.query(intersects_predicate<GeometryMode, value_type>(shape), counter);
+
+    return count;
+}
+
+/// \brief The subtrees which can contain elements intersecting `shape`.
+template <class GeometryMode, class TopTree, class ShapeT>
+inline std::vector<typename TopTree::value_type>
+intersecting_subtrees(const TopTree& top_tree, const ShapeT& shape) {
+    auto subtrees = std::vector<typename TopTree::value_type>{};
+    top_tree.query(
+        bgi::intersects(bgi::indexable<ShapeT>{}(shape))
+        && bgi::satisfies([&shape](const auto& v) {
+            return geometry_intersects(shape, v, GeometryMode{});
+        }),
+        std::back_inserter(subtrees)
+    );
+
+    return subtrees;
+}
+
+/// \brief Does every element of `subtree` intersect `shape`.
+template <class GeometryMode, class ShapeT>
+inline bool subtree_inside(const IndexedSubtreeBox& subtree, const ShapeT& shape) {
+    return std::is_same<GeometryMode, BoundingBoxGeometry>::value
+           && strictly_contains(shape, bgi::indexable<IndexedSubtreeBox>{}(subtree));
+}
+
+}  // namespace detail
+
+
+template <typename T, typename SubtreeCache>
+template <typename GeometryMode, typename ShapeT>
+inline bool
+MultiIndexTree<T, SubtreeCache>::is_intersecting(const ShapeT& shape) const {
+    auto stats_scope = this->query_stats_scope();
+    auto inner_sweep = [&shape](const auto &tree) {
+        return detail::query_any(tree, detail::intersects_predicate<GeometryMode, T>(shape));
+    };
+
+    auto subtrees = detail::intersecting_subtrees<GeometryMode>(this->top_rtree, shape);
+    bool found = std::any_of(subtrees.begin(), subtrees.end(), [&shape](const auto& subtree) {
+        return subtree.n_elements > 0 && detail::subtree_inside<GeometryMode>(subtree, shape);
+    });
+
+    for(size_t i = 0; !found && i < subtrees.size(); ++i) {
+        const auto &tree = this->load_subtree(subtrees[i]);
+        found = inner_sweep(detail::deref_subtree(tree));
+    }
+
+    ++this->query_count;
+    return found;
+}
+
+
+template <typename T, typename SubtreeCache>
+template <typename GeometryMode, typename ShapeT>
+inline size_t
+MultiIndexTree<T, SubtreeCache>::count_intersecting(const ShapeT& shape) const {
+    auto stats_scope = this->query_stats_scope();
+    auto subtrees = detail::intersecting_subtrees<GeometryMode>(this->top_rtree, shape);
+
+    size_t count = 0;
+    auto to_visit = std::vector<typename multi_index_base::toptree_type::value_type>{};
+    for(const auto& subtree : subtrees) {
+        if(detail::subtree_inside<GeometryMode>(subtree, shape)) {
+            SI_QUERY_STATS_ADD(hits, subtree.n_elements);
+            count += subtree.n_elements;
+        } else {
+            to_visit.push_back(subtree);
+        }
+    }
+
+    this->for_each_subtree(to_visit, [&shape, &count](const auto& subtree) {
+        count += detail::count_intersecting_subtree<GeometryMode>(subtree, shape);
+    });
+
+    ++this->query_count;
+    return count;
+}
+
+
+template <typename T, typename SubtreeCache>
+template <typename GeometryMode, typename ShapeT>
+inline auto
+MultiIndexTree<T, SubtreeCache>::find_intersecting_objs(const ShapeT& shape) const
+    -> std::vector<value_type> {
+
+    std::vector<value_type> results;
+    this->template find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+namespace detail {
+
+/// \brief The matches, pairs of the index of the query and the value, in CSR format.
+template <class T>
+inline batch_query_result<T>
+make_batch_query_result(size_t n_queries,
+                        const std::vector<std::vector<std::pair<size_t, T>>>& chunk_matches,
+                        query_fields_t fields) {
+    batch_query_result<T> result;
+    result.values.fields = fields;
+    result.offsets.assign(n_queries + 1, 0);
+    for(const auto& matches : chunk_matches) {
+        for(const auto& match : matches) {
+            ++result.offsets[match.first + 1];
+        }
+    }
+    std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+
+    auto next = std::vector<size_t>(result.offsets.begin(), result.offsets.end() - 1);
+    auto sorted = std::vector<const T*>(result.offsets.back());
+    for(const auto& matches : chunk_matches) {
+        for(const auto& match : matches) {
+            sorted[next[match.first]++] = &match.second;
+        }
+    }
+
+    auto getter = iter_entry_getter<T>(result.values);
+    for(const auto* value : sorted) {
+        getter = *value;
+    }
+
+    return result;
+}
+
+}  // namespace detail
+
+
+template <typename T, typename SubtreeCache>
+template <typename GeometryMode, typename ShapeT>
+inline detail::batch_query_result<T>
+MultiIndexTree<T, SubtreeCache>::find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                         size_t n_threads,
+                                                         query_fields_t fields) const {
+    auto stats_scope = this->query_stats_scope(shapes.size());
+
+    auto chunk_matches = find_intersecting_batch_matches<GeometryMode>(
+        shapes, [](size_t) { return true; }, n_threads
+    );
+
+    return detail::make_batch_query_result(shapes.size(), chunk_matches, fields);
+}
+
+
+template <typename T, typename SubtreeCache>
+template <typename GeometryMode, typename ShapeT, typename SubtreeFilter>
+inline std::vector<std::vector<std::pair<size_t, T>>>
+MultiIndexTree<T, SubtreeCache>::find_intersecting_batch_matches(
+    const std::vector<ShapeT>& shapes,
+    const SubtreeFilter& is_included,
+    size_t n_threads) const {
+
+    using subtree_id_type = typename multi_index_base::toptree_type::value_type;
+    auto n_queries = shapes.size();
+    auto boxes = std::vector<Box3D>{};
+    auto centers = std::vector<Point3Dx>{};
+    boxes.reserve(n_queries);
+    centers.reserve(n_queries);
+    for(const auto& shape : shapes) {
+        const auto& box = bgi::indexable<ShapeT>{}(shape);
+        boxes.push_back(box);
+        centers.push_back((Point3Dx(box.min_corner()) + box.max_corner()) / CoordType(2));
+    }
+
+    // Every touch is a pair of the group of a subtree and a query. The groups
+    // are numbered in the order the subtrees are first touched.
+    auto group_of = std::unordered_map<size_t, size_t>{};
+    auto group_subtrees = std::vector<subtree_id_type>{};
+    auto touches = std::vector<std::pair<size_t, size_t>>{};
+
+    // Only the elements of the subtrees count towards the statistics.
+    auto to_query = std::vector<subtree_id_type>{};
+    auto top_tree_stats = QueryStats{};
+    for(auto i : experimental::space_filling_order(centers)) {
+        to_query.clear();
+        detail::with_query_stats(top_tree_stats, [&]() {
+            this->top_rtree.query(
+                bgi::intersects(boxes[i])
+                && bgi::satisfies(detail::GeometryIntersects<GeometryMode, ShapeT>{shapes[i]}),
+                std::back_inserter(to_query)
+            );
+        });
+
+        for(const auto& subtree_id : to_query) {
+            if(!is_included(size_t(subtree_id.id))) {
+                continue;
+            }
+
+            auto [it, is_new] = group_of.emplace(subtree_id.id, group_subtrees.size());
+            if(is_new) {
+                group_subtrees.push_back(subtree_id);
+            }
+            touches.emplace_back(it->second, i);
+        }
+    }
+    std::stable_sort(touches.begin(), touches.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    auto group_begin = std::vector<size_t>(group_subtrees.size() + 1, 0);
+    for(const auto& touch : touches) {
+        ++group_begin[touch.first + 1];
+    }
+    std::partial_sum(group_begin.begin(), group_begin.end(), group_begin.begin());
+
+    // The matches are stored with the index of their query; and put back in
+    // the original order afterwards.
+    using match_type = std::pair<size_t, T>;
+    auto query_groups = [&](size_t k_begin, size_t k_end, std::vector<match_type>& matches) {
+        for(size_t k = k_begin; k < k_end; ++k) {
+            util::check_signals();
+
+            const auto& subtree = this->load_subtree(group_subtrees[k]);
+            for(size_t j = group_begin[k]; j < group_begin[k + 1]; ++j) {
+                auto i = touches[j].second;
+                auto append = boost::make_function_output_iterator(
+                    [&matches, i](const auto& value) { matches.emplace_back(i, value); }
+                );
+
+                detail::deref_subtree(subtree).query(
+                    detail::intersects_predicate<GeometryMode, T>(shapes[i], boxes[i]),
+                    append
+                );
+            }
+
+            ++this->query_count;
+        }
+    };
+
+    auto n_groups = group_subtrees.size();
+    auto chunk_matches = std::vector<std::vector<match_type>>{};
+    if(!supports_concurrent_queries<MultiIndexTree>::value || n_threads <= 1 || n_groups <= 1) {
+        chunk_matches.resize(1);
+        query_groups(0, n_groups, chunk_matches[0]);
+    } else {
+        // Consecutive groups are close to each other, hence every chunk is
+        // a contiguous range of groups.
+        auto n_chunks = std::min(n_groups, 8 * n_threads);
+        chunk_matches.resize(n_chunks);
+        auto chunk_stats = std::vector<QueryStats>(n_chunks);
+
+        util::parallel_for(n_chunks, n_threads, [&](size_t k_chunk) {
+            auto range = util::balanced_chunks(n_groups, n_chunks, k_chunk);
+            detail::with_query_stats(chunk_stats[k_chunk], [&]() {
+                query_groups(range.low, range.high, chunk_matches[k_chunk]);
+            });
+        });
+
+        for(const auto& stats : chunk_stats) {
+            detail::add_to_running_query(stats);
+        }
+    }
+
+    return chunk_matches;
+}
+
+
+namespace detail {
+
+/// \brief The heavy data directories of the bases of the snapshot `output_dir`.
+inline std::vector<std::string> multi_index_base_dirs(const std::string& output_dir) {
+    auto meta_data = read_meta_data(output_dir);
+    const auto& section = meta_data[MetaDataConstants::multi_index_key];
+
+    auto base_dirs = std::vector<std::string>{};
+    if(section.contains(MetaDataConstants::base_paths_key)) {
+        for(const auto& relpath : section[MetaDataConstants::base_paths_key]) {
+            base_dirs.push_back(resolve_meta_data_path(output_dir, relpath.get<std::string>()));
+        }
+    }
+
+    return base_dirs;
+}
+
+/// \brief The storage which rewrites subtrees of the multi-index in `output_dir`.
+template <class Storage>
+inline Storage open_multi_index_storage_for_update(const std::string& output_dir) {
+    if constexpr (detail::is_container_storage<Storage>::value) {
+        if(!multi_index_base_dirs(output_dir).empty()) {
+            auto msg = boost::format("The storage doesn't support snapshots: %s") % output_dir;
+            throw std::runtime_error(msg.str());
+        }
+
+        // The rewritten subtrees go into a new container.
+        auto index_dir = resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key);
+        return Storage(index_dir, Storage::next_writer_id(index_dir));
+    } else {
+        return open_multi_index_storage<Storage>(output_dir);
+    }
+}
+
+/** \brief Save the top-level tree of an updated multi-index.
+ *
+ *  The positions recorded in the gid index are stale; hence it's removed.
+ */
+template <class Storage>
+inline void finalize_multi_index_update(const Storage& storage,
+                                        const std::string& output_dir,
+                                        const std::unordered_map<size_t, IndexedSubtreeBox>& boxes) {
+    using toptree_type = typename Storage::toptree_type;
+
+    auto updated_boxes = std::vector<IndexedSubtreeBox>{};
+    updated_boxes.reserve(boxes.size());
+    for(const auto& [id, box] : boxes) {
+        updated_boxes.push_back(box);
+    }
+
+    storage.save_top_tree(toptree_type(updated_boxes.begin(), updated_boxes.end()));
+
+    auto meta_data = read_meta_data(output_dir);
+    auto& section = meta_data[MetaDataConstants::multi_index_key];
+    if(section.contains(MetaDataConstants::gid_index_path_key)) {
+        auto relpath = section[MetaDataConstants::gid_index_path_key].get<std::string>();
+        std::filesystem::remove(resolve_meta_data_path(output_dir, relpath));
+        section.erase(MetaDataConstants::gid_index_path_key);
+        write_meta_data(deduce_meta_data_path(output_dir), meta_data);
+    }
+}
+
+}  // namespace detail
+
+
+template <class Storage>
+inline Storage open_multi_index_storage(const std::string& output_dir) {
+    auto index_dir = resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key);
+    auto base_dirs = detail::multi_index_base_dirs(output_dir);
+
+    if constexpr (std::is_constructible<Storage, std::string, std::vector<std::string>>::value) {
+        return Storage(std::move(index_dir), std::move(base_dirs));
+    } else {
+        if(!base_dirs.empty()) {
+            auto msg = boost::format("The storage doesn't support snapshots: %s") % output_dir;
+            throw std::runtime_error(msg.str());
+        }
+
+        return Storage(std::move(index_dir));
+    }
+}
+
+
+template <class Value, class Storage>
+inline void append_to_multi_index(const std::string& output_dir,
+                                  const std::vector<Value>& values,
+                                  size_t max_elements_per_part) {
+    using subtree_type = typename Storage::subtree_type;
+    using GetCoordinate = GetCenterCoordinate<Value>;
+
+    static_assert(std::is_same<typename subtree_type::value_type, Value>::value,
+                  "The values must be of the same type as those in the subtrees.");
+
+    if(values.empty()) {
+        return;
+    }
+
+    auto storage = detail::open_multi_index_storage_for_update<Storage>(output_dir);
+
+    auto top_tree = storage.load_top_tree();
+    if(top_tree.empty()) {
+        auto msg = boost::format("Can't append to a multi-index without subtrees: %s") % output_dir;
+        throw std::runtime_error(msg.str());
+    }
+
+    auto boxes = std::unordered_map<size_t, IndexedSubtreeBox>{};
+    size_t next_id = 0;
+    for(const auto& box : top_tree) {
+        boxes.emplace(box.id, box);
+        next_id = std::max(next_id, box.id + 1);
+    }
+
+    // Group the new values by the subtree they're added to.
+    auto added = std::unordered_map<size_t, std::vector<Value>>{};
+    for(const auto& value : values) {
+        auto centroid = Point3D{
+            GetCoordinate::template apply<0>(value),
+            GetCoordinate::template apply<1>(value),
+            GetCoordinate::template apply<2>(value)
+        };
+
+        auto it = top_tree.qbegin(bgi::nearest(centroid, 1));
+        added[it->id].push_back(value);
+    }
+
+    for(auto& [id, new_values] : added) {
+        util::check_signals();
+
+        auto subtree_values = std::vector<Value>{};
+        {
+            // The subtree might be a mapping of the file that's overwritten.
+            auto subtree = storage.load_subtree(id);
+            subtree_values.reserve(subtree.size() + new_values.size());
+            subtree_values.assign(subtree.begin(), subtree.end());
+        }
+        subtree_values.insert(subtree_values.end(), new_values.begin(), new_values.end());
+        new_values = {};
+
+        // Subtrees which are too large are split into the fewest STR parts
+        // per dimension which fit.
+        auto n_values = subtree_values.size();
+        auto n_parts_per_dim = size_t(1);
+        while(n_values > max_elements_per_part * n_parts_per_dim * n_parts_per_dim * n_parts_per_dim) {
+            ++n_parts_per_dim;
+        }
+
+        auto str_params = SerialSTRParams{
+            n_values, {n_parts_per_dim, n_parts_per_dim, n_parts_per_dim}
+        };
+        auto n_parts = str_params.n_parts();
+        if(n_parts > 1) {
+            serial_sort_tile_recursion<Value, GetCoordinate>(subtree_values, str_params);
+        }
+        auto boundaries = str_params.partition_boundaries();
+
+        for(size_t k = 0; k < n_parts; ++k) {
+            auto subtree = subtree_type(subtree_values.data() + boundaries[k],
+                                        subtree_values.data() + boundaries[k+1]);
+
+            // The first part keeps the id of the subtree it replaces.
+            auto part_id = k == 0 ? id : next_id++;
+            storage.save_subtree(subtree, part_id);
+            boxes.insert_or_assign(part_id, IndexedSubtreeBox(part_id, subtree.size(), subtree.bounds()));
+        }
+    }
+
+    detail::finalize_multi_index_update(storage, output_dir, boxes);
+}
+
+
+template <class Value, class Storage, class Predicate>
+inline size_t remove_from_multi_index(const std::string& output_dir,
+                                      const Predicate& is_removed) {
+    using subtree_type = typename Storage::subtree_type;
+
+    static_assert(std::is_same<typename subtree_type::value_type, Value>::value,
+                  "The values must be of the same type as those in the subtrees.");
+
+    auto storage = detail::open_multi_index_storage_for_update<Storage>(output_dir);
+    auto top_tree = storage.load_top_tree();
+
+    auto boxes = std::unordered_map<size_t, IndexedSubtreeBox>{};
+    for(const auto& box : top_tree) {
+        boxes.emplace(box.id, box);
+    }
+
+    size_t n_removed = 0;
+    for(const auto& box : top_tree) {
+        util::check_signals();
+
+        auto kept_values = std::vector<Value>{};
+        {
+            // The subtree might be a mapping of the file that's overwritten.
+            auto subtree = storage.load_subtree(box.id);
+            kept_values.reserve(subtree.size());
+            for(const auto& value : subtree) {
+                if(!is_removed(value)) {
+                    kept_values.push_back(value);
+                }
+            }
+
+            if(kept_values.size() == subtree.size()) {
+                continue;
+            }
+
+            n_removed += subtree.size() - kept_values.size();
+        }
+
+        if(kept_values.empty()) {
+            boxes.erase(box.id);
+            continue;
+        }
+
+        auto subtree = subtree_type(kept_values.begin(), kept_values.end());
+        storage.save_subtree(subtree, box.id);
+        boxes.insert_or_assign(box.id, IndexedSubtreeBox(box.id, subtree.size(), subtree.bounds()));
+    }
+
+    if(n_removed != 0) {
+        detail::finalize_multi_index_update(storage, output_dir, boxes);
+    }
+
+    return n_removed;
+}
+
+
+inline void create_multi_index_snapshot(const std::string& base_path,
+                                        const std::string& output_dir) {
+    namespace fs = std::filesystem;
+
+    auto index_reldir = std::string("multi_index");
+    auto index_dir = join_path(output_dir, index_reldir);
+    util::ensure_valid_output_directory(index_dir);
+
+    auto base_index_dir = resolve_heavy_data_path(base_path, MetaDataConstants::multi_index_key);
+    fs::copy_file(NativeFilenames::top_tree(base_index_dir), NativeFilenames::top_tree(index_dir));
+
+    // The bases are listed from the most recent to the oldest; such that
+    // the subtrees of the most recent version shadow the others.
+    auto snapshot_dir = fs::canonical(output_dir);
+    auto base_paths = nlohmann::json::array();
+    base_paths.push_back(fs::relative(fs::canonical(base_index_dir), snapshot_dir).string());
+    for(const auto& base_dir : detail::multi_index_base_dirs(base_path)) {
+        base_paths.push_back(fs::relative(fs::canonical(base_dir), snapshot_dir).string());
+    }
+
+    auto meta_data = read_meta_data(base_path);
+    auto& section = meta_data[MetaDataConstants::multi_index_key];
+    section["heavy_data_path"] = index_reldir;
+    section[MetaDataConstants::base_paths_key] = base_paths;
+    section.erase(MetaDataConstants::gid_index_path_key);
+
+    write_meta_data(default_meta_data_path(output_dir), meta_data);
+}
+
+
+#if SI_MPI == 1
+
+template <class Value, class Storage>
+MultiIndexBulkBuilder<Value, Storage>::MultiIndexBulkBuilder(std::string output_dir)
+    : output_dir_(std::move(output_dir)),
+      index_reldir_("multi_index"),
+      index_dir_(join_path(output_dir_, index_reldir_)) {
+
+    util::ensure_valid_output_directory(index_dir_);
+}
+
+
+template <class Value, class Storage>
+MultiIndexBulkBuilder<Value, Storage>::MultiIndexBulkBuilder(std::string output_dir,
+                                                             std::string scratch_dir,
+                                                             size_t max_elements_in_memory)
+    : MultiIndexBulkBuilder(std::move(output_dir)) {
+
+    if(max_elements_in_memory == 0) {
+        throw std::invalid_argument("Streaming requires room for at least one element.");
+    }
+
+    std::filesystem::create_directories(scratch_dir);
+
+    scratch_dir_ = std::move(scratch_dir);
+    max_elements_in_memory_ = max_elements_in_memory;
+    spilled_runs_ = spilled_runs_type(
+        scratch_dir_, "run_" + std::to_string(mpi::rank(MPI_COMM_WORLD))
+    );
+}
+
+
+template <class Value, class Storage>
+template <class BeginIt, class EndIt>
+inline void MultiIndexBulkBuilder<Value, Storage>::insert(BeginIt begin, EndIt end) {
+    if(!is_streaming()) {
+        IndexBulkBuilderBase<Value>::insert(begin, end);
+        return;
+    }
+
+    for(auto it = begin; it != end; ++it) {
+        insert(*it);
+    }
+}
+
+
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::insert(const Value& value) {
+    IndexBulkBuilderBase<Value>::insert(value);
+    spill_if_needed();
+}
+
+
+template <class Value, class Storage>
+inline bool MultiIndexBulkBuilder<Value, Storage>::is_streaming() const {
+    return max_elements_in_memory_ > 0;
+}
+
+
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::spill_if_needed() {
+    if(is_streaming() && this->values_.size() >= max_elements_in_memory_) {
+        spilled_runs_.spill(this->values_);
+    }
+}
+
+
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::finalize(MPI_Comm comm, size_t n_threads) {
+    finalize(comm, n_threads, UnitWeight{});
+}
+
+
+template <class Value, class Storage>
+template <class Weight>
+inline void MultiIndexBulkBuilder<Value, Storage>::finalize(MPI_Comm comm,
+                                                            size_t n_threads,
+                                                            const Weight& weight) {
+    if(is_streaming() && !std::is_same<Weight, UnitWeight>::value) {
+        throw std::invalid_argument("Weighted partitioning requires the in-memory builder.");
+    }
+
+    auto comm_size = mpi::size(comm);
+
+    size_t n_values = local_size();
+    size_t n_total_values = 0;
     MPI_Allreduce(&n_values, &n_total_values, 1, MPI_SIZE_T, MPI_SUM, comm);
     this->n_total_values_ = n_total_values;
 
     auto max_elements_per_part = size_t(4e6);
 
-    auto str_params = two_level_str_heuristic(
-        n_total_values,
-        max_elements_per_part,
-        comm_size
-    );
-    auto storage = NativeStorageT<Value>(index_dir_);
+    auto storage = [&]() {
+        if constexpr (detail::is_container_storage<Storage>::value) {
+            // Every rank appends its subtrees to its own container. Those of
+            // an earlier build on more ranks would supersede them.
+            auto mpi_rank = size_t(mpi::rank(comm));
+            if(mpi_rank == 0) {
+                Storage::remove_containers(index_dir_, size_t(comm_size));
+            }
+
+            auto rank_storage = Storage(index_dir_, mpi_rank);
+            rank_storage.create_container();
+            return rank_storage;
+        } else {
+            return Storage(index_dir_);
+        }
+    }();
     using GetCoordinate = GetCenterCoordinate<Value>;
-    distributed_partition<GetCoordinate>(storage, this->values_, str_params, comm);
+
+    if(is_streaming()) {
+        if(!this->values_.empty()) {
+            spilled_runs_.spill(this->values_);
+        }
+
+        external_distributed_partition<GetCoordinate>(
+            storage,
+            spilled_runs_,
+            scratch_dir_,
+            max_elements_per_part,
+            max_elements_in_memory_,
+            comm
+        );
+    } else {
+        auto str_params = two_level_str_heuristic(
+            n_total_values,
+            max_elements_per_part,
+            comm_size
+        );
+        distributed_partition<GetCoordinate>(
+            storage, this->values_, str_params, comm, n_threads, weight
+        );
+    }
 
     write_meta_data();
 }
 
-template <class Value>
-inline void MultiIndexBulkBuilder<Value>::write_meta_data() const {
+template <class Value, class Storage>
+inline void MultiIndexBulkBuilder<Value, Storage>::write_meta_data() const {
     auto element_type = value_to_element_type<Value>();
     auto meta_data = create_basic_meta_data(element_type);
     meta_data[MetaDataConstants::multi_index_key] = {
         // Relative path of the heavy files.
-        {"heavy_data_path", index_reldir_}
+        {"heavy_data_path", index_reldir_},
+        {"subtree_compression", detail::storage_codec<Storage>::type::name}
     };
 
     brain_indexer::write_meta_data(default_meta_data_path(output_dir_), meta_data);
 }
 
-template <class Value>
-inline size_t MultiIndexBulkBuilder<Value>::local_size() const {
-    return this->values_.size();
+template <class Value, class Storage>
+inline size_t MultiIndexBulkBuilder<Value, Storage>::local_size() const {
+    return this->values_.size() + spilled_runs_.size();
 }
 #endif
 
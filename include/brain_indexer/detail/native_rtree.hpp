@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/format.hpp>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief Header of the format written by `write_native_rtree`.
+struct NativeRTreeHeader {
+    static constexpr std::uint64_t current_version = 1;
+
+    char magic[8];
+    std::uint64_t version;
+    std::uint64_t struct_version;
+    std::uint64_t value_size;
+    std::uint64_t box_size;
+    std::uint64_t n_values;
+    std::uint64_t leafs_level;
+    std::uint64_t n_nodes;
+};
+
+static constexpr char native_rtree_magic[8] = {'S', 'I', 'N', 'A', 'T', 'I', 'V', 'E'};
+
+
+/// \brief The nodes of an R-tree, level by level.
+template <class MembersHolder>
+struct NativeRTreeLevels {
+    using box_type = typename MembersHolder::box_type;
+    using leaf = typename MembersHolder::leaf;
+
+    explicit NativeRTreeLevels(size_t n_levels)
+        : n_children(n_levels), boxes(n_levels) {}
+
+    std::vector<std::vector<std::uint32_t>> n_children;
+    /// The bounding boxes of the nodes on each level; none for the root.
+    std::vector<std::vector<box_type>> boxes;
+    std::vector<const leaf*> leaves;
+};
+
+template <class MembersHolder>
+inline void collect_native_rtree_levels(typename MembersHolder::node_pointer node,
+                                        size_t level,
+                                        size_t leafs_level,
+                                        NativeRTreeLevels<MembersHolder>& levels) {
+    namespace rtree = bgi::detail::rtree;
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+
+    if(level < leafs_level) {
+        const auto& elements = rtree::elements(rtree::get<internal_node>(*node));
+        levels.n_children[level].push_back(std::uint32_t(elements.size()));
+
+        for(const auto& element : elements) {
+            levels.boxes[level + 1].push_back(element.first);
+            collect_native_rtree_levels(element.second, level + 1, leafs_level, levels);
+        }
+    } else {
+        const auto& l = rtree::get<leaf>(*node);
+        levels.n_children[level].push_back(std::uint32_t(rtree::elements(l).size()));
+        levels.leaves.push_back(&l);
+    }
+}
+
+template <class T>
+inline void write_native_rtree_array(std::ostream& os, const std::vector<T>& array) {
+    os.write(reinterpret_cast<const char*>(array.data()),
+             std::streamsize(array.size() * sizeof(T)));
+}
+
+template <class T>
+inline std::vector<T> read_native_rtree_array(std::istream& is, size_t n) {
+    auto array = std::vector<T>(n);
+    is.read(reinterpret_cast<char*>(array.data()), std::streamsize(n * sizeof(T)));
+
+    return array;
+}
+
+inline std::runtime_error invalid_native_rtree(const std::string& reason) {
+    return std::runtime_error("Invalid native R-tree: " + reason);
+}
+
+} // namespace detail
+
+
+template <class... Args>
+inline void write_native_rtree(const bgi::rtree<Args...>& tree, std::ostream& os) {
+    using rtree_type = bgi::rtree<Args...>;
+    using view = bgi::detail::rtree::const_private_view<rtree_type>;
+    using members_holder = typename view::members_holder;
+    using value_type = typename rtree_type::value_type;
+    using box_type = typename members_holder::box_type;
+    using header_t = detail::NativeRTreeHeader;
+
+    static_assert(detail::is_packable<value_type>::value,
+                  "The values of a native R-tree must be safe to copy bytewise.");
+    static_assert(std::is_trivially_copyable<box_type>::value,
+                  "The boxes of a native R-tree must be safe to copy bytewise.");
+
+    view tree_view(tree);
+    const auto& members = tree_view.members();
+
+    auto n_levels = members.values_count > 0 ? size_t(members.leafs_level) + 1 : size_t(0);
+    auto levels = detail::NativeRTreeLevels<members_holder>(n_levels);
+    if(n_levels > 0) {
+        detail::collect_native_rtree_levels(members.root, 0, members.leafs_level, levels);
+    }
+
+    auto header = header_t{};
+    std::memcpy(header.magic, detail::native_rtree_magic, sizeof(header.magic));
+    header.version = header_t::current_version;
+    header.struct_version = SPATIAL_INDEX_STRUCT_VERSION;
+    header.value_size = sizeof(value_type);
+    header.box_size = sizeof(box_type);
+    header.n_values = members.values_count;
+    header.leafs_level = n_levels > 0 ? members.leafs_level : 0;
+    header.n_nodes = 0;
+    for(const auto& n_children : levels.n_children) {
+        header.n_nodes += n_children.size();
+    }
+
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for(const auto& n_children : levels.n_children) {
+        detail::write_native_rtree_array(os, n_children);
+    }
+    for(const auto& boxes : levels.boxes) {
+        detail::write_native_rtree_array(os, boxes);
+    }
+    for(const auto* leaf : levels.leaves) {
+        const auto& elements = bgi::detail::rtree::elements(*leaf);
+        os.write(reinterpret_cast<const char*>(elements.data()),
+                 std::streamsize(elements.size() * sizeof(value_type)));
+    }
+
+    if(!os) {
+        throw std::runtime_error("Failed to write native R-tree.");
+    }
+}
+
+
+template <class... Args>
+inline void read_native_rtree(bgi::rtree<Args...>& tree, std::istream& is) {
+    namespace rtree = bgi::detail::rtree;
+
+    using rtree_type = bgi::rtree<Args...>;
+    using view = rtree::private_view<rtree_type>;
+    using members_holder = typename view::members_holder;
+    using value_type = typename rtree_type::value_type;
+    using box_type = typename members_holder::box_type;
+    using allocators_type = typename members_holder::allocators_type;
+    using node_pointer = typename members_holder::node_pointer;
+    using internal_node = typename members_holder::internal_node;
+    using leaf = typename members_holder::leaf;
+    using element_type = typename rtree::elements_type<internal_node>::type::value_type;
+    using subtree_destroyer = rtree::subtree_destroyer<members_holder>;
+    using header_t = detail::NativeRTreeHeader;
+
+    static_assert(detail::is_packable<value_type>::value,
+                  "The values of a native R-tree must be safe to copy bytewise.");
+
+    view tree_view(tree);
+    auto& members = tree_view.members();
+
+    auto header = header_t{};
+    if(!is.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw detail::invalid_native_rtree("the header is truncated");
+    }
+
+    if(std::memcmp(header.magic, detail::native_rtree_magic, sizeof(header.magic)) != 0) {
+        throw detail::invalid_native_rtree("wrong magic number");
+    }
+
+    if(header.version != header_t::current_version) {
+        throw detail::invalid_native_rtree("unsupported version " + std::to_string(header.version));
+    }
+
+    if(header.struct_version != SPATIAL_INDEX_STRUCT_VERSION) {
+        auto msg = boost::format(
+            "it was written with struct version %d instead of %d. Please recreate the index."
+        ) % header.struct_version % SPATIAL_INDEX_STRUCT_VERSION;
+        throw detail::invalid_native_rtree(msg.str());
+    }
+
+    if(header.value_size != sizeof(value_type) || header.box_size != sizeof(box_type)) {
+        throw detail::invalid_native_rtree("the element type doesn't match");
+    }
+
+    if((header.n_nodes == 0) != (header.n_values == 0)
+       || (header.n_nodes > 0 && header.leafs_level >= header.n_nodes)) {
+        throw detail::invalid_native_rtree("inconsistent header");
+    }
+
+    auto n_children = detail::read_native_rtree_array<std::uint32_t>(is, header.n_nodes);
+    auto boxes = detail::read_native_rtree_array<box_type>(
+        is, header.n_nodes > 0 ? header.n_nodes - 1 : 0
+    );
+    if(!is) {
+        throw detail::invalid_native_rtree("the nodes are truncated");
+    }
+
+    // The nodes of level `l` are `level_begin[l], ..., level_begin[l+1]-1`.
+    auto max_elements = members.parameters().get_max_elements();
+    auto level_begin = std::vector<size_t>{0};
+    if(header.n_nodes > 0) {
+        level_begin.push_back(1);
+        for(size_t level = 0; level <= header.leafs_level; ++level) {
+            size_t n_next = 0;
+            for(size_t i = level_begin[level]; i < level_begin[level + 1]; ++i) {
+                if(n_children[i] == 0 || n_children[i] > max_elements) {
+                    throw detail::invalid_native_rtree("invalid number of children");
+                }
+                n_next += n_children[i];
+            }
+
+            auto expected = level < header.leafs_level ? header.n_nodes - level_begin[level + 1]
+                                                       : header.n_values;
+            if(n_next > expected || (level == header.leafs_level && n_next != expected)) {
+                throw detail::invalid_native_rtree("inconsistent number of nodes");
+            }
+
+            if(level < header.leafs_level) {
+                level_begin.push_back(level_begin[level + 1] + n_next);
+            }
+        }
+
+        if(level_begin.back() != header.n_nodes) {
+            throw detail::invalid_native_rtree("inconsistent number of nodes");
+        }
+    }
+
+    // The nodes are built bottom-up. Until a node is linked to its parent,
+    // it's owned by `nodes`.
+    auto nodes = std::vector<node_pointer>(header.n_nodes, node_pointer(0));
+    try {
+        for(size_t i = level_begin[header.leafs_level]; i < header.n_nodes; ++i) {
+            nodes[i] = rtree::create_node<allocators_type, leaf>::apply(members.allocators());
+
+            auto& elements = rtree::elements(rtree::get<leaf>(*nodes[i]));
+            elements.resize(n_children[i]);
+            is.read(reinterpret_cast<char*>(elements.data()),
+                    std::streamsize(n_children[i] * sizeof(value_type)));
+        }
+
+        if(!is) {
+            throw detail::invalid_native_rtree("the values are truncated");
+        }
+
+        for(size_t level = header.leafs_level; level-- > 0; ) {
+            auto child = level_begin[level + 1];
+            for(size_t i = level_begin[level]; i < level_begin[level + 1]; ++i) {
+                nodes[i] = rtree::create_node<allocators_type, internal_node>::apply(
+                    members.allocators()
+                );
+
+                auto& elements = rtree::elements(rtree::get<internal_node>(*nodes[i]));
+                for(size_t k = 0; k < n_children[i]; ++k, ++child) {
+                    elements.push_back(element_type(boxes[child - 1], nodes[child]));
+                    nodes[child] = node_pointer(0);
+                }
+            }
+        }
+    }
+    catch(...) {
+        for(auto node : nodes) {
+            subtree_destroyer remover(node, members.allocators());
+        }
+        throw;
+    }
+
+    auto root = header.n_nodes > 0 ? nodes[0] : node_pointer(0);
+
+    subtree_destroyer remover(members.root, members.allocators());
+    members.root = root;
+    members.values_count = header.n_values;
+    members.leafs_level = header.leafs_level;
+}
+
+
+inline bool is_native_rtree(std::istream& is) {
+    auto position = is.tellg();
+
+    char magic[sizeof(detail::native_rtree_magic)] = {};
+    is.read(magic, sizeof(magic));
+    auto is_native = bool(is)
+        && std::memcmp(magic, detail::native_rtree_magic, sizeof(magic)) == 0;
+
+    is.clear();
+    is.seekg(position);
+
+    return is_native;
+}
+
+
+template <class Tree>
+inline void save_rtree(const Tree& tree, std::ostream& os) {
+    if constexpr (detail::is_packable<typename Tree::value_type>::value) {
+        write_native_rtree(tree, os);
+    } else {
+        boost::archive::binary_oarchive oa(os);
+        oa << tree;
+    }
+}
+
+
+template <class Tree>
+inline void load_rtree(Tree& tree, std::istream& is) {
+    if constexpr (detail::is_packable<typename Tree::value_type>::value) {
+        if(is_native_rtree(is)) {
+            read_native_rtree(tree, is);
+            return;
+        }
+    }
+
+    // Legacy format, or values which can't be copied bytewise.
+    boost::archive::binary_iarchive ia(is);
+    ia >> tree;
+}
+
+} // namespace brain_indexer
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cmath>
+#include <stdexcept>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief The rotation matrix, row by row, of the quaternion `(w, x, y, z)`.
+inline std::array<double, 9> rotation_matrix(const std::array<CoordType, 4>& q) {
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    double norm = std::sqrt(w * w + x * x + y * y + z * z);
+    if(norm == 0.0) {
+        throw std::invalid_argument("The rotation quaternion must not be zero.");
+    }
+
+    w /= norm; x /= norm; y /= norm; z /= norm;
+
+    return {
+        1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y - w * z), 2.0 * (x * z + w * y),
+        2.0 * (x * y + w * z), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z - w * x),
+        2.0 * (x * z - w * y), 2.0 * (y * z + w * x), 1.0 - 2.0 * (x * x + y * y)
+    };
+}
+
+/// \brief Rotate and shift the `n_points` points `in` into `out`.
+inline void transform_points(const Point3D* in,
+                             size_t n_points,
+                             const std::array<double, 9>& r,
+                             const Point3D& shift,
+                             Point3D* out) {
+    const auto r00 = CoordType(r[0]), r01 = CoordType(r[1]), r02 = CoordType(r[2]);
+    const auto r10 = CoordType(r[3]), r11 = CoordType(r[4]), r12 = CoordType(r[5]);
+    const auto r20 = CoordType(r[6]), r21 = CoordType(r[7]), r22 = CoordType(r[8]);
+    const auto sx = shift.get<0>(), sy = shift.get<1>(), sz = shift.get<2>();
+
+    // Point3D is three packed coordinates, see `extract_points_ptr`.
+    const auto* src = reinterpret_cast<const CoordType*>(in);
+    auto* dst = reinterpret_cast<CoordType*>(out);
+
+    for(size_t i = 0; i < n_points; ++i) {
+        const auto x = src[3 * i], y = src[3 * i + 1], z = src[3 * i + 2];
+        dst[3 * i] = r00 * x + r01 * y + r02 * z + sx;
+        dst[3 * i + 1] = r10 * x + r11 * y + r12 * z + sy;
+        dst[3 * i + 2] = r20 * x + r21 * y + r22 * z + sz;
+    }
+}
+
+}  // namespace detail
+
+
+template <class OutputIt>
+inline void ingest_neurons(const std::vector<MorphologyView>& morphologies,
+                           const std::vector<NeuronPlacement>& placements,
+                           OutputIt it) {
+    static_assert(sizeof(Point3D) == 3 * sizeof(CoordType),
+                  "Point3D must consist of three packed coordinates.");
+
+    auto points = std::vector<Point3D>{};
+
+    for(const auto& placement : placements) {
+        const auto& morph = morphologies.at(placement.morphology_id);
+        const auto gid = placement.gid;
+
+        Point3D soma_center = Point3Dx(morph.soma_center) + placement.position;
+        *it = Soma{gid, soma_center, morph.soma_radius};
+        ++it;
+
+        points.resize(morph.n_points);
+        detail::transform_points(morph.points,
+                                 morph.n_points,
+                                 detail::rotation_matrix(placement.rotation),
+                                 placement.position,
+                                 points.data());
+
+        for(size_t k = 0; k < morph.n_sections; ++k) {
+            const size_t p_start = morph.section_offsets[k];
+            const size_t p_end = k + 1 < morph.n_sections ? morph.section_offsets[k + 1]
+                                                          : morph.n_points;
+            const auto section_id = unsigned(k + 1);
+            const auto section_type = SectionType(morph.section_types[k]);
+
+            for(size_t p = p_start; p + 1 < p_end; ++p) {
+                const auto segment_id = unsigned(p - p_start);
+                const auto radius = (morph.radii[p] + morph.radii[p + 1]) / 2;
+                *it = Segment{gid, section_id, segment_id,
+                              points[p], points[p + 1], radius, section_type};
+                ++it;
+            }
+        }
+    }
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,358 @@
+#pragma once
+
+#include "../node_shared_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <stdexcept>
+
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief The name of the `NodeSharedState` inside the segment.
+constexpr const char* node_shared_state_name = "brain_indexer::NodeSharedState";
+
+/// \brief Releases the pin of a subtree when the last copy of its handle is destroyed.
+struct NodeSharedPin {
+    using segment_type = boost::interprocess::managed_shared_memory;
+
+    NodeSharedPin(std::shared_ptr<segment_type> segment, NodeSharedState* state, size_t id)
+        : segment(std::move(segment)), state(state), id(id) {}
+
+    NodeSharedPin(const NodeSharedPin&) = delete;
+    NodeSharedPin& operator=(const NodeSharedPin&) = delete;
+
+    ~NodeSharedPin() {
+        auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+            state->mutex
+        );
+
+        // Pinned subtrees aren't evicted; therefore, it's always found.
+        auto it = state->entries.find(id);
+        if(it != state->entries.end()) {
+            --it->second.n_pins;
+        }
+    }
+
+    std::shared_ptr<segment_type> segment;
+    NodeSharedState* state;
+    size_t id;
+};
+
+}  // namespace detail
+
+
+template <class Storage>
+NodeSharedCache<Storage>::NodeSharedCache(const std::string& segment_name,
+                                          size_t max_cached_bytes,
+                                          Storage storage)
+    : NodeSharedCache(
+        std::make_shared<segment_type>(boost::interprocess::open_or_create,
+                                       segment_name.c_str(),
+                                       segment_size(max_cached_bytes)),
+        max_cached_bytes,
+        std::move(storage)) {}
+
+
+template <class Storage>
+NodeSharedCache<Storage>::NodeSharedCache(std::shared_ptr<segment_type> segment,
+                                          size_t max_cached_bytes,
+                                          Storage storage)
+    : storage(std::move(storage))
+    , segment(std::move(segment))
+    , max_cached_bytes(max_cached_bytes) {
+
+    state = this->segment->template find_or_construct<detail::NodeSharedState>(
+        detail::node_shared_state_name
+    )(this->segment->get_segment_manager());
+}
+
+
+template <class Storage>
+inline size_t NodeSharedCache<Storage>::segment_size(size_t max_cached_bytes) {
+    // The entries of the map and the bookkeeping of the allocator live in
+    // the segment too. The pages of the segment are only backed by memory
+    // once they're used.
+    constexpr size_t min_overhead = size_t(1) << 20;
+    if(max_cached_bytes > std::numeric_limits<size_t>::max() / 2) {
+        throw std::invalid_argument("NodeSharedCache requires a finite memory budget.");
+    }
+
+    return max_cached_bytes + max_cached_bytes / 16 + min_overhead;
+}
+
+
+template <class Storage>
+inline void NodeSharedCache<Storage>::remove_segment(const std::string& segment_name) {
+    boost::interprocess::shared_memory_object::remove(segment_name.c_str());
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline auto
+NodeSharedCache<Storage>::load_subtree(const SubtreeID& subtree_id, size_t /* query_count */)
+        -> subtree_handle {
+
+    auto id = subtree_id.id;
+
+    {
+        auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+            state->mutex
+        );
+
+        auto it = state->entries.find(id);
+        if(it != state->entries.end()) {
+            ++it->second.n_pins;
+            it->second.last_use = ++state->clock;
+            return make_handle(id, it->second);
+        }
+    }
+
+    // Loading happens without holding the lock. If several processes load the
+    // same subtree at once, only the first copy is shared.
+    return share_subtree(id, storage.load_subtree(id));
+}
+
+
+template <class Storage>
+template <class SubtreeID>
+inline auto
+NodeSharedCache<Storage>::insert_subtree(const SubtreeID& subtree_id,
+                                         subtree_type subtree,
+                                         size_t /* query_count */)
+        -> subtree_handle {
+
+    return share_subtree(subtree_id.id, std::move(subtree));
+}
+
+
+template <class Storage>
+inline bool NodeSharedCache<Storage>::is_cached(size_t subtree_id) const {
+    auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+        state->mutex
+    );
+
+    return state->entries.find(subtree_id) != state->entries.end();
+}
+
+
+template <class Storage>
+inline size_t NodeSharedCache<Storage>::cached_bytes() const {
+    auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+        state->mutex
+    );
+
+    return state->cached_bytes;
+}
+
+
+template <class Storage>
+inline std::vector<size_t> NodeSharedCache<Storage>::cached_subtree_ids() const {
+    auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+        state->mutex
+    );
+
+    auto ranked = std::vector<std::pair<size_t, size_t>>{};
+    for(const auto& kv : state->entries) {
+        ranked.emplace_back(kv.second.last_use, kv.first);
+    }
+    std::sort(ranked.rbegin(), ranked.rend());
+
+    auto ids = std::vector<size_t>{};
+    for(const auto& [_, id] : ranked) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+
+template <class Storage>
+inline bool NodeSharedCache<Storage>::has_room_for(size_t /* n_elements */,
+                                                   size_t n_bytes) const {
+    return cached_bytes() + n_bytes <= max_cached_bytes;
+}
+
+
+template <class Storage>
+inline size_t NodeSharedCache<Storage>::estimated_bytes(size_t n_elements) const {
+    auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+        state->mutex
+    );
+
+    size_t n_values = 0;
+    for(const auto& kv : state->entries) {
+        n_values += kv.second.n_values;
+    }
+
+    if(n_values == 0) {
+        return 0;
+    }
+
+    return size_t(double(n_elements) * double(state->cached_bytes) / double(n_values));
+}
+
+
+template <class Storage>
+inline auto
+NodeSharedCache<Storage>::make_handle(size_t subtree_id,
+                                      const detail::NodeSharedEntry& entry) const
+        -> subtree_handle {
+
+    using value_type = typename subtree_type::value_type;
+    using node_type = typename subtree_type::node_type;
+    using leaf_type = typename subtree_type::leaf_type;
+
+    auto base = static_cast<const char*>(segment->get_address_from_handle(entry.handle));
+    auto pin = std::make_shared<detail::NodeSharedPin>(segment, state, subtree_id);
+
+    return subtree_type(PackedRTree<value_type>(
+        std::move(pin),
+        reinterpret_cast<const node_type*>(base + entry.nodes_offset), entry.n_nodes,
+        reinterpret_cast<const leaf_type*>(base + entry.leaves_offset), entry.n_leaves,
+        reinterpret_cast<const value_type*>(base + entry.values_offset), entry.n_values
+    ));
+}
+
+
+template <class Storage>
+inline auto
+NodeSharedCache<Storage>::share_subtree(size_t subtree_id, subtree_type subtree)
+        -> subtree_handle {
+
+    using value_type = typename subtree_type::value_type;
+    using node_type = typename subtree_type::node_type;
+    using leaf_type = typename subtree_type::leaf_type;
+
+    // The same layout as the files written by `write_packed_rtree`.
+    auto entry = detail::NodeSharedEntry{};
+    entry.nodes_offset = 0;
+    entry.n_nodes = subtree.n_nodes();
+    entry.leaves_offset = detail::packed_rtree_align(entry.n_nodes * sizeof(node_type));
+    entry.n_leaves = subtree.n_leaves();
+    entry.values_offset = detail::packed_rtree_align(
+        entry.leaves_offset + entry.n_leaves * sizeof(leaf_type)
+    );
+    entry.n_values = subtree.size();
+    entry.n_bytes = entry.values_offset + entry.n_values * sizeof(value_type);
+    entry.n_pins = 1;
+
+    auto lock = boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex>(
+        state->mutex
+    );
+
+    auto it = state->entries.find(subtree_id);
+    if(it != state->entries.end()) {
+        ++it->second.n_pins;
+        it->second.last_use = ++state->clock;
+        return make_handle(subtree_id, it->second);
+    }
+
+    if(entry.n_bytes > max_cached_bytes) {
+        return subtree;
+    }
+
+    // The budget might be met while the segment is too fragmented, hence the
+    // allocation can fail too.
+    void* block = nullptr;
+    while(block == nullptr) {
+        if(state->cached_bytes + entry.n_bytes <= max_cached_bytes) {
+            block = segment->allocate_aligned(std::max(entry.n_bytes, size_t(1)),
+                                              detail::PackedRTreeFileHeader::alignment,
+                                              std::nothrow);
+        }
+
+        if(block == nullptr && !evict_one()) {
+            return subtree;
+        }
+    }
+
+    auto base = static_cast<char*>(block);
+    auto copy = [base](size_t offset, const auto* array, size_t n) {
+        if(n > 0) {
+            std::memcpy(base + offset, array, n * sizeof(*array));
+        }
+    };
+    copy(entry.nodes_offset, subtree.nodes(), entry.n_nodes);
+    copy(entry.leaves_offset, subtree.leaves(), entry.n_leaves);
+    copy(entry.values_offset, subtree.begin(), entry.n_values);
+
+    entry.handle = segment->get_handle_from_address(block);
+    entry.last_use = ++state->clock;
+
+    try {
+        it = state->entries.emplace(subtree_id, entry).first;
+    } catch(const boost::interprocess::bad_alloc&) {
+        segment->deallocate(block);
+        return subtree;
+    }
+
+    state->cached_bytes += entry.n_bytes;
+    return make_handle(subtree_id, it->second);
+}
+
+
+template <class Storage>
+inline bool NodeSharedCache<Storage>::evict_one() {
+    auto victim = state->entries.end();
+    for(auto it = state->entries.begin(); it != state->entries.end(); ++it) {
+        const auto& entry = it->second;
+        if(entry.n_pins == 0
+           && (victim == state->entries.end() || entry.last_use < victim->second.last_use)) {
+            victim = it;
+        }
+    }
+
+    if(victim == state->entries.end()) {
+        return false;
+    }
+
+    segment->deallocate(segment->get_address_from_handle(victim->second.handle));
+    state->cached_bytes -= victim->second.n_bytes;
+    state->entries.erase(victim);
+
+    return true;
+}
+
+
+#if SI_MPI == 1
+template <class Storage>
+inline NodeSharedCache<Storage> make_node_shared_cache(const std::string& segment_name,
+                                                       size_t max_cached_bytes,
+                                                       Storage storage,
+                                                       MPI_Comm comm) {
+    using cache_type = NodeSharedCache<Storage>;
+    using segment_type = boost::interprocess::managed_shared_memory;
+
+    auto node_comm = mpi::comm_split_shared(comm);
+    auto node_rank = mpi::rank(*node_comm);
+
+    auto segment = std::shared_ptr<segment_type>{};
+    if(node_rank == 0) {
+        cache_type::remove_segment(segment_name);
+        segment = std::make_shared<segment_type>(boost::interprocess::create_only,
+                                                 segment_name.c_str(),
+                                                 cache_type::segment_size(max_cached_bytes));
+    }
+
+    MPI_Barrier(*node_comm);
+    if(node_rank != 0) {
+        segment = std::make_shared<segment_type>(boost::interprocess::open_only,
+                                                 segment_name.c_str());
+    }
+
+    MPI_Barrier(*node_comm);
+    if(node_rank == 0) {
+        cache_type::remove_segment(segment_name);
+    }
+
+    return cache_type(std::move(segment), max_cached_bytes, std::move(storage));
+}
+#endif
+
+}  // namespace brain_indexer
@@ -7,6 +7,9 @@
 
 #include "../index.hpp"
 
+#include <stdexcept>
+#include <string>
+
 #include <boost/container/vector.hpp>
 
 namespace brain_indexer {
@@ -96,12 +99,55 @@ inline SectionType get_section_type(const MorphoEntry& element) {
 
 // Structures that contains the results of a query.
 // Necessary to export data as numpy arrays.
+//
+// Only the fields selected by `fields` are filled, see `query_fields_t`. The
+// bits of the fields are listed in `field`; and `field_mask` maps the name of
+// a field to its bit.
+
+struct query_result_base {
+    query_fields_t fields = all_query_fields;
+
+    inline bool has(query_fields_t field) const noexcept {
+        return (fields & field) != 0;
+    }
+};
+
+inline std::invalid_argument invalid_query_field(const std::string& name) {
+    return std::invalid_argument("Invalid field: " + name);
+}
 
 template<typename Element>
 struct query_result;
 
 template<>
-struct query_result<MorphoEntry> {
+struct query_result<MorphoEntry> : public query_result_base {
+    struct field {
+        enum : query_fields_t {
+            gid = 1u << 0,
+            section_id = 1u << 1,
+            segment_id = 1u << 2,
+            ids = 1u << 3,
+            centroid = 1u << 4,
+            radius = 1u << 5,
+            endpoints = 1u << 6,
+            section_type = 1u << 7,
+            is_soma = 1u << 8
+        };
+    };
+
+    static inline query_fields_t field_mask(const std::string& name) {
+        if(name == "gid") { return field::gid; }
+        if(name == "section_id") { return field::section_id; }
+        if(name == "segment_id") { return field::segment_id; }
+        if(name == "ids") { return field::ids; }
+        if(name == "centroid") { return field::centroid; }
+        if(name == "radius") { return field::radius; }
+        if(name == "endpoints") { return field::endpoints; }
+        if(name == "section_type") { return field::section_type; }
+        if(name == "is_soma") { return field::is_soma; }
+        throw invalid_query_field(name);
+    }
+
     std::vector<identifier_t> gid;
     std::vector<unsigned> section_id;
     std::vector<unsigned> segment_id;
@@ -115,7 +161,24 @@ struct query_result<MorphoEntry> {
 };
 
 template<>
-struct query_result<Synapse> {
+struct query_result<Synapse> : public query_result_base {
+    struct field {
+        enum : query_fields_t {
+            id = 1u << 0,
+            pre_gid = 1u << 1,
+            post_gid = 1u << 2,
+            position = 1u << 3
+        };
+    };
+
+    static inline query_fields_t field_mask(const std::string& name) {
+        if(name == "id") { return field::id; }
+        if(name == "pre_gid") { return field::pre_gid; }
+        if(name == "post_gid") { return field::post_gid; }
+        if(name == "position") { return field::position; }
+        throw invalid_query_field(name);
+    }
+
     std::vector<identifier_t> id;
     std::vector<identifier_t> pre_gid;
     std::vector<identifier_t> post_gid;
@@ -123,37 +186,72 @@ struct query_result<Synapse> {
 };
 
 template<>
-struct query_result<IndexedSphere> {
+struct query_result<IndexedSphere> : public query_result_base {
+    struct field {
+        enum : query_fields_t {
+            id = 1u << 0,
+            centroid = 1u << 1,
+            radius = 1u << 2
+        };
+    };
+
+    static inline query_fields_t field_mask(const std::string& name) {
+        if(name == "id") { return field::id; }
+        if(name == "centroid") { return field::centroid; }
+        if(name == "radius") { return field::radius; }
+        throw invalid_query_field(name);
+    }
+
     std::vector<identifier_t> id;
     std::vector<Point3D> centroid;
     std::vector<CoordType> radius;
 };
 
 template <>
-struct query_result<IndexedPoint> {
+struct query_result<IndexedPoint> : public query_result_base {
+    struct field {
+        enum : query_fields_t {
+            id = 1u << 0,
+            position = 1u << 1
+        };
+    };
+
+    static inline query_fields_t field_mask(const std::string& name) {
+        if(name == "id") { return field::id; }
+        if(name == "position") { return field::position; }
+        throw invalid_query_field(name);
+    }
+
     std::vector<identifier_t> id;
     std::vector<Point3D> position;
 };
 
-}  // namespace detail
-
-
-
-template <typename ArgT>
-struct iter_callback: public detail::iter_append_only<iter_callback<ArgT>> {
-    iter_callback(const std::function<void(const ArgT&)>& func)
-        : f_(func) {}
-
-    inline iter_callback<ArgT>& operator=(const ArgT& v) {
-        f_(v);
-        return *this;
+/// \brief The union of the bits of the fields called `names`.
+template <typename Element>
+inline query_fields_t query_field_mask(const std::vector<std::string>& names) {
+    query_fields_t mask = 0;
+    for(const auto& name : names) {
+        mask |= query_result<Element>::field_mask(name);
     }
+    return mask;
+}
 
-  private:
-    // Keep the const ref to the function. Func must get items by const-ref
-    const std::function<void(const ArgT&)>& f_;
+/** \brief Results of a batch of queries, in CSR format.
+ *
+ * The matches of all queries are appended to a single `query_result`, which
+ * acts as a shared arena. The matches of query `i` are stored in the range
+ * `[offsets[i], offsets[i+1])`. Hence, `offsets` has one more entry than
+ * there are queries and starts with `0`.
+ */
+template<typename Element>
+struct batch_query_result {
+    std::vector<size_t> offsets;
+    query_result<Element> values;
 };
 
+}  // namespace detail
+
+
 
 struct iter_ids_getter: public detail::iter_append_only<iter_ids_getter> {
     using value_type = identifier_t;
@@ -181,7 +279,9 @@ struct iter_gid_segm_getter: public detail::iter_append_only<iter_gid_segm_gette
 
     template <typename S>
     inline iter_gid_segm_getter& operator=(const IndexedShape<S, MorphPartId>& result_entry) {
-        output_.emplace_back(result_entry.gid(), result_entry.section_id(), result_entry.segment_id());
+        output_.push_back(
+            gid_segm_t{result_entry.gid(), result_entry.section_id(), result_entry.segment_id()}
+        );
         return *this;
     }
 
@@ -200,7 +300,8 @@ struct iter_gid_segm_getter: public detail::iter_append_only<iter_gid_segm_gette
 };
 
 // Iterators to fetch all data from the payload of segments, soma and synapses.
-// Exports all the fields of the payload as query result object i.e. a struct of arrays.
+// Exports the fields of the payload as query result object i.e. a struct of arrays.
+// Only the fields selected in the query result are computed and stored.
 // Used to fetch data to export as numpy arrays.
 
 template<typename Entry>
@@ -215,24 +316,56 @@ struct iter_entry_getter<MorphoEntry> : public detail::iter_append_only<iter_ent
         : output_(output) {}
 
     inline iter_entry_getter& operator=(const element_t& element) { 
-        boost::apply_visitor(
-            [this](const auto& t) {
-                output_.gid.push_back(t.gid());
-                output_.section_id.push_back(t.section_id());
-                output_.segment_id.push_back(t.segment_id());
-                output_.ids.push_back(gid_segm_t{t.gid(), t.section_id(), t.segment_id()});
-                output_.centroid.push_back(t.get_centroid());
-                output_.radius.push_back(t.radius);
-                output_.endpoint1.push_back(detail::get_endpoint(t, 1));
-                output_.endpoint2.push_back(detail::get_endpoint(t, 0));
-                output_.section_type.push_back(detail::get_section_type(t));
-                output_.is_soma.push_back(detail::get_is_soma(t));
-            },
-            element);
+        boost::apply_visitor([this](const auto& t) { append(t); }, element);
+        return *this;
+    }
+
+    // Indexes which store somas and segments separately, don't need the variant.
+    inline iter_entry_getter& operator=(const Soma& soma) {
+        append(soma);
+        return *this;
+    }
+
+    inline iter_entry_getter& operator=(const Segment& segment) {
+        append(segment);
         return *this;
     }
 
   private:
+    template <typename Part>
+    inline void append(const Part& t) {
+        using field = result_t::field;
+
+        if(output_.has(field::gid)) {
+            output_.gid.push_back(t.gid());
+        }
+        if(output_.has(field::section_id)) {
+            output_.section_id.push_back(t.section_id());
+        }
+        if(output_.has(field::segment_id)) {
+            output_.segment_id.push_back(t.segment_id());
+        }
+        if(output_.has(field::ids)) {
+            output_.ids.push_back(gid_segm_t{t.gid(), t.section_id(), t.segment_id()});
+        }
+        if(output_.has(field::centroid)) {
+            output_.centroid.push_back(t.get_centroid());
+        }
+        if(output_.has(field::radius)) {
+            output_.radius.push_back(t.radius);
+        }
+        if(output_.has(field::endpoints)) {
+            output_.endpoint1.push_back(detail::get_endpoint(t, 1));
+            output_.endpoint2.push_back(detail::get_endpoint(t, 0));
+        }
+        if(output_.has(field::section_type)) {
+            output_.section_type.push_back(detail::get_section_type(t));
+        }
+        if(output_.has(field::is_soma)) {
+            output_.is_soma.push_back(detail::get_is_soma(t));
+        }
+    }
+
     result_t& output_;
 };
 
@@ -245,10 +378,20 @@ struct iter_entry_getter<Synapse> : public detail::iter_append_only<iter_entry_g
         : output_(output) {}
 
     inline iter_entry_getter& operator=(const element_t& element) {
-        output_.id.push_back(element.id);
-        output_.pre_gid.push_back(element.pre_gid_);
-        output_.post_gid.push_back(element.post_gid_);
-        output_.position.push_back(element.get_centroid());
+        using field = result_t::field;
+
+        if(output_.has(field::id)) {
+            output_.id.push_back(element.id);
+        }
+        if(output_.has(field::pre_gid)) {
+            output_.pre_gid.push_back(element.pre_gid_);
+        }
+        if(output_.has(field::post_gid)) {
+            output_.post_gid.push_back(element.post_gid_);
+        }
+        if(output_.has(field::position)) {
+            output_.position.push_back(element.get_centroid());
+        }
         return *this;
     }
 
@@ -266,9 +409,17 @@ struct iter_entry_getter<IndexedSphere> : public detail::iter_append_only<iter_e
         : output_(output) {}
 
     inline iter_entry_getter& operator=(const element_t& element) {
-        output_.id.push_back(element.id);
-        output_.centroid.push_back(element.centroid);
-        output_.radius.push_back(element.radius);
+        using field = result_t::field;
+
+        if(output_.has(field::id)) {
+            output_.id.push_back(element.id);
+        }
+        if(output_.has(field::centroid)) {
+            output_.centroid.push_back(element.centroid);
+        }
+        if(output_.has(field::radius)) {
+            output_.radius.push_back(element.radius);
+        }
         return *this;
     }
 
@@ -286,8 +437,14 @@ struct iter_entry_getter<IndexedPoint>
         : output_(output) { }
 
     inline iter_entry_getter& operator=(const element_t& element) {
-        output_.id.push_back(element.id);
-        output_.position.push_back(element);
+        using field = result_t::field;
+
+        if(output_.has(field::id)) {
+            output_.id.push_back(element.id);
+        }
+        if(output_.has(field::position)) {
+            output_.position.push_back(element);
+        }
         return *this;
     }
 
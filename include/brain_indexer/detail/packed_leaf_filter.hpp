@@ -0,0 +1,566 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <boost/variant.hpp>
+
+#include <brain_indexer/geometries.hpp>
+#include <brain_indexer/detail/packed_node_filter.hpp>
+
+#if SI_PACKED_NODE_FILTER_X86 == 1
+/// Every function of the AVX2 kernels is compiled for AVX2 and inlined.
+#define SI_LANE_KERNEL __attribute__((always_inline, target("avx2"))) inline
+#endif
+
+namespace brain_indexer {
+namespace detail {
+
+/** \brief The spheres or cylinders of a leaf, as a structure of arrays.
+ *
+ *  `fields[j][i]` is the `j`-th field of the `i`-th lane, see `SphereLanes`
+ *  and `CylinderLanes`; `child[i]` is the index, within the leaf, of the
+ *  element in lane `i`.
+ *
+ *  This is created for every leaf, hence the lanes aren't initialized. Before
+ *  running a kernel, the last vector must be filled up, see `pad_lanes`.
+ */
+template <size_t n_fields, size_t N = 16>
+struct LeafLanes {
+    static constexpr size_t max_lanes = N;
+
+    /// The kernels process up to this many lanes at once.
+    static constexpr size_t vector_lanes = 8;
+
+    CoordType fields[n_fields][N];
+    std::uint32_t child[N];
+    std::uint32_t n_lanes = 0;
+};
+
+/// The fields are: center, radius.
+using SphereLanes = LeafLanes<4>;
+
+/// The fields are: first point, second point, radius.
+using CylinderLanes = LeafLanes<7>;
+
+/// \brief The exact shapes of the candidates of a leaf, split by kind.
+struct LeafCandidates {
+    SphereLanes spheres;
+    CylinderLanes cylinders;
+};
+
+inline void append_lane(LeafCandidates& candidates, const Sphere& sphere, std::uint32_t child) {
+    auto& lanes = candidates.spheres;
+    auto i = lanes.n_lanes++;
+    lanes.fields[0][i] = sphere.centroid.get<0>();
+    lanes.fields[1][i] = sphere.centroid.get<1>();
+    lanes.fields[2][i] = sphere.centroid.get<2>();
+    lanes.fields[3][i] = sphere.radius;
+    lanes.child[i] = child;
+}
+
+inline void append_lane(LeafCandidates& candidates, const Cylinder& cylinder, std::uint32_t child) {
+    auto& lanes = candidates.cylinders;
+    auto i = lanes.n_lanes++;
+    lanes.fields[0][i] = cylinder.p1.get<0>();
+    lanes.fields[1][i] = cylinder.p1.get<1>();
+    lanes.fields[2][i] = cylinder.p1.get<2>();
+    lanes.fields[3][i] = cylinder.p2.get<0>();
+    lanes.fields[4][i] = cylinder.p2.get<1>();
+    lanes.fields[5][i] = cylinder.p2.get<2>();
+    lanes.fields[6][i] = cylinder.radius;
+    lanes.child[i] = child;
+}
+
+template <typename... Args>
+inline void append_lane(LeafCandidates& candidates,
+                        const boost::variant<Args...>& value,
+                        std::uint32_t child) {
+    boost::apply_visitor([&candidates, child](const auto& v) {
+        append_lane(candidates, v, child);
+    }, value);
+}
+
+/// \brief Fills the unused lanes of the last vector with copies of the first lane.
+template <size_t n_fields, size_t N>
+inline void pad_lanes(LeafLanes<n_fields, N>& lanes) {
+    constexpr size_t vector_lanes = LeafLanes<n_fields, N>::vector_lanes;
+    static_assert(N % vector_lanes == 0, "The lanes must fill whole vectors.");
+
+    size_t n_padded = (lanes.n_lanes + vector_lanes - 1) / vector_lanes * vector_lanes;
+    for(size_t j = 0; j < n_fields; ++j) {
+        for(size_t i = lanes.n_lanes; i < n_padded; ++i) {
+            lanes.fields[j][i] = lanes.fields[j][0];
+        }
+    }
+}
+
+/// \brief Can the elements be tested with the lane-wise kernels.
+template <typename T>
+struct has_lane_shape
+    : std::disjunction<std::is_convertible<const T*, const Sphere*>,
+                       std::is_convertible<const T*, const Cylinder*>> {};
+
+template <typename... Args>
+struct has_lane_shape<boost::variant<Args...>> : std::conjunction<has_lane_shape<Args>...> {};
+
+
+#if SI_PACKED_NODE_FILTER_X86 == 1
+
+////////////////////////////////////////////////////////////////////////////////
+// Lane-wise arithmetic
+//
+// The kernels below are the exact tests of `detail/geometries.hpp` rewritten
+// for eight lanes at once. Every branch is replaced by computing both sides
+// and selecting the result. The formulas and the order of the floating point
+// operations are those of the scalar code; since AVX2 doesn't imply FMA, the
+// results are identical.
+////////////////////////////////////////////////////////////////////////////////
+
+using LaneFloats = float __attribute__((vector_size(32)));
+using LaneMask = std::int32_t __attribute__((vector_size(32)));
+
+SI_LANE_KERNEL LaneFloats lane_splat(float x) {
+    return _mm256_set1_ps(x);
+}
+
+SI_LANE_KERNEL std::uint32_t lane_bits(LaneMask m) {
+    return std::uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(__m256i(m))));
+}
+
+/// \brief Is the mask set in every lane, used to skip work which can't change the result.
+SI_LANE_KERNEL bool lane_all(LaneMask m) {
+    return lane_bits(m) == 0xffu;
+}
+
+// Same as `std::max`, `std::min` and `std::clamp`, including the handling of NaN.
+SI_LANE_KERNEL LaneFloats lane_max(LaneFloats a, LaneFloats b) { return (a < b) ? b : a; }
+
+SI_LANE_KERNEL LaneFloats lane_min(LaneFloats a, LaneFloats b) { return (b < a) ? b : a; }
+
+SI_LANE_KERNEL LaneFloats lane_clamp(LaneFloats x, LaneFloats low, LaneFloats high) {
+    return (x < low) ? low : ((high < x) ? high : x);
+}
+
+SI_LANE_KERNEL LaneFloats lane_abs(LaneFloats x) {
+    return (x < LaneFloats{}) ? -x : x;
+}
+
+SI_LANE_KERNEL LaneFloats lane_sqrt(LaneFloats x) {
+    return _mm256_sqrt_ps(x);
+}
+
+struct LanePoints {
+    LaneFloats x, y, z;
+};
+
+SI_LANE_KERNEL LanePoints lane_splat(const Point3D& p) {
+    return {lane_splat(p.get<0>()), lane_splat(p.get<1>()), lane_splat(p.get<2>())};
+}
+
+SI_LANE_KERNEL LanePoints operator+(const LanePoints& a, const LanePoints& b) {
+    return {a.x + b.x, a.y + b.y, a.z + b.z};
+}
+
+SI_LANE_KERNEL LanePoints operator-(const LanePoints& a, const LanePoints& b) {
+    return {a.x - b.x, a.y - b.y, a.z - b.z};
+}
+
+SI_LANE_KERNEL LanePoints operator*(const LanePoints& a, LaneFloats s) {
+    return {a.x * s, a.y * s, a.z * s};
+}
+
+SI_LANE_KERNEL LaneFloats dot(const LanePoints& a, const LanePoints& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+SI_LANE_KERNEL LaneFloats norm_sq(const LanePoints& a) {
+    return dot(a, a);
+}
+
+SI_LANE_KERNEL LanePoints lane_select(LaneMask m, const LanePoints& a, const LanePoints& b) {
+    return {m ? a.x : b.x, m ? a.y : b.y, m ? a.z : b.z};
+}
+
+SI_LANE_KERNEL LanePoints lane_clamp(const LanePoints& p, const LanePoints& low, const LanePoints& high) {
+    return {lane_min(lane_max(low.x, p.x), high.x),
+            lane_min(lane_max(low.y, p.y), high.y),
+            lane_min(lane_max(low.z, p.z), high.z)};
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Lane-wise exact tests
+////////////////////////////////////////////////////////////////////////////////
+
+/// \brief Lane-wise `square_distance_segment_segment`.
+SI_LANE_KERNEL LaneFloats square_distance_segment_segment_lanes(const LanePoints& s1_0,
+                                                                const LanePoints& s1_1,
+                                                                const LanePoints& s2_0,
+                                                                const LanePoints& s2_1) {
+    const auto u = s1_1 - s1_0;
+    const auto v = s2_1 - s2_0;
+    const auto w = s1_0 - s2_0;
+    const auto a = dot(u, u);
+    const auto b = dot(u, v);
+    const auto c = dot(v, v);
+    const auto d = dot(u, w);
+    const auto e = dot(v, w);
+    const auto D = a * c - b * b;
+
+    const auto zero = LaneFloats{};
+    const auto one = lane_splat(1.0f);
+    const auto epsilon = lane_splat(CoordType(1e-6));
+
+    // The lines are almost parallel: use the point `s1_0`.
+    const auto parallel = D < epsilon;
+    auto sN = parallel ? zero : (b * e - c * d);
+    auto sD = parallel ? one : D;
+    auto tN = parallel ? e : (a * e - b * d);
+    auto tD = parallel ? c : D;
+
+    // Is the `s=0` or `s=1` edge visible? Never true for parallel lines.
+    const auto s_low = sN < zero;
+    const auto s_high = ~s_low & (sN > sD);
+    tN = s_low ? e : (s_high ? e + b : tN);
+    tD = (s_low | s_high) ? c : tD;
+    sN = s_low ? zero : (s_high ? sD : sN);
+
+    // Is the `t=0` or `t=1` edge visible? If so, recompute `sc` for this edge.
+    const auto t_low = tN < zero;
+    const auto t_high = ~t_low & (tN > tD);
+    const auto x = t_low ? -d : (-d + b);
+    const auto x_low = x < zero;
+    const auto x_high = ~x_low & (x > a);
+    const auto t_edge = t_low | t_high;
+    sN = t_edge ? (x_low ? zero : (x_high ? sD : x)) : sN;
+    sD = (t_edge & ~(x_low | x_high)) ? a : sD;
+    tN = t_low ? zero : (t_high ? tD : tN);
+
+    const auto sc = (lane_abs(sN) < epsilon) ? zero : sN / sD;
+    const auto tc = (lane_abs(tN) < epsilon) ? zero : tN / tD;
+
+    return norm_sq((w + u * sc) - v * tc);
+}
+
+/// \brief Lane-wise `Sphere::intersects(Box3D)`.
+SI_LANE_KERNEL LaneMask sphere_intersects_box_lanes(const LanePoints& centroid, LaneFloats radius,
+                                                    const LanePoints& min_xyz,
+                                                    const LanePoints& max_xyz) {
+    const auto inside = ((min_xyz.x <= centroid.x) & (centroid.x <= max_xyz.x))
+                      & ((min_xyz.y <= centroid.y) & (centroid.y <= max_xyz.y))
+                      & ((min_xyz.z <= centroid.z) & (centroid.z <= max_xyz.z));
+
+    const auto p = lane_clamp(centroid, min_xyz, max_xyz);
+    return inside | (norm_sq(p - centroid) <= radius * radius);
+}
+
+/// \brief Lane-wise `Sphere::intersects(Sphere)`.
+SI_LANE_KERNEL LaneMask sphere_intersects_sphere_lanes(const LanePoints& centroid, LaneFloats radius,
+                                                       const LanePoints& other_centroid,
+                                                       LaneFloats other_radius) {
+    const auto radii_sum = radius + other_radius;
+    return (radii_sum * radii_sum) >= norm_sq(centroid - other_centroid);
+}
+
+/// \brief Lane-wise `Sphere::intersects(Cylinder)`.
+SI_LANE_KERNEL LaneMask sphere_intersects_cylinder_lanes(const LanePoints& centroid, LaneFloats radius,
+                                                         const LanePoints& p1, const LanePoints& p2,
+                                                         LaneFloats cylinder_radius) {
+    const auto u = centroid - p1;
+    const auto v = p2 - p1;
+
+    const auto v_dot_u = dot(v, u);
+    const auto v_dot_v = norm_sq(v);
+
+    const auto max_distance = radius + cylinder_radius;
+    const auto max_distance_sq = max_distance * max_distance;
+
+    // The projection of the center onto the axis lies between the caps.
+    const auto zero = LaneFloats{};
+    const auto between_caps = (zero <= v_dot_u) & (v_dot_u <= v_dot_v);
+    const auto dist_sq = norm_sq(u) - v_dot_u * v_dot_u / v_dot_v;
+    const auto hits_side = between_caps & (dist_sq <= max_distance_sq);
+    if(lane_all(between_caps)) {
+        return hits_side;
+    }
+
+    // Otherwise, find the point on the closer cap which is closest to the center.
+    const auto closer_cap = lane_select(v_dot_u < zero, p1, p2);
+    const auto near_cap = ~(norm_sq(centroid - closer_cap) > max_distance_sq);
+
+    const auto p = p1 + v * (v_dot_u / v_dot_v);
+    const auto d = centroid - p;
+    const auto d_norm = lane_sqrt(norm_sq(d));
+
+    const auto base = closer_cap - d * (cylinder_radius / d_norm);
+    const auto dir = d * (lane_splat(2.0f) * cylinder_radius / d_norm);
+    const auto x_rel = lane_clamp(dot(centroid - base, dir) / norm_sq(dir), zero, lane_splat(1.0f));
+    const auto projected = base + dir * x_rel;
+
+    const auto on_axis = lane_splat(100 * std::numeric_limits<CoordType>::epsilon());
+    const auto centroid_to_cap = lane_select(d_norm < on_axis, closer_cap, projected);
+    const auto hits_cap = near_cap & (norm_sq(centroid - centroid_to_cap) <= radius * radius);
+
+    return hits_side | (~between_caps & hits_cap);
+}
+
+/** \brief Lane-wise `Cylinder::intersects(Box3D)`, except the final test.
+ *
+ *  Checks the caps and the distance from the axis to all 12 edges of the box.
+ *  If no lane matches, `Cylinder::intersects` continues by intersecting the
+ *  axis with the box, which must be done by the caller.
+ */
+SI_LANE_KERNEL LaneMask cylinder_intersects_box_lanes(const LanePoints& p1, const LanePoints& p2,
+                                                      LaneFloats radius, const Box3D& box) {
+    const auto min_xyz = lane_splat(box.min_corner());
+    const auto max_xyz = lane_splat(box.max_corner());
+    const auto radius_sq = radius * radius;
+
+    auto hits = (norm_sq(lane_clamp(p1, min_xyz, max_xyz) - p1) < radius_sq)
+              | (norm_sq(lane_clamp(p2, min_xyz, max_xyz) - p2) < radius_sq);
+    if(lane_all(hits)) {
+        return hits;
+    }
+
+    // The corners of the lower and upper square of the box, counter-clockwise.
+    const LaneFloats xs[4] = {min_xyz.x, max_xyz.x, max_xyz.x, min_xyz.x};
+    const LaneFloats ys[4] = {min_xyz.y, min_xyz.y, max_xyz.y, max_xyz.y};
+
+    for(size_t i = 0; i < 4; ++i) {
+        const size_t j = (i + 1) % 4;
+        const auto lower_i = LanePoints{xs[i], ys[i], min_xyz.z};
+        const auto lower_j = LanePoints{xs[j], ys[j], min_xyz.z};
+        const auto upper_i = LanePoints{xs[i], ys[i], max_xyz.z};
+        const auto upper_j = LanePoints{xs[j], ys[j], max_xyz.z};
+
+        hits = hits
+             | (square_distance_segment_segment_lanes(lower_i, lower_j, p1, p2) < radius_sq)
+             | (square_distance_segment_segment_lanes(lower_i, upper_i, p1, p2) < radius_sq)
+             | (square_distance_segment_segment_lanes(upper_i, upper_j, p1, p2) < radius_sq);
+    }
+
+    return hits;
+}
+
+/// \brief Lane-wise `Cylinder::intersects(Cylinder)`.
+SI_LANE_KERNEL LaneMask cylinder_intersects_cylinder_lanes(const LanePoints& p1, const LanePoints& p2,
+                                                           LaneFloats radius,
+                                                           const LanePoints& other_p1,
+                                                           const LanePoints& other_p2,
+                                                           LaneFloats other_radius) {
+    const auto min_dist_sq = square_distance_segment_segment_lanes(p1, p2, other_p1, other_p2);
+    return min_dist_sq <= (radius + other_radius) * (radius + other_radius);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Kernels, i.e. a query shape tested against all lanes of a leaf.
+////////////////////////////////////////////////////////////////////////////////
+
+SI_LANE_KERNEL LanePoints lane_point(const LaneFloats* fields) {
+    return {fields[0], fields[1], fields[2]};
+}
+
+/** \brief Runs `kernel` on every lane of `lanes`, eight lanes at a time.
+ *
+ *  \returns A bitmask, bit `i` is set if lane `i` intersects.
+ */
+template <class Kernel, size_t n_fields, size_t N>
+__attribute__((target("avx2")))
+inline std::uint32_t run_lane_kernel(const Kernel& kernel, const LeafLanes<n_fields, N>& lanes) {
+    static_assert(LeafLanes<n_fields, N>::vector_lanes == 8, "The padding must fill whole vectors.");
+
+    std::uint32_t mask = 0;
+    for(size_t i = 0; i < lanes.n_lanes; i += 8) {
+        LaneFloats fields[n_fields];
+        for(size_t j = 0; j < n_fields; ++j) {
+            std::memcpy(&fields[j], lanes.fields[j] + i, sizeof(LaneFloats));
+        }
+
+        mask |= lane_bits(kernel.apply(fields)) << i;
+    }
+
+    return mask & all_children_mask(lanes.n_lanes);
+}
+
+struct BoxSphereKernel {
+    const Box3D& box;
+
+    SI_LANE_KERNEL LaneMask apply(const LaneFloats (&f)[4]) const {
+        return sphere_intersects_box_lanes(lane_point(f), f[3],
+                                           lane_splat(box.min_corner()),
+                                           lane_splat(box.max_corner()));
+    }
+};
+
+struct BoxCylinderKernel {
+    const Box3D& box;
+
+    SI_LANE_KERNEL LaneMask apply(const LaneFloats (&f)[7]) const {
+        return cylinder_intersects_box_lanes(lane_point(f), lane_point(f + 3), f[6], box);
+    }
+};
+
+struct SphereSphereKernel {
+    const Sphere& sphere;
+
+    SI_LANE_KERNEL LaneMask apply(const LaneFloats (&f)[4]) const {
+        return sphere_intersects_sphere_lanes(lane_splat(sphere.centroid),
+                                              lane_splat(sphere.radius),
+                                              lane_point(f), f[3]);
+    }
+};
+
+struct SphereCylinderKernel {
+    const Sphere& sphere;
+
+    SI_LANE_KERNEL LaneMask apply(const LaneFloats (&f)[7]) const {
+        return sphere_intersects_cylinder_lanes(lane_splat(sphere.centroid),
+                                                lane_splat(sphere.radius),
+                                                lane_point(f), lane_point(f + 3), f[6]);
+    }
+};
+
+struct CylinderSphereKernel {
+    const Cylinder& cylinder;
+
+    SI_LANE_KERNEL LaneMask apply(const LaneFloats (&f)[4]) const {
+        return sphere_intersects_cylinder_lanes(lane_point(f), f[3],
+                                                lane_splat(cylinder.p1),
+                                                lane_splat(cylinder.p2),
+                                                lane_splat(cylinder.radius));
+    }
+};
+
+struct CylinderCylinderKernel {
+    const Cylinder& cylinder;
+
+    SI_LANE_KERNEL LaneMask apply(const LaneFloats (&f)[7]) const {
+        return cylinder_intersects_cylinder_lanes(lane_splat(cylinder.p1),
+                                                  lane_splat(cylinder.p2),
+                                                  lane_splat(cylinder.radius),
+                                                  lane_point(f), lane_point(f + 3), f[6]);
+    }
+};
+
+/// \brief Which lanes intersect, `0` if there are no lanes.
+template <class Kernel, size_t n_fields, size_t N>
+inline std::uint32_t intersecting_lanes(const Kernel& kernel, const LeafLanes<n_fields, N>& lanes) {
+    return lanes.n_lanes == 0 ? 0 : run_lane_kernel(kernel, lanes);
+}
+
+#endif
+
+/// \brief Sets the bits of `children` for every lane in `lane_mask`.
+template <size_t n_fields, size_t N>
+inline std::uint32_t lanes_to_children(const LeafLanes<n_fields, N>& lanes, std::uint32_t lane_mask) {
+    std::uint32_t mask = 0;
+    for(; lane_mask != 0; lane_mask &= lane_mask - 1) {
+        mask |= std::uint32_t(1) << lanes.child[lowest_set_bit(lane_mask)];
+    }
+    return mask;
+}
+
+/** \brief Leaves with fewer candidates are tested one at a time.
+ *
+ *  Gathering the lanes isn't free, and the scalar tests often return early.
+ *  Measured on morphologies, the kernels only pay off from about four candidates.
+ */
+constexpr std::uint32_t min_lane_candidates = 4;
+
+/// \brief Is the query shape supported by the lane-wise kernels.
+template <class Shape>
+struct has_lane_kernels
+    : std::disjunction<std::is_convertible<const Shape*, const Box3D*>,
+                       std::is_same<Shape, Sphere>,
+                       std::is_same<Shape, Cylinder>> {};
+
+/** \brief Which of the `values[k]`, for `k` in `mask`, intersect `shape`.
+ *
+ *  The result is the same as checking
+ *
+ *      geometry_intersects(shape, values[k], BestEffortGeometry{})
+ *
+ *  for every bit `k` of `mask`. However, with AVX2 the candidates are first
+ *  gathered into a structure of arrays and all spheres, and all cylinders,
+ *  are tested at once, if there are at least `min_lane_candidates`. AVX-512
+ *  uses the same kernels, because it implies FMA, which would change the
+ *  rounding.
+ */
+template <class Shape, class T>
+inline std::uint32_t best_effort_intersecting_values([[maybe_unused]] NodeFilterISA isa,
+                                                     const Shape& shape,
+                                                     const T* values,
+                                                     std::uint32_t mask) {
+#if SI_PACKED_NODE_FILTER_X86 == 1
+    if constexpr (has_lane_shape<T>::value && has_lane_kernels<Shape>::value) {
+        if(isa != NodeFilterISA::scalar && count_set_bits(mask) >= min_lane_candidates) {
+            LeafCandidates candidates;
+            for(auto m = mask; m != 0; m &= m - 1) {
+                auto k = lowest_set_bit(m);
+                append_lane(candidates, values[k], k);
+            }
+            pad_lanes(candidates.spheres);
+            pad_lanes(candidates.cylinders);
+
+            const auto& spheres = candidates.spheres;
+            const auto& cylinders = candidates.cylinders;
+
+            if constexpr (std::is_convertible<const Shape*, const Box3D*>::value) {
+                const Box3D& box = shape;
+                auto sphere_mask = intersecting_lanes(BoxSphereKernel{box}, spheres);
+                auto cylinder_mask = intersecting_lanes(BoxCylinderKernel{box}, cylinders);
+
+                // The remaining cylinders could still intersect if their axis passes
+                // through the box, see `Cylinder::intersects`. Which is only possible
+                // if the bounding box of the axis intersects the box.
+                auto undecided = all_children_mask(cylinders.n_lanes) & ~cylinder_mask;
+                for(; undecided != 0; undecided &= undecided - 1) {
+                    auto i = lowest_set_bit(undecided);
+                    const auto& f = cylinders.fields;
+                    auto p1 = Point3D{f[0][i], f[1][i], f[2][i]};
+                    auto p2 = Point3D{f[3][i], f[4][i], f[5][i]};
+                    if(bg::intersects(make_query_box(p1, p2), box) && segment_intersects(box, p1, p2)) {
+                        cylinder_mask |= std::uint32_t(1) << i;
+                    }
+                }
+
+                return lanes_to_children(spheres, sphere_mask)
+                       | lanes_to_children(cylinders, cylinder_mask);
+            } else if constexpr (std::is_same<Shape, Sphere>::value) {
+                return lanes_to_children(spheres, intersecting_lanes(SphereSphereKernel{shape}, spheres))
+                       | lanes_to_children(cylinders,
+                                           intersecting_lanes(SphereCylinderKernel{shape}, cylinders));
+            } else {
+                return lanes_to_children(spheres, intersecting_lanes(CylinderSphereKernel{shape}, spheres))
+                       | lanes_to_children(cylinders,
+                                           intersecting_lanes(CylinderCylinderKernel{shape}, cylinders));
+            }
+        }
+    }
+#endif
+
+    for(auto m = mask; m != 0; m &= m - 1) {
+        auto k = lowest_set_bit(m);
+        if(!geometry_intersects(shape, values[k], BestEffortGeometry{})) {
+            mask &= ~(std::uint32_t(1) << k);
+        }
+    }
+
+    return mask;
+}
+
+/// \brief Same as above, using the best instruction set of this CPU.
+template <class Shape, class T>
+inline std::uint32_t best_effort_intersecting_values(const Shape& shape,
+                                                     const T* values,
+                                                     std::uint32_t mask) {
+    static const auto isa = detect_node_filter_isa();
+    return best_effort_intersecting_values(isa, shape, values, mask);
+}
+
+}  // namespace detail
+}  // namespace brain_indexer
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstdint>
+
+#include <brain_indexer/point3d.hpp>
+
+// The vectorized kernels are compiled for their target ISA individually and
+// selected at runtime. Hence, no special compiler flags are needed.
+#if !defined(BBPSPATIAL_DOUBLE_PRECISION) && defined(__x86_64__) \
+    && (defined(__GNUC__) || defined(__clang__))
+#define SI_PACKED_NODE_FILTER_X86 1
+#include <immintrin.h>
+#else
+#define SI_PACKED_NODE_FILTER_X86 0
+#endif
+
+namespace brain_indexer {
+namespace detail {
+
+/** \brief Instruction sets available for filtering the children of a node.
+ *
+ *  Every level computes exactly the same result; only the speed differs.
+ */
+enum class NodeFilterISA { scalar, avx2, avx512 };
+
+/// \brief Bit `k` is set if and only if `k < n_children`.
+inline std::uint32_t all_children_mask(std::uint32_t n_children) {
+    return n_children >= 32 ? ~std::uint32_t(0) : (std::uint32_t(1) << n_children) - 1;
+}
+
+/// \brief Index of the lowest set bit, `mask` must not be zero.
+inline std::uint32_t lowest_set_bit(std::uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return std::uint32_t(__builtin_ctz(mask));
+#else
+    std::uint32_t k = 0;
+    for(; (mask & 1u) == 0; mask >>= 1) {
+        ++k;
+    }
+    return k;
+#endif
+}
+
+/// \brief Number of set bits in `mask`.
+inline std::uint32_t count_set_bits(std::uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return std::uint32_t(__builtin_popcount(mask));
+#else
+    std::uint32_t n = 0;
+    for(; mask != 0; mask &= mask - 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
+
+/** \brief Which children, of a node with `n_children`, intersect with `box`.
+ *
+ *  The bounding boxes of the children are passed as a structure of arrays
+ *  with `N` entries each, see `PackedRTreeNode`. Boxes which only touch count
+ *  as intersecting, like `bg::intersects`.
+ *
+ *  \returns A bitmask, bit `k` is set if the `k`-th child intersects.
+ */
+template <size_t N>
+inline std::uint32_t intersecting_children_scalar(const Box3D& box,
+                                                  const CoordType (&min_corner)[3][N],
+                                                  const CoordType (&max_corner)[3][N],
+                                                  std::uint32_t n_children) {
+    const CoordType qmin[3] = {box.min_corner().get<0>(),
+                               box.min_corner().get<1>(),
+                               box.min_corner().get<2>()};
+    const CoordType qmax[3] = {box.max_corner().get<0>(),
+                               box.max_corner().get<1>(),
+                               box.max_corner().get<2>()};
+
+    std::uint32_t mask = 0;
+    for(std::uint32_t k = 0; k < n_children; ++k) {
+        bool intersects = true;
+        for(size_t d = 0; d < 3; ++d) {
+            intersects &= (qmin[d] <= max_corner[d][k]) & (min_corner[d][k] <= qmax[d]);
+        }
+        mask |= std::uint32_t(intersects) << k;
+    }
+
+    return mask;
+}
+
+#if SI_PACKED_NODE_FILTER_X86 == 1
+
+/// \brief AVX2 version of `intersecting_children_scalar` for nodes with 16 children.
+__attribute__((target("avx2")))
+inline std::uint32_t intersecting_children_avx2(const Box3D& box,
+                                                const CoordType (&min_corner)[3][16],
+                                                const CoordType (&max_corner)[3][16],
+                                                std::uint32_t n_children) {
+    const CoordType qmin[3] = {box.min_corner().get<0>(),
+                               box.min_corner().get<1>(),
+                               box.min_corner().get<2>()};
+    const CoordType qmax[3] = {box.max_corner().get<0>(),
+                               box.max_corner().get<1>(),
+                               box.max_corner().get<2>()};
+
+    std::uint32_t mask = 0;
+    for(size_t half = 0; half < 2; ++half) {
+        auto intersects = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(size_t d = 0; d < 3; ++d) {
+            auto lo = _mm256_loadu_ps(min_corner[d] + 8 * half);
+            auto hi = _mm256_loadu_ps(max_corner[d] + 8 * half);
+
+            auto below = _mm256_cmp_ps(_mm256_set1_ps(qmin[d]), hi, _CMP_LE_OQ);
+            auto above = _mm256_cmp_ps(lo, _mm256_set1_ps(qmax[d]), _CMP_LE_OQ);
+            intersects = _mm256_and_ps(intersects, _mm256_and_ps(below, above));
+        }
+
+        mask |= std::uint32_t(_mm256_movemask_ps(intersects)) << (8 * half);
+    }
+
+    return mask & all_children_mask(n_children);
+}
+
+/// \brief AVX-512 version of `intersecting_children_scalar` for nodes with 16 children.
+__attribute__((target("avx512f")))
+inline std::uint32_t intersecting_children_avx512(const Box3D& box,
+                                                  const CoordType (&min_corner)[3][16],
+                                                  const CoordType (&max_corner)[3][16],
+                                                  std::uint32_t n_children) {
+    const CoordType qmin[3] = {box.min_corner().get<0>(),
+                               box.min_corner().get<1>(),
+                               box.min_corner().get<2>()};
+    const CoordType qmax[3] = {box.max_corner().get<0>(),
+                               box.max_corner().get<1>(),
+                               box.max_corner().get<2>()};
+
+    __mmask16 intersects = __mmask16(all_children_mask(n_children));
+    for(size_t d = 0; d < 3; ++d) {
+        auto lo = _mm512_loadu_ps(min_corner[d]);
+        auto hi = _mm512_loadu_ps(max_corner[d]);
+
+        intersects = _mm512_mask_cmp_ps_mask(intersects, _mm512_set1_ps(qmin[d]), hi, _CMP_LE_OQ);
+        intersects = _mm512_mask_cmp_ps_mask(intersects, lo, _mm512_set1_ps(qmax[d]), _CMP_LE_OQ);
+    }
+
+    return std::uint32_t(intersects);
+}
+
+#endif
+
+/// \brief The best instruction set supported by this CPU.
+inline NodeFilterISA detect_node_filter_isa() {
+#if SI_PACKED_NODE_FILTER_X86 == 1
+    if(__builtin_cpu_supports("avx512f")) {
+        return NodeFilterISA::avx512;
+    }
+
+    if(__builtin_cpu_supports("avx2")) {
+        return NodeFilterISA::avx2;
+    }
+#endif
+
+    return NodeFilterISA::scalar;
+}
+
+/// \brief Is `isa` supported by this CPU.
+inline bool is_supported(NodeFilterISA isa) {
+    return int(isa) <= int(detect_node_filter_isa());
+}
+
+/** \brief Dispatch to the kernel for `isa`.
+ *
+ *  The caller must ensure `is_supported(isa)`.
+ */
+template <size_t N>
+inline std::uint32_t intersecting_children([[maybe_unused]] NodeFilterISA isa,
+                                           const Box3D& box,
+                                           const CoordType (&min_corner)[3][N],
+                                           const CoordType (&max_corner)[3][N],
+                                           std::uint32_t n_children) {
+#if SI_PACKED_NODE_FILTER_X86 == 1
+    if constexpr (N == 16) {
+        switch(isa) {
+        case NodeFilterISA::avx512:
+            return intersecting_children_avx512(box, min_corner, max_corner, n_children);
+        case NodeFilterISA::avx2:
+            return intersecting_children_avx2(box, min_corner, max_corner, n_children);
+        case NodeFilterISA::scalar:
+            break;
+        }
+    }
+#endif
+
+    return intersecting_children_scalar(box, min_corner, max_corner, n_children);
+}
+
+/// \brief Same as above, using the best instruction set of this CPU.
+template <size_t N>
+inline std::uint32_t intersecting_children(const Box3D& box,
+                                           const CoordType (&min_corner)[3][N],
+                                           const CoordType (&max_corner)[3][N],
+                                           std::uint32_t n_children) {
+    static const auto isa = detect_node_filter_isa();
+    return intersecting_children(isa, box, min_corner, max_corner, n_children);
+}
+
+}  // namespace detail
+}  // namespace brain_indexer
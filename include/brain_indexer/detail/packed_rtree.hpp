@@ -0,0 +1,1419 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/tuple/tuple.hpp>
+
+#include <brain_indexer/util.hpp>
+#include <brain_indexer/detail/packed_leaf_filter.hpp>
+#include <brain_indexer/detail/packed_node_filter.hpp>
+
+namespace brain_indexer {
+
+namespace detail {
+
+/** \brief Evaluates the predicates of a query against a `PackedRTree`.
+ *
+ *  `children` checks, for all children of a node at once, if their bounding
+ *  box could satisfy the predicate; it returns a bitmask. `values` checks the
+ *  remaining conditions on the values of a leaf, i.e. `values[k]` for every
+ *  bit `k` of `mask`, and returns the bits of those which pass.
+ */
+template <class Predicate, class Enable = void>
+struct packed_rtree_predicate {
+    static_assert(sizeof(Predicate) == 0, "This predicate isn't supported by `PackedRTree`.");
+};
+
+template <class Geometry>
+struct packed_rtree_predicate<
+    bgi::detail::predicates::spatial_predicate<Geometry,
+                                               bgi::detail::predicates::intersects_tag,
+                                               false>> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& predicate, const PackedRTreeNode& node) {
+        if constexpr (std::is_same<Geometry, Box3D>::value) {
+            return intersecting_children(predicate.geometry,
+                                         node.min_corner,
+                                         node.max_corner,
+                                         node.n_children);
+        } else {
+            std::uint32_t mask = 0;
+            for(std::uint32_t k = 0; k < node.n_children; ++k) {
+                mask |= std::uint32_t(bg::intersects(predicate.geometry, node.child_box(k))) << k;
+            }
+            return mask;
+        }
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& /* predicate */,
+                                       const Value* /* values */,
+                                       std::uint32_t mask) {
+        return mask;
+    }
+};
+
+template <class Fun, bool Negated>
+struct packed_rtree_predicate<bgi::detail::predicates::satisfies<Fun, Negated>> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& /* predicate */,
+                                         const PackedRTreeNode& node) {
+        return all_children_mask(node.n_children);
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& predicate,
+                                       const Value* values,
+                                       std::uint32_t mask) {
+        for(auto m = mask; m != 0; m &= m - 1) {
+            auto k = lowest_set_bit(m);
+            if(bool(predicate.fun(values[k])) == Negated) {
+                mask &= ~(std::uint32_t(1) << k);
+            }
+        }
+
+        return mask;
+    }
+};
+
+/** \brief The children of `node` which could contain elements intersecting `shape`.
+ *
+ *  The bounding box of `shape` is already checked by the `intersects`
+ *  predicate of the query. Hence, this only does better for shapes with a
+ *  cheap test against boxes, see `may_intersect`; for all others it's every child.
+ */
+template <class ShapeT>
+inline std::uint32_t exact_children(const ShapeT& shape, const PackedRTreeNode& node) {
+    if constexpr (shape_matches_any_of<ShapeT, OrientedBox, ConvexPolytope, VoxelMask>()) {
+        std::uint32_t mask = 0;
+        for(std::uint32_t k = 0; k < node.n_children; ++k) {
+            mask |= std::uint32_t(may_intersect(shape, node.child_box(k))) << k;
+        }
+        return mask;
+    } else {
+        return all_children_mask(node.n_children);
+    }
+}
+
+/// The exact intersection test of `IndexTreeMixin` is evaluated for all values of a leaf at once.
+template <class ShapeT>
+struct packed_rtree_predicate<
+    bgi::detail::predicates::satisfies<GeometryIntersects<BestEffortGeometry, ShapeT>, false>> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& predicate, const PackedRTreeNode& node) {
+        return exact_children(predicate.fun.shape, node);
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& predicate,
+                                       const Value* values,
+                                       std::uint32_t mask) {
+        auto hits = best_effort_intersecting_values(predicate.fun.shape, values, mask);
+
+        SI_QUERY_STATS_ADD(exact_tests, count_set_bits(mask));
+        SI_QUERY_STATS_ADD(hits, count_set_bits(hits));
+        return hits;
+    }
+};
+
+template <class ShapeT>
+struct packed_rtree_predicate<
+    bgi::detail::predicates::satisfies<GeometryIntersects<BoundingBoxGeometry, ShapeT>, false>> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& predicate, const PackedRTreeNode& node) {
+        return exact_children(predicate.fun.shape, node);
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& predicate,
+                                       const Value* values,
+                                       std::uint32_t mask) {
+        for(auto m = mask; m != 0; m &= m - 1) {
+            auto k = lowest_set_bit(m);
+            if(!predicate.fun(values[k])) {
+                mask &= ~(std::uint32_t(1) << k);
+            }
+        }
+
+        return mask;
+    }
+};
+
+template <>
+struct packed_rtree_predicate<boost::tuples::null_type> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& /* predicate */,
+                                         const PackedRTreeNode& node) {
+        return all_children_mask(node.n_children);
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& /* predicate */,
+                                       const Value* /* values */,
+                                       std::uint32_t mask) {
+        return mask;
+    }
+};
+
+template <class Head, class Tail>
+struct packed_rtree_predicate<boost::tuples::cons<Head, Tail>> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& predicate, const PackedRTreeNode& node) {
+        return packed_rtree_predicate<Head>::children(predicate.get_head(), node)
+               & packed_rtree_predicate<Tail>::children(predicate.get_tail(), node);
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& predicate,
+                                       const Value* values,
+                                       std::uint32_t mask) {
+        mask = packed_rtree_predicate<Head>::values(predicate.get_head(), values, mask);
+        return packed_rtree_predicate<Tail>::values(predicate.get_tail(), values, mask);
+    }
+};
+
+template <class... Predicates>
+struct packed_rtree_predicate<std::tuple<Predicates...>> {
+    template <class Predicate>
+    static inline std::uint32_t children(const Predicate& predicate, const PackedRTreeNode& node) {
+        return std::apply([&node](const auto&... p) {
+            return (all_children_mask(node.n_children)
+                    & ... & packed_rtree_predicate<std::decay_t<decltype(p)>>::children(p, node));
+        }, predicate);
+    }
+
+    template <class Predicate, class Value>
+    static inline std::uint32_t values(const Predicate& predicate,
+                                       const Value* values,
+                                       std::uint32_t mask) {
+        std::apply([values, &mask](const auto&... p) {
+            ((mask = packed_rtree_predicate<std::decay_t<decltype(p)>>::values(p, values, mask)), ...);
+        }, predicate);
+        return mask;
+    }
+};
+
+template <class Predicate>
+struct is_nearest_predicate : std::false_type {};
+
+template <class PointOrRelation>
+struct is_nearest_predicate<bgi::detail::predicates::nearest<PointOrRelation>>
+    : std::true_type {};
+
+
+/// \brief The bounding box of all children of `node`.
+inline Box3D packed_rtree_node_bounds(const PackedRTreeNode& node) {
+    Box3D box;
+    bg::assign_inverse(box);
+    for(size_t k = 0; k < node.n_children; ++k) {
+        bg::expand(box, node.child_box(k));
+    }
+
+    return box;
+}
+
+inline void set_packed_rtree_child_box(PackedRTreeNode& node, size_t k, const Box3D& box) {
+    node.min_corner[0][k] = box.min_corner().get<0>();
+    node.min_corner[1][k] = box.min_corner().get<1>();
+    node.min_corner[2][k] = box.min_corner().get<2>();
+    node.max_corner[0][k] = box.max_corner().get<0>();
+    node.max_corner[1][k] = box.max_corner().get<1>();
+    node.max_corner[2][k] = box.max_corner().get<2>();
+}
+
+/** \brief STR parameters such that no part has more than `max_children` elements.
+ *
+ *  The number of parts is close to the minimum required, which keeps the
+ *  nodes well filled.
+ */
+inline SerialSTRParams packed_rtree_str_params(size_t n_elements, size_t max_children) {
+    auto n_groups = std::max<size_t>(1, (n_elements + max_children - 1) / max_children);
+    auto n0 = std::max<size_t>(1, size_t(std::ceil(std::cbrt(double(n_groups)))));
+    auto n1 = std::max<size_t>(1, size_t(std::ceil(std::sqrt(double(n_groups) / double(n0)))));
+    auto n2 = (n_groups + n0 * n1 - 1) / (n0 * n1);
+
+    return SerialSTRParams(n_elements, {n0, n1, n2});
+}
+
+/// \brief A node of the level being built, as seen by its parent.
+struct PackedRTreeBuildEntry {
+    Box3D box;
+    size_t node_id;
+};
+
+struct GetPackedRTreeBuildEntryCenter {
+    template <size_t dim>
+    inline static CoordType apply(const PackedRTreeBuildEntry& entry) {
+        return CoordType(0.5) * (entry.box.min_corner().get<dim>()
+                                 + entry.box.max_corner().get<dim>());
+    }
+};
+
+/** \brief The power of two `cell` such that `lo + max_quantized * cell` covers `hi`.
+ *
+ *  It's zero if `hi <= lo`, then all coordinates are exactly `lo`.
+ */
+inline CoordType packed_compact_leaf_cell(CoordType lo, CoordType hi) {
+    if(!(lo < hi)) {
+        return CoordType(0);
+    }
+
+    constexpr auto max_quantized = CoordType(PackedCompactLeaf::max_quantized);
+
+    int exponent = 0;
+    std::frexp(double(hi) - double(lo), &exponent);
+    auto cell = std::max(CoordType(std::ldexp(1.0, exponent - 16)),
+                         std::numeric_limits<CoordType>::denorm_min());
+    while(lo + max_quantized * cell < hi) {
+        cell *= 2;
+    }
+
+    return cell;
+}
+
+/** \brief Creates a compact leaf from a regular one.
+ *
+ *  The lower corners are rounded down and the upper corners up, such that
+ *  every quantized box contains the exact box.
+ */
+inline PackedCompactLeaf make_packed_compact_leaf(const PackedRTreeNode& node) {
+    constexpr auto max_quantized = PackedCompactLeaf::max_quantized;
+
+    auto leaf = PackedCompactLeaf{};
+    leaf.first_child = node.first_child;
+    leaf.n_children = node.n_children;
+
+    auto bounds = packed_rtree_node_bounds(node);
+    const CoordType lo[3] = {bounds.min_corner().get<0>(),
+                             bounds.min_corner().get<1>(),
+                             bounds.min_corner().get<2>()};
+    const CoordType hi[3] = {bounds.max_corner().get<0>(),
+                             bounds.max_corner().get<1>(),
+                             bounds.max_corner().get<2>()};
+
+    for(size_t d = 0; d < 3; ++d) {
+        leaf.origin[d] = lo[d];
+        leaf.cell[d] = packed_compact_leaf_cell(lo[d], hi[d]);
+    }
+
+    auto estimate = [&leaf](size_t d, CoordType x) {
+        auto q = (double(x) - double(leaf.origin[d])) / double(leaf.cell[d]);
+        return std::uint32_t(std::clamp(q, 0.0, double(max_quantized)));
+    };
+
+    for(size_t d = 0; d < 3; ++d) {
+        if(leaf.cell[d] == CoordType(0)) {
+            continue;
+        }
+
+        // The estimates can be off by one, due to rounding.
+        for(size_t k = 0; k < node.n_children; ++k) {
+            auto q_min = estimate(d, node.min_corner[d][k]);
+            while(q_min > 0 && leaf.decode(d, std::uint16_t(q_min)) > node.min_corner[d][k]) {
+                --q_min;
+            }
+
+            auto q_max = estimate(d, node.max_corner[d][k]);
+            while(q_max < max_quantized && leaf.decode(d, std::uint16_t(q_max)) < node.max_corner[d][k]) {
+                ++q_max;
+            }
+
+            leaf.min_offset[d][k] = std::uint16_t(q_min);
+            leaf.max_offset[d][k] = std::uint16_t(q_max);
+        }
+    }
+
+    return leaf;
+}
+
+/// \brief Decodes the boxes of all `max_children` lanes of `leaf` into `node`.
+inline void decode_packed_compact_leaf(const PackedCompactLeaf& leaf, PackedRTreeNode& node) {
+    for(size_t d = 0; d < 3; ++d) {
+        for(size_t k = 0; k < PackedCompactLeaf::max_children; ++k) {
+            node.min_corner[d][k] = leaf.decode(d, leaf.min_offset[d][k]);
+            node.max_corner[d][k] = leaf.decode(d, leaf.max_offset[d][k]);
+        }
+    }
+
+    node.first_child = leaf.first_child;
+    node.n_children = leaf.n_children;
+    node.is_leaf = 1;
+}
+
+template <class T>
+struct PackedRTreeArrays {
+    std::vector<PackedRTreeNode> nodes;
+    std::vector<PackedCompactLeaf> leaves;
+    std::vector<T> values;
+};
+
+/// \brief Elements per chunk, when the work on a level is split among threads.
+constexpr size_t min_packed_rtree_chunk_size = 1 << 10;
+
+/** \brief Calls `f(i)` for every `i` in `[0, n)` using `n_threads` threads.
+ *
+ *  The range is split into a few chunks per thread, such that small levels
+ *  of the tree are processed by the calling thread only.
+ */
+template <class F>
+inline void packed_rtree_parallel_for(size_t n, size_t n_threads, const F& f) {
+    auto n_chunks = std::max<size_t>(
+        1, std::min(4 * n_threads, n / min_packed_rtree_chunk_size)
+    );
+
+    util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+        auto [low, high] = util::balanced_chunks(n, n_chunks, k);
+        for(size_t i = low; i < high; ++i) {
+            f(i);
+        }
+    });
+}
+
+/// \brief The non-empty parts of `boundaries`, see `SerialSTRParams::partition_boundaries`.
+inline std::vector<util::Range> packed_rtree_groups(const std::vector<size_t>& boundaries) {
+    auto groups = std::vector<util::Range>{};
+    for(size_t k = 0; k + 1 < boundaries.size(); ++k) {
+        if(boundaries[k] < boundaries[k + 1]) {
+            groups.push_back({boundaries[k], boundaries[k + 1]});
+        }
+    }
+
+    return groups;
+}
+
+inline double packed_rtree_volume(const Box3D& box) {
+    auto extent = Point3Dx(box.max_corner()) - box.min_corner();
+    return double(extent.get<0>()) * double(extent.get<1>()) * double(extent.get<2>());
+}
+
+/// \brief The overlap and the sum of the volumes of `a` and `b`.
+inline std::pair<double, double> packed_rtree_split_cost(const Box3D& a, const Box3D& b) {
+    Box3D intersection;
+    auto overlap = bg::intersection(a, b, intersection) ? packed_rtree_volume(intersection) : 0.0;
+
+    return {overlap, packed_rtree_volume(a) + packed_rtree_volume(b)};
+}
+
+/** \brief Moves the cuts between neighbouring leaves to reduce their overlap.
+ *
+ *  After STR, the leaves of a column, i.e. the parts which differ only in
+ *  the last dimension, are consecutive runs of values sorted along that
+ *  dimension. STR cuts them by counting values, and ignores the extent of
+ *  the values. Therefore, moving a cut by a few values keeps the order but
+ *  can shrink the overlap of the two leaves.
+ *
+ *  Every cut is placed where the overlap of its two leaves is smallest,
+ *  ties are broken by the sum of their volumes. Both leaves keep at most
+ *  `max_children` values; and no fewer than `max_children / 2`, unless one
+ *  of them had fewer to start with. The cuts of a column are visited in
+ *  order, different columns are processed concurrently.
+ *
+ *  \param boundaries  The partition boundaries of `str_params`, they're
+ *                     updated in place.
+ */
+template <class T>
+inline void refine_packed_rtree_leaves(const std::vector<T>& values,
+                                       const SerialSTRParams& str_params,
+                                       std::vector<size_t>& boundaries,
+                                       size_t max_children,
+                                       size_t n_threads = 1) {
+    auto n_per_column = str_params.n_parts_per_dim[2];
+    if(n_per_column < 2) {
+        return;
+    }
+
+    auto n_columns = str_params.n_parts() / n_per_column;
+    util::parallel_for(n_columns, n_threads, [&](size_t column) {
+        auto prefix = std::vector<Box3D>{};
+        auto suffix = std::vector<Box3D>{};
+
+        for(size_t k = 1; k < n_per_column; ++k) {
+            auto i_cut = column * n_per_column + k;
+            auto lo = boundaries[i_cut - 1];
+            auto cut = boundaries[i_cut];
+            auto hi = boundaries[i_cut + 1];
+            if(lo == cut || cut == hi) {
+                continue;
+            }
+
+            auto min_children = std::min({cut - lo, hi - cut, max_children / 2});
+            auto first = std::max(lo + min_children, hi - std::min(hi - lo, max_children));
+            auto last = std::min(hi - min_children, lo + max_children);
+
+            // prefix[i - lo] is the box of `[lo, i)`, suffix[i - lo] that of `[i, hi)`.
+            prefix.assign(hi - lo + 1, Box3D{});
+            suffix.assign(hi - lo + 1, Box3D{});
+            bg::assign_inverse(prefix[0]);
+            bg::assign_inverse(suffix[hi - lo]);
+            for(size_t i = lo; i < hi; ++i) {
+                prefix[i - lo + 1] = prefix[i - lo];
+                bg::expand(prefix[i - lo + 1], bgi::indexable<T>{}(values[i]));
+            }
+            for(size_t i = hi; i > lo; --i) {
+                suffix[i - lo - 1] = suffix[i - lo];
+                bg::expand(suffix[i - lo - 1], bgi::indexable<T>{}(values[i - 1]));
+            }
+
+            auto best = cut;
+            auto best_cost = packed_rtree_split_cost(prefix[cut - lo], suffix[cut - lo]);
+            for(size_t i = first; i <= last; ++i) {
+                auto cost = packed_rtree_split_cost(prefix[i - lo], suffix[i - lo]);
+                if(cost < best_cost) {
+                    best = i;
+                    best_cost = cost;
+                }
+            }
+
+            boundaries[i_cut] = best;
+        }
+    });
+}
+
+/** \brief Creates the parents of `children`, by STR on their bounding boxes.
+ *
+ *  The children are reordered such that the children of every parent are
+ *  contiguous. The parents refer to their children by the index in the
+ *  reordered level.
+ */
+inline std::vector<PackedRTreeNode> build_packed_rtree_parents(
+        std::vector<PackedRTreeNode>& children,
+        size_t n_threads) {
+    constexpr size_t max_children = PackedRTreeNode::max_children;
+
+    auto entries = std::vector<PackedRTreeBuildEntry>(children.size());
+    packed_rtree_parallel_for(children.size(), n_threads, [&](size_t i) {
+        entries[i] = {packed_rtree_node_bounds(children[i]), i};
+    });
+
+    auto params = packed_rtree_str_params(entries.size(), max_children);
+    parallel_sort_tile_recursion<PackedRTreeBuildEntry, GetPackedRTreeBuildEntryCenter>(
+        entries, params, n_threads
+    );
+    auto groups = packed_rtree_groups(params.partition_boundaries());
+
+    // The groups are contiguous; hence, the children are reordered like the entries.
+    auto reordered = std::vector<PackedRTreeNode>(children.size());
+    auto parents = std::vector<PackedRTreeNode>(groups.size());
+    packed_rtree_parallel_for(groups.size(), n_threads, [&](size_t k) {
+        auto [i_begin, i_end] = groups[k];
+
+        auto& parent = parents[k];
+        parent.first_child = i_begin;
+        parent.n_children = std::uint32_t(i_end - i_begin);
+        parent.is_leaf = 0;
+        for(size_t i = i_begin; i < i_end; ++i) {
+            set_packed_rtree_child_box(parent, i - i_begin, entries[i].box);
+            reordered[i] = children[entries[i].node_id];
+        }
+    });
+
+    children = std::move(reordered);
+    return parents;
+}
+
+/** \brief Bulk load `values` into a `PackedRTree`.
+ *
+ *  The leaves are created by STR on the values, and the parents of every
+ *  level by STR on the bounding boxes of the level below. Before the leaves
+ *  are created, the cuts between them are moved such that they overlap less,
+ *  see `refine_packed_rtree_leaves`.
+ *
+ *  Siblings are stored contiguously and the levels are concatenated from the
+ *  root downwards; which results in breadth-first order. Finally, the values
+ *  are reordered such that they appear in the same order as the leaves. For
+ *  `PackedLeafFormat::compact` the leaves are then quantized.
+ *
+ *  Every step uses `n_threads` threads. The tree is the same for any number of
+ *  threads, except for the order of elements with identical centers, see
+ *  `parallel_sort_tile_recursion`.
+ */
+template <class T>
+inline PackedRTreeArrays<T> build_packed_rtree(std::vector<T> values,
+                                               PackedLeafFormat format,
+                                               size_t n_threads = 1) {
+    constexpr size_t max_children = PackedRTreeNode::max_children;
+
+    auto arrays = PackedRTreeArrays<T>{};
+    if(values.empty()) {
+        return arrays;
+    }
+
+    auto leaf_params = packed_rtree_str_params(values.size(), max_children);
+    parallel_sort_tile_recursion<T, GetCenterCoordinate<T>>(values, leaf_params, n_threads);
+    auto leaf_boundaries = leaf_params.partition_boundaries();
+    refine_packed_rtree_leaves(values, leaf_params, leaf_boundaries, max_children, n_threads);
+    auto leaf_groups = packed_rtree_groups(leaf_boundaries);
+
+    // levels[0] are the leaves, `levels.back()` contains only the root.
+    auto levels = std::vector<std::vector<PackedRTreeNode>>(1);
+    levels[0].resize(leaf_groups.size());
+    packed_rtree_parallel_for(leaf_groups.size(), n_threads, [&](size_t k) {
+        auto [i_begin, i_end] = leaf_groups[k];
+
+        auto& leaf = levels[0][k];
+        leaf.first_child = i_begin;
+        leaf.n_children = std::uint32_t(i_end - i_begin);
+        leaf.is_leaf = 1;
+        for(size_t i = i_begin; i < i_end; ++i) {
+            set_packed_rtree_child_box(leaf, i - i_begin, bgi::indexable<T>{}(values[i]));
+        }
+    });
+
+    while(levels.back().size() > 1) {
+        util::check_signals();
+
+        auto parents = build_packed_rtree_parents(levels.back(), n_threads);
+        levels.push_back(std::move(parents));
+    }
+
+    // The nodes are written bottom-up, every level at its final offset.
+    auto n_levels = levels.size();
+    auto level_offsets = std::vector<size_t>(n_levels, 0);
+    for(size_t l = n_levels - 1; l > 0; --l) {
+        level_offsets[l - 1] = level_offsets[l] + levels[l].size();
+    }
+
+    arrays.nodes.resize(level_offsets[0] + levels[0].size());
+    for(size_t l = 0; l < n_levels; ++l) {
+        const auto& level = levels[l];
+        auto child_offset = l > 0 ? level_offsets[l - 1] : size_t(0);
+        packed_rtree_parallel_for(level.size(), n_threads, [&](size_t i) {
+            auto node = level[i];
+            if(!node.is_leaf) {
+                node.first_child += child_offset;
+            }
+            arrays.nodes[level_offsets[l] + i] = node;
+        });
+    }
+
+    // The leaves refer to the values in STR order; after reordering the leaves
+    // their values must be moved as well.
+    auto value_offsets = std::vector<size_t>(levels[0].size() + 1, 0);
+    for(size_t k = 0; k < levels[0].size(); ++k) {
+        value_offsets[k + 1] = value_offsets[k] + levels[0][k].n_children;
+    }
+
+    arrays.values.resize(values.size(), values.front());
+    packed_rtree_parallel_for(levels[0].size(), n_threads, [&](size_t k) {
+        auto& leaf = arrays.nodes[level_offsets[0] + k];
+        auto first = values.begin() + long(leaf.first_child);
+        std::copy(first, first + leaf.n_children, arrays.values.begin() + long(value_offsets[k]));
+        leaf.first_child = value_offsets[k];
+    });
+
+    // The leaves are the last level. Hence, the children of an inner node
+    // already refer to the compact leaves, when offset by the number of
+    // inner nodes.
+    if(format == PackedLeafFormat::compact) {
+        auto n_inner_nodes = level_offsets[0];
+
+        arrays.leaves.resize(arrays.nodes.size() - n_inner_nodes);
+        packed_rtree_parallel_for(arrays.leaves.size(), n_threads, [&](size_t k) {
+            arrays.leaves[k] = make_packed_compact_leaf(arrays.nodes[n_inner_nodes + k]);
+        });
+
+        arrays.nodes.resize(n_inner_nodes);
+        arrays.nodes.shrink_to_fit();
+    }
+
+    return arrays;
+}
+
+
+/// \brief Header of the file format used by `write_packed_rtree`.
+struct PackedRTreeFileHeader {
+    static constexpr std::uint64_t current_version = 2;
+    static constexpr std::uint64_t alignment = 64;
+
+    char magic[8];
+    std::uint64_t version;
+    std::uint64_t node_size;
+    std::uint64_t leaf_size;
+    std::uint64_t value_size;
+    std::uint64_t n_nodes;
+    std::uint64_t n_leaves;
+    std::uint64_t n_values;
+    std::uint64_t nodes_offset;
+    std::uint64_t leaves_offset;
+    std::uint64_t values_offset;
+};
+
+static constexpr char packed_rtree_magic[8] = {'S', 'I', 'P', 'A', 'C', 'K', 'R', 'T'};
+
+inline std::uint64_t packed_rtree_align(std::uint64_t offset) {
+    constexpr auto alignment = PackedRTreeFileHeader::alignment;
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/// \brief Keeps a read-only mapping of a file alive.
+struct MappedFile {
+    explicit MappedFile(const std::string& filename)
+        : file(filename.c_str(), boost::interprocess::read_only),
+          region(file, boost::interprocess::read_only) {}
+
+    const char* data() const {
+        return static_cast<const char*>(region.get_address());
+    }
+
+    size_t size() const {
+        return region.get_size();
+    }
+
+    boost::interprocess::file_mapping file;
+    boost::interprocess::mapped_region region;
+};
+
+/** \brief The number of nodes in the top `n_levels` levels of the tree.
+ *
+ *  The nodes are stored level by level, hence the next level ends where the
+ *  children of the nodes of the current level end. Compact leaves aren't in
+ *  `nodes`.
+ */
+inline size_t packed_rtree_n_top_nodes(const PackedRTreeNode* nodes,
+                                       size_t n_nodes,
+                                       size_t n_levels) {
+    if(n_nodes == 0 || n_levels == 0) {
+        return 0;
+    }
+
+    size_t level_begin = 0;
+    size_t level_end = 1;
+    for(size_t level = 1; level < n_levels; ++level) {
+        if(nodes[level_begin].is_leaf) {
+            break;
+        }
+
+        size_t next_end = level_end;
+        for(size_t i = level_begin; i < level_end; ++i) {
+            next_end = std::max(next_end, size_t(nodes[i].first_child + nodes[i].n_children));
+        }
+
+        level_begin = level_end;
+        level_end = std::min(next_end, n_nodes);
+        if(level_begin == level_end) {
+            break;
+        }
+    }
+
+    return level_end;
+}
+
+/// \brief Read one byte of every page in `[data, data + n_bytes)`, such that it's paged in.
+inline void prefault_pages(const char* data, size_t n_bytes) {
+    constexpr size_t page_size = 4096;
+
+    const volatile char* bytes = data;
+    for(size_t i = 0; i < n_bytes; i += page_size) {
+        (void) bytes[i];
+    }
+
+    if(n_bytes > 0) {
+        (void) bytes[n_bytes - 1];
+    }
+}
+
+} // namespace detail
+
+
+template <typename T>
+template <class ValueIt>
+inline PackedRTree<T>::PackedRTree(ValueIt begin,
+                                   ValueIt end,
+                                   PackedLeafFormat format,
+                                   size_t n_threads) {
+    auto arrays = std::make_shared<detail::PackedRTreeArrays<T>>(
+        detail::build_packed_rtree(std::vector<T>(begin, end), format, n_threads)
+    );
+
+    nodes_ = arrays->nodes.data();
+    n_nodes_ = arrays->nodes.size();
+    leaves_ = arrays->leaves.data();
+    n_leaves_ = arrays->leaves.size();
+    values_ = arrays->values.data();
+    n_values_ = arrays->values.size();
+    owner_ = std::move(arrays);
+}
+
+
+template <typename T>
+inline PackedRTree<T>::PackedRTree(std::shared_ptr<const void> owner,
+                                   const node_type* nodes,
+                                   size_t n_nodes,
+                                   const PackedCompactLeaf* leaves,
+                                   size_t n_leaves,
+                                   const T* values,
+                                   size_t n_values)
+    : owner_(std::move(owner)),
+      nodes_(nodes),
+      n_nodes_(n_nodes),
+      leaves_(leaves),
+      n_leaves_(n_leaves),
+      values_(values),
+      n_values_(n_values) {}
+
+
+template <typename T>
+template <class Predicates, class Visitor>
+inline void PackedRTree<T>::visit(const Predicates& predicates, Visitor&& f) const {
+    using predicate = detail::packed_rtree_predicate<Predicates>;
+
+    if(n_nodes_ == 0 && n_leaves_ == 0) {
+        return;
+    }
+
+    // Every node pushes at most `max_children` entries after popping one.
+    // Hence, this is enough for trees with more than 16 levels.
+    auto stack = std::array<std::uint64_t, 16 * max_children>{};
+    size_t stack_size = 0;
+    stack[stack_size++] = 0;
+
+    // Counted locally, such that the statistics are updated once per query.
+    std::uint64_t n_visited = 0;
+    std::uint64_t n_leaves = 0;
+    auto record_stats = [&n_visited, &n_leaves]() {
+        SI_QUERY_STATS_ADD(nodes_visited, n_visited);
+        SI_QUERY_STATS_ADD(leaves_tested, n_leaves);
+    };
+
+    while(stack_size > 0) {
+        auto node_id = stack[--stack_size];
+        ++n_visited;
+
+        if(node_id >= n_nodes_) {
+            ++n_leaves;
+            const auto& leaf = leaves_[node_id - n_nodes_];
+            const auto* leaf_values = values_ + leaf.first_child;
+
+            PackedRTreeNode node;
+            detail::decode_packed_compact_leaf(leaf, node);
+
+            // The quantized boxes contain the exact boxes. Therefore, the
+            // candidates must be checked again, using their exact boxes.
+            auto mask = predicate::children(predicates, node);
+            if(mask != 0) {
+                for(auto m = mask; m != 0; m &= m - 1) {
+                    auto k = detail::lowest_set_bit(m);
+                    detail::set_packed_rtree_child_box(node, k, bgi::indexable<T>{}(leaf_values[k]));
+                }
+                mask &= predicate::children(predicates, node);
+            }
+
+            if(!visit_leaf_values(predicates, leaf_values, mask, f)) {
+                record_stats();
+                return;
+            }
+
+            continue;
+        }
+
+        const auto& node = nodes_[node_id];
+
+        auto mask = predicate::children(predicates, node);
+        if(node.is_leaf) {
+            ++n_leaves;
+            if(!visit_leaf_values(predicates, values_ + node.first_child, mask, f)) {
+                record_stats();
+                return;
+            }
+        } else {
+            for(; mask != 0; mask &= mask - 1) {
+                stack[stack_size++] = node.first_child + detail::lowest_set_bit(mask);
+            }
+        }
+    }
+
+    record_stats();
+}
+
+
+template <typename T>
+template <class Predicates, class Visitor>
+inline bool PackedRTree<T>::visit_leaf_values(const Predicates& predicates,
+                                              const T* leaf_values,
+                                              std::uint32_t mask,
+                                              Visitor& f) const {
+    using predicate = detail::packed_rtree_predicate<Predicates>;
+
+    // The values of a leaf are checked together, which allows testing
+    // their exact shapes in bulk.
+    for(mask = predicate::values(predicates, leaf_values, mask); mask != 0; mask &= mask - 1) {
+        if(!f(leaf_values[detail::lowest_set_bit(mask)])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+template <typename T>
+template <class Geometry, class OutputIt>
+inline size_t PackedRTree<T>::query_nearest(const Geometry& geometry,
+                                            size_t k,
+                                            OutputIt it) const {
+    using distance_t = typename bg::default_comparable_distance_result<Geometry, Box3D>::type;
+    using entry_t = std::pair<distance_t, std::uint64_t>;
+    using min_heap_t = std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>>;
+
+    if((n_nodes_ == 0 && n_leaves_ == 0) || k == 0) {
+        return 0;
+    }
+
+    // Nodes to visit, closest first; and the `k` closest values found so far,
+    // as a max-heap.
+    auto to_visit = min_heap_t{};
+    auto neighbors = std::vector<entry_t>{};
+    neighbors.reserve(k);
+
+    auto is_candidate = [&neighbors, k](distance_t distance) {
+        return neighbors.size() < k || distance < neighbors.front().first;
+    };
+
+    auto add_neighbor = [&neighbors, k](distance_t distance, std::uint64_t value_id) {
+        if(neighbors.size() == k) {
+            std::pop_heap(neighbors.begin(), neighbors.end());
+            neighbors.pop_back();
+        }
+        neighbors.emplace_back(distance, value_id);
+        std::push_heap(neighbors.begin(), neighbors.end());
+    };
+
+    std::uint64_t n_visited = 0;
+    std::uint64_t n_leaves = 0;
+
+    to_visit.emplace(distance_t(0), 0);
+    while(!to_visit.empty()) {
+        auto [node_distance, node_id] = to_visit.top();
+        to_visit.pop();
+
+        if(!is_candidate(node_distance)) {
+            break;
+        }
+
+        ++n_visited;
+        if(node_id >= n_nodes_ || nodes_[node_id].is_leaf) {
+            ++n_leaves;
+        }
+
+        if(node_id >= n_nodes_) {
+            // The distance to a quantized box is a lower bound of the exact
+            // distance, which is only computed if needed.
+            const auto& leaf = leaves_[node_id - n_nodes_];
+            for(size_t i = 0; i < leaf.n_children; ++i) {
+                if(!is_candidate(distance_t(bg::comparable_distance(geometry, leaf.child_box(i))))) {
+                    continue;
+                }
+
+                auto value_id = leaf.first_child + i;
+                auto exact_box = bgi::indexable<T>{}(values_[value_id]);
+                auto distance = distance_t(bg::comparable_distance(geometry, exact_box));
+                if(is_candidate(distance)) {
+                    add_neighbor(distance, value_id);
+                }
+            }
+
+            continue;
+        }
+
+        const auto& node = nodes_[node_id];
+        for(size_t i = 0; i < node.n_children; ++i) {
+            auto distance = distance_t(bg::comparable_distance(geometry, node.child_box(i)));
+            if(!is_candidate(distance)) {
+                continue;
+            }
+
+            auto child = node.first_child + i;
+            if(node.is_leaf) {
+                add_neighbor(distance, child);
+            } else {
+                to_visit.emplace(distance, child);
+            }
+        }
+    }
+
+    SI_QUERY_STATS_ADD(nodes_visited, n_visited);
+    SI_QUERY_STATS_ADD(leaves_tested, n_leaves);
+
+    std::sort_heap(neighbors.begin(), neighbors.end());
+    for(const auto& [distance, value_id] : neighbors) {
+        *it = values_[value_id];
+        ++it;
+    }
+
+    return neighbors.size();
+}
+
+
+template <typename T>
+template <class Predicates, class OutputIt>
+inline size_t PackedRTree<T>::query(const Predicates& predicates, OutputIt it) const {
+    if constexpr (detail::is_nearest_predicate<Predicates>::value) {
+        return query_nearest(predicates.point_or_relation, predicates.count, it);
+    } else {
+        size_t n_found = 0;
+        visit(predicates, [&it, &n_found](const T& value) {
+            *it = value;
+            ++it;
+            ++n_found;
+            return true;
+        });
+
+        return n_found;
+    }
+}
+
+
+template <typename T>
+template <class Predicates>
+inline bool PackedRTree<T>::query_any(const Predicates& predicates) const {
+    bool found = false;
+    visit(predicates, [&found](const T& /* value */) {
+        found = true;
+        return false;
+    });
+
+    return found;
+}
+
+
+template <typename T>
+inline Box3D PackedRTree<T>::bounds() const {
+    if(n_nodes_ > 0) {
+        return detail::packed_rtree_node_bounds(nodes_[0]);
+    }
+
+    // Either the tree is empty, or the root is a compact leaf. Its quantized
+    // boxes are too large, but the exact ones are those of its values.
+    Box3D box;
+    bg::assign_inverse(box);
+    for(size_t i = 0; i < n_values_; ++i) {
+        bg::expand(box, bgi::indexable<T>{}(values_[i]));
+    }
+
+    return box;
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline bool PackedIndexTree<T>::is_intersecting(const ShapeT& shape) const {
+    auto stats_scope = this->query_stats_scope();
+    return this->query_any(detail::intersects_predicate<GeometryMode, T>(shape));
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<typename PackedIndexTree<T>::cref_t>
+PackedIndexTree<T>::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<cref_t> results;
+    this->template find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+namespace detail {
+
+/// \brief The values of a leaf, i.e. a node with `is_leaf` or a compact leaf.
+template <class T>
+inline std::pair<const T*, size_t> packed_rtree_leaf_values(const PackedRTree<T>& tree,
+                                                            std::uint64_t node_id) {
+    if(node_id >= tree.n_nodes()) {
+        const auto& leaf = tree.leaves()[node_id - tree.n_nodes()];
+        return {tree.begin() + leaf.first_child, leaf.n_children};
+    }
+
+    const auto& node = tree.nodes()[node_id];
+    return {tree.begin() + node.first_child, node.n_children};
+}
+
+inline bool is_packed_rtree_leaf(const PackedRTreeNode* nodes,
+                                 size_t n_nodes,
+                                 std::uint64_t node_id) {
+    return node_id >= n_nodes || nodes[node_id].is_leaf;
+}
+
+/// \brief Sort `runs` by gid and merge the runs of equal gids.
+inline void merge_gid_runs(std::vector<GidRun>& runs) {
+    std::sort(runs.begin(), runs.end(), [](const GidRun& a, const GidRun& b) {
+        return a.gid < b.gid;
+    });
+
+    size_t n_merged = 0;
+    for(const auto& run : runs) {
+        if(n_merged > 0 && runs[n_merged - 1].gid == run.gid) {
+            runs[n_merged - 1].count += run.count;
+        } else {
+            runs[n_merged++] = run;
+        }
+    }
+
+    runs.resize(n_merged);
+}
+
+template <class T>
+inline PackedGidSummaries build_packed_gid_summaries(const PackedRTree<T>& tree) {
+    const auto* nodes = tree.nodes();
+    auto n_nodes = tree.n_nodes();
+
+    // Nodes are stored breadth-first, i.e. children come after their parent.
+    // Hence, the summaries of the children are ready when a node is reached.
+    auto node_runs = std::vector<std::vector<GidRun>>(n_nodes);
+    for(size_t i = n_nodes; i-- > 0; ) {
+        const auto& node = nodes[i];
+        if(node.is_leaf) {
+            continue;
+        }
+
+        auto& runs = node_runs[i];
+        for(size_t k = 0; k < node.n_children; ++k) {
+            auto child = node.first_child + k;
+            if(is_packed_rtree_leaf(nodes, n_nodes, child)) {
+                auto [values, n_values] = packed_rtree_leaf_values(tree, child);
+                for(size_t j = 0; j < n_values; ++j) {
+                    runs.push_back(GidRun{values[j].post_gid(), 1});
+                }
+            } else {
+                runs.insert(runs.end(), node_runs[child].begin(), node_runs[child].end());
+            }
+        }
+
+        merge_gid_runs(runs);
+    }
+
+    auto summaries = PackedGidSummaries{};
+    summaries.offsets.reserve(n_nodes + 1);
+    summaries.offsets.push_back(0);
+    for(const auto& runs : node_runs) {
+        summaries.offsets.push_back(summaries.offsets.back() + runs.size());
+    }
+
+    summaries.runs.reserve(summaries.offsets.back());
+    for(const auto& runs : node_runs) {
+        summaries.runs.insert(summaries.runs.end(), runs.begin(), runs.end());
+    }
+
+    return summaries;
+}
+
+}  // namespace detail
+
+
+template <typename T>
+inline void PackedIndexTree<T>::build_gid_summaries() {
+    gid_summaries_ = std::make_shared<const PackedGidSummaries>(
+        detail::build_packed_gid_summaries(static_cast<const super&>(*this))
+    );
+}
+
+
+template <typename T>
+template <typename GeometryMode, typename ShapeT>
+inline std::unordered_map<identifier_t, size_t>
+PackedIndexTree<T>::count_intersecting_agg_gid(const ShapeT& shape) const {
+    using mixin = IndexTreeMixin<PackedIndexTree<T>, T>;
+    auto stats_scope = this->query_stats_scope();
+
+    // Only with bounding boxes does a node inside the query imply that all
+    // its elements intersect the query.
+    if constexpr (!std::is_same<GeometryMode, BoundingBoxGeometry>::value) {
+        return mixin::template count_intersecting_agg_gid<GeometryMode>(shape);
+    } else {
+        if(gid_summaries_ == nullptr) {
+            return mixin::template count_intersecting_agg_gid<GeometryMode>(shape);
+        }
+
+        const auto* nodes = this->nodes();
+        auto n_nodes = this->n_nodes();
+        if(n_nodes == 0 && this->n_leaves() == 0) {
+            return {};
+        }
+
+        const auto& summaries = *gid_summaries_;
+        const auto query_box = bgi::indexable<ShapeT>{}(shape);
+
+        util::FlatCounter<identifier_t> counts;
+        auto count_leaf = [&](std::uint64_t node_id, bool is_contained) {
+            auto [values, n_values] = detail::packed_rtree_leaf_values(*this, node_id);
+            for(size_t j = 0; j < n_values; ++j) {
+                if(is_contained
+                   || (bg::intersects(query_box, bgi::indexable<T>{}(values[j]))
+                       && geometry_intersects(shape, values[j], GeometryMode{}))) {
+                    counts.add(values[j].post_gid());
+                }
+            }
+        };
+
+        auto stack = std::vector<std::uint64_t>{0};
+        while(!stack.empty()) {
+            auto node_id = stack.back();
+            stack.pop_back();
+
+            if(detail::is_packed_rtree_leaf(nodes, n_nodes, node_id)) {
+                count_leaf(node_id, false);
+                continue;
+            }
+
+            const auto& node = nodes[node_id];
+            for(size_t k = 0; k < node.n_children; ++k) {
+                auto box = node.child_box(k);
+                if(!bg::intersects(query_box, box)) {
+                    continue;
+                }
+
+                auto child = node.first_child + k;
+                if(!strictly_contains(shape, box)) {
+                    stack.push_back(child);
+                } else if(detail::is_packed_rtree_leaf(nodes, n_nodes, child)) {
+                    count_leaf(child, true);
+                } else {
+                    for(auto r = summaries.offsets[child]; r < summaries.offsets[child + 1]; ++r) {
+                        counts.add(summaries.runs[r].gid, summaries.runs[r].count);
+                    }
+                }
+            }
+        }
+
+        return counts.to_unordered_map();
+    }
+}
+
+
+template <typename T>
+inline PackedIndexTree<T>::PackedIndexTree(const std::string& filename, size_t n_eager_levels)
+    : super(map_packed_rtree<T>(filename, n_eager_levels)) {}
+
+
+template <typename T>
+inline void PackedIndexTree<T>::dump(const std::string& filename) const {
+    write_packed_rtree(*this, filename);
+}
+
+
+template <typename T>
+inline void write_packed_rtree(const PackedRTree<T>& tree, const std::string& filename) {
+    static_assert(detail::is_packable<T>::value,
+                  "The values of a packed R-tree must be safe to copy bytewise.");
+
+    using header_t = detail::PackedRTreeFileHeader;
+    using node_type = typename PackedRTree<T>::node_type;
+    using leaf_type = typename PackedRTree<T>::leaf_type;
+
+    auto header = header_t{};
+    std::memcpy(header.magic, detail::packed_rtree_magic, sizeof(header.magic));
+    header.version = header_t::current_version;
+    header.node_size = sizeof(node_type);
+    header.leaf_size = sizeof(leaf_type);
+    header.value_size = sizeof(T);
+    header.n_nodes = tree.n_nodes();
+    header.n_leaves = tree.n_leaves();
+    header.n_values = tree.size();
+    header.nodes_offset = detail::packed_rtree_align(sizeof(header_t));
+    header.leaves_offset = detail::packed_rtree_align(
+        header.nodes_offset + header.n_nodes * header.node_size
+    );
+    header.values_offset = detail::packed_rtree_align(
+        header.leaves_offset + header.n_leaves * header.leaf_size
+    );
+
+    auto ofs = util::open_ofstream(filename, std::ios::binary | std::ios::trunc);
+    auto write_padding = [&ofs](std::uint64_t offset) {
+        auto padding = std::array<char, header_t::alignment>{};
+        auto n_bytes = detail::packed_rtree_align(offset) - offset;
+        ofs.write(padding.data(), std::streamsize(n_bytes));
+    };
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    write_padding(sizeof(header));
+
+    auto n_node_bytes = header.n_nodes * header.node_size;
+    ofs.write(reinterpret_cast<const char*>(tree.nodes()), std::streamsize(n_node_bytes));
+    write_padding(header.nodes_offset + n_node_bytes);
+
+    auto n_leaf_bytes = header.n_leaves * header.leaf_size;
+    ofs.write(reinterpret_cast<const char*>(tree.leaves()), std::streamsize(n_leaf_bytes));
+    write_padding(header.leaves_offset + n_leaf_bytes);
+
+    ofs.write(reinterpret_cast<const char*>(tree.begin()),
+              std::streamsize(header.n_values * header.value_size));
+
+    if(!ofs) {
+        auto msg = boost::format("Failed to write packed R-tree: %s") % filename.c_str();
+        throw std::runtime_error(msg.str());
+    }
+}
+
+
+template <typename T>
+inline PackedRTree<T> map_packed_rtree(const std::string& filename, size_t n_eager_levels) {
+    static_assert(detail::is_packable<T>::value,
+                  "The values of a packed R-tree must be safe to copy bytewise.");
+
+    using header_t = detail::PackedRTreeFileHeader;
+    using node_type = typename PackedRTree<T>::node_type;
+    using leaf_type = typename PackedRTree<T>::leaf_type;
+
+    if(!std::filesystem::exists(filename)) {
+        auto msg = boost::format("No such file: %s") % filename.c_str();
+        throw std::runtime_error(msg.str());
+    }
+
+    auto invalid_file = [&filename](const std::string& reason) {
+        auto msg = boost::format("Invalid packed R-tree '%s': %s") % filename.c_str() % reason;
+        return std::runtime_error(msg.str());
+    };
+
+    if(std::filesystem::file_size(filename) < sizeof(header_t)) {
+        throw invalid_file("file is too small");
+    }
+
+    auto mapped = std::make_shared<detail::MappedFile>(filename);
+
+    auto header = header_t{};
+    std::memcpy(&header, mapped->data(), sizeof(header));
+
+    if(std::memcmp(header.magic, detail::packed_rtree_magic, sizeof(header.magic)) != 0) {
+        throw invalid_file("wrong magic number");
+    }
+
+    if(header.version != header_t::current_version) {
+        throw invalid_file("unsupported version " + std::to_string(header.version));
+    }
+
+    if(header.node_size != sizeof(node_type)
+       || header.leaf_size != sizeof(leaf_type)
+       || header.value_size != sizeof(T)) {
+        throw invalid_file("the element type doesn't match");
+    }
+
+    auto nodes_end = header.nodes_offset + header.n_nodes * header.node_size;
+    auto leaves_end = header.leaves_offset + header.n_leaves * header.leaf_size;
+    auto values_end = header.values_offset + header.n_values * header.value_size;
+    if(header.nodes_offset % header_t::alignment != 0
+       || header.leaves_offset % header_t::alignment != 0
+       || header.values_offset % header_t::alignment != 0
+       || nodes_end > header.leaves_offset
+       || leaves_end > header.values_offset
+       || values_end > mapped->size()) {
+        throw invalid_file("inconsistent header");
+    }
+
+    auto nodes = reinterpret_cast<const node_type*>(mapped->data() + header.nodes_offset);
+    auto leaves = reinterpret_cast<const leaf_type*>(mapped->data() + header.leaves_offset);
+    auto values = reinterpret_cast<const T*>(mapped->data() + header.values_offset);
+
+    auto n_eager_nodes = detail::packed_rtree_n_top_nodes(nodes, header.n_nodes, n_eager_levels);
+    detail::prefault_pages(mapped->data() + header.nodes_offset, n_eager_nodes * header.node_size);
+
+    return PackedRTree<T>(std::move(mapped),
+                          nodes, header.n_nodes,
+                          leaves, header.n_leaves,
+                          values, header.n_values);
+}
+
+namespace detail {
+
+/** \brief Creates the `bgi::rtree` node for node `node_id` of `arrays`, and its subtree.
+ *
+ *  The arrays must use `PackedLeafFormat::full`.
+ */
+template <class MembersHolder, class T>
+inline typename MembersHolder::node_pointer
+make_native_rtree_node(const PackedRTreeArrays<T>& arrays,
+                       size_t node_id,
+                       typename MembersHolder::allocators_type& allocators) {
+    namespace rtree = bgi::detail::rtree;
+    using allocators_type = typename MembersHolder::allocators_type;
+    using box_type = typename MembersHolder::box_type;
+    using internal_node = typename MembersHolder::internal_node;
+    using leaf = typename MembersHolder::leaf;
+    using element_type = typename rtree::elements_type<internal_node>::type::value_type;
+    using subtree_destroyer = rtree::subtree_destroyer<MembersHolder>;
+
+    const auto& node = arrays.nodes[node_id];
+    if(node.is_leaf) {
+        auto pointer = rtree::create_node<allocators_type, leaf>::apply(allocators);
+        subtree_destroyer guard(pointer, allocators);
+
+        auto& elements = rtree::elements(rtree::get<leaf>(*pointer));
+        for(size_t k = 0; k < node.n_children; ++k) {
+            elements.push_back(arrays.values[node.first_child + k]);
+        }
+
+        guard.release();
+        return pointer;
+    }
+
+    auto pointer = rtree::create_node<allocators_type, internal_node>::apply(allocators);
+    subtree_destroyer guard(pointer, allocators);
+
+    auto& elements = rtree::elements(rtree::get<internal_node>(*pointer));
+    for(size_t k = 0; k < node.n_children; ++k) {
+        box_type box;
+        bg::convert(node.child_box(k), box);
+
+        auto child = make_native_rtree_node<MembersHolder>(arrays, node.first_child + k, allocators);
+        elements.push_back(element_type(box, child));
+    }
+
+    guard.release();
+    return pointer;
+}
+
+} // namespace detail
+
+
+template <class... Args>
+inline void bulk_load_rtree(bgi::rtree<Args...>& tree,
+                            std::vector<typename bgi::rtree<Args...>::value_type> values,
+                            size_t n_threads) {
+    namespace rtree = bgi::detail::rtree;
+
+    using rtree_type = bgi::rtree<Args...>;
+    using value_type = typename rtree_type::value_type;
+    using view = rtree::private_view<rtree_type>;
+    using members_holder = typename view::members_holder;
+    using node_pointer = typename members_holder::node_pointer;
+    using subtree_destroyer = rtree::subtree_destroyer<members_holder>;
+
+    static_assert(std::is_same<typename rtree_type::indexable_getter,
+                               bgi::indexable<value_type>>::value,
+                  "The packed layout requires the default indexable.");
+
+    view tree_view(tree);
+    auto& members = tree_view.members();
+
+    if(members.parameters().get_max_elements() < PackedRTreeNode::max_children) {
+        throw std::invalid_argument("The nodes of the R-tree are too small for STR bulk loading.");
+    }
+
+    auto n_values = values.size();
+    auto arrays = detail::build_packed_rtree(std::move(values), PackedLeafFormat::full, n_threads);
+
+    // The leaves are the only nodes without inner nodes as children.
+    size_t leafs_level = 0;
+    for(size_t i = 0; !arrays.nodes.empty() && !arrays.nodes[i].is_leaf; ++leafs_level) {
+        i = arrays.nodes[i].first_child;
+    }
+
+    auto root = node_pointer(0);
+    if(!arrays.nodes.empty()) {
+        root = detail::make_native_rtree_node<members_holder>(arrays, 0, members.allocators());
+    }
+
+    subtree_destroyer remover(members.root, members.allocators());
+    members.root = root;
+    members.values_count = n_values;
+    members.leafs_level = leafs_level;
+}
+
+
+} // namespace brain_indexer
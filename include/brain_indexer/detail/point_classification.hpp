@@ -0,0 +1,253 @@
+#pragma once
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <brain_indexer/detail/tree_nodes.hpp>
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+template <class T>
+inline bool element_contains(const T& element, const Point3D& p) {
+    if constexpr (shape_matches_any_of<T, Sphere, Cylinder>()) {
+        return element.contains(p);
+    } else {
+        return false;
+    }
+}
+
+template <class... V>
+inline bool element_contains(const boost::variant<V...>& element, const Point3D& p) {
+    return boost::apply_visitor(
+        [&p](const auto& alternative) { return element_contains(alternative, p); },
+        element
+    );
+}
+
+
+/** \brief Classifies the points of one block against one tree.
+ *
+ *  The indices of the points inside the current node are kept on a stack,
+ *  `active_`; each child pushes the subset inside its box, and pops it once
+ *  it's been visited.
+ */
+template <class Nodes>
+class PointClassification {
+  public:
+    using node_type = typename Nodes::node_type;
+    using value_type = typename Nodes::value_type;
+
+    inline PointClassification(const Nodes& nodes, Point3Dx const* points, identifier_t* ids)
+        : nodes_(nodes)
+        , points_(points)
+        , ids_(ids) {}
+
+    /// \brief Classify the points `order[low:high]`.
+    inline void classify_block(const std::vector<size_t>& order, size_t low, size_t high) {
+        active_.clear();
+        for(size_t k = low; k < high; ++k) {
+            if(bg::covered_by(point(order[k]), nodes_.bounds())) {
+                active_.push_back(order[k]);
+            }
+        }
+
+        if(!active_.empty()) {
+            visit(nodes_.root(), 0, active_.size());
+        }
+    }
+
+  private:
+    inline const Point3D& point(size_t i) const {
+        return points_[i];
+    }
+
+    /// \brief `active_[begin:end]` are the points inside `node`.
+    inline void visit(const node_type& node, size_t begin, size_t end) {
+        if(nodes_.is_leaf(node)) {
+            nodes_.for_each_value(node, [this, begin, end](const value_type& value) {
+                auto box = Box3D(bgi::indexable<value_type>{}(value));
+                auto id = get_id_from(value);
+
+                for(size_t k = begin; k < end; ++k) {
+                    const auto& p = point(active_[k]);
+                    auto& point_id = ids_[active_[k]];
+                    if(id < point_id && bg::covered_by(p, box) && element_contains(value, p)) {
+                        point_id = id;
+                    }
+                }
+            });
+            return;
+        }
+
+        nodes_.for_each_child(node, [this, begin, end](const Box3D& box, const node_type& child) {
+            auto child_begin = active_.size();
+            for(size_t k = begin; k < end; ++k) {
+                auto i = active_[k];
+                if(bg::covered_by(point(i), box)) {
+                    active_.push_back(i);
+                }
+            }
+
+            if(active_.size() > child_begin) {
+                visit(child, child_begin, active_.size());
+            }
+            active_.resize(child_begin);
+        });
+    }
+
+    const Nodes& nodes_;
+    Point3Dx const* points_;
+    identifier_t* ids_;
+    std::vector<size_t> active_;
+};
+
+
+/** \brief Classify the blocks `blocks` of points against one tree.
+ *
+ *  Block `b` are the points `order[b * block_size:(b + 1) * block_size]`.
+ *  Since no two blocks share a point, they're classified in parallel.
+ */
+template <class Nodes>
+inline void classify_point_blocks(const Nodes& nodes,
+                                  Point3Dx const* points,
+                                  const std::vector<size_t>& order,
+                                  size_t block_size,
+                                  const std::vector<size_t>& blocks,
+                                  size_t n_threads,
+                                  identifier_t* ids) {
+    if(nodes.empty()) {
+        return;
+    }
+
+    util::parallel_for(blocks.size(), n_threads, [&](size_t k) {
+        auto low = blocks[k] * block_size;
+        auto high = std::min(low + block_size, order.size());
+        PointClassification<Nodes>(nodes, points, ids).classify_block(order, low, high);
+    });
+}
+
+
+/// \brief `classify_points` of a multi-index.
+struct MultiIndexPointClassification {
+    template <class T, class SubtreeCache>
+    static inline void classify(const MultiIndexTree<T, SubtreeCache>& index,
+                                Point3Dx const* points,
+                                const std::vector<size_t>& order,
+                                size_t block_size,
+                                size_t n_blocks,
+                                size_t n_threads,
+                                identifier_t* ids) {
+        using subtree_id_type = typename MultiIndexTree<T, SubtreeCache>::toptree_type::value_type;
+
+        auto block_boxes = std::vector<Box3D>(n_blocks);
+        util::parallel_for(n_blocks, n_threads, [&](size_t b) {
+            auto low = b * block_size;
+            auto high = std::min(low + block_size, order.size());
+
+            const Point3D& first = points[order[low]];
+            bg::envelope(first, block_boxes[b]);
+            for(size_t k = low + 1; k < high; ++k) {
+                bg::expand(block_boxes[b], static_cast<const Point3D&>(points[order[k]]));
+            }
+        });
+
+        // The blocks which each subtree might contain, in the order of `to_visit`.
+        auto to_visit = std::vector<subtree_id_type>{};
+        auto blocks = std::vector<std::vector<size_t>>{};
+        auto positions = std::unordered_map<size_t, size_t>{};
+
+        auto found = std::vector<subtree_id_type>{};
+        for(size_t b = 0; b < n_blocks; ++b) {
+            found.clear();
+            index.top_rtree.query(bgi::intersects(block_boxes[b]), std::back_inserter(found));
+
+            for(const auto& subtree : found) {
+                auto [it, is_new] = positions.emplace(subtree.id, to_visit.size());
+                if(is_new) {
+                    to_visit.push_back(subtree);
+                    blocks.emplace_back();
+                }
+                blocks[it->second].push_back(b);
+            }
+        }
+
+        size_t k = 0;
+        index.for_each_subtree(to_visit, [&](const auto& subtree) {
+            classify_point_blocks(make_tree_nodes(subtree), points, order, block_size,
+                                  blocks[k], n_threads, ids);
+            ++k;
+        });
+
+        ++index.query_count;
+    }
+};
+
+
+template <class Index>
+inline void classify_points_impl(const Index& index,
+                                 Point3Dx const* points,
+                                 const std::vector<size_t>& order,
+                                 size_t block_size,
+                                 size_t n_blocks,
+                                 size_t n_threads,
+                                 identifier_t* ids) {
+    auto blocks = std::vector<size_t>(n_blocks);
+    for(size_t b = 0; b < n_blocks; ++b) {
+        blocks[b] = b;
+    }
+
+    classify_point_blocks(make_tree_nodes(index), points, order, block_size,
+                          blocks, n_threads, ids);
+}
+
+template <class T, class SubtreeCache>
+inline void classify_points_impl(const MultiIndexTree<T, SubtreeCache>& index,
+                                 Point3Dx const* points,
+                                 const std::vector<size_t>& order,
+                                 size_t block_size,
+                                 size_t n_blocks,
+                                 size_t n_threads,
+                                 identifier_t* ids) {
+    MultiIndexPointClassification::classify(index, points, order, block_size,
+                                            n_blocks, n_threads, ids);
+}
+
+}  // namespace detail
+
+
+template <class Index>
+inline std::vector<identifier_t> classify_points(const Index& index,
+                                                 Point3Dx const* points,
+                                                 size_t n_points,
+                                                 size_t n_threads,
+                                                 size_t block_size) {
+    if(block_size == 0) {
+        throw std::invalid_argument("The blocks of points must not be empty.");
+    }
+
+    auto ids = std::vector<identifier_t>(n_points, unclassified_point);
+    if(n_points == 0) {
+        return ids;
+    }
+
+    auto order = experimental::space_filling_order(points, n_points, 10, n_threads);
+    auto n_blocks = (n_points + block_size - 1) / block_size;
+    detail::classify_points_impl(index, points, order, block_size, n_blocks, n_threads,
+                                 ids.data());
+
+    return ids;
+}
+
+template <class Index>
+inline std::vector<identifier_t> classify_points(const Index& index,
+                                                 const std::vector<Point3Dx>& points,
+                                                 size_t n_threads,
+                                                 size_t block_size) {
+    return classify_points(index, points.data(), points.size(), n_threads, block_size);
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <iterator>
+
+namespace brain_indexer {
+
+template <class Index>
+template <class OutputIt>
+inline size_t QueryCursor<Index>::next_batch(size_t max_elements, OutputIt it) {
+    size_t n_written = 0;
+    for(; n_written < max_elements && it_ != end_; ++it_, ++n_written) {
+        *it = *it_;
+        ++it;
+    }
+
+    return n_written;
+}
+
+
+template <class T, class SubtreeCache>
+inline QueryCursor<MultiIndexTree<T, SubtreeCache>>::QueryCursor(const index_type& index,
+                                                                 const Box3D& query_box,
+                                                                 exact_test_type exact_test)
+    : index_(index)
+    , query_box_(query_box)
+    , exact_test_(std::move(exact_test)) {
+    index_.top_rtree.query(bgi::intersects(query_box_), std::back_inserter(subtrees_));
+    ++index_.query_count;
+}
+
+
+template <class T, class SubtreeCache>
+template <class OutputIt>
+inline size_t
+QueryCursor<MultiIndexTree<T, SubtreeCache>>::next_batch(size_t max_elements, OutputIt it) {
+    size_t n_written = 0;
+    while(n_written < max_elements) {
+        if(n_returned_ == pending_.size()) {
+            if(next_subtree_ == subtrees_.size()) {
+                break;
+            }
+
+            util::check_signals();
+
+            // Release the matches of the previous subtree first.
+            pending_.clear();
+            n_returned_ = 0;
+            index_.query_subtree(subtrees_[next_subtree_++],
+                                 bgi::intersects(query_box_) && bgi::satisfies(exact_test_),
+                                 std::back_inserter(pending_));
+            continue;
+        }
+
+        *it = pending_[n_returned_++];
+        ++it;
+        ++n_written;
+    }
+
+    return n_written;
+}
+
+
+template <typename GeometryMode, class Index, class ShapeT>
+inline QueryCursor<Index> make_query_cursor(const Index& index, const ShapeT& shape) {
+    static_assert(supports_query_cursor<Index>::value,
+                  "This index doesn't support query cursors.");
+
+    using value_type = typename Index::value_type;
+    return QueryCursor<Index>(
+        index,
+        bgi::indexable<ShapeT>{}(shape),
+        [shape](const value_type& value) {
+            return geometry_intersects(shape, value, GeometryMode{});
+        }
+    );
+}
+
+}  // namespace brain_indexer
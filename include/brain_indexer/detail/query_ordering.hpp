@@ -0,0 +1,187 @@
+#pragma once
+
+#include "../query_ordering.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+
+#include <boost/format.hpp>
+
+#include <brain_indexer/util.hpp>
+
+namespace brain_indexer {
+namespace experimental {
+
+namespace detail {
+
+/// \brief Chunks smaller than this aren't worth a thread of their own.
+constexpr size_t min_ordering_chunk_size = 1 << 14;
+
+inline size_t ordering_chunk_count(size_t n_elements, size_t n_threads) {
+    return std::max<size_t>(1, std::min(n_threads, n_elements / min_ordering_chunk_size));
+}
+
+
+template <int N>
+inline std::uint64_t hilbert_key(const Point3D& xyz) {
+    static_assert(3 * N <= 64, "The key doesn't fit into 64 bits.");
+
+    return zisa::hilbert_index<N>(xyz.get<0>(), xyz.get<1>(), xyz.get<2>()).to_ullong();
+}
+
+
+template <int... N>
+inline std::uint64_t hilbert_key(int n_bits,
+                                 const Point3D& xyz,
+                                 std::integer_sequence<int, N...>) {
+    using key_function = std::uint64_t (*)(const Point3D&);
+    static constexpr key_function key_functions[] = {&hilbert_key<N + 1>...};
+
+    return key_functions[n_bits - 1](xyz);
+}
+
+
+inline std::uint64_t hilbert_key(int n_bits, const Point3D& xyz) {
+    return hilbert_key(n_bits, xyz, std::make_integer_sequence<int, max_hilbert_bits>{});
+}
+
+
+inline void radix_sort_by_key(std::vector<std::pair<std::uint64_t, size_t>>& pairs,
+                              int n_key_bits,
+                              size_t n_threads) {
+    constexpr int digit_bits = 8;
+    constexpr size_t n_buckets = size_t(1) << digit_bits;
+    constexpr std::uint64_t digit_mask = n_buckets - 1;
+
+    auto n_pairs = pairs.size();
+    auto n_chunks = ordering_chunk_count(n_pairs, n_threads);
+    auto histograms = std::vector<std::array<size_t, n_buckets>>(n_chunks);
+    auto buffer = std::vector<std::pair<std::uint64_t, size_t>>(n_pairs);
+
+    for(int shift = 0; shift < n_key_bits; shift += digit_bits) {
+        auto digit = [shift](std::uint64_t key) {
+            return size_t((key >> shift) & digit_mask);
+        };
+
+        util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+            auto [low, high] = util::balanced_chunks(n_pairs, n_chunks, k);
+
+            auto& histogram = histograms[k];
+            histogram.fill(0);
+            for(size_t i = low; i < high; ++i) {
+                ++histogram[digit(pairs[i].first)];
+            }
+        });
+
+        // Turn the counts into the offset at which each chunk writes its
+        // elements of each bucket; bucket-major to keep the sort stable.
+        size_t offset = 0;
+        bool is_single_bucket = false;
+        for(size_t b = 0; b < n_buckets; ++b) {
+            auto bucket_begin = offset;
+            for(auto& histogram : histograms) {
+                auto count = histogram[b];
+                histogram[b] = offset;
+                offset += count;
+            }
+
+            is_single_bucket |= (offset - bucket_begin == n_pairs);
+        }
+
+        // The pass wouldn't change the order, e.g. the high digits of
+        // clustered points.
+        if(is_single_bucket) {
+            continue;
+        }
+
+        util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+            auto [low, high] = util::balanced_chunks(n_pairs, n_chunks, k);
+
+            auto& offsets = histograms[k];
+            for(size_t i = low; i < high; ++i) {
+                buffer[offsets[digit(pairs[i].first)]++] = pairs[i];
+            }
+        });
+
+        std::swap(pairs, buffer);
+    }
+}
+
+}  // namespace detail
+
+
+inline std::vector<size_t> space_filling_order(Point3Dx const * points,
+                                               size_t n_points,
+                                               int n_bits,
+                                               size_t n_threads) {
+    if(n_bits < 1 || n_bits > max_hilbert_bits) {
+        auto msg = boost::format("Invalid number of bits per axis: %d, must be in [1, %d].")
+            % n_bits % max_hilbert_bits;
+        throw std::invalid_argument(msg.str());
+    }
+
+    auto float_max = std::numeric_limits<CoordType>::max();
+    auto float_min = std::numeric_limits<CoordType>::lowest();
+
+    auto n_chunks = detail::ordering_chunk_count(n_points, n_threads);
+    auto min_corners = std::vector<Point3Dx>(n_chunks, Point3Dx{float_max, float_max, float_max});
+    auto max_corners = std::vector<Point3Dx>(n_chunks, Point3Dx{float_min, float_min, float_min});
+
+    util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+        auto [low, high] = util::balanced_chunks(n_points, n_chunks, k);
+        for(size_t i = low; i < high; ++i) {
+            min_corners[k] = min(min_corners[k], points[i]);
+            max_corners[k] = max(max_corners[k], points[i]);
+        }
+    });
+
+    auto min_corner = min_corners[0];
+    auto max_corner = max_corners[0];
+    for(size_t k = 1; k < n_chunks; ++k) {
+        min_corner = min(min_corner, min_corners[k]);
+        max_corner = max(max_corner, max_corners[k]);
+    }
+
+    // If all points share a coordinate, that dimension is collapsed to `0`
+    // instead of dividing by zero.
+    auto box_size = max(max_corner - min_corner,
+                        Point3Dx{std::numeric_limits<CoordType>::min(),
+                                 std::numeric_limits<CoordType>::min(),
+                                 std::numeric_limits<CoordType>::min()});
+
+    auto normalize = [min_corner, box_size](const Point3D& xyz) {
+        return Point3D{
+            (xyz.get<0>() - min_corner.get<0>()) / box_size.get<0>(),
+            (xyz.get<1>() - min_corner.get<1>()) / box_size.get<1>(),
+            (xyz.get<2>() - min_corner.get<2>()) / box_size.get<2>()
+        };
+    };
+
+    auto keyed = std::vector<std::pair<std::uint64_t, size_t>>(n_points);
+    util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+        auto [low, high] = util::balanced_chunks(n_points, n_chunks, k);
+        for(size_t i = low; i < high; ++i) {
+            keyed[i] = {detail::hilbert_key(n_bits, normalize(points[i])), i};
+        }
+    });
+
+    detail::radix_sort_by_key(keyed, 3 * n_bits, n_threads);
+
+    auto order = std::vector<size_t>(n_points);
+    for(size_t i = 0; i < n_points; ++i) {
+        order[i] = keyed[i].second;
+    }
+
+    return order;
+}
+
+inline std::vector<size_t> space_filling_order(const std::vector<Point3Dx> & points,
+                                               int n_bits,
+                                               size_t n_threads) {
+    return space_filling_order(points.data(), points.size(), n_bits, n_threads);
+}
+
+}  // namespace experimental
+}  // namespace brain_indexer
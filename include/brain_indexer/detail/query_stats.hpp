@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+
+namespace brain_indexer {
+
+template <class Stats, class F>
+inline void for_each_query_stat(Stats& stats, F&& f) {
+    f("n_queries", stats.n_queries);
+    f("nodes_visited", stats.nodes_visited);
+    f("leaves_tested", stats.leaves_tested);
+    f("exact_tests", stats.exact_tests);
+    f("hits", stats.hits);
+    f("subtree_loads", stats.subtree_loads);
+    f("bytes_read", stats.bytes_read);
+    f("load_nanoseconds", stats.load_nanoseconds);
+}
+
+inline QueryStats& QueryStats::operator+=(const QueryStats& other) {
+    n_queries += other.n_queries;
+    nodes_visited += other.nodes_visited;
+    leaves_tested += other.leaves_tested;
+    exact_tests += other.exact_tests;
+    hits += other.hits;
+    subtree_loads += other.subtree_loads;
+    bytes_read += other.bytes_read;
+    load_nanoseconds += other.load_nanoseconds;
+
+    return *this;
+}
+
+
+inline QueryStatsRecorder::QueryStatsRecorder(QueryStats& stats) noexcept
+    : previous_(detail::thread_query_stats().recorder) {
+    detail::thread_query_stats().recorder = &stats;
+}
+
+inline QueryStatsRecorder::~QueryStatsRecorder() {
+    detail::thread_query_stats().recorder = previous_;
+}
+
+
+#if SI_MPI == 1
+inline QueryStats reduce_query_stats(const QueryStats& stats, MPI_Comm comm) {
+    auto counters = std::array<std::uint64_t, 8>{};
+    size_t k = 0;
+    for_each_query_stat(stats, [&counters, &k](const char*, std::uint64_t value) {
+        counters[k++] = value;
+    });
+
+    MPI_Allreduce(MPI_IN_PLACE, counters.data(), int(counters.size()), MPI_UINT64_T, MPI_SUM, comm);
+
+    auto total = QueryStats{};
+    k = 0;
+    for_each_query_stat(total, [&counters, &k](const char*, std::uint64_t& value) {
+        value = counters[k++];
+    });
+
+    return total;
+}
+#endif
+
+
+namespace detail {
+
+inline ThreadQueryStats& thread_query_stats() noexcept {
+    static thread_local ThreadQueryStats stats;
+    return stats;
+}
+
+
+inline QueryStatsTotal::QueryStatsTotal(const QueryStatsTotal& other)
+    : stats_(other.get()) {}
+
+inline QueryStatsTotal& QueryStatsTotal::operator=(const QueryStatsTotal& other) {
+    auto stats = other.get();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = stats;
+    return *this;
+}
+
+inline void QueryStatsTotal::add(const QueryStats& stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ += stats;
+}
+
+inline QueryStats QueryStatsTotal::get() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+inline void QueryStatsTotal::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = QueryStats{};
+}
+
+
+inline QueryStatsScope::QueryStatsScope(QueryStatsTotal& total, std::uint64_t n_queries) {
+    if constexpr (query_stats_enabled) {
+        auto& current = thread_query_stats();
+        if(current.query == nullptr) {
+            total_ = &total;
+            stats_.n_queries = n_queries;
+            current.query = &stats_;
+        }
+    }
+}
+
+inline QueryStatsScope::~QueryStatsScope() {
+    if(total_ == nullptr) {
+        return;
+    }
+
+    auto& current = thread_query_stats();
+    current.query = nullptr;
+
+    total_->add(stats_);
+    if(current.recorder != nullptr) {
+        *current.recorder += stats_;
+    }
+}
+
+
+template <class F>
+inline decltype(auto) with_query_stats(QueryStats& stats, F&& f) {
+    struct Restore {
+        ThreadQueryStats& current;
+        QueryStats* previous;
+
+        ~Restore() {
+            current.query = previous;
+        }
+    };
+
+    if constexpr (!query_stats_enabled) {
+        return f();
+    } else {
+        auto& current = thread_query_stats();
+        auto restore = Restore{current, current.query};
+
+        current.query = &stats;
+        return f();
+    }
+}
+
+inline void add_to_running_query(const QueryStats& stats) {
+    if constexpr (!query_stats_enabled) {
+        return;
+    }
+
+    if(auto* running = thread_query_stats().query) {
+        *running += stats;
+    }
+}
+
+
+template <class NBytes>
+inline void record_subtree_load(std::chrono::steady_clock::time_point start,
+                                const NBytes& n_bytes) {
+    if constexpr (query_stats_enabled) {
+        auto* stats = thread_query_stats().query;
+        if(stats == nullptr) {
+            return;
+        }
+
+        auto elapsed = std::chrono::steady_clock::now() - start;
+
+        stats->subtree_loads += 1;
+        stats->bytes_read += std::uint64_t(n_bytes());
+        stats->load_nanoseconds += std::uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()
+        );
+    }
+}
+
+}  // namespace detail
+}  // namespace brain_indexer
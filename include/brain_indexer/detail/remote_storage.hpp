@@ -0,0 +1,466 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <tuple>
+
+#include <unistd.h>
+
+#include <boost/interprocess/streams/bufferstream.hpp>
+
+#if SI_CURL == 1
+#include <curl/curl.h>
+#endif
+
+#include <brain_indexer/logging.hpp>
+
+namespace brain_indexer {
+
+inline FileObjectStore::FileObjectStore(std::string root_dir)
+    : root_dir(std::move(root_dir)) {}
+
+
+inline std::optional<std::string> FileObjectStore::read(const std::string& key) const {
+    auto filename = (std::filesystem::path(root_dir) / key).string();
+    if(!std::filesystem::exists(filename)) {
+        return std::nullopt;
+    }
+
+    return read_range(key, 0, std::filesystem::file_size(filename));
+}
+
+
+inline std::string FileObjectStore::read_range(const std::string& key,
+                                               size_t offset,
+                                               size_t n_bytes) const {
+    auto filename = (std::filesystem::path(root_dir) / key).string();
+    auto ifs = util::open_ifstream(filename, std::ios::binary);
+
+    auto bytes = std::string(n_bytes, '\0');
+    ifs.seekg(std::streamoff(offset));
+    ifs.read(bytes.data(), std::streamsize(n_bytes));
+    if(!ifs || size_t(ifs.gcount()) != n_bytes) {
+        auto msg = boost::format("Failed to read %d bytes at %d from: %s")
+            % n_bytes % offset % filename;
+        throw std::runtime_error(msg.str());
+    }
+
+    return bytes;
+}
+
+
+inline std::string FileObjectStore::identity() const {
+    return std::filesystem::weakly_canonical(root_dir).string();
+}
+
+
+#if SI_CURL == 1
+namespace detail {
+
+inline size_t append_to_string(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    static_cast<std::string*>(userdata)->append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+}  // namespace detail
+
+
+inline HttpObjectStore::HttpObjectStore(std::string base_url,
+                                        std::vector<std::string> headers,
+                                        size_t max_retries)
+    : base_url(std::move(base_url))
+    , headers(std::move(headers))
+    , max_retries(max_retries) {
+
+    static std::once_flag is_initialized;
+    std::call_once(is_initialized, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    while(!this->base_url.empty() && this->base_url.back() == '/') {
+        this->base_url.pop_back();
+    }
+}
+
+
+inline std::pair<long, std::string> HttpObjectStore::get(const std::string& key,
+                                                         const std::string& range) const {
+    auto url = base_url + "/" + key;
+    auto error = std::string{};
+
+    for(size_t attempt = 0; attempt <= max_retries; ++attempt) {
+        if(attempt > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100 << (attempt - 1)));
+        }
+
+        auto curl = std::unique_ptr<CURL, decltype(&curl_easy_cleanup)>(
+            curl_easy_init(), &curl_easy_cleanup
+        );
+        if(curl == nullptr) {
+            throw std::runtime_error("Failed to create a curl handle.");
+        }
+
+        auto header_list = std::unique_ptr<curl_slist, decltype(&curl_slist_free_all)>(
+            nullptr, &curl_slist_free_all
+        );
+        for(const auto& header : headers) {
+            header_list.reset(curl_slist_append(header_list.release(), header.c_str()));
+        }
+
+        auto body = std::string{};
+        curl_easy_setopt(curl.get(), CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl.get(), CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(curl.get(), CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl.get(), CURLOPT_HTTPHEADER, header_list.get());
+        curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, &detail::append_to_string);
+        curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &body);
+        if(!range.empty()) {
+            curl_easy_setopt(curl.get(), CURLOPT_RANGE, range.c_str());
+        }
+
+        auto code = curl_easy_perform(curl.get());
+        long status = 0;
+        curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &status);
+
+        // Server errors and throttling are transient.
+        if(code == CURLE_OK && status < 500 && status != 429) {
+            return {status, std::move(body)};
+        }
+
+        error = (code != CURLE_OK) ? std::string(curl_easy_strerror(code))
+                                   : "HTTP status " + std::to_string(status);
+        log_warn("Retrying GET %s: %s", url, error);
+    }
+
+    auto msg = boost::format("Failed to GET %s: %s") % url % error;
+    throw std::runtime_error(msg.str());
+}
+
+
+inline std::string HttpObjectStore::identity() const {
+    return base_url;
+}
+
+
+inline std::optional<std::string> HttpObjectStore::read(const std::string& key) const {
+    auto [status, body] = get(key, "");
+    if(status == 404) {
+        return std::nullopt;
+    }
+
+    if(status != 200) {
+        auto msg = boost::format("Failed to GET %s/%s: HTTP status %d") % base_url % key % status;
+        throw std::runtime_error(msg.str());
+    }
+
+    return std::move(body);
+}
+
+
+inline std::string HttpObjectStore::read_range(const std::string& key,
+                                               size_t offset,
+                                               size_t n_bytes) const {
+    if(n_bytes == 0) {
+        return std::string{};
+    }
+
+    auto range = std::to_string(offset) + "-" + std::to_string(offset + n_bytes - 1);
+    auto [status, body] = get(key, range);
+
+    // A server which ignores the range sends the whole object.
+    if(status == 200 && body.size() >= offset + n_bytes) {
+        body = body.substr(offset, n_bytes);
+    } else if(status != 206) {
+        auto msg = boost::format("Failed to GET bytes %s of %s/%s: HTTP status %d")
+            % range % base_url % key % status;
+        throw std::runtime_error(msg.str());
+    }
+
+    if(body.size() != n_bytes) {
+        auto msg = boost::format("Expected %d bytes of %s/%s, got: %d")
+            % n_bytes % base_url % key % body.size();
+        throw std::runtime_error(msg.str());
+    }
+
+    return std::move(body);
+}
+#endif
+
+
+namespace detail {
+
+inline std::uint64_t fnv1a_hash(const std::string& bytes, std::uint64_t hash) {
+    for(auto c : bytes) {
+        hash ^= std::uint64_t(static_cast<unsigned char>(c));
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+inline SubtreeDiskCache::SubtreeDiskCache(std::string cache_dir, size_t max_cached_bytes)
+    : cache_dir(std::move(cache_dir))
+    , max_cached_bytes(max_cached_bytes) {
+
+    std::filesystem::create_directories(this->cache_dir);
+
+    // Adopt the files of earlier processes; the last written is the most recently used.
+    auto found = std::vector<std::tuple<std::filesystem::file_time_type, std::uint64_t, size_t>>{};
+    auto prefix = std::string("subtree-");
+    for(const auto& entry : std::filesystem::directory_iterator(this->cache_dir)) {
+        auto basename = entry.path().filename().string();
+        if(basename.compare(0, prefix.size(), prefix) != 0 || entry.path().extension() != ".bin") {
+            continue;
+        }
+
+        auto key = entry.path().stem().string().substr(prefix.size());
+        if(key.empty() || key.size() > 20 || !std::all_of(key.begin(), key.end(), ::isdigit)) {
+            continue;
+        }
+
+        found.emplace_back(entry.last_write_time(), std::stoull(key), entry.file_size());
+    }
+    std::sort(found.begin(), found.end());
+
+    for(const auto& [time, key, n_bytes] : found) {
+        std::ignore = time;
+        touch(key, n_bytes);
+    }
+
+    auto lock = std::lock_guard<std::mutex>(mutex);
+    while(n_cached_bytes > this->max_cached_bytes) {
+        evict_least_recently_used();
+    }
+}
+
+
+inline void SubtreeDiskCache::evict_least_recently_used() {
+    auto key = lru.back();
+    n_cached_bytes -= entries.at(key).second;
+    entries.erase(key);
+    lru.pop_back();
+
+    auto ec = std::error_code{};
+    std::filesystem::remove(filename(key), ec);
+}
+
+
+inline std::string SubtreeDiskCache::filename(std::uint64_t object_key) const {
+    auto basename = std::string("subtree-") + std::to_string(object_key) + ".bin";
+    return (std::filesystem::path(cache_dir) / basename).string();
+}
+
+
+inline void SubtreeDiskCache::touch(std::uint64_t object_key, size_t n_bytes) {
+    auto lock = std::lock_guard<std::mutex>(mutex);
+
+    auto it = entries.find(object_key);
+    if(it != entries.end()) {
+        n_cached_bytes -= it->second.second;
+        lru.erase(it->second.first);
+        entries.erase(it);
+    }
+
+    lru.push_front(object_key);
+    entries.emplace(object_key, std::make_pair(lru.begin(), n_bytes));
+    n_cached_bytes += n_bytes;
+}
+
+
+inline std::optional<std::string> SubtreeDiskCache::find(std::uint64_t object_key,
+                                                         size_t n_bytes) {
+    // Another process may have written the file; or removed it.
+    auto ifs = std::ifstream(filename(object_key), std::ios::binary);
+    if(!ifs) {
+        return std::nullopt;
+    }
+
+    auto bytes = std::string(n_bytes, '\0');
+    ifs.read(bytes.data(), std::streamsize(n_bytes));
+    if(!ifs || size_t(ifs.gcount()) != n_bytes || ifs.peek() != std::ifstream::traits_type::eof()) {
+        return std::nullopt;
+    }
+
+    touch(object_key, n_bytes);
+    return bytes;
+}
+
+
+inline void SubtreeDiskCache::insert(std::uint64_t object_key, const std::string& bytes) {
+    if(bytes.size() > max_cached_bytes) {
+        return;
+    }
+
+    auto target = filename(object_key);
+    auto tmp = target + ".tmp-" + std::to_string(::getpid()) + "-"
+        + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    auto ofs = std::ofstream(tmp, std::ios::binary | std::ios::trunc);
+    ofs.write(bytes.data(), std::streamsize(bytes.size()));
+    ofs.close();
+
+    auto ec = std::error_code{};
+    if(ofs) {
+        std::filesystem::rename(tmp, target, ec);
+    }
+
+    if(!ofs || ec) {
+        log_warn("Failed to cache object %d in: %s", object_key, cache_dir);
+        std::filesystem::remove(tmp, ec);
+        return;
+    }
+
+    touch(object_key, bytes.size());
+
+    auto lock = std::lock_guard<std::mutex>(mutex);
+    while(n_cached_bytes > max_cached_bytes && lru.back() != object_key) {
+        evict_least_recently_used();
+    }
+}
+
+
+inline size_t SubtreeDiskCache::cached_bytes() const {
+    auto lock = std::lock_guard<std::mutex>(mutex);
+    return n_cached_bytes;
+}
+
+}  // namespace detail
+
+
+template <class TopTree, class SubTree, class ObjectStore>
+inline RemoteContainerStorage<TopTree, SubTree, ObjectStore>::RemoteContainerStorage(
+    ObjectStore store,
+    const RemoteStorageParams& params)
+    : store(std::make_shared<ObjectStore>(std::move(store))) {
+
+    if(!params.cache_dir.empty()) {
+        disk_cache = std::make_shared<detail::SubtreeDiskCache>(params.cache_dir,
+                                                                params.max_cached_bytes);
+    }
+}
+
+
+template <class TopTree, class SubTree, class ObjectStore>
+inline void RemoteContainerStorage<TopTree, SubTree, ObjectStore>::open_reader() const {
+    std::call_once(reader->is_opened, [this]() {
+        auto index_version = detail::fnv1a_hash(store->identity());
+
+        // Later writers supersede earlier ones, hence they're read last.
+        for(size_t id = 0; ; ++id) {
+            auto offsets_key = ContainerFilenames::offsets("", id);
+            auto table = store->read(offsets_key);
+            if(!table) {
+                break;
+            }
+            index_version = detail::fnv1a_hash(*table, index_version);
+
+            if(table->size() % sizeof(detail::ContainerRecord) != 0) {
+                auto msg = boost::format("Invalid offset table: %s") % offsets_key;
+                throw std::runtime_error(msg.str());
+            }
+
+            auto records = std::vector<detail::ContainerRecord>(
+                table->size() / sizeof(detail::ContainerRecord)
+            );
+            std::copy(table->begin(), table->end(), reinterpret_cast<char*>(records.data()));
+
+            for(const auto& record : records) {
+                reader->locations[record.subtree_id] = detail::ContainerReader::Location{
+                    id, record.offset, record.n_bytes
+                };
+            }
+        }
+
+        // A rewritten index has different offset tables or a different top-level tree.
+        if(auto top_tree = store->read(ContainerFilenames::top_tree(""))) {
+            index_version = detail::fnv1a_hash(*top_tree, index_version);
+        }
+        reader->index_version = index_version;
+    });
+}
+
+
+template <class TopTree, class SubTree, class ObjectStore>
+inline std::uint64_t RemoteContainerStorage<TopTree, SubTree, ObjectStore>::object_key(
+    const detail::ContainerReader::Location& location) const {
+
+    auto object = ContainerFilenames::data("", location.writer_id)
+        + ":" + std::to_string(location.offset)
+        + ":" + std::to_string(location.n_bytes);
+
+    return detail::fnv1a_hash(object, reader->index_version);
+}
+
+
+template <class TopTree, class SubTree, class ObjectStore>
+inline std::string RemoteContainerStorage<TopTree, SubTree, ObjectStore>::read_subtree(
+    const detail::ContainerReader::Location& location) const {
+
+    auto key = object_key(location);
+    if(disk_cache != nullptr) {
+        if(auto bytes = disk_cache->find(key, location.n_bytes)) {
+            return std::move(*bytes);
+        }
+    }
+
+    auto bytes = store->read_range(ContainerFilenames::data("", location.writer_id),
+                                   location.offset,
+                                   location.n_bytes);
+
+    if(disk_cache != nullptr) {
+        disk_cache->insert(key, bytes);
+    }
+
+    return bytes;
+}
+
+
+template <class TopTree, class SubTree, class ObjectStore>
+inline SubTree
+RemoteContainerStorage<TopTree, SubTree, ObjectStore>::load_subtree(size_t subtree_id) const {
+    auto start = std::chrono::steady_clock::now();
+    open_reader();
+
+    auto it = reader->locations.find(subtree_id);
+    if(it == reader->locations.end()) {
+        auto msg = boost::format("Subtree %d isn't stored in any container.") % subtree_id;
+        throw std::runtime_error(msg.str());
+    }
+
+    const auto& location = it->second;
+    auto bytes = read_subtree(location);
+
+    auto subtree = SubTree{};
+    {
+        auto is = boost::interprocess::ibufferstream(bytes.data(), bytes.size());
+        load_rtree(subtree, static_cast<std::istream&>(is));
+    }
+    util::check_signals();
+
+    detail::record_subtree_load(start, [&location]() { return location.n_bytes; });
+    return subtree;
+}
+
+
+template <class TopTree, class SubTree, class ObjectStore>
+inline TopTree RemoteContainerStorage<TopTree, SubTree, ObjectStore>::load_top_tree() const {
+    auto key = ContainerFilenames::top_tree("");
+    auto bytes = store->read(key);
+    if(!bytes) {
+        auto msg = boost::format("No top-level tree found: %s") % key;
+        throw std::runtime_error(msg.str());
+    }
+
+    auto tree = TopTree{};
+    auto is = boost::interprocess::ibufferstream(bytes->data(), bytes->size());
+    load_compressed_rtree(tree, static_cast<std::istream&>(is));
+
+    return tree;
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/detail/tree_nodes.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+/** \brief Where the segment `p1 + t * dir`, with `0 <= t <= 1`, enters `box`.
+ *
+ *  This is the slab test: the segment is clipped to the slab between the two
+ *  faces of the box orthogonal to each axis. If `p1` is inside `box`, the
+ *  segment enters at `t = 0`.
+ *
+ *  \returns false if the segment misses `box`.
+ */
+inline bool segment_entry(const Point3D& p1,
+                          const Point3D& dir,
+                          const Box3D& box,
+                          CoordType& t_entry) {
+    auto origin = coordinates(p1);
+    auto direction = coordinates(dir);
+    auto low = coordinates(box.min_corner());
+    auto high = coordinates(box.max_corner());
+
+    auto t_min = CoordType(0);
+    auto t_max = CoordType(1);
+    for(size_t d = 0; d < 3; ++d) {
+        if(direction[d] == 0) {
+            if(origin[d] < low[d] || origin[d] > high[d]) {
+                return false;
+            }
+            continue;
+        }
+
+        auto t_low = (low[d] - origin[d]) / direction[d];
+        auto t_high = (high[d] - origin[d]) / direction[d];
+        if(t_low > t_high) {
+            std::swap(t_low, t_high);
+        }
+
+        t_min = std::max(t_min, t_low);
+        t_max = std::min(t_max, t_high);
+        if(t_min > t_max) {
+            return false;
+        }
+    }
+
+    t_entry = t_min;
+    return true;
+}
+
+
+/** \brief The first `max_hits` elements of one tree hit by `segment`, see `find_along_segment`.
+ *
+ *  The tree is traversed best-first: the nodes entered by the segment and
+ *  the hits found in the leaves are kept in two heaps, ordered by `t`. A
+ *  hit is final once no node left is entered before it. The hits are
+ *  appended to `hits` in order.
+ */
+template <class GeometryMode, class Nodes>
+inline void find_along_segment_tree(const Nodes& nodes,
+                                    const Cylinder& segment,
+                                    size_t max_hits,
+                                    std::vector<SegmentHit<typename Nodes::value_type>>& hits) {
+    using node_type = typename Nodes::node_type;
+    using value_type = typename Nodes::value_type;
+    using hit_type = SegmentHit<value_type>;
+
+    struct node_entry {
+        CoordType t;
+        node_type node;
+    };
+
+    if(max_hits == 0 || nodes.empty()) {
+        return;
+    }
+
+    auto dir = Point3Dx(segment.p2) - segment.p1;
+    auto enters = [&segment, &dir](const Box3D& box, CoordType& t) {
+        auto inflated = Box3D{Point3Dx(box.min_corner()) - segment.radius,
+                              Point3Dx(box.max_corner()) + segment.radius};
+        return segment_entry(segment.p1, dir, inflated, t);
+    };
+    auto is_hit = GeometryIntersects<GeometryMode, Cylinder>{segment};
+
+    // Both are min-heaps by `t`.
+    auto is_later = [](const auto& a, const auto& b) {
+        return a.t > b.t;
+    };
+    auto to_visit = std::vector<node_entry>{};
+    auto found = std::vector<hit_type>{};
+
+    auto t = CoordType(0);
+    if(enters(nodes.bounds(), t)) {
+        to_visit.push_back(node_entry{t, nodes.root()});
+    }
+
+    size_t n_hits = 0;
+    while(n_hits < max_hits && !(to_visit.empty() && found.empty())) {
+        if(!found.empty() && (to_visit.empty() || found.front().t <= to_visit.front().t)) {
+            std::pop_heap(found.begin(), found.end(), is_later);
+            hits.push_back(std::move(found.back()));
+            found.pop_back();
+            ++n_hits;
+            continue;
+        }
+
+        std::pop_heap(to_visit.begin(), to_visit.end(), is_later);
+        auto node = to_visit.back().node;
+        to_visit.pop_back();
+
+        if(nodes.is_leaf(node)) {
+            nodes.for_each_value(node, [&](const value_type& value) {
+                if(enters(Box3D(bgi::indexable<value_type>{}(value)), t) && is_hit(value)) {
+                    found.push_back(hit_type{t, value});
+                    std::push_heap(found.begin(), found.end(), is_later);
+                }
+            });
+        } else {
+            nodes.for_each_child(node, [&](const Box3D& box, const node_type& child) {
+                if(enters(box, t)) {
+                    to_visit.push_back(node_entry{t, child});
+                    std::push_heap(to_visit.begin(), to_visit.end(), is_later);
+                }
+            });
+        }
+    }
+}
+
+
+/// \brief `find_along_segment` of a multi-index.
+struct MultiIndexSegmentQuery {
+    /** \brief Visits the subtrees in the order in which the segment enters them.
+     *
+     *  The hits of a subtree are final once the segment enters the next
+     *  subtree after them. Hence, the subtrees which come after the first
+     *  `max_hits` hits are never loaded.
+     */
+    template <class GeometryMode, class T, class SubtreeCache>
+    static inline std::vector<SegmentHit<T>>
+    find(const MultiIndexTree<T, SubtreeCache>& index, const Cylinder& segment, size_t max_hits) {
+        using subtree_id_type = typename MultiIndexTree<T, SubtreeCache>::toptree_type::value_type;
+
+        auto dir = Point3Dx(segment.p2) - segment.p1;
+        auto subtrees = std::vector<std::pair<CoordType, subtree_id_type>>{};
+        for(const auto& subtree : index.top_rtree) {
+            const auto& box = subtree.bounding_box();
+            auto inflated = Box3D{Point3Dx(box.min_corner()) - segment.radius,
+                                  Point3Dx(box.max_corner()) + segment.radius};
+
+            auto t = CoordType(0);
+            if(segment_entry(segment.p1, dir, inflated, t)) {
+                subtrees.emplace_back(t, subtree);
+            }
+        }
+        std::stable_sort(subtrees.begin(), subtrees.end(), [](const auto& a, const auto& b) {
+            return a.first < b.first;
+        });
+
+        auto is_later = [](const SegmentHit<T>& a, const SegmentHit<T>& b) {
+            return a.t > b.t;
+        };
+
+        auto hits = std::vector<SegmentHit<T>>{};
+        auto pending = std::vector<SegmentHit<T>>{};
+        auto flush_until = [&](CoordType t_max) {
+            while(hits.size() < max_hits && !pending.empty() && pending.front().t <= t_max) {
+                std::pop_heap(pending.begin(), pending.end(), is_later);
+                hits.push_back(std::move(pending.back()));
+                pending.pop_back();
+            }
+        };
+
+        for(const auto& [t_entry, subtree_id] : subtrees) {
+            flush_until(t_entry);
+            if(hits.size() >= max_hits) {
+                break;
+            }
+
+            util::check_signals();
+
+            auto n_before = pending.size();
+            const auto& subtree = index.load_subtree(subtree_id);
+            find_along_segment_tree<GeometryMode>(make_tree_nodes(deref_subtree(subtree)),
+                                                  segment,
+                                                  max_hits - hits.size(),
+                                                  pending);
+            for(auto k = n_before + 1; k <= pending.size(); ++k) {
+                std::push_heap(pending.begin(), pending.begin() + long(k), is_later);
+            }
+        }
+        flush_until(std::numeric_limits<CoordType>::max());
+
+        ++index.query_count;
+        return hits;
+    }
+};
+
+
+template <class GeometryMode, class Index>
+inline std::vector<SegmentHit<typename Index::value_type>>
+find_along_segment_impl(const Index& index, const Cylinder& segment, size_t max_hits) {
+    auto hits = std::vector<SegmentHit<typename Index::value_type>>{};
+    find_along_segment_tree<GeometryMode>(make_tree_nodes(index), segment, max_hits, hits);
+    return hits;
+}
+
+template <class GeometryMode, class T, class SubtreeCache>
+inline std::vector<SegmentHit<T>>
+find_along_segment_impl(const MultiIndexTree<T, SubtreeCache>& index,
+                        const Cylinder& segment,
+                        size_t max_hits) {
+    return MultiIndexSegmentQuery::find<GeometryMode>(index, segment, max_hits);
+}
+
+}  // namespace detail
+
+
+template <class GeometryMode, class Index>
+inline std::vector<SegmentHit<typename Index::value_type>>
+find_along_segment(const Index& index,
+                   const Point3D& p1,
+                   const Point3D& p2,
+                   CoordType radius,
+                   size_t max_hits) {
+    return detail::find_along_segment_impl<GeometryMode>(index, Cylinder{p1, p2, radius}, max_hits);
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#include <boost/format.hpp>
+
+namespace brain_indexer {
+
+#if SI_HDF5 == 1
+
+namespace detail {
+
+inline Hdf5Handle::Hdf5Handle(hid_t id, herr_t (*close)(hid_t)) noexcept
+    : id_(id)
+    , close_(close) {}
+
+inline Hdf5Handle::Hdf5Handle(Hdf5Handle&& other) noexcept
+    : id_(other.id_)
+    , close_(other.close_) {
+    other.id_ = -1;
+}
+
+inline Hdf5Handle& Hdf5Handle::operator=(Hdf5Handle&& other) noexcept {
+    std::swap(id_, other.id_);
+    std::swap(close_, other.close_);
+    return *this;
+}
+
+inline Hdf5Handle::~Hdf5Handle() {
+    if(id_ >= 0 && close_ != nullptr) {
+        close_(id_);
+    }
+}
+
+template <class T>
+inline hid_t hdf5_native_type() {
+    if constexpr (std::is_same<T, float>::value) {
+        return H5T_NATIVE_FLOAT;
+    } else if constexpr (std::is_same<T, double>::value) {
+        return H5T_NATIVE_DOUBLE;
+    } else {
+        static_assert(std::is_same<T, unsigned long>::value, "Unsupported type.");
+        return H5T_NATIVE_ULONG;
+    }
+}
+
+inline Hdf5Handle open_edge_dataset(hid_t file, const std::string& path) {
+    // Missing datasets are reported by the exception, not the HDF5 error stack.
+    hid_t id = -1;
+    H5E_BEGIN_TRY {
+        id = H5Dopen2(file, path.c_str(), H5P_DEFAULT);
+    } H5E_END_TRY;
+
+    auto dataset = Hdf5Handle(id, H5Dclose);
+    if(dataset < 0) {
+        throw std::runtime_error("Can't open the SONATA dataset: " + path);
+    }
+
+    return dataset;
+}
+
+inline size_t edge_dataset_size(hid_t dataset) {
+    auto space = Hdf5Handle(H5Dget_space(dataset), H5Sclose);
+    if(space < 0 || H5Sget_simple_extent_ndims(space) != 1) {
+        throw std::runtime_error("SONATA edge datasets must be one-dimensional.");
+    }
+
+    hsize_t size = 0;
+    H5Sget_simple_extent_dims(space, &size, nullptr);
+    return size;
+}
+
+} // namespace detail
+
+
+inline SonataEdgeReader::SonataEdgeReader(const std::string& filename,
+                                          const std::string& population) {
+    hid_t file_id = -1;
+    H5E_BEGIN_TRY {
+        file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    } H5E_END_TRY;
+
+    file_ = detail::Hdf5Handle(file_id, H5Fclose);
+    if(file_ < 0) {
+        throw std::runtime_error("Can't open the SONATA edge file: " + filename);
+    }
+
+    const auto prefix = "/edges/" + population + "/";
+    source_ids_ = detail::open_edge_dataset(file_, prefix + "source_node_id");
+    target_ids_ = detail::open_edge_dataset(file_, prefix + "target_node_id");
+
+    const char* axes[3] = {"x", "y", "z"};
+    for(size_t k = 0; k < 3; ++k) {
+        centers_[k] = detail::open_edge_dataset(file_, prefix + "0/afferent_center_" + axes[k]);
+    }
+
+    n_edges_ = detail::edge_dataset_size(source_ids_);
+    for(hid_t dataset : {hid_t(target_ids_), hid_t(centers_[0]), hid_t(centers_[1]),
+                         hid_t(centers_[2])}) {
+        if(detail::edge_dataset_size(dataset) != n_edges_) {
+            throw std::runtime_error("The SONATA edge datasets differ in size.");
+        }
+    }
+}
+
+inline size_t SonataEdgeReader::size() const noexcept {
+    return n_edges_;
+}
+
+inline void SonataEdgeReader::check_range(size_t low, size_t high) const {
+    if(low > high || high > n_edges_) {
+        throw std::out_of_range(boost::str(
+            boost::format("Invalid range of edges [%d, %d) for %d edges.") % low % high % n_edges_
+        ));
+    }
+}
+
+inline void SonataEdgeReader::check_block_size(size_t block_size) {
+    if(block_size == 0) {
+        throw std::invalid_argument("The block size must be positive.");
+    }
+}
+
+template <class T>
+inline void SonataEdgeReader::read_block(hid_t dataset,
+                                         size_t offset,
+                                         size_t count,
+                                         T* buffer) const {
+    hsize_t start = offset;
+    hsize_t n = count;
+
+    auto file_space = detail::Hdf5Handle(H5Dget_space(dataset), H5Sclose);
+    auto mem_space = detail::Hdf5Handle(H5Screate_simple(1, &n, nullptr), H5Sclose);
+    if(file_space < 0 || mem_space < 0
+       || H5Sselect_hyperslab(file_space, H5S_SELECT_SET, &start, nullptr, &n, nullptr) < 0
+       || H5Dread(dataset, detail::hdf5_native_type<T>(), mem_space, file_space,
+                  H5P_DEFAULT, buffer) < 0) {
+        throw std::runtime_error(boost::str(
+            boost::format("Failed to read the SONATA edges [%d, %d).") % offset % (offset + count)
+        ));
+    }
+}
+
+template <class OutputIt>
+inline void SonataEdgeReader::read(const std::vector<std::pair<size_t, size_t>>& ranges,
+                                   OutputIt it,
+                                   size_t block_size) const {
+    check_block_size(block_size);
+
+    std::vector<identifier_t> source_ids, target_ids;
+    std::vector<CoordType> centers[3];
+
+    for(const auto& [low, high] : ranges) {
+        check_range(low, high);
+
+        for(size_t offset = low; offset < high; offset += block_size) {
+            const auto count = std::min(block_size, high - offset);
+
+            source_ids.resize(count);
+            target_ids.resize(count);
+            read_block(source_ids_, offset, count, source_ids.data());
+            read_block(target_ids_, offset, count, target_ids.data());
+            for(size_t k = 0; k < 3; ++k) {
+                centers[k].resize(count);
+                read_block(centers_[k], offset, count, centers[k].data());
+            }
+
+            for(size_t i = 0; i < count; ++i) {
+                *it = Synapse{identifier_t(offset + i), target_ids[i], source_ids[i],
+                              Point3D{centers[0][i], centers[1][i], centers[2][i]}};
+                ++it;
+            }
+        }
+    }
+}
+
+template <class Index>
+inline void SonataEdgeReader::insert_into(Index& index,
+                                          const std::vector<std::pair<size_t, size_t>>& ranges,
+                                          size_t block_size) const {
+    check_block_size(block_size);
+
+    std::vector<Synapse> synapses;
+    for(const auto& [low, high] : ranges) {
+        check_range(low, high);
+
+        for(size_t offset = low; offset < high; offset += block_size) {
+            const auto count = std::min(block_size, high - offset);
+
+            synapses.clear();
+            read({{offset, offset + count}}, std::back_inserter(synapses), block_size);
+            index.insert(synapses.begin(), synapses.end());
+        }
+    }
+}
+
+#endif
+
+} // namespace brain_indexer
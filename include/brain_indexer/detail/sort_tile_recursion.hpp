@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <iterator>
+
 #include <brain_indexer/util.hpp>
 
 namespace brain_indexer {
@@ -91,6 +94,160 @@ void SerialSortTileRecursion<Value, GetCoordinate, dim>::apply(std::vector<Value
 }
 
 
+namespace detail {
+
+/// \brief Ranges shorter than this are sorted by a single thread.
+constexpr size_t min_parallel_sort_size = 1 << 15;
+
+/** \brief Sort `[first, last)` using `n_threads` threads.
+ *
+ *  Every thread sorts a chunk, then pairs of sorted runs are merged until
+ *  only one is left. Each merge is split into independent pieces, by cutting
+ *  the first run evenly and searching the cuts in the second run.
+ */
+template <class Value, class Compare>
+inline void parallel_sort(Value* first, Value* last, const Compare& compare, size_t n_threads) {
+    auto n_values = size_t(last - first);
+    auto n_chunks = std::min(n_threads, n_values / min_parallel_sort_size);
+    if(n_chunks <= 1) {
+        std::sort(first, last, compare);
+        return;
+    }
+
+    auto boundaries = std::vector<size_t>(n_chunks + 1);
+    for(size_t k = 0; k < n_chunks; ++k) {
+        boundaries[k + 1] = util::balanced_chunks(n_values, n_chunks, k).high;
+    }
+
+    util::parallel_for(n_chunks, n_threads, [&](size_t k) {
+        std::sort(first + boundaries[k], first + boundaries[k + 1], compare);
+    });
+
+    auto buffer = std::vector<Value>(std::make_move_iterator(first),
+                                     std::make_move_iterator(last));
+    auto src = buffer.data();
+    auto dst = first;
+
+    // The chunks were sorted in place; hence the first round merges from
+    // `buffer` into `[first, last)`.
+    while(boundaries.size() > 2) {
+        auto n_runs = boundaries.size() - 1;
+        auto n_merges = (n_runs + 1) / 2;
+        auto n_pieces = std::max<size_t>(1, n_threads / n_merges);
+
+        util::parallel_for(n_merges * n_pieces, n_threads, [&](size_t task) {
+            auto k = task / n_pieces;
+            auto piece = task % n_pieces;
+
+            auto a_first = src + boundaries[2 * k];
+            auto b_first = src + boundaries[std::min(2 * k + 1, n_runs)];
+            auto b_last = src + boundaries[std::min(2 * k + 2, n_runs)];
+            auto n_a = size_t(b_first - a_first);
+
+            auto cut = [&](size_t i) {
+                if(i == 0) {
+                    return b_first;
+                }
+                if(i == n_a) {
+                    return b_last;
+                }
+
+                // Equal elements of the second run are merged after those
+                // of the first.
+                return std::lower_bound(b_first, b_last, a_first[i], compare);
+            };
+
+            auto [low, high] = util::balanced_chunks(n_a, n_pieces, piece);
+            auto b_low = cut(low);
+            auto b_high = cut(high);
+
+            std::merge(std::make_move_iterator(a_first + low),
+                       std::make_move_iterator(a_first + high),
+                       std::make_move_iterator(b_low),
+                       std::make_move_iterator(b_high),
+                       dst + (a_first - src) + low + (b_low - b_first),
+                       compare);
+        });
+
+        auto merged_boundaries = std::vector<size_t>{};
+        for(size_t k = 0; k < n_runs; k += 2) {
+            merged_boundaries.push_back(boundaries[k]);
+        }
+        merged_boundaries.push_back(boundaries.back());
+
+        boundaries = std::move(merged_boundaries);
+        std::swap(src, dst);
+    }
+
+    if(src != first) {
+        std::move(src, src + n_values, first);
+    }
+}
+
+
+/// \brief Sort every range in `ranges` along `dim`, then recurse into its slabs.
+template <class Value, typename GetCoordinate, size_t dim>
+inline void parallel_sort_tile_recursion(std::vector<Value>& values,
+                                         const std::vector<util::Range>& ranges,
+                                         const SerialSTRParams& str_params,
+                                         size_t n_threads) {
+    if constexpr(dim < 3) {
+        using Key = STRKey<GetCoordinate, dim>;
+        auto compare = [](const Value& a, const Value& b) {
+            return Key::compare(a, b);
+        };
+
+        // Only the calling thread may check for signals.
+        util::check_signals();
+
+        auto n_ranges = ranges.size();
+        auto n_threads_per_range = std::max<size_t>(1, n_threads / n_ranges);
+        util::parallel_for(n_ranges, n_threads, [&](size_t k) {
+            parallel_sort(values.data() + ranges[k].low,
+                          values.data() + ranges[k].high,
+                          compare,
+                          n_threads_per_range);
+        });
+
+        // The same slabs as `SerialSortTileRecursion`.
+        auto n_parts = str_params.n_parts_per_dim[dim];
+        auto slabs = std::vector<util::Range>{};
+        slabs.reserve(n_ranges * n_parts);
+        for(const auto& [values_begin, values_end] : ranges) {
+            for(size_t i = 0; i < n_parts; ++i) {
+                auto range = util::balanced_chunks(values_end - values_begin, n_parts, i);
+
+                slabs.push_back({std::min(values_begin + range.low, values_end),
+                                 std::min(values_begin + range.high, values_end)});
+            }
+        }
+
+        parallel_sort_tile_recursion<Value, GetCoordinate, dim + 1>(
+            values, slabs, str_params, n_threads
+        );
+    }
+}
+
+}  // namespace detail
+
+
+template <size_t dim, typename Value>
+inline CoordType get_centroid_coordinate(const Value& value) {
+    return value.template get_centroid_coord<dim>();
+}
+
+
+template<size_t dim, typename... VariantArgs>
+inline CoordType get_centroid_coordinate(boost::variant<VariantArgs...> const& value) {
+    return boost::apply_visitor(
+        [](const auto& value) {
+            return value.template get_centroid_coord<dim>();
+        },
+        value
+    );
+}
+
+
 template <typename Value, typename GetCoordinate>
 void serial_sort_tile_recursion(std::vector<Value>& values, const SerialSTRParams& str_params) {
 
@@ -98,4 +255,15 @@ void serial_sort_tile_recursion(std::vector<Value>& values, const SerialSTRParam
     STR::apply(values, 0ul, values.size(), str_params);
 }
 
+template <typename Value, typename GetCoordinate>
+void parallel_sort_tile_recursion(std::vector<Value>& values,
+                                  const SerialSTRParams& str_params,
+                                  size_t n_threads) {
+
+    auto ranges = std::vector<util::Range>{{0ul, values.size()}};
+    detail::parallel_sort_tile_recursion<Value, GetCoordinate, 0ul>(
+        values, ranges, str_params, n_threads
+    );
+}
+
 }
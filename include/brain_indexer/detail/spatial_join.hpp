@@ -0,0 +1,651 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <brain_indexer/detail/tree_nodes.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+/// \brief The square of the distance between two boxes, `0` if they intersect.
+inline CoordType square_box_distance(const Box3D& a, const Box3D& b) {
+    auto gap = [](CoordType a_min, CoordType a_max, CoordType b_min, CoordType b_max) {
+        return std::max(CoordType(0), std::max(a_min - b_max, b_min - a_max));
+    };
+
+    auto dx = gap(a.min_corner().get<0>(), a.max_corner().get<0>(),
+                  b.min_corner().get<0>(), b.max_corner().get<0>());
+    auto dy = gap(a.min_corner().get<1>(), a.max_corner().get<1>(),
+                  b.min_corner().get<1>(), b.max_corner().get<1>());
+    auto dz = gap(a.min_corner().get<2>(), a.max_corner().get<2>(),
+                  b.min_corner().get<2>(), b.max_corner().get<2>());
+
+    return dx * dx + dy * dy + dz * dz;
+}
+
+
+// The shapes which contain all points within `distance` of a shape.
+inline Sphere inflate(const Point3D& p, CoordType distance) {
+    return Sphere{p, distance};
+}
+
+inline Sphere inflate(const Sphere& s, CoordType distance) {
+    return Sphere{s.centroid, s.radius + distance};
+}
+
+inline Cylinder inflate(const Cylinder& c, CoordType distance) {
+    return Cylinder{c.p1, c.p2, c.radius + distance};
+}
+
+
+/** \brief Collects matches and passes them to the sink in batches.
+ *
+ *  The sink is shared by all threads, hence it's only called while holding
+ *  `mutex`. The remaining matches must be passed on with `flush`.
+ */
+template <class ValueA, class ValueB, class Sink>
+class SpatialJoinBuffer {
+  public:
+    static constexpr size_t max_buffered = 1024;
+
+    inline SpatialJoinBuffer(Sink& sink, std::mutex& mutex)
+        : sink_(sink)
+        , mutex_(mutex) {}
+
+    inline void push(const ValueA& a, const ValueB& b) {
+        matches_.emplace_back(a, b);
+        if(matches_.size() >= max_buffered) {
+            flush();
+        }
+    }
+
+    inline void flush() {
+        if(matches_.empty()) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(const auto& [a, b] : matches_) {
+            sink_(a, b);
+        }
+        matches_.clear();
+    }
+
+  private:
+    Sink& sink_;
+    std::mutex& mutex_;
+    std::vector<std::pair<ValueA, ValueB>> matches_;
+};
+
+
+/// \brief Passes matches to the sink immediately, if there's only one thread.
+template <class Sink>
+struct UnbufferedJoinSink {
+    Sink& sink;
+
+    template <class A, class B>
+    inline void push(const A& a, const B& b) {
+        sink(a, b);
+    }
+};
+
+
+/** \brief The bounding boxes of the values of recently visited leaves.
+ *
+ *  Every leaf is joined with several leaves of the other tree. Computing
+ *  the boxes of its values only once, rather than once per pair of leaves,
+ *  is what makes the dual traversal cheaper than one query per value. The
+ *  cache is cleared whenever it's full; since the traversal is depth-first,
+ *  recently visited leaves are likely to be visited again soon.
+ */
+template <class Nodes>
+class LeafBoxCache {
+  public:
+    using node_type = typename Nodes::node_type;
+    using value_type = typename Nodes::value_type;
+
+    static constexpr size_t max_boxes = size_t(1) << 16;
+
+    /** \brief The boxes of the values of `leaf`, in order.
+     *
+     *  The pointer is valid until the next call.
+     */
+    inline const Box3D* boxes(const Nodes& nodes, const node_type& leaf) {
+        auto key = nodes.key(leaf);
+        auto it = offsets_.find(key);
+        if(it != offsets_.end()) {
+            return boxes_.data() + it->second;
+        }
+
+        if(boxes_.size() >= max_boxes) {
+            boxes_.clear();
+            offsets_.clear();
+        }
+
+        auto offset = boxes_.size();
+        nodes.for_each_value(leaf, [this](const value_type& v) {
+            boxes_.push_back(bgi::indexable<value_type>{}(v));
+        });
+        offsets_.emplace(key, offset);
+
+        return boxes_.data() + offset;
+    }
+
+  private:
+    std::vector<Box3D> boxes_;
+    std::unordered_map<std::uintptr_t, size_t> offsets_;
+};
+
+
+/** \brief The dual traversal of two trees.
+ *
+ *  Pairs of inner nodes are split into all pairs of their children which are
+ *  within `distance`; if only one node is a leaf, the other one is split.
+ *  Pairs of leaves test all pairs of their values.
+ *
+ *  In a self-join both trees are the same. A node paired with itself is
+ *  split into every child paired with itself and the pairs of distinct
+ *  children `(i, j)` with `i < j`; a leaf paired with itself tests the pairs
+ *  of distinct values in the same way. Hence, every unordered pair of values
+ *  is found once.
+ */
+template <class GeometryMode, class NodesA, class NodesB>
+class DualTreeJoin {
+  public:
+    using node_a = typename NodesA::node_type;
+    using node_b = typename NodesB::node_type;
+    using value_a = typename NodesA::value_type;
+    using value_b = typename NodesB::value_type;
+
+    struct node_pair {
+        node_a a;
+        Box3D box_a;
+        node_b b;
+        Box3D box_b;
+    };
+
+    inline DualTreeJoin(const NodesA& nodes_a,
+                        const NodesB& nodes_b,
+                        CoordType distance,
+                        bool is_self_join = false)
+        : nodes_a_(nodes_a)
+        , nodes_b_(nodes_b)
+        , distance_(distance)
+        , distance_sq_(distance * distance)
+        , is_self_join_(is_self_join) {}
+
+    inline bool is_near(const Box3D& a, const Box3D& b) const {
+        return square_box_distance(a, b) <= distance_sq_;
+    }
+
+    inline bool is_leaf_pair(const node_pair& p) const {
+        return nodes_a_.is_leaf(p.a) && nodes_b_.is_leaf(p.b);
+    }
+
+    /// \brief Is `p` a node paired with itself, in a self-join.
+    inline bool is_self_pair(const node_pair& p) const {
+        if constexpr (std::is_same<NodesA, NodesB>::value) {
+            return is_self_join_ && nodes_a_.key(p.a) == nodes_b_.key(p.b);
+        } else {
+            return false;
+        }
+    }
+
+    /// \brief Calls `f(q)` for every pair of children `q` of `p` which are near each other.
+    template <class F>
+    inline void split(const node_pair& p, F&& f) const {
+        if constexpr (std::is_same<NodesA, NodesB>::value) {
+            if(is_self_pair(p)) {
+                split_self(p, f);
+                return;
+            }
+        }
+
+        auto is_leaf_a = nodes_a_.is_leaf(p.a);
+        auto is_leaf_b = nodes_b_.is_leaf(p.b);
+
+        if(!is_leaf_a && !is_leaf_b) {
+            nodes_a_.for_each_child(p.a, [this, &p, &f](const Box3D& box_a, const node_a& a) {
+                if(!is_near(box_a, p.box_b)) {
+                    return;
+                }
+
+                nodes_b_.for_each_child(p.b, [&](const Box3D& box_b, const node_b& b) {
+                    if(is_near(box_a, box_b)) {
+                        f(node_pair{a, box_a, b, box_b});
+                    }
+                });
+            });
+        } else if(!is_leaf_a) {
+            nodes_a_.for_each_child(p.a, [this, &p, &f](const Box3D& box_a, const node_a& a) {
+                if(is_near(box_a, p.box_b)) {
+                    f(node_pair{a, box_a, p.b, p.box_b});
+                }
+            });
+        } else {
+            nodes_b_.for_each_child(p.b, [this, &p, &f](const Box3D& box_b, const node_b& b) {
+                if(is_near(p.box_a, box_b)) {
+                    f(node_pair{p.a, p.box_a, b, box_b});
+                }
+            });
+        }
+    }
+
+    /// \brief Passes all matches below `p` to `buffer`.
+    template <class Buffer>
+    inline void join(const node_pair& p, Buffer& buffer) {
+        if(!is_leaf_pair(p)) {
+            split(p, [this, &buffer](const node_pair& q) { join(q, buffer); });
+            return;
+        }
+
+        if constexpr (std::is_same<NodesA, NodesB>::value) {
+            if(is_self_pair(p)) {
+                join_self_leaf(p.a, buffer);
+                return;
+            }
+        }
+
+        // Only the values near the other leaf are tested pairwise.
+        const auto* boxes_a = boxes_a_.boxes(nodes_a_, p.a);
+        size_t k = 0;
+        values_a_.clear();
+        nodes_a_.for_each_value(p.a, [this, &p, boxes_a, &k](const value_a& v) {
+            const auto& box = boxes_a[k++];
+            if(is_near(box, p.box_b)) {
+                values_a_.emplace_back(box, &v);
+            }
+        });
+
+        if(values_a_.empty()) {
+            return;
+        }
+
+        const auto* boxes_b = boxes_b_.boxes(nodes_b_, p.b);
+        k = 0;
+        values_b_.clear();
+        nodes_b_.for_each_value(p.b, [this, &p, boxes_b, &k](const value_b& v) {
+            const auto& box = boxes_b[k++];
+            if(is_near(p.box_a, box)) {
+                values_b_.emplace_back(box, &v);
+            }
+        });
+
+        for(const auto& [box_a, a] : values_a_) {
+            for(const auto& [box_b, b] : values_b_) {
+                if(is_near(box_a, box_b)
+                   && within_distance(*a, *b, distance_, GeometryMode{})) {
+                    buffer.push(*a, *b);
+                }
+            }
+        }
+    }
+
+  private:
+    template <class F>
+    inline void split_self(const node_pair& p, F&& f) const {
+        auto children = std::vector<std::pair<Box3D, node_a>>{};
+        nodes_a_.for_each_child(p.a, [&children](const Box3D& box, const node_a& a) {
+            children.emplace_back(box, a);
+        });
+
+        for(size_t i = 0; i < children.size(); ++i) {
+            const auto& [box_i, a_i] = children[i];
+            f(node_pair{a_i, box_i, a_i, box_i});
+
+            for(size_t j = i + 1; j < children.size(); ++j) {
+                const auto& [box_j, a_j] = children[j];
+                if(is_near(box_i, box_j)) {
+                    f(node_pair{a_i, box_i, a_j, box_j});
+                }
+            }
+        }
+    }
+
+    template <class Buffer>
+    inline void join_self_leaf(const node_a& leaf, Buffer& buffer) {
+        const auto* boxes = boxes_a_.boxes(nodes_a_, leaf);
+        size_t k = 0;
+        values_a_.clear();
+        nodes_a_.for_each_value(leaf, [this, boxes, &k](const value_a& v) {
+            values_a_.emplace_back(boxes[k++], &v);
+        });
+
+        for(size_t i = 0; i < values_a_.size(); ++i) {
+            const auto& [box_i, a_i] = values_a_[i];
+            for(size_t j = i + 1; j < values_a_.size(); ++j) {
+                const auto& [box_j, a_j] = values_a_[j];
+                if(is_near(box_i, box_j)
+                   && within_distance(*a_i, *a_j, distance_, GeometryMode{})) {
+                    buffer.push(*a_i, *a_j);
+                }
+            }
+        }
+    }
+
+    const NodesA& nodes_a_;
+    const NodesB& nodes_b_;
+    CoordType distance_;
+    CoordType distance_sq_;
+    bool is_self_join_;
+
+    LeafBoxCache<NodesA> boxes_a_;
+    LeafBoxCache<NodesB> boxes_b_;
+    std::vector<std::pair<Box3D, const value_a*>> values_a_;
+    std::vector<std::pair<Box3D, const value_b*>> values_b_;
+};
+
+
+/** \brief `spatial_join` of two trees, i.e. neither is a multi-index.
+ *
+ *  If `is_self_join`, then `tree_a` and `tree_b` must be the same tree.
+ */
+template <class GeometryMode, class TreeA, class TreeB, class Sink>
+inline void spatial_join_trees(const TreeA& tree_a,
+                               const TreeB& tree_b,
+                               CoordType distance,
+                               Sink& sink,
+                               size_t n_threads,
+                               bool is_self_join = false) {
+    auto nodes_a = make_tree_nodes(tree_a);
+    auto nodes_b = make_tree_nodes(tree_b);
+    if(nodes_a.empty() || nodes_b.empty()) {
+        return;
+    }
+
+    using join_type = DualTreeJoin<GeometryMode, decltype(nodes_a), decltype(nodes_b)>;
+    using node_pair = typename join_type::node_pair;
+    using buffer_type = SpatialJoinBuffer<typename join_type::value_a,
+                                          typename join_type::value_b,
+                                          Sink>;
+
+    auto root = node_pair{nodes_a.root(), nodes_a.bounds(), nodes_b.root(), nodes_b.bounds()};
+    auto splitter = join_type(nodes_a, nodes_b, distance, is_self_join);
+    if(!splitter.is_near(root.box_a, root.box_b)) {
+        return;
+    }
+
+    if(n_threads <= 1) {
+        auto unbuffered = UnbufferedJoinSink<Sink>{sink};
+        splitter.join(root, unbuffered);
+        return;
+    }
+
+    // The pairs of nodes are split, level by level, until there are enough
+    // to keep all threads busy.
+    auto pairs = std::vector<node_pair>{root};
+    while(pairs.size() < 16 * n_threads) {
+        auto next = std::vector<node_pair>{};
+        bool is_split = false;
+        for(const auto& p : pairs) {
+            if(splitter.is_leaf_pair(p)) {
+                next.push_back(p);
+            } else {
+                splitter.split(p, [&next](const node_pair& q) { next.push_back(q); });
+                is_split = true;
+            }
+        }
+
+        pairs = std::move(next);
+        if(!is_split) {
+            break;
+        }
+    }
+
+    auto sink_mutex = std::mutex{};
+    util::parallel_for(pairs.size(), n_threads, [&](size_t k) {
+        auto buffer = buffer_type(sink, sink_mutex);
+        join_type(nodes_a, nodes_b, distance, is_self_join).join(pairs[k], buffer);
+        buffer.flush();
+    });
+}
+
+
+/// \brief Visits the subtrees of a multi-index near a box.
+struct MultiIndexJoin {
+    /// \brief Calls `visitor(subtree)` for every subtree within `distance` of `box`.
+    template <class SubtreeCache, class Visitor>
+    static inline void for_each_subtree_near(const MultiIndexTreeBase<SubtreeCache>& index,
+                                             const Box3D& box,
+                                             CoordType distance,
+                                             const Visitor& visitor) {
+        using subtree_id_type = typename MultiIndexTreeBase<SubtreeCache>::toptree_type::value_type;
+
+        auto distance_sq = distance * distance;
+        auto is_near = [&box, distance_sq](const subtree_id_type& subtree) {
+            return square_box_distance(box, subtree.bounding_box()) <= distance_sq;
+        };
+
+        auto search_box = Box3D{Point3Dx(box.min_corner()) - distance,
+                                Point3Dx(box.max_corner()) + distance};
+
+        auto to_visit = std::vector<subtree_id_type>{};
+        index.top_rtree.query(bgi::intersects(search_box) && bgi::satisfies(is_near),
+                              std::back_inserter(to_visit));
+
+        index.for_each_subtree(to_visit, visitor);
+        ++index.query_count;
+    }
+
+    /** \brief `self_join` of a multi-index.
+     *
+     *  Every subtree is loaded once. First, it's joined with itself. Then
+     *  with the elements of the previously visited subtrees which are near
+     *  it; these were collected while those subtrees were loaded. Finally,
+     *  its elements near the subtrees which are yet to be visited are
+     *  collected. Hence, only elements near the boundary of a subtree are
+     *  kept in memory, and no subtree is needed while another is loaded.
+     */
+    template <class GeometryMode, class T, class SubtreeCache, class Sink>
+    static inline void self_join(const MultiIndexTree<T, SubtreeCache>& index,
+                                 CoordType distance,
+                                 Sink& sink,
+                                 size_t n_threads) {
+        using subtree_id_type = typename MultiIndexTreeBase<SubtreeCache>::toptree_type::value_type;
+
+        auto subtrees = std::vector<subtree_id_type>(index.top_rtree.begin(),
+                                                     index.top_rtree.end());
+
+        auto positions = std::unordered_map<size_t, size_t>{};
+        for(size_t k = 0; k < subtrees.size(); ++k) {
+            positions[subtrees[k].id] = k;
+        }
+
+        auto distance_sq = distance * distance;
+        auto expand = [distance](const Box3D& box) {
+            return Box3D{Point3Dx(box.min_corner()) - distance,
+                         Point3Dx(box.max_corner()) + distance};
+        };
+
+        // The elements of previously visited subtrees near the `k`-th subtree.
+        auto boundary = std::vector<std::vector<T>>(subtrees.size());
+
+        size_t k = 0;
+        index.for_each_subtree(subtrees, [&](const auto& subtree) {
+            const auto& box = subtrees[k].bounding_box();
+            spatial_join_trees<GeometryMode>(subtree, subtree, distance, sink, n_threads, true);
+
+            if(!boundary[k].empty()) {
+                auto near = IndexTree<T>(std::move(boundary[k]));
+                spatial_join_trees<GeometryMode>(near, subtree, distance, sink, n_threads);
+                boundary[k] = std::vector<T>{};
+            }
+
+            auto is_near_subtree = [&box, distance_sq](const subtree_id_type& other) {
+                return square_box_distance(box, other.bounding_box()) <= distance_sq;
+            };
+
+            auto neighbours = std::vector<subtree_id_type>{};
+            index.top_rtree.query(bgi::intersects(expand(box)) && bgi::satisfies(is_near_subtree),
+                                  std::back_inserter(neighbours));
+
+            for(const auto& other : neighbours) {
+                auto j = positions.at(other.id);
+                if(j <= k) {
+                    continue;
+                }
+
+                const auto& other_box = other.bounding_box();
+                auto is_near_other = [&other_box, distance_sq](const T& value) {
+                    return square_box_distance(bgi::indexable<T>{}(value), other_box)
+                           <= distance_sq;
+                };
+
+                subtree.query(bgi::intersects(expand(other_box)) && bgi::satisfies(is_near_other),
+                              std::back_inserter(boundary[j]));
+            }
+
+            ++k;
+        });
+
+        ++index.query_count;
+    }
+};
+
+
+template <class GeometryMode, class IndexA, class IndexB, class Sink>
+inline void spatial_join_impl(const IndexA& index_a,
+                              const IndexB& index_b,
+                              CoordType distance,
+                              Sink& sink,
+                              size_t n_threads) {
+    spatial_join_trees<GeometryMode>(index_a, index_b, distance, sink, n_threads);
+}
+
+template <class GeometryMode, class T, class SubtreeCache, class IndexB, class Sink>
+inline void spatial_join_impl(const MultiIndexTree<T, SubtreeCache>& index_a,
+                              const IndexB& index_b,
+                              CoordType distance,
+                              Sink& sink,
+                              size_t n_threads) {
+    MultiIndexJoin::for_each_subtree_near(
+        index_a, index_b.bounds(), distance,
+        [&](const auto& subtree) {
+            spatial_join_impl<GeometryMode>(subtree, index_b, distance, sink, n_threads);
+        }
+    );
+}
+
+template <class GeometryMode, class IndexA, class T, class SubtreeCache, class Sink>
+inline void spatial_join_impl(const IndexA& index_a,
+                              const MultiIndexTree<T, SubtreeCache>& index_b,
+                              CoordType distance,
+                              Sink& sink,
+                              size_t n_threads) {
+    MultiIndexJoin::for_each_subtree_near(
+        index_b, index_a.bounds(), distance,
+        [&](const auto& subtree) {
+            spatial_join_impl<GeometryMode>(index_a, subtree, distance, sink, n_threads);
+        }
+    );
+}
+
+template <class GeometryMode, class TA, class CacheA, class TB, class CacheB, class Sink>
+inline void spatial_join_impl(const MultiIndexTree<TA, CacheA>& index_a,
+                              const MultiIndexTree<TB, CacheB>& index_b,
+                              CoordType distance,
+                              Sink& sink,
+                              size_t n_threads) {
+    // Every subtree of `index_a` is joined with the subtrees of `index_b` near it.
+    MultiIndexJoin::for_each_subtree_near(
+        index_a, index_b.bounds(), distance,
+        [&](const auto& subtree) {
+            spatial_join_impl<GeometryMode>(subtree, index_b, distance, sink, n_threads);
+        }
+    );
+}
+
+
+template <class GeometryMode, class Index, class Sink>
+inline void self_join_impl(const Index& index,
+                           CoordType distance,
+                           Sink& sink,
+                           size_t n_threads) {
+    spatial_join_trees<GeometryMode>(index, index, distance, sink, n_threads, true);
+}
+
+template <class GeometryMode, class T, class SubtreeCache, class Sink>
+inline void self_join_impl(const MultiIndexTree<T, SubtreeCache>& index,
+                           CoordType distance,
+                           Sink& sink,
+                           size_t n_threads) {
+    MultiIndexJoin::self_join<GeometryMode>(index, distance, sink, n_threads);
+}
+
+}  // namespace detail
+
+
+template <class GeometryMode, class IndexA, class IndexB, class Sink>
+inline void spatial_join(const IndexA& index_a,
+                         const IndexB& index_b,
+                         CoordType distance,
+                         Sink&& sink,
+                         size_t n_threads) {
+    detail::spatial_join_impl<GeometryMode>(index_a, index_b, distance, sink, n_threads);
+}
+
+
+template <class GeometryMode, class IndexA, class IndexB>
+inline std::vector<std::pair<identifier_t, identifier_t>>
+spatial_join_ids(const IndexA& index_a,
+                 const IndexB& index_b,
+                 CoordType distance,
+                 size_t n_threads) {
+    auto ids = std::vector<std::pair<identifier_t, identifier_t>>{};
+    spatial_join<GeometryMode>(index_a, index_b, distance, [&ids](const auto& a, const auto& b) {
+        ids.emplace_back(detail::get_id_from(a), detail::get_id_from(b));
+    }, n_threads);
+
+    return ids;
+}
+
+
+template <class GeometryMode, class Index, class Sink>
+inline void self_join(const Index& index, CoordType distance, Sink&& sink, size_t n_threads) {
+    detail::self_join_impl<GeometryMode>(index, distance, sink, n_threads);
+}
+
+
+template <class GeometryMode, class Index>
+inline std::vector<std::pair<identifier_t, identifier_t>>
+self_join_ids(const Index& index, CoordType distance, size_t n_threads) {
+    auto ids = std::vector<std::pair<identifier_t, identifier_t>>{};
+    self_join<GeometryMode>(index, distance, [&ids](const auto& a, const auto& b) {
+        ids.emplace_back(detail::get_id_from(a), detail::get_id_from(b));
+    }, n_threads);
+
+    return ids;
+}
+
+
+template <class A, class B>
+inline bool within_distance(const A& a, const B& b, CoordType distance, BestEffortGeometry geo) {
+    return geometry_intersects(detail::inflate(a, distance), b, geo);
+}
+
+template <class... VarA, class B>
+inline bool within_distance(const boost::variant<VarA...>& a,
+                            const B& b,
+                            CoordType distance,
+                            BestEffortGeometry geo) {
+    return boost::apply_visitor(
+        [&b, distance, geo](const auto& a_alternative) {
+            return within_distance(a_alternative, b, distance, geo);
+        },
+        a
+    );
+}
+
+template <class A, class B>
+inline bool within_distance(const A& a, const B& b, CoordType distance, BoundingBoxGeometry) {
+    return detail::square_box_distance(bgi::indexable<A>{}(a), bgi::indexable<B>{}(b))
+           <= distance * distance;
+}
+
+}  // namespace brain_indexer
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "../split_morph_index.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <boost/iterator/function_output_iterator.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+/// \brief Appends every element to the array of its type.
+struct MorphoEntrySplitter {
+    std::vector<Segment>& segments;
+    std::vector<Soma>& somas;
+
+    inline void operator()(const Segment& segment) const {
+        segments.push_back(segment);
+    }
+
+    inline void operator()(const Soma& soma) const {
+        somas.push_back(soma);
+    }
+
+    template <typename... Args>
+    inline void operator()(const boost::variant<Args...>& value) const {
+        boost::apply_visitor(*this, value);
+    }
+};
+
+/** \brief Writes the `k` elements of `segments` and `somas` closest to `geometry`.
+ *
+ *  The distance is measured to the bounding box, as `bgi::nearest` does. The
+ *  elements are written closest first.
+ */
+template <class Geometry, class OutputIt>
+inline size_t merge_nearest(const Geometry& geometry,
+                            size_t k,
+                            const std::vector<Segment>& segments,
+                            const std::vector<Soma>& somas,
+                            OutputIt it) {
+    using distance_t = typename bg::default_comparable_distance_result<Geometry, Box3D>::type;
+
+    // A candidate `i >= segments.size()` refers to a soma.
+    auto candidates = std::vector<std::pair<distance_t, size_t>>{};
+    candidates.reserve(segments.size() + somas.size());
+    for(const auto& segment : segments) {
+        auto distance = bg::comparable_distance(geometry, bgi::indexable<Segment>{}(segment));
+        candidates.emplace_back(distance_t(distance), candidates.size());
+    }
+    for(const auto& soma : somas) {
+        auto distance = bg::comparable_distance(geometry, bgi::indexable<Soma>{}(soma));
+        candidates.emplace_back(distance_t(distance), candidates.size());
+    }
+
+    auto n_found = std::min(k, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + n_found, candidates.end());
+
+    for(size_t j = 0; j < n_found; ++j) {
+        auto i = candidates[j].second;
+        if(i < segments.size()) {
+            *it = segments[i];
+        } else {
+            *it = somas[i - segments.size()];
+        }
+        ++it;
+    }
+
+    return n_found;
+}
+
+}  // namespace detail
+
+
+template <template <typename...> class Tree>
+template <class ValueIt>
+inline SplitMorphIndexTree<Tree>::SplitMorphIndexTree(ValueIt begin, ValueIt end) {
+    auto segments = std::vector<Segment>{};
+    auto somas = std::vector<Soma>{};
+
+    auto split = detail::MorphoEntrySplitter{segments, somas};
+    for(auto it = begin; it != end; ++it) {
+        split(*it);
+    }
+
+    segments_ = segment_tree_type(segments.begin(), segments.end());
+    somas_ = soma_tree_type(somas.begin(), somas.end());
+}
+
+
+template <template <typename...> class Tree>
+template <class Predicates, class OutputIt>
+inline size_t SplitMorphIndexTree<Tree>::query(const Predicates& predicates, OutputIt it) const {
+    if constexpr (detail::is_nearest_predicate<Predicates>::value) {
+        auto segments = std::vector<Segment>{};
+        auto somas = std::vector<Soma>{};
+        segments_.query(predicates, std::back_inserter(segments));
+        somas_.query(predicates, std::back_inserter(somas));
+
+        return detail::merge_nearest(
+            predicates.point_or_relation, predicates.count, segments, somas, it
+        );
+    } else {
+        // Both trees must write to, and advance, the same iterator.
+        auto forward = boost::make_function_output_iterator([&it](const auto& value) {
+            *it = value;
+            ++it;
+        });
+
+        return segments_.query(predicates, forward) + somas_.query(predicates, forward);
+    }
+}
+
+
+template <template <typename...> class Tree>
+template <typename GeometryMode, typename ShapeT>
+inline std::vector<MorphoEntry>
+SplitMorphIndexTree<Tree>::find_intersecting_objs(const ShapeT& shape) const {
+    std::vector<MorphoEntry> results;
+    this->template find_intersecting<GeometryMode>(shape, std::back_inserter(results));
+    return results;
+}
+
+
+template <template <typename...> class Tree>
+inline Box3D SplitMorphIndexTree<Tree>::bounds() const {
+    Box3D box;
+    bg::assign_inverse(box);
+
+    if(!segments_.empty()) {
+        bg::expand(box, segments_.bounds());
+    }
+
+    if(!somas_.empty()) {
+        bg::expand(box, somas_.bounds());
+    }
+
+    return box;
+}
+
+}  // namespace brain_indexer
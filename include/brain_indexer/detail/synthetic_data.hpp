@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+namespace brain_indexer {
+
+inline size_t SyntheticCircuit::n_elements() const {
+    auto extent = Point3Dx(domain.max_corner()) - domain.min_corner();
+    auto volume = double(extent.get<0>()) * double(extent.get<1>()) * double(extent.get<2>());
+
+    return size_t(std::llround(density * volume));
+}
+
+inline size_t SyntheticCircuit::segments_per_neuron() const {
+    return std::max(sections_per_neuron * segments_per_section, size_t(1));
+}
+
+
+namespace detail {
+
+inline std::mt19937_64 synthetic_engine(std::uint64_t seed, std::uint64_t stream) {
+    auto seq = std::seed_seq{std::uint32_t(seed), std::uint32_t(seed >> 32),
+                             std::uint32_t(stream), std::uint32_t(stream >> 32)};
+    return std::mt19937_64(seq);
+}
+
+/// \brief The SplitMix64 hash, see Steele, Lea & Flood, OOPSLA 2014.
+inline std::uint64_t splitmix64(std::uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+inline Point3Dx random_point(const Box3D& domain, std::mt19937_64& gen) {
+    const auto& low = domain.min_corner();
+    const auto& high = domain.max_corner();
+
+    auto x = std::uniform_real_distribution<CoordType>(low.get<0>(), high.get<0>());
+    auto y = std::uniform_real_distribution<CoordType>(low.get<1>(), high.get<1>());
+    auto z = std::uniform_real_distribution<CoordType>(low.get<2>(), high.get<2>());
+
+    return Point3Dx(Point3D{x(gen), y(gen), z(gen)});
+}
+
+inline Point3Dx random_direction(std::mt19937_64& gen) {
+    auto normal = std::normal_distribution<CoordType>(0.0f, 1.0f);
+
+    while(true) {
+        auto direction = Point3Dx(Point3D{normal(gen), normal(gen), normal(gen)});
+        auto norm = direction.norm();
+        if(norm > CoordType(1e-6)) {
+            return direction / norm;
+        }
+    }
+}
+
+/// \brief The cluster centers of `circuit`; they're the same on every rank.
+inline std::vector<Point3D> synthetic_cluster_centers(const SyntheticCircuit& circuit) {
+    if(circuit.distribution != SyntheticDistribution::clustered) {
+        return {};
+    }
+
+    // The stream of the centers can't collide with the stream of a neuron.
+    auto gen = synthetic_engine(circuit.seed, ~std::uint64_t(0));
+
+    auto centers = std::vector<Point3D>(std::max(circuit.n_clusters, size_t(1)));
+    for(auto& center : centers) {
+        center = random_point(circuit.domain, gen);
+    }
+
+    return centers;
+}
+
+/// \brief The first and second point of every segment of the neuron `gid`.
+inline void synthetic_neuron(const SyntheticCircuit& circuit,
+                             const std::vector<Point3D>& centers,
+                             identifier_t gid,
+                             std::vector<Point3D>& first,
+                             std::vector<Point3D>& second) {
+    auto gen = synthetic_engine(circuit.seed, gid);
+    const auto n_segments = circuit.segments_per_neuron();
+    const auto length = circuit.segment_length;
+
+    first.resize(n_segments);
+    second.resize(n_segments);
+
+    if(circuit.distribution == SyntheticDistribution::morphology) {
+        const auto soma = random_point(circuit.domain, gen);
+        const auto n_sections = std::min(std::max(circuit.sections_per_neuron, size_t(1)),
+                                         n_segments);
+        const auto segments_per_section = n_segments / n_sections;
+
+        auto coin = std::bernoulli_distribution(0.5);
+        size_t i = 0;
+        for(size_t section = 0; section < n_sections; ++section) {
+            // Sections either start at the soma or branch off the end of an
+            // earlier section.
+            auto p = soma;
+            if(section > 0 && coin(gen)) {
+                auto parent = std::uniform_int_distribution<size_t>(0, section - 1)(gen);
+                p = Point3Dx(second[(parent + 1) * segments_per_section - 1]);
+            }
+
+            auto direction = random_direction(gen);
+            for(size_t k = 0; k < segments_per_section; ++k, ++i) {
+                direction = direction + random_direction(gen) * CoordType(0.3f);
+                direction = direction / direction.norm();
+
+                first[i] = p;
+                p = p + direction * length;
+                second[i] = p;
+            }
+        }
+
+        return;
+    }
+
+    auto normal = std::normal_distribution<CoordType>(0.0f, circuit.cluster_radius);
+    auto cluster = std::uniform_int_distribution<size_t>(0, std::max(centers.size(), size_t(1)) - 1);
+
+    for(size_t i = 0; i < n_segments; ++i) {
+        auto p = Point3Dx{};
+        if(circuit.distribution == SyntheticDistribution::clustered) {
+            p = Point3Dx(centers[cluster(gen)]) + Point3D{normal(gen), normal(gen), normal(gen)};
+        } else {
+            p = random_point(circuit.domain, gen);
+        }
+
+        first[i] = p;
+        second[i] = p + random_direction(gen) * length;
+    }
+}
+
+/** \brief Calls `f(i, gid, first, second)` for every element `i` in `[low, high)`.
+ *
+ *  Where `first` and `second` are the points of the segment `i`.
+ */
+template <class F>
+inline void for_each_synthetic_element(const SyntheticCircuit& circuit,
+                                       size_t low,
+                                       size_t high,
+                                       F&& f) {
+    const auto centers = synthetic_cluster_centers(circuit);
+    const auto n_segments = circuit.segments_per_neuron();
+    high = std::min(high, circuit.n_elements());
+
+    std::vector<Point3D> first, second;
+    for(size_t i = low; i < high;) {
+        const auto gid = identifier_t(i / n_segments);
+        synthetic_neuron(circuit, centers, gid, first, second);
+
+        const auto neuron_end = std::min(high, (gid + 1) * n_segments);
+        for(; i < neuron_end; ++i) {
+            const auto k = i - gid * n_segments;
+            f(i, gid, first[k], second[k]);
+        }
+    }
+}
+
+} // namespace detail
+
+
+template <class OutputIt>
+inline void generate_synthetic_segments(const SyntheticCircuit& circuit,
+                                        size_t low,
+                                        size_t high,
+                                        OutputIt it) {
+    const auto n_segments = circuit.segments_per_neuron();
+    const auto segments_per_section = std::max(circuit.segments_per_section, size_t(1));
+
+    detail::for_each_synthetic_element(circuit, low, high,
+        [&](size_t i, identifier_t gid, const Point3D& first, const Point3D& second) {
+            const auto k = i - gid * n_segments;
+            const auto section_id = unsigned(k / segments_per_section + 1);
+            const auto segment_id = unsigned(k % segments_per_section);
+
+            *it = Segment{gid, section_id, segment_id, first, second, circuit.radius,
+                          SectionType::basal_dendrite};
+            ++it;
+        }
+    );
+}
+
+template <class OutputIt>
+inline void generate_synthetic_synapses(const SyntheticCircuit& circuit,
+                                        size_t low,
+                                        size_t high,
+                                        OutputIt it) {
+    const auto n_neurons = std::max(circuit.n_elements() / circuit.segments_per_neuron(),
+                                    size_t(1));
+
+    detail::for_each_synthetic_element(circuit, low, high,
+        [&](size_t i, identifier_t gid, const Point3D& first, const Point3D& /* second */) {
+            // The pre-synaptic gid is a hash of the id, such that the synapses
+            // don't depend on `low`.
+            auto pre_gid = identifier_t(detail::splitmix64(circuit.seed ^ i) % n_neurons);
+
+            *it = Synapse{identifier_t(i), gid, pre_gid, first};
+            ++it;
+        }
+    );
+}
+
+
+#if SI_MPI == 1
+template <class Value, class Builder>
+inline void insert_synthetic_elements(Builder& builder,
+                                      const SyntheticCircuit& circuit,
+                                      MPI_Comm comm,
+                                      size_t block_size) {
+    const auto comm_size = size_t(mpi::size(comm));
+    const auto comm_rank = size_t(mpi::rank(comm));
+    const auto range = util::balanced_chunks(circuit.n_elements(), comm_size, comm_rank);
+
+    block_size = std::max(block_size, size_t(1));
+
+    std::vector<Value> values;
+    for(size_t low = range.low; low < range.high; low += block_size) {
+        const auto high = std::min(low + block_size, range.high);
+
+        values.clear();
+        if constexpr (std::is_same<Value, Synapse>::value) {
+            generate_synthetic_synapses(circuit, low, high, std::back_inserter(values));
+        } else {
+            generate_synthetic_segments(circuit, low, high, std::back_inserter(values));
+        }
+
+        builder.insert(values.begin(), values.end());
+    }
+}
+#endif
+
+} // namespace brain_indexer
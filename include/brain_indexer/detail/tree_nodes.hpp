@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+namespace brain_indexer {
+namespace detail {
+
+/** \brief Access to the nodes of a `bgi::rtree`, for traversals such as `spatial_join`.
+ *
+ *  A node is a pointer together with its level; the leaves are on level
+ *  `leafs_level`.
+ */
+template <class RTree>
+class RTreeNodes {
+    using view_type = bgi::detail::rtree::const_private_view<RTree>;
+    using members_holder = typename view_type::members_holder;
+    using internal_node = typename members_holder::internal_node;
+    using leaf = typename members_holder::leaf;
+
+  public:
+    using value_type = typename RTree::value_type;
+
+    struct node_type {
+        typename members_holder::node_pointer node;
+        size_t level;
+    };
+
+    inline explicit RTreeNodes(const RTree& tree)
+        : tree_(tree)
+        , view_(tree) {}
+
+    inline bool empty() const {
+        return view_.members().values_count == 0;
+    }
+
+    inline node_type root() const {
+        return node_type{view_.members().root, 0};
+    }
+
+    inline Box3D bounds() const {
+        return tree_.bounds();
+    }
+
+    inline bool is_leaf(const node_type& n) const {
+        return n.level == view_.members().leafs_level;
+    }
+
+    /// \brief Identifies the node `n` among all nodes of the tree.
+    inline std::uintptr_t key(const node_type& n) const {
+        return reinterpret_cast<std::uintptr_t>(&(*n.node));
+    }
+
+    /// \brief Calls `f(box, child)` for every child of the inner node `n`.
+    template <class F>
+    inline void for_each_child(const node_type& n, F&& f) const {
+        namespace rtree = bgi::detail::rtree;
+        for(const auto& [box, child] : rtree::elements(rtree::get<internal_node>(*n.node))) {
+            f(Box3D(box), node_type{child, n.level + 1});
+        }
+    }
+
+    /// \brief Calls `f(value)` for every value of the leaf `n`.
+    template <class F>
+    inline void for_each_value(const node_type& n, F&& f) const {
+        namespace rtree = bgi::detail::rtree;
+        for(const auto& value : rtree::elements(rtree::get<leaf>(*n.node))) {
+            f(value);
+        }
+    }
+
+    /// \brief The number of values of the leaf `n`.
+    inline size_t n_values(const node_type& n) const {
+        namespace rtree = bgi::detail::rtree;
+        return rtree::elements(rtree::get<leaf>(*n.node)).size();
+    }
+
+  private:
+    const RTree& tree_;
+    view_type view_;
+};
+
+
+/** \brief Access to the nodes of a `PackedRTree`, see `RTreeNodes`.
+ *
+ *  A node is its index in the node array, or `n_nodes() + k` for the
+ *  compact leaf `k`.
+ */
+template <class T>
+class PackedRTreeNodes {
+  public:
+    using value_type = T;
+    using node_type = std::uint64_t;
+
+    inline explicit PackedRTreeNodes(const PackedRTree<T>& tree)
+        : tree_(tree) {}
+
+    inline bool empty() const {
+        return tree_.empty();
+    }
+
+    inline node_type root() const {
+        return 0;
+    }
+
+    inline Box3D bounds() const {
+        return tree_.bounds();
+    }
+
+    inline bool is_leaf(node_type n) const {
+        return n >= tree_.n_nodes() || tree_.nodes()[n].is_leaf != 0;
+    }
+
+    inline std::uintptr_t key(node_type n) const {
+        return std::uintptr_t(n);
+    }
+
+    template <class F>
+    inline void for_each_child(node_type n, F&& f) const {
+        const auto& node = tree_.nodes()[n];
+        for(std::uint32_t k = 0; k < node.n_children; ++k) {
+            f(node.child_box(k), node_type(node.first_child + k));
+        }
+    }
+
+    template <class F>
+    inline void for_each_value(node_type n, F&& f) const {
+        auto [first, n_children] = leaf_values(n);
+
+        const auto* values = tree_.begin() + first;
+        for(std::uint32_t k = 0; k < n_children; ++k) {
+            f(values[k]);
+        }
+    }
+
+    inline size_t n_values(node_type n) const {
+        return leaf_values(n).second;
+    }
+
+    /** \brief The number of values below `n`.
+     *
+     *  The values of the leaves of one parent are contiguous. Hence, only
+     *  the inner nodes below `n` are traversed, and the first and last
+     *  leaf of each parent of leaves.
+     */
+    inline size_t n_values_below(node_type n) const {
+        if(is_leaf(n)) {
+            return n_values(n);
+        }
+
+        const auto& node = tree_.nodes()[n];
+        if(is_leaf(node.first_child)) {
+            auto first = leaf_values(node.first_child).first;
+            auto [last, n_last] = leaf_values(node.first_child + node.n_children - 1);
+            return size_t(last + n_last - first);
+        }
+
+        size_t count = 0;
+        for(std::uint32_t k = 0; k < node.n_children; ++k) {
+            count += n_values_below(node.first_child + k);
+        }
+
+        return count;
+    }
+
+  private:
+    /// \brief The first value of the leaf `n` and the number of values.
+    inline std::pair<std::uint64_t, std::uint32_t> leaf_values(node_type n) const {
+        return n >= tree_.n_nodes()
+            ? std::make_pair(tree_.leaves()[n - tree_.n_nodes()].first_child,
+                             tree_.leaves()[n - tree_.n_nodes()].n_children)
+            : std::make_pair(tree_.nodes()[n].first_child, tree_.nodes()[n].n_children);
+    }
+
+    const PackedRTree<T>& tree_;
+};
+
+
+template <class... Args>
+inline RTreeNodes<bgi::rtree<Args...>> make_tree_nodes(const bgi::rtree<Args...>& tree) {
+    return RTreeNodes<bgi::rtree<Args...>>(tree);
+}
+
+template <class T>
+inline PackedRTreeNodes<T> make_tree_nodes(const PackedRTree<T>& tree) {
+    return PackedRTreeNodes<T>(tree);
+}
+
+}  // namespace detail
+}  // namespace brain_indexer
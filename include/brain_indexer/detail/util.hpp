@@ -1,7 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 
 namespace brain_indexer { namespace util {
 
@@ -33,5 +50,337 @@ inline Range balanced_chunks(size_t n_total, size_t n_chunks, size_t k_chunk) {
     return balanced_chunks(Range{0, n_total}, n_chunks, k_chunk);
 }
 
+
+inline Range balanced_chunks(const std::vector<size_t>& weights,
+                             size_t n_chunks,
+                             size_t k_chunk) {
+    auto total_weight = std::accumulate(weights.begin(), weights.end(), 0.0);
+    if(total_weight == 0.0) {
+        return balanced_chunks(weights.size(), n_chunks, k_chunk);
+    }
+
+    auto chunk_of = [&, prefix = 0.0](size_t w) mutable {
+        auto midpoint = prefix + 0.5 * double(w);
+        prefix += double(w);
+        return std::min(size_t(midpoint * double(n_chunks) / total_weight), n_chunks - 1);
+    };
+
+    auto range = Range{weights.size(), weights.size()};
+    for(size_t i = 0; i < weights.size(); ++i) {
+        auto k = chunk_of(weights[i]);
+        if(k >= k_chunk && range.low == weights.size()) {
+            range.low = i;
+        }
+        if(k > k_chunk) {
+            range.high = i;
+            break;
+        }
+    }
+
+    range.high = std::max(range.low, range.high);
+    return range;
+}
+
+
+template<class F>
+inline void parallel_for(size_t n_tasks, size_t n_threads, const F& f) {
+    n_threads = std::max(size_t(1), std::min(n_threads, n_tasks));
+
+    std::atomic<size_t> next_task{0};
+    std::exception_ptr first_exception = nullptr;
+    std::mutex exception_mutex;
+
+    auto worker = [&]() {
+        for(size_t k = next_task++; k < n_tasks; k = next_task++) {
+            try {
+                f(k);
+            }
+            catch(...) {
+                auto guard = std::lock_guard<std::mutex>(exception_mutex);
+                if(first_exception == nullptr) {
+                    first_exception = std::current_exception();
+                }
+
+                // Let the other threads run out of work.
+                next_task = n_tasks;
+            }
+        }
+    };
+
+    auto threads = std::vector<std::thread>{};
+    threads.reserve(n_threads - 1);
+    for(size_t i = 1; i < n_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    if(first_exception != nullptr) {
+        std::rethrow_exception(first_exception);
+    }
+}
+
+}  // namespace util
+
+namespace detail {
+
+#if defined(__linux__)
+/** \brief The bitmask of the online NUMA nodes, as expected by `mbind`.
+ *
+ *  Empty if it can't be determined.
+ */
+inline std::vector<unsigned long> online_numa_nodes() {
+    auto mask = std::vector<unsigned long>{};
+    auto ifs = std::ifstream("/sys/devices/system/node/online");
+    auto ranges = std::string{};
+    if(!std::getline(ifs, ranges)) {
+        return mask;
+    }
+
+    // The format is a list of ranges, e.g. `0-1,4`.
+    auto iss = std::istringstream(ranges);
+    auto range = std::string{};
+    constexpr auto n_bits = 8 * sizeof(unsigned long);
+    while(std::getline(iss, range, ',')) {
+        auto dash = range.find('-');
+        auto low = std::stoul(range.substr(0, dash));
+        auto high = dash == std::string::npos ? low : std::stoul(range.substr(dash + 1));
+        for(auto node = low; node <= high; ++node) {
+            if(node / n_bits >= mask.size()) {
+                mask.resize(node / n_bits + 1, 0ul);
+            }
+            mask[node / n_bits] |= 1ul << (node % n_bits);
+        }
+    }
+
+    return mask;
+}
+
+/// \brief Interleaves the pages of the mapping `[p, p + n_bytes)` across all NUMA nodes.
+inline void interleave_numa_nodes(void* p, size_t n_bytes) {
+    static const auto nodes = online_numa_nodes();
+
+    size_t n_nodes = 0;
+    for(auto word : nodes) {
+        n_nodes += size_t(__builtin_popcountl(word));
+    }
+
+    if(n_nodes > 1) {
+        // Best effort, e.g. it fails in containers without the capability.
+        constexpr int mpol_interleave = 3;
+        auto max_node = 8 * sizeof(unsigned long) * nodes.size() + 1;
+        syscall(SYS_mbind, p, n_bytes, mpol_interleave, nodes.data(), max_node, 0u);
+    }
+}
+
+/// \brief Maps `n_bytes`, a multiple of the huge page size, aligned to huge pages.
+inline char* map_huge_page_block(size_t n_bytes, util::HugePages huge_pages) {
+    constexpr auto huge_page_size = util::MonotonicArena::huge_page_size;
+    if(huge_pages == util::HugePages::explicit_) {
+        auto p = mmap(nullptr, n_bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(p != MAP_FAILED) {
+            return static_cast<char*>(p);
+        }
+    }
+
+    // Over-allocate, such that the block can be aligned to huge pages.
+    auto n_mapped = n_bytes + huge_page_size;
+    auto p = mmap(nullptr, n_mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+
+    auto begin = static_cast<char*>(p);
+    auto address = reinterpret_cast<std::uintptr_t>(begin);
+    auto aligned = begin + (huge_page_size - address % huge_page_size) % huge_page_size;
+    if(aligned != begin) {
+        munmap(begin, size_t(aligned - begin));
+    }
+    auto tail = size_t(begin + n_mapped - (aligned + n_bytes));
+    if(tail > 0) {
+        munmap(aligned + n_bytes, tail);
+    }
+
+    if(huge_pages != util::HugePages::none) {
+        madvise(aligned, n_bytes, MADV_HUGEPAGE);
+    }
+
+    return aligned;
+}
+#endif
+
+}  // namespace detail
+
+namespace util {
+
+inline MonotonicArena::~MonotonicArena() {
+    for(const auto& block : blocks_) {
+#if defined(__linux__)
+        if(block.is_mapped) {
+            munmap(block.data, block.size);
+            continue;
+        }
+#endif
+        delete[] block.data;
+    }
+}
+
+inline void MonotonicArena::add_block(size_t min_size) {
+    // Requests larger than a block get a block of their own.
+    auto block_size = std::max(next_block_size_, min_size);
+    next_block_size_ = std::min(2 * next_block_size_, max_block_size);
+
+#if defined(__linux__)
+    if(placement_.huge_pages != HugePages::none || placement_.interleave_numa_nodes) {
+        block_size = (block_size + huge_page_size - 1) / huge_page_size * huge_page_size;
+
+        auto data = detail::map_huge_page_block(block_size, placement_.huge_pages);
+        blocks_.push_back(Block{data, block_size, true});
+        if(placement_.interleave_numa_nodes) {
+            detail::interleave_numa_nodes(data, block_size);
+        }
+    } else
+#endif
+    {
+        blocks_.push_back(Block{new char[block_size], block_size, false});  // Not zeroed.
+    }
+
+    current_ = blocks_.back().data;
+    n_free_ = block_size;
+    reserved_bytes_ += block_size;
+}
+
+inline void* MonotonicArena::allocate(size_t n_bytes, size_t alignment) {
+    auto padding = [this, alignment]() {
+        auto address = reinterpret_cast<std::uintptr_t>(current_);
+        return (alignment - address % alignment) % alignment;
+    };
+
+    if(current_ == nullptr || padding() + n_bytes > n_free_) {
+        add_block(n_bytes + alignment);
+    }
+
+    auto offset = padding();
+    auto p = current_ + offset;
+    current_ += offset + n_bytes;
+    n_free_ -= offset + n_bytes;
+
+    return p;
+}
+
+
+template <class Key>
+inline FlatCounter<Key>::FlatCounter(size_t n_keys) {
+    size_t capacity = 16;
+    while(capacity < 2 * n_keys) {
+        capacity *= 2;
+    }
+
+    keys_.assign(capacity, empty_key);
+    counts_.assign(capacity, 0);
+}
+
+
+template <class Key>
+inline size_t FlatCounter<Key>::slot(Key key) const {
+    // Fibonacci hashing, which spreads consecutive keys, e.g. gids, over the table.
+    auto mask = keys_.size() - 1;
+    auto i = size_t((std::uint64_t(key) * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+
+    while(keys_[i] != key && keys_[i] != empty_key) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+
+template <class Key>
+inline void FlatCounter<Key>::grow() {
+    auto keys = std::move(keys_);
+    auto counts = std::move(counts_);
+
+    auto capacity = std::max(size_t(16), 2 * keys.size());
+    keys_.assign(capacity, empty_key);
+    counts_.assign(capacity, 0);
+
+    for(size_t i = 0; i < keys.size(); ++i) {
+        if(keys[i] != empty_key) {
+            auto j = slot(keys[i]);
+            keys_[j] = keys[i];
+            counts_[j] = counts[i];
+        }
+    }
+}
+
+
+template <class Key>
+inline void FlatCounter<Key>::add(Key key, size_t count) {
+    if(key == empty_key) {
+        size_ += (empty_key_count_ == 0);
+        empty_key_count_ += count;
+        return;
+    }
+
+    // Keep the load factor at most 1/2, such that probe sequences are short.
+    if(2 * (size_ + 1) > keys_.size()) {
+        grow();
+    }
+
+    auto i = slot(key);
+    if(keys_[i] == empty_key) {
+        keys_[i] = key;
+        ++size_;
+    }
+
+    counts_[i] += count;
+}
+
+
+template <class Key>
+inline size_t FlatCounter<Key>::count(Key key) const {
+    if(key == empty_key) {
+        return empty_key_count_;
+    }
+
+    if(keys_.empty()) {
+        return 0;
+    }
+
+    return counts_[slot(key)];
+}
+
+
+template <class Key>
+template <class F>
+inline void FlatCounter<Key>::for_each(F&& f) const {
+    for(size_t i = 0; i < keys_.size(); ++i) {
+        if(keys_[i] != empty_key) {
+            f(keys_[i], counts_[i]);
+        }
+    }
+
+    if(empty_key_count_ != 0) {
+        f(empty_key, empty_key_count_);
+    }
+}
+
+
+template <class Key>
+inline std::unordered_map<Key, size_t> FlatCounter<Key>::to_unordered_map() const {
+    auto counts = std::unordered_map<Key, size_t>{};
+    counts.reserve(size_);
+    for_each([&counts](Key key, size_t count) {
+        counts.emplace(key, count);
+    });
+
+    return counts;
+}
+
 }
 }
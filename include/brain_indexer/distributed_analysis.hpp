@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+#include <utility>
 #include <vector>
 
 #include <brain_indexer/mpi_wrapper.hpp>
@@ -9,92 +11,124 @@
 
 namespace brain_indexer {
 
-
-inline std::vector<size_t> histogram(const std::vector<CoordType>& bins,
-                                     std::vector<CoordType> data,
-                                     MPI_Comm comm) {
-
-    auto mpi_rank = mpi::rank(comm);
-
-    std::sort(data.begin(), data.end());
-
-    auto counts = std::vector<size_t>(bins.size(), 0ul);
-    size_t current_bin_idx = 0;
-    for(auto x : data) {
-        while(x >= bins[current_bin_idx]) {
-            ++current_bin_idx;
-        }
-
-        ++counts[current_bin_idx];
+/** \brief A histogram which counts one value at a time.
+ *
+ *  The bins are given by their upper edges, e.g. `log10_bins`: a value `x`
+ *  is counted in the first bin `i` with `x < bins[i]`; values past the last
+ *  edge are counted in the last bin. The bin is found by binary search; or,
+ *  for `StreamingHistogram::log10`, directly from the logarithm of `x`.
+ */
+class StreamingHistogram {
+  public:
+    /// \throws std::invalid_argument if there are no `bins`.
+    inline explicit StreamingHistogram(std::vector<CoordType> bins);
+
+    /// \brief A histogram with the bins `log10_bins(log10_low, log10_high, bins_per_decade)`.
+    static inline StreamingHistogram log10(CoordType log10_low,
+                                           CoordType log10_high,
+                                           size_t bins_per_decade);
+
+    inline void add(CoordType x);
+
+    /** \brief Sum the counts of all ranks of `comm` on rank 0.
+     *
+     *  The counts of all other ranks are reset to zero. This is an MPI
+     *  collective operation.
+     */
+    inline void reduce(MPI_Comm comm);
+
+    inline const std::vector<CoordType>& bins() const { return bins_; }
+    inline const std::vector<size_t>& counts() const { return counts_; }
+
+  private:
+    inline size_t find_bin(CoordType x) const;
+
+    std::vector<CoordType> bins_;
+    std::vector<size_t> counts_;
+
+    // The bins are those of `log10_bins`, if `bins_per_decade_` isn't zero.
+    CoordType log10_low_ = CoordType(0);
+    size_t bins_per_decade_ = 0;
+};
+
+
+/** \brief Adds `f(value)` of every element to a histogram.
+ *
+ *  This is a reducer for `reduce_elements`.
+ */
+template <class F>
+class HistogramReducer {
+  public:
+    inline HistogramReducer(StreamingHistogram histogram, F f)
+        : histogram_(std::move(histogram))
+        , f_(std::move(f)) {}
+
+    template <class T>
+    inline void operator()(const T& value) {
+        histogram_.add(CoordType(f_(value)));
     }
 
-    MPI_Reduce(
-        (mpi_rank == 0) ? MPI_IN_PLACE : counts.data(),
-        counts.data(),
-        util::safe_integer_cast<int>(bins.size()),
-        mpi::datatype<size_t>(),
-        MPI_SUM,
-        0,
-        comm
-    );
-
-    return (mpi_rank == 0) ? counts : std::vector<size_t>{};
-}
+    inline void reduce(MPI_Comm comm) {
+        histogram_.reduce(comm);
+    }
 
+    inline const StreamingHistogram& histogram() const { return histogram_; }
 
-inline std::vector<CoordType> log10_bins(CoordType log10_low,
-                                  CoordType log10_high,
-                                  size_t bins_per_decade) {
-
-    auto n_decades = log10_high - log10_low;
-    auto n_bins = 2 + bins_per_decade * n_decades;
-    auto bin_width = CoordType(1.0) / bins_per_decade;
-    auto bins = std::vector<CoordType>(n_bins);
-
-    for(size_t i = 0; i < n_bins-1; ++i) {
-        bins[i] = std::pow(
-            CoordType(10.0),
-            CoordType(log10_low + i * bin_width)
-        );
-    }
-    bins[n_bins-1] = std::numeric_limits<CoordType>::max();
+  private:
+    StreamingHistogram histogram_;
+    F f_;
+};
 
-    return bins;
+template <class F>
+inline HistogramReducer<F> make_histogram_reducer(StreamingHistogram histogram, F f) {
+    return HistogramReducer<F>(std::move(histogram), std::move(f));
 }
 
 
-inline void segment_length_histogram(const std::string &output_dir, MPI_Comm comm = MPI_COMM_WORLD) {
-    auto storage = NativeStorageT<MorphoEntry>(output_dir);
-    auto top_tree = storage.load_top_tree();
-    auto n_subtrees = top_tree.size();
-
-    auto comm_size = mpi::size(comm);
-    auto comm_rank = mpi::rank(comm);
+/** \brief Pass every element of a multi-index to each of `reducers`.
+ *
+ *  A reducer is any object with two methods: `reducer(value)` is called
+ *  for every element, on the rank which owns its subtree; and, after all
+ *  elements have been visited, `reducer.reduce(comm)` combines the partial
+ *  results of all ranks, e.g. `HistogramReducer`. The reducers are called
+ *  in the order they're passed, and only from the calling thread.
+ *
+ *  The subtrees are split into contiguous chunks, one per rank, with
+ *  roughly equal number of elements. Each rank loads its next subtree in
+ *  the background, while the elements of the current subtree are reduced.
+ *
+ *  This is an MPI collective operation.
+ *
+ *  \param storage  The storage of the multi-index, e.g. `NativeStorageT<T>`.
+ */
+template <class Storage, class... Reducers>
+inline void reduce_elements(const Storage& storage, MPI_Comm comm, Reducers&... reducers);
+
+
+/** \brief The histogram of `data`, summed over all ranks of `comm`.
+ *
+ *  Only rank 0 receives the counts; on all other ranks the result is
+ *  empty. This is an MPI collective operation.
+ */
+inline std::vector<size_t> histogram(const std::vector<CoordType>& bins,
+                                     const std::vector<CoordType>& data,
+                                     MPI_Comm comm);
 
-    auto chunk = util::balanced_chunks(n_subtrees, comm_size, comm_rank);
-    auto data = std::vector<CoordType>{};
-    for(size_t i = chunk.low; i < chunk.high; ++i) {
-        log_info(boost::format("loading: %d") % i);
-        auto subtree = storage.load_subtree(i); 
 
-        for(const auto &value : subtree) {
-            data.push_back(characteristic_length(value));
-        }
-    }
+/// \brief Logarithmically spaced upper edges of bins, see `StreamingHistogram`.
+inline std::vector<CoordType> log10_bins(CoordType log10_low,
+                                         CoordType log10_high,
+                                         size_t bins_per_decade);
 
-    auto bins = log10_bins(CoordType(-8), CoordType(6), 4ul);
-    auto counts = histogram(bins, std::move(data), comm);
 
-    MPI_Barrier(comm);
+/** \brief Print the histogram of segment lengths of a multi-index.
+ *
+ *  This is an MPI collective operation.
+ *
+ *  \param output_dir  The directory of the multi-index, as for `MultiIndexTree`.
+ */
+inline void segment_length_histogram(const std::string &output_dir, MPI_Comm comm = MPI_COMM_WORLD);
 
-    if(mpi::rank(comm) == 0) {
-        std::cout << std::setprecision(4) << std::scientific;
-        std::cout << "[      -inf, " << bins[0] << "): " << counts[0] << "\n";
-        for(size_t i = 1; i < bins.size()-1; ++i) {
-            std::cout << "[" << bins[i-1] << ", " << bins[i] << "): "  << counts[i] << "\n";
-        }
-        std::cout << "[" << bins[bins.size()-2] << ",        inf): " << counts.back() << "\n";
-    }
 }
 
-}
+#include "detail/distributed_analysis.hpp"
@@ -0,0 +1,96 @@
+#pragma once
+
+#if SI_MPI == 1
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/mpi_wrapper.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A multi-index which is queried collectively by the ranks of a communicator.
+ *
+ *  If every rank opens its own `MultiIndexTree`, every rank loads any subtree
+ *  its queries need. Hence, every cache must hold the working set of all
+ *  queries. Instead, here every subtree is owned by exactly one rank; and
+ *  only its owner ever loads it. A query is sent, using the top-level tree,
+ *  to the owners of the subtrees it touches, answered there and the matches
+ *  are sent back. Therefore, the total cache capacity grows with the number
+ *  of ranks.
+ *
+ *  The subtrees, ordered by id, are split into contiguous blocks; and rank
+ *  `k` owns the `k`-th block. Since the distributed STR numbers the subtrees
+ *  of every rank consecutively, each rank owns the subtrees it wrote if the
+ *  index is opened on as many ranks as it was built with; and in general,
+ *  subtrees which are close in space.
+ *
+ *  The communicator must remain valid while the index is used.
+ */
+template <class T, class SubtreeCache = UsageRateCacheT<T>>
+class DistributedMultiIndexTree {
+  public:
+    using value_type = T;
+    using index_type = MultiIndexTree<T, SubtreeCache>;
+
+    /** \brief Open the multi-index in `output_dir` on every rank of `comm`.
+     *
+     *  Collective. The cache of every rank holds at most `max_cached_bytes`.
+     */
+    DistributedMultiIndexTree(const std::string& output_dir,
+                              size_t max_cached_bytes,
+                              MPI_Comm comm);
+
+    /** \brief The matches of this rank's `shapes`, see `MultiIndexTree::find_intersecting_batch`.
+     *
+     *  Collective; every rank passes its own, possibly empty, `shapes`. The
+     *  queries are exchanged by `MPI_Alltoallv`; every rank answers all
+     *  queries for its subtrees as one batch, with `n_threads` threads if
+     *  the cache supports it. The matches of one query are in no particular
+     *  order.
+     */
+    template <typename GeometryMode = BoundingBoxGeometry, typename ShapeT>
+    inline detail::batch_query_result<value_type>
+    find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                            size_t n_threads = 1,
+                            query_fields_t fields = all_query_fields) const;
+
+    /// \brief The rank which owns the subtree with id `subtree_id`.
+    inline int owner(size_t subtree_id) const {
+        return owners_.at(subtree_id);
+    }
+
+    /// \brief The ids of the subtrees owned by this rank.
+    inline const std::vector<size_t>& local_subtrees() const {
+        return local_subtrees_;
+    }
+
+    /// \brief The part of the index on this rank; only owned subtrees are cached.
+    inline const index_type& local_index() const {
+        return index_;
+    }
+
+    inline Box3D bounds() const {
+        return index_.bounds();
+    }
+
+    /// \brief Total number of elements, on all ranks.
+    inline size_t size() const {
+        return index_.size();
+    }
+
+  private:
+    index_type index_;
+    MPI_Comm comm_;
+    std::unordered_map<size_t, int> owners_;
+    std::vector<size_t> local_subtrees_;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/distributed_query.hpp"
+
+#endif
@@ -2,6 +2,8 @@
 
 #if SI_MPI == 1
 
+#include <future>
+
 #include <brain_indexer/mpi_wrapper.hpp>
 #include <brain_indexer/distributed_sorting.hpp>
 #include <brain_indexer/index.hpp>
@@ -34,6 +36,15 @@ struct LocalSTRParams {
 };
 
 
+/// \brief Every element has the same weight; hence, ranks are balanced by count.
+struct UnitWeight {
+    template <class Value>
+    constexpr double operator()(const Value& /* value */) const {
+        return 1.0;
+    }
+};
+
+
 /** \brief MPI-parallel version of Sort Tile Recursion.
  *
  * Please refer to `SerialSortTileRecursion` for a detailed
@@ -51,6 +62,12 @@ struct LocalSTRParams {
  * compute successive groups of MPI ranks of size `n[1]*n[2]*...`;
  * and continue with STR recursively.
  *
+ * Optionally, the elements have a `weight`, e.g. an estimate of how costly
+ * they're to query; then every MPI rank receives roughly the same total
+ * weight instead of the same number of elements. See
+ * `DistributedMemorySorter::sort_and_balance`. Otherwise, the elements are
+ * sorted with `DistributedMemorySorter::sort_and_balance_once`.
+ *
  * \sa `distributed_sort_tile_recursion` for a more convenient interface.
  * \sa `DistributedMemorySorter` for an implementation of a
  * distributed and balanced sorting algorithm.
@@ -64,9 +81,11 @@ private:
   using STR = DistributedSortTileRecursion<Value, GetCoordinate, D>;
 
 public:
+    template <class Weight = UnitWeight>
     static void apply(std::vector<Value> &values,
                       const DistributedSTRParams&str_params,
-                      MPI_Comm mpi_comm);
+                      MPI_Comm mpi_comm,
+                      const Weight &weight = Weight{});
 };
 
 
@@ -74,10 +93,11 @@ public:
  *
  * \sa `DistributedSortTileRecursion`.
  */
-template <typename Value, typename GetCoordinate>
+template <typename Value, typename GetCoordinate, class Weight = UnitWeight>
 void distributed_sort_tile_recursion(std::vector<Value> &values,
                                      const DistributedSTRParams&str_params,
-                                     MPI_Comm mpi_comm);
+                                     MPI_Comm mpi_comm,
+                                     const Weight &weight = Weight{});
 
 
 inline std::vector<IndexedSubtreeBox> gather_bounding_boxes(
@@ -108,27 +128,80 @@ inline LocalSTRParams infer_local_str_params(
 /// that `n == m[0] * m[1] * m[2]` and the difference between all
 /// `m[k]` is reasonably small.
 ///
-/// \warning Current implementation only supports powers of two.
+/// The prime factors of `n` are assigned from largest to smallest, each to
+/// the dimension with the fewest ranks so far. Hence, any `n` works; but if
+/// `n` has a large prime factor, the parts are elongated along one axis.
 ///
 inline std::array<int, 3> rank_distribution(int comm_size);
 
 
 /// \brief Is `comm_size` a valid MPI communicator size for the C++ backend?
+///
+/// Any positive number of ranks is valid.
 inline bool is_valid_comm_size(int comm_size);
 
 
+/// \brief The prime factors of `n`, in ascending order, with multiplicity.
+inline std::vector<int> prime_factors(int n);
+
+
 /// Uses `SerialSTRParams::from_heuristics` as a heuristic.
 inline TwoLevelSTRParams two_level_str_heuristic(size_t n_elements,
                                           size_t max_elements_per_part,
                                           int comm_size);
 
 
-/// Creates the top-level and all subtrees of the multi-index.
-template <class GetCenterCoordinate, class Storage, class Value>
+/** \brief Saves subtrees on a background thread.
+ *
+ * `save` returns once the previous subtree has been written; hence, the next
+ * subtree can be built while the current one is written. At most two
+ * subtrees are alive at once.
+ *
+ * Any error while writing is rethrown by the next call to `save` or `wait`.
+ * The destructor waits for the last subtree; but discards any error.
+ */
+template <class Storage>
+class AsyncSubtreeWriter {
+  public:
+    using subtree_type = typename Storage::subtree_type;
+
+    /// \brief `storage` must outlive the writer.
+    explicit inline AsyncSubtreeWriter(const Storage& storage);
+
+    AsyncSubtreeWriter(const AsyncSubtreeWriter&) = delete;
+    AsyncSubtreeWriter& operator=(const AsyncSubtreeWriter&) = delete;
+
+    inline ~AsyncSubtreeWriter();
+
+    /// \brief Wait for the previous subtree, then start writing `subtree`.
+    inline void save(subtree_type subtree, size_t subtree_id);
+
+    /// \brief Wait until all subtrees have been written.
+    inline void wait();
+
+  private:
+    const Storage& storage;
+    std::future<void> pending;
+};
+
+
+/** \brief Creates the top-level and all subtrees of the multi-index.
+ *
+ * The local partitioning on each rank uses `n_threads` threads. Each subtree
+ * is written by an `AsyncSubtreeWriter`, while the next one is built.
+ *
+ * The elements are distributed such that every rank has the same total
+ * `weight`, see `DistributedSortTileRecursion`. Every rank creates the same
+ * number of subtrees, i.e. `str_params.local`; hence, the subtrees balance
+ * the weight too, rather than the number of elements.
+ */
+template <class GetCenterCoordinate, class Storage, class Value, class Weight = UnitWeight>
 void distributed_partition(const Storage &storage,
                            std::vector<Value> &values,
                            const TwoLevelSTRParams &str_params,
-                           MPI_Comm comm);
+                           MPI_Comm comm,
+                           size_t n_threads = 1,
+                           const Weight &weight = Weight{});
 
 
 }
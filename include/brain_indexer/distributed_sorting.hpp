@@ -10,6 +10,10 @@
 #include <algorithm>
 #include <numeric>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 #include <brain_indexer/mpi_wrapper.hpp>
 
@@ -61,6 +65,41 @@ public:
      */
     static void sort_and_balance(Values &values, MPI_Comm comm);
 
+    /**
+     * \brief Sort and re-distribute values such that every rank has the same weight.
+     *
+     * Like `sort_and_balance`, but the sum of `weight(value)` over the values
+     * on each rank is (roughly) the same, rather than their number. Every
+     * rank keeps at least one value, if there are enough values.
+     *
+     * \param weight  Computes the non-negative weight of a value, as a
+     *                `double`. If all weights are zero, the values are
+     *                balanced by count.
+     *
+     * \throws std::invalid_argument if any weight is negative.
+     */
+    template <class Weight>
+    static void sort_and_balance(Values &values, MPI_Comm comm, const Weight &weight);
+
+    /**
+     * \brief Sort and evenly re-distribute values, moving every value only once.
+     *
+     * The result is the same as `sort_and_balance`, except for the order of
+     * values with equal keys. Instead of sampling, the splitters are the
+     * exact keys at which the balanced parts start; they're found by
+     * bisecting the keys on all ranks at once. Hence, the sorted buckets are
+     * already balanced and a single exchange suffices.
+     *
+     * The buckets are exchanged point-to-point, in messages of at most
+     * `max_message_size` bytes; hence, the counts don't overflow `int` even
+     * for very large buckets. Since every bucket is sorted, the received
+     * buckets are merged, not sorted; and neighbouring buckets are merged
+     * while the others are still being received.
+     */
+    static void sort_and_balance_once(Values &values,
+                                      MPI_Comm comm,
+                                      size_t max_message_size = size_t(1) << 30);
+
 private:
     DistributedMemorySorter();
     ~DistributedMemorySorter();
@@ -87,6 +126,29 @@ private:
      * MPI rank will have an equal (plus/minus one) number of elements.
      */
     auto balance(const Values &values, MPI_Comm comm) -> Values;
+
+    /// \brief Distributes elements such that every rank has the same weight.
+    template <class Weight>
+    auto balance(const Values &values, MPI_Comm comm, const Weight &weight) -> Values;
+
+    /**
+     * \brief The local indices at which the balanced parts start.
+     *
+     * The values must be sorted. Returns `comm_size + 1` offsets, such that
+     * the values in `[split[i], split[i+1])` of all ranks form part `i`.
+     */
+    auto find_balanced_splits(const Values &sorted, MPI_Comm comm) -> std::vector<size_t>;
+
+    /// \brief Send `[split[i], split[i+1])` to rank `i`, and merge what's received.
+    auto exchange_and_merge(const Values &sorted,
+                            const std::vector<size_t> &split,
+                            size_t max_message_size,
+                            MPI_Comm comm) -> Values;
+
+    /// \brief Send `send_counts[i]` consecutive elements to rank `i`, keeping their order.
+    auto redistribute(const Values &values,
+                      const std::vector<int> &send_counts,
+                      MPI_Comm comm) -> Values;
 };
 
 
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <list>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+
+namespace brain_indexer {
+
+/** \brief The meta data required to compute usage rate.
+ *
+ * The assumption is that there's a global query counter. It increases on
+ * every query of the spatial index.
+ *
+ * The current value query counter at time of loading the subtree is stored as
+ * the `load_generation`. The `current_access_count` is increased everytime
+ * the subtree is requested.
+ *
+ * On eviction `previous_*` are increased such that they reflect the historic usage
+ * rate.
+ */
+class UsageRateMetaData {
+  public:
+    inline double usage_rate(size_t query_count) const;
+    inline size_t access_count() const;
+    inline size_t eviction_count() const;
+    inline size_t incache_count(size_t query_count) const;
+
+
+    /// \brief To be called every time the subtree is queries while residing cache.
+    inline void on_query();
+
+    /// \brief To be called every time the subtree is loaded into cache.
+    inline void on_load(size_t query_count);
+
+    /// \brief To be called immediately before evicting the subtree.
+    inline void on_evict(size_t query_count);
+
+  private:
+    size_t load_generation_ = 0;
+    size_t current_access_count_ = 0;
+
+    size_t previous_access_count_ = 0;
+    size_t previous_age_ = 0;
+
+    size_t eviction_count_ = 0;
+};
+
+/// \brief The eviction policies which can be selected at runtime.
+enum class EvictionPolicyKind {
+    /// Evict the subtree with the lowest usage rate, see `UsageRateEvictionPolicy`.
+    usage_rate,
+    /// Evict the least recently used subtree, see `LRUEvictionPolicy`.
+    lru,
+    /// Second-chance approximation of LRU, see `ClockEvictionPolicy`.
+    clock,
+    /// Weigh the size of a subtree against its reload cost, see `CostAwareEvictionPolicy`.
+    cost_aware
+};
+
+/** \brief Parse the name of an eviction policy, e.g. `"lru"`.
+ *
+ *  The names are those of the enumerators of `EvictionPolicyKind`.
+ *
+ *  \throws std::invalid_argument if the name is unknown.
+ */
+inline EvictionPolicyKind eviction_policy_from_string(const std::string& name);
+
+
+/** \brief Eviction policies decide which subtrees a `UsageRateCache` evicts.
+ *
+ *  Every policy offers:
+ *
+ *    - `on_load(id, n_bytes, load_seconds, query_count)` which is called after
+ *      the subtree `id` was added to the cache. The time it took to load it
+ *      is only known if the cache loaded it, e.g. not if it was prefetched.
+ *
+ *    - `on_query(id, query_count)` which is called when a cached subtree is
+ *      requested again.
+ *
+ *    - `select_victims(meta_data, query_count, n, victims)` which appends the
+ *      ids of `n` cached subtrees to `victims`. The policy forgets about
+ *      them, and the cache must evict them. `meta_data` is the usage
+ *      statistic the cache keeps for every subtree.
+ *
+ *  The cache ensures that `n` doesn't exceed the number of cached subtrees.
+ */
+using EvictionMetaData = std::unordered_map<size_t, UsageRateMetaData>;
+
+
+/** \brief Evict the subtrees with the lowest usage rate.
+ *
+ *  This is the original policy of `UsageRateCache`; see `UsageRateMetaData`.
+ *  Since the usage rate depends on the query count, the order of the subtrees
+ *  changes over time. Hence, selecting the victims is linear in the number of
+ *  cached subtrees.
+ */
+class UsageRateEvictionPolicy {
+  public:
+    inline void on_load(size_t id,
+                        size_t n_bytes,
+                        std::optional<double> load_seconds,
+                        size_t query_count);
+
+    inline void on_query(size_t id, size_t query_count);
+
+    inline void select_victims(const EvictionMetaData& meta_data,
+                               size_t query_count,
+                               size_t n,
+                               std::vector<size_t>& victims);
+
+  private:
+    std::vector<size_t> cached_ids;
+    std::unordered_map<size_t, size_t> positions;
+
+    // Reused, to avoid allocating on every eviction.
+    std::vector<std::pair<double, size_t>> candidates;
+};
+
+
+/** \brief Evict the least recently used subtrees.
+ *
+ *  All operations are O(1). This suits access patterns which move through
+ *  space, e.g. a sliding window along a fibre tract.
+ */
+class LRUEvictionPolicy {
+  public:
+    inline void on_load(size_t id,
+                        size_t n_bytes,
+                        std::optional<double> load_seconds,
+                        size_t query_count);
+
+    inline void on_query(size_t id, size_t query_count);
+
+    inline void select_victims(const EvictionMetaData& meta_data,
+                               size_t query_count,
+                               size_t n,
+                               std::vector<size_t>& victims);
+
+  private:
+    // The most recently used subtree is at the front.
+    std::list<size_t> order;
+    std::unordered_map<size_t, std::list<size_t>::iterator> positions;
+};
+
+
+/** \brief The CLOCK, or second-chance, approximation of LRU.
+ *
+ *  The subtrees are arranged in a ring. A query only sets the reference bit
+ *  of the subtree, which is cheaper than reordering a list. To select a
+ *  victim the hand sweeps the ring: subtrees that were referenced lose their
+ *  bit and get a second chance; the first one without is evicted.
+ */
+class ClockEvictionPolicy {
+  public:
+    inline void on_load(size_t id,
+                        size_t n_bytes,
+                        std::optional<double> load_seconds,
+                        size_t query_count);
+
+    inline void on_query(size_t id, size_t query_count);
+
+    inline void select_victims(const EvictionMetaData& meta_data,
+                               size_t query_count,
+                               size_t n,
+                               std::vector<size_t>& victims);
+
+  private:
+    struct Slot {
+        size_t id;
+        bool is_occupied;
+        bool is_referenced;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<size_t> free_slots;
+    std::unordered_map<size_t, size_t> positions;
+    size_t hand = 0;
+};
+
+
+/** \brief Weigh the size of a subtree against the cost of reloading it.
+ *
+ *  This is the GreedyDual-Size policy. Every subtree has a priority
+ *  `H = L + cost / size`, which is renewed when the subtree is queried.
+ *  The subtree with the lowest priority is evicted, and `L` is raised to
+ *  its priority. Hence, subtrees which are small or expensive to reload stay
+ *  longer; and subtrees which aren't queried age as `L` increases.
+ *
+ *  The cost is the time it took to load the subtree. If it's unknown, e.g.
+ *  for prefetched subtrees, it's estimated from the average time per byte.
+ */
+class CostAwareEvictionPolicy {
+  public:
+    inline void on_load(size_t id,
+                        size_t n_bytes,
+                        std::optional<double> load_seconds,
+                        size_t query_count);
+
+    inline void on_query(size_t id, size_t query_count);
+
+    inline void select_victims(const EvictionMetaData& meta_data,
+                               size_t query_count,
+                               size_t n,
+                               std::vector<size_t>& victims);
+
+  private:
+    struct State {
+        double priority;
+        double cost_per_byte;
+    };
+
+    std::set<std::pair<double, size_t>> queue;
+    std::unordered_map<size_t, State> states;
+    double inflation = 0.0;
+
+    double total_load_seconds = 0.0;
+    double total_loaded_bytes = 0.0;
+};
+
+
+/** \brief The eviction policy is selected at runtime.
+ *
+ *  This is the default policy of `UsageRateCache`; such that the policy can
+ *  be chosen through `UsageRateCacheParams::eviction_policy`, e.g. from
+ *  Python.
+ */
+class SelectableEvictionPolicy {
+  public:
+    inline SelectableEvictionPolicy() = default;
+    inline explicit SelectableEvictionPolicy(EvictionPolicyKind kind);
+
+    inline void on_load(size_t id,
+                        size_t n_bytes,
+                        std::optional<double> load_seconds,
+                        size_t query_count);
+
+    inline void on_query(size_t id, size_t query_count);
+
+    inline void select_victims(const EvictionMetaData& meta_data,
+                               size_t query_count,
+                               size_t n,
+                               std::vector<size_t>& victims);
+
+  private:
+    std::variant<UsageRateEvictionPolicy,
+                 LRUEvictionPolicy,
+                 ClockEvictionPolicy,
+                 CostAwareEvictionPolicy> policy;
+};
+
+}  // namespace brain_indexer
+
+#include "detail/eviction_policies.hpp"
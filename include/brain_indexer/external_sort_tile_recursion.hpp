@@ -0,0 +1,120 @@
+#pragma once
+
+#if SI_MPI == 1
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <brain_indexer/distributed_sort_tile_recursion.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/mpi_wrapper.hpp>
+#include <brain_indexer/sort_tile_recursion.hpp>
+
+namespace brain_indexer {
+
+/** \brief The elements of one MPI rank, spilled to disk in sorted runs.
+ *
+ * Every call to `spill` sorts the elements along the x-axis, as in the first
+ * step of STR, and writes them to a new file in `scratch_dir`. The files
+ * contain the raw bytes of the elements, like `MPI_Alltoallv` sends them.
+ *
+ * \tparam GetCoordinate  See `SerialSortTileRecursion`.
+ */
+template <class Value, class GetCoordinate>
+class SpilledRuns {
+  public:
+    SpilledRuns() = default;
+
+    /// \brief The runs are called `<scratch_dir>/<prefix>_<k>.bin`.
+    inline SpilledRuns(std::string scratch_dir, std::string prefix);
+
+    /// \brief Sort `values`, write them as a new run and clear `values`.
+    inline void spill(std::vector<Value>& values);
+
+    /// \brief Append `count` elements of run `k`, starting at `offset`, to `values`.
+    inline void read(size_t k, size_t offset, size_t count, std::vector<Value>& values) const;
+
+    /// \brief Delete all runs.
+    inline void remove();
+
+    /// \brief The number of elements in all runs.
+    inline size_t size() const;
+
+    inline size_t n_runs() const;
+    inline size_t run_size(size_t k) const;
+
+  private:
+    std::string scratch_dir_;
+    std::string prefix_;
+    std::vector<std::string> filenames_;
+    std::vector<size_t> run_sizes_;
+};
+
+
+/** \brief The planes which cut space into the parts of STR.
+ *
+ * These are the STR boundaries of a sample of the elements. There is one
+ * plane per slab along x, per slab along y in every x-slab, and per part
+ * along z. Hence, the parts don't overlap (except on the planes) and each
+ * contains roughly the same number of elements.
+ */
+struct STRSplitters {
+    std::array<size_t, 3> n_parts_per_dim;
+
+    /// Lower boundary along x of every x-slab.
+    std::vector<CoordType> x;
+    /// Lower boundary along y of every y-slab, grouped by x-slab.
+    std::vector<CoordType> y;
+    /// Lower boundary along z of every part.
+    std::vector<CoordType> z;
+
+    inline size_t n_parts() const;
+
+    /// \brief The part with `centroid`, in the same order as `SerialSTRParams`.
+    inline size_t part(const Point3Dx& centroid) const;
+};
+
+/** \brief Compute the splitters which partition `samples` by STR.
+ *
+ * \throws std::runtime_error if there are fewer samples than parts.
+ */
+inline STRSplitters compute_str_splitters(std::vector<Point3Dx> samples,
+                                          const std::array<size_t, 3>& n_parts_per_dim);
+
+
+/** \brief Creates the top-level and all subtrees of a multi-index out of core.
+ *
+ * This is the external memory version of `distributed_partition`, for
+ * elements that don't fit into the memory of all ranks. It works in three
+ * passes over the spilled elements:
+ *
+ *   1. A regular sample is drawn from the runs of every rank. Every rank
+ *      computes the same `STRSplitters` from the combined sample.
+ *
+ *   2. The parts are assigned to the ranks in contiguous blocks. The runs are
+ *      read in chunks of at most `max_elements_in_memory` elements, and
+ *      every chunk is sent to the owners of its elements; who append them
+ *      to one file per part. Since the runs are sorted, ranks start reading
+ *      at different offsets; otherwise they'd all send to the same owners.
+ *
+ *   3. Every rank loads its parts one at a time, and saves them as subtrees;
+ *      the next part is built while the previous one is written. Rank 0
+ *      saves the top-level tree.
+ *
+ * Only one chunk, and then two parts, must fit into memory. The runs are
+ * deleted afterwards.
+ */
+template <class GetCenterCoordinate, class Storage, class Value>
+void external_distributed_partition(const Storage& storage,
+                                    SpilledRuns<Value, GetCenterCoordinate>& runs,
+                                    const std::string& scratch_dir,
+                                    size_t max_elements_per_part,
+                                    size_t max_elements_in_memory,
+                                    MPI_Comm comm);
+
+}
+
+#include "detail/external_sort_tile_recursion.hpp"
+
+#endif
@@ -1,5 +1,11 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 #include <boost/serialization/serialization.hpp>
 
 #include "point3d.hpp"
@@ -224,6 +230,185 @@ struct Cylinder {
     }
 };
 
+/**
+ * \brief A box which isn't aligned with the coordinate axes; a query shape.
+ *
+ * The box consists of all points `center + t0 * axes[0] + t1 * axes[1] + t2 * axes[2]`
+ * with `|tk| <= half_extents[k]`. The axes must be orthonormal.
+ */
+struct OrientedBox {
+    using box_type = Box3D;
+
+    Point3D center;
+    std::array<Point3D, 3> axes;
+    Point3D half_extents;
+
+    OrientedBox() = default;
+    inline OrientedBox(const Point3D& center,
+                       const std::array<Point3D, 3>& axes,
+                       const Point3D& half_extents)
+        : center(center), axes(axes), half_extents(half_extents) {}
+
+    inline Box3D bounding_box() const;
+
+    /// \brief The coordinates of `p` along `axes`, relative to `center`.
+    inline Point3D to_local(const Point3D& p) const;
+
+    /// \brief The box itself, in the coordinates of `to_local`.
+    inline Box3D local_box() const {
+        return Box3D(Point3Dx(half_extents) * CoordType(-1), half_extents);
+    }
+
+    /// \brief Separating-axis test, exact.
+    inline bool intersects(Box3D const& b) const;
+    inline bool intersects(Sphere const& s) const;
+    inline bool intersects(Cylinder const& c) const;
+    inline bool intersects(Point3D const& p) const;
+
+    inline bool contains(Point3D const& p) const;
+};
+
+/// \brief The half-space of all points `x` with `dot(normal, x) <= offset`.
+struct HalfSpace {
+    Point3D normal;
+    CoordType offset;
+};
+
+/**
+ * \brief A convex polytope, the intersection of half-spaces; a query shape.
+ *
+ * For example, a view frustum is the intersection of six half-spaces. The
+ * polytope must be bounded and its interior not empty. Its vertices and
+ * edges are computed once, on construction, for the separating-axis tests.
+ */
+class ConvexPolytope {
+  public:
+    using box_type = Box3D;
+
+    ConvexPolytope() = default;
+    inline explicit ConvexPolytope(const std::vector<HalfSpace>& half_spaces);
+    inline explicit ConvexPolytope(const OrientedBox& box);
+
+    /// \brief The half-spaces, with normals of unit length.
+    inline const std::vector<HalfSpace>& half_spaces() const noexcept {
+        return half_spaces_;
+    }
+
+    inline const std::vector<Point3D>& vertices() const noexcept {
+        return vertices_;
+    }
+
+    /// \brief The edges, as pairs of indices into `vertices()`.
+    inline const std::vector<std::pair<size_t, size_t>>& edges() const noexcept {
+        return edges_;
+    }
+
+    inline const Box3D& bounding_box() const noexcept {
+        return bounding_box_;
+    }
+
+    /// \brief The squared distance from `p` to the polytope; zero inside.
+    inline CoordType distance_sq(const Point3D& p) const;
+
+    /// \brief Separating-axis test, exact.
+    inline bool intersects(Box3D const& b) const;
+    inline bool intersects(Sphere const& s) const;
+    inline bool intersects(Cylinder const& c) const;
+    inline bool intersects(Point3D const& p) const;
+
+    inline bool contains(Point3D const& p) const;
+
+  private:
+    std::vector<HalfSpace> half_spaces_;
+    std::vector<Point3D> vertices_;
+    std::vector<std::pair<size_t, size_t>> edges_;
+    std::vector<Point3D> edge_directions_;
+    Box3D bounding_box_;
+};
+
+/**
+ * \brief A region given by a mask of voxels, e.g. a brain region of an atlas; a query shape.
+ *
+ * Voxel `(i, j, k)` covers the box from `origin + (i, j, k) * voxel_size` to
+ * `origin + (i + 1, j + 1, k + 1) * voxel_size`; the region is the union of the
+ * voxels which are set. The mask is stored as a summed-volume table, such that
+ * the number of set voxels in any block of voxels is known in constant time.
+ * Hence, boxes are classified as outside, inside or on the boundary of the
+ * region cheaply; and only elements in boundary voxels are tested exactly.
+ */
+class VoxelMask {
+  public:
+    using box_type = Box3D;
+    using shape_type = std::array<size_t, 3>;
+
+    VoxelMask() = default;
+
+    /// \brief The mask has `shape[0] * shape[1] * shape[2]` entries in C order.
+    inline VoxelMask(const Point3D& origin,
+                     const Point3D& voxel_size,
+                     const shape_type& shape,
+                     const std::uint8_t* mask);
+
+    inline const Point3D& origin() const noexcept {
+        return origin_;
+    }
+
+    inline const Point3D& voxel_size() const noexcept {
+        return voxel_size_;
+    }
+
+    inline const shape_type& shape() const noexcept {
+        return shape_;
+    }
+
+    /// \brief The bounding box of the voxels which are set.
+    inline const Box3D& bounding_box() const noexcept {
+        return bounding_box_;
+    }
+
+    inline bool is_set(size_t i, size_t j, size_t k) const;
+
+    /// \brief The number of set voxels touched by `b`.
+    inline size_t count(Box3D const& b) const;
+
+    /// \brief Are all voxels touched by `b` set, and `b` inside the mask.
+    inline bool covers(Box3D const& b) const;
+
+    inline bool intersects(Box3D const& b) const;
+    inline bool intersects(Sphere const& s) const;
+    inline bool intersects(Cylinder const& c) const;
+    inline bool intersects(Point3D const& p) const;
+
+    inline bool contains(Point3D const& p) const;
+
+  private:
+    /// \brief The voxels `low[d] <= i[d] < high[d]`.
+    struct VoxelRange {
+        shape_type low;
+        shape_type high;
+
+        inline size_t size() const {
+            return (high[0] - low[0]) * (high[1] - low[1]) * (high[2] - low[2]);
+        }
+    };
+
+    /// \brief The voxels touched by `b`; `false` if there are none.
+    inline bool voxel_range(Box3D const& b, VoxelRange& range) const;
+    inline size_t count(const VoxelRange& range) const;
+    inline Box3D voxel_box(size_t i, size_t j, size_t k) const;
+
+    template <class ShapeT>
+    inline bool intersects_voxels(ShapeT const& shape) const;
+
+    Point3D origin_;
+    Point3D voxel_size_;
+    shape_type shape_ = {0, 0, 0};
+
+    // The number of set voxels in `[0, i) x [0, j) x [0, k)`.
+    std::vector<std::uint32_t> summed_volume_;
+    Box3D bounding_box_;
+};
+
 inline CoordType characteristic_length(const Sphere &sph) {
     return 2*sph.radius;
 }
@@ -278,7 +463,12 @@ inline bool geometry_intersects(const Box3D& query_shape, const Point3D& element
 
 template <class QueryShape,
           class ElementShape,
-          std::enable_if_t<shape_matches_any_of<QueryShape, Sphere, Cylinder>() &&
+          std::enable_if_t<shape_matches_any_of<QueryShape,
+                                                Sphere,
+                                                Cylinder,
+                                                OrientedBox,
+                                                ConvexPolytope,
+                                                VoxelMask>() &&
                                shape_matches_any_of<ElementShape, Point3D, Box3D>(),
                            int> SFINAE = 0>
 inline bool geometry_intersects(const QueryShape& query_shape,
@@ -289,7 +479,13 @@ inline bool geometry_intersects(const QueryShape& query_shape,
 
 template <class QueryShape,
           class ElementShape,
-          std::enable_if_t<shape_matches_any_of<QueryShape, Box3D, Sphere, Cylinder>() &&
+          std::enable_if_t<shape_matches_any_of<QueryShape,
+                                                Box3D,
+                                                Sphere,
+                                                Cylinder,
+                                                OrientedBox,
+                                                ConvexPolytope,
+                                                VoxelMask>() &&
                                shape_matches_any_of<ElementShape, Sphere, Cylinder>(),
                            int> SFINAE = 0>
 inline bool geometry_intersects(const QueryShape& query_shape,
@@ -298,6 +494,75 @@ inline bool geometry_intersects(const QueryShape& query_shape,
     return geometry_intersects(query_shape, element_shape.bounding_box(), geo);
 }
 
+/** \brief Does the interior of `query_shape` contain all of `box`.
+ *
+ *  If it does, every element whose bounding box lies in `box` intersects
+ *  `query_shape` with `BoundingBoxGeometry`; and can be counted without
+ *  testing it. For other query shapes this is `false`, which is always safe.
+ */
+template <class QueryShape>
+inline bool strictly_contains(const QueryShape& /* query_shape */, const Box3D& /* box */) {
+    return false;
+}
+
+inline bool strictly_contains(const Box3D& query_shape, const Box3D& box) {
+    const auto& q_min = query_shape.min_corner();
+    const auto& q_max = query_shape.max_corner();
+    const auto& b_min = box.min_corner();
+    const auto& b_max = box.max_corner();
+
+    return q_min.get<0>() < b_min.get<0>() && b_max.get<0>() < q_max.get<0>()
+        && q_min.get<1>() < b_min.get<1>() && b_max.get<1>() < q_max.get<1>()
+        && q_min.get<2>() < b_min.get<2>() && b_max.get<2>() < q_max.get<2>();
+}
+
+inline bool strictly_contains(const Sphere& query_shape, const Box3D& box) {
+    // The distance along each axis to the farthest corner of the box.
+    auto farthest = [](CoordType c, CoordType low, CoordType high) {
+        return std::max(c - low, high - c);
+    };
+
+    const auto& c = query_shape.centroid;
+    const auto& b_min = box.min_corner();
+    const auto& b_max = box.max_corner();
+
+    auto dx = farthest(c.get<0>(), b_min.get<0>(), b_max.get<0>());
+    auto dy = farthest(c.get<1>(), b_min.get<1>(), b_max.get<1>());
+    auto dz = farthest(c.get<2>(), b_min.get<2>(), b_max.get<2>());
+
+    return dx * dx + dy * dy + dz * dz < query_shape.radius * query_shape.radius;
+}
+
+inline bool strictly_contains(const OrientedBox& query_shape, const Box3D& box);
+inline bool strictly_contains(const ConvexPolytope& query_shape, const Box3D& box);
+
+inline bool strictly_contains(const VoxelMask& query_shape, const Box3D& box) {
+    return query_shape.covers(box);
+}
+
+/** \brief Can an element whose bounding box lies in `box` intersect `query_shape`.
+ *
+ *  Used to prune the nodes of a tree, in addition to their bounding boxes.
+ *  Only shapes with a cheap test against boxes, i.e. a separating-axis test
+ *  or a lookup in a voxel mask, do better than `true`.
+ */
+template <class QueryShape>
+inline bool may_intersect(const QueryShape& /* query_shape */, const Box3D& /* box */) {
+    return true;
+}
+
+inline bool may_intersect(const OrientedBox& query_shape, const Box3D& box) {
+    return query_shape.intersects(box);
+}
+
+inline bool may_intersect(const ConvexPolytope& query_shape, const Box3D& box) {
+    return query_shape.intersects(box);
+}
+
+inline bool may_intersect(const VoxelMask& query_shape, const Box3D& box) {
+    return query_shape.intersects(box);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Best-effort Geometry
 ///////////////////////////////////////////////////////////////////////////////
@@ -312,7 +577,12 @@ inline bool geometry_intersects(const Box3D& query_shape,
 template <
     class QueryShape,
     class ElementShape,
-    std::enable_if_t<shape_matches_any_of<QueryShape, Sphere, Cylinder>() &&
+    std::enable_if_t<shape_matches_any_of<QueryShape,
+                                              Sphere,
+                                              Cylinder,
+                                              OrientedBox,
+                                              ConvexPolytope,
+                                              VoxelMask>() &&
                          shape_matches_any_of<ElementShape, Point3D, Box3D, Sphere, Cylinder>(),
                      int> SFINAE = 0>
 inline bool geometry_intersects(const QueryShape& query_shape,
@@ -324,6 +594,8 @@ inline bool geometry_intersects(const QueryShape& query_shape,
 
 inline std::ostream& operator<<(std::ostream& os, const Sphere& s);
 inline std::ostream& operator<<(std::ostream& os, const Cylinder& c);
+inline std::ostream& operator<<(std::ostream& os, const OrientedBox& b);
+inline std::ostream& operator<<(std::ostream& os, const VoxelMask& m);
 
 }  // namespace brain_indexer
 
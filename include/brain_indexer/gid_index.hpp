@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <brain_indexer/geometries.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/meta_data.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A run of consecutive elements of one gid in a subtree of a multi-index.
+ *
+ *  The positions refer to the order in which the subtree iterates over its
+ *  elements, i.e. `subtree.begin()`. For packed subtrees that's the order in
+ *  which the elements are stored; hence, the run can be copied directly.
+ */
+struct GidIndexEntry {
+    std::uint64_t subtree_id;
+    /// \brief The number of elements in the subtree.
+    std::uint64_t subtree_size;
+    std::uint64_t first;
+    /// \brief One past the last position of the run.
+    std::uint64_t last;
+    /// \brief The bounding box of the elements of the run.
+    Box3D bounds;
+};
+
+/// \brief A `GidIndexEntry` together with its gid.
+struct GidIndexRun {
+    identifier_t gid;
+    GidIndexEntry entry;
+};
+
+/** \brief A secondary index from gids to the location of their elements in a multi-index.
+ *
+ *  For every gid it stores the runs of its elements in the subtrees, see
+ *  `GidIndexEntry`. Hence, `get_by_gid` only loads the subtrees which contain
+ *  elements of the gid; rather than every subtree which overlaps the region
+ *  of the cell. In packed subtrees only those elements are read.
+ *
+ *  The index is stored next to the `meta_data.json` of the multi-index, see
+ *  `write_gid_index` and `open_gid_index`.
+ */
+class GidIndex {
+  public:
+    GidIndex() = default;
+
+    /// \brief An index of `runs`, which can be in any order.
+    inline explicit GidIndex(std::vector<GidIndexRun> runs);
+
+    /// \brief The runs of `gid`, sorted by subtree and position; empty if there are none.
+    inline std::pair<const GidIndexEntry*, const GidIndexEntry*> entries(identifier_t gid) const;
+
+    /// \brief The ids of the subtrees which contain elements of `gid`, in ascending order.
+    inline std::vector<size_t> subtree_ids(identifier_t gid) const;
+
+    inline size_t n_gids() const {
+        return gids_.size();
+    }
+
+    inline size_t n_entries() const {
+        return entries_.size();
+    }
+
+    /** \brief Write the index to `filename`.
+     *
+     *  The arrays are copied bytewise. Hence, the layout isn't portable across
+     *  architectures with different endianness or type layouts.
+     */
+    inline void write(const std::string& filename) const;
+
+    /** \brief Read an index written by `write`.
+     *
+     *  \throws std::runtime_error if the file isn't a gid index.
+     */
+    inline static GidIndex read(const std::string& filename);
+
+  private:
+    std::vector<identifier_t> gids_;
+    std::vector<std::uint64_t> offsets_;
+    std::vector<GidIndexEntry> entries_;
+};
+
+
+/// \brief The gid of an element; the post-synaptic gid of a synapse.
+template <class T>
+inline identifier_t element_gid(const T& value);
+
+template <class... Ts>
+inline identifier_t element_gid(const boost::variant<Ts...>& value);
+
+
+/// \brief Append the runs of consecutive elements of equal gid in `subtree` to `runs`.
+template <class SubTree>
+inline void collect_gid_runs(const SubTree& subtree,
+                             size_t subtree_id,
+                             std::vector<GidIndexRun>& runs);
+
+/// \brief The gid index of all subtrees in `storage`.
+template <class Storage>
+inline GidIndex build_gid_index(const Storage& storage);
+
+
+/** \brief Build the gid index of the multi-index in `output_dir`.
+ *
+ *  Every subtree is loaded once. The index is written next to the meta data,
+ *  which records its path. Note that `append_to_multi_index` removes the
+ *  gid index, since it moves elements between subtrees.
+ */
+template <class Value, class Storage = NativeStorageT<Value>>
+inline void write_gid_index(const std::string& output_dir);
+
+#if SI_MPI == 1
+/** \brief Build the gid index of the multi-index in `output_dir`, using all ranks of `comm`.
+ *
+ *  The subtrees are split among the ranks; rank `0` writes the index.
+ *
+ *  \note This is an MPI collective operation and all ranks must participate.
+ */
+template <class Value, class Storage = NativeStorageT<Value>>
+inline void write_gid_index(const std::string& output_dir, MPI_Comm comm);
+#endif
+
+/// \brief Does the multi-index in `output_dir` have a gid index.
+inline bool has_gid_index(const std::string& output_dir);
+
+/** \brief Read the gid index of the multi-index in `output_dir`.
+ *
+ *  \throws std::runtime_error if it doesn't have one, see `write_gid_index`.
+ */
+inline GidIndex open_gid_index(const std::string& output_dir);
+
+
+/** \brief All elements of `gid` in `index`.
+ *
+ *  Only the subtrees listed by `gid_index` are loaded, through the cache of
+ *  `index`. In packed subtrees, e.g. those of `MemoryMappedMultiIndexTree`,
+ *  the runs are copied directly; hence, the cost is proportional to the
+ *  number of elements returned. Other subtrees are queried with the bounding
+ *  boxes of the runs.
+ *
+ *  The elements are ordered by subtree, and by their position within it.
+ */
+template <class T, class SubtreeCache>
+inline std::vector<T> get_by_gid(const MultiIndexTree<T, SubtreeCache>& index,
+                                 const GidIndex& gid_index,
+                                 identifier_t gid);
+
+}  // namespace brain_indexer
+
+#include "detail/gid_index.hpp"
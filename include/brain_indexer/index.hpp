@@ -3,9 +3,12 @@
 #ifndef BOOST_GEOMETRY_INDEX_DETAIL_EXPERIMENTAL
 #error "BrainIndexer requires definition BOOST_GEOMETRY_INDEX_DETAIL_EXPERIMENTAL"
 #endif
+#include <array>
+#include <cstdint>
 #include <cstdio>
 #include <functional>
 #include <iostream>
+#include <type_traits>
 #include <unordered_map>
 
 // boost::serialize before boost::geometry
@@ -22,6 +25,7 @@
 #include <brain_indexer/geometries.hpp>
 #include <brain_indexer/util.hpp>
 #include <brain_indexer/logging.hpp>
+#include <brain_indexer/query_stats.hpp>
 #include <brain_indexer/version.hpp>
 
 namespace brain_indexer {
@@ -57,10 +61,6 @@ struct gid_segm_t {
 };
 
 
-/// \brief result iterator to run a given callback
-template <typename ArgT>
-struct iter_callback;
-
 /// \brief result iterator to collect gids
 struct iter_ids_getter;
 
@@ -71,6 +71,14 @@ struct iter_gid_segm_getter;
 template<typename Element>
 struct iter_entry_getter;
 
+/** \brief Selects the fields collected by `iter_entry_getter`, one bit per field.
+ *
+ * The bits of each type of element are listed in `detail::query_result<T>::field`.
+ */
+using query_fields_t = std::uint32_t;
+
+constexpr query_fields_t all_query_fields = ~query_fields_t(0);
+
 /**
  * \brief ShapeId adds an 'id' field to the underlying struct
  */
@@ -463,6 +471,142 @@ typedef boost::variant<Sphere, Cylinder> GeometryEntry;
 typedef boost::variant<Soma, Segment> MorphoEntry;
 
 
+namespace detail {
+
+/** \brief The exact test of a query: `geometry_intersects(shape, v, GeometryMode{})`.
+ *
+ *  Unlike a lambda, this can be recognized by the index; which allows
+ *  `PackedRTree` to test all candidates of a leaf at once.
+ */
+template <typename GeometryMode, typename ShapeT>
+struct GeometryIntersects {
+    const ShapeT& shape;
+
+    template <typename Value>
+    inline bool operator()(const Value& value) const {
+        bool is_hit = geometry_intersects(shape, value, GeometryMode{});
+
+        if(std::is_same<GeometryMode, BestEffortGeometry>::value) {
+            SI_QUERY_STATS_ADD(exact_tests, 1);
+        }
+        SI_QUERY_STATS_ADD(hits, std::uint64_t(is_hit));
+
+        return is_hit;
+    }
+};
+
+/// \brief Is the geometry of `Value` its bounding box, for queries with `BoundingBoxGeometry`.
+template <typename Value>
+struct has_box_geometry
+    : std::integral_constant<bool, shape_matches_any_of<Value, Sphere, Cylinder>()> {};
+
+template <typename... V>
+struct has_box_geometry<boost::variant<V...>> : std::conjunction<has_box_geometry<V>...> {};
+
+/** \brief Does the bounding box test of a query already decide `GeometryIntersects`.
+ *
+ *  True for boxes queried with `BoundingBoxGeometry`, if the elements are
+ *  spheres or cylinders: their exact test compares the same two boxes. Points
+ *  are excluded, since they must lie strictly inside the box.
+ */
+template <typename GeometryMode, typename ShapeT, typename Value>
+constexpr bool is_decided_by_bounding_box() {
+#if SI_QUERY_STATS == 1
+    // The exact test also counts the hits.
+    return false;
+#else
+    return std::is_same<GeometryMode, BoundingBoxGeometry>::value
+        && std::is_same<ShapeT, Box3D>::value
+        && has_box_geometry<Value>::value;
+#endif
+}
+
+/** \brief The predicate of a query for the elements of type `Value` intersecting `shape`.
+ *
+ *  This is `intersects(box) && satisfies(GeometryIntersects{shape})`, where
+ *  `box` is the bounding box of `shape`; without the exact test whenever it's
+ *  redundant, see `is_decided_by_bounding_box`.
+ */
+template <typename GeometryMode, typename Value, typename ShapeT>
+inline auto intersects_predicate(const ShapeT& shape, const Box3D& box) {
+    if constexpr (is_decided_by_bounding_box<GeometryMode, ShapeT, Value>()) {
+        return bgi::intersects(box);
+    } else {
+        return bgi::intersects(box)
+            && bgi::satisfies(GeometryIntersects<GeometryMode, ShapeT>{shape});
+    }
+}
+
+template <typename GeometryMode, typename Value, typename ShapeT>
+inline auto intersects_predicate(const ShapeT& shape) {
+    return intersects_predicate<GeometryMode, Value>(shape, bgi::indexable<ShapeT>{}(shape));
+}
+
+/** \brief The candidate positions of a shape in a region, see `IndexTree::place`.
+ *
+ *  The positions of the minimum corner of the bounding box of the shape form
+ *  a grid over the region. Its spacing is an eighth of the largest extent of
+ *  the region; or finer, down to half the smallest extent of the shape, such
+ *  that small shapes also fit into gaps. The positions are ordered with `z`
+ *  varying fastest.
+ *
+ *  The elements near the region are rasterized onto the grid: each element
+ *  marks the few positions at which it intersects the shape, see
+ *  `BestEffortGeometry`. Hence, every element is tested once per grid;
+ *  rather than once per position, as in querying the tree at each position.
+ *  The elements are rasterized lazily, in order of the first slab of
+ *  constant `x` they reach; such that finding a position early in the grid
+ *  only costs the elements up to there.
+ */
+template <class T, class ShapeT>
+class PlacementGrid {
+  public:
+    static constexpr size_t max_steps_per_dim = 64;
+
+    /// \brief The grid for `shape` in `region`, occupied by `elements`.
+    inline PlacementGrid(const Box3D& region, const ShapeT& shape, std::vector<T> elements);
+
+    /// \brief Marks the positions at which the shape intersects `value` as occupied.
+    inline void add(const T& value);
+
+    /** \brief Moves `shape` to the first position which isn't occupied.
+     *
+     *  \returns false if every position is occupied.
+     */
+    inline bool next_free(ShapeT& shape);
+
+    /// \brief Marks the position returned by the last `next_free` as occupied.
+    inline void mark_occupied() {
+        occupied_[first_free_] = 1;
+    }
+
+    inline const std::array<CoordType, 3>& extent() const {
+        return extent_;
+    }
+
+  private:
+    /// \brief The first slab of constant `x` at which `value` might be in the way.
+    inline size_t first_slab(const T& value) const;
+
+    /// \brief The translation from the first position to `position`.
+    inline Point3D offset(size_t position) const;
+
+    ShapeT shape_;
+    std::array<CoordType, 3> region_min_;
+    std::array<CoordType, 3> extent_;
+    std::array<CoordType, 3> step_;
+    std::array<size_t, 3> n_steps_;
+
+    std::vector<char> occupied_;
+    size_t first_free_ = 0;
+
+    std::vector<T> pending_;
+    size_t n_rasterized_ = 0;
+};
+
+}  // namespace detail
+
+
 /// A shorthand for a default IndexTree with potentially custom allocator
 template <typename T, typename A = boost::container::new_allocator<T>>
 using IndexTreeBaseT = bgi::rtree<T, bgi::linear<16, 2>, bgi::indexable<T>, bgi::equal_to<T>, A>;
@@ -489,12 +633,58 @@ class IndexTreeMixin {
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename OutputIt>
     inline void find_intersecting(const ShapeT& shape, const OutputIt& iter) const;
 
+    /**
+     * \brief Find elements which intersect the shape and satisfy `filter`.
+     *
+     * The same as `find_intersecting`, except that `filter(value)` is
+     * evaluated in the traversal, before the exact intersection test. Hence,
+     * elements which don't match are neither tested nor collected. The
+     * `filter` is any predicate of the elements, e.g. an `AttributeFilter`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry,
+              typename ShapeT,
+              typename Filter,
+              typename OutputIt>
+    inline void find_intersecting_filtered(const ShapeT& shape,
+                                           const Filter& filter,
+                                           const OutputIt& iter) const;
+
     /**
      * \brief Finds & return objects which intersect, numpy version.
+     * \param fields: The fields to collect; the other fields are left empty.
      * \returns A vector of POD objects, to be exposed as numpy arrays(dtype)
      */
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
-    inline decltype(auto) find_intersecting_np(const ShapeT& shape) const;
+    inline decltype(auto) find_intersecting_np(const ShapeT& shape,
+                                               query_fields_t fields = all_query_fields) const;
+
+    /// \brief Finds & return objects which intersect and satisfy `filter`, numpy version.
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT, typename Filter>
+    inline decltype(auto) find_intersecting_filtered_np(
+        const ShapeT& shape,
+        const Filter& filter,
+        query_fields_t fields = all_query_fields) const;
+
+    /**
+     * \brief Runs `find_intersecting_np` for each shape in `shapes`.
+     *
+     * All matches are collected in a single growable buffer, which avoids
+     * allocating a new result for every query.
+     *
+     * If `n_threads > 1` and the index supports concurrent queries, see
+     * `supports_concurrent_queries`, the queries are split into chunks which
+     * are processed by `n_threads` threads. Otherwise, the queries are
+     * processed serially.
+     *
+     * Only the `fields` are collected, as in `find_intersecting_np`.
+     *
+     * \returns A `batch_query_result` in CSR format, i.e. the matches of
+     *   `shapes[i]` are the entries `offsets[i], ..., offsets[i+1]-1`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline decltype(auto) find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                                                  size_t n_threads = 1,
+                                                  query_fields_t fields = all_query_fields) const;
 
     /**
      * \brief Gets the ids of the the nearest K objects
@@ -507,12 +697,42 @@ class IndexTreeMixin {
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline size_t count_intersecting(const ShapeT& shape) const;
 
-    /// \brief Counts objects intersecting the given region deliminted by the shape
+    /// \brief Counts the objects intersecting the shape, per post-synaptic gid.
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline std::unordered_map<identifier_t, size_t> count_intersecting_agg_gid(
         const ShapeT& shape) const;
+
+    /** \brief The statistics of all queries of this index, see `QueryStats`.
+     *
+     *  Requires building with `SI_QUERY_STATS`; otherwise they're all zero.
+     */
+    inline QueryStats query_stats() const {
+        return query_stats_.get();
+    }
+
+    inline void reset_query_stats() {
+        query_stats_.reset();
+    }
+
+  protected:
+    /// \brief Records the statistics of the query on this thread, until it's destroyed.
+    inline detail::QueryStatsScope query_stats_scope(std::uint64_t n_queries = 1) const {
+        return detail::QueryStatsScope(query_stats_, n_queries);
+    }
+
+  private:
+    mutable detail::QueryStatsTotal query_stats_;
 };
 
+/**
+ * \brief Can `query` be called on the same instance from several threads?
+ *
+ * Indexes which modify internal state while querying, e.g. caches, must not
+ * be queried concurrently.
+ */
+template <typename Index>
+struct supports_concurrent_queries : std::false_type {};
+
 /**
  * \brief IndexTree is a Boost::rtree spatial index tree with helper methods
  *    for finding intersections and serialization.
@@ -565,8 +785,24 @@ class IndexTree: public IndexTreeMixin<IndexTree<T, A>, T>, public IndexTreeBase
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline std::vector<cref_t> find_intersecting_objs(const ShapeT& shape) const;
 
+    /** \brief Counts the elements intersecting `shape`.
+     *
+     *  With `BoundingBoxGeometry`, the elements of nodes which lie inside
+     *  `shape` are counted without testing them one by one.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
 
-    /// \brief Non-overlapping placement of Shapes
+    /** \brief Non-overlapping placement of Shapes
+     *
+     *  Moves `shape` to the first position in `region`, on a grid, at which
+     *  it doesn't intersect any element; and inserts it. The first position,
+     *  at the minimum corner of `region`, is tested directly; only if it's
+     *  occupied are the elements near `region` queried, see `PlacementGrid`.
+     *
+     *  \returns Whether a free position was found.
+     */
     template <typename ShapeT>
     inline bool place(const Box3D& region, ShapeT& shape);
 
@@ -576,6 +812,18 @@ class IndexTree: public IndexTreeMixin<IndexTree<T, A>, T>, public IndexTreeBase
         return place(region, shape);
     }
 
+    /** \brief Places each of the `shapes` in `region`, in order, see `place`.
+     *
+     *  The elements near `region` are queried at most once per batch; the
+     *  shapes placed are taken into account for the following ones.
+     *  Consecutive shapes with bounding boxes of equal size share one
+     *  `PlacementGrid`.
+     *
+     *  \returns For each shape, whether it was placed.
+     */
+    template <typename ShapeT>
+    inline std::vector<bool> place_batch(const Box3D& region, std::vector<ShapeT>& shapes);
+
     /// \brief list all ids in the tree
     /// note: this will allocate a full vector. Consider iterating over the tree using
     ///     begin()->end()
@@ -604,6 +852,20 @@ private:
     }
 };
 
+/// The read-only R-tree can be queried by any number of threads at once.
+template <typename T, typename A>
+struct supports_concurrent_queries<IndexTree<T, A>> : std::true_type {};
+
+/** \brief An `IndexTree` whose nodes are allocated from an arena.
+ *
+ *  The nodes of a tree that's built or loaded in one go are contiguous in
+ *  memory; and destroying the tree frees a few large blocks rather than
+ *  every node. See `util::ArenaAllocator`; `Placement` selects e.g. huge
+ *  pages, see `util::HugePageArenaPlacement`.
+ */
+template <typename T, typename Placement = util::HeapArenaPlacement>
+using ArenaIndexTree = IndexTree<T, util::ArenaAllocator<T, Placement>>;
+
 }  // namespace brain_indexer
 
 #include "detail/index.hpp"
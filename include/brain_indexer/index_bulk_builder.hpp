@@ -3,6 +3,8 @@
 #include <vector>
 #include <boost/optional.hpp>
 
+#include <brain_indexer/packed_rtree.hpp>
+
 namespace brain_indexer {
 
 template<class Value>
@@ -22,6 +24,15 @@ class IndexBulkBuilderBase {
     /// total number of elements in the tree known.
     inline size_t size() const;
 
+    /** \brief Reorder the inserted elements along a Hilbert curve.
+     *
+     *  This is an optional pre-ordering pass before `finalize()`. Elements
+     *  that are close in space end up close in memory, which speeds up the
+     *  partitioning of the elements. The order is that of
+     *  `experimental::space_filling_order` applied to the centroids.
+     */
+    inline void sort_along_space_filling_curve(int n_bits = 21, size_t n_threads = 1);
+
   protected:
     std::vector<Value> values_;
     boost::optional<size_t> n_total_values_ = boost::none;
@@ -31,7 +42,14 @@ class IndexBulkBuilderBase {
 template<class Index, class Value = typename Index::value_type>
 class IndexBulkBuilder : public IndexBulkBuilderBase<Value> {
   public:
-    inline void finalize();
+    /** \brief Build the index from all inserted elements.
+     *
+     *  R-trees, i.e. `IndexTree` and anything else derived from `bgi::rtree`,
+     *  and `PackedIndexTree` are built by the same STR bulk loader, see
+     *  `bulk_load_rtree`; which uses `n_threads` threads. Other indexes are
+     *  constructed from the vector of elements.
+     */
+    inline void finalize(size_t n_threads = 1);
 
     /// \brief Obtain the index after it's been built.
     inline Index index() const;
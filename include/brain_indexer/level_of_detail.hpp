@@ -0,0 +1,73 @@
+#pragma once
+
+#include <vector>
+
+#include <brain_indexer/geometries.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+
+namespace brain_indexer {
+
+/// \brief A node of the tree which stands for the elements below it, see `find_level_of_detail`.
+struct NodeSummary {
+    /// \brief The bounding box of the node, not clipped to the region.
+    Box3D bounds;
+    /// \brief The center of `bounds`.
+    Point3D centroid;
+    /// \brief The number of elements below the node.
+    size_t count;
+};
+
+/// \brief The result of `find_level_of_detail`.
+template <class T>
+struct LevelOfDetail {
+    /// \brief The elements in the region, where they fit into the budget.
+    std::vector<T> values;
+    /// \brief Summaries of the nodes, where the elements don't fit.
+    std::vector<NodeSummary> nodes;
+
+    inline size_t size() const {
+        return values.size() + nodes.size();
+    }
+};
+
+/** \brief At most `max_results` elements or node summaries covering `shape`.
+ *
+ *  The tree is descended level by level, keeping only the nodes which
+ *  intersect `shape`, as long as the next level has at most `max_results`
+ *  nodes. If the elements of the leaves which intersect `shape` fit into
+ *  the budget, they're returned as is, i.e. the result is that of
+ *  `find_intersecting`. Otherwise, every node of the deepest level which
+ *  fits is summarized by its bounding box, center and the number of
+ *  elements below it.
+ *
+ *  Since no level visited has more than `max_results` nodes, other than the
+ *  last, the cost is proportional to `max_results` and the depth of the
+ *  tree; not to the number of elements in `shape`. The exception is the
+ *  count of a summary, for which the inner nodes below the summarized node
+ *  are traversed; but none of the elements are visited.
+ *
+ *  The count includes the elements of the node which lie outside of
+ *  `shape`. Hence, it's a measure of the density, rather than the exact
+ *  number of elements in `shape`.
+ *
+ *  The index can be an `IndexTree`, a `PackedIndexTree` or a
+ *  `MultiIndexTree`. For a multi-index, if more than `max_results` subtrees
+ *  intersect `shape`, the nodes of the top tree are summarized and no
+ *  subtree is loaded. Otherwise, the budget is split across the subtrees
+ *  in proportion to their number of elements, with at least one each; the
+ *  budget a subtree doesn't use is passed on to the next. Every subtree
+ *  contributes either its elements or its summaries. Hence, unlike for a
+ *  single tree, the elements are only guaranteed to be returned as is if
+ *  `max_results` is at least the number of elements of the subtrees which
+ *  intersect `shape`, plus the number of such subtrees.
+ */
+template <class GeometryMode = BoundingBoxGeometry, class Index, class ShapeT>
+inline LevelOfDetail<typename Index::value_type>
+find_level_of_detail(const Index& index, const ShapeT& shape, size_t max_results);
+
+}  // namespace brain_indexer
+
+#include "detail/level_of_detail.hpp"
@@ -4,6 +4,11 @@
 #include <cstdlib>
 #include <functional>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
 #include <boost/format.hpp>
 
 namespace brain_indexer {
@@ -40,10 +45,12 @@ inline const std::string& to_string(LogSeverity severity) {
  * or for temporary debugging purposes `LOG_DEBUG` and `LOG_DEBUG_IF`.
  *
  * This is intended to used as a singleton, via `get_global_logger()`.
+ * The callback must not be replaced while other threads log.
  */
 class Logger {
     public:
         using callback_type = std::function<void(LogSeverity, const std::string&)>;
+        using flush_type = std::function<void()>;
 
     public:
         Logger() = delete;
@@ -59,12 +66,21 @@ class Logger {
             _cb(severity, message);
         }
 
-        inline void set_logging_callback(callback_type cb) {
+        inline void set_logging_callback(callback_type cb, flush_type flush = nullptr) {
             _cb = std::move(cb);
+            _flush = std::move(flush);
+        }
+
+        /// \brief Wait until the callback has received all messages logged so far.
+        inline void flush() {
+            if(_flush) {
+                _flush();
+            }
         }
 
     private:
         callback_type _cb;
+        flush_type _flush;
 };
 
 /** \brief Safe logger for very early messages.
@@ -84,6 +100,163 @@ inline void default_logging_callback(LogSeverity severity, const std::string& me
     std::cout << to_string(severity) << ": " << message << std::endl;
 }
 
+/** \brief A sink which passes messages to a callback on a background thread.
+ *
+ * Logging only copies the message into a bounded ring buffer, without locks
+ * or system calls; hence it doesn't serialize the threads that log, nor wait
+ * for the callback, e.g. one which needs the Python GIL. If the buffer is
+ * full, the message is dropped and counted in `n_dropped`.
+ *
+ * The buffer is a bounded multi-producer queue, with a sequence number per
+ * slot. A single thread, the one owned by the sink, consumes it. It polls
+ * the buffer when there's nothing to pass on.
+ */
+class AsyncLogSink {
+    public:
+        inline explicit AsyncLogSink(Logger::callback_type cb, size_t capacity = 1024);
+        inline ~AsyncLogSink();
+
+        AsyncLogSink(const AsyncLogSink&) = delete;
+        AsyncLogSink(AsyncLogSink&&) = delete;
+        AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+        AsyncLogSink& operator=(AsyncLogSink&&) = delete;
+
+        /// \brief Queue a message; returns `false` if it was dropped.
+        inline bool push(LogSeverity severity, const std::string& message);
+
+        /** \brief Wait until all messages queued so far have been passed on.
+         *
+         * Must not be called from the callback.
+         */
+        inline void flush();
+
+        /// \brief The number of messages dropped, because the buffer was full.
+        inline size_t n_dropped() const {
+            return _n_dropped.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Slot {
+            std::atomic<size_t> sequence;
+            LogSeverity severity;
+            std::string message;
+        };
+
+        inline bool pop(LogSeverity& severity, std::string& message);
+        inline void run();
+
+        Logger::callback_type _cb;
+        size_t _mask;
+        std::unique_ptr<Slot[]> _slots;
+
+        // The positions at which the next message is queued and taken.
+        std::atomic<size_t> _head{0};
+        size_t _tail = 0;
+
+        std::atomic<size_t> _n_passed_on{0};
+        std::atomic<size_t> _n_dropped{0};
+        std::atomic<bool> _is_stopping{false};
+        std::thread _thread;
+};
+
+inline AsyncLogSink::AsyncLogSink(Logger::callback_type cb, size_t capacity)
+    : _cb(std::move(cb)) {
+
+    size_t n_slots = 1;
+    while(n_slots < capacity) {
+        n_slots *= 2;
+    }
+
+    _mask = n_slots - 1;
+    _slots = std::make_unique<Slot[]>(n_slots);
+    for(size_t i = 0; i < n_slots; ++i) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    _thread = std::thread([this]() { run(); });
+}
+
+inline AsyncLogSink::~AsyncLogSink() {
+    _is_stopping.store(true, std::memory_order_release);
+    _thread.join();
+}
+
+inline bool AsyncLogSink::push(LogSeverity severity, const std::string& message) {
+    auto pos = _head.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    while(true) {
+        slot = &_slots[pos & _mask];
+        auto sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = std::ptrdiff_t(sequence) - std::ptrdiff_t(pos);
+
+        if(diff == 0) {
+            if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            _n_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->severity = severity;
+    slot->message = message;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+inline bool AsyncLogSink::pop(LogSeverity& severity, std::string& message) {
+    auto& slot = _slots[_tail & _mask];
+    if(slot.sequence.load(std::memory_order_acquire) != _tail + 1) {
+        return false;
+    }
+
+    severity = slot.severity;
+    message = std::move(slot.message);
+    slot.sequence.store(_tail + _mask + 1, std::memory_order_release);
+    ++_tail;
+
+    return true;
+}
+
+inline void AsyncLogSink::flush() {
+    // Every message before `_head` is either queued, or about to be.
+    auto head = _head.load(std::memory_order_acquire);
+    while(_n_passed_on.load(std::memory_order_acquire) < head) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+}
+
+inline void AsyncLogSink::run() {
+    auto severity = LogSeverity::INFO;
+    auto message = std::string{};
+
+    while(true) {
+        // Messages queued before stopping are passed on in the loop below.
+        bool is_stopping = _is_stopping.load(std::memory_order_acquire);
+
+        while(pop(severity, message)) {
+            try {
+                _cb(severity, message);
+            } catch(const std::exception& e) {
+                log_fallback(LogSeverity::ERROR, std::string("Logging failed: ") + e.what());
+            }
+            _n_passed_on.fetch_add(1, std::memory_order_release);
+        }
+
+        if(is_stopping) {
+            return;
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+}
+
 /** \brief Obtain a reference to the logger used by SI.
  *
  * This uses a Meyers singleton, to ensure that the global logger is
@@ -107,6 +280,32 @@ inline void register_logging_callback(Logger::callback_type cb) {
     logger.set_logging_callback(std::move(cb));
 }
 
+/** \brief Sets a callback that's called on a background thread, see `AsyncLogSink`.
+ *
+ * The sink is returned, e.g. to check if messages were dropped. It's kept
+ * alive until the next callback is registered; which waits for it to pass
+ * on all queued messages.
+ */
+inline std::shared_ptr<AsyncLogSink>
+register_async_logging_callback(Logger::callback_type cb, size_t capacity = 1024) {
+    auto sink = std::make_shared<AsyncLogSink>(std::move(cb), capacity);
+
+    auto& logger = get_global_logger();
+    logger.set_logging_callback(
+        [sink](LogSeverity severity, const std::string& message) {
+            sink->push(severity, message);
+        },
+        [sink]() { sink->flush(); }
+    );
+
+    return sink;
+}
+
+/// \brief Wait until the callback has received all messages logged so far.
+inline void flush_logs() {
+    get_global_logger().flush();
+}
+
 /// \brief Log a `message` with severity `severity`.
 inline void log(LogSeverity severity, const std::string& message) {
     auto& logger = get_global_logger();
@@ -117,22 +316,44 @@ inline void log(LogSeverity severity, const boost::format& message) {
     log(severity, message.str());
 }
 
+inline const LogSeverity& get_global_minimum_log_severity();
+
+namespace detail {
+/** \brief Log `message`, if `severity` is at least the minimum log severity.
+ *
+ * If there are `args`, `message` is a format string; which is formatted only
+ * if the message is logged.
+ */
+template<class Message, class... Args>
+inline void log_if_enabled(LogSeverity severity, const Message& message, const Args&... args) {
+    if(severity < get_global_minimum_log_severity()) {
+        return;
+    }
+
+    if constexpr (sizeof...(Args) == 0) {
+        log(severity, message);
+    } else {
+        log(severity, (boost::format(message) % ... % args));
+    }
+}
+}
+
 /// \brief Log messages that are useful to non-developers.
-template<class T>
-inline void log_info(const T& message) {
-    log(LogSeverity::INFO, message);
+template<class T, class... Args>
+inline void log_info(const T& message, const Args&... args) {
+    detail::log_if_enabled(LogSeverity::INFO, message, args...);
 }
 
 /// \brief Log issues that users should be aware of.
-template<class T>
-inline void log_warn(const T& message) {
-    log(LogSeverity::WARN, message);
+template<class T, class... Args>
+inline void log_warn(const T& message, const Args&... args) {
+    detail::log_if_enabled(LogSeverity::WARN, message, args...);
 }
 
 /// \brief Log additional information about an error.
-template<class T>
-inline void log_error(const T& message) {
-    log(LogSeverity::ERROR, message);
+template<class T, class... Args>
+inline void log_error(const T& message, const Args&... args) {
+    detail::log_if_enabled(LogSeverity::ERROR, message, args...);
 }
 
 /** \brief Fetches the minimum log severity from the environment.
@@ -24,6 +24,8 @@ namespace brain_indexer {
         static constexpr auto memory_mapped_key = "memory_mapped";
         static constexpr auto in_memory_key = "in_memory";
         static constexpr auto multi_index_key = "multi_index";
+        static constexpr auto gid_index_path_key = "gid_index_path";
+        static constexpr auto base_paths_key = "base_paths";
     };
 
     /** \brief Join two paths safely.
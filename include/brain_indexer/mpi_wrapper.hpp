@@ -157,6 +157,17 @@ inline std::vector<int>
 compute_balance_send_counts(const std::vector<size_t>& counts_per_rank, int mpi_rank);
 
 
+/** \brief Compute the number of elements to send to the owners of `boundaries`.
+ *
+ * MPI rank `i` will own the elements with global index in
+ * `[boundaries[i], boundaries[i+1])`, in the natural order; this rank holds
+ * `[local_start, local_end)`. The same as `compute_balance_send_counts`, but
+ * for arbitrary boundaries.
+ */
+inline std::vector<int>
+compute_send_counts(const std::vector<size_t>& boundaries, size_t local_start, size_t local_end);
+
+
 /// RAII style wrapper for MPI handles.
 /** Idiomatic C tends to expose handles to resources which need to be
  *  acquired (allocated, opened) and released (free, closed) manually. Idiomatic
@@ -264,6 +275,14 @@ void comm_free(MPI_Comm &comm);
 inline Comm comm_split(MPI_Comm comm, int color, int order);
 
 
+/// Shallow wrapper for `MPI_Comm_split_type` with `MPI_COMM_TYPE_SHARED`.
+/**
+ *  The ranks which can share memory, i.e. those on the same node, are put
+ *  into the same communicator.
+ */
+inline Comm comm_split_shared(MPI_Comm comm);
+
+
 /** \brief Create a new comm with the desired size.
  *
  *  The first `n_ranks` ranks are put in one communicator. On all
@@ -1,6 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <boost/serialization/utility.hpp>
 #include <boost/filesystem.hpp>
@@ -8,18 +19,35 @@
 
 #include <nlohmann/json.hpp>
 
+#include <brain_indexer/compression.hpp>
+#include <brain_indexer/eviction_policies.hpp>
 #include <brain_indexer/geometries.hpp>
 #include <brain_indexer/index.hpp>
 #include <brain_indexer/index_bulk_builder.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/query_ordering.hpp>
 #include <brain_indexer/sort_tile_recursion.hpp>
 #include <brain_indexer/util.hpp>
 
 #if SI_MPI == 1
+#include <brain_indexer/external_sort_tile_recursion.hpp>
 #include <brain_indexer/mpi_wrapper.hpp>
 #endif
 
 namespace brain_indexer {
 
+namespace detail {
+struct MultiIndexJoin;
+struct MultiIndexSegmentQuery;
+struct MultiIndexGidQuery;
+struct MultiIndexLevelOfDetailQuery;
+struct MultiIndexDensityGrid;
+struct MultiIndexPointClassification;
+}
+
+template <class T, class SubtreeCache>
+class DistributedMultiIndexTree;
+
 /// \brief These filenames are used together with `NativeStorage`.
 struct NativeFilenames {
     static inline std::string top_tree(const std::string& output_dir) {
@@ -60,6 +88,15 @@ class MultiIndexStorage {
 
     explicit MultiIndexStorage(std::string output_dir);
 
+    /** \brief Subtrees missing from `output_dir` are read from `base_dirs`.
+     *
+     *  A subtree is read from the first of `output_dir` and `base_dirs`
+     *  which has it; but always saved to `output_dir`. This is how
+     *  snapshots refer to the unchanged subtrees of the versions they're
+     *  based on, see `create_multi_index_snapshot`.
+     */
+    MultiIndexStorage(std::string output_dir, std::vector<std::string> base_dirs);
+
     inline void save_subtree(const SubTree& subtree, size_t subtree_id) const;
     inline static void save_subtree(const SubTree& subtree,
                              const std::string& output_dir,
@@ -74,30 +111,44 @@ class MultiIndexStorage {
     inline TopTree load_top_tree() const;
     inline static TopTree load_top_tree(const std::string& output_dir);
 
+    /// \brief The file of the subtree `subtree_id`, in `output_dir` or a base directory.
+    inline std::string subtree_path(size_t subtree_id) const;
+
   private:
+    inline static SubTree load_subtree_file(const std::string& filename);
+
     std::string output_dir;
+    std::vector<std::string> base_dirs;
 };
 
 
-/** \brief Native Boost serialization.
+/** \brief Native serialization.
+ *
+ *  This is storage policy for `UsageRateCache`. It saves the R-trees with
+ *  `save_rtree`, i.e. in the native bulk format if the values can be copied
+ *  bytewise; and with Boost serialization otherwise.
  *
- *  This is storage policy for `UsageRateCache`. It delegates the saving the
- *  R-tree to Boost serialization.
+ *  Each file is optionally compressed with `Codec`, see
+ *  `save_compressed_rtree`. The reader detects compressed files; hence,
+ *  every `NativeStorage` can read files written with any codec. Since the
+ *  subtrees are decompressed while they're loaded, prefetching also
+ *  decompresses them in the background.
  * 
  *  See, `NativeStorageT` for a version that selects the appropriate
  *  values of `TopTree` and `SubTree` for the common use case.
  *
  *  \tparam TopTree Type of the top-level index of a multi index.
  *  \tparam SubTree Type of the sub indices of a multi index.
+ *  \tparam Codec   Compression of the files written, e.g. `ZstdCompression`.
  */
-template <class TopTree, class SubTree>
+template <class TopTree, class SubTree, class Codec = NoCompression>
 class NativeStorage : public MultiIndexStorage<
-                                NativeStorage<TopTree, SubTree>,
+                                NativeStorage<TopTree, SubTree, Codec>,
                                 TopTree,
                                 SubTree,
                                 NativeFilenames> {
   private:
-    using super = MultiIndexStorage<NativeStorage<TopTree, SubTree>,
+    using super = MultiIndexStorage<NativeStorage<TopTree, SubTree, Codec>,
                                     TopTree,
                                     SubTree,
                                     NativeFilenames>;
@@ -107,6 +158,8 @@ class NativeStorage : public MultiIndexStorage<
 
     explicit NativeStorage(std::string output_dir);
 
+    NativeStorage(std::string output_dir, std::vector<std::string> base_dirs);
+
     template <class RTree>
     inline static void save_tree(const RTree& rtree, const std::string& filename);
 
@@ -123,23 +176,337 @@ class NativeStorage : public MultiIndexStorage<
 
 using MultiIndexTopTreeT = bgi::rtree<IndexedSubtreeBox, bgi::linear<16, 2>>;
 
+/// \brief The subtrees count their allocations, see `subtree_resident_bytes`.
 template<typename T>
-using MultiIndexSubTreeT = IndexTreeBaseT<T>;
+using MultiIndexSubTreeT = IndexTreeBaseT<T, util::CountingAllocator<T>>;
+
+/// \brief The subtrees allocate their nodes from an arena, see `util::ArenaAllocator`.
+template<typename T, typename Placement = util::HeapArenaPlacement>
+using MultiIndexArenaSubTreeT = IndexTreeBaseT<T, util::ArenaAllocator<T, Placement>>;
 
 template<class T>
 using NativeStorageT = NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>;
 
+/** \brief Like `NativeStorageT`, but subtrees are loaded into an arena.
+ *
+ *  The files are the same; only evicting a subtree is cheaper, since its
+ *  nodes are freed in a few large blocks. With `util::InterleavedArenaPlacement`
+ *  the subtrees are on huge pages, spread across all NUMA nodes.
+ */
+template<class T, class Placement = util::HeapArenaPlacement>
+using ArenaStorageT = NativeStorage<MultiIndexTopTreeT, MultiIndexArenaSubTreeT<T, Placement>>;
+
+#if SI_ZSTD == 1
+/// \brief Like `NativeStorageT`, but the files are compressed with zstd.
+template<class T>
+using ZstdStorageT = NativeStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>, ZstdCompression>;
+#endif
+
+
+/// \brief These filenames are used together with `MemoryMappedStorage`.
+struct MemoryMappedFilenames {
+    static inline std::string top_tree(const std::string& output_dir) {
+        return NativeFilenames::top_tree(output_dir);
+    }
+
+    static inline
+    std::string subtree(const std::string& output_dir, size_t subtree_id) {
+        auto dirname = std::filesystem::path(output_dir);
+        auto basename = std::string("index-l") + std::to_string(subtree_id) + ".packed";
+        auto p = dirname / basename;
+        return p.string();
+    }
+};
+
+/** \brief Subtrees are stored as flat arrays and memory mapped.
+ *
+ *  This is a storage policy for `UsageRateCache` and `ShardedUsageRateCache`.
+ *  Subtrees of type `PackedRTree` are written with `write_packed_rtree` and
+ *  loaded with `map_packed_rtree`. Hence, loading a subtree doesn't require
+ *  any deserialization and the pages of a subtree are only read from disk
+ *  when a query touches them. Since the mapping is read-only, the OS page
+ *  cache can be shared by all processes on a node.
+ *
+ *  The top-level tree is small and is saved as in `NativeStorage`.
+ *
+ *  See, `MemoryMappedStorageT` for a version that selects the appropriate
+ *  values of `TopTree` and `SubTree` for the common use case.
+ *
+ *  \tparam TopTree Type of the top-level index of a multi index.
+ *  \tparam SubTree Type of the sub indices of a multi index.
+ */
+template <class TopTree, class SubTree>
+class MemoryMappedStorage : public MultiIndexStorage<
+                                      MemoryMappedStorage<TopTree, SubTree>,
+                                      TopTree,
+                                      SubTree,
+                                      MemoryMappedFilenames> {
+  private:
+    using super = MultiIndexStorage<MemoryMappedStorage<TopTree, SubTree>,
+                                    TopTree,
+                                    SubTree,
+                                    MemoryMappedFilenames>;
+
+  public:
+    explicit MemoryMappedStorage() = default;
+
+    explicit MemoryMappedStorage(std::string output_dir);
+
+    MemoryMappedStorage(std::string output_dir, std::vector<std::string> base_dirs);
+
+    template <class RTree>
+    inline static void save_tree(const RTree& rtree, const std::string& filename);
+
+    template <class RTree>
+    inline static RTree load_tree(const std::string& filename);
+};
+
+template<typename T>
+using MultiIndexPackedSubTreeT = PackedRTree<T>;
+
+template<class T>
+using MemoryMappedStorageT = MemoryMappedStorage<MultiIndexTopTreeT, MultiIndexPackedSubTreeT<T>>;
+
+/// \brief Like `MemoryMappedStorageT`, but the subtrees have compact leaves.
+template<class T>
+using CompactMemoryMappedStorageT = MemoryMappedStorage<MultiIndexTopTreeT, CompactPackedRTree<T>>;
+
+
+/// \brief These filenames are used together with `ContainerStorage`.
+struct ContainerFilenames {
+    static inline std::string top_tree(const std::string& output_dir) {
+        return NativeFilenames::top_tree(output_dir);
+    }
+
+    /// \brief The serialized subtrees of one writer.
+    static inline std::string data(const std::string& output_dir, size_t writer_id) {
+        auto dirname = std::filesystem::path(output_dir);
+        auto basename = std::string("subtrees-") + std::to_string(writer_id) + ".bin";
+        return (dirname / basename).string();
+    }
+
+    /// \brief The offset table of the subtrees of one writer.
+    static inline std::string offsets(const std::string& output_dir, size_t writer_id) {
+        auto dirname = std::filesystem::path(output_dir);
+        auto basename = std::string("subtrees-") + std::to_string(writer_id) + ".offsets";
+        return (dirname / basename).string();
+    }
+};
+
+namespace detail {
+
+/// \brief An entry of the offset table of a container.
+struct ContainerRecord {
+    std::uint64_t subtree_id;
+    std::uint64_t offset;
+    std::uint64_t n_bytes;
+};
+
+/// \brief The open files of the writer of a container.
+struct ContainerWriter {
+    std::mutex mutex;
+    std::ofstream data;
+    std::ofstream offsets;
+};
+
+/// \brief The offset tables and mapped data files of all writers.
+struct ContainerReader {
+    struct Location {
+        size_t writer_id;
+        size_t offset;
+        size_t n_bytes;
+    };
+
+    std::once_flag is_opened;
+    std::unordered_map<size_t, Location> locations;
+    std::unordered_map<size_t, std::unique_ptr<MappedFile>> files;
+};
+
+}  // namespace detail
+
+/** \brief All subtrees of a writer are stored in a single file.
+ *
+ *  `NativeStorage` writes one file per subtree. Large indexes have tens of
+ *  thousands of subtrees; and the metadata operations needed to create and
+ *  open that many files are slow on shared file systems. This storage policy
+ *  appends the subtrees of every writer, i.e. MPI rank, saved with
+ *  `save_rtree` to one data file; and where they start to an offset table, see
+ *  `ContainerFilenames`. Hence, an index consists of two files per rank that
+ *  built it, plus the top-level tree.
+ *
+ *  The offset tables are read, and the data files memory mapped, once, when
+ *  the first subtree is loaded. Loading a subtree then only reads its range
+ *  of the data file.
+ *
+ *  The subtrees are the same as those of `NativeStorage`; only their layout
+ *  on disk differs. See, `ContainerStorageT` for the common use case.
+ *
+ *  \tparam TopTree Type of the top-level index of a multi index.
+ *  \tparam SubTree Type of the sub indices of a multi index.
+ */
+template <class TopTree, class SubTree>
+class ContainerStorage {
+  public:
+    /// \brief The type of the top-level tree of the multi index.
+    using toptree_type = TopTree;
+
+    /// \brief The type of the subtrees of the multi index.
+    using subtree_type = SubTree;
+
+  public:
+    ContainerStorage() = default;
+
+    /// \brief Subtrees are saved to the container of `writer_id`.
+    explicit ContainerStorage(std::string output_dir, size_t writer_id = 0);
+
+    /** \brief Create an empty container for this writer.
+     *
+     *  Any previous container of this writer is replaced. This happens
+     *  implicitly when the first subtree is saved; but a writer without any
+     *  subtrees must call it too, to remove a stale container.
+     */
+    inline void create_container() const;
+
+    inline void save_subtree(const SubTree& subtree, size_t subtree_id) const;
+    inline void save_top_tree(const TopTree& tree) const;
+
+    /** \brief Load the subtree with id `subtree_id`, from any writer.
+     *
+     *  If a subtree was saved more than once, the version in the container
+     *  with the largest writer id wins; and within a container the last one.
+     *
+     *  \throws std::runtime_error if no writer saved the subtree.
+     */
+    inline SubTree load_subtree(size_t subtree_id) const;
+    inline TopTree load_top_tree() const;
+
+    /// \brief A writer id larger than that of any container in `output_dir`.
+    static inline size_t next_writer_id(const std::string& output_dir);
+
+    /// \brief Remove the containers of all writers with id `min_writer_id` or larger.
+    static inline void remove_containers(const std::string& output_dir, size_t min_writer_id);
+
+  private:
+    inline void open_writer() const;
+    inline void open_reader() const;
+
+    /// \brief The ids of all writers with a container in `output_dir`.
+    static inline std::vector<size_t> writer_ids(const std::string& output_dir);
+
+    std::string output_dir;
+    size_t writer_id = 0;
+    std::shared_ptr<detail::ContainerWriter> writer = std::make_shared<detail::ContainerWriter>();
+    std::shared_ptr<detail::ContainerReader> reader = std::make_shared<detail::ContainerReader>();
+};
+
+template<class T>
+using ContainerStorageT = ContainerStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>>;
+
+namespace detail {
 
-/// \brief The parameters control the eviction policy of `UsageRateCache`.
+template <class Storage>
+struct is_container_storage : std::false_type {};
+
+template <class TopTree, class SubTree>
+struct is_container_storage<ContainerStorage<TopTree, SubTree>> : std::true_type {};
+
+/// \brief The codec with which `Storage` compresses the subtrees.
+template <class Storage>
+struct storage_codec {
+    using type = NoCompression;
+};
+
+template <class TopTree, class SubTree, class Codec>
+struct storage_codec<NativeStorage<TopTree, SubTree, Codec>> {
+    using type = Codec;
+};
+
+/// \brief Does `Storage` read every subtree from its own file, see `subtree_path`?
+template <class Storage, class = void>
+struct has_subtree_path : std::false_type {};
+
+template <class Storage>
+struct has_subtree_path<
+    Storage, std::void_t<decltype(std::declval<const Storage&>().subtree_path(size_t(0)))>>
+    : std::true_type {};
+
+/** \brief The subtrees which are alive in this process, by file.
+ *
+ *  Snapshots of a multi-index share the files of their unchanged subtrees,
+ *  see `create_multi_index_snapshot`. Through this registry, the caches of
+ *  all snapshots open in a process share a single copy of such a subtree.
+ *
+ *  Subtrees are held weakly; they're freed once no cache, or query, uses
+ *  them. A file which is rewritten, i.e. has a different modification time
+ *  or size, is a different subtree.
+ */
+template <class SubTree>
+class SharedSubtreeRegistry {
+  public:
+    using subtree_handle = std::shared_ptr<const SubTree>;
+
+    static inline SharedSubtreeRegistry& instance();
+
+    /// \brief The shared subtree in `filename`; or `load()` if there's none.
+    template <class Load>
+    inline subtree_handle find_or_load(const std::string& filename, Load&& load);
+
+    /// \brief The shared subtree in `filename`; `subtree` becomes it if there's none.
+    inline subtree_handle insert(const std::string& filename, subtree_handle subtree);
+
+  private:
+    inline static std::string key(const std::string& filename);
+
+    /// \brief Insert `subtree` unless there's a live one; `mutex` must be locked.
+    inline subtree_handle insert_locked(const std::string& key, subtree_handle subtree);
+
+    /// \brief Remove the freed subtrees; `mutex` must be locked.
+    inline void sweep();
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<const SubTree>> subtrees;
+    size_t sweep_threshold = 64;
+};
+
+}  // namespace detail
+
+
+/** \brief Memory used by `subtree` while it's cached.
+ *
+ *  For R-trees with a `util::CountingAllocator` or `util::ArenaAllocator`,
+ *  e.g. `MultiIndexSubTreeT`, this is the memory they allocated, including
+ *  the nodes; for packed R-trees it's the size of their arrays. Otherwise,
+ *  it's only the size of the elements.
+ */
+template <class SubTree>
+inline size_t subtree_resident_bytes(const SubTree& subtree);
+
+
+/** \brief The parameters control the eviction policy of `UsageRateCache`.
+ *
+ *  Subtrees are evicted if either the number of cached elements would exceed
+ *  `max_cached_elements` or the memory used by the cached subtrees, see
+ *  `subtree_resident_bytes`, would exceed `max_cached_bytes`. Which subtrees
+ *  are evicted is decided by `eviction_policy`.
+ */
 struct UsageRateCacheParams {
     UsageRateCacheParams() = default;
 
     explicit UsageRateCacheParams(size_t max_cached_elements)
         : max_cached_elements(max_cached_elements) { }
 
+    /// \brief Only limit the memory used by the cached subtrees.
+    static inline UsageRateCacheParams from_max_cached_bytes(size_t max_cached_bytes) {
+        auto params = UsageRateCacheParams(std::numeric_limits<size_t>::max());
+        params.max_cached_bytes = max_cached_bytes;
+        return params;
+    }
+
     size_t max_cached_elements = 1ul;
+    size_t max_cached_bytes = std::numeric_limits<size_t>::max();
     size_t max_evict = 1ul;
     size_t current_cached_subtrees = 0ul;
+    EvictionPolicyKind eviction_policy = EvictionPolicyKind::usage_rate;
 };
 
 /** \brief A cache for loading and keeping R-trees in memory.
@@ -148,56 +515,22 @@ struct UsageRateCacheParams {
  *  subtrees as they are needed and decide which trees should be evicted once
  *  there is insufficient memory to load further subtrees.
  *
- *  The eviction policy is the following: For each subtree the number of times
- *  the subtree is accessed per query that occurs while this tree is loaded can
- *  be computed. This number is called "usage rate". The subtrees with the lowest
- *  usage rate is evicted.
+ *  The default eviction policy is the following: For each subtree the number
+ *  of times the subtree is accessed per query that occurs while this tree is
+ *  loaded can be computed. This number is called "usage rate". The subtrees
+ *  with the lowest usage rate is evicted. Other policies, e.g. LRU, can be
+ *  selected through `UsageRateCacheParams::eviction_policy`; see
+ *  `eviction_policies.hpp`.
  * 
  *  See `UsageRateCacheT` for a convenient alias in the context of building a
  *  `MultiIndexTree`.
  *
  *  \tparam Storage  A policy for loading subtrees from disk.
+ *  \tparam EvictionPolicy  Decides which subtrees to evict, e.g. `LRUEvictionPolicy`.
  */
-template <class Storage>
+template <class Storage, class EvictionPolicy = SelectableEvictionPolicy>
 class UsageRateCache {
-    /** \brief The meta data required to compute usage rate.
-     *
-     * The assumption is that there's a global query counter. It increases on
-     * every query of the spatial index.
-     *
-     * The current value query counter at time of loading the subtree is stored as
-     * the `load_generation`. The `current_access_count` is increased everytime
-     * the subtree is requested.
-     *
-     * On eviction `previous_*` are increased such that they reflect the historic usage
-     * rate.
-     */
-    class MetaData {
-      public:
-        double usage_rate(size_t query_count) const;
-        size_t access_count() const;
-        size_t eviction_count() const;
-        size_t incache_count(size_t query_count) const;
-
-
-        /// \brief To be called every time the subtree is queries while residing cache.
-        inline void on_query();
-
-        /// \brief To be called every time the subtree is loaded into cache.
-        inline void on_load(size_t query_count);
-
-        /// \brief To be called immediately before evicting the subtree.
-        inline void on_evict(size_t query_count);
-
-      private:
-        size_t load_generation_ = 0;
-        size_t current_access_count_ = 0;
-
-        size_t previous_access_count_ = 0;
-        size_t previous_age_ = 0;
-
-        size_t eviction_count_ = 0;
-    };
+    using MetaData = UsageRateMetaData;
 
   public:
     using storage_type = Storage;
@@ -208,6 +541,8 @@ class UsageRateCache {
 
     UsageRateCache(const UsageRateCacheParams& cache_params, Storage storage)
         : storage(std::move(storage))
+        , eviction_policy(detail::make_eviction_policy<EvictionPolicy>(
+              cache_params.eviction_policy))
         , cache_params(cache_params) { }
 
     ~UsageRateCache();
@@ -219,30 +554,221 @@ class UsageRateCache {
     template<class SubtreeID>
     inline const subtree_type& load_subtree(const SubtreeID& subtree_id, size_t query_count);
 
+    /** \brief Add a subtree that was loaded elsewhere, e.g. by prefetching.
+     *
+     * If the subtree is already cached, `subtree` is discarded and the cached
+     * subtree is returned.
+     */
+    template<class SubtreeID>
+    inline const subtree_type& insert_subtree(const SubtreeID& subtree_id,
+                                              subtree_type subtree,
+                                              size_t query_count);
+
+    /// \brief Is the subtree with id `subtree_id` currently in the cache?
+    inline bool is_cached(size_t subtree_id) const;
+
+    /// \brief Memory used by all cached subtrees, see `subtree_resident_bytes`.
+    inline size_t cached_bytes() const { return n_cached_bytes; }
+
+    /// \brief The ids of the cached subtrees, the most used first.
+    inline std::vector<size_t> cached_subtree_ids() const;
+
+    /** \brief Can a subtree be added without evicting any.
+     *
+     *  \param n_bytes  The memory it uses, see `subtree_resident_bytes`; or
+     *      `estimated_bytes(n_elements)` if it hasn't been loaded.
+     */
+    inline bool has_room_for(size_t n_elements, size_t n_bytes) const;
+
+    /// \brief The memory a subtree with `n_elements` elements is expected to use.
+    inline size_t estimated_bytes(size_t n_elements) const;
+
   protected:
     /// \brief Total number of elements across all subtrees loaded.
-    size_t cached_elements() const;
+    inline size_t cached_elements() const { return n_cached_elements; }
 
+    /** \brief Make room for the subtree `subtree_id`, before loading it.
+     *
+     *  The memory used by the subtree isn't known before it's loaded. It's
+     *  estimated from the memory per element of the cached subtrees.
+     */
     template<class SubtreeID>
     inline void evict_subtrees(const SubtreeID& subtree_id, size_t query_count);
 
-    inline std::vector<size_t> subtree_ids_sorted_by_usage_rate(size_t query_count);
-
+    /** \brief Add `subtree` to the cache; room must already have been made.
+     *
+     *  \param load_seconds  The time it took to load the subtree, if known.
+     */
+    inline const subtree_type& emplace_subtree(size_t subtree_id,
+                                               subtree_type subtree,
+                                               std::optional<double> load_seconds,
+                                               size_t query_count);
 
   private:
+    struct Entry {
+        subtree_type subtree;
+        size_t n_elements;
+        size_t n_bytes;
+    };
+
     Storage storage;
+    EvictionPolicy eviction_policy;
 
-    std::unordered_map<size_t, subtree_type> subtrees;
-    std::unordered_map<size_t, MetaData> meta_data;
+    std::unordered_map<size_t, Entry> subtrees;
+    EvictionMetaData meta_data;
     UsageRateCacheParams cache_params;
 
     size_t most_recent_query_count = 0;
+    size_t n_cached_elements = 0;
+    size_t n_cached_bytes = 0;
+
+    // Reused, to avoid allocating on every eviction.
+    std::vector<size_t> victims;
 };
 
 template<typename T>
 using UsageRateCacheT = UsageRateCache<NativeStorageT<T>>;
 
 
+/** \brief A thread-safe variant of `UsageRateCache`.
+ *
+ *  The loaded subtrees are distributed over several shards, each protected by
+ *  its own mutex. The mutex is only held while looking up or modifying the
+ *  book keeping, never while reading a subtree from disk. Hence, cache hits
+ *  are never blocked by other threads loading subtrees. A thread that requests
+ *  a subtree which is currently being loaded by another thread waits for that
+ *  load to complete, rather than loading it a second time.
+ *
+ *  Subtrees are handed out as ref-counted handles. Evicting a subtree only
+ *  removes it from the cache; threads that are still querying it keep it
+ *  alive until they release their handle.
+ *
+ *  Subtrees stored in the same file, e.g. the unchanged subtrees of several
+ *  snapshots, are shared by all caches of the process, see
+ *  `detail::SharedSubtreeRegistry`.
+ *
+ *  The eviction policy is the usage rate policy of `UsageRateCache`; other
+ *  values of `UsageRateCacheParams::eviction_policy` are rejected.
+ *
+ *  \tparam Storage  A policy for loading subtrees from disk.
+ */
+template <class Storage>
+class ShardedUsageRateCache {
+    using MetaData = UsageRateMetaData;
+
+  public:
+    using storage_type = Storage;
+    using subtree_type = typename storage_type::subtree_type;
+    using subtree_handle = std::shared_ptr<const subtree_type>;
+
+    /// \brief The default number of shards.
+    static constexpr size_t default_n_shards = 16;
+
+  public:
+    ShardedUsageRateCache();
+
+    ShardedUsageRateCache(const UsageRateCacheParams& cache_params,
+                          Storage storage,
+                          size_t n_shards = default_n_shards);
+
+    ShardedUsageRateCache(ShardedUsageRateCache&&) = default;
+    ShardedUsageRateCache& operator=(ShardedUsageRateCache&&) = default;
+
+    ~ShardedUsageRateCache();
+
+    /** \brief Return a handle to the subtree with id `subtree_id`.
+     *
+     * This method may be called concurrently from several threads.
+     *
+     * \param query_count The query count increses on every query to the spatial index.
+     */
+    template<class SubtreeID>
+    inline subtree_handle load_subtree(const SubtreeID& subtree_id, size_t query_count);
+
+    /** \brief Add a subtree that was loaded elsewhere, e.g. by prefetching.
+     *
+     * If the subtree is already cached, or being loaded, `subtree` is
+     * discarded and the cached subtree is returned.
+     */
+    template<class SubtreeID>
+    inline subtree_handle insert_subtree(const SubtreeID& subtree_id,
+                                         subtree_type subtree,
+                                         size_t query_count);
+
+    /// \brief Is the subtree with id `subtree_id` cached or being loaded?
+    inline bool is_cached(size_t subtree_id) const;
+
+    /// \brief Total number of elements across all subtrees loaded or being loaded.
+    inline size_t cached_elements() const;
+
+    /** \brief Memory used by all subtrees loaded or being loaded.
+     *
+     *  For subtrees that are being loaded, this is an estimate based on the
+     *  memory per element of the cached subtrees.
+     */
+    inline size_t cached_bytes() const;
+
+    /// \brief The ids of the cached subtrees, the most used first.
+    inline std::vector<size_t> cached_subtree_ids() const;
+
+    /// \brief Can a subtree be added without evicting any, see `UsageRateCache`.
+    inline bool has_room_for(size_t n_elements, size_t n_bytes) const;
+
+    /// \brief The estimated memory used by a subtree with `n_elements` elements.
+    inline size_t estimated_bytes(size_t n_elements) const;
+
+  protected:
+    inline void evict_subtrees(size_t query_count);
+
+  private:
+    struct Entry {
+        std::shared_future<subtree_handle> subtree;
+        size_t n_elements;
+        size_t n_bytes;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<size_t, Entry> subtrees;
+        std::unordered_map<size_t, MetaData> meta_data;
+    };
+
+    inline Shard& shard_for(size_t subtree_id) const;
+
+    /// \brief Replace the estimated memory of a loaded subtree with `n_bytes`.
+    inline void update_cached_bytes(size_t subtree_id, size_t n_bytes);
+
+    Storage storage;
+    UsageRateCacheParams cache_params;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::unique_ptr<std::mutex> eviction_mutex;
+
+    std::unique_ptr<std::atomic<size_t>> n_cached_elements;
+    std::unique_ptr<std::atomic<size_t>> n_cached_bytes;
+    std::unique_ptr<std::atomic<size_t>> most_recent_query_count;
+};
+
+template<typename T>
+using ShardedUsageRateCacheT = ShardedUsageRateCache<NativeStorageT<T>>;
+
+
+/** \brief Write the ids of a hot set, see `MultiIndexTreeBase::hot_set`.
+ *
+ *  The file is a JSON list of objects with an `"id"`, like the usage
+ *  statistics written if `SI_REPORT_USAGE_STATS` is set.
+ */
+inline void write_hot_set(const std::string& filename, const std::vector<size_t>& subtree_ids);
+
+/** \brief Read the ids of a hot set, the most used first.
+ *
+ *  Reads the files of `write_hot_set`, which are in order; and the usage
+ *  statistics written if `SI_REPORT_USAGE_STATS` is set, which are ordered
+ *  by their `"usage_rate"`.
+ */
+inline std::vector<size_t> read_hot_set(const std::string& filename);
+
+
 /** \brief Implements core querying functionality of a spatial index.
  *
  * This class only provides the core functionality for loading parts of a multi
@@ -262,6 +788,8 @@ class MultiIndexTreeBase {
     MultiIndexTreeBase() = default;
     MultiIndexTreeBase(const storage_type& storage, SubtreeCache subtree_cache);
 
+    ~MultiIndexTreeBase();
+
     template <class Predicates, class OutIt>
     inline void query(const Predicates& predicates, const OutIt& it) const;
 
@@ -269,18 +797,105 @@ class MultiIndexTreeBase {
       return top_rtree.bounds();
     }
 
+    /** \brief Number of subtrees that are read ahead of the one being queried.
+     *
+     * If `prefetch_depth > 0`, a query which needs to visit the subtrees
+     * `0, ..., n-1` reads the subtrees `k+1, ..., k+prefetch_depth` on
+     * background threads while subtree `k` is being queried. This overlaps
+     * disk I/O with querying. Note that the prefetched subtrees temporarily
+     * use memory in addition to the cache.
+     *
+     * A depth of `0` disables prefetching, which is the default.
+     */
+    inline void set_prefetch_depth(size_t prefetch_depth) {
+      prefetch_depth_ = prefetch_depth;
+    }
+
+    inline size_t prefetch_depth() const {
+      return prefetch_depth_;
+    }
+
+    /// \brief Memory used by the cached subtrees, see `subtree_resident_bytes`.
+    inline size_t cached_bytes() const {
+      return subtree_cache.cached_bytes();
+    }
+
+    /** \brief Load the subtrees `subtree_ids`, in order, until the cache is full.
+     *
+     * This warms up the cache of a new job, e.g. with the hot set of an
+     * earlier one, see `hot_set` and `read_hot_set`; or the subtrees of the
+     * regions it'll query, see `subtrees_intersecting`. Subtrees which are
+     * cached, or not part of the index, are skipped. It stops before the
+     * first subtree which doesn't fit; nothing is evicted. The subtrees are
+     * read by `n_threads` threads.
+     *
+     * \returns The number of subtrees loaded.
+     */
+    inline size_t warm_up(const std::vector<size_t>& subtree_ids, size_t n_threads = 1) const;
+
+    /// \brief The ids of the subtrees which intersect any of `regions`, in order.
+    inline std::vector<size_t> subtrees_intersecting(const std::vector<Box3D>& regions) const;
+
+    /// \brief The ids of the cached subtrees, the most used first.
+    inline std::vector<size_t> hot_set() const {
+      return subtree_cache.cached_subtree_ids();
+    }
+
+    /** \brief Write the hot set to `filename` when the index is destroyed.
+     *
+     * See `write_hot_set`. An empty `filename` disables it, which is the
+     * default.
+     */
+    inline void save_hot_set_at_exit(const std::string& filename) {
+      hot_set_filename_ = filename;
+    }
+
   protected:
+    template <class Index>
+    friend class QueryCursor;
+
+    friend struct detail::MultiIndexJoin;
+    friend struct detail::MultiIndexSegmentQuery;
+    friend struct detail::MultiIndexGidQuery;
+    friend struct detail::MultiIndexLevelOfDetailQuery;
+    friend struct detail::MultiIndexDensityGrid;
+    friend struct detail::MultiIndexPointClassification;
+
     template <class SubtreeID, class Predicates, class OutIt>
     inline void query_subtree(const SubtreeID& subtree_id,
                        const Predicates& predicates,
                        const OutIt& it) const;
 
+    /** \brief Calls `visitor(subtree)` for each subtree in `to_visit`, in order.
+     *
+     *  If `prefetch_depth > 0`, the subtrees that follow are read in the
+     *  background, see `set_prefetch_depth`.
+     */
+    template <class SubtreeID, class Visitor>
+    inline void for_each_subtree(const std::vector<SubtreeID>& to_visit,
+                                 const Visitor& visitor) const;
+
+    /** \brief The `k` values closest to `geometry`, closest first.
+     *
+     *  The subtrees are visited best-first, i.e. in the order of the
+     *  distance to their bounding boxes; and the search stops as soon as no
+     *  further subtree can be closer than the current `k`-th neighbour.
+     *  Hence, only the subtrees which are needed are loaded. As for
+     *  `bgi::nearest`, the distance to a value is that to its bounding box.
+     */
+    template <class Geometry, class OutIt>
+    inline void query_nearest(const Geometry& geometry, size_t k, const OutIt& it) const;
+
+    /// \brief Either a reference or a ref-counted handle to the subtree.
     template <class SubtreeID>
-    inline auto load_subtree(const SubtreeID& subtree_id) const -> const subtree_type&;
+    inline decltype(auto) load_subtree(const SubtreeID& subtree_id) const;
 
+    storage_type storage;
     toptree_type top_rtree;
     mutable SubtreeCache subtree_cache;
-    mutable size_t query_count = 0;
+    mutable std::atomic<size_t> query_count{0};
+    size_t prefetch_depth_ = 0;
+    std::string hot_set_filename_;
 };
 
 template<class T>
@@ -308,12 +923,14 @@ using MultiIndexTreeBaseT = MultiIndexTreeBase<UsageRateCacheT<T>>;
  * 
  *  The available caches policies are:
  *   - `UsageRateCache` which evicts the least used subtree.
+ *   - `ShardedUsageRateCache` which uses the same policy but can be shared by
+ *     many threads, see `ConcurrentMultiIndexTree`.
  */
-template <typename T>
-class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
-                      public MultiIndexTreeBaseT<T> {
+template <typename T, typename SubtreeCache = UsageRateCacheT<T>>
+class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T, SubtreeCache>, T>,
+                      public MultiIndexTreeBase<SubtreeCache> {
   private:
-    using multi_index_base = MultiIndexTreeBaseT<T>;
+    using multi_index_base = MultiIndexTreeBase<SubtreeCache>;
 
   public:
     using value_type = T;
@@ -322,15 +939,31 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
     inline MultiIndexTree() = default;
     using multi_index_base::multi_index_base;
 
-    MultiIndexTree(const std::string& output_dir, size_t max_cached_bytes);
+    MultiIndexTree(const std::string& output_dir,
+                   size_t max_cached_bytes,
+                   EvictionPolicyKind eviction_policy = EvictionPolicyKind::usage_rate);
 
-    MultiIndexTree(const NativeStorageT<T>& storage,
+    MultiIndexTree(const typename SubtreeCache::storage_type& storage,
                    const UsageRateCacheParams& params);
 
-    /// \brief Checks whether a given shape intersects any object in the tree
+    /** \brief Checks whether a given shape intersects any object in the tree
+     *
+     *  With `BoundingBoxGeometry`, a non-empty subtree which lies inside
+     *  `shape` answers the query without loading any subtree.
+     */
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline bool is_intersecting(const ShapeT& shape) const;
 
+    /** \brief Counts the elements intersecting `shape`.
+     *
+     *  With `BoundingBoxGeometry`, subtrees which lie inside `shape` are
+     *  counted by the number of elements recorded in the top-level tree,
+     *  without loading them. In the other subtrees, nodes which lie inside
+     *  `shape` are counted without testing their elements.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline size_t count_intersecting(const ShapeT& shape) const;
+
 
     /**
      * \brief Finds & return objects which intersect. To be used mainly with id-less objects
@@ -339,6 +972,31 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
     template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
     inline auto find_intersecting_objs(const ShapeT& shape) const -> std::vector<value_type>;
 
+    /** \brief Runs `find_intersecting_np` for each shape in `shapes`, grouped by subtree.
+     *
+     *  Answering queries in the given order loads a subtree whenever a query
+     *  needs it, which thrashes the cache if the queries are scattered. Instead,
+     *  the shapes are sorted along a Hilbert curve, see `space_filling_order`.
+     *  Then all queries that touch a subtree are answered while it's loaded;
+     *  and the subtrees are visited in the order they're first touched.
+     *  Hence, every subtree is loaded once per batch if the cache can hold
+     *  one subtree. Every subtree visited counts as one query towards the
+     *  usage statistics of the cache.
+     *
+     *  If `n_threads > 1` and the cache supports concurrent queries, the
+     *  subtrees are processed by `n_threads` threads.
+     *
+     *  Only the `fields` are collected, as in `find_intersecting_np`.
+     *
+     *  \returns A `batch_query_result` in CSR format, i.e. the matches of
+     *    `shapes[i]` are the entries `offsets[i], ..., offsets[i+1]-1`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline detail::batch_query_result<value_type>
+    find_intersecting_batch(const std::vector<ShapeT>& shapes,
+                            size_t n_threads = 1,
+                            query_fields_t fields = all_query_fields) const;
+
     /** \brief Total number of index elements.
      */
     inline size_t size() const {
@@ -350,20 +1008,122 @@ class MultiIndexTree: public IndexTreeMixin<MultiIndexTree<T>, T>,
 
       return count;
     }
+
+  private:
+    template <class, class>
+    friend class DistributedMultiIndexTree;
+
+    /** \brief The matches of `shapes` in the subtrees with `is_included(id)`.
+     *
+     *  The matches are pairs of the index of the query and the value, in
+     *  chunks; see `find_intersecting_batch`.
+     */
+    template <typename GeometryMode, typename ShapeT, typename SubtreeFilter>
+    inline std::vector<std::vector<std::pair<size_t, value_type>>>
+    find_intersecting_batch_matches(const std::vector<ShapeT>& shapes,
+                                    const SubtreeFilter& is_included,
+                                    size_t n_threads) const;
 };
 
-template<size_t dim, typename Value>
-inline CoordType get_centroid_coordinate(const Value &value);
+/// \brief A `MultiIndexTree` which can be queried by many threads at once.
+template <typename T>
+using ConcurrentMultiIndexTree = MultiIndexTree<T, ShardedUsageRateCacheT<T>>;
 
+template <typename T, typename Storage>
+struct supports_concurrent_queries<MultiIndexTree<T, ShardedUsageRateCache<Storage>>>
+    : std::true_type {};
 
-template<typename Value>
-struct GetCenterCoordinate {
-public:
-    template<size_t dim>
-    inline static CoordType apply(const Value &value) {
-        return get_centroid_coordinate<dim>(value);
-    }
-};
+/// \brief A `MultiIndexTree` whose subtrees are stored in containers, see `ContainerStorage`.
+template<typename T>
+using ContainerMultiIndexTree = MultiIndexTree<T, UsageRateCache<ContainerStorageT<T>>>;
+
+/// \brief A `MultiIndexTree` whose subtrees are memory mapped, see `MemoryMappedStorage`.
+template <typename T>
+using MemoryMappedMultiIndexTree = MultiIndexTree<T, UsageRateCache<MemoryMappedStorageT<T>>>;
+
+/// \brief A `MemoryMappedMultiIndexTree` whose subtrees have compact leaves.
+template <typename T>
+using CompactMemoryMappedMultiIndexTree
+    = MultiIndexTree<T, UsageRateCache<CompactMemoryMappedStorageT<T>>>;
+
+/// \brief A `MultiIndexTree` whose subtrees are allocated in arenas, see `ArenaStorageT`.
+template <typename T, typename Placement = util::HeapArenaPlacement>
+using ArenaMultiIndexTree = MultiIndexTree<T, UsageRateCache<ArenaStorageT<T, Placement>>>;
+
+
+/** \brief Add `values` to the existing multi-index in `output_dir`.
+ *
+ *  Every value is routed, by its centroid, to the subtree with the closest
+ *  bounding box; i.e. one that contains the centroid, if any. Only those
+ *  subtrees are rewritten, and the top-level tree is updated with their new
+ *  bounding boxes. A subtree which grows beyond `max_elements_per_part`
+ *  elements is split by STR; the new parts get unused ids.
+ *
+ *  Hence, the cost scales with the number of affected subtrees rather than
+ *  the size of the index. The subtrees no longer form an STR partition
+ *  though; after large updates a full rebuild results in faster queries.
+ *
+ *  With `ContainerStorage` the rewritten subtrees are stored in a new
+ *  container, which supersedes the previous versions of those subtrees.
+ *
+ *  The gid index, see `write_gid_index`, is removed since the elements of
+ *  the rewritten subtrees change position.
+ *
+ *  \warning The index must not be open, or updated, by any other process.
+ *
+ *  \throws std::runtime_error if the index has no subtrees.
+ */
+template <class Value, class Storage = NativeStorageT<Value>>
+inline void append_to_multi_index(const std::string& output_dir,
+                                  const std::vector<Value>& values,
+                                  size_t max_elements_per_part = size_t(4e6));
+
+/** \brief Create a copy-on-write snapshot of the multi-index `base_path`.
+ *
+ *  The snapshot in `output_dir` starts out as a copy of the top-level tree
+ *  and meta data of `base_path`; its subtrees are those of the base, which
+ *  are referenced via `base_paths` in the meta data. Snapshots of snapshots
+ *  reference the whole chain of bases.
+ *
+ *  Updating the snapshot, with `append_to_multi_index` or
+ *  `remove_from_multi_index`, writes only the changed subtrees, into the
+ *  snapshot. They shadow the subtrees of the base; which remain unchanged.
+ *  Hence, a series of versions of a slowly changing index stores each
+ *  subtree once per change rather than once per version.
+ *
+ *  Snapshots are supported by `NativeStorage` and `MemoryMappedStorage`; the
+ *  base must not be moved relative to the snapshot, nor updated in place.
+ *
+ *  In a process, the identical subtrees of several snapshots are loaded and
+ *  cached once by `ShardedUsageRateCache`.
+ */
+inline void create_multi_index_snapshot(const std::string& base_path,
+                                        const std::string& output_dir);
+
+/** \brief Remove the values with `is_removed(value)` from the multi-index in `output_dir`.
+ *
+ *  Only the subtrees which contain removed values are rewritten; subtrees
+ *  which become empty are dropped from the top-level tree. As with
+ *  `append_to_multi_index`, the gid index is removed.
+ *
+ *  \warning The index must not be open, or updated, by any other process.
+ *
+ *  \returns The number of removed values.
+ */
+template <class Value, class Storage = NativeStorageT<Value>, class Predicate>
+inline size_t remove_from_multi_index(const std::string& output_dir,
+                                      const Predicate& is_removed);
+
+/** \brief The storage of the multi-index in `output_dir`.
+ *
+ *  The storage also reads the subtrees of the bases of a snapshot, see
+ *  `create_multi_index_snapshot`.
+ *
+ *  \throws std::runtime_error if the index is a snapshot and `Storage`
+ *      doesn't support snapshots.
+ */
+template <class Storage>
+inline Storage open_multi_index_storage(const std::string& output_dir);
 
 #if SI_MPI == 1
 
@@ -372,23 +1132,61 @@ public:
  * This class offers an API which allows adding elements to the "index" one by one. However, no
  * index is created until `finalize()` is called.
  *
- * @tparam Value  The type of the elements in the index, e.g. `MorphoEntry`.
+ * By default all elements are kept in memory until `finalize()`. In streaming
+ * mode, once `max_elements_in_memory` elements have been inserted on a rank,
+ * they're spilled to `scratch_dir` as a sorted run; and `finalize()` builds
+ * the index out of core, see `external_distributed_partition`. Hence, the
+ * index can be larger than the memory of all ranks combined.
+ *
+ * @tparam Value    The type of the elements in the index, e.g. `MorphoEntry`.
+ * @tparam Storage  The storage policy used to write the subtrees, e.g.
+ *                  `MemoryMappedStorageT<Value>` to write subtrees that can be
+ *                  opened with `MemoryMappedMultiIndexTree`.
  */
-template<class Value>
+template<class Value, class Storage = NativeStorageT<Value>>
 class MultiIndexBulkBuilder : public IndexBulkBuilderBase<Value> {
 public:
     explicit MultiIndexBulkBuilder(std::string output_dir);
 
+    /** \brief A builder in streaming mode.
+     *
+     * Every rank may pass the same `scratch_dir`. It should be on a fast,
+     * local file system; and have room for about twice the elements.
+     */
+    MultiIndexBulkBuilder(std::string output_dir,
+                          std::string scratch_dir,
+                          size_t max_elements_in_memory);
+
+    template<class BeginIt, class EndIt>
+    inline void insert(BeginIt begin, EndIt end);
+
+    inline void insert(const Value &value);
+
     /** \brief Finalize the builder and build the index.
      *
      * Indicates that the user does not want to add anymore elements. Hence the
      * index can now be created (in parallel).
      *
+     * Each rank partitions its elements using `n_threads` threads.
+     *
      * \note This is an MPI collective operation and all ranks must participate.
      */
-    inline void finalize(MPI_Comm comm = MPI_COMM_WORLD);
+    inline void finalize(MPI_Comm comm = MPI_COMM_WORLD, size_t n_threads = 1);
+
+    /** \brief Finalize the builder, such that every rank has the same total `weight`.
+     *
+     * See `distributed_partition`. The elements are weighted by
+     * `weight(value)`, e.g. an estimate of their query cost.
+     *
+     * \throws std::invalid_argument in streaming mode, which only balances
+     * the number of elements.
+     */
+    template <class Weight>
+    inline void finalize(MPI_Comm comm, size_t n_threads, const Weight& weight);
 
     /** \brief The current number of elements on this MPI rank.
+     *
+     * This includes the elements which have been spilled.
      */
     inline size_t local_size() const;
 
@@ -396,9 +1194,18 @@ protected:
     inline void write_meta_data() const;
 
 private:
+    using spilled_runs_type = SpilledRuns<Value, GetCenterCoordinate<Value>>;
+
+    inline bool is_streaming() const;
+    inline void spill_if_needed();
+
     std::string output_dir_;
     std::string index_reldir_;
     std::string index_dir_;
+
+    std::string scratch_dir_;
+    size_t max_elements_in_memory_ = 0;
+    spilled_runs_type spilled_runs_;
 };
 
 #endif
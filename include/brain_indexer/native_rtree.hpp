@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef BOOST_GEOMETRY_INDEX_DETAIL_EXPERIMENTAL
+#error "BrainIndexer requires definition BOOST_GEOMETRY_INDEX_DETAIL_EXPERIMENTAL"
+#endif
+#include <iostream>
+#include <type_traits>
+
+// boost::serialize before boost::geometry
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/serialization.hpp>
+
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/variant.hpp>
+
+#include <brain_indexer/point3d.hpp>
+#include <brain_indexer/version.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief Write `tree` in the native bulk format.
+ *
+ *  The format consists of a header, followed by the number of children of
+ *  every node, the bounding boxes of all nodes except the root, and the
+ *  values of all leaves. The nodes are listed level by level, and within a
+ *  level in the order of their parents. Each of the three arrays is copied
+ *  bytewise; nothing is serialized element by element. Therefore, the values
+ *  must be safe to copy bytewise, see `detail::is_packable`.
+ *
+ *  The header records `SPATIAL_INDEX_STRUCT_VERSION` and the size of the
+ *  values. The layout isn't portable across architectures with different
+ *  endianness or type layouts.
+ */
+template <class... Args>
+inline void write_native_rtree(const bgi::rtree<Args...>& tree, std::ostream& os);
+
+/** \brief Read a tree written by `write_native_rtree` into `tree`.
+ *
+ *  The nodes are recreated as they were written, i.e. the tree isn't built
+ *  again. Any previous content of `tree` is discarded.
+ *
+ *  \throws std::runtime_error if the stream doesn't contain a native tree of
+ *  the same type of values, with the current `SPATIAL_INDEX_STRUCT_VERSION`.
+ */
+template <class... Args>
+inline void read_native_rtree(bgi::rtree<Args...>& tree, std::istream& is);
+
+/** \brief Does `is` start with a tree in the native bulk format.
+ *
+ *  The position of the stream is left unchanged.
+ */
+inline bool is_native_rtree(std::istream& is);
+
+/** \brief Write `tree` to `os`.
+ *
+ *  If the values can be copied bytewise the native bulk format is used;
+ *  otherwise Boost serialization.
+ */
+template <class Tree>
+inline void save_rtree(const Tree& tree, std::ostream& os);
+
+/** \brief Read a tree written by `save_rtree` from `is`.
+ *
+ *  Trees stored with Boost serialization can always be read; this includes
+ *  all trees written before the native format was introduced.
+ */
+template <class Tree>
+inline void load_rtree(Tree& tree, std::istream& is);
+
+
+namespace detail {
+
+/// \brief Can `T` be written to disk by copying its object representation.
+template <typename T>
+struct is_packable : std::is_trivially_copyable<T> {};
+
+template <typename... Args>
+struct is_packable<boost::variant<Args...>>
+    : std::conjunction<std::is_trivially_copyable<Args>...> {};
+
+} // namespace detail
+
+} // namespace brain_indexer
+
+#include "detail/native_rtree.hpp"
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A morphology in its own frame of reference.
+ *
+ *  The arrays aren't owned; they must outlive every call of `ingest_neurons`
+ *  which uses the morphology. The points of section `i` are
+ *  `section_offsets[i], ..., section_offsets[i+1]-1`; the last section ends
+ *  at `n_points`.
+ */
+struct MorphologyView {
+    Point3D soma_center;
+    CoordType soma_radius;
+
+    const Point3D* points;
+    const CoordType* radii;
+    size_t n_points;
+
+    const unsigned* section_offsets;
+    const unsigned* section_types;
+    size_t n_sections;
+};
+
+/** \brief Where and how a morphology is placed.
+ *
+ *  The points of the morphology are rotated by the quaternion `rotation`,
+ *  given as `(w, x, y, z)`, and then shifted by `position`. The quaternion
+ *  needn't be normalized. The soma is only shifted.
+ */
+struct NeuronPlacement {
+    identifier_t gid;
+    size_t morphology_id;
+    Point3D position;
+    std::array<CoordType, 4> rotation = {1.0f, 0.0f, 0.0f, 0.0f};
+};
+
+/** \brief Place the neurons and output their somas and segments.
+ *
+ *  For every placement, the soma and then all segments of the morphology
+ *  `morphologies[placement.morphology_id]` are written to `it`, in the same
+ *  order and with the same ids as `_add_soma` followed by `_add_neuron`. The
+ *  radius of a segment is the mean radius of its two points.
+ *
+ *  The points of a neuron are transformed into a buffer which is reused for
+ *  all neurons. The transform is a plain loop over the points, which the
+ *  compiler can vectorize.
+ *
+ *  \throws std::out_of_range if a placement refers to a morphology that
+ *    doesn't exist.
+ */
+template <class OutputIt>
+inline void ingest_neurons(const std::vector<MorphologyView>& morphologies,
+                           const std::vector<NeuronPlacement>& placements,
+                           OutputIt it);
+
+}  // namespace brain_indexer
+
+#include "detail/neuron_ingestion.hpp"
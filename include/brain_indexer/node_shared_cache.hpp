@@ -0,0 +1,207 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/containers/map.hpp>
+#include <boost/interprocess/managed_shared_memory.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+#if SI_MPI == 1
+#include <brain_indexer/mpi_wrapper.hpp>
+#endif
+
+
+namespace brain_indexer {
+
+namespace detail {
+
+/// \brief The location of a cached subtree inside the shared memory segment.
+struct NodeSharedEntry {
+    boost::interprocess::managed_shared_memory::handle_t handle;
+    size_t n_bytes;
+
+    size_t nodes_offset;
+    size_t n_nodes;
+    size_t leaves_offset;
+    size_t n_leaves;
+    size_t values_offset;
+    size_t n_values;
+
+    /// Number of handles to this subtree, across all processes.
+    size_t n_pins;
+
+    /// Value of the shared clock when the subtree was last requested.
+    size_t last_use;
+};
+
+/// \brief The state of the cache which is shared by all processes on a node.
+struct NodeSharedState {
+    using segment_manager = boost::interprocess::managed_shared_memory::segment_manager;
+    using entry_allocator = boost::interprocess::allocator<
+        std::pair<const size_t, NodeSharedEntry>, segment_manager>;
+    using entry_map = boost::interprocess::map<
+        size_t, NodeSharedEntry, std::less<size_t>, entry_allocator>;
+
+    explicit NodeSharedState(segment_manager* manager)
+        : entries(std::less<size_t>{}, entry_allocator(manager)) {}
+
+    boost::interprocess::interprocess_mutex mutex;
+    entry_map entries;
+    size_t cached_bytes = 0;
+    size_t clock = 0;
+};
+
+}  // namespace detail
+
+
+/** \brief A subtree cache which is shared by all processes on a node.
+ *
+ *  With many MPI ranks per node, every rank that owns a `UsageRateCache`
+ *  holds its own copy of the same hot subtrees. This cache places the
+ *  subtrees in a `boost::interprocess` shared memory segment instead. The
+ *  first process that requests a subtree loads it and copies it into the
+ *  segment; all other processes which open the same segment use that copy.
+ *  Hence, `max_cached_bytes` is the budget of the entire node, not of a
+ *  single process.
+ *
+ *  Only packed R-trees can be shared, since they don't contain pointers,
+ *  e.g. `MemoryMappedStorageT`. The subtrees are handed out as copies of
+ *  `subtree_type` that refer to the segment; a subtree isn't evicted while
+ *  any process holds such a copy.
+ *
+ *  Eviction is coordinated through a clock in the segment: the least
+ *  recently requested subtree, by any process, is evicted first. The usage
+ *  rate policy of `UsageRateCache` depends on the query count of a single
+ *  multi-index, which isn't meaningful across processes. If every cached
+ *  subtree is in use, the new subtree isn't shared, and only lives as long
+ *  as its handle.
+ *
+ *  The cache can be queried by many threads at once.
+ *
+ *  \tparam Storage  A policy for loading subtrees from disk; its subtrees
+ *                   must be packed R-trees.
+ */
+template <class Storage>
+class NodeSharedCache {
+  public:
+    using storage_type = Storage;
+    using subtree_type = typename storage_type::subtree_type;
+    using subtree_handle = subtree_type;
+
+    static_assert(detail::is_packed_rtree<subtree_type>::value,
+                  "Only packed R-trees can be placed in shared memory.");
+
+  public:
+    NodeSharedCache() = default;
+
+    /** \brief Open, or create, the segment `segment_name`.
+     *
+     *  All processes that pass the same name share the cached subtrees. The
+     *  segment outlives the processes; call `remove_segment` once it's no
+     *  longer needed. With MPI prefer `make_node_shared_cache`.
+     */
+    NodeSharedCache(const std::string& segment_name, size_t max_cached_bytes, Storage storage);
+
+    /// \brief Return a handle to the subtree with id `subtree_id`.
+    template<class SubtreeID>
+    inline subtree_handle load_subtree(const SubtreeID& subtree_id, size_t query_count);
+
+    /** \brief Add a subtree that was loaded elsewhere, e.g. by prefetching.
+     *
+     * If the subtree is already cached, `subtree` is discarded and the cached
+     * subtree is returned.
+     */
+    template<class SubtreeID>
+    inline subtree_handle insert_subtree(const SubtreeID& subtree_id,
+                                         subtree_type subtree,
+                                         size_t query_count);
+
+    /// \brief Is the subtree with id `subtree_id` in the segment?
+    inline bool is_cached(size_t subtree_id) const;
+
+    /// \brief Memory used by all subtrees in the segment, by all processes.
+    inline size_t cached_bytes() const;
+
+    /// \brief The ids of the subtrees in the segment, the most recently used first.
+    inline std::vector<size_t> cached_subtree_ids() const;
+
+    /// \brief Can a subtree be added without evicting any; only the memory counts.
+    inline bool has_room_for(size_t n_elements, size_t n_bytes) const;
+
+    /// \brief The memory a subtree with `n_elements` elements is expected to use.
+    inline size_t estimated_bytes(size_t n_elements) const;
+
+    /// \brief The memory required by the segment for a budget of `max_cached_bytes`.
+    static inline size_t segment_size(size_t max_cached_bytes);
+
+    /// \brief Remove the segment; processes which have mapped it keep their mapping.
+    static inline void remove_segment(const std::string& segment_name);
+
+  private:
+    using segment_type = boost::interprocess::managed_shared_memory;
+
+    NodeSharedCache(std::shared_ptr<segment_type> segment,
+                    size_t max_cached_bytes,
+                    Storage storage);
+
+    /// \brief A handle to `entry`; its pin must already be counted.
+    inline subtree_handle make_handle(size_t subtree_id,
+                                      const detail::NodeSharedEntry& entry) const;
+
+    /** \brief Copy `subtree` into the segment, unless another process was faster.
+     *
+     *  Returns `subtree` itself if there isn't enough room.
+     */
+    inline subtree_handle share_subtree(size_t subtree_id, subtree_type subtree);
+
+    /// \brief Evict the least recently used subtree which isn't in use; requires the lock.
+    inline bool evict_one();
+
+    Storage storage;
+    std::shared_ptr<segment_type> segment;
+    detail::NodeSharedState* state = nullptr;
+    size_t max_cached_bytes = 0;
+
+#if SI_MPI == 1
+    template <class S>
+    friend NodeSharedCache<S> make_node_shared_cache(const std::string&,
+                                                     size_t,
+                                                     S,
+                                                     MPI_Comm);
+#endif
+};
+
+
+#if SI_MPI == 1
+/** \brief Create a cache that is shared by all ranks of `comm` on the same node.
+ *
+ *  This is collective on `comm`. Any stale segment called `segment_name` is
+ *  removed first. Once all ranks on a node have mapped the segment, its name
+ *  is removed again; hence, the segment is freed when the last rank exits,
+ *  even if it crashes.
+ */
+template <class Storage>
+inline NodeSharedCache<Storage> make_node_shared_cache(const std::string& segment_name,
+                                                       size_t max_cached_bytes,
+                                                       Storage storage,
+                                                       MPI_Comm comm);
+#endif
+
+
+/// \brief A `MemoryMappedMultiIndexTree` whose cache is shared by all ranks on a node.
+template <typename T>
+using NodeSharedMultiIndexTree = MultiIndexTree<T, NodeSharedCache<MemoryMappedStorageT<T>>>;
+
+template <typename T, typename Storage>
+struct supports_concurrent_queries<MultiIndexTree<T, NodeSharedCache<Storage>>>
+    : std::true_type {};
+
+}  // namespace brain_indexer
+
+#include "detail/node_shared_cache.hpp"
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <brain_indexer/geometries.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/native_rtree.hpp>
+#include <brain_indexer/sort_tile_recursion.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A node of a `PackedRTree`.
+ *
+ *  The bounding boxes of the children are stored as a structure of arrays,
+ *  i.e. `min_corner[d][k]` is the `d`-th coordinate of the lower corner of
+ *  the `k`-th child. The children of a node are stored contiguously, either
+ *  in the node array (inner nodes) or in the value array (leaves).
+ *
+ *  The node doesn't contain any pointers. Therefore, an array of nodes can be
+ *  written to disk as is and used without deserialization.
+ */
+struct alignas(64) PackedRTreeNode {
+    static constexpr size_t max_children = 16;
+
+    CoordType min_corner[3][max_children];
+    CoordType max_corner[3][max_children];
+
+    /// \brief Index of the first child, in the node or value array.
+    std::uint64_t first_child;
+    std::uint32_t n_children;
+    std::uint32_t is_leaf;
+
+    /// \brief The bounding box of the `k`-th child.
+    inline Box3D child_box(size_t k) const {
+        return Box3D{
+            Point3D{min_corner[0][k], min_corner[1][k], min_corner[2][k]},
+            Point3D{max_corner[0][k], max_corner[1][k], max_corner[2][k]}
+        };
+    }
+};
+
+
+/// \brief How the leaves of a `PackedRTree` store the boxes of their elements.
+enum class PackedLeafFormat : std::uint32_t {
+    /// The leaves are `PackedRTreeNode`s, i.e. the boxes are stored exactly.
+    full = 0,
+    /// The leaves are `PackedCompactLeaf`s, which are about half the size.
+    compact = 1
+};
+
+/** \brief A leaf of a `PackedRTree` with quantized bounding boxes.
+ *
+ *  The corners of the boxes are stored as 16-bit offsets on a grid that
+ *  covers the bounding box of the leaf. Coordinate `q` along dimension `d`
+ *  means `origin[d] + q * cell[d]`. Since `cell[d]` is a power of two, this
+ *  is the same with or without FMA.
+ *
+ *  The lower corners are rounded down and the upper corners up. Therefore, the
+ *  quantized boxes contain the exact ones and can be used to prune the
+ *  elements conservatively. Elements which pass are checked again using their
+ *  exact boxes.
+ */
+struct alignas(64) PackedCompactLeaf {
+    static constexpr size_t max_children = PackedRTreeNode::max_children;
+    static constexpr std::uint32_t max_quantized = 0xffff;
+
+    CoordType origin[3];
+    CoordType cell[3];
+
+    std::uint16_t min_offset[3][max_children];
+    std::uint16_t max_offset[3][max_children];
+
+    /// \brief Index of the first element in the value array.
+    std::uint64_t first_child;
+    std::uint32_t n_children;
+
+    inline CoordType decode(size_t d, std::uint16_t q) const {
+        return origin[d] + CoordType(q) * cell[d];
+    }
+
+    /// \brief The quantized bounding box of the `k`-th child.
+    inline Box3D child_box(size_t k) const {
+        return Box3D{
+            Point3D{decode(0, min_offset[0][k]), decode(1, min_offset[1][k]), decode(2, min_offset[2][k])},
+            Point3D{decode(0, max_offset[0][k]), decode(1, max_offset[1][k]), decode(2, max_offset[2][k])}
+        };
+    }
+};
+
+
+/** \brief A read-only R-tree stored in flat arrays.
+ *
+ *  The tree is built once, using Sort Tile Recursion on every level, and
+ *  can't be modified afterwards. The nodes are stored in breadth-first order
+ *  with the root at index `0`. Since neither nodes nor values contain
+ *  pointers, the arrays can be memory mapped directly from a file, see
+ *  `write_packed_rtree` and `map_packed_rtree`.
+ *
+ *  With `PackedLeafFormat::compact` the leaves are stored in a separate array
+ *  of `PackedCompactLeaf`s, and `nodes()` only contains the inner nodes. A
+ *  child `i >= n_nodes()` of an inner node refers to the compact leaf
+ *  `i - n_nodes()`. The results of all queries are the same in both formats.
+ *
+ *  Copies are cheap and share the underlying arrays.
+ *
+ *  The predicates supported by `query` are those used by `IndexTreeMixin`
+ *  and `MultiIndexTree`: `bgi::intersects`, `bgi::satisfies` and their
+ *  conjunction with `&&`; and `bgi::nearest` on its own.
+ *
+ *  \tparam T  The type of the indexed elements. It must be safe to copy
+ *             its object representation, e.g. `MorphoEntry` or `Synapse`.
+ */
+template <typename T>
+class PackedRTree {
+  public:
+    using value_type = T;
+    using node_type = PackedRTreeNode;
+    using leaf_type = PackedCompactLeaf;
+    using const_iterator = const T*;
+
+    static constexpr size_t max_children = node_type::max_children;
+
+  public:
+    PackedRTree() = default;
+
+    /// \brief Bulk load the elements `[begin, end)` into a new tree, using `n_threads` threads.
+    template <class ValueIt>
+    inline PackedRTree(ValueIt begin,
+                       ValueIt end,
+                       PackedLeafFormat format = PackedLeafFormat::full,
+                       size_t n_threads = 1);
+
+    /** \brief Wrap existing arrays.
+     *
+     *  The arrays are not copied; `owner` must keep them alive.
+     */
+    inline PackedRTree(std::shared_ptr<const void> owner,
+                       const node_type* nodes,
+                       size_t n_nodes,
+                       const T* values,
+                       size_t n_values)
+        : PackedRTree(std::move(owner), nodes, n_nodes, nullptr, 0, values, n_values) {}
+
+    /// \brief Wrap existing arrays, including compact leaves.
+    inline PackedRTree(std::shared_ptr<const void> owner,
+                       const node_type* nodes,
+                       size_t n_nodes,
+                       const leaf_type* leaves,
+                       size_t n_leaves,
+                       const T* values,
+                       size_t n_values);
+
+    /** \brief Query the tree in the same way as `bgi::rtree::query`.
+     *
+     *  \returns The number of elements found.
+     */
+    template <class Predicates, class OutputIt>
+    inline size_t query(const Predicates& predicates, OutputIt it) const;
+
+    /// \brief Does any element satisfy `predicates`.
+    template <class Predicates>
+    inline bool query_any(const Predicates& predicates) const;
+
+    /// \brief Number of elements in the tree.
+    inline size_t size() const { return n_values_; }
+
+    inline bool empty() const { return n_values_ == 0; }
+
+    /// \brief The bounding box of all elements in the tree.
+    inline Box3D bounds() const;
+
+    inline const_iterator begin() const { return values_; }
+    inline const_iterator end() const { return values_ + n_values_; }
+
+    inline const node_type* nodes() const { return nodes_; }
+    inline size_t n_nodes() const { return n_nodes_; }
+
+    inline const leaf_type* leaves() const { return leaves_; }
+    inline size_t n_leaves() const { return n_leaves_; }
+
+    inline PackedLeafFormat leaf_format() const {
+        return n_leaves_ == 0 ? PackedLeafFormat::full : PackedLeafFormat::compact;
+    }
+
+  private:
+    /// \brief Calls `f(value)` for the elements of a leaf in `mask`, until `f` returns `false`.
+    template <class Predicates, class Visitor>
+    inline bool visit_leaf_values(const Predicates& predicates,
+                                  const T* leaf_values,
+                                  std::uint32_t mask,
+                                  Visitor& f) const;
+
+    /// \brief Calls `f(value)` for every match until `f` returns `false`.
+    template <class Predicates, class Visitor>
+    inline void visit(const Predicates& predicates, Visitor&& f) const;
+
+    /// \brief Best-first search for the `k` elements closest to `geometry`.
+    template <class Geometry, class OutputIt>
+    inline size_t query_nearest(const Geometry& geometry, size_t k, OutputIt it) const;
+
+    std::shared_ptr<const void> owner_;
+    const node_type* nodes_ = nullptr;
+    size_t n_nodes_ = 0;
+    const leaf_type* leaves_ = nullptr;
+    size_t n_leaves_ = 0;
+    const T* values_ = nullptr;
+    size_t n_values_ = 0;
+};
+
+
+/// \brief `count` elements with the same `gid`.
+struct GidRun {
+    identifier_t gid;
+    std::uint64_t count;
+};
+
+/** \brief Run-length summaries of the gids below the inner nodes of a tree.
+ *
+ *  The runs of node `i` are `runs[offsets[i]], ..., runs[offsets[i+1]-1]`,
+ *  sorted by gid. Leaves have no runs, since their few elements are counted
+ *  directly. Each level has at most one run per element; usually far fewer,
+ *  because nearby elements tend to share their gid.
+ */
+struct PackedGidSummaries {
+    std::vector<std::uint64_t> offsets;
+    std::vector<GidRun> runs;
+};
+
+
+/** \brief A read-only spatial index backed by a `PackedRTree`.
+ *
+ *  This offers the same queries as `IndexTree`, e.g. `find_intersecting`,
+ *  `count_intersecting` and `find_nearest`. However, it can't be modified
+ *  after construction. In return, the nodes are stored contiguously and the
+ *  bounding boxes of the children of a node are next to each other in memory,
+ *  which reduces the number of cache misses per query.
+ *
+ *  \note Like `IndexTree` it can be initialized from an SoA reader, see
+ *        `make_soa_reader`, to avoid copying all the raw data.
+ */
+template <typename T>
+class PackedIndexTree: public IndexTreeMixin<PackedIndexTree<T>, T>, public PackedRTree<T> {
+    using super = PackedRTree<T>;
+
+  public:
+    using value_type = T;
+    using cref_t = std::reference_wrapper<const T>;
+
+    inline PackedIndexTree() = default;
+
+    /// \brief Bulk load the elements `[begin, end)`.
+    template <class ValueIt>
+    inline PackedIndexTree(ValueIt begin,
+                           ValueIt end,
+                           PackedLeafFormat format = PackedLeafFormat::full,
+                           size_t n_threads = 1)
+        : super(begin, end, format, n_threads) {}
+
+    /// \brief Builds a packed copy of all elements in `tree`.
+    template <class A>
+    inline explicit PackedIndexTree(const IndexTree<T, A>& tree,
+                                    PackedLeafFormat format = PackedLeafFormat::full,
+                                    size_t n_threads = 1)
+        : super(tree.begin(), tree.end(), format, n_threads) {}
+
+    /// \brief Wraps an existing tree, e.g. one returned by `map_packed_rtree`.
+    inline explicit PackedIndexTree(PackedRTree<T> tree)
+        : super(std::move(tree)) {}
+
+    /** \brief Open an index written by `dump`.
+     *
+     *  Unlike `IndexTree(filename)`, nothing is deserialized. The file is
+     *  memory mapped and only the top `n_eager_levels` levels of the tree are
+     *  read right away; deeper nodes and the elements are paged in when a
+     *  query first touches them. Hence, opening takes about as long as reading
+     *  a few pages, independent of the size of the index.
+     */
+    inline explicit PackedIndexTree(const std::string& filename, size_t n_eager_levels = 3);
+
+    /// \brief Output the tree to a file which can be memory mapped, see `write_packed_rtree`.
+    inline void dump(const std::string& filename) const;
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const;
+
+    /**
+     * \brief Finds & return objects which intersect. To be used mainly with id-less objects
+     * \returns A vector of references to tree objects
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<cref_t> find_intersecting_objs(const ShapeT& shape) const;
+
+    /** \brief Summarize the gids below every inner node, see `PackedGidSummaries`.
+     *
+     *  Afterwards, `count_intersecting_agg_gid` with `BoundingBoxGeometry`
+     *  merges the summary of any node which lies inside the query, instead of
+     *  visiting its elements. The summaries are shared by copies of the index
+     *  made afterwards. They aren't written by `dump`.
+     *
+     *  Requires that `T` has a `post_gid()`, e.g. `Synapse`.
+     */
+    inline void build_gid_summaries();
+
+    inline bool has_gid_summaries() const { return gid_summaries_ != nullptr; }
+
+    /// \brief Counts the objects intersecting the shape, per post-synaptic gid.
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::unordered_map<identifier_t, size_t> count_intersecting_agg_gid(
+        const ShapeT& shape) const;
+
+  private:
+    std::shared_ptr<const PackedGidSummaries> gid_summaries_;
+};
+
+/// The packed R-tree is immutable and can be queried by any number of threads at once.
+template <typename T>
+struct supports_concurrent_queries<PackedIndexTree<T>> : std::true_type {};
+
+
+/** \brief A `PackedRTree` which is built with compact leaves.
+ *
+ *  This is meant as the subtree type of a multi-index, see
+ *  `CompactMemoryMappedStorageT`; which reduces the memory required by every
+ *  cached subtree.
+ */
+template <typename T>
+class CompactPackedRTree: public PackedRTree<T> {
+    using super = PackedRTree<T>;
+
+  public:
+    CompactPackedRTree() = default;
+
+    /// \brief Bulk load the elements `[begin, end)` with compact leaves.
+    template <class ValueIt>
+    inline CompactPackedRTree(ValueIt begin, ValueIt end)
+        : super(begin, end, PackedLeafFormat::compact) {}
+
+    /// \brief Wraps an existing tree, e.g. one returned by `map_packed_rtree`.
+    inline explicit CompactPackedRTree(PackedRTree<T> tree)
+        : super(std::move(tree)) {}
+};
+
+
+/** \brief Write `tree` to `filename` such that it can be memory mapped.
+ *
+ *  The file consists of a small header followed by the node, compact leaf
+ *  and value arrays, each aligned to 64 bytes. The layout isn't portable
+ *  across architectures with different endianness or type layouts.
+ */
+template <typename T>
+inline void write_packed_rtree(const PackedRTree<T>& tree, const std::string& filename);
+
+/** \brief Memory map a tree written by `write_packed_rtree`.
+ *
+ *  The nodes and values are used in place; they are paged in by the OS when
+ *  they are first accessed. The mapping is released when the last copy of the
+ *  returned tree is destroyed.
+ *
+ *  The nodes of the top `n_eager_levels` levels are read before returning,
+ *  such that the first queries don't need to wait for the disk on every
+ *  level of the tree. Since the nodes are stored in breadth-first order,
+ *  these levels are a prefix of the node array.
+ *
+ *  \throws std::runtime_error if the file isn't a packed R-tree of `T`.
+ */
+template <typename T>
+inline PackedRTree<T> map_packed_rtree(const std::string& filename, size_t n_eager_levels = 0);
+
+/** \brief Bulk load `values` into `tree`, using the same STR as `PackedRTree`.
+ *
+ *  The nodes of `tree` are created with the layout of the packed tree, see
+ *  `PackedRTree(begin, end)`; rather than by `bgi::rtree`'s own packing
+ *  algorithm. Only the STR uses `n_threads` threads, the nodes are allocated
+ *  by the calling thread. Any previous content of `tree` is discarded.
+ *
+ *  The tree can be modified afterwards, like any other `bgi::rtree`.
+ *
+ *  \throws std::invalid_argument if the nodes of `tree` can't hold
+ *  `PackedRTreeNode::max_children` children.
+ */
+template <class... Args>
+inline void bulk_load_rtree(bgi::rtree<Args...>& tree,
+                            std::vector<typename bgi::rtree<Args...>::value_type> values,
+                            size_t n_threads = 1);
+
+
+namespace detail {
+
+template <typename T>
+struct is_packed_rtree : std::false_type {};
+
+template <typename T>
+struct is_packed_rtree<PackedRTree<T>> : std::true_type {};
+
+template <typename T>
+struct is_packed_rtree<CompactPackedRTree<T>> : std::true_type {};
+
+} // namespace detail
+
+} // namespace brain_indexer
+
+#include "detail/packed_rtree.hpp"
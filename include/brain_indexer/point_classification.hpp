@@ -0,0 +1,47 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/query_ordering.hpp>
+
+
+namespace brain_indexer {
+
+/// \brief The id of the points which no element contains, see `classify_points`.
+constexpr identifier_t unclassified_point = std::numeric_limits<identifier_t>::max();
+
+/** \brief The id of an element which contains the point, for each of `points`.
+ *
+ *  Spheres, somas, cylinders, segments and synapses contain the points for
+ *  which their `contains` is true; points contain no points. If several
+ *  elements contain a point, it gets the smallest id; if none does,
+ *  `unclassified_point`. The ids are those returned by queries, i.e. the
+ *  gid for parts of morphologies.
+ *
+ *  The points are sorted along a Hilbert curve, and split into blocks of
+ *  `block_size` consecutive points. Each block traverses the tree once,
+ *  descending only into nodes which contain some of its points; and it
+ *  tests only the points inside the bounding box of an element. The blocks
+ *  are classified by `n_threads` threads. A multi-index loads the subtrees
+ *  which contain any of the blocks one after the other.
+ */
+template <class Index>
+inline std::vector<identifier_t> classify_points(const Index& index,
+                                                 Point3Dx const* points,
+                                                 size_t n_points,
+                                                 size_t n_threads = 1,
+                                                 size_t block_size = 64);
+
+template <class Index>
+inline std::vector<identifier_t> classify_points(const Index& index,
+                                                 const std::vector<Point3Dx>& points,
+                                                 size_t n_threads = 1,
+                                                 size_t block_size = 64);
+
+}  // namespace brain_indexer
+
+#include "detail/point_classification.hpp"
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief Streams the elements intersecting a query, in batches.
+ *
+ *  Unlike `find_intersecting`, the matches aren't collected all at once.
+ *  Every call of `next_batch` returns at most the requested number of
+ *  further matches. Hence, queries with very large results can be processed
+ *  with bounded memory, e.g. by passing an `iter_entry_getter` which is
+ *  cleared after every batch.
+ *
+ *  This is the cursor of in-memory indexes, e.g. `IndexTree`. It wraps a
+ *  query iterator of the R-tree, i.e. the tree is traversed lazily. The
+ *  index must outlive the cursor and must not be modified while the cursor
+ *  is in use.
+ *
+ *  Cursors are created by `make_query_cursor`.
+ */
+template <class Index>
+class QueryCursor {
+  public:
+    using value_type = typename Index::value_type;
+    using exact_test_type = std::function<bool(const value_type&)>;
+
+    /** \brief Elements whose box intersects `query_box` and which pass `exact_test`.
+     */
+    inline QueryCursor(const Index& index, const Box3D& query_box, exact_test_type exact_test)
+        : it_(index.qbegin(bgi::intersects(query_box) && bgi::satisfies(std::move(exact_test))))
+        , end_(index.qend()) {}
+
+    /** \brief Output at most `max_elements` further matches to `it`.
+     *
+     *  \returns The number of elements written; `0` only if all matches
+     *    have been returned.
+     */
+    template <class OutputIt>
+    inline size_t next_batch(size_t max_elements, OutputIt it);
+
+  private:
+    typename Index::const_query_iterator it_;
+    typename Index::const_query_iterator end_;
+};
+
+
+/** \brief The cursor of multi-indexes.
+ *
+ *  The subtrees which intersect the query are queried one at a time, when
+ *  the matches of the previous subtree have all been returned. Therefore, at
+ *  most the matches of one subtree are held in memory, in addition to the
+ *  subtree itself. The cursor counts as one query towards the usage
+ *  statistics of the cache; and it doesn't prefetch subtrees.
+ *
+ *  The multi-index must outlive the cursor.
+ */
+template <class T, class SubtreeCache>
+class QueryCursor<MultiIndexTree<T, SubtreeCache>> {
+  public:
+    using index_type = MultiIndexTree<T, SubtreeCache>;
+    using value_type = T;
+    using exact_test_type = std::function<bool(const value_type&)>;
+
+    inline QueryCursor(const index_type& index,
+                       const Box3D& query_box,
+                       exact_test_type exact_test);
+
+    /// \brief See `QueryCursor::next_batch`.
+    template <class OutputIt>
+    inline size_t next_batch(size_t max_elements, OutputIt it);
+
+  private:
+    using subtree_id_type = typename index_type::toptree_type::value_type;
+
+    const index_type& index_;
+    Box3D query_box_;
+    exact_test_type exact_test_;
+
+    std::vector<subtree_id_type> subtrees_;
+    size_t next_subtree_ = 0;
+
+    /// The matches of the current subtree, starting at `n_returned_`.
+    std::vector<value_type> pending_;
+    size_t n_returned_ = 0;
+};
+
+
+/// \brief Can `make_query_cursor` be used with `Index`.
+template <class Index>
+struct supports_query_cursor : std::false_type {};
+
+template <class T, class A>
+struct supports_query_cursor<IndexTree<T, A>> : std::true_type {};
+
+template <class T, class SubtreeCache>
+struct supports_query_cursor<MultiIndexTree<T, SubtreeCache>> : std::true_type {};
+
+
+/** \brief A cursor over the elements of `index` which intersect `shape`.
+ *
+ *  The cursor returns the same elements as `find_intersecting` with the same
+ *  `GeometryMode`; but not necessarily in the same order. A copy of `shape`
+ *  is kept by the cursor.
+ */
+template <typename GeometryMode = BoundingBoxGeometry, class Index, class ShapeT>
+inline QueryCursor<Index> make_query_cursor(const Index& index, const ShapeT& shape);
+
+}  // namespace brain_indexer
+
+#include "detail/query_cursor.hpp"
@@ -1,60 +1,56 @@
 #pragma once
 
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 #include <brain_indexer/index.hpp>
 #include <zisa/math/space_filling_curve.hpp>
 
 namespace brain_indexer {
 namespace experimental {
 
-std::vector<size_t> space_filling_order(Point3Dx const * points, size_t n_points) {
-    auto sfc_index = std::vector<size_t>(n_points);
-
-    auto float_max = std::numeric_limits<CoordType>::max();
-    auto float_min = std::numeric_limits<CoordType>::lowest();
-
-    auto min_corner = Point3Dx{float_max, float_max, float_max};
-    auto max_corner = Point3Dx{float_min, float_min, float_min};
-
-    for(size_t i = 0; i < n_points; ++i) {
-        min_corner = min(min_corner, points[i]);
-        max_corner = max(max_corner, points[i]);
-    }
-
-    auto box_size = max_corner - min_corner;
-
-    auto normalize = [min_corner, box_size](const Point3D& xyz) {
-        return Point3D{
-            (xyz.get<0>() - min_corner.get<0>()) / box_size.get<0>(),
-            (xyz.get<1>() - min_corner.get<1>()) / box_size.get<1>(),
-            (xyz.get<2>() - min_corner.get<2>()) / box_size.get<2>()
-        };
-    };
-
-    for(size_t i = 0; i < n_points; ++i) {
-        auto xyz_norm = normalize(points[i]);
-        sfc_index[i] = zisa::hilbert_index<10>(
-            xyz_norm.get<0>(),
-            xyz_norm.get<1>(),
-            xyz_norm.get<2>()
-        ).to_ulong();
-    }
-
-    auto order = std::vector<size_t>(n_points);
-    for(size_t i = 0; i < n_points; ++i) {
-        order[i] = i;
-    }
-
-    std::sort(order.begin(), order.end(), [&sfc_index](size_t i, size_t j) {
-         return sfc_index[i] < sfc_index[j];
-    });
-
-    return order;
-}
-
-std::vector<size_t> space_filling_order(const std::vector<Point3Dx> & points) {
-    return space_filling_order(points.data(), points.size());
-}
-
-
-}
-}
\ No newline at end of file
+/// \brief The largest number of bits per axis such that a Hilbert key fits into 64 bits.
+constexpr int max_hilbert_bits = 21;
+
+/** \brief Order the points along a Hilbert curve.
+ *
+ *  The points are normalized to their bounding box, which is divided into
+ *  `2**n_bits` cells per axis. Points in the same cell keep their relative
+ *  order. Note that `n_bits = 21` is the most that fits into a 64-bit key.
+ *
+ *  The keys are computed, and sorted with an LSD radix sort, using `n_threads`
+ *  threads.
+ *
+ *  \throws std::invalid_argument if `n_bits` isn't in `[1, 21]`.
+ */
+inline std::vector<size_t> space_filling_order(Point3Dx const * points,
+                                               size_t n_points,
+                                               int n_bits = 10,
+                                               size_t n_threads = 1);
+
+inline std::vector<size_t> space_filling_order(const std::vector<Point3Dx> & points,
+                                               int n_bits = 10,
+                                               size_t n_threads = 1);
+
+namespace detail {
+
+/// \brief The `n_bits` Hilbert key of a point in the unit cube.
+inline std::uint64_t hilbert_key(int n_bits, const Point3D& xyz);
+
+/** \brief Stable sort of `(key, index)` pairs by key.
+ *
+ *  This is an LSD radix sort with 8-bit digits. Only the lowest `n_key_bits`
+ *  of the keys are considered. Every pass computes one histogram per chunk
+ *  of the input, which makes the scatter parallel and still stable.
+ */
+inline void radix_sort_by_key(std::vector<std::pair<std::uint64_t, size_t>>& pairs,
+                              int n_key_bits,
+                              size_t n_threads = 1);
+
+}  // namespace detail
+
+}  // namespace experimental
+}  // namespace brain_indexer
+
+#include "detail/query_ordering.hpp"
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#if SI_MPI == 1
+#include <mpi.h>
+#endif
+
+
+namespace brain_indexer {
+
+/** \brief Counters describing the work done by queries.
+ *
+ *  They're only collected if BrainIndexer is built with `SI_QUERY_STATS`;
+ *  otherwise all counters remain zero and collecting them costs nothing.
+ *
+ *  Together they show whether a workload is I/O-bound (`subtree_loads`,
+ *  `bytes_read`, `load_nanoseconds`), traversal-bound (`nodes_visited`,
+ *  `leaves_tested`) or geometry-bound (`exact_tests`).
+ *
+ *  The nodes of a Boost R-tree are only counted by `count_intersecting`,
+ *  other queries of a Boost R-tree leave `nodes_visited` and `leaves_tested`
+ *  at zero. The nodes of a `PackedRTree` are always counted.
+ */
+struct QueryStats {
+    std::uint64_t n_queries = 0;
+
+    /// Nodes whose children were tested, including leaves.
+    std::uint64_t nodes_visited = 0;
+    /// Leaves whose elements were tested.
+    std::uint64_t leaves_tested = 0;
+    /// Tests of the exact geometry of an element, i.e. in best-effort mode.
+    std::uint64_t exact_tests = 0;
+    /// Elements which matched the query.
+    std::uint64_t hits = 0;
+
+    /// Subtrees of a multi-index read from disk.
+    std::uint64_t subtree_loads = 0;
+    /// Bytes of those subtrees.
+    std::uint64_t bytes_read = 0;
+    /// Time spent reading and deserializing those subtrees.
+    std::uint64_t load_nanoseconds = 0;
+
+    inline QueryStats& operator+=(const QueryStats& other);
+
+    inline double load_seconds() const {
+        return 1e-9 * double(load_nanoseconds);
+    }
+};
+
+/// \brief Calls `f(name, counter)` for every counter of `stats`.
+template <class Stats, class F>
+inline void for_each_query_stat(Stats& stats, F&& f);
+
+
+/** \brief Adds the statistics of all queries on this thread to `stats`.
+ *
+ *  Every query which finishes on this thread, while the recorder is alive,
+ *  is added to `stats`. This allows measuring a single query:
+ *
+ *      auto stats = QueryStats{};
+ *      {
+ *          auto recorder = QueryStatsRecorder(stats);
+ *          index.find_intersecting(box, it);
+ *      }
+ *
+ *  The statistics of each index are also accumulated by the index itself,
+ *  see `IndexTreeMixin::query_stats`.
+ */
+class QueryStatsRecorder {
+  public:
+    inline explicit QueryStatsRecorder(QueryStats& stats) noexcept;
+    inline ~QueryStatsRecorder();
+
+    QueryStatsRecorder(const QueryStatsRecorder&) = delete;
+    QueryStatsRecorder& operator=(const QueryStatsRecorder&) = delete;
+
+  private:
+    QueryStats* previous_;
+};
+
+
+#if SI_MPI == 1
+/// \brief The sum of `stats` over all ranks of `comm`, on every rank.
+inline QueryStats reduce_query_stats(const QueryStats& stats, MPI_Comm comm);
+#endif
+
+
+namespace detail {
+
+#if SI_QUERY_STATS == 1
+constexpr bool query_stats_enabled = true;
+#else
+constexpr bool query_stats_enabled = false;
+#endif
+
+/// \brief The statistics of the query running on this thread, and of its recorder.
+struct ThreadQueryStats {
+    QueryStats* query = nullptr;
+    QueryStats* recorder = nullptr;
+};
+
+inline ThreadQueryStats& thread_query_stats() noexcept;
+
+/// \brief The statistics of all queries of an index, which may run concurrently.
+class QueryStatsTotal {
+  public:
+    QueryStatsTotal() = default;
+    inline QueryStatsTotal(const QueryStatsTotal& other);
+    inline QueryStatsTotal& operator=(const QueryStatsTotal& other);
+
+    inline void add(const QueryStats& stats);
+    inline QueryStats get() const;
+    inline void reset();
+
+  private:
+    mutable std::mutex mutex_;
+    QueryStats stats_;
+};
+
+/** \brief Collects the statistics of one query on this thread.
+ *
+ *  On destruction, they're added to `total` and the recorder of this
+ *  thread, if any. Scopes of queries which run inside another query, e.g.
+ *  of the subtrees of a multi-index, are ignored.
+ */
+class QueryStatsScope {
+  public:
+    inline explicit QueryStatsScope(QueryStatsTotal& total, std::uint64_t n_queries = 1);
+    inline ~QueryStatsScope();
+
+    QueryStatsScope(const QueryStatsScope&) = delete;
+    QueryStatsScope& operator=(const QueryStatsScope&) = delete;
+
+  private:
+    QueryStatsTotal* total_ = nullptr;
+    QueryStats stats_;
+};
+
+/// \brief Runs `f()` on this thread, while recording into `stats`, e.g. on a background thread.
+template <class F>
+inline decltype(auto) with_query_stats(QueryStats& stats, F&& f);
+
+/// \brief Adds `stats` to the query running on this thread, if any.
+inline void add_to_running_query(const QueryStats& stats);
+
+/** \brief Adds a subtree load, which started at `start`, to the running query.
+ *
+ *  `n_bytes` is only called if the statistics are collected.
+ */
+template <class NBytes>
+inline void record_subtree_load(std::chrono::steady_clock::time_point start,
+                                const NBytes& n_bytes);
+
+}  // namespace detail
+}  // namespace brain_indexer
+
+
+/// \brief Adds `n` to the counter `field` of the running query, if statistics are collected.
+#if SI_QUERY_STATS == 1
+#define SI_QUERY_STATS_ADD(field, n)                                                        \
+    do {                                                                                    \
+        if(auto* si_query_stats_ = ::brain_indexer::detail::thread_query_stats().query) {  \
+            si_query_stats_->field += (n);                                                  \
+        }                                                                                   \
+    } while(false)
+#else
+#define SI_QUERY_STATS_ADD(field, n) do { } while(false)
+#endif
+
+#include "detail/query_stats.hpp"
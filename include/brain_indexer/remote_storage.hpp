@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <brain_indexer/multi_index.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief Objects are the files of a local directory.
+ *
+ *  This is an object store for `RemoteContainerStorage`; e.g. for a bucket
+ *  mounted as a file system. An object store maps keys, the basenames of
+ *  the files of a multi-index, to their bytes. It must provide:
+ *
+ *    - `read(key)`, all bytes of an object; or `std::nullopt` if there's no
+ *      object `key`.
+ *    - `read_range(key, offset, n_bytes)`, exactly the bytes
+ *      `[offset, offset + n_bytes)` of an object; throwing otherwise.
+ *    - `identity()`, a name of the store, e.g. its URL; which tells
+ *      the subtrees of different stores in a disk cache apart.
+ *
+ *  Both are called concurrently, e.g. by the prefetcher of the multi-index.
+ */
+class FileObjectStore {
+  public:
+    explicit FileObjectStore(std::string root_dir);
+
+    inline std::optional<std::string> read(const std::string& key) const;
+    inline std::string read_range(const std::string& key, size_t offset, size_t n_bytes) const;
+    inline std::string identity() const;
+
+  private:
+    std::string root_dir;
+};
+
+
+#if SI_CURL == 1
+/** \brief Objects are read with HTTP GET requests, e.g. from S3.
+ *
+ *  The object `key` is at `base_url + "/" + key`; and ranges are read with
+ *  HTTP range requests. Every request uses its own connection, such that
+ *  requests can be made from many threads. Failed requests, server errors
+ *  and throttling are retried up to `max_retries` times, with exponential
+ *  backoff.
+ *
+ *  The `headers` are sent with every request, e.g. an authorization header.
+ *  Requests aren't signed; private buckets need pre-signed or proxied URLs.
+ *
+ *  Requires building with `SI_CURL`.
+ */
+class HttpObjectStore {
+  public:
+    explicit HttpObjectStore(std::string base_url,
+                             std::vector<std::string> headers = {},
+                             size_t max_retries = 3);
+
+    inline std::optional<std::string> read(const std::string& key) const;
+    inline std::string read_range(const std::string& key, size_t offset, size_t n_bytes) const;
+    inline std::string identity() const;
+
+  private:
+    /// \brief The HTTP status and body of a GET request.
+    inline std::pair<long, std::string> get(const std::string& key,
+                                            const std::string& range) const;
+
+    std::string base_url;
+    std::vector<std::string> headers;
+    size_t max_retries;
+};
+#endif
+
+
+/** \brief The parameters of the local cache of `RemoteContainerStorage`.
+ *
+ *  Subtrees read from the object store are kept as files in `cache_dir`,
+ *  up to `max_cached_bytes`; the least recently used ones are removed
+ *  first. An empty `cache_dir` disables the cache.
+ *
+ *  The files are named after the object store, the version of the index
+ *  and the location of the subtree in its container; hence, subtrees of
+ *  other indexes, or of an index that was rewritten, are never returned.
+ *  Still, a `cache_dir` should only be shared by the readers of the same
+ *  index: every reader applies its own `max_cached_bytes` to all files.
+ */
+struct RemoteStorageParams {
+    std::string cache_dir;
+    size_t max_cached_bytes = std::numeric_limits<size_t>::max();
+};
+
+namespace detail {
+
+/** \brief Serialized subtrees on a local disk, by the key of their object.
+ *
+ *  The key identifies the bytes of a subtree in the object store, see
+ *  `RemoteContainerStorage::object_key`.
+ *
+ *  Files are written under a temporary name and renamed; hence processes
+ *  on the same node can share `cache_dir`. Files which are already in
+ *  `cache_dir` are adopted. The cache is best effort: a subtree which
+ *  can't be written, or which disappears, is read from the object store.
+ */
+class SubtreeDiskCache {
+  public:
+    SubtreeDiskCache(std::string cache_dir, size_t max_cached_bytes);
+
+    /// \brief The subtree `object_key`, if it's cached and has `n_bytes` bytes.
+    inline std::optional<std::string> find(std::uint64_t object_key, size_t n_bytes);
+
+    /// \brief Cache the subtree, evicting the least recently used ones.
+    inline void insert(std::uint64_t object_key, const std::string& bytes);
+
+    inline size_t cached_bytes() const;
+
+  private:
+    inline std::string filename(std::uint64_t object_key) const;
+
+    /// \brief Mark the file `object_key` as most recently used.
+    inline void touch(std::uint64_t object_key, size_t n_bytes);
+
+    /// \brief Remove the least recently used file; `mutex` must be locked.
+    inline void evict_least_recently_used();
+
+    std::string cache_dir;
+    size_t max_cached_bytes;
+
+    mutable std::mutex mutex;
+    std::list<std::uint64_t> lru;
+    std::unordered_map<std::uint64_t, std::pair<std::list<std::uint64_t>::iterator, size_t>> entries;
+    size_t n_cached_bytes = 0;
+};
+
+/// \brief The offset tables of all containers in an object store.
+struct RemoteContainerReader {
+    std::once_flag is_opened;
+    std::unordered_map<size_t, ContainerReader::Location> locations;
+
+    /// \brief A hash of the store, the offset tables and the top-level tree.
+    std::uint64_t index_version = 0;
+};
+
+/// \brief The FNV-1a hash of `bytes`, continuing from `hash`; stable across processes.
+inline std::uint64_t fnv1a_hash(const std::string& bytes,
+                                std::uint64_t hash = 14695981039346656037ull);
+
+}  // namespace detail
+
+
+/** \brief The containers of a multi-index are read from an object store.
+ *
+ *  This is a read-only storage policy for `UsageRateCache` and
+ *  `ShardedUsageRateCache`. It reads multi-indexes written with
+ *  `ContainerStorage` from an `ObjectStore`, e.g. `HttpObjectStore`; without
+ *  copying them to a local disk first. The top-level tree and the offset
+ *  tables are read in full when the storage is opened; every subtree is a
+ *  single range read of its data file.
+ *
+ *  Subtrees are also kept in a local disk cache, see `RemoteStorageParams`;
+ *  it outlives the process, and is shared by processes on the same node.
+ *
+ *  Subtrees are read in parallel by the prefetcher, see `set_prefetch_depth`,
+ *  and by `warm_up`; which hides the latency of the requests.
+ *
+ *  The containers are those of writers `0, 1, ...`, up to the first writer
+ *  without an offset table; since object stores can't list the objects.
+ *
+ *  \tparam TopTree Type of the top-level index of a multi index.
+ *  \tparam SubTree Type of the sub indices of a multi index.
+ *  \tparam ObjectStore Where the containers are read from, e.g. `FileObjectStore`.
+ */
+template <class TopTree, class SubTree, class ObjectStore>
+class RemoteContainerStorage {
+  public:
+    /// \brief The type of the top-level tree of the multi index.
+    using toptree_type = TopTree;
+
+    /// \brief The type of the subtrees of the multi index.
+    using subtree_type = SubTree;
+
+  public:
+    RemoteContainerStorage() = default;
+
+    explicit RemoteContainerStorage(ObjectStore store,
+                                    const RemoteStorageParams& params = RemoteStorageParams{});
+
+    /** \brief Load the subtree with id `subtree_id`, from any writer.
+     *
+     *  Precedence is as in `ContainerStorage::load_subtree`.
+     *
+     *  \throws std::runtime_error if no writer saved the subtree.
+     */
+    inline SubTree load_subtree(size_t subtree_id) const;
+    inline TopTree load_top_tree() const;
+
+  private:
+    inline void open_reader() const;
+
+    /// \brief The key of the bytes of a subtree in the disk cache.
+    inline std::uint64_t object_key(const detail::ContainerReader::Location& location) const;
+
+    /// \brief The serialized subtree, from the disk cache or the object store.
+    inline std::string read_subtree(const detail::ContainerReader::Location& location) const;
+
+    std::shared_ptr<ObjectStore> store;
+    std::shared_ptr<detail::SubtreeDiskCache> disk_cache;
+    std::shared_ptr<detail::RemoteContainerReader> reader
+        = std::make_shared<detail::RemoteContainerReader>();
+};
+
+template<class T, class ObjectStore = FileObjectStore>
+using RemoteContainerStorageT
+    = RemoteContainerStorage<MultiIndexTopTreeT, MultiIndexSubTreeT<T>, ObjectStore>;
+
+/// \brief A multi-index whose containers are read from an object store.
+template<class T, class ObjectStore = FileObjectStore>
+using RemoteMultiIndexTree
+    = MultiIndexTree<T, UsageRateCache<RemoteContainerStorageT<T, ObjectStore>>>;
+
+}  // namespace brain_indexer
+
+#include "detail/remote_storage.hpp"
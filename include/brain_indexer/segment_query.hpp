@@ -0,0 +1,54 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include <brain_indexer/geometries.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+
+namespace brain_indexer {
+
+/// \brief An element hit by a segment, see `find_along_segment`.
+template <class T>
+struct SegmentHit {
+    /// \brief The position along the segment, from `0` at `p1` to `1` at `p2`.
+    CoordType t;
+    T value;
+};
+
+/** \brief The elements hit by the segment from `p1` to `p2`, ordered along it.
+ *
+ *  The segment can be thickened by `radius`, i.e. it's the capsule of all
+ *  points within `radius` of the segment. Only the nodes whose bounding box,
+ *  inflated by `radius`, is crossed by the segment are visited; this is a
+ *  slab test. Hence, long oblique segments don't visit all the nodes of
+ *  their bounding box. For a ray, pass an end point outside of `bounds()`.
+ *
+ *  An element is hit if the capsule intersects it, see `BestEffortGeometry`;
+ *  or with `BoundingBoxGeometry` if it intersects its bounding box, as in
+ *  `find_intersecting`.
+ *
+ *  The hits are sorted by `t`, the parameter at which the segment enters
+ *  the inflated bounding box of the element. The nodes are visited in the
+ *  order in which the segment enters them; hence, the traversal stops as
+ *  soon as the first `max_hits` hits are known.
+ *
+ *  The index can be an `IndexTree`, a `PackedIndexTree` or a
+ *  `MultiIndexTree`. The subtrees of a multi-index are loaded in the order
+ *  in which the segment enters them, and only as long as they can contain
+ *  one of the first `max_hits` hits.
+ */
+template <class GeometryMode = BestEffortGeometry, class Index>
+inline std::vector<SegmentHit<typename Index::value_type>>
+find_along_segment(const Index& index,
+                   const Point3D& p1,
+                   const Point3D& p2,
+                   CoordType radius = 0,
+                   size_t max_hits = std::numeric_limits<size_t>::max());
+
+}  // namespace brain_indexer
+
+#include "detail/segment_query.hpp"
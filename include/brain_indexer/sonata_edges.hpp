@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+
+#if SI_HDF5 == 1
+#include <hdf5.h>
+#endif
+
+
+namespace brain_indexer {
+
+#if SI_HDF5 == 1
+
+namespace detail {
+
+/// \brief Owns an HDF5 identifier and closes it with `close`.
+class Hdf5Handle {
+  public:
+    Hdf5Handle() = default;
+    inline Hdf5Handle(hid_t id, herr_t (*close)(hid_t)) noexcept;
+    inline Hdf5Handle(Hdf5Handle&& other) noexcept;
+    inline Hdf5Handle& operator=(Hdf5Handle&& other) noexcept;
+    inline ~Hdf5Handle();
+
+    Hdf5Handle(const Hdf5Handle&) = delete;
+    Hdf5Handle& operator=(const Hdf5Handle&) = delete;
+
+    inline operator hid_t() const noexcept {
+        return id_;
+    }
+
+  private:
+    hid_t id_ = -1;
+    herr_t (*close_)(hid_t) = nullptr;
+};
+
+} // namespace detail
+
+/** \brief Streams the synapses of a SONATA edge population.
+ *
+ *  The edges are read straight from the datasets `source_node_id`,
+ *  `target_node_id` and `0/afferent_center_{x,y,z}` of the population, one
+ *  hyperslab of at most `block_size` edges at a time. The id of a synapse is
+ *  its edge id.
+ *
+ *  Requires building with `SI_HDF5`.
+ */
+class SonataEdgeReader {
+  public:
+    /// The number of edges read at once, unless stated otherwise.
+    static constexpr size_t default_block_size = size_t(1) << 20;
+
+    /** \brief Open the population `population` of the edge file `filename`.
+     *
+     *  \throws std::runtime_error if the file, the population or one of the
+     *    datasets can't be opened.
+     */
+    inline SonataEdgeReader(const std::string& filename, const std::string& population);
+
+    /// \brief The number of edges in the population.
+    inline size_t size() const noexcept;
+
+    /** \brief Write the synapses of the edges `[low, high)` of every range.
+     *
+     *  Each block is read into buffers which are reused; and the synapses
+     *  are then written to `it`, one by one.
+     *
+     *  \throws std::out_of_range if a range lies outside the population.
+     *  \throws std::invalid_argument if `block_size` is zero.
+     */
+    template <class OutputIt>
+    inline void read(const std::vector<std::pair<size_t, size_t>>& ranges,
+                     OutputIt it,
+                     size_t block_size = default_block_size) const;
+
+    /** \brief Insert the synapses of the edges `[low, high)` of every range.
+     *
+     *  The synapses are inserted block by block, i.e. at most `block_size`
+     *  synapses are held in memory besides the ones in `index`.
+     */
+    template <class Index>
+    inline void insert_into(Index& index,
+                            const std::vector<std::pair<size_t, size_t>>& ranges,
+                            size_t block_size = default_block_size) const;
+
+  private:
+    inline void check_range(size_t low, size_t high) const;
+    static inline void check_block_size(size_t block_size);
+
+    template <class T>
+    inline void read_block(hid_t dataset, size_t offset, size_t count, T* buffer) const;
+
+    // The datasets are closed before the file.
+    detail::Hdf5Handle file_;
+    detail::Hdf5Handle source_ids_;
+    detail::Hdf5Handle target_ids_;
+    detail::Hdf5Handle centers_[3];
+    size_t n_edges_ = 0;
+};
+
+#endif
+
+} // namespace brain_indexer
+
+#include "detail/sonata_edges.hpp"
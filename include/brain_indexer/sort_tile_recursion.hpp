@@ -141,6 +141,37 @@ public:
 template <typename Value, typename GetCoordinate>
 void serial_sort_tile_recursion(std::vector<Value> &values, const SerialSTRParams&str_params);
 
+/** \brief Multi-threaded Sort Tile Recursion.
+ *
+ * Computes the same partition as `serial_sort_tile_recursion`, using
+ * `n_threads` threads. The slabs of each level are independent and are
+ * sorted concurrently. At the top levels, where there are fewer slabs than
+ * threads, each slab is sorted by a parallel merge sort.
+ *
+ * Just like the serial version, elements with identical coordinates can end
+ * up in any order.
+ *
+ * \sa `SerialSortTileRecursion`.
+ */
+template <typename Value, typename GetCoordinate>
+void parallel_sort_tile_recursion(std::vector<Value> &values,
+                                  const SerialSTRParams &str_params,
+                                  size_t n_threads);
+
+template<size_t dim, typename Value>
+inline CoordType get_centroid_coordinate(const Value &value);
+
+
+/// \brief STR coordinate accessor which uses the centroid of the element.
+template<typename Value>
+struct GetCenterCoordinate {
+public:
+    template<size_t dim>
+    inline static CoordType apply(const Value &value) {
+        return get_centroid_coordinate<dim>(value);
+    }
+};
+
 inline bool is_power_of_two(int n) { return (n & (n - 1)) == 0; }
 inline int int_log2(int n) { return int(std::round(std::log2(n))); }
 inline int int_pow2(int k) { return 1 << k; }
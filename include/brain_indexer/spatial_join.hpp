@@ -0,0 +1,96 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include <boost/variant.hpp>
+
+#include <brain_indexer/geometries.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief Calls `sink(a, b)` for every pair of elements within `distance`.
+ *
+ *  Here `a` is an element of `index_a` and `b` one of `index_b`. Both
+ *  indexes are traversed together: a pair of nodes is only visited if their
+ *  bounding boxes are within `distance` of each other. Hence, this is much
+ *  faster than one query of `index_b` per element of `index_a`.
+ *
+ *  With `BoundingBoxGeometry` a pair matches if the distance of the bounding
+ *  boxes of the elements is at most `distance`. With `BestEffortGeometry`
+ *  those pairs are tested further, see `within_distance`; e.g. the distance
+ *  of the axes of two segments minus their radii must be at most `distance`.
+ *
+ *  The indexes can be an `IndexTree`, a `PackedIndexTree` or a
+ *  `MultiIndexTree`. The subtrees of a multi-index are loaded one at a time,
+ *  and only if they're within `distance` of the other index.
+ *
+ *  If `n_threads > 1`, pairs of nodes are joined by `n_threads` threads.
+ *  The matches are passed to `sink` in batches; and `sink` is only called
+ *  by one thread at a time. The order of the pairs is unspecified.
+ *
+ *  Note, joining an index with itself also reports `(a, a)` and both
+ *  `(a, b)` and `(b, a)`; use `self_join` instead.
+ */
+template <class GeometryMode = BestEffortGeometry, class IndexA, class IndexB, class Sink>
+inline void spatial_join(const IndexA& index_a,
+                         const IndexB& index_b,
+                         CoordType distance,
+                         Sink&& sink,
+                         size_t n_threads = 1);
+
+/// \brief The ids of all pairs of elements within `distance`, see `spatial_join`.
+template <class GeometryMode = BestEffortGeometry, class IndexA, class IndexB>
+inline std::vector<std::pair<identifier_t, identifier_t>>
+spatial_join_ids(const IndexA& index_a,
+                 const IndexB& index_b,
+                 CoordType distance,
+                 size_t n_threads = 1);
+
+/** \brief Calls `sink(a, b)` for every pair of distinct elements of `index` within `distance`.
+ *
+ *  Every unordered pair is reported once, in either order; and no element
+ *  is paired with itself. Otherwise, this is the same as `spatial_join`.
+ *
+ *  The top-level nodes of the tree, i.e. its tiles, are joined with
+ *  themselves and with the neighbouring tiles by `n_threads` threads. The
+ *  subtrees of a multi-index are loaded one at a time; pairs across two
+ *  subtrees are found from the elements near the boundary of the subtree
+ *  which is loaded first.
+ */
+template <class GeometryMode = BestEffortGeometry, class Index, class Sink>
+inline void self_join(const Index& index,
+                      CoordType distance,
+                      Sink&& sink,
+                      size_t n_threads = 1);
+
+/// \brief The ids of all pairs of distinct elements within `distance`, see `self_join`.
+template <class GeometryMode = BestEffortGeometry, class Index>
+inline std::vector<std::pair<identifier_t, identifier_t>>
+self_join_ids(const Index& index, CoordType distance, size_t n_threads = 1);
+
+/** \brief Is `b` within `distance` of `a`.
+ *
+ *  This is the exact test of `spatial_join`. With `BestEffortGeometry`
+ *  the shape of `a` is inflated by `distance` and tested for intersection
+ *  with `b`.
+ */
+template <class A, class B>
+inline bool within_distance(const A& a, const B& b, CoordType distance, BestEffortGeometry);
+
+template <class... VarA, class B>
+inline bool within_distance(const boost::variant<VarA...>& a,
+                            const B& b,
+                            CoordType distance,
+                            BestEffortGeometry);
+
+template <class A, class B>
+inline bool within_distance(const A& a, const B& b, CoordType distance, BoundingBoxGeometry);
+
+}  // namespace brain_indexer
+
+#include "detail/spatial_join.hpp"
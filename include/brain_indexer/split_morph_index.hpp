@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+
+namespace brain_indexer {
+
+/** \brief A morphology index which stores segments and somas separately.
+ *
+ *  Every element of a `MorphoEntry` index is a `boost::variant<Soma, Segment>`.
+ *  Hence, every element is as big as a `Segment` plus the discriminator, and
+ *  every test must dispatch on the type. Since somas are rare, this index
+ *  keeps two trees instead: one of `Segment` and one of `Soma`. The leaves
+ *  are denser and the hot loops over the segments don't visit variants.
+ *
+ *  It offers the same queries as `IndexTree<MorphoEntry>`; the matches are
+ *  passed to the output iterator as `Segment` or `Soma`. All builtin output
+ *  iterators, e.g. `iter_gid_segm_getter`, accept either.
+ *
+ *  \tparam Tree  The tree of each kind, e.g. `IndexTree` or `PackedIndexTree`.
+ */
+template <template <typename...> class Tree>
+class SplitMorphIndexTree: public IndexTreeMixin<SplitMorphIndexTree<Tree>, MorphoEntry> {
+  public:
+    using value_type = MorphoEntry;
+    using segment_tree_type = Tree<Segment>;
+    using soma_tree_type = Tree<Soma>;
+
+    inline SplitMorphIndexTree() = default;
+
+    /// \brief Builds both trees from the elements `[begin, end)`.
+    template <class ValueIt>
+    inline SplitMorphIndexTree(ValueIt begin, ValueIt end);
+
+    /// \brief Builds a split copy of all elements in `tree`.
+    template <class A>
+    inline explicit SplitMorphIndexTree(const IndexTree<MorphoEntry, A>& tree)
+        : SplitMorphIndexTree(tree.begin(), tree.end()) {}
+
+    inline SplitMorphIndexTree(segment_tree_type segments, soma_tree_type somas)
+        : segments_(std::move(segments)), somas_(std::move(somas)) {}
+
+    /** \brief Query both trees in the same way as `bgi::rtree::query`.
+     *
+     *  For `bgi::nearest` the closest elements of both trees are merged.
+     *  Otherwise, the segments are reported before the somas.
+     *
+     *  \returns The number of elements found.
+     */
+    template <class Predicates, class OutputIt>
+    inline size_t query(const Predicates& predicates, OutputIt it) const;
+
+    /// \brief Checks whether a given shape intersects any object in the tree
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline bool is_intersecting(const ShapeT& shape) const {
+        auto stats_scope = this->query_stats_scope();
+        return segments_.template is_intersecting<GeometryMode>(shape)
+               || somas_.template is_intersecting<GeometryMode>(shape);
+    }
+
+    /**
+     * \brief Finds & return objects which intersect.
+     * \returns Copies of the objects, since the index doesn't store `MorphoEntry`.
+     */
+    template <typename GeometryMode=BoundingBoxGeometry, typename ShapeT>
+    inline std::vector<MorphoEntry> find_intersecting_objs(const ShapeT& shape) const;
+
+    /// \brief Number of segments and somas in the index.
+    inline size_t size() const { return segments_.size() + somas_.size(); }
+
+    inline bool empty() const { return size() == 0; }
+
+    /// \brief The bounding box of all elements in the index.
+    inline Box3D bounds() const;
+
+    inline const segment_tree_type& segments() const { return segments_; }
+    inline const soma_tree_type& somas() const { return somas_; }
+
+  private:
+    segment_tree_type segments_;
+    soma_tree_type somas_;
+};
+
+/// \brief The split index can be queried concurrently if both trees can.
+template <template <typename...> class Tree>
+struct supports_concurrent_queries<SplitMorphIndexTree<Tree>>
+    : std::conjunction<supports_concurrent_queries<Tree<Segment>>,
+                       supports_concurrent_queries<Tree<Soma>>> {};
+
+}  // namespace brain_indexer
+
+#include "detail/split_morph_index.hpp"
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/util.hpp>
+
+#if SI_MPI == 1
+#include <brain_indexer/mpi_wrapper.hpp>
+#endif
+
+
+namespace brain_indexer {
+
+/// \brief How synthetic elements are placed in the domain.
+enum class SyntheticDistribution {
+    /// Uniformly in the domain.
+    uniform,
+    /// Normally distributed around cluster centers, which are uniform.
+    clustered,
+    /// Along random walks which start at uniformly placed somas.
+    morphology
+};
+
+/** \brief Describes a synthetic circuit.
+ *
+ *  The elements are generated in neurons of `segments_per_neuron()`
+ *  elements. Every neuron has its own random engine, seeded from `seed` and
+ *  the gid; hence the generated elements don't depend on how the ids are
+ *  split between MPI ranks.
+ */
+struct SyntheticCircuit {
+    SyntheticDistribution distribution = SyntheticDistribution::uniform;
+
+    /// Somas, cluster centers and uniform elements are placed in `domain`.
+    Box3D domain = Box3D{Point3D{0.0f, 0.0f, 0.0f}, Point3D{1000.0f, 1000.0f, 1000.0f}};
+
+    /// The number of elements per unit volume.
+    double density = 1e-3;
+
+    std::uint64_t seed = 0;
+
+    size_t sections_per_neuron = 50;
+    size_t segments_per_section = 20;
+    CoordType segment_length = 2.0f;
+    CoordType radius = 0.5f;
+
+    /// Only used by `SyntheticDistribution::clustered`.
+    size_t n_clusters = 100;
+    CoordType cluster_radius = 50.0f;
+
+    /// \brief The number of elements, i.e. `density` times the volume of `domain`.
+    inline size_t n_elements() const;
+
+    inline size_t segments_per_neuron() const;
+};
+
+/** \brief Write the segments `[low, high)` of `circuit` to `it`.
+ *
+ *  Segment `i` belongs to the neuron `i / segments_per_neuron()`; the
+ *  section and segment ids are contiguous within a neuron.
+ */
+template <class OutputIt>
+inline void generate_synthetic_segments(const SyntheticCircuit& circuit,
+                                        size_t low,
+                                        size_t high,
+                                        OutputIt it);
+
+/** \brief Write the synapses `[low, high)` of `circuit` to `it`.
+ *
+ *  Synapse `i` has id `i`, is placed on the post-synaptic neuron
+ *  `i / segments_per_neuron()` where segment `i` starts, and its
+ *  pre-synaptic gid is random.
+ */
+template <class OutputIt>
+inline void generate_synthetic_synapses(const SyntheticCircuit& circuit,
+                                        size_t low,
+                                        size_t high,
+                                        OutputIt it);
+
+#if SI_MPI == 1
+/** \brief Insert this rank's share of the elements of `circuit` into `builder`.
+ *
+ *  The elements are split evenly between the ranks of `comm`, and inserted
+ *  in blocks of `block_size`. `Value` is either `MorphoEntry`, for segments,
+ *  or `Synapse`.
+ */
+template <class Value, class Builder>
+inline void insert_synthetic_elements(Builder& builder,
+                                      const SyntheticCircuit& circuit,
+                                      MPI_Comm comm,
+                                      size_t block_size = size_t(1) << 20);
+#endif
+
+} // namespace brain_indexer
+
+#include "detail/synthetic_data.hpp"
@@ -1,8 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <limits>
+#include <memory>
+#include <new>
 #include <string>
 #include <filesystem>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <boost/numeric/conversion/converter.hpp>
 #include <boost/format.hpp>
@@ -72,6 +80,31 @@ struct constant: public identity<T> {
 };
 
 
+/// \brief Virtual array returning the elements of `array` converted to `T`
+/// Useful for fields which can't be read directly, e.g. enums stored as integers.
+template <typename T, typename Array>
+struct converted {
+    inline converted(const Array& array) noexcept
+        : array_(array) {}
+
+    inline T operator[](size_t i) const {
+        return static_cast<T>(array_[i]);
+    }
+
+    inline size_t size() const {
+        return array_.size();
+    }
+
+  private:
+    const Array& array_;
+};
+
+template <typename T, typename Array>
+inline converted<T, Array> make_converted(const Array& array) {
+    return converted<T, Array>(array);
+}
+
+
 /// \Brief Iterator reading SOA and offering AOS interface
 template <typename T, typename... Fields>
 class SoA;
@@ -221,6 +254,316 @@ inline Range balanced_chunks(const Range &range, size_t n_chunks, size_t k_chunk
 inline Range balanced_chunks(size_t n_total, size_t n_chunks, size_t k_chunk);
 
 
+/** \brief Split `[0, weights.size())` into chunks of roughly equal weight.
+ *
+ * Element `i` belongs to the chunk which contains the midpoint of its
+ * weight, i.e. `weights[0] + ... + weights[i-1] + weights[i] / 2`, when the
+ * total weight is split evenly. Hence, the chunks are contiguous, but may
+ * be empty. Without any weight, the chunks are `balanced_chunks`.
+ */
+inline Range balanced_chunks(const std::vector<size_t>& weights,
+                             size_t n_chunks,
+                             size_t k_chunk);
+
+
+/** \brief Calls `f(k)` for every `k` in `[0, n_tasks)` using `n_threads` threads.
+ *
+ * Threads pick the next task from a shared counter, i.e. threads that finish
+ * early steal the remaining work. If any call throws, the first exception is
+ * rethrown on the calling thread after all threads have joined.
+ *
+ * Note, `f` must be safe to call concurrently; and it must not call into
+ * Python.
+ */
+template<class F>
+inline void parallel_for(size_t n_tasks, size_t n_threads, const F& f);
+
+
+/** \brief An allocator which keeps track of the memory it allocated.
+ *
+ *  All copies and rebound copies of an allocator share one counter. Hence,
+ *  the counter of the allocator of a container, e.g. a `bgi::rtree`, is the
+ *  memory used by that container. The counter includes an estimate of the
+ *  overhead of `malloc`, see `allocation_footprint`.
+ *
+ *  A copy of a container gets a new counter; while moving a container moves
+ *  the counter along with it.
+ */
+template <class T>
+class CountingAllocator {
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    inline CountingAllocator()
+        : allocated_bytes_(std::make_shared<std::atomic<size_t>>(0)) {}
+
+    template <class U>
+    inline CountingAllocator(const CountingAllocator<U>& other) noexcept
+        : allocated_bytes_(other.allocated_bytes_) {}
+
+    inline T* allocate(size_t n) {
+        auto p = static_cast<T*>(::operator new(n * sizeof(T)));
+        *allocated_bytes_ += allocation_footprint(n * sizeof(T));
+        return p;
+    }
+
+    inline void deallocate(T* p, size_t n) noexcept {
+        ::operator delete(p);
+        *allocated_bytes_ -= allocation_footprint(n * sizeof(T));
+    }
+
+    inline CountingAllocator select_on_container_copy_construction() const {
+        return CountingAllocator{};
+    }
+
+    /// \brief Bytes currently allocated through this allocator or its copies.
+    inline size_t allocated_bytes() const {
+        return allocated_bytes_->load();
+    }
+
+    /** \brief Bytes used by an allocation of `n_bytes`.
+     *
+     *  This mirrors glibc: every chunk has an 8 byte header, is a multiple of
+     *  16 bytes and at least 32 bytes.
+     */
+    static constexpr size_t allocation_footprint(size_t n_bytes) {
+        return std::max(size_t(32), (n_bytes + sizeof(size_t) + 15) / 16 * 16);
+    }
+
+    template <class U>
+    inline bool operator==(const CountingAllocator<U>& other) const {
+        return allocated_bytes_ == other.allocated_bytes_;
+    }
+
+    template <class U>
+    inline bool operator!=(const CountingAllocator<U>& other) const {
+        return !(*this == other);
+    }
+
+  private:
+    template <class U>
+    friend class CountingAllocator;
+
+    std::shared_ptr<std::atomic<size_t>> allocated_bytes_;
+};
+
+
+/// \brief The backing of the blocks of a `MonotonicArena`.
+enum class HugePages {
+    none,         ///< Regular heap memory.
+    transparent,  ///< Anonymous mappings, advised to use transparent huge pages.
+    explicit_     ///< `MAP_HUGETLB`; falls back to `transparent` if none are reserved.
+};
+
+/** \brief Where the blocks of a `MonotonicArena` are placed in memory.
+ *
+ *  Huge pages reduce TLB misses when querying large trees. Interleaving the
+ *  pages of every block across all NUMA nodes spreads a tree that's loaded
+ *  by a single thread evenly over the memory of all sockets. Both only take
+ *  effect on Linux; elsewhere blocks are always regular heap memory.
+ */
+struct ArenaPlacement {
+    HugePages huge_pages = HugePages::none;
+    bool interleave_numa_nodes = false;
+};
+
+/// \brief The placement of `ArenaAllocator` by default, on the heap.
+struct HeapArenaPlacement {
+    static constexpr ArenaPlacement value = {HugePages::none, false};
+};
+
+/// \brief Blocks on transparent huge pages.
+struct HugePageArenaPlacement {
+    static constexpr ArenaPlacement value = {HugePages::transparent, false};
+};
+
+/// \brief Blocks on transparent huge pages, interleaved across NUMA nodes.
+struct InterleavedArenaPlacement {
+    static constexpr ArenaPlacement value = {HugePages::transparent, true};
+};
+
+
+/** \brief A monotonic buffer from which memory is handed out in order.
+ *
+ *  The memory is carved from blocks of growing size, which are only released
+ *  when the arena is destroyed. Hence, the nodes of a tree built or loaded in
+ *  one go lie next to each other; and releasing them takes one call per
+ *  block, rather than one per node. Memory that's deallocated isn't reused.
+ *  The blocks are placed according to an `ArenaPlacement`.
+ *
+ *  An arena must not be used from several threads concurrently.
+ */
+class MonotonicArena {
+  public:
+    static constexpr size_t default_block_size = size_t(64) << 10;
+    static constexpr size_t max_block_size = size_t(64) << 20;
+    static constexpr size_t huge_page_size = size_t(2) << 20;
+
+    explicit MonotonicArena(size_t initial_block_size = default_block_size,
+                            const ArenaPlacement& placement = ArenaPlacement{})
+        : next_block_size_(std::max(initial_block_size, size_t(1))),
+          placement_(placement) {}
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    inline ~MonotonicArena();
+
+    inline void* allocate(size_t n_bytes, size_t alignment);
+
+    /// \brief The size of all blocks, i.e. the memory held by the arena.
+    inline size_t reserved_bytes() const noexcept {
+        return reserved_bytes_;
+    }
+
+    inline size_t n_blocks() const noexcept {
+        return blocks_.size();
+    }
+
+    inline const ArenaPlacement& placement() const noexcept {
+        return placement_;
+    }
+
+  private:
+    struct Block {
+        char* data;
+        size_t size;
+        bool is_mapped;
+    };
+
+    inline void add_block(size_t min_size);
+
+    std::vector<Block> blocks_;
+    char* current_ = nullptr;
+    size_t n_free_ = 0;
+    size_t next_block_size_;
+    size_t reserved_bytes_ = 0;
+    ArenaPlacement placement_;
+};
+
+
+/** \brief An allocator which takes its memory from a `MonotonicArena`.
+ *
+ *  All copies and rebound copies of an allocator share one arena; it's
+ *  released when the last of them is destroyed. Hence, destroying a
+ *  container, e.g. a `bgi::rtree`, frees all its nodes at once. This suits
+ *  trees which are built or loaded once and not modified much afterwards.
+ *
+ *  As with `CountingAllocator`, a copy of a container gets a new arena,
+ *  while moving a container moves its arena along with it.
+ *
+ *  \tparam Placement  Provides the `ArenaPlacement` of new arenas as `value`,
+ *      e.g. `HugePageArenaPlacement`.
+ */
+template <class T, class Placement = HeapArenaPlacement>
+class ArenaAllocator {
+  public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    inline ArenaAllocator()
+        : arena_(std::make_shared<MonotonicArena>(MonotonicArena::default_block_size,
+                                                  Placement::value)) {}
+
+    template <class U>
+    inline ArenaAllocator(const ArenaAllocator<U, Placement>& other) noexcept
+        : arena_(other.arena_) {}
+
+    inline T* allocate(size_t n) {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    inline void deallocate(T* /* p */, size_t /* n */) noexcept {}
+
+    inline ArenaAllocator select_on_container_copy_construction() const {
+        return ArenaAllocator{};
+    }
+
+    /// \brief Bytes held by the arena, see `MonotonicArena::reserved_bytes`.
+    inline size_t allocated_bytes() const {
+        return arena_->reserved_bytes();
+    }
+
+    inline const MonotonicArena& arena() const noexcept {
+        return *arena_;
+    }
+
+    template <class U>
+    inline bool operator==(const ArenaAllocator<U, Placement>& other) const {
+        return arena_ == other.arena_;
+    }
+
+    template <class U>
+    inline bool operator!=(const ArenaAllocator<U, Placement>& other) const {
+        return !(*this == other);
+    }
+
+  private:
+    template <class U, class P>
+    friend class ArenaAllocator;
+
+    std::shared_ptr<MonotonicArena> arena_;
+};
+
+
+/** \brief Counts how often each key occurs, using a flat hash table.
+ *
+ *  The keys and counts are stored in two arrays with open addressing and
+ *  linear probing. Compared to `std::unordered_map` this avoids allocating a
+ *  node for every key and one pointer chase per increment. Keys can't be
+ *  removed, which is all counting needs.
+ *
+ *  \tparam Key  An unsigned integer type.
+ */
+template <class Key>
+class FlatCounter {
+    static_assert(std::is_unsigned<Key>::value, "The keys must be unsigned integers.");
+
+  public:
+    inline FlatCounter() = default;
+
+    /// \brief Reserve space for `n_keys` distinct keys.
+    inline explicit FlatCounter(size_t n_keys);
+
+    /// \brief Increase the count of `key` by `count`.
+    inline void add(Key key, size_t count = 1);
+
+    /// \brief The count of `key`; zero if it was never added.
+    inline size_t count(Key key) const;
+
+    /// \brief Number of distinct keys.
+    inline size_t size() const { return size_; }
+
+    inline bool empty() const { return size_ == 0; }
+
+    /// \brief Calls `f(key, count)` for every key, in no particular order.
+    template <class F>
+    inline void for_each(F&& f) const;
+
+    /// \brief A copy of the counts as an `std::unordered_map`.
+    inline std::unordered_map<Key, size_t> to_unordered_map() const;
+
+  private:
+    /// Marks empty slots. The key itself is counted in `empty_key_count_`.
+    static constexpr Key empty_key = std::numeric_limits<Key>::max();
+
+    inline size_t slot(Key key) const;
+    inline void grow();
+
+    std::vector<Key> keys_;
+    std::vector<size_t> counts_;
+    size_t size_ = 0;
+    size_t empty_key_count_ = 0;
+};
+
+
 /// Now formatted as 'YYYY-MM-DDTHH:MM:SS'.
 inline std::string iso_datetime_now() {
     // Credit: https://stackoverflow.com/a/9528166
@@ -38,6 +38,23 @@ inline auto as_pyarray(Sequence&& seq) {
 }
 
 
+/**
+ * \brief Like `as_pyarray`, but views the elements as an array of `Scalar`.
+ *  E.g. a sequence of 3D points becomes an Nx3 array of coordinates, by
+ *  passing the shape `{seq.size(), 3}`.
+ */
+template <typename Scalar, typename Sequence>
+inline auto as_pyarray(Sequence&& seq, std::vector<py::ssize_t> shape) {
+    Sequence* seq_ptr = new Sequence(std::move(seq));
+    auto capsule = py::capsule(seq_ptr,
+                               [](void* p) { delete reinterpret_cast<Sequence*>(p); });
+
+    return py::array_t<Scalar>(std::move(shape),
+                               reinterpret_cast<const Scalar*>(seq_ptr->data()),
+                               capsule);
+}
+
+
 /**
  * \brief Converts and STL Sequence to numpy array by copying i
  */
@@ -50,6 +50,15 @@ inline point_t const* extract_points_ptr(array_t const& points) {
     return reinterpret_cast<point_t const*>(points.data());
 }
 
+/// Hands `points` over to numpy as an Nx3 array, without copying them.
+inline py::array_t<coord_t> points_as_pyarray(std::vector<point_t>&& points) {
+    static_assert(sizeof(point_t) == 3 * sizeof(coord_t),
+                  "point3d not convertible to numpy array");
+
+    auto n_points = py::ssize_t(points.size());
+    return pyutil::as_pyarray<coord_t>(std::move(points), {n_points, 3});
+}
+
 inline std::pair<point_t const*, coord_t const*>
 extract_points_radii_ptrs(array_t const& points, array_t const& radii) {
     return std::make_pair(extract_points_ptr(points), extract_radii_ptr(radii));
@@ -101,6 +110,52 @@ inline const auto& mk_point(array_t const& point) {
     return *reinterpret_cast<const point_t*>(point.data());
 }
 
+/// The box with axes given by the rows of the 3x3 array `axes`.
+inline si::OrientedBox mk_oriented_box(array_t const& center,
+                                       array_t const& axes,
+                                       array_t const& half_extents) {
+    if (axes.ndim() != 2 || axes.shape(0) != 3 || axes.shape(1) != 3) {
+        throw std::invalid_argument("Invalid numpy array shape for 'axes', expected 3x3.");
+    }
+
+    auto axes_ptr = extract_points_ptr(axes);
+    return si::OrientedBox{
+        mk_point(center), {axes_ptr[0], axes_ptr[1], axes_ptr[2]}, mk_point(half_extents)
+    };
+}
+
+/// The polytope `normals[i] . x <= offsets[i]` for all `i`.
+inline si::ConvexPolytope mk_polytope(array_t const& normals, array_t const& offsets) {
+    auto normals_ptr = extract_points_ptr(normals);
+    if (offsets.ndim() != 1 || offsets.shape(0) != normals.shape(0)) {
+        throw std::invalid_argument(
+            "Invalid numpy array shape for 'offsets', expected one per normal."
+        );
+    }
+
+    auto offsets_ptr = extract_radii_ptr(offsets);
+    auto half_spaces = std::vector<si::HalfSpace>{};
+    for (py::ssize_t i = 0; i < offsets.shape(0); ++i) {
+        half_spaces.push_back(si::HalfSpace{normals_ptr[i], offsets_ptr[i]});
+    }
+
+    return si::ConvexPolytope(half_spaces);
+}
+
+/// The region of the voxels set in the 3D array `mask`, in C order.
+inline si::VoxelMask mk_voxel_mask(array_t const& origin,
+                                   array_t const& voxel_size,
+                                   pybind_array_t<std::uint8_t> const& mask) {
+    if (mask.ndim() != 3) {
+        throw std::invalid_argument("Invalid numpy array shape for 'mask', expected 3 dims.");
+    }
+
+    auto shape = si::VoxelMask::shape_type{
+        size_t(mask.shape(0)), size_t(mask.shape(1)), size_t(mask.shape(2))
+    };
+    return si::VoxelMask(mk_point(origin), mk_point(voxel_size), shape, mask.data());
+}
+
 inline void mark_deprecated(const std::string& deprecation_message) {
     // Credit: https://stackoverflow.com/a/62559865
     // See: https://docs.python.org/3/c-api/exceptions.html#c.PyErr_WarnEx
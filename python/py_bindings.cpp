@@ -11,6 +11,11 @@ namespace si_python = si::py_bindings;
 namespace brain_indexer { namespace py_bindings {
 
 void check_signals() {
+    // Queries might run with the GIL released, e.g. batched queries.
+    if (PyGILState_Check() == 0) {
+        return;
+    }
+
     if (PyErr_CheckSignals() != 0) {
         throw py::error_already_set();
     }
@@ -28,29 +33,65 @@ PYBIND11_MODULE(_brain_indexer, m) {
     );
 
     m.def("_register_python_logger",
-        [](py::object python_logger) {
-            si::register_logging_callback(
-                [python_logger](si::LogSeverity log_severity, const std::string& message) {
-                    if(log_severity == si::LogSeverity::DEBUG) {
-                        python_logger.attr("debug")(py::str(message));
-                    }
-                    else if (log_severity == si::LogSeverity::INFO) {
-                        python_logger.attr("info")(py::str(message));
-                    }
-                    else if (log_severity == si::LogSeverity::WARN) {
-                        python_logger.attr("warning")(py::str(message));
-                    }
-                    else if (log_severity == si::LogSeverity::ERROR) {
-                        python_logger.attr("error")(py::str(message));
-                    }
-                    else {
-                        python_logger.attr("error")(py::str("Invalid log severity detected for message:"));
-                        python_logger.attr("error")(py::str(message));
-                        throw std::runtime_error("Invalid log severity.");
+        [](py::object new_logger, bool asynchronous) {
+            // The callback may run on any thread, even after the interpreter
+            // has been finalized; then the logger is leaked.
+            auto logger = std::shared_ptr<py::object>(
+                new py::object(std::move(new_logger)),
+                [](py::object* obj) {
+                    if(Py_IsInitialized()) {
+                        py::gil_scoped_acquire gil;
+                        delete obj;
+                    } else {
+                        obj->release();
+                        delete obj;
                     }
                 }
             );
-        }
+
+            auto callback = [logger](si::LogSeverity log_severity, const std::string& message) {
+                if(!Py_IsInitialized()) {
+                    si::log_fallback(log_severity, message);
+                    return;
+                }
+
+                py::gil_scoped_acquire gil;
+                const auto& python_logger = *logger;
+                if(log_severity == si::LogSeverity::DEBUG) {
+                    python_logger.attr("debug")(py::str(message));
+                }
+                else if (log_severity == si::LogSeverity::INFO) {
+                    python_logger.attr("info")(py::str(message));
+                }
+                else if (log_severity == si::LogSeverity::WARN) {
+                    python_logger.attr("warning")(py::str(message));
+                }
+                else if (log_severity == si::LogSeverity::ERROR) {
+                    python_logger.attr("error")(py::str(message));
+                }
+                else {
+                    python_logger.attr("error")(py::str("Invalid log severity detected for message:"));
+                    python_logger.attr("error")(py::str(message));
+                    throw std::runtime_error("Invalid log severity.");
+                }
+            };
+
+            // Replacing an asynchronous callback waits for its thread, which
+            // might need the GIL.
+            py::gil_scoped_release release;
+            if(asynchronous) {
+                si::register_async_logging_callback(std::move(callback));
+            } else {
+                si::register_logging_callback(std::move(callback));
+            }
+        },
+        py::arg("logger"),
+        py::arg("asynchronous") = false
+    );
+
+    m.def("_flush_logs",
+        []() { si::flush_logs(); },
+        py::call_guard<py::gil_scoped_release>()
     );
 
     py::enum_<si::LogSeverity>(m, "_LogSeverity")
@@ -77,6 +118,7 @@ PYBIND11_MODULE(_brain_indexer, m) {
     );
 
     si_python::create_MetaDataConstants_bindings(m);
+    si_python::create_hot_set_bindings(m);
 
     using namespace pybind11::literals;
     m.attr("SectionType") = py::module::import("enum").attr("IntEnum")(
@@ -96,12 +138,26 @@ PYBIND11_MODULE(_brain_indexer, m) {
     si_python::create_Sphere_bindings(m);
     si_python::create_Synapse_bindings(m);
     si_python::create_MorphoEntry_bindings(m);
+    si_python::create_AttributeFilter_bindings(m);
 
     si_python::create_PointIndex_bindings(m, "PointIndex");
     si_python::create_SphereIndex_bindings(m, "SphereIndex");
     si_python::create_SynapseIndex_bindings(m, "SynapseIndex");
     si_python::create_MorphIndex_bindings(m, "MorphIndex");
 
+    // Read-only copies of in-memory indexes with a packed node layout.
+    si_python::create_PackedSphereIndex_bindings(m, "PackedSphereIndex");
+    si_python::create_PackedSynapseIndex_bindings(m, "PackedSynapseIndex");
+    si_python::create_PackedMorphIndex_bindings(m, "PackedMorphIndex");
+
+    // Morphology indexes with separate trees for segments and somas.
+    si_python::create_SplitMorphIndex_bindings<si::SplitMorphIndexTree<si::IndexTree>>(
+        m, "SplitMorphIndex"
+    );
+    si_python::create_SplitMorphIndex_bindings<si::SplitMorphIndexTree<si::PackedIndexTree>>(
+        m, "PackedSplitMorphIndex"
+    );
+
     si_python::create_SynapseIndexBulkBuilder_bindings(m, "SynapseIndexBulkBuilder");
     si_python::create_MorphIndexBulkBuilder_bindings(m, "MorphIndexBulkBuilder");
 
@@ -109,6 +165,14 @@ PYBIND11_MODULE(_brain_indexer, m) {
     si_python::create_MorphMultiIndex_bindings(m, "MorphMultiIndex");
     si_python::create_SynapseMultiIndex_bindings(m, "SynapseMultiIndex");
 
+    // Multi-indexes which can be queried from many threads, e.g. batched queries.
+    si_python::create_MorphMultiIndex_bindings<si::ConcurrentMultiIndexTree<si::MorphoEntry>>(
+        m, "ConcurrentMorphMultiIndex"
+    );
+    si_python::create_SynapseMultiIndex_bindings<si::ConcurrentMultiIndexTree<si::Synapse>>(
+        m, "ConcurrentSynapseMultiIndex"
+    );
+
 #if SI_MPI == 1
     si_python::create_MorphMultiIndexBulkBuilder_bindings(m, "MorphMultiIndexBulkBuilder");
     si_python::create_SynapseMultiIndexBulkBuilder_bindings(m, "SynapseMultiIndexBulkBuilder");
@@ -1,10 +1,21 @@
 #pragma once
 #include "bind_common.hpp"
 #include <iostream>
+#include <optional>
 #include <pybind11/eval.h>
 
+#include <brain_indexer/attribute_filter.hpp>
+#include <brain_indexer/density_grid.hpp>
+#include <brain_indexer/level_of_detail.hpp>
 #include <brain_indexer/logging.hpp>
+#include <brain_indexer/neuron_ingestion.hpp>
+#include <brain_indexer/point_classification.hpp>
+#include <brain_indexer/query_cursor.hpp>
 #include <brain_indexer/query_ordering.hpp>
+#include <brain_indexer/segment_query.hpp>
+#include <brain_indexer/sonata_edges.hpp>
+#include <brain_indexer/spatial_join.hpp>
+#include <brain_indexer/split_morph_index.hpp>
 
 namespace bg = boost::geometry;
 
@@ -35,6 +46,47 @@ inline void create_IndexedPoint_bindings(py::module& m) {
 }
 
 
+inline void create_AttributeFilter_bindings(py::module& m) {
+    using Class = si::AttributeFilter;
+    py::class_<Class>(m, "_AttributeFilter",
+            "Selects elements by section type, gid, pre- and post-synaptic gid.")
+        .def(py::init<>())
+        .def("_section_types",
+            [](Class& obj, const std::vector<unsigned char>& types) {
+                auto section_types = std::vector<SectionType>{};
+                for(auto type : types) {
+                    section_types.push_back(SectionType(type));
+                }
+                obj.section_types(section_types);
+            },
+            py::arg("types"))
+        .def("_gid_range",
+            [](Class& obj, si::identifier_t low, si::identifier_t high) {
+                obj.gid_range(low, high);
+            },
+            py::arg("low"), py::arg("high"))
+        .def("_gids",
+            [](Class& obj, std::vector<si::identifier_t> gids) { obj.gids(std::move(gids)); },
+            py::arg("gids"))
+        .def("_pre_gid_range",
+            [](Class& obj, si::identifier_t low, si::identifier_t high) {
+                obj.pre_gid_range(low, high);
+            },
+            py::arg("low"), py::arg("high"))
+        .def("_pre_gids",
+            [](Class& obj, std::vector<si::identifier_t> gids) { obj.pre_gids(std::move(gids)); },
+            py::arg("gids"))
+        .def("_post_gid_range",
+            [](Class& obj, si::identifier_t low, si::identifier_t high) {
+                obj.post_gid_range(low, high);
+            },
+            py::arg("low"), py::arg("high"))
+        .def("_post_gids",
+            [](Class& obj, std::vector<si::identifier_t> gids) { obj.post_gids(std::move(gids)); },
+            py::arg("gids"));
+}
+
+
 // We provide bindings to spatial indexes of spheres since they are space efficient
 inline void create_Sphere_bindings(py::module& m) {
     using Class = IndexedSphere;
@@ -187,6 +239,58 @@ inline void add_IndexTree_add_points_bindings(py::class_<Class>& c) {
 
 namespace detail {
 
+/** \brief Releases the GIL, if `Class` supports concurrent queries.
+ *
+ *  Other indexes, e.g. `MultiIndexTree` with a `UsageRateCache`, modify
+ *  their cache while querying. For them the GIL is kept, which serializes
+ *  the queries of several Python threads on the same index.
+ */
+template<typename Class>
+inline std::optional<py::gil_scoped_release> release_gil_if_concurrent() {
+    if constexpr (si::supports_concurrent_queries<Class>::value) {
+        return std::optional<py::gil_scoped_release>(std::in_place);
+    } else {
+        return std::nullopt;
+    }
+}
+
+/** \brief Inserts into `index` while holding the GIL.
+ *
+ *  This is for bulk inserts which read or compute the values with the GIL
+ *  released. Modifying the index requires the GIL, since other Python
+ *  threads may query it. Single values are buffered, such that the GIL is
+ *  acquired once per `block_size` values; `flush` inserts the rest.
+ */
+template<typename Index, typename Value>
+class GilHoldingInserter {
+  public:
+    explicit GilHoldingInserter(Index& index, size_t block_size = size_t(1) << 16)
+        : index(index), block_size(block_size) {}
+
+    template<typename It>
+    inline void insert(It begin, It end) {
+        py::gil_scoped_acquire gil;
+        index.insert(begin, end);
+    }
+
+    inline void insert(const Value& value) {
+        buffer.push_back(value);
+        if(buffer.size() >= block_size) {
+            flush();
+        }
+    }
+
+    inline void flush() {
+        insert(buffer.begin(), buffer.end());
+        buffer.clear();
+    }
+
+  private:
+    Index& index;
+    size_t block_size;
+    std::vector<Value> buffer;
+};
+
 template<typename Class, typename Shape>
 inline decltype(auto)
 is_intersecting(Class& obj, const Shape& query_shape, const std::string& geometry) {
@@ -215,20 +319,113 @@ find_intersecting_objs(Class& obj, const Shape& query_shape, const std::string&
     throw std::runtime_error("Invalid geometry: " + geometry + ".");
 }
 
+/// The fields selected by the names in `fields`; all fields if `None`.
+template<typename Class>
+inline si::query_fields_t
+query_fields(const std::optional<std::vector<std::string>>& fields) {
+    if(!fields) {
+        return si::all_query_fields;
+    }
+
+    return si::detail::query_field_mask<typename Class::value_type>(*fields);
+}
+
+template<typename Class, typename Shape>
+inline decltype(auto)
+find_intersecting_np(Class& obj,
+                     const Shape& query_shape,
+                     const std::string& geometry,
+                     si::query_fields_t fields,
+                     const std::optional<si::AttributeFilter>& where = std::nullopt) {
+    if(geometry != "bounding_box" && geometry != "best_effort") {
+        throw std::runtime_error("Invalid geometry: " + geometry + ".");
+    }
+
+    if(where && !where->selects_all()) {
+        if(geometry == "bounding_box") {
+            return obj.template find_intersecting_filtered_np<BoundingBoxGeometry>(
+                query_shape, *where, fields
+            );
+        }
+
+        return obj.template find_intersecting_filtered_np<BestEffortGeometry>(
+            query_shape, *where, fields
+        );
+    }
+
+    if(geometry == "bounding_box") {
+        return obj.template find_intersecting_np<BoundingBoxGeometry>(query_shape, fields);
+    }
+
+    return obj.template find_intersecting_np<BestEffortGeometry>(query_shape, fields);
+}
+
 template<typename Class, typename Shape>
 inline decltype(auto)
-find_intersecting_np(Class& obj, const Shape& query_shape, const std::string& geometry) {
+find_intersecting_batch(Class& obj,
+                        const std::vector<Shape>& query_shapes,
+                        const std::string& geometry,
+                        size_t n_threads,
+                        si::query_fields_t fields) {
+    // The queries themselves don't touch any Python objects.
+    auto release = release_gil_if_concurrent<Class>();
+
     if(geometry == "bounding_box") {
-        return obj.template find_intersecting_np<BoundingBoxGeometry>(query_shape);
+        return obj.template find_intersecting_batch<BoundingBoxGeometry>(
+            query_shapes, n_threads, fields
+        );
     }
 
     if(geometry == "best_effort") {
-        return obj.template find_intersecting_np<BestEffortGeometry>(query_shape);
+        return obj.template find_intersecting_batch<BestEffortGeometry>(
+            query_shapes, n_threads, fields
+        );
     }
 
     throw std::runtime_error("Invalid geometry: " + geometry + ".");
 }
 
+inline std::vector<si::Sphere>
+make_query_spheres(const array_t& centers, const array_t& radii) {
+    if (centers.shape(0) != radii.shape(0)) {
+        throw std::invalid_argument("Please provide exactly one radius per center.");
+    }
+
+    auto [centers_ptr, radii_ptr] = extract_points_radii_ptrs(centers, radii);
+    auto n_queries = static_cast<size_t>(centers.shape(0));
+
+    auto spheres = std::vector<si::Sphere>{};
+    spheres.reserve(n_queries);
+    for(size_t i = 0; i < n_queries; ++i) {
+        spheres.push_back(si::Sphere{centers_ptr[i], radii_ptr[i]});
+    }
+
+    return spheres;
+}
+
+inline std::vector<si::Box3D>
+make_query_boxes(const array_t& boxes) {
+    if (boxes.ndim() != 3 || boxes.shape(1) != 2 || boxes.shape(2) != 3) {
+        auto message = boost::str(
+            boost::format(
+                "Invalid numpy array shape for 'boxes': n_dims = %d, shape[0] = %d"
+            ) % boxes.ndim() % boxes.shape(0)
+        );
+        throw std::invalid_argument(message);
+    }
+
+    auto corners_ptr = reinterpret_cast<point_t const*>(boxes.data());
+    auto n_queries = static_cast<size_t>(boxes.shape(0));
+
+    auto query_boxes = std::vector<si::Box3D>{};
+    query_boxes.reserve(n_queries);
+    for(size_t i = 0; i < n_queries; ++i) {
+        query_boxes.push_back(si::make_query_box(corners_ptr[2*i], corners_ptr[2*i + 1]));
+    }
+
+    return query_boxes;
+}
+
 template<typename Class, typename Shape>
 inline decltype(auto)
 count_intersecting(Class& obj, const Shape& query_shape, const std::string& geometry) {
@@ -243,6 +440,91 @@ count_intersecting(Class& obj, const Shape& query_shape, const std::string& geom
     throw std::runtime_error("Invalid geometry: " + geometry + ".");
 }
 
+template<typename IndexA, typename IndexB>
+inline std::vector<std::pair<identifier_t, identifier_t>>
+spatial_join_ids(const IndexA& index_a,
+                 const IndexB& index_b,
+                 CoordType distance,
+                 const std::string& geometry,
+                 size_t n_threads) {
+    if(geometry == "bounding_box") {
+        return si::spatial_join_ids<BoundingBoxGeometry>(index_a, index_b, distance, n_threads);
+    }
+
+    if(geometry == "best_effort") {
+        return si::spatial_join_ids<BestEffortGeometry>(index_a, index_b, distance, n_threads);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
+template<typename Index>
+inline std::vector<std::pair<identifier_t, identifier_t>>
+self_join_ids(const Index& index,
+              CoordType distance,
+              const std::string& geometry,
+              size_t n_threads) {
+    if(geometry == "bounding_box") {
+        return si::self_join_ids<BoundingBoxGeometry>(index, distance, n_threads);
+    }
+
+    if(geometry == "best_effort") {
+        return si::self_join_ids<BestEffortGeometry>(index, distance, n_threads);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
+template<typename Index>
+inline std::vector<si::SegmentHit<typename Index::value_type>>
+find_along_segment(const Index& index,
+                   const si::Point3D& p1,
+                   const si::Point3D& p2,
+                   CoordType radius,
+                   size_t max_hits,
+                   const std::string& geometry) {
+    if(geometry == "bounding_box") {
+        return si::find_along_segment<BoundingBoxGeometry>(index, p1, p2, radius, max_hits);
+    }
+
+    if(geometry == "best_effort") {
+        return si::find_along_segment<BestEffortGeometry>(index, p1, p2, radius, max_hits);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
+template<typename Index>
+inline si::LevelOfDetail<typename Index::value_type>
+find_level_of_detail(const Index& index,
+                     const si::Box3D& box,
+                     size_t max_results,
+                     const std::string& geometry) {
+    if(geometry == "bounding_box") {
+        return si::find_level_of_detail<BoundingBoxGeometry>(index, box, max_results);
+    }
+
+    if(geometry == "best_effort") {
+        return si::find_level_of_detail<BestEffortGeometry>(index, box, max_results);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
+template<typename Class, typename Shape>
+inline si::QueryCursor<Class>
+make_query_cursor(Class& obj, const Shape& query_shape, const std::string& geometry) {
+    if(geometry == "bounding_box") {
+        return si::make_query_cursor<BoundingBoxGeometry>(obj, query_shape);
+    }
+
+    if(geometry == "best_effort") {
+        return si::make_query_cursor<BestEffortGeometry>(obj, query_shape);
+    }
+
+    throw std::runtime_error("Invalid geometry: " + geometry + ".");
+}
+
 template<typename Class, typename Shape>
 inline decltype(auto)
 count_intersecting_agg_gid(Class& obj, const Shape& query_shape, const std::string& geometry) {
@@ -319,25 +601,39 @@ inline void add_IndexTree_find_intersecting_box_objs_bindings(py::class_<Class>&
 
 template<typename Class>
 inline void add_MorphIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_results_in_dict = [](const auto& results) {
-        auto centroid = py::array_t<CoordType>({results.centroid.size(), 3ul},
-                                                (CoordType*)results.endpoint1.data());
-        auto endpoint1 = py::array_t<CoordType>({results.endpoint1.size(), 3ul},
-                                                (CoordType*)results.endpoint1.data());
-        auto endpoint2 = py::array_t<CoordType>({results.endpoint2.size(), 3ul},
-                                                (CoordType*)results.endpoint2.data());
-
-        return py::dict(
-            "gid"_a=pyutil::to_pyarray(results.gid), 
-            "section_id"_a=pyutil::to_pyarray(results.section_id),
-            "segment_id"_a=pyutil::to_pyarray(results.segment_id),
-            "ids"_a=pyutil::to_pyarray(results.ids),
-            "centroid"_a=centroid,
-            "radius"_a=pyutil::to_pyarray(results.radius),
-            "endpoints"_a=py::make_tuple(endpoint1, endpoint2),
-            "section_type"_a=pyutil::to_pyarray(results.section_type),
-            "is_soma"_a=pyutil::to_pyarray(results.is_soma)
-        );
+    auto wrap_results_in_dict = [](auto results) {
+        using field = typename decltype(results)::field;
+
+        auto dict = py::dict();
+        if(results.has(field::gid)) {
+            dict["gid"] = pyutil::as_pyarray(std::move(results.gid));
+        }
+        if(results.has(field::section_id)) {
+            dict["section_id"] = pyutil::as_pyarray(std::move(results.section_id));
+        }
+        if(results.has(field::segment_id)) {
+            dict["segment_id"] = pyutil::as_pyarray(std::move(results.segment_id));
+        }
+        if(results.has(field::ids)) {
+            dict["ids"] = pyutil::as_pyarray(std::move(results.ids));
+        }
+        if(results.has(field::centroid)) {
+            dict["centroid"] = points_as_pyarray(std::move(results.centroid));
+        }
+        if(results.has(field::radius)) {
+            dict["radius"] = pyutil::as_pyarray(std::move(results.radius));
+        }
+        if(results.has(field::endpoints)) {
+            dict["endpoints"] = py::make_tuple(points_as_pyarray(std::move(results.endpoint1)),
+                                               points_as_pyarray(std::move(results.endpoint2)));
+        }
+        if(results.has(field::section_type)) {
+            dict["section_type"] = pyutil::as_pyarray(std::move(results.section_type));
+        }
+        if(results.has(field::is_soma)) {
+            dict["is_soma"] = pyutil::as_pyarray(std::move(results.is_soma));
+        }
+        return dict;
     };
 
     add_IndexTree_find_intersecting_box_np(c, wrap_results_in_dict);
@@ -375,12 +671,213 @@ inline void add_IndexTree_find_nearest_bindings(py::class_<Class>& c) {
     c
     .def("_find_nearest",
         [](Class& obj, const array_t& point, const int k_neighbors) {
-            const auto& vec = obj.find_nearest(mk_point(point), k_neighbors);
-            return pyutil::to_pyarray(vec);
+            auto vec = obj.find_nearest(mk_point(point), k_neighbors);
+            return pyutil::as_pyarray(std::move(vec));
         }
     );
 }
 
+template<typename Class>
+inline void add_IndexTree_spatial_join_bindings(py::class_<Class>& c) {
+    c
+    .def("_spatial_join_ids",
+        [](const Class& obj, const Class& other, CoordType distance,
+           const std::string& geometry, size_t n_threads) {
+            auto ids = [&]() {
+                auto release = detail::release_gil_if_concurrent<Class>();
+                return detail::spatial_join_ids(obj, other, distance, geometry, n_threads);
+            }();
+
+            auto n_pairs = static_cast<py::ssize_t>(ids.size());
+            return pyutil::as_pyarray<identifier_t>(std::move(ids), {n_pairs, 2});
+        },
+        py::arg("other"),
+        py::arg("distance"),
+        py::arg("geometry"),
+        py::arg("n_threads"),
+        R"(
+        The ids of all pairs of elements of this index and `other` which are
+        within `distance` of each other, as an array of shape `(n, 2)`.
+        )"
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_self_join_bindings(py::class_<Class>& c) {
+    c
+    .def("_self_join_ids",
+        [](const Class& obj, CoordType distance, const std::string& geometry, size_t n_threads) {
+            auto ids = [&]() {
+                auto release = detail::release_gil_if_concurrent<Class>();
+                return detail::self_join_ids(obj, distance, geometry, n_threads);
+            }();
+
+            auto n_pairs = static_cast<py::ssize_t>(ids.size());
+            return pyutil::as_pyarray<identifier_t>(std::move(ids), {n_pairs, 2});
+        },
+        py::arg("distance"),
+        py::arg("geometry"),
+        py::arg("n_threads"),
+        R"(
+        The ids of all pairs of distinct elements of this index which are
+        within `distance` of each other, as an array of shape `(n, 2)`. Every
+        pair is contained once.
+        )"
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_segment_query_bindings(py::class_<Class>& c) {
+    c
+    .def("_find_along_segment",
+        [](const Class& obj, const array_t& p1, const array_t& p2, CoordType radius,
+           const std::optional<size_t>& max_hits, const std::string& geometry) {
+            auto hits = [&]() {
+                auto release = detail::release_gil_if_concurrent<Class>();
+                return detail::find_along_segment(
+                    obj, mk_point(p1), mk_point(p2), radius,
+                    max_hits.value_or(std::numeric_limits<size_t>::max()), geometry
+                );
+            }();
+
+            auto ids = std::vector<identifier_t>();
+            auto t = std::vector<CoordType>();
+            ids.reserve(hits.size());
+            t.reserve(hits.size());
+            for(const auto& hit : hits) {
+                ids.push_back(si::detail::get_id_from(hit.value));
+                t.push_back(hit.t);
+            }
+
+            return py::make_tuple(pyutil::as_pyarray(std::move(ids)),
+                                  pyutil::as_pyarray(std::move(t)));
+        },
+        py::arg("p1"),
+        py::arg("p2"),
+        py::arg("radius"),
+        py::arg("max_hits"),
+        py::arg("geometry"),
+        R"(
+        The ids of the elements hit by the segment from `p1` to `p2`,
+        thickened by `radius`, and the position `t` along the segment at
+        which each is hit; ordered by `t`. At most `max_hits` are returned.
+        )"
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_level_of_detail_bindings(py::class_<Class>& c) {
+    c
+    .def("_find_level_of_detail_box",
+        [](const Class& obj, const array_t& corner, const array_t& opposite_corner,
+           size_t max_results, const std::string& geometry) {
+            auto lod = [&]() {
+                auto release = detail::release_gil_if_concurrent<Class>();
+                return detail::find_level_of_detail(
+                    obj, si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
+                    max_results, geometry
+                );
+            }();
+
+            auto ids = std::vector<identifier_t>();
+            ids.reserve(lod.values.size());
+            for(const auto& value : lod.values) {
+                ids.push_back(si::detail::get_id_from(value));
+            }
+
+            auto min_corners = std::vector<si::Point3D>();
+            auto max_corners = std::vector<si::Point3D>();
+            auto centroids = std::vector<si::Point3D>();
+            auto counts = std::vector<size_t>();
+            for(const auto& node : lod.nodes) {
+                min_corners.push_back(node.bounds.min_corner());
+                max_corners.push_back(node.bounds.max_corner());
+                centroids.push_back(node.centroid);
+                counts.push_back(node.count);
+            }
+
+            auto dict = py::dict();
+            dict["ids"] = pyutil::as_pyarray(std::move(ids));
+            dict["min_corner"] = points_as_pyarray(std::move(min_corners));
+            dict["max_corner"] = points_as_pyarray(std::move(max_corners));
+            dict["centroid"] = points_as_pyarray(std::move(centroids));
+            dict["count"] = pyutil::as_pyarray(std::move(counts));
+            return dict;
+        },
+        py::arg("corner"),
+        py::arg("opposite_corner"),
+        py::arg("max_results"),
+        py::arg("geometry"),
+        R"(
+        At most `max_results` elements or node summaries in the box, as a
+        dict. The elements are `ids`; the summaries are `min_corner`,
+        `max_corner`, `centroid` and `count`.
+        )"
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_density_grid_bindings(py::class_<Class>& c) {
+    c
+    .def("_density_grid",
+        [](const Class& obj, const array_t& corner, const array_t& opposite_corner,
+           const std::array<size_t, 3>& resolution, bool approximate, size_t n_threads) {
+            auto grid = [&]() {
+                auto release = detail::release_gil_if_concurrent<Class>();
+                return si::density_grid(
+                    obj, si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
+                    resolution,
+                    approximate ? si::DensityAccuracy::approximate : si::DensityAccuracy::exact,
+                    n_threads
+                );
+            }();
+
+            auto shape = std::vector<py::ssize_t>{py::ssize_t(resolution[0]),
+                                                  py::ssize_t(resolution[1]),
+                                                  py::ssize_t(resolution[2])};
+
+            auto dict = py::dict();
+            dict["count"] = pyutil::as_pyarray<size_t>(std::move(grid.counts), shape);
+            dict["length"] = pyutil::as_pyarray<double>(std::move(grid.lengths), shape);
+            return dict;
+        },
+        py::arg("corner"),
+        py::arg("opposite_corner"),
+        py::arg("resolution"),
+        py::arg("approximate"),
+        py::arg("n_threads"),
+        R"(
+        The number of elements, `count`, and the sum of their lengths,
+        `length`, in every cell of a grid of `resolution` cells covering
+        the box. Both are arrays of shape `resolution`.
+        )"
+    );
+}
+
+template<typename Class>
+inline void add_IndexTree_classify_points_bindings(py::class_<Class>& c) {
+    c
+    .def("_classify_points",
+        [](const Class& obj, const array_t& points_np, size_t n_threads, size_t block_size) {
+            auto points_ptr = static_cast<Point3Dx const*>(extract_points_ptr(points_np));
+            size_t n_points = points_np.shape(0);
+
+            auto ids = [&]() {
+                auto release = detail::release_gil_if_concurrent<Class>();
+                return si::classify_points(obj, points_ptr, n_points, n_threads, block_size);
+            }();
+            return pyutil::as_pyarray(std::move(ids));
+        },
+        py::arg("points"),
+        py::arg("n_threads"),
+        py::arg("block_size"),
+        R"(
+        The smallest id of the elements containing each point; or the
+        largest integer of its type, if no element contains it.
+        )"
+    );
+}
+
 template<typename Class>
 inline void add_str_for_streamable_bindings(py::class_<Class>& c) {
     c
@@ -397,6 +894,29 @@ inline void add_len_for_size_bindings(py::class_<Class>& c) {
     .def("__len__", [](const Class& obj) { return obj.size(); });
 }
 
+template<typename Class>
+inline void add_IndexTree_query_stats_bindings(py::class_<Class>& c) {
+    c
+    .def("_query_stats",
+        [](const Class& obj) {
+            auto stats = obj.query_stats();
+
+            py::dict d;
+            si::for_each_query_stat(stats, [&d](const char* name, std::uint64_t value) {
+                d[name] = value;
+            });
+            return d;
+        },
+        R"(
+        The statistics of all queries of this index, see `QueryStats`.
+
+        They're only collected if BrainIndexer was built with `SI_QUERY_STATS`,
+        otherwise all counters are zero.
+        )"
+    )
+    .def("_reset_query_stats", &Class::reset_query_stats);
+}
+
 /// Generic IndexTree bindings. It is a common base between full in-memory
 /// and disk-based memory mapped version, basically leaving ctors out
 
@@ -410,6 +930,8 @@ inline void add_IndexTree_query_bindings(py::class_<Class> &c) {
     add_IndexTree_count_intersecting_bindings<Class>(c);
 
     add_IndexTree_find_nearest_bindings<Class>(c);
+
+    add_IndexTree_query_stats_bindings<Class>(c);
 }
 
 template <
@@ -422,6 +944,12 @@ inline py::class_<Class> generic_IndexTree_bindings(py::module& m,
                                                     const char* class_name) {
     py::class_<Class> c = py::class_<Class, HolderT>(m, class_name);
     add_IndexTree_query_bindings(c);
+    add_IndexTree_spatial_join_bindings(c);
+    add_IndexTree_self_join_bindings(c);
+    add_IndexTree_segment_query_bindings(c);
+    add_IndexTree_level_of_detail_bindings(c);
+    add_IndexTree_density_grid_bindings(c);
+    add_IndexTree_classify_points_bindings(c);
 
     add_IndexTree_bounds_bindings(c);
     add_str_for_streamable_bindings<Class>(c);
@@ -559,6 +1087,85 @@ inline void add_SphereIndex_fields_bindings(py::class_<Class>& c) {
     );
 }
 
+/// Binds a cursor class, `Class._QueryCursor`, for streaming query results.
+template<typename Class, typename WrapAsDict>
+inline void add_IndexTree_query_cursor_bindings(
+        py::class_<Class>& c,
+        const WrapAsDict& wrap_as_dict) {
+
+    using cursor_t = si::QueryCursor<Class>;
+    using value_type = typename Class::value_type;
+
+    py::class_<cursor_t>(c, "_QueryCursor")
+    .def("_next_batch_np",
+            [wrap_as_dict](cursor_t& cursor,
+                           size_t batch_size,
+                           const std::optional<std::vector<std::string>>& fields) -> py::object {
+                typename si::iter_entry_getter<value_type>::result_t results;
+                results.fields = detail::query_fields<Class>(fields);
+                auto n_found = cursor.next_batch(
+                    batch_size, si::iter_entry_getter<value_type>(results)
+                );
+
+                if(n_found == 0) {
+                    return py::none();
+                }
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("batch_size"),
+            py::arg("fields") = py::none(),
+            R"(
+        Returns the next at most `batch_size` matches.
+
+        The result has the same fields as `_find_intersecting_np`. Once all
+        matches have been returned, `None` is returned.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_box_cursor",
+            [](Class& obj,
+               const array_t& corner, const array_t& opposite_corner,
+               const std::string& geometry) {
+                return detail::make_query_cursor(
+                    obj,
+                    si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
+                    geometry
+                );
+            },
+            py::arg("corner"),
+            py::arg("opposite_corner"),
+            py::arg("geometry"),
+            py::keep_alive<0, 1>(),
+            R"(
+        A cursor over the elements intersecting the box, see `_QueryCursor`.
+
+        The index must not be modified while the cursor is in use.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_cursor",
+            [](Class& obj,
+               const array_t& center, CoordType radius,
+               const std::string& geometry) {
+                return detail::make_query_cursor(
+                    obj, si::Sphere{mk_point(center), radius}, geometry
+                );
+            },
+            py::arg("center"),
+            py::arg("radius"),
+            py::arg("geometry"),
+            py::keep_alive<0, 1>(),
+            R"(
+        A cursor over the elements intersecting the sphere, see `_QueryCursor`.
+
+        The index must not be modified while the cursor is in use.
+        )"
+        );
+}
+
 template<typename Class, typename WrapAsDict>
 inline void add_IndexTree_find_intersecting_box_np(
         py::class_<Class>& c,
@@ -568,49 +1175,267 @@ inline void add_IndexTree_find_intersecting_box_np(
     .def("_find_intersecting_box_np",
             [wrap_as_dict](Class& obj,
                            const array_t& corner, const array_t& opposite_corner,
-                           const std::string& geometry) {
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields,
+                           const std::optional<si::AttributeFilter>& where) {
 
-                const auto& results = detail::find_intersecting_np(
+                auto results = detail::find_intersecting_np(
                     obj,
                     si::make_query_box(mk_point(corner), mk_point(opposite_corner)),
-                    geometry
+                    geometry,
+                    detail::query_fields<Class>(fields),
+                    where
                 );
-                return wrap_as_dict(results);
+                return wrap_as_dict(std::move(results));
             },
             py::arg("corner"),
             py::arg("opposite_corner"),
-            py::arg("geometry")
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            py::arg("where") = py::none(),
+            R"(
+        Finds the elements intersecting with the box.
+
+        Only the builtin `fields` are computed and returned; all by default.
+
+        If `where`, an `_AttributeFilter`, is given only the matching elements
+        are returned; it's evaluated while traversing the index.
+        )"
         );
 
     c
     .def("_find_intersecting_np",
             [wrap_as_dict](Class& obj,
                            const array_t& center, CoordType radius,
-                           const std::string& geometry) {
-                const auto& results = detail::find_intersecting_np(
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields,
+                           const std::optional<si::AttributeFilter>& where) {
+                auto results = detail::find_intersecting_np(
                     obj,
                     si::Sphere{mk_point(center), radius},
-                    geometry
+                    geometry,
+                    detail::query_fields<Class>(fields),
+                    where
                 );
 
-                return wrap_as_dict(results); 
+                return wrap_as_dict(std::move(results));
             },
             py::arg("center"),
             py::arg("radius"),
-            py::arg("geometry")
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            py::arg("where") = py::none(),
+            R"(
+        Finds the elements intersecting with the sphere.
+
+        Only the builtin `fields` are computed and returned; all by default.
+
+        If `where`, an `_AttributeFilter`, is given only the matching elements
+        are returned; it's evaluated while traversing the index.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_oriented_box_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& center,
+                           const array_t& axes,
+                           const array_t& half_extents,
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields,
+                           const std::optional<si::AttributeFilter>& where) {
+                auto results = detail::find_intersecting_np(
+                    obj,
+                    mk_oriented_box(center, axes, half_extents),
+                    geometry,
+                    detail::query_fields<Class>(fields),
+                    where
+                );
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("center"),
+            py::arg("axes"),
+            py::arg("half_extents"),
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            py::arg("where") = py::none(),
+            R"(
+        Finds the elements intersecting with the oriented box.
+
+        The rows of `axes` are the orthonormal axes of the box. Only the
+        builtin `fields` are computed and returned; all by default.
+
+        If `where`, an `_AttributeFilter`, is given only the matching elements
+        are returned; it's evaluated while traversing the index.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_polytope_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& normals,
+                           const array_t& offsets,
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields,
+                           const std::optional<si::AttributeFilter>& where) {
+                auto results = detail::find_intersecting_np(
+                    obj,
+                    mk_polytope(normals, offsets),
+                    geometry,
+                    detail::query_fields<Class>(fields),
+                    where
+                );
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("normals"),
+            py::arg("offsets"),
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            py::arg("where") = py::none(),
+            R"(
+        Finds the elements intersecting with the convex polytope.
+
+        The polytope is the set of points `x` with `normals[i] . x <= offsets[i]`
+        for all `i`. Only the builtin `fields` are computed and returned; all
+        by default.
+
+        If `where`, an `_AttributeFilter`, is given only the matching elements
+        are returned; it's evaluated while traversing the index.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_voxel_mask_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& origin,
+                           const array_t& voxel_size,
+                           const pybind_array_t<std::uint8_t>& mask,
+                           const std::string& geometry,
+                           const std::optional<std::vector<std::string>>& fields,
+                           const std::optional<si::AttributeFilter>& where) {
+                auto results = detail::find_intersecting_np(
+                    obj,
+                    mk_voxel_mask(origin, voxel_size, mask),
+                    geometry,
+                    detail::query_fields<Class>(fields),
+                    where
+                );
+
+                return wrap_as_dict(std::move(results));
+            },
+            py::arg("origin"),
+            py::arg("voxel_size"),
+            py::arg("mask"),
+            py::arg("geometry"),
+            py::arg("fields") = py::none(),
+            py::arg("where") = py::none(),
+            R"(
+        Finds the elements intersecting with the voxels set in `mask`.
+
+        Voxel `(i, j, k)` starts at `origin + (i, j, k) * voxel_size`. Only the
+        builtin `fields` are computed and returned; all by default.
+
+        If `where`, an `_AttributeFilter`, is given only the matching elements
+        are returned; it's evaluated while traversing the index.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_box_batch_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& boxes,
+                           const std::string& geometry,
+                           size_t n_threads,
+                           const std::optional<std::vector<std::string>>& fields) {
+                auto results = detail::find_intersecting_batch(
+                    obj, detail::make_query_boxes(boxes), geometry, n_threads,
+                    detail::query_fields<Class>(fields)
+                );
+
+                auto dict = wrap_as_dict(std::move(results.values));
+                dict["offsets"] = pyutil::as_pyarray(std::move(results.offsets));
+                return dict;
+            },
+            py::arg("boxes"),
+            py::arg("geometry"),
+            py::arg("n_threads") = 1,
+            py::arg("fields") = py::none(),
+            R"(
+        Finds the elements intersecting with each of the N boxes.
+
+        The results of all queries are returned in CSR format: the matches of
+        the i-th box are the entries `offsets[i]:offsets[i+1]` of each field.
+
+        Args:
+            boxes(np.array): A Nx2x3 array[float32] of the corner and
+                opposite corner of each query box.
+            geometry(str): Either "bounding_box" or "best_effort".
+            n_threads(int): Number of threads used to process the queries;
+                ignored by indexes that cannot be queried concurrently.
+            fields(list): The builtin fields to compute; all by default.
+        )"
+        );
+
+    c
+    .def("_find_intersecting_batch_np",
+            [wrap_as_dict](Class& obj,
+                           const array_t& centers, const array_t& radii,
+                           const std::string& geometry,
+                           size_t n_threads,
+                           const std::optional<std::vector<std::string>>& fields) {
+                auto results = detail::find_intersecting_batch(
+                    obj, detail::make_query_spheres(centers, radii), geometry, n_threads,
+                    detail::query_fields<Class>(fields)
+                );
+
+                auto dict = wrap_as_dict(std::move(results.values));
+                dict["offsets"] = pyutil::as_pyarray(std::move(results.offsets));
+                return dict;
+            },
+            py::arg("centers"),
+            py::arg("radii"),
+            py::arg("geometry"),
+            py::arg("n_threads") = 1,
+            py::arg("fields") = py::none(),
+            R"(
+        Finds the elements intersecting with each of the N spheres.
+
+        The results of all queries are returned in CSR format: the matches of
+        the i-th sphere are the entries `offsets[i]:offsets[i+1]` of each field.
+
+        Args:
+            centers(np.array): A Nx3 array[float32] of the sphere centers.
+            radii(np.array): An array[float32] with the radii.
+            geometry(str): Either "bounding_box" or "best_effort".
+            n_threads(int): Number of threads used to process the queries;
+                ignored by indexes that cannot be queried concurrently.
+            fields(list): The builtin fields to compute; all by default.
+        )"
         );
-    
+
+    if constexpr (si::supports_query_cursor<Class>::value) {
+        add_IndexTree_query_cursor_bindings(c, wrap_as_dict);
+    }
 }
 
 template<typename Class>
 inline void add_SphereIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
-        return py::dict(
-            "id"_a=pyutil::to_pyarray(results.id),
-            "centroid"_a=py::array_t<CoordType>({results.centroid.size(), 3ul},
-                                                (CoordType*)results.centroid.data()),
-            "radius"_a=pyutil::to_pyarray(results.radius)
-        );
+    auto wrap_as_dict = [](auto results) {
+        using field = typename decltype(results)::field;
+
+        auto dict = py::dict();
+        if(results.has(field::id)) {
+            dict["id"] = pyutil::as_pyarray(std::move(results.id));
+        }
+        if(results.has(field::centroid)) {
+            dict["centroid"] = points_as_pyarray(std::move(results.centroid));
+        }
+        if(results.has(field::radius)) {
+            dict["radius"] = pyutil::as_pyarray(std::move(results.radius));
+        }
+        return dict;
     };
 
     add_IndexTree_find_intersecting_box_np(c, wrap_as_dict);
@@ -681,11 +1506,17 @@ inline void add_PointIndex_fields_bindings(py::class_<Class>& c) {
 
 template <typename Class>
 inline void add_PointIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
-        return py::dict("id"_a = pyutil::to_pyarray(results.id),
-                        "position"_a =
-                            py::array_t<CoordType>({results.position.size(), 3ul},
-                                                   (CoordType*) results.position.data()));
+    auto wrap_as_dict = [](auto results) {
+        using field = typename decltype(results)::field;
+
+        auto dict = py::dict();
+        if(results.has(field::id)) {
+            dict["id"] = pyutil::as_pyarray(std::move(results.id));
+        }
+        if(results.has(field::position)) {
+            dict["position"] = points_as_pyarray(std::move(results.position));
+        }
+        return dict;
     };
 
     add_IndexTree_find_intersecting_box_np(c, wrap_as_dict);
@@ -763,14 +1594,23 @@ inline void create_Synapse_bindings(py::module& m) {
 
 template<typename Class>
 inline void add_SynapseIndex_find_intersecting_box_np(py::class_<Class>& c) {
-    auto wrap_as_dict = [](const auto& results) {
-        return py::dict(
-            "id"_a=pyutil::to_pyarray(results.id),
-            "pre_gid"_a=pyutil::to_pyarray(results.pre_gid),
-            "post_gid"_a=pyutil::to_pyarray(results.post_gid),
-            "position"_a=py::array_t<CoordType>({results.position.size(), 3ul},
-                                                (CoordType*)results.position.data())
-        );
+    auto wrap_as_dict = [](auto results) {
+        using field = typename decltype(results)::field;
+
+        auto dict = py::dict();
+        if(results.has(field::id)) {
+            dict["id"] = pyutil::as_pyarray(std::move(results.id));
+        }
+        if(results.has(field::pre_gid)) {
+            dict["pre_gid"] = pyutil::as_pyarray(std::move(results.pre_gid));
+        }
+        if(results.has(field::post_gid)) {
+            dict["post_gid"] = pyutil::as_pyarray(std::move(results.post_gid));
+        }
+        if(results.has(field::position)) {
+            dict["position"] = points_as_pyarray(std::move(results.position));
+        }
+        return dict;
     };
 
     add_IndexTree_find_intersecting_box_np(c, wrap_as_dict);
@@ -811,6 +1651,36 @@ inline void add_SynapseIndex_add_synapses_bindings(py::class_<Class>& c) {
         These indices maintain the gids as well to enable computing aggregated counts.
         )"
     );
+
+#if SI_HDF5 == 1
+    c
+    .def("_add_synapses_from_sonata",
+        [](Class& obj,
+           const std::string& filename,
+           const std::string& population,
+           const std::vector<std::pair<size_t, size_t>>& ranges,
+           size_t block_size) {
+            // The file is read with the GIL released; but the index is only
+            // modified while holding it.
+            py::gil_scoped_release release;
+
+            auto inserter = detail::GilHoldingInserter<Class, Synapse>(obj);
+            auto reader = si::SonataEdgeReader(filename, population);
+            reader.insert_into(inserter, ranges, block_size);
+        },
+        py::arg("filename"),
+        py::arg("population"),
+        py::arg("ranges"),
+        py::arg("block_size") = si::SonataEdgeReader::default_block_size,
+        R"(
+        Adds the synapses of the edges `[low, high)` of every range.
+
+        The edges are read natively from the SONATA edge file, in blocks of
+        `block_size` edges, and inserted without intermediate numpy arrays.
+        The id of a synapse is its edge id.
+        )"
+    );
+#endif
 }
 
 
@@ -849,12 +1719,52 @@ inline void add_SynapseIndex_count_intersecting_agg_gid_bindings(py::class_<Clas
 }
 
 
+template <typename Class>
+inline void add_SynapseIndex_numpy_ctor(py::class_<Class>& c) {
+    c.def(py::init([](const array_ids& syn_ids,
+                      const array_ids& post_gids,
+                      const array_ids& pre_gids,
+                      const array_t& points) {
+              auto n_synapses = syn_ids.shape(0);
+              if (post_gids.shape(0) != n_synapses || pre_gids.shape(0) != n_synapses
+                  || points.shape(0) != n_synapses) {
+                  throw std::invalid_argument("Please provide exactly one id, post_gid, "
+                                              "pre_gid and position per synapse.");
+              }
+
+              const auto syn_ids_ = syn_ids.template unchecked<1>();
+              const auto post_gids_ = post_gids.template unchecked<1>();
+              const auto pre_gids_ = pre_gids.template unchecked<1>();
+              auto const* const points_ptr_ = extract_points_ptr(points);
+              auto soa = si::util::make_soa_reader<Synapse>(syn_ids_, post_gids_, pre_gids_, points_ptr_);
+              return std::make_unique<Class>(soa.begin(), soa.end());
+          }),
+          py::arg("ids"),
+          py::arg("post_gids"),
+          py::arg("pre_gids"),
+          py::arg("positions"),
+          R"(
+        Creates a SynapseIndex prefilled with the synapses.
+
+        The index is packed directly from the arrays, i.e. no intermediate
+        copy of the synapses is made.
+
+        Args:
+            ids(np.array): An array[int64] with the ids of the synapses
+            post_gids(np.array): An array[int64] with the post-synaptic gids
+            pre_gids(np.array): An array[int64] with the pre-synaptic gids
+            positions(np.array): A Nx3 array[float32] of the positions
+        )");
+}
+
+
 template <typename Class = si::IndexTree<si::Synapse>>
 inline void create_SynapseIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
     auto c = create_IndexTree_bindings<value_type, value_type, Class>(m, class_name);
     add_IndexTree_insert_themed_bindings<value_type, value_type, Class>(c);
     add_IndexTree_deprecated_ctors<value_type>(c);
+    add_SynapseIndex_numpy_ctor(c);
 
     add_SynapseIndex_count_intersecting_agg_gid_bindings(c);
     add_SynapseIndex_find_intersecting_box_np(c);
@@ -1193,6 +2103,125 @@ inline void add_MorphIndex_add_neuron_bindings(py::class_<Class>& c) {
 }
 
 
+template <typename Class>
+inline void add_MorphIndex_add_neurons_bindings(py::class_<Class>& c) {
+    c
+    .def("_add_neurons",
+        [](Class& obj, const array_ids& gids_np, const array_ids& morphology_ids_np,
+                       const array_t& positions_np, const array_t& rotations_np,
+                       const std::vector<py::tuple>& morphologies_np) {
+
+            const auto n_neurons = gids_np.size();
+            if (morphology_ids_np.size() != n_neurons || positions_np.shape(0) != n_neurons
+                || rotations_np.shape(0) != n_neurons) {
+                throw py::value_error("Please provide exactly one value per neuron.");
+            }
+
+            if (rotations_np.ndim() != 2 || rotations_np.shape(1) != 4) {
+                throw py::value_error("The rotations must be a Nx4 array of quaternions.");
+            }
+
+            // The converted arrays must stay alive until all neurons are inserted.
+            std::vector<array_t> points_np, radii_np;
+            std::vector<array_offsets> offsets_np;
+            std::vector<array_types> types_np;
+
+            std::vector<si::MorphologyView> morphologies;
+            morphologies.reserve(morphologies_np.size());
+
+            for (const auto& morph_np : morphologies_np) {
+                if (morph_np.size() != 6) {
+                    throw py::value_error(
+                        "A morphology is a tuple (soma_center, soma_radius, points,"
+                        " radii, section_offsets, section_types)."
+                    );
+                }
+
+                const auto soma_center = mk_point(morph_np[0].cast<array_t>());
+                const auto soma_radius = morph_np[1].cast<coord_t>();
+                const auto& points = points_np.emplace_back(morph_np[2].cast<array_t>());
+                const auto& radii = radii_np.emplace_back(morph_np[3].cast<array_t>());
+                const auto& offsets = offsets_np.emplace_back(morph_np[4].cast<array_offsets>());
+                const auto& types = types_np.emplace_back(morph_np[5].cast<array_types>());
+
+                auto [points_ptr, radii_ptr] = extract_points_radii_ptrs(points, radii);
+                const auto n_points = util::safe_integer_cast<size_t>(points.shape(0));
+                const auto n_sections = util::safe_integer_cast<size_t>(offsets.size());
+
+                if (util::safe_integer_cast<size_t>(radii.size()) != n_points) {
+                    throw py::value_error("Please provide exactly one radius for each point.");
+                }
+
+                if (util::safe_integer_cast<size_t>(types.size()) < n_sections) {
+                    throw py::value_error("Please provide one section type per section.");
+                }
+
+                auto offsets_ptr = extract_offsets_ptr(offsets);
+                for (size_t i = 0; i < n_sections; ++i) {
+                    const auto next = i + 1 < n_sections ? size_t(offsets_ptr[i + 1]) : n_points;
+                    if (size_t(offsets_ptr[i]) >= next) {
+                        throw py::value_error("The 'section_offsets' must be increasing.");
+                    }
+                }
+
+                morphologies.push_back(si::MorphologyView{
+                    soma_center, soma_radius,
+                    points_ptr, radii_ptr, n_points,
+                    offsets_ptr, extract_section_types_ptr(types), n_sections
+                });
+            }
+
+            const auto gids = gids_np.template unchecked<1>();
+            const auto morphology_ids = morphology_ids_np.template unchecked<1>();
+            const auto* positions = extract_points_ptr(positions_np);
+            const auto rotations = rotations_np.template unchecked<2>();
+
+            std::vector<si::NeuronPlacement> placements;
+            placements.reserve(util::safe_integer_cast<size_t>(n_neurons));
+            for (py::ssize_t i = 0; i < n_neurons; ++i) {
+                placements.push_back(si::NeuronPlacement{
+                    gids(i),
+                    util::safe_integer_cast<size_t>(morphology_ids(i)),
+                    positions[i],
+                    {rotations(i, 0), rotations(i, 1), rotations(i, 2), rotations(i, 3)}
+                });
+            }
+
+            // The neurons are transformed with the GIL released; but the index
+            // is only modified while holding it.
+            py::gil_scoped_release release;
+            auto inserter = detail::GilHoldingInserter<Class, MorphoEntry>(obj);
+            si::ingest_neurons(morphologies, placements,
+                               boost::make_function_output_iterator([&inserter](const auto& value) {
+                                   inserter.insert(MorphoEntry(value));
+                               }));
+            inserter.flush();
+        },
+        py::arg("gids"), py::arg("morphology_ids"), py::arg("positions"),
+        py::arg("rotations"), py::arg("morphologies"),
+        R"(
+        Bulk add many placed neurons, soma and segments, to the spatial index.
+
+        The neurons are rotated and shifted natively, neuron by neuron, without
+        creating intermediate arrays in Python. Every distinct morphology is
+        passed only once, and referred to by its position in `morphologies`.
+
+        Args:
+            gids(np.array): An array[int64] with the gids of the neurons
+            morphology_ids(np.array): An array[int64] with the position in
+                `morphologies` of the morphology of each neuron
+            positions(np.array): A Nx3 array[float32] of the soma positions
+            rotations(np.array): A Nx4 array[float32] of the quaternions
+                (w, x, y, z) by which the neurons are rotated
+            morphologies(list): A list of tuples ``(soma_center, soma_radius,
+                points, radii, section_offsets, section_types)``, where
+                ``section_offsets`` is the offset of the first point of each
+                section, see `_add_neuron`.
+        )"
+    );
+}
+
+
 template <typename Class>
 inline void add_MorphIndex_fields_bindings(py::class_<Class>& c) {
     c.def_property_readonly_static(
@@ -1221,10 +2250,67 @@ inline void add_MorphIndex_common_insert_bindings(py::class_<Class>& c) {
 
     add_MorphIndex_add_branch_bindings<Class>(c);
     add_MorphIndex_add_neuron_bindings<Class>(c);
+    add_MorphIndex_add_neurons_bindings<Class>(c);
     add_MorphIndex_add_soma_bindings<Class>(c);
 }
 
 
+template <typename Class>
+inline void add_MorphIndex_segments_ctor(py::class_<Class>& c) {
+    c.def(py::init([](const array_ids& gids,
+                      const array_offsets& section_ids,
+                      const array_offsets& segment_ids,
+                      const array_t& endpoints1,
+                      const array_t& endpoints2,
+                      const array_t& radii,
+                      const array_types& section_types) {
+              auto n_segments = gids.shape(0);
+              for (auto n : {section_ids.shape(0), segment_ids.shape(0), endpoints1.shape(0),
+                             endpoints2.shape(0), radii.shape(0), section_types.shape(0)}) {
+                  if (n != n_segments) {
+                      throw std::invalid_argument("Please provide exactly one value per segment.");
+                  }
+              }
+
+              const auto gids_ = gids.template unchecked<1>();
+              const auto section_ids_ = section_ids.template unchecked<1>();
+              const auto segment_ids_ = segment_ids.template unchecked<1>();
+              const auto section_types_ = section_types.template unchecked<1>();
+              const auto types_ = si::util::make_converted<SectionType>(section_types_);
+              auto const* const endpoints1_ptr = extract_points_ptr(endpoints1);
+              auto const* const endpoints2_ptr = extract_points_ptr(endpoints2);
+              auto const* const radii_ptr = extract_radii_ptr(radii);
+
+              auto soa = si::util::make_soa_reader<si::Segment>(gids_, section_ids_, segment_ids_,
+                                                                endpoints1_ptr, endpoints2_ptr,
+                                                                radii_ptr, types_);
+              return std::make_unique<Class>(soa.begin(), soa.end());
+          }),
+          py::arg("gids"),
+          py::arg("section_ids"),
+          py::arg("segment_ids"),
+          py::arg("endpoints1"),
+          py::arg("endpoints2"),
+          py::arg("radii"),
+          py::arg("section_types"),
+          R"(
+        Creates a MorphIndex prefilled with segments.
+
+        The index is packed directly from the arrays, i.e. no intermediate
+        copy of the segments is made.
+
+        Args:
+            gids(np.array): An array[int64] with the gids of the neurons
+            section_ids(np.array): An array[uint32] with the section ids
+            segment_ids(np.array): An array[uint32] with the segment ids
+            endpoints1(np.array): A Nx3 array[float32] of the first endpoints
+            endpoints2(np.array): A Nx3 array[float32] of the second endpoints
+            radii(np.array): An array[float32] with the radii of the segments
+            section_types(np.array): An array[uint32] with the section types
+        )");
+}
+
+
 /// Bindings to index si::IndexTree<MorphoEntry>
 template <typename Class = si::IndexTree<MorphoEntry>>
 inline void create_MorphIndex_bindings(py::module& m, const char* class_name) {
@@ -1232,6 +2318,7 @@ inline void create_MorphIndex_bindings(py::module& m, const char* class_name) {
     add_IndexTree_insert_themed_bindings<MorphoEntry, si::Soma, Class>(c);
 
     add_IndexTree_deprecated_ctors<si::Soma>(c);
+    add_MorphIndex_segments_ctor<Class>(c);
 
     add_MorphIndex_find_intersecting_box_np<Class>(c);
     add_MorphIndex_fields_bindings<Class>(c);
@@ -1240,6 +2327,139 @@ inline void create_MorphIndex_bindings(py::module& m, const char* class_name) {
 }
 
 
+///
+/// 2b - Packed, read-only indexes
+///
+
+template <typename Value, typename Class = si::PackedIndexTree<Value>>
+inline py::class_<Class> create_PackedIndex_bindings(py::module& m, const char* class_name) {
+    py::class_<Class> c = py::class_<Class>(m, class_name);
+
+    c
+    .def(py::init([](const si::IndexTree<Value>& index, bool compact, size_t n_threads) {
+            auto format = compact ? si::PackedLeafFormat::compact : si::PackedLeafFormat::full;
+            return std::make_unique<Class>(index, format, n_threads);
+         }),
+         py::arg("index"),
+         py::arg("compact") = false,
+         py::arg("n_threads") = 1,
+         R"(
+        Create a read-only copy of the in-memory index `index`.
+
+        The copy stores its nodes contiguously, which makes queries faster. It
+        can't be modified, but can be queried by many threads at once.
+
+        Args:
+            index:  The core index to be copied, e.g. `SphereIndex`.
+            compact:  Store the boxes in the leaves with 16-bit precision,
+                which almost halves the size of the tree. The results of
+                all queries are unchanged.
+            n_threads:  Number of threads used to build the tree.
+        )"
+    )
+
+    .def(py::init<const std::string&, size_t>(),
+         py::arg("filename"),
+         py::arg("n_eager_levels") = 3,
+         R"(
+        Open a packed index from a file written by `_dump`.
+
+        The file is memory mapped instead of deserialized. Only the top
+        `n_eager_levels` levels of the tree are read when opening; the
+        remaining nodes are read when a query first needs them.
+
+        Args:
+            filename(str): The file path to read the packed index from.
+            n_eager_levels(int): Number of levels read eagerly.
+        )"
+    )
+
+    .def("_dump",
+        [](const Class& obj, const std::string& filename) { obj.dump(filename); },
+        R"(
+        Save the packed index to a file on disk, such that it can be memory mapped.
+
+        Args:
+            filename(str): The file path to write the packed index to.
+        )"
+    );
+
+    add_IndexTree_query_bindings(c);
+    add_IndexTree_self_join_bindings(c);
+    add_IndexTree_segment_query_bindings(c);
+    add_IndexTree_level_of_detail_bindings(c);
+    add_IndexTree_density_grid_bindings(c);
+    add_IndexTree_classify_points_bindings(c);
+
+    add_IndexTree_bounds_bindings(c);
+    add_len_for_size_bindings(c);
+
+    return c;
+}
+
+inline void create_PackedSphereIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_PackedIndex_bindings<si::IndexedSphere>(m, class_name);
+
+    add_SphereIndex_find_intersecting_box_np(c);
+    add_SphereIndex_fields_bindings(c);
+}
+
+inline void create_PackedSynapseIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_PackedIndex_bindings<si::Synapse>(m, class_name);
+
+    c.def("_build_gid_summaries",
+        [](si::PackedIndexTree<si::Synapse>& obj) { obj.build_gid_summaries(); },
+        R"(
+        Summarize the post-synaptic gids below every node of the index.
+
+        Afterwards, counting per gid with geometry "bounding_box" no longer
+        visits the synapses of nodes which lie inside the query. The
+        summaries aren't saved by `_dump`.
+        )"
+    );
+
+    add_SynapseIndex_count_intersecting_agg_gid_bindings(c);
+    add_SynapseIndex_find_intersecting_box_np(c);
+    add_SynapseIndex_fields_bindings(c);
+}
+
+inline void create_PackedMorphIndex_bindings(py::module& m, const char* class_name) {
+    auto c = create_PackedIndex_bindings<si::MorphoEntry>(m, class_name);
+
+    add_MorphIndex_find_intersecting_box_np(c);
+    add_MorphIndex_fields_bindings(c);
+}
+
+/// Morphology indexes which store the segments and somas in separate trees.
+template <typename Class>
+inline void create_SplitMorphIndex_bindings(py::module& m, const char* class_name) {
+    py::class_<Class> c = py::class_<Class>(m, class_name);
+
+    c
+    .def(py::init<const si::IndexTree<si::MorphoEntry>&>(),
+         py::arg("index"),
+         R"(
+        Create a read-only copy of the morphology index `index`.
+
+        The segments and somas are stored in two separate trees. Hence, the
+        elements don't need to be stored as variants, which makes the index
+        smaller and the queries faster.
+
+        Args:
+            index:  The core index to be copied, i.e. a `MorphIndex`.
+        )"
+    );
+
+    add_IndexTree_query_bindings(c);
+
+    add_IndexTree_bounds_bindings(c);
+    add_len_for_size_bindings(c);
+
+    add_MorphIndex_find_intersecting_box_np(c);
+    add_MorphIndex_fields_bindings(c);
+}
+
+
 template<typename Class>
 inline void add_IndexBulkBuilder_reserve_bindings(py::class_<Class>& c) {
     c
@@ -1345,6 +2565,30 @@ inline void add_MultiIndexBulkBuilder_creation_bindings(py::class_<Class>& c) {
         )"
     )
 
+    .def(py::init<std::string, std::string, size_t>(),
+         py::arg("output_dir"),
+         py::arg("scratch_dir"),
+         py::arg("max_elements_in_memory"),
+         R"(
+        Create a `MultiIndexBulkBuilder` in streaming mode.
+
+        Once a rank holds `max_elements_in_memory` elements, they're written to
+        `scratch_dir` in a sorted run. When `_finalize` is called, the runs are
+        partitioned and written to the subtrees out of core. This allows
+        building indexes which don't fit into the memory of all MPI ranks.
+
+        Args:
+            output_dir(string):  The directory where the all files that make up
+                the multi index are stored.
+
+            scratch_dir(string):  A directory for temporary files, preferably
+                on a fast local file system. All ranks may use the same one.
+
+            max_elements_in_memory(int):  The number of elements a rank keeps
+                in memory, while inserting and while building the index.
+        )"
+    )
+
     .def("_finalize",
          [](Class &obj) {
             auto comm_size = mpi::size(MPI_COMM_WORLD);
@@ -1410,9 +2654,16 @@ inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* c
     py::class_<Class> c = py::class_<Class>(m, class_name);
 
     c
-    .def(py::init<std::string, std::size_t>(),
+    .def(py::init([](const std::string& output_dir,
+                     std::size_t max_cached_bytes,
+                     const std::string& eviction_policy) {
+             return std::make_unique<Class>(
+                 output_dir, max_cached_bytes, si::eviction_policy_from_string(eviction_policy)
+             );
+         }),
          py::arg("output_dir"),
          py::arg("max_cached_bytes"),
+         py::arg("eviction_policy") = "usage_rate",
          R"(
         Create a `MultiIndexBulkBuilder` that writes output to `output_dir`.
 
@@ -1425,12 +2676,91 @@ inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* c
             output_dir(string):  The directory where the all files that make up
                 the multi index are stored.
 
-            max_cached_bytes(int):  The total size of the index should, up to a
-                log factor, not use more than `max_cached_bytes` bytes of memory.
+            max_cached_bytes(int):  The cached subtrees should not use more than
+                `max_cached_bytes` bytes of memory, see `cached_bytes`.
+
+            eviction_policy(str):  Which subtrees to evict when the cache is
+                full. One of "usage_rate", "lru", "clock" or "cost_aware".
+                Concurrent multi indexes only support "usage_rate".
+        )"
+    );
+
+    c
+    .def_property("prefetch_depth",
+        &Class::prefetch_depth,
+        &Class::set_prefetch_depth,
+        R"(
+        Number of subtrees read from disk in the background, ahead of the
+        subtree being queried. A depth of `0` disables prefetching.
+        )"
+    );
+
+    c
+    .def_property_readonly("cached_bytes",
+        &Class::cached_bytes,
+        R"(
+        Memory in bytes used by the subtrees which are currently cached. This
+        includes the nodes of the subtrees, not only the indexed elements.
+        )"
+    );
+
+    c
+    .def("_warm_up",
+        [](const Class& obj, const std::vector<size_t>& subtree_ids, size_t n_threads) {
+            // Warming up inserts into the cache; which only concurrent caches
+            // allow while other Python threads query the index.
+            auto release = detail::release_gil_if_concurrent<Class>();
+            return obj.warm_up(subtree_ids, n_threads);
+        },
+        py::arg("subtree_ids"),
+        py::arg("n_threads"),
+        R"(
+        Load the subtrees `subtree_ids` into the cache, in that order, until
+        it's full. Returns the number of subtrees loaded.
+        )"
+    )
+    .def("_hot_set",
+        &Class::hot_set,
+        R"(
+        The ids of the cached subtrees, the most valuable first.
+        )"
+    )
+    .def("_subtrees_intersecting",
+        [](const Class& obj, const array_t& min_corners, const array_t& max_corners) {
+            auto min_ptr = extract_points_ptr(min_corners);
+            auto max_ptr = extract_points_ptr(max_corners);
+            auto n_regions = size_t(min_corners.shape(0));
+            if(size_t(max_corners.shape(0)) != n_regions) {
+                throw std::invalid_argument("Every region needs two corners.");
+            }
+
+            auto regions = std::vector<si::Box3D>{};
+            for(size_t i = 0; i < n_regions; ++i) {
+                regions.push_back(si::make_query_box(min_ptr[i], max_ptr[i]));
+            }
+            return obj.subtrees_intersecting(regions);
+        },
+        py::arg("min_corners"),
+        py::arg("max_corners"),
+        R"(
+        The ids of the subtrees intersecting any of the boxes, without
+        duplicates.
+        )"
+    )
+    .def("_save_hot_set_at_exit",
+        &Class::save_hot_set_at_exit,
+        py::arg("filename"),
+        R"(
+        Write the hot set to `filename` when the index is destroyed.
         )"
     );
 
     add_IndexTree_query_bindings(c);
+    add_IndexTree_self_join_bindings(c);
+    add_IndexTree_segment_query_bindings(c);
+    add_IndexTree_level_of_detail_bindings(c);
+    add_IndexTree_density_grid_bindings(c);
+    add_IndexTree_classify_points_bindings(c);
 
     add_IndexTree_bounds_bindings(c);
     add_len_for_size_bindings(c);
@@ -1442,7 +2772,7 @@ inline py::class_<Class> create_MultiIndex_bindings(py::module& m, const char* c
 template <typename Class = si::MultiIndexTree<MorphoEntry>>
 inline py::class_<Class> create_MorphMultiIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
-    auto c = create_MultiIndex_bindings<value_type>(m, class_name);
+    auto c = create_MultiIndex_bindings<value_type, Class>(m, class_name);
 
     add_MorphIndex_find_intersecting_box_np(c);
     add_MorphIndex_fields_bindings(c);
@@ -1454,7 +2784,7 @@ inline py::class_<Class> create_MorphMultiIndex_bindings(py::module& m, const ch
 template <typename Class = si::MultiIndexTree<Synapse>>
 inline py::class_<Class> create_SynapseMultiIndex_bindings(py::module& m, const char* class_name) {
     using value_type = typename Class::value_type;
-    auto c = create_MultiIndex_bindings<value_type>(m, class_name);
+    auto c = create_MultiIndex_bindings<value_type, Class>(m, class_name);
 
     add_SynapseIndex_find_intersecting_box_np(c);
     add_SynapseIndex_fields_bindings(c);
@@ -1493,6 +2823,17 @@ inline void create_MetaDataConstants_bindings(py::module& m) {
 }
 
 
+inline void create_hot_set_bindings(py::module& m) {
+    m.def("_read_hot_set", [](const std::string& filename) {
+        return si::read_hot_set(filename);
+    });
+
+    m.def("_write_hot_set", [](const std::string& filename, const std::vector<size_t>& ids) {
+        si::write_hot_set(filename, ids);
+    });
+}
+
+
 #if SI_MPI == 1
 inline void create_is_valid_comm_size_bindings(py::module& m) {
     m.def(
@@ -1513,20 +2854,33 @@ inline void create_experimental_space_filling_order(py::module& m) {
     py::module m_experimental = m.def_submodule("experimental");
     m_experimental.def(
         "space_filling_order",
-        [](const array_t& points_np) {
+        [](const array_t& points_np, int n_bits, size_t n_threads) {
             auto points_ptr = static_cast<Point3Dx const*>(extract_points_ptr(points_np));
             size_t n_points = points_np.shape(0);
 
             // FIXME, use safe types.
-            auto order = si::experimental::space_filling_order(points_ptr, n_points);
-            return pyutil::to_pyarray(order);
+            auto order = [&]() {
+                py::gil_scoped_release release;
+                return si::experimental::space_filling_order(
+                    points_ptr, n_points, n_bits, n_threads
+                );
+            }();
+            return pyutil::as_pyarray(std::move(order));
         },
+        py::arg("points"),
+        py::arg("n_bits") = 10,
+        py::arg("n_threads") = 1,
         R"(
         Order of the points according to a space filling curve.
 
         This is useful for ordering queries. Since the space filling order is
         locality preserving, points that are close in 3D are often also close in
         space filling order. Hence, hopefully improving cache effieciency.
+
+        Args:
+            points: The points as an array of shape ``(n, 3)``.
+            n_bits: Bits of the Hilbert key per axis, at most 21.
+            n_threads: Number of threads used to compute the order.
         )"
     );
 }
@@ -1,4 +1,5 @@
 """ brain_indexer classes """
+import atexit
 import logging
 from importlib.metadata import version
 
@@ -13,15 +14,27 @@ except Exception:
 
 
 # Set up logging
-def register_logger(new_logger):
-    """Register `new_logger` as the logger used by SI."""
+def register_logger(new_logger, asynchronous=False):
+    """Register `new_logger` as the logger used by SI.
+
+    If `asynchronous`, messages from C++ are queued and passed to the logger
+    on a background thread; such that threads which log, e.g. while
+    building an index or loading subtrees, don't wait for the GIL. Messages
+    can be dropped if the queue is full. See `flush_logs`.
+    """
     global logger
     logger = new_logger
 
-    core._register_python_logger(logger)
+    core._register_python_logger(logger, asynchronous)
+
+
+def flush_logs():
+    """Wait until the logger has received all messages logged in C++ so far."""
+    core._flush_logs()
 
 
 register_logger(logging.getLogger(__name__))
+atexit.register(flush_logs)
 # --------------
 
 from ._brain_indexer import SectionType # noqa
@@ -6,7 +6,7 @@ import brain_indexer
 
 from . import core
 from .util import ranges_with_progress, gen_ranges
-from .util import register_mpi_excepthook, balanced_chunk
+from .util import register_mpi_excepthook, guided_chunks
 
 
 class ChunkedProcessingMixin(metaclass=ABCMeta):
@@ -39,12 +39,38 @@ class ChunkedProcessingMixin(metaclass=ABCMeta):
 
 
 class MultiIndexBuilderMixin:
+    @staticmethod
+    def _create_core_builder(core_builder_cls, output_dir, scratch_dir=None,
+                             max_elements_in_memory=None):
+        """Create the core builder; in streaming mode if `scratch_dir` is given.
+
+        In streaming mode each rank keeps at most `max_elements_in_memory`
+        elements in memory, and spills the rest to `scratch_dir`.
+        """
+        assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
+
+        if scratch_dir is None:
+            return core_builder_cls(output_dir)
+
+        if max_elements_in_memory is None:
+            raise ValueError("Streaming requires `max_elements_in_memory`.")
+
+        return core_builder_cls(output_dir, scratch_dir, max_elements_in_memory)
+
     def _finalize(self):
         self._core_builder._finalize()
 
     def local_size(self):
         return self._core_builder.local_size()
 
+    def element_weights(self):
+        """The estimated cost of indexing each element.
+
+        The work is balanced with respect to these weights. Returns `None` if
+        all elements are equally expensive.
+        """
+        return None
+
     @classmethod
     def create(cls, *args, output_dir=None, progress=False, **kw):
         """Interactively create, with some progress"""
@@ -57,28 +83,18 @@ class MultiIndexBuilderMixin:
         mpi_rank = comm.Get_rank()
         comm_size = comm.Get_size()
 
-        def is_valid_comm_size(comm_size):
-            return core.is_valid_comm_size(comm_size - 1)
-
-        if not is_valid_comm_size(comm_size):
-            if comm_size == 1:
-                brain_indexer.logger.warning(
-                    "Please check that you're using `mpirun` or `srun`."
-                )
-
-            brain_indexer.logger.error(
-                f"BrainIndexer is running on N={comm_size} MPI ranks; but requires that "
-                "the number of MPI ranks is equal to `N = 2**n * 3**m * 5**l + 1`."
-            )
+        if not core.is_valid_comm_size(comm_size):
             raise ValueError(f"Invalid communicator size, comm_size={comm_size}.")
 
-        work_queue = MultiIndexWorkQueue(comm)
+        # The weights are estimated once and must be identical on all ranks.
+        weights = builder.element_weights() if mpi_rank == 0 else None
+        weights = comm.bcast(weights, root=0)
 
-        if mpi_rank == work_queue.distributor_rank:
-            work_queue.distribute_work(builder.n_elements_to_import())
-        else:
-            while (chunk := work_queue.request_work(builder.local_size())) is not None:
-                builder.process_range(chunk)
+        work_queue = MultiIndexWorkQueue(comm, builder.n_elements_to_import(), weights)
+        while (chunk := work_queue.next_chunk()) is not None:
+            builder.process_range(chunk)
+
+        work_queue.free()
 
         comm.Barrier()
         if mpi_rank == 0:
@@ -89,129 +105,59 @@ class MultiIndexBuilderMixin:
 
 
 class MultiIndexWorkQueue:
-    """Dynamic work queue for loading even number of elements.
+    """Distributed dynamic work queue.
 
-    The task is to distribute jobs with IDs `[0, ..., n_jobs)` to
-    the MPI ranks in such a manner that the total weight of the assigned
-    jobs is reasonably even between MPI ranks.
+    The task is to distribute jobs with IDs `[0, ..., n_jobs)` to the MPI
+    ranks in such a manner that the total weight of the jobs processed by
+    each rank is reasonably even.
 
-    Example: Assign neurons to each MPI ranks such that the total number of
+    Example: Assign neurons to each MPI rank such that the total number of
     segments is balanced across MPI ranks.
 
-    Note: The rank performing the distribution task is the last rank, i.e.
-    `comm_size - 1`.
+    The jobs are cut into chunks, see `guided_chunks`, which get smaller as
+    the work runs out. Every rank claims the next chunk by atomically
+    incrementing a counter on rank 0 with `MPI_Fetch_and_op`. Hence, all
+    ranks process jobs and no rank is busy distributing them.
     """
-    def __init__(self, comm):
+    def __init__(self, comm, n_jobs, weights=None):
+        from mpi4py import MPI
+
         self.comm = comm
         self.comm_rank = comm.Get_rank()
         self.comm_size = comm.Get_size()
-        self._n_workers = self.comm_size - 1
-
-        self._current_sizes = np.zeros(self.comm_size, dtype=np.int64)
-        self._is_waiting = np.full(self.comm_size, False)
-
-        self._request_tag = 2388
-        self._chunk_tag = 2930
-
-        self._distributor_rank = self.comm_size - 1
 
-    @property
-    def distributor_rank(self):
-        return self._distributor_rank
+        if weights is None:
+            weights = np.ones(n_jobs)
 
-    def distribute_work(self, n_elements):
-        """This is the entry-point for the distributor rank."""
-        assert self.comm_rank == self._distributor_rank, \
-            "Wrong rank is attempting to distribute work."
+        self._chunks = guided_chunks(weights, self.comm_size)
 
-        assert self._n_workers <= n_elements, \
-            "More worker ranks than elements to process."
-
-        n_chunks = min(n_elements, 100 * self._n_workers)
-        chunks = [
-            balanced_chunk(n_elements, n_chunks, k_chunk)
-            for k_chunk in range(n_chunks)
-        ]
-
-        k_chunk = 0
-        while k_chunk < n_chunks:
-            # 1. Listen for anyone that needs more work.
-            self._receive_request()
-
-            # 2. Compute the eligible ranks.
-            avg_size = np.sum(self._current_sizes) / self._n_workers
-
-            is_eligible = np.logical_and(
-                self._current_sizes <= 1.05 * avg_size,
-                self._is_waiting
-            )
-            eligible_ranks = np.argwhere(is_eligible)[:, 0]
-
-            # 3. Send work to all eligible ranks.
-            for rank in eligible_ranks:
-                if k_chunk < n_chunks:
-                    self._send_chunk(chunks[k_chunk], rank)
-                    self._is_waiting[rank] = False
-                    k_chunk += 1
-
-        # 4. Send everyone an empty chunk to signal that there's no more work.
-        for rank in range(self._n_workers):
-            if not self._is_waiting[rank]:
-                self._receive_local_count()
-
-            self._send_chunk((0, 0), rank)
-
-    def request_work(self, current_size):
-        """Request more work from the distributor.
+        # Only the counter on rank 0 is used.
+        self._counter = np.zeros(1, dtype=np.int64)
+        self._window = MPI.Win.Create(
+            self._counter, disp_unit=self._counter.itemsize, comm=comm
+        )
 
-        If there is more work, two integers are turned, the assigned work
-        is the range `[low, high)`. If there is nomore work `None` is returned.
+    def next_chunk(self):
+        """Claim the next chunk of jobs.
 
-        The `current_size` must be the current total weight of all jobs that
-        have been assigned to this MPI rank.
+        If there is more work, two integers are returned, the assigned work
+        is the range `[low, high)`. If there is no more work `None` is returned.
         """
-        assert self.comm_rank != self._distributor_rank, \
-            "The distributor rank is attempting to receive work."
-
-        self._send_local_count(current_size)
-        return self._receive_chunk()
-
-    def _send_chunk(self, raw_chunk, dest):
-        chunk = np.empty(2, dtype=np.int64)
-        chunk[0] = raw_chunk[0]
-        chunk[1] = raw_chunk[1]
-
-        self.comm.Send(chunk, dest=dest, tag=self._chunk_tag)
-
-    def _receive_chunk(self):
-        chunk = np.empty(2, dtype=np.int64)
-        self.comm.Recv(chunk, source=self._distributor_rank, tag=self._chunk_tag)
-
-        return chunk if chunk[0] < chunk[1] else None
+        from mpi4py import MPI
 
-    def _send_local_count(self, raw_local_count):
-        local_count = np.empty(1, dtype=np.int64)
-        local_count[0] = raw_local_count
-        self.comm.Send(local_count, dest=self._distributor_rank, tag=self._request_tag)
+        one = np.ones(1, dtype=np.int64)
+        k_chunk = np.empty(1, dtype=np.int64)
 
-    def _receive_local_count(self):
-        from mpi4py import MPI
+        self._window.Lock(0, MPI.LOCK_SHARED)
+        self._window.Fetch_and_op(one, k_chunk, 0, 0, MPI.SUM)
+        self._window.Unlock(0)
 
-        local_count = np.empty(1, dtype=np.int64)
-        status = MPI.Status()
-        self.comm.Recv(
-            local_count,
-            source=MPI.ANY_SOURCE,
-            tag=self._request_tag,
-            status=status,
-        )
-        source = status.Get_source()
+        if k_chunk[0] < len(self._chunks):
+            return self._chunks[k_chunk[0]]
 
-        return local_count[0], source
+        return None
 
-    def _receive_request(self):
-        local_count, source = self._receive_local_count()
+    def free(self):
+        """Free the counter; this is collective."""
+        self._window.Free()
 
-        # This rank is now waiting for work.
-        self._is_waiting[source] = True
-        self._current_sizes[source] = local_count
@@ -14,7 +14,7 @@ from .util import is_non_string_iterable, strip_singleton_non_string_iterable
 class IndexInterface(abc.ABC):
     @abc.abstractmethod
     def box_query(self, corner, opposite_corner, *,
-                  fields=None, accuracy=None,
+                  fields=None, accuracy=None, where=None,
                   populations=None, population_mode=None):
         """Find all elements intersecting with the query box.
 
@@ -28,6 +28,12 @@ class IndexInterface(abc.ABC):
                 elements are treated. Allowed are either ``"bounding_box"`` or
                 ``"best_effort"``. Default: ``"best_effort"``
 
+            where(dict):  Only return elements with these attributes. The keys
+                are ``"section_type"``, ``"gid"``, ``"pre_gid"`` and
+                ``"post_gid"``; the values are a value, a list of values or,
+                for the gids, a ``range``. The filter is evaluated while
+                traversing the index. See the User Guide.
+
             populations(str,list):  A string or list of strings specifying which
                 populations to query. Ignored by single-population indexes.
 
@@ -41,7 +47,7 @@ class IndexInterface(abc.ABC):
 
     @abc.abstractmethod
     def sphere_query(self, center, radius, *,
-                     fields=None, accuracy=None,
+                     fields=None, accuracy=None, where=None,
                      populations=None, population_mode=None):
         """Find all elements intersecting with the query sphere.
 
@@ -55,6 +61,12 @@ class IndexInterface(abc.ABC):
                 elements are treated. Allowed are either ``"bounding_box"`` or
                 ``"best_effort"``. Default: ``"best_effort"``
 
+            where(dict):  Only return elements with these attributes. The keys
+                are ``"section_type"``, ``"gid"``, ``"pre_gid"`` and
+                ``"post_gid"``; the values are a value, a list of values or,
+                for the gids, a ``range``. The filter is evaluated while
+                traversing the index. See the User Guide.
+
             populations(str,list):  A string or list of strings specifying which
                 populations to query. Ignored by single-population indexes.
 
@@ -66,6 +78,64 @@ class IndexInterface(abc.ABC):
         """
         pass
 
+    @abc.abstractmethod
+    def oriented_box_query(self, center, axes, half_extents, *,
+                           fields=None, accuracy=None, where=None,
+                           populations=None, population_mode=None):
+        """Find all elements intersecting with a rotated query box.
+
+        The box consists of all points ``center + sum(t[k] * axes[k])`` with
+        ``abs(t[k]) <= half_extents[k]``. The rows of ``axes`` must be
+        orthonormal. Nodes of the index are pruned by the exact box, not only
+        by its axis-aligned bounding box.
+
+        Arguments:
+            axes(array):  A 3x3 array; its rows are the axes of the box.
+
+        For the remaining arguments see ``box_query``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def polytope_query(self, normals, offsets, *,
+                       fields=None, accuracy=None, where=None,
+                       populations=None, population_mode=None):
+        """Find all elements intersecting with a convex query polytope.
+
+        The polytope, e.g. a view frustum, is the set of all points ``x`` with
+        ``dot(normals[i], x) <= offsets[i]`` for every ``i``. It must be
+        bounded. Nodes of the index are pruned by the exact polytope, not only
+        by its axis-aligned bounding box.
+
+        Arguments:
+            normals(array):  An Nx3 array of the outward normals.
+            offsets(array):  The N offsets of the half-spaces.
+
+        For the remaining arguments see ``box_query``.
+        """
+        pass
+
+    @abc.abstractmethod
+    def voxel_mask_query(self, origin, voxel_size, mask, *,
+                         fields=None, accuracy=None, where=None,
+                         populations=None, population_mode=None):
+        """Find all elements intersecting with the voxels set in a mask.
+
+        The mask is typically a brain region of a voxel atlas. Voxel
+        ``(i, j, k)`` covers the box from ``origin + (i, j, k) * voxel_size``
+        to ``origin + (i + 1, j + 1, k + 1) * voxel_size``. Nodes of the index
+        are classified against the mask; only elements near the boundary of
+        the region are tested individually.
+
+        Arguments:
+            origin(array):  The lower corner of the voxel ``(0, 0, 0)``.
+            voxel_size(array):  The size of a voxel along each axis.
+            mask(array):  A 3D boolean array, ``True`` for voxels in the region.
+
+        For the remaining arguments see ``box_query``.
+        """
+        pass
+
     @abc.abstractmethod
     def box_counts(self, corner, opposite_corner, *,
                    accuracy=None, group_by=None,
@@ -237,6 +307,42 @@ class IndexInterface(abc.ABC):
         pass
 
 
+def _make_attribute_filter(where):
+    """The core filter of the attributes in ``where``; or ``None``."""
+    if where is None:
+        return None
+
+    valid_keys = ["section_type", "gid", "pre_gid", "post_gid"]
+    if invalid_keys := set(where).difference(valid_keys):
+        raise ValueError(f"Invalid keys in 'where': {sorted(invalid_keys)}")
+
+    attribute_filter = brain_indexer.core._AttributeFilter()
+
+    if (section_types := where.get("section_type")) is not None:
+        if not is_non_string_iterable(section_types):
+            section_types = [section_types]
+
+        attribute_filter._section_types([int(t) for t in section_types])
+
+    for key in ["gid", "pre_gid", "post_gid"]:
+        if (ids := where.get(key)) is None:
+            continue
+
+        if isinstance(ids, range):
+            if ids.step != 1:
+                raise ValueError(f"Invalid range in 'where': {key}={ids}")
+
+            getattr(attribute_filter, f"_{key}_range")(ids.start, ids.stop)
+
+        else:
+            if not is_non_string_iterable(ids):
+                ids = [ids]
+
+            getattr(attribute_filter, f"_{key}s")([int(i) for i in ids])
+
+    return attribute_filter
+
+
 def _wrap_single_as_multi_population(func):
     @functools.wraps(func)
     def wrapped_func(self, *query_shape, populations=None, population_mode=None,
@@ -266,6 +372,18 @@ class Index(IndexInterface):
             "raw_elements": self._core_index._find_intersecting_objs,
         }
 
+        self._oriented_box_queries = {
+            "_np": self._core_index._find_intersecting_oriented_box_np,
+        }
+
+        self._polytope_queries = {
+            "_np": self._core_index._find_intersecting_polytope_np,
+        }
+
+        self._voxel_mask_queries = {
+            "_np": self._core_index._find_intersecting_voxel_mask_np,
+        }
+
         self._box_counts = {
             None: self._core_index._count_intersecting,
         }
@@ -288,24 +406,59 @@ class Index(IndexInterface):
 
     @_wrap_single_as_multi_population
     def box_query(self, corner, opposite_corner, *,
-                  fields=None, accuracy=None):
+                  fields=None, accuracy=None, where=None):
         return self._query(
             (corner, opposite_corner),
             fields=fields,
             accuracy=accuracy,
+            where=where,
             methods=self._box_queries,
         )
 
     @_wrap_single_as_multi_population
     def sphere_query(self, center, radius, *,
-                     fields=None, accuracy=None):
+                     fields=None, accuracy=None, where=None):
         return self._query(
             (center, radius),
             fields=fields,
             accuracy=accuracy,
+            where=where,
             methods=self._sphere_queries
         )
 
+    @_wrap_single_as_multi_population
+    def oriented_box_query(self, center, axes, half_extents, *,
+                           fields=None, accuracy=None, where=None):
+        return self._query(
+            (center, axes, half_extents),
+            fields=fields,
+            accuracy=accuracy,
+            where=where,
+            methods=self._oriented_box_queries
+        )
+
+    @_wrap_single_as_multi_population
+    def polytope_query(self, normals, offsets, *,
+                       fields=None, accuracy=None, where=None):
+        return self._query(
+            (normals, offsets),
+            fields=fields,
+            accuracy=accuracy,
+            where=where,
+            methods=self._polytope_queries
+        )
+
+    @_wrap_single_as_multi_population
+    def voxel_mask_query(self, origin, voxel_size, mask, *,
+                         fields=None, accuracy=None, where=None):
+        return self._query(
+            (origin, voxel_size, mask),
+            fields=fields,
+            accuracy=accuracy,
+            where=where,
+            methods=self._voxel_mask_queries
+        )
+
     @_wrap_single_as_multi_population
     def box_counts(self, corner, opposite_corner, *,
                    group_by=None, accuracy=None):
@@ -342,9 +495,172 @@ class Index(IndexInterface):
             geometry=accuracy
         )
 
+    def box_query_batches(self, corner, opposite_corner, *,
+                          batch_size=1_000_000, fields=None, accuracy=None):
+        """Iterate over the elements intersecting with the query box, in batches.
+
+        Instead of returning all results at once, this yields the results in
+        batches of at most ``batch_size`` elements. Hence, very large results
+        can be processed with bounded memory. Together, the batches contain
+        the same elements as ``box_query``; but not necessarily in the same
+        order. Only builtin fields are supported.
+
+        The index must not be modified while iterating.
+        """
+        return self._query_batches(
+            self._core_index_method("_find_intersecting_box_cursor"),
+            (corner, opposite_corner),
+            batch_size=batch_size,
+            fields=fields,
+            accuracy=accuracy,
+        )
+
+    def sphere_query_batches(self, center, radius, *,
+                             batch_size=1_000_000, fields=None, accuracy=None):
+        """Iterate over the elements intersecting with the query sphere, in batches.
+
+        See ``box_query_batches``.
+        """
+        return self._query_batches(
+            self._core_index_method("_find_intersecting_cursor"),
+            (center, radius),
+            batch_size=batch_size,
+            fields=fields,
+            accuracy=accuracy,
+        )
+
     def __len__(self):
         return len(self._core_index)
 
+    def spatial_join(self, other, distance, *, accuracy="best_effort", n_threads=1):
+        """The ids of all pairs of elements within ``distance`` of each other.
+
+        Returns an array of shape ``(n, 2)``, where the first column are the
+        ids of elements of this index and the second those of ``other``. Both
+        indexes are traversed together, which is much faster than one query
+        per element. Both must be in-memory indexes of the same type.
+
+        With ``accuracy="best_effort"`` the distance between the shapes of the
+        elements is used, e.g. between the surfaces of two segments; with
+        ``"bounding_box"`` the distance between their bounding boxes.
+        """
+        if type(self._core_index) is not type(other._core_index):
+            raise ValueError("Both indexes of a spatial join must be of the same type.")
+
+        return self._core_index._spatial_join_ids(
+            other._core_index, distance, geometry=accuracy, n_threads=n_threads
+        )
+
+    def self_join(self, distance, *, accuracy="best_effort", n_threads=1):
+        """The ids of all pairs of distinct elements within ``distance`` of each other.
+
+        Returns an array of shape ``(n, 2)``. Every unordered pair is contained
+        once, and no element is paired with itself. Unlike ``spatial_join``
+        this also supports packed and multi-indexes; the subtrees of a
+        multi-index are loaded one at a time. See ``spatial_join`` for
+        ``accuracy``.
+        """
+        return self._core_index._self_join_ids(
+            distance, geometry=accuracy, n_threads=n_threads
+        )
+
+    def segment_query(self, p1, p2, *, radius=0.0, max_hits=None,
+                      accuracy="best_effort"):
+        """The elements hit by the segment from ``p1`` to ``p2``, in order along it.
+
+        The segment can be thickened by ``radius``. Returns a pair of arrays:
+        the ids of the elements hit, and the position ``t`` along the segment
+        at which each is hit, from ``0`` at ``p1`` to ``1`` at ``p2``. Only
+        the nodes crossed by the segment are visited; and the search stops
+        after ``max_hits`` hits, if given. For a ray, pass an end point
+        outside of ``bounds()``. See ``spatial_join`` for ``accuracy``.
+        """
+        return self._core_index._find_along_segment(
+            p1, p2, radius, max_hits, geometry=accuracy
+        )
+
+    def box_level_of_detail(self, corner, opposite_corner, max_results, *,
+                            accuracy="bounding_box"):
+        """At most ``max_results`` elements or node summaries in the box.
+
+        Meant for overviews of large regions: the tree is descended only as
+        long as the next level has at most ``max_results`` nodes in the box.
+        Hence, the cost scales with ``max_results`` rather than the number of
+        elements in the box.
+
+        Returns a ``dict``. If the elements in the box fit, ``"ids"`` are
+        their ids. Otherwise, every node of the deepest level which fits is
+        summarized by ``"min_corner"``, ``"max_corner"``, ``"centroid"``,
+        the center of its bounding box; and ``"count"``, the number of
+        elements below it, including those outside of the box. For
+        multi-indexes both can be present: every subtree contributes either
+        its elements or summaries. See ``spatial_join`` for ``accuracy``.
+        """
+        return self._core_index._find_level_of_detail_box(
+            corner, opposite_corner, max_results, geometry=accuracy
+        )
+
+    def density_grid(self, min_corner, max_corner, resolution, *,
+                     approximate=False, n_threads=1):
+        """The number and total length of the elements on a regular grid.
+
+        The box is divided into ``resolution``, a triple, cells. Returns a
+        ``dict`` with ``"count"``, the number of elements of every cell, and
+        ``"length"``, the sum of their characteristic lengths, e.g. the
+        lengths of segments; both are arrays of shape ``resolution``. An
+        element belongs to the cell containing the center of its bounding box.
+
+        With ``approximate=True``, nodes of the index which are no larger
+        than a cell aren't descended; their elements are all attributed to
+        the cell containing the center of the node, and their length is
+        estimated. Small subtrees of a multi-index aren't even loaded.
+        """
+        return self._core_index._density_grid(
+            min_corner, max_corner, tuple(resolution), approximate, n_threads
+        )
+
+    def classify_points(self, points, *, n_threads=1, block_size=64):
+        """The id of an element containing each of the ``points``.
+
+        Returns an array with one id per point; ``-1`` for the points which
+        no element contains. If several elements contain a point, it gets the
+        smallest id. Somas, segments, spheres and synapses contain the points
+        inside their volume; points don't contain any.
+
+        Rather than querying point by point, the points are sorted along a
+        Hilbert curve and the index is traversed once per ``block_size``
+        consecutive points, using ``n_threads`` threads.
+        """
+        ids = self._core_index._classify_points(points, n_threads, block_size)
+
+        unclassified = ids == np.iinfo(ids.dtype).max
+        ids = ids.astype(np.int64)
+        ids[unclassified] = -1
+
+        return ids
+
+    def query_stats(self, comm=None):
+        """Statistics of all queries of this index, as a ``dict``.
+
+        The counters are: ``n_queries``, ``nodes_visited``, ``leaves_tested``,
+        ``exact_tests``, ``hits``, ``subtree_loads``, ``bytes_read`` and
+        ``load_nanoseconds``. They're only collected if BrainIndexer was built
+        with ``SI_QUERY_STATS``, otherwise they're all zero.
+
+        If ``comm`` is an MPI communicator, the statistics are summed over all
+        of its ranks.
+        """
+        stats = self._core_index._query_stats()
+
+        if comm is not None:
+            stats = {key: comm.allreduce(value) for key, value in stats.items()}
+
+        return stats
+
+    def reset_query_stats(self):
+        """Sets all query statistics of this index to zero."""
+        self._core_index._reset_query_stats()
+
     @_wrap_single_as_multi_population
     def bounds(self):
         return self._core_index.bounds()
@@ -361,15 +677,17 @@ class Index(IndexInterface):
     def populations(self):
         return [None]
 
-    def _query(self, query_shape, *, fields=None, accuracy=None, methods=None):
+    def _query(self, query_shape, *, fields=None, accuracy=None, where=None, methods=None):
         fields = self._enforce_fields_default(fields)
         accuracy = self._enforce_accuracy_default(accuracy)
+        where = _make_attribute_filter(where)
 
         if is_non_string_iterable(fields):
             return self._multi_field_box_query(
                 query_shape,
                 fields=fields,
                 accuracy=accuracy,
+                where=where,
                 methods=methods
             )
 
@@ -378,25 +696,68 @@ class Index(IndexInterface):
                 query_shape,
                 field=fields,
                 accuracy=accuracy,
+                where=where,
                 methods=methods
             )
 
     def _multi_field_box_query(self, query_shape, *,
-                               fields=None, accuracy=None, methods=None):
+                               fields=None, accuracy=None, where=None, methods=None):
 
-        result = methods["_np"](*query_shape, geometry=accuracy)
+        # Only the requested fields are computed by the core index.
+        fields = list(fields)
+        result = methods["_np"](*query_shape, geometry=accuracy, fields=fields, where=where)
         return {k: result[k] for k in fields}
 
     def _single_field_box_query(self, query_shape, *,
-                                field=None, accuracy=None, methods=None):
+                                field=None, accuracy=None, where=None, methods=None):
 
         if field in methods:
+            if where is not None:
+                raise ValueError(f"The field '{field}' doesn't support 'where'.")
+
             return methods[field](*query_shape, geometry=accuracy)
 
         else:
-            result = methods["_np"](*query_shape, geometry=accuracy)
+            result = methods["_np"](
+                *query_shape, geometry=accuracy, fields=[field], where=where
+            )
             return result[field]
 
+    def _core_index_method(self, name):
+        method = getattr(self._core_index, name, None)
+        if method is None:
+            raise NotImplementedError(
+                f"'{type(self._core_index).__name__}' doesn't support streaming queries."
+            )
+
+        return method
+
+    def _query_batches(self, open_cursor, query_shape, *,
+                       batch_size=None, fields=None, accuracy=None):
+        fields = self._enforce_fields_default(fields)
+        accuracy = self._enforce_accuracy_default(accuracy)
+
+        if batch_size < 1:
+            raise ValueError(f"Invalid batch_size: {batch_size}")
+
+        requested = fields if is_non_string_iterable(fields) else [fields]
+        for field in requested:
+            if field not in self.builtin_fields:
+                raise ValueError(f"Streaming queries only support builtin fields: {field}")
+
+        # The cursor is opened right away, such that invalid arguments are
+        # reported by the call rather than when iterating.
+        cursor = open_cursor(*query_shape, geometry=accuracy)
+
+        def batches():
+            while (result := cursor._next_batch_np(batch_size, requested)) is not None:
+                if is_non_string_iterable(fields):
+                    yield {k: result[k] for k in fields}
+                else:
+                    yield result[fields]
+
+        return batches()
+
     def _enforce_accuracy_default(self, accuracy):
         if accuracy is None:
             return "best_effort"
@@ -473,7 +834,8 @@ class SONATAIndex(Index):
             return cls(core_index)
 
     def _sonata_multi_field_box_query(self, query_shape, *,
-                                      fields=None, accuracy=None, methods=None):
+                                      fields=None, accuracy=None, where=None,
+                                      methods=None):
 
         id_key = self._id_key_for_sonata_selection
 
@@ -497,7 +859,8 @@ class SONATAIndex(Index):
             raise ValueError(f"Invalid fields: {fields}")
 
         result = super()._multi_field_box_query(
-            query_shape, fields=builtin_fields, accuracy=accuracy, methods=methods
+            query_shape, fields=builtin_fields, accuracy=accuracy, where=where,
+            methods=methods
         )
 
         if sonata_fields:
@@ -509,19 +872,20 @@ class SONATAIndex(Index):
         return {k: result[k] for k in fields}
 
     def _sonata_single_field_box_query(self, query_shape, *,
-                                       field=None, accuracy=None, methods=None):
+                                       field=None, accuracy=None, where=None,
+                                       methods=None):
 
         regular_fields = self.builtin_fields + self._deduce_special_fields(methods)
 
         if field in regular_fields:
             return super()._single_field_box_query(
-                query_shape, field=field, accuracy=accuracy, methods=methods
+                query_shape, field=field, accuracy=accuracy, where=where, methods=methods
             )
 
         else:
             id_key = self._id_key_for_sonata_selection
             ids = super()._single_field_box_query(
-                query_shape, field=id_key, accuracy=accuracy, methods=methods,
+                query_shape, field=id_key, accuracy=accuracy, where=where, methods=methods,
             )
 
             selection = libsonata.Selection(ids)
@@ -582,7 +946,46 @@ class SynapseIndex(SynapseIndexBase, _WriteSONATAInMemoryIndex):
     pass
 
 
-class SynapseMultiIndex(SynapseIndexBase):
+class _WarmUpMultiIndex:
+    def warm_up(self, hot_set=None, *, regions=None, n_threads=1):
+        """Load subtrees into the cache before the first query.
+
+        ``hot_set`` is either a list of subtree ids, the most valuable first,
+        or the name of a file written by ``save_hot_set_at_exit``. The usage
+        statistics written when ``SI_REPORT_USAGE_STATS`` is set can be used
+        as well. ``regions`` is a list of boxes, i.e. pairs of corners; the
+        subtrees which intersect them are loaded after the hot set.
+
+        Subtrees are loaded, ``n_threads`` at a time, until the cache is
+        full; nothing is evicted. Returns the number of subtrees loaded.
+        """
+        if isinstance(hot_set, str):
+            hot_set = brain_indexer.core._read_hot_set(hot_set)
+
+        subtree_ids = list(hot_set) if hot_set is not None else []
+        if regions is not None and len(regions) > 0:
+            corners = np.asarray(regions, dtype=np.float32).reshape(-1, 2, 3)
+            subtree_ids += self._core_index._subtrees_intersecting(
+                np.ascontiguousarray(corners[:, 0, :]),
+                np.ascontiguousarray(corners[:, 1, :]),
+            )
+
+        return self._core_index._warm_up(subtree_ids, n_threads)
+
+    @property
+    def hot_set(self):
+        """The ids of the cached subtrees, the most valuable first."""
+        return self._core_index._hot_set()
+
+    def save_hot_set_at_exit(self, filename):
+        """Write the ``hot_set`` to ``filename`` when the index is destroyed.
+
+        The next process can start with ``warm_up(filename)``.
+        """
+        self._core_index._save_hot_set_at_exit(filename)
+
+
+class SynapseMultiIndex(SynapseIndexBase, _WarmUpMultiIndex):
     pass
 
 
@@ -635,7 +1038,7 @@ class MorphIndex(MorphIndexBase, _WriteSONATAInMemoryIndex):
     pass
 
 
-class MorphMultiIndex(MorphIndexBase):
+class MorphMultiIndex(MorphIndexBase, _WarmUpMultiIndex):
     pass
 
 
@@ -700,6 +1103,18 @@ class MultiPopulationIndex(IndexInterface):
     def box_query(self, index, *args, **kwargs):
         return index.box_query(*args, **kwargs)
 
+    @_wrap_as_multi_population
+    def oriented_box_query(self, index, *args, **kwargs):
+        return index.oriented_box_query(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def polytope_query(self, index, *args, **kwargs):
+        return index.polytope_query(*args, **kwargs)
+
+    @_wrap_as_multi_population
+    def voxel_mask_query(self, index, *args, **kwargs):
+        return index.voxel_mask_query(*args, **kwargs)
+
     @_wrap_as_multi_population
     def box_counts(self, index, *args, **kwargs):
         return index.box_counts(*args, **kwargs)
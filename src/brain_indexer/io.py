@@ -134,7 +134,8 @@ class MetaData:
         return core.deduce_meta_data_path(path)
 
 
-def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, resolver=None):
+def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, eviction_policy=None,
+                             resolver=None):
     if in_memory_conf := meta_data.in_memory:
         return resolver.core_class("in_memory")(in_memory_conf.index_path)
 
@@ -143,7 +144,9 @@ def open_core_from_meta_data(meta_data, *, max_cache_size_mb=None, resolver=None
         mem = 1024 ** 2 * max_cache_size_mb
 
         return resolver.core_class("multi_index")(
-            multi_index_conf.index_path, max_cached_bytes=mem
+            multi_index_conf.index_path,
+            max_cached_bytes=mem,
+            eviction_policy=eviction_policy or "usage_rate",
         )
 
     else:
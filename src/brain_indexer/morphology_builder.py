@@ -1,7 +1,12 @@
 import warnings; warnings.simplefilter("ignore")  # NOQA
 
+import collections
+import concurrent.futures
+import os
+import threading
 from collections import namedtuple
 
+import libsonata
 import morphio
 import numpy as np
 import quaternion as npq
@@ -21,30 +26,112 @@ MorphInfo = namedtuple("MorphInfo", "soma, points, radius, branch_offsets, secti
 
 
 class MorphologyLib:
-    def __init__(self, collection_path):
+    """Loads and caches the morphologies of a collection.
+
+    Morphologies requested through `get_many` are decoded ahead of time by
+    `n_reader_threads` reader threads. At most `max_prefetched` decoded
+    morphologies wait to be consumed, which bounds the memory used by the
+    pipeline.
+    """
+    def __init__(self, collection_path, n_reader_threads=1, max_prefetched=None):
+        self._collection_path = collection_path
         self._collection = morphio.Collection(collection_path)
         self._morphologies = {}
 
-    def _load(self, morph_name):
-        morph = self._collection.load(morph_name)
+        self._n_reader_threads = n_reader_threads
+        self._max_prefetched = max_prefetched or 4 * n_reader_threads
+        self._executor = None
+
+        # Every reader thread opens its own collection.
+        self._thread_local = threading.local()
+
+    def _decode(self, collection, morph_name):
+        morph = collection.load(morph_name)
 
         soma = morph.soma
-        morph_infos = MorphInfo(
+        return MorphInfo(
             soma=(soma.center, soma.max_distance),
             points=morph.points,
             radius=morph.diameters / 2.,
             branch_offsets=morph.section_offsets,
             section_type=morph.section_types,
         )
+
+    def _decode_in_reader(self, morph_name):
+        collection = getattr(self._thread_local, "collection", None)
+        if collection is None:
+            collection = morphio.Collection(self._collection_path)
+            self._thread_local.collection = collection
+
+        return self._decode(collection, morph_name)
+
+    def _load(self, morph_name):
+        morph_infos = self._decode(self._collection, morph_name)
         self._morphologies[morph_name] = morph_infos
         return morph_infos
 
+    @property
+    def collection_path(self):
+        return self._collection_path
+
     def get(self, morph_name):
         return self._morphologies.get(morph_name) or self._load(morph_name)
 
+    def get_many(self, morph_names):
+        """Yields `(morph_name, morph_info)` in the order of `morph_names`.
+
+        While the caller processes one morphology, the reader threads decode
+        the next ones.
+        """
+        if self._n_reader_threads <= 1:
+            for morph_name in morph_names:
+                yield morph_name, self.get(morph_name)
+            return
+
+        if self._executor is None:
+            self._executor = concurrent.futures.ThreadPoolExecutor(
+                max_workers=self._n_reader_threads
+            )
+
+        pending = collections.deque()
+        morph_names = iter(morph_names)
+
+        def fill_queue():
+            for morph_name in morph_names:
+                if morph_name in self._morphologies:
+                    pending.append((morph_name, None))
+                else:
+                    future = self._executor.submit(self._decode_in_reader, morph_name)
+                    pending.append((morph_name, future))
+
+                if len(pending) >= self._max_prefetched:
+                    break
+
+        fill_queue()
+        while pending:
+            morph_name, future = pending.popleft()
+            if future is None:
+                morph_info = self._morphologies[morph_name]
+            else:
+                morph_info = future.result()
+                self._morphologies[morph_name] = morph_info
+
+            fill_queue()
+            yield morph_name, morph_info
+
+
+def _morphology_file_size(morphology_dir, morph_name):
+    for extension in ["", ".h5", ".asc", ".swc", ".ASC", ".SWC"]:
+        filename = os.path.join(morphology_dir, morph_name + extension)
+        if os.path.isfile(filename):
+            return os.path.getsize(filename)
+
+    return 1
+
 
 class MorphIndexBuilderBase:
-    def __init__(self, morphology_dir, nodes_file, population=None, gids=None):
+    def __init__(self, morphology_dir, nodes_file, population=None, gids=None,
+                 n_reader_threads=1, max_prefetched=None):
         """Initializes a node index builder
 
         Args:
@@ -53,6 +140,12 @@ class MorphIndexBuilderBase:
             population (str, optional): The nodes population. Defaults to the only
                population.
             gids ([type], optional): A selection of gids to index. Defaults to all GIDs.
+            n_reader_threads (int, optional): The number of threads which decode
+               morphology files while the index is built. Defaults to 1, i.e.
+               morphologies are loaded by the building thread.
+            max_prefetched (int, optional): The maximum number of decoded
+               morphologies waiting to be inserted. Defaults to
+               `4 * n_reader_threads`.
         """
         population = validated_sonata_nodes_population_name(nodes_file, population)
         self._sonata_nodes = open_sonata_nodes(nodes_file, population)
@@ -65,12 +158,35 @@ class MorphIndexBuilderBase:
 
         self._gids = gids
 
-        self.morph_lib = MorphologyLib(morphology_dir)
+        self.morph_lib = MorphologyLib(
+            morphology_dir, n_reader_threads=n_reader_threads, max_prefetched=max_prefetched
+        )
         brain_indexer.logger.info("Number of neurons to index: %d", len(gids))
 
     def n_elements_to_import(self):
         return len(self._gids)
 
+    def element_weights(self):
+        """Estimates the number of segments of each cell.
+
+        The estimate is the size of the morphology file. If the morphologies
+        aren't separate files, e.g. they're stored in a container, all cells
+        are weighted equally.
+        """
+        morphology_dir = self.morph_lib.collection_path
+        if not os.path.isdir(morphology_dir):
+            return None
+
+        selection = libsonata.Selection(np.asarray(self._gids, dtype=np.int64))
+        morph_names = self._sonata_nodes.get_attribute("morphology", selection)
+        unique_names, morphology_ids = np.unique(morph_names, return_inverse=True)
+
+        file_sizes = np.array([
+            _morphology_file_size(morphology_dir, morph_name)
+            for morph_name in unique_names
+        ])
+        return file_sizes[morphology_ids]
+
     def rototranslate(self, morph, position, rotation):
         # npq requires quaternion in the order: (w, x, y, z)
 
@@ -104,27 +220,49 @@ class MorphIndexBuilderBase:
     def process_range(self, sub_range=(None,)):
         """ Process a range of cells.
 
+        The node attributes of the whole range are read at once. The distinct
+        morphologies are decoded by the reader threads of `morph_lib`; while
+        the cells of one morphology are placed and inserted natively, the next
+        morphologies are decoded.
+
         :param: sub_range (start, end, [step]), or (None,) [all]
         """
         slice_ = slice(*sub_range)
-        cur_gids = self._gids[slice_]
+        cur_gids = np.asarray(self._gids[slice_], dtype=np.int64)
+        if cur_gids.size == 0:
+            return
 
         sonata_nodes = self._sonata_nodes
-        for gid in cur_gids:
-            morph_name = sonata_nodes.get_attribute("morphology", gid)
+        selection = libsonata.Selection(cur_gids)
 
-            pos_keys = ["x", "y", "z"]
-            pos = np.array(
-                [sonata_nodes.get_attribute(key, gid) for key in pos_keys]
-            )
+        def get_attributes(keys):
+            return np.stack(
+                [sonata_nodes.get_attribute(key, selection) for key in keys], axis=1
+            ).astype(np.float32)
+
+        morph_names = sonata_nodes.get_attribute("morphology", selection)
+        positions = get_attributes(["x", "y", "z"])
+        rotations = get_attributes([f"orientation_{key}" for key in ["w", "x", "y", "z"]])
+
+        unique_names, morphology_ids = np.unique(morph_names, return_inverse=True)
+        cells_by_morphology = np.split(
+            np.argsort(morphology_ids, kind="stable"),
+            np.cumsum(np.bincount(morphology_ids))[:-1]
+        )
 
-            orientation_keys = [f"orientation_{key}" for key in ["w", "x", "y", "z"]]
-            rot = np.array(
-                [sonata_nodes.get_attribute(key, gid) for key in orientation_keys]
+        morphs = self.morph_lib.get_many(unique_names)
+        for (morph_name, morph), cells in zip(morphs, cells_by_morphology):
+            soma_center, soma_rad = morph.soma
+            morphology = (
+                soma_center, soma_rad, morph.points, morph.radius,
+                morph.branch_offsets[:-1], morph.section_type
             )
 
-            rotopoints = self.rototranslate(morph_name, pos, rot)
-            self.process_cell(gid, morph_name, rotopoints, pos)
+            # The GIL is released while the cells are inserted.
+            self._core_builder._add_neurons(
+                cur_gids[cells], np.zeros(cells.size, dtype=np.int64),
+                positions[cells], rotations[cells], [morphology]
+            )
 
     @classmethod
     def from_sonata_file(cls, morphology_dir, node_filename, pop_name, gids=None,
@@ -183,8 +321,11 @@ class MorphIndexBuilder(MorphIndexBuilderBase,
     """A MorphIndexBuilder is a helper class to create a `MorphIndex`
     from a SONATA nodes file and a morphology library.
     """
-    def __init__(self, morphology_dir, nodes_file, population=None, gids=None):
-        super().__init__(morphology_dir, nodes_file, population, gids)
+    def __init__(self, morphology_dir, nodes_file, population=None, gids=None,
+                 n_reader_threads=1, max_prefetched=None):
+        super().__init__(morphology_dir, nodes_file, population, gids,
+                         n_reader_threads=n_reader_threads,
+                         max_prefetched=max_prefetched)
         self._core_builder = core.MorphIndexBulkBuilder()
         self._warn_when_too_large()
 
@@ -196,6 +337,34 @@ class MorphIndexBuilder(MorphIndexBuilderBase,
                 " it would be better to use a multi-index."
             )
 
+    @classmethod
+    def from_numpy(cls, gids, section_ids, segment_ids, endpoints1, endpoints2,
+                   radii, section_types, output_dir=None):
+        """Creates a morphology index of segments directly from arrays.
+
+        The index is packed from the arrays without an intermediate copy of
+        the segments.
+
+        Args:
+            gids: The gids of the neurons the segments belong to.
+            section_ids: The section ids of the segments.
+            segment_ids: The segment ids of the segments.
+            endpoints1: A Nx3 array of the first endpoints.
+            endpoints2: A Nx3 array of the second endpoints.
+            radii: The radii of the segments.
+            section_types: The section types, e.g. ``morphio.SectionType``.
+            output_dir: If not ``None`` the index will be stored in the folder
+                ``output_dir``.
+        """
+        core_index = core.MorphIndex(
+            gids, section_ids, segment_ids, endpoints1, endpoints2, radii,
+            np.asarray(section_types, dtype=np.uint32)
+        )
+        index = MorphIndex(core_index)
+        index.write(output_dir)
+
+        return index
+
     @property
     def _index_if_loaded(self):
         return self.index
@@ -222,11 +391,16 @@ if hasattr(core, "MorphMultiIndexBulkBuilder"):
                                  MorphIndexBuilderBase):
 
         def __init__(self, morphology_dir, nodes_file, population=None, gids=None,
-                     output_dir=None):
-            super().__init__(morphology_dir, nodes_file, population=population, gids=gids)
-
-            assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
-            self._core_builder = core.MorphMultiIndexBulkBuilder(output_dir)
+                     output_dir=None, scratch_dir=None, max_elements_in_memory=None,
+                     n_reader_threads=1, max_prefetched=None):
+            super().__init__(morphology_dir, nodes_file, population=population, gids=gids,
+                             n_reader_threads=n_reader_threads,
+                             max_prefetched=max_prefetched)
+
+            self._core_builder = self._create_core_builder(
+                core.MorphMultiIndexBulkBuilder, output_dir,
+                scratch_dir=scratch_dir, max_elements_in_memory=max_elements_in_memory
+            )
 
         @property
         def _index_if_loaded(self):
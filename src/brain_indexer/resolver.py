@@ -195,7 +195,7 @@ def _open_multi_population_index(meta_data, **kwargs):
     return MultiPopulationIndex(indexes)
 
 
-def open_index(path, max_cache_size_mb=None):
+def open_index(path, max_cache_size_mb=None, eviction_policy=None):
     """Open an index.
 
     Indexes are stored in folders, these folders contain the actual index and
@@ -205,11 +205,14 @@ def open_index(path, max_cache_size_mb=None):
 
     When opening multi-indexes one must specify the amount of memory the index
     is allowed to consume. This is done through ``max_cache_size_mb`` which is
-    the size maximum amount of memory all loaded indexed elements may consume,
-    in MB. Note that this does not include the space required for the tree
-    structure itself. The User Guide contains more information about how a
-    multi-index works and how the cache size affects performance. Regular,
-    in-memory indexes will ignore this flag.
+    the maximum amount of memory all loaded subtrees may consume, in MB. This
+    includes the space required for the tree structure itself. The User Guide
+    contains more information about how a multi-index works and how the cache
+    size affects performance. Regular, in-memory indexes will ignore this flag.
+
+    Which subtrees a multi-index evicts is chosen by ``eviction_policy``; one of
+    ``"usage_rate"`` (the default), ``"lru"``, ``"clock"`` or ``"cost_aware"``.
+    In-memory indexes ignore it too.
     """
 
     meta_data = MetaData(path)
@@ -217,11 +220,13 @@ def open_index(path, max_cache_size_mb=None):
     if meta_data.multi_population:
         return _open_multi_population_index(
             meta_data,
-            max_cache_size_mb=max_cache_size_mb
+            max_cache_size_mb=max_cache_size_mb,
+            eviction_policy=eviction_policy,
         )
 
     else:
         return _open_single_population_index(
             meta_data,
-            max_cache_size_mb=max_cache_size_mb
+            max_cache_size_mb=max_cache_size_mb,
+            eviction_policy=eviction_policy,
         )
@@ -16,9 +16,10 @@ class SynapseIndexBuilderBase:
     N_ELEMENTS_CHUNK = 1
     MAX_SYN_COUNT_RANGE = 100_000
 
-    def __init__(self, sonata_edges, selection):
+    def __init__(self, sonata_edges, selection, edge_filename=None):
         self._sonata_edges = sonata_edges
         self._selection = self._normalize_selection(selection)
+        self._edge_filename = edge_filename
 
     @property
     def core_builder(self):
@@ -28,8 +29,21 @@ class SynapseIndexBuilderBase:
     def n_elements_to_import(self):
         return len(self._selection.ranges)
 
+    def element_weights(self):
+        # An element is a range of synapses.
+        ranges = np.asarray(self._selection.ranges, dtype=np.int64).reshape(-1, 2)
+        return ranges[:, 1] - ranges[:, 0]
+
     def process_range(self, range_):
-        selection = libsonata.Selection(self._selection.ranges[slice(*range_)])
+        ranges = self._selection.ranges[slice(*range_)]
+        if self._reads_natively():
+            # The core reads the edges in blocks, without intermediate arrays.
+            self._core_builder._add_synapses_from_sonata(
+                self._edge_filename, self._sonata_edges.name, list(ranges)
+            )
+            return
+
+        selection = libsonata.Selection(ranges)
         syn_ids = selection.flatten()
         post_gids = self._sonata_edges.target_nodes(selection)
         pre_gids = self._sonata_edges.source_nodes(selection)
@@ -41,6 +55,16 @@ class SynapseIndexBuilderBase:
 
         self._core_builder._add_synapses(syn_ids, post_gids, pre_gids, synapse_centers)
 
+    def _reads_natively(self):
+        """Can the core read the edges straight from the SONATA file.
+
+        Requires the core to be built with `SI_HDF5`.
+        """
+        return (
+            self._edge_filename is not None
+            and hasattr(self._core_builder, "_add_synapses_from_sonata")
+        )
+
     @classmethod
     def from_sonata_file(cls, edge_filename, population_name, target_gids=None,
                          output_dir=None, **kw):
@@ -61,7 +85,8 @@ class SynapseIndexBuilderBase:
         )
         edges = open_sonata_edges(edge_filename, population_name)
         index = cls.from_sonata_tgids(
-            edges, target_gids=target_gids, output_dir=output_dir, **kw
+            edges, target_gids=target_gids, output_dir=output_dir,
+            edge_filename=edge_filename, **kw
         )
 
         if output_dir is not None:
@@ -111,8 +136,8 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
     # set in `SynapseIndexBuilderBase` not `ChunkedProcessingMixin`.
     N_ELEMENTS_CHUNK = SynapseIndexBuilderBase.N_ELEMENTS_CHUNK
 
-    def __init__(self, sonata_edges, selection):
-        super().__init__(sonata_edges, selection)
+    def __init__(self, sonata_edges, selection, edge_filename=None):
+        super().__init__(sonata_edges, selection, edge_filename=edge_filename)
         self._core_builder = core.SynapseIndexBulkBuilder()
         self._warn_when_too_large()
 
@@ -124,6 +149,27 @@ class SynapseIndexBuilder(SynapseIndexBuilderBase,
                 " Likely, it would be better to use a multi-index."
             )
 
+    @classmethod
+    def from_numpy(cls, ids, post_gids, pre_gids, positions, output_dir=None):
+        """Creates a synapse index directly from arrays.
+
+        The index is packed from the arrays without an intermediate copy of
+        the synapses.
+
+        Args:
+            ids: The ids of the synapses.
+            post_gids: The post-synaptic gids.
+            pre_gids: The pre-synaptic gids.
+            positions: A Nx3 array of the positions of the synapses.
+            output_dir: If not ``None`` the index will be stored in the folder
+                ``output_dir``.
+        """
+        core_index = core.SynapseIndex(ids, post_gids, pre_gids, positions)
+        index = SynapseIndex(core_index)
+        index.write(output_dir)
+
+        return index
+
     @property
     def index(self):
         return SynapseIndex(self._core_index, self._sonata_edges)
@@ -153,11 +199,14 @@ if hasattr(core, "SynapseMultiIndexBulkBuilder"):
         Note: this requires MPI support. Guidance on choosing the number of
         MPI ranks can be found in the User Guide.
         """
-        def __init__(self, sonata_edges, selection, output_dir=None):
-            super().__init__(sonata_edges, selection)
+        def __init__(self, sonata_edges, selection, output_dir=None,
+                     scratch_dir=None, max_elements_in_memory=None, edge_filename=None):
+            super().__init__(sonata_edges, selection, edge_filename=edge_filename)
 
-            assert output_dir is not None, f"Invalid `output_dir`. [{output_dir}]"
-            self._core_builder = core.SynapseMultiIndexBulkBuilder(output_dir)
+            self._core_builder = self._create_core_builder(
+                core.SynapseMultiIndexBulkBuilder, output_dir,
+                scratch_dir=scratch_dir, max_elements_in_memory=max_elements_in_memory
+            )
 
         @classmethod
         def constructor_rank(cls, mpi_comm=None):
@@ -216,7 +265,7 @@ if hasattr(core, "SynapseMultiIndexBulkBuilder"):
             chunk_size = cls.MAX_SYN_COUNT_RANGE
             while chunk_size >= 1:
                 candidate_selection = chunk_sonata_selection(selection, chunk_size)
-                if len(candidate_selection.ranges) >= comm_size - 1:
+                if len(candidate_selection.ranges) >= comm_size:
                     return candidate_selection
 
                 chunk_size = chunk_size // 8
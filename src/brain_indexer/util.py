@@ -106,6 +106,41 @@ def balanced_chunk(n_elements, n_chunks, k_chunk):
     return min(low, n_elements), min(high, n_elements)
 
 
+def guided_chunks(weights, n_workers, max_chunks_per_worker=100):
+    """Cut the jobs with weights `weights` into contiguous chunks.
+
+    Every chunk holds about `1 / (2 * n_workers)` of the weight that remains,
+    but at least `1 / (max_chunks_per_worker * n_workers)` of the total. The
+    first chunks are large, which keeps the number of chunks low; and the
+    last ones are small, such that all workers finish at about the same time.
+
+    Returns a list of ranges `(low, high)`.
+    """
+    weights = np.asarray(weights, dtype=np.float64)
+    n_jobs = weights.size
+    if n_jobs == 0:
+        return []
+
+    if not np.any(weights > 0.0):
+        weights = np.ones(n_jobs)
+
+    cumulative = np.cumsum(weights)
+    total = cumulative[-1]
+    min_weight = total / (max_chunks_per_worker * n_workers)
+
+    chunks = []
+    low, done = 0, 0.0
+    while low < n_jobs:
+        target = max((total - done) / (2 * n_workers), min_weight)
+        high = int(np.searchsorted(cumulative, done + target, side="left")) + 1
+        high = min(max(high, low + 1), n_jobs)
+
+        chunks.append((low, high))
+        low, done = high, cumulative[high - 1]
+
+    return chunks
+
+
 def register_mpi_excepthook():
     # Credit: https://stackoverflow.com/a/16993115
 
@@ -0,0 +1,495 @@
+// Times the hot paths of BrainIndexer and writes the results as JSON.
+//
+// Usage:
+//   [mpirun -n N] benchmark_suite [OPTIONS]
+//
+// Options:
+//   --output FILE     where the JSON is written, default: benchmarks.json
+//   --work-dir DIR    where the indexes are stored, default: benchmark_data
+//   --elements N      elements per index, default: 1000000
+//   --queries Q       queries per latency benchmark, default: 10000
+//   --query-size A    edge length of the query boxes, and twice the radius
+//                     of the query spheres, default: 10
+//   --k K             neighbours per k-NN query, default: 10
+//   --seed S          default: 0
+//
+// The serial benchmarks run on rank 0. With MPI, the distributed STR is
+// timed on `1, 2, 4, ...` ranks up to the size of `MPI_COMM_WORLD`, and the
+// multi-index is built on all ranks.
+//
+// The output has the form:
+//   {"context": {...},
+//    "benchmarks": [{"name": ..., "params": {...}, "metrics": {...}}, ...]}
+// Durations are in seconds; query latencies are in microseconds.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/spatial_join.hpp>
+#include <brain_indexer/synthetic_data.hpp>
+#include <brain_indexer/version.hpp>
+
+#if SI_MPI == 1
+#include <brain_indexer/distributed_sort_tile_recursion.hpp>
+#include <brain_indexer/mpi_wrapper.hpp>
+#include <brain_indexer/multi_index.hpp>
+#endif
+
+using namespace brain_indexer;
+using nlohmann::json;
+
+
+struct BenchmarkOptions {
+    std::string output = "benchmarks.json";
+    std::string work_dir = "benchmark_data";
+    size_t n_elements = 1000000;
+    size_t n_queries = 10000;
+    CoordType query_size = 10.0f;
+    unsigned k = 10;
+    std::uint64_t seed = 0;
+};
+
+static BenchmarkOptions parse_options(int argc, char* argv[]) {
+    auto options = BenchmarkOptions{};
+
+    for(int i = 1; i < argc; i += 2) {
+        auto key = std::string(argv[i]);
+        if(i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for: " + key);
+        }
+        auto value = std::string(argv[i + 1]);
+
+        if(key == "--output") {
+            options.output = value;
+        } else if(key == "--work-dir") {
+            options.work_dir = value;
+        } else if(key == "--elements") {
+            options.n_elements = std::stoull(value);
+        } else if(key == "--queries") {
+            options.n_queries = std::stoull(value);
+        } else if(key == "--query-size") {
+            options.query_size = CoordType(std::stod(value));
+        } else if(key == "--k") {
+            options.k = unsigned(std::stoul(value));
+        } else if(key == "--seed") {
+            options.seed = std::stoull(value);
+        } else {
+            throw std::invalid_argument("Unknown option: " + key);
+        }
+    }
+
+    return options;
+}
+
+
+/// \brief A circuit of about `n_elements` segments with a density of 1e-3.
+static SyntheticCircuit benchmark_circuit(const BenchmarkOptions& options) {
+    auto circuit = SyntheticCircuit{};
+    circuit.distribution = SyntheticDistribution::morphology;
+    circuit.seed = options.seed;
+
+    auto extent = CoordType(std::cbrt(double(options.n_elements) / circuit.density));
+    circuit.domain = Box3D{Point3D{0.0f, 0.0f, 0.0f}, Point3D{extent, extent, extent}};
+
+    return circuit;
+}
+
+static std::vector<Point3D> random_query_points(const BenchmarkOptions& options,
+                                                const SyntheticCircuit& circuit) {
+    auto gen = std::mt19937_64(options.seed + 1);
+    auto points = std::vector<Point3D>(options.n_queries);
+    for(auto& point : points) {
+        point = detail::random_point(circuit.domain, gen);
+    }
+
+    return points;
+}
+
+template <class F>
+static double time_seconds(F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// \brief Percentiles of the latencies, in microseconds, and the throughput.
+static json latency_metrics(std::vector<double> seconds) {
+    if(seconds.empty()) {
+        return json::object();
+    }
+
+    std::sort(seconds.begin(), seconds.end());
+    auto percentile = [&seconds](double p) {
+        auto k = size_t(std::ceil(p * double(seconds.size()))) - 1;
+        return 1e6 * seconds[std::min(k, seconds.size() - 1)];
+    };
+
+    double total = 0.0;
+    for(auto s : seconds) {
+        total += s;
+    }
+
+    return {
+        {"p50_us", percentile(0.5)},
+        {"p90_us", percentile(0.9)},
+        {"p99_us", percentile(0.99)},
+        {"max_us", 1e6 * seconds.back()},
+        {"mean_us", 1e6 * total / double(seconds.size())},
+        {"queries_per_second", double(seconds.size()) / total}
+    };
+}
+
+/// \brief Times `query(point, ids)` for every point.
+template <class Query>
+static json query_latency(const std::vector<Point3D>& points, Query&& query) {
+    auto latencies = std::vector<double>(points.size());
+    auto ids = std::vector<identifier_t>{};
+    size_t n_found = 0;
+
+    for(size_t i = 0; i < points.size(); ++i) {
+        ids.clear();
+        latencies[i] = time_seconds([&]() { query(points[i], ids); });
+        n_found += ids.size();
+    }
+
+    auto metrics = latency_metrics(latencies);
+    metrics["mean_matches"] = points.empty() ? 0.0 : double(n_found) / double(points.size());
+    return metrics;
+}
+
+/// \brief The total size of the files in the directory `path`.
+static size_t disk_usage(const std::filesystem::path& path) {
+    size_t bytes = 0;
+    for(const auto& entry : std::filesystem::recursive_directory_iterator(path)) {
+        if(entry.is_regular_file()) {
+            bytes += entry.file_size();
+        }
+    }
+
+    return bytes;
+}
+
+static json benchmark(const std::string& name, json params, json metrics) {
+    std::cout << name << " " << params.dump() << "\n    " << metrics.dump() << std::endl;
+    return {{"name", name}, {"params", std::move(params)}, {"metrics", std::move(metrics)}};
+}
+
+
+template <class Value>
+static json benchmark_build(const std::string& element_type, const std::vector<Value>& values) {
+    IndexTree<Value> index;
+    auto seconds = time_seconds([&]() { index = IndexTree<Value>(values); });
+
+    return benchmark("build", {{"element_type", element_type}, {"elements", values.size()}},
+                     {{"seconds", seconds},
+                      {"elements_per_second", double(values.size()) / seconds}});
+}
+
+template <class Value>
+static json benchmark_load(const std::string& element_type,
+                           const std::vector<Value>& values,
+                           const std::string& output_dir) {
+    IndexTree<Value>(values).dump(output_dir);
+
+    size_t n_loaded = 0;
+    auto seconds = time_seconds([&]() { n_loaded = IndexTree<Value>(output_dir).size(); });
+    if(n_loaded != values.size()) {
+        throw std::runtime_error("Loaded the wrong number of elements from: " + output_dir);
+    }
+
+    return benchmark("load", {{"element_type", element_type}, {"elements", values.size()}},
+                     {{"seconds", seconds},
+                      {"bytes", disk_usage(output_dir)},
+                      {"elements_per_second", double(values.size()) / seconds}});
+}
+
+template <class GeometryMode>
+static void benchmark_intersecting_queries(json& results,
+                                           const std::string& geometry,
+                                           const IndexTree<MorphoEntry>& index,
+                                           const std::vector<Point3D>& points,
+                                           CoordType query_size) {
+    auto params = json{{"element_type", "segment"},
+                       {"elements", index.size()},
+                       {"geometry", geometry},
+                       {"queries", points.size()},
+                       {"query_size", query_size}};
+
+    results.push_back(benchmark("query_box", params,
+        query_latency(points, [&](const Point3D& p, std::vector<identifier_t>& ids) {
+            auto box = Box3D{p, Point3Dx(p) + query_size};
+            index.template find_intersecting<GeometryMode>(box, iter_ids_getter(ids));
+        })
+    ));
+
+    results.push_back(benchmark("query_sphere", params,
+        query_latency(points, [&](const Point3D& p, std::vector<identifier_t>& ids) {
+            auto sphere = Sphere{p, CoordType(0.5f) * query_size};
+            index.template find_intersecting<GeometryMode>(sphere, iter_ids_getter(ids));
+        })
+    ));
+}
+
+/// \brief Times `spatial_join` against one query of `segments` per synapse.
+static json benchmark_spatial_join(const IndexTree<MorphoEntry>& segments,
+                                   const std::vector<Synapse>& synapses,
+                                   CoordType distance) {
+    auto synapse_index = IndexTree<Synapse>(synapses);
+
+    size_t n_join_pairs = 0;
+    auto join_seconds = time_seconds([&]() {
+        n_join_pairs = spatial_join_ids(segments, synapse_index, distance).size();
+    });
+
+    size_t n_query_pairs = 0;
+    auto query_seconds = time_seconds([&]() {
+        for(const auto& synapse : synapses) {
+            const auto& box = bgi::indexable<Synapse>{}(synapse);
+            auto search_box = Box3D{Point3Dx(box.min_corner()) - distance,
+                                    Point3Dx(box.max_corner()) + distance};
+            auto is_near = [&synapse, distance](const MorphoEntry& segment) {
+                return within_distance(segment, synapse, distance, BoundingBoxGeometry{})
+                       && within_distance(segment, synapse, distance, BestEffortGeometry{});
+            };
+
+            segments.query(bgi::intersects(search_box) && bgi::satisfies(is_near),
+                           boost::make_function_output_iterator(
+                               [&n_query_pairs](const MorphoEntry&) { ++n_query_pairs; }
+                           ));
+        }
+    });
+
+    if(n_join_pairs != n_query_pairs) {
+        throw std::runtime_error("The spatial join and the queries found different pairs.");
+    }
+
+    return benchmark("spatial_join",
+                     {{"element_type", "segment-synapse"},
+                      {"elements", segments.size()},
+                      {"distance", distance}},
+                     {{"seconds", join_seconds},
+                      {"query_seconds", query_seconds},
+                      {"speedup", query_seconds / join_seconds},
+                      {"pairs", n_join_pairs}});
+}
+
+static void run_serial_benchmarks(json& results, const BenchmarkOptions& options) {
+    auto circuit = benchmark_circuit(options);
+    auto n_elements = circuit.n_elements();
+
+    auto segments = std::vector<MorphoEntry>{};
+    segments.reserve(n_elements);
+    generate_synthetic_segments(circuit, 0, n_elements, std::back_inserter(segments));
+
+    auto synapses = std::vector<Synapse>{};
+    synapses.reserve(n_elements);
+    generate_synthetic_synapses(circuit, 0, n_elements, std::back_inserter(synapses));
+
+    auto somas = std::vector<MorphoEntry>{};
+    somas.reserve(n_elements);
+    for(const auto& synapse : synapses) {
+        somas.emplace_back(Soma{synapse.id, synapse.centroid, circuit.radius});
+    }
+
+    results.push_back(benchmark_build("segment", segments));
+    results.push_back(benchmark_build("synapse", synapses));
+    results.push_back(benchmark_build("soma", somas));
+
+    auto work_dir = std::filesystem::path(options.work_dir);
+    results.push_back(benchmark_load("segment", segments, work_dir / "segments"));
+    results.push_back(benchmark_load("synapse", synapses, work_dir / "synapses"));
+
+    auto index = IndexTree<MorphoEntry>(segments);
+    auto points = random_query_points(options, circuit);
+
+    benchmark_intersecting_queries<BoundingBoxGeometry>(
+        results, "bounding_box", index, points, options.query_size);
+    benchmark_intersecting_queries<BestEffortGeometry>(
+        results, "best_effort", index, points, options.query_size);
+
+    results.push_back(benchmark("query_knn",
+        {{"element_type", "segment"},
+         {"elements", index.size()},
+         {"queries", points.size()},
+         {"k", options.k}},
+        query_latency(points, [&](const Point3D& p, std::vector<identifier_t>& ids) {
+            for(const auto& gid_segm : index.find_nearest(p, options.k)) {
+                ids.push_back(gid_segm.gid);
+            }
+        })
+    ));
+
+    results.push_back(benchmark_spatial_join(index, synapses, circuit.radius));
+}
+
+
+#if SI_MPI == 1
+/// \brief Times the distributed STR of the circuit on `1, 2, 4, ...` ranks.
+static void run_distributed_str_benchmarks(json& results, const BenchmarkOptions& options) {
+    auto circuit = benchmark_circuit(options);
+    auto world_size = mpi::size(MPI_COMM_WORLD);
+
+    auto comm_sizes = std::vector<int>{};
+    for(int n = 1; n < world_size; n *= 2) {
+        comm_sizes.push_back(n);
+    }
+    comm_sizes.push_back(world_size);
+
+    double serial_seconds = 0.0;
+    for(auto comm_size : comm_sizes) {
+        auto comm = mpi::comm_shrink(MPI_COMM_WORLD, comm_size);
+
+        if(*comm != MPI_COMM_NULL) {
+            auto range = util::balanced_chunks(circuit.n_elements(),
+                                               size_t(comm_size),
+                                               size_t(mpi::rank(*comm)));
+
+            auto values = std::vector<MorphoEntry>{};
+            generate_synthetic_segments(circuit, range.low, range.high,
+                                        std::back_inserter(values));
+
+            auto params = DistributedSTRParams{circuit.n_elements(), rank_distribution(comm_size)};
+
+            MPI_Barrier(*comm);
+            auto seconds = time_seconds([&]() {
+                distributed_sort_tile_recursion<MorphoEntry, GetCenterCoordinate<MorphoEntry>>(
+                    values, params, *comm);
+                MPI_Barrier(*comm);
+            });
+
+            if(comm_size == 1) {
+                serial_seconds = seconds;
+            }
+
+            if(mpi::rank(*comm) == 0) {
+                results.push_back(benchmark("distributed_str",
+                    {{"element_type", "segment"},
+                     {"elements", circuit.n_elements()},
+                     {"ranks", comm_size}},
+                    {{"seconds", seconds},
+                     {"speedup", serial_seconds / seconds},
+                     {"efficiency", serial_seconds / seconds / double(comm_size)}}
+                ));
+            }
+        }
+
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+/** \brief Times queries of a multi-index with a cold and a warm cache.
+ *
+ *  The cold cache is too small to hold any subtree, hence every subtree a
+ *  query visits is read from disk. The warm cache holds every subtree, and
+ *  all of them are loaded before the queries are timed.
+ */
+static void run_multi_index_benchmarks(json& results, const BenchmarkOptions& options) {
+    auto circuit = benchmark_circuit(options);
+    auto output_dir = (std::filesystem::path(options.work_dir) / "multi_index").string();
+
+    auto build_seconds = time_seconds([&]() {
+        auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+        insert_synthetic_elements<MorphoEntry>(builder, circuit, MPI_COMM_WORLD);
+        builder.finalize(MPI_COMM_WORLD);
+        MPI_Barrier(MPI_COMM_WORLD);
+    });
+
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    results.push_back(benchmark("multi_index_build",
+        {{"element_type", "segment"},
+         {"elements", circuit.n_elements()},
+         {"ranks", mpi::size(MPI_COMM_WORLD)}},
+        {{"seconds", build_seconds},
+         {"elements_per_second", double(circuit.n_elements()) / build_seconds}}
+    ));
+
+    auto points = random_query_points(options, circuit);
+    auto query_size = options.query_size;
+
+    auto cold = MultiIndexTree<MorphoEntry>(output_dir, /* max_cached_bytes = */ 1);
+    auto warm = MultiIndexTree<MorphoEntry>(output_dir, std::numeric_limits<size_t>::max());
+    warm.count_intersecting(warm.bounds());
+
+    for(auto* index : {&cold, &warm}) {
+        results.push_back(benchmark("multi_index_query_box",
+            {{"element_type", "segment"},
+             {"elements", index->size()},
+             {"cache", index == &cold ? "cold" : "warm"},
+             {"queries", points.size()},
+             {"query_size", query_size}},
+            query_latency(points, [&](const Point3D& p, std::vector<identifier_t>& ids) {
+                auto box = Box3D{p, Point3Dx(p) + query_size};
+                index->find_intersecting(box, iter_ids_getter(ids));
+            })
+        ));
+    }
+}
+#endif
+
+
+int main(int argc, char* argv[]) {
+#if SI_MPI == 1
+    MPI_Init(&argc, &argv);
+    auto comm_rank = mpi::rank(MPI_COMM_WORLD);
+    auto comm_size = mpi::size(MPI_COMM_WORLD);
+#else
+    int comm_rank = 0;
+    int comm_size = 1;
+#endif
+
+    int return_code = 0;
+    try {
+        auto options = parse_options(argc, argv);
+        auto results = json::array();
+
+        if(comm_rank == 0) {
+            std::filesystem::remove_all(options.work_dir);
+            std::filesystem::create_directories(options.work_dir);
+
+            run_serial_benchmarks(results, options);
+        }
+
+#if SI_MPI == 1
+        MPI_Barrier(MPI_COMM_WORLD);
+        run_distributed_str_benchmarks(results, options);
+        run_multi_index_benchmarks(results, options);
+#endif
+
+        if(comm_rank == 0) {
+            auto report = json{
+                {"context", {{"ranks", comm_size},
+                             {"elements", options.n_elements},
+                             {"seed", options.seed},
+                             {"structs_version", SPATIAL_INDEX_STRUCT_VERSION}}},
+                {"benchmarks", results}
+            };
+
+            std::ofstream(options.output) << report.dump(2) << std::endl;
+            std::filesystem::remove_all(options.work_dir);
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return_code = 1;
+    }
+
+#if SI_MPI == 1
+    MPI_Finalize();
+#endif
+    return return_code;
+}
@@ -0,0 +1 @@
+#include <brain_indexer/attribute_filter.hpp>
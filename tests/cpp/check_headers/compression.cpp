@@ -0,0 +1 @@
+#include <brain_indexer/compression.hpp>
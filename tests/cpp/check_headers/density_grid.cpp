@@ -0,0 +1 @@
+#include <brain_indexer/density_grid.hpp>
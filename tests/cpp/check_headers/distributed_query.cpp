@@ -0,0 +1 @@
+#include <brain_indexer/distributed_query.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/external_sort_tile_recursion.hpp>
@@ -12,4 +12,25 @@ target_sources(si_check_headers
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/index.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_sorting.cpp
     PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_analysis.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/packed_rtree.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/split_morph_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/eviction_policies.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/node_shared_cache.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/external_sort_tile_recursion.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/native_rtree.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/compression.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/query_cursor.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/neuron_ingestion.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/sonata_edges.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/synthetic_data.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/query_stats.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/spatial_join.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/distributed_query.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/segment_query.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/gid_index.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/attribute_filter.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/level_of_detail.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/density_grid.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/point_classification.cpp
+    PRIVATE ${CMAKE_CURRENT_SOURCE_DIR}/remote_storage.cpp
 )
@@ -0,0 +1 @@
+#include <brain_indexer/gid_index.hpp>
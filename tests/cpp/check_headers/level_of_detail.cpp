@@ -0,0 +1 @@
+#include <brain_indexer/level_of_detail.hpp>
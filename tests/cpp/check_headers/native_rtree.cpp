@@ -0,0 +1 @@
+#include <brain_indexer/native_rtree.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/neuron_ingestion.hpp>
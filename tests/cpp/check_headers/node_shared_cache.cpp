@@ -0,0 +1 @@
+#include <brain_indexer/node_shared_cache.hpp>
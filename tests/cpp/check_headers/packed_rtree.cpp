@@ -0,0 +1 @@
+#include <brain_indexer/packed_rtree.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/point_classification.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/query_stats.hpp>
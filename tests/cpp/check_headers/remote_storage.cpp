@@ -0,0 +1 @@
+#include <brain_indexer/remote_storage.hpp>
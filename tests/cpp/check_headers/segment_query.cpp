@@ -0,0 +1 @@
+#include <brain_indexer/segment_query.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/sonata_edges.hpp>
@@ -0,0 +1 @@
+#include <brain_indexer/spatial_join.hpp>
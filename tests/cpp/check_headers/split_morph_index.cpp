@@ -0,0 +1 @@
+#include <brain_indexer/split_morph_index.hpp>
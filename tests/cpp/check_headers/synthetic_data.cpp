@@ -0,0 +1 @@
+#include <brain_indexer/synthetic_data.hpp>
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include <brain_indexer/synthetic_data.hpp>
+
+
+/** \brief The cells `[first_gid, first_gid + n_cells)` of a synthetic circuit.
+ *
+ *  Every cell is a soma followed by the segments of a
+ *  `SyntheticDistribution::morphology` neuron, with its soma in
+ *  `[0, 100]^3`; the soma is twice as thick as the segments. A cell only
+ *  depends on `seed` and its gid; hence, the cells of several ranks can be
+ *  generated separately.
+ */
+inline std::vector<brain_indexer::MorphoEntry>
+synthetic_cells(brain_indexer::identifier_t first_gid,
+                size_t n_cells,
+                std::uint64_t seed,
+                size_t segments_per_section = 20,
+                brain_indexer::CoordType radius = 0.5f) {
+    using namespace brain_indexer;
+
+    auto circuit = SyntheticCircuit{};
+    circuit.distribution = SyntheticDistribution::morphology;
+    circuit.domain = Box3D{Point3D{0.0f, 0.0f, 0.0f}, Point3D{100.0f, 100.0f, 100.0f}};
+    circuit.seed = seed;
+    circuit.sections_per_neuron = 5;
+    circuit.segments_per_section = segments_per_section;
+    circuit.radius = radius;
+
+    // Dense enough to contain the requested gids.
+    const auto n_segments = circuit.segments_per_neuron();
+    const auto low = size_t(first_gid) * n_segments;
+    const auto high = low + n_cells * n_segments;
+    circuit.density = double(high) / 1e6;
+
+    auto segments = std::vector<Segment>{};
+    generate_synthetic_segments(circuit, low, high, std::back_inserter(segments));
+
+    auto cells = std::vector<MorphoEntry>{};
+    cells.reserve(segments.size() + n_cells);
+    for(size_t i = 0; i < segments.size(); ++i) {
+        if(i % n_segments == 0) {
+            cells.emplace_back(Soma(segments[i].gid(), segments[i].p1, 2 * radius));
+        }
+        cells.emplace_back(segments[i]);
+    }
+
+    return cells;
+}
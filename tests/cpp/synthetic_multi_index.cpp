@@ -0,0 +1,149 @@
+// Builds a multi-index of a synthetic circuit and times building and querying it.
+//
+// Usage:
+//   mpirun -n N synthetic_multi_index OUTPUT_DIR [OPTIONS]
+//
+// Options:
+//   --elements segments|synapses
+//   --distribution uniform|clustered|morphology
+//   --density D       elements per unit volume, default: 1e-3
+//   --extent L        the domain is the cube [0, L]^3, default: 1000
+//   --seed S          default: 0
+//   --n-queries Q     random box queries run on rank 0, default: 1000
+//   --query-size A    edge length of the query boxes, default: 10
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/synthetic_data.hpp>
+
+using namespace brain_indexer;
+
+
+static SyntheticDistribution parse_distribution(const std::string& name) {
+    if(name == "uniform") {
+        return SyntheticDistribution::uniform;
+    }
+    if(name == "clustered") {
+        return SyntheticDistribution::clustered;
+    }
+    if(name == "morphology") {
+        return SyntheticDistribution::morphology;
+    }
+
+    throw std::invalid_argument("Unknown distribution: " + name);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <class Value>
+static void build_and_query(const std::string& output_dir,
+                            const SyntheticCircuit& circuit,
+                            size_t n_queries,
+                            CoordType query_size) {
+    auto rank = mpi::rank(MPI_COMM_WORLD);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = std::chrono::steady_clock::now();
+
+    auto builder = MultiIndexBulkBuilder<Value>(output_dir);
+    insert_synthetic_elements<Value>(builder, circuit, MPI_COMM_WORLD);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto t_generate = seconds_since(start);
+
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto t_build = seconds_since(start);
+
+    if(rank != 0) {
+        return;
+    }
+
+    std::cout << "elements: " << circuit.n_elements() << "\n"
+              << "generate [s]: " << t_generate << "\n"
+              << "build [s]: " << t_build << "\n";
+
+    auto index = MultiIndexTree<Value>(output_dir, /* mem = */ size_t(1) << 30);
+
+    auto gen = std::mt19937_64(circuit.seed);
+    auto corners = std::vector<Point3D>(n_queries);
+    for(auto& corner : corners) {
+        corner = detail::random_point(circuit.domain, gen);
+    }
+
+    start = std::chrono::steady_clock::now();
+    size_t n_found = 0;
+    for(const auto& corner : corners) {
+        auto box = Box3D{corner, Point3Dx(corner) + query_size};
+        n_found += index.count_intersecting(box);
+    }
+    auto t_query = seconds_since(start);
+
+    std::cout << "queries: " << n_queries << "\n"
+              << "found: " << n_found << "\n"
+              << "query [s]: " << t_query << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+
+    int return_code = 0;
+    try {
+        if(argc < 2) {
+            throw std::invalid_argument("Usage: synthetic_multi_index OUTPUT_DIR [OPTIONS]");
+        }
+
+        auto output_dir = std::string(argv[1]);
+        auto circuit = SyntheticCircuit{};
+        auto elements = std::string("segments");
+        auto extent = CoordType(1000.0);
+        auto n_queries = size_t(1000);
+        auto query_size = CoordType(10.0);
+
+        for(int i = 2; i + 1 < argc; i += 2) {
+            auto key = std::string(argv[i]);
+            auto value = std::string(argv[i + 1]);
+
+            if(key == "--elements") {
+                elements = value;
+            } else if(key == "--distribution") {
+                circuit.distribution = parse_distribution(value);
+            } else if(key == "--density") {
+                circuit.density = std::stod(value);
+            } else if(key == "--extent") {
+                extent = CoordType(std::stod(value));
+            } else if(key == "--seed") {
+                circuit.seed = std::stoull(value);
+            } else if(key == "--n-queries") {
+                n_queries = std::stoull(value);
+            } else if(key == "--query-size") {
+                query_size = CoordType(std::stod(value));
+            } else {
+                throw std::invalid_argument("Unknown option: " + key);
+            }
+        }
+
+        circuit.domain = Box3D{Point3D{0.0, 0.0, 0.0}, Point3D{extent, extent, extent}};
+
+        if(elements == "segments") {
+            build_and_query<MorphoEntry>(output_dir, circuit, n_queries, query_size);
+        } else if(elements == "synapses") {
+            build_and_query<Synapse>(output_dir, circuit, n_queries, query_size);
+        } else {
+            throw std::invalid_argument("Unknown elements: " + elements);
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return_code = 1;
+    }
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,254 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include <brain_indexer/attribute_filter.hpp>
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/split_morph_index.hpp>
+
+using namespace brain_indexer;
+
+using ElementKey = std::tuple<identifier_t, unsigned, unsigned>;
+
+
+static std::vector<MorphoEntry> random_morphologies(size_t n_cells, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+    auto step = std::uniform_real_distribution<CoordType>(-3.0, 3.0);
+    auto section_type = std::uniform_int_distribution<int>(2, 4);
+
+    auto elements = std::vector<MorphoEntry>{};
+    for(identifier_t gid = 0; gid < n_cells; ++gid) {
+        auto x = Point3Dx{pos(gen), pos(gen), pos(gen)};
+        elements.emplace_back(Soma(gid, x, CoordType(2.0)));
+
+        for(unsigned section_id = 1; section_id <= 10; ++section_id) {
+            auto type = SectionType(section_type(gen));
+            auto y = x;
+            for(unsigned segment_id = 0; segment_id < 10; ++segment_id) {
+                auto z = y + Point3Dx{step(gen), step(gen), step(gen)};
+                elements.emplace_back(Segment(gid, section_id, segment_id, y, z, 0.5, type));
+                y = z;
+            }
+        }
+    }
+
+    return elements;
+}
+
+static std::vector<Synapse> random_synapses(size_t n, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+    auto gid = std::uniform_int_distribution<identifier_t>(0, 99);
+
+    auto synapses = std::vector<Synapse>{};
+    for(identifier_t id = 0; id < n; ++id) {
+        synapses.emplace_back(id, gid(gen), gid(gen), Point3D{pos(gen), pos(gen), pos(gen)});
+    }
+
+    return synapses;
+}
+
+static ElementKey element_key(const Soma& soma) {
+    return {soma.gid(), 0, 0};
+}
+
+static ElementKey element_key(const Segment& segment) {
+    return {segment.gid(), segment.section_id(), segment.segment_id() + 1};
+}
+
+static ElementKey element_key(const Synapse& synapse) {
+    return {synapse.id, 0, 0};
+}
+
+static ElementKey element_key(const MorphoEntry& entry) {
+    return boost::apply_visitor([](const auto& e) { return element_key(e); }, entry);
+}
+
+template <class Value, class ShapeT>
+static std::vector<ElementKey> brute_force_keys(const std::vector<Value>& elements,
+                                                const ShapeT& shape,
+                                                const AttributeFilter& filter) {
+    auto query_box = bgi::indexable<ShapeT>{}(shape);
+
+    auto keys = std::vector<ElementKey>{};
+    for(const auto& element : elements) {
+        if(filter(element)
+           && bg::intersects(query_box, bgi::indexable<Value>{}(element))
+           && geometry_intersects(shape, element, BestEffortGeometry{})) {
+            keys.push_back(element_key(element));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+
+    return keys;
+}
+
+template <class Index, class ShapeT>
+static std::vector<ElementKey> filtered_keys(const Index& index,
+                                             const ShapeT& shape,
+                                             const AttributeFilter& filter) {
+    auto keys = std::vector<ElementKey>{};
+    index.template find_intersecting_filtered<BestEffortGeometry>(
+        shape,
+        filter,
+        boost::make_function_output_iterator([&keys](const auto& element) {
+            keys.push_back(element_key(element));
+        })
+    );
+    std::sort(keys.begin(), keys.end());
+
+    return keys;
+}
+
+static std::vector<AttributeFilter> morphology_filters() {
+    return {
+        AttributeFilter(),
+        AttributeFilter().section_types({SectionType::axon}),
+        AttributeFilter().section_types({SectionType::soma, SectionType::basal_dendrite}),
+        AttributeFilter().gid_range(10, 40),
+        AttributeFilter().gids({3, 70, 5, 70, 1000}),
+        AttributeFilter().section_types({SectionType::apical_dendrite}).gid_range(0, 50),
+    };
+}
+
+template <class Index>
+static void check_morphology_filters(const Index& index, const std::vector<MorphoEntry>& elements) {
+    auto box = Box3D{{20.0, 20.0, 20.0}, {80.0, 80.0, 80.0}};
+    auto sphere = Sphere{{50.0, 50.0, 50.0}, 25.0};
+
+    for(const auto& filter : morphology_filters()) {
+        BOOST_CHECK(filtered_keys(index, box, filter) == brute_force_keys(elements, box, filter));
+        BOOST_CHECK(filtered_keys(index, sphere, filter)
+                    == brute_force_keys(elements, sphere, filter));
+    }
+
+    // The section type is pushed into the traversal; no somas are returned.
+    auto axons = AttributeFilter().section_types({SectionType::axon});
+    auto keys = filtered_keys(index, box, axons);
+    BOOST_CHECK(!keys.empty());
+    BOOST_CHECK(std::none_of(keys.begin(), keys.end(), [](const ElementKey& key) {
+        return std::get<2>(key) == 0;
+    }));
+
+    // The pre-synaptic gid isn't an attribute of morphologies.
+    BOOST_CHECK(filtered_keys(index, box, AttributeFilter().pre_gids({1})).empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(IdSelectionContains) {
+    auto all = IdSelection{};
+    BOOST_CHECK(all.selects_all());
+    BOOST_CHECK(all.contains(0));
+
+    auto range = IdSelection{};
+    range.restrict_to_range(10, 20);
+    BOOST_CHECK(!range.selects_all());
+    BOOST_CHECK(!range.contains(9));
+    BOOST_CHECK(range.contains(10));
+    BOOST_CHECK(!range.contains(20));
+
+    // Restrictions are intersected.
+    range.restrict_to({25, 15, 12, 15});
+    range.restrict_to({12, 25, 99});
+    BOOST_CHECK(range.contains(12));
+    BOOST_CHECK(!range.contains(15));
+    BOOST_CHECK(!range.contains(25));
+}
+
+BOOST_AUTO_TEST_CASE(AttributeFilterSynapses) {
+    auto synapses = random_synapses(20000, 0);
+    auto index = IndexTree<Synapse>(synapses);
+    auto box = Box3D{{10.0, 10.0, 10.0}, {70.0, 70.0, 70.0}};
+
+    auto filters = std::vector<AttributeFilter>{
+        AttributeFilter().pre_gids({2, 3, 5, 7, 11}),
+        AttributeFilter().post_gid_range(20, 30),
+        AttributeFilter().pre_gid_range(0, 50).post_gids({1, 2}),
+        AttributeFilter().gids({4}),
+        AttributeFilter().section_types({SectionType::axon}),
+    };
+
+    for(const auto& filter : filters) {
+        BOOST_CHECK(filtered_keys(index, box, filter) == brute_force_keys(synapses, box, filter));
+    }
+
+    // The gid of a synapse is its post-synaptic gid.
+    BOOST_CHECK(filtered_keys(index, box, AttributeFilter().gids({4}))
+                == filtered_keys(index, box, AttributeFilter().post_gids({4})));
+
+    auto packed_index = PackedIndexTree<Synapse>(synapses.begin(), synapses.end());
+    for(const auto& filter : filters) {
+        BOOST_CHECK(filtered_keys(packed_index, box, filter)
+                    == brute_force_keys(synapses, box, filter));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AttributeFilterMorphologies) {
+    auto elements = random_morphologies(100, 1);
+
+    check_morphology_filters(IndexTree<MorphoEntry>(elements), elements);
+    check_morphology_filters(PackedIndexTree<MorphoEntry>(elements.begin(), elements.end()),
+                             elements);
+    check_morphology_filters(SplitMorphIndexTree<IndexTree>(elements.begin(), elements.end()),
+                             elements);
+}
+
+BOOST_AUTO_TEST_CASE(AttributeFilterNumpy) {
+    auto elements = random_morphologies(100, 2);
+    auto index = IndexTree<MorphoEntry>(elements);
+    auto box = Box3D{{20.0, 20.0, 20.0}, {80.0, 80.0, 80.0}};
+
+    auto filter = AttributeFilter().section_types({SectionType::basal_dendrite});
+    auto result = index.find_intersecting_filtered_np<BestEffortGeometry>(box, filter);
+
+    BOOST_CHECK_EQUAL(result.gid.size(), brute_force_keys(elements, box, filter).size());
+    BOOST_CHECK(std::all_of(result.section_type.begin(), result.section_type.end(), [](auto t) {
+        return SectionType(t) == SectionType::basal_dendrite;
+    }));
+}
+
+BOOST_AUTO_TEST_CASE(AttributeFilterMultiIndex) {
+    auto output_dir = std::string("tmp-attribute-filter-w3p6t");
+
+    auto elements = random_morphologies(100, 3);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(elements.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements.begin() + long(range.low), elements.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, size_t(1) << 30);
+        check_morphology_filters(index, elements);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
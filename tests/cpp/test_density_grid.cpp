@@ -0,0 +1,152 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <filesystem>
+#include <numeric>
+#include <vector>
+
+#include <brain_indexer/density_grid.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+#include "synthetic_cells.hpp"
+
+using namespace brain_indexer;
+
+
+static DensityGrid brute_force_density_grid(const std::vector<MorphoEntry>& elements,
+                                            const Box3D& box,
+                                            const std::array<size_t, 3>& resolution) {
+    auto grid = DensityGrid(box, resolution);
+    for(const auto& element : elements) {
+        auto center = Point3D{};
+        bg::centroid(Box3D(bgi::indexable<MorphoEntry>{}(element)), center);
+
+        size_t cell = 0;
+        if(grid.find_cell(center, cell)) {
+            grid.counts[cell] += 1;
+            grid.lengths[cell] += double(characteristic_length(element));
+        }
+    }
+
+    return grid;
+}
+
+static size_t total_count(const DensityGrid& grid) {
+    return std::accumulate(grid.counts.begin(), grid.counts.end(), size_t(0));
+}
+
+static double total_length(const DensityGrid& grid) {
+    return std::accumulate(grid.lengths.begin(), grid.lengths.end(), 0.0);
+}
+
+static void check_same_grid(const DensityGrid& actual, const DensityGrid& expected) {
+    BOOST_REQUIRE_EQUAL(actual.n_cells(), expected.n_cells());
+    BOOST_CHECK(actual.counts == expected.counts);
+    for(size_t i = 0; i < actual.n_cells(); ++i) {
+        auto tolerance = 1e-6 * (1.0 + expected.lengths[i]);
+        BOOST_CHECK_SMALL(actual.lengths[i] - expected.lengths[i], tolerance);
+    }
+}
+
+template <class Index>
+static void check_density_grid(const Index& index, const std::vector<MorphoEntry>& elements) {
+    auto box = Box3D{{10.0, 20.0, 30.0}, {90.0, 80.0, 70.0}};
+    auto resolution = std::array<size_t, 3>{8, 6, 4};
+    auto expected = brute_force_density_grid(elements, box, resolution);
+
+    for(size_t n_threads : {1, 3}) {
+        check_same_grid(density_grid(index, box, resolution, DensityAccuracy::exact, n_threads),
+                        expected);
+    }
+
+    // Every element is counted once, although possibly in a neighbouring cell.
+    auto all = Box3D{{-500.0, -500.0, -500.0}, {600.0, 600.0, 600.0}};
+    auto all_expected = brute_force_density_grid(elements, all, resolution);
+    BOOST_CHECK_EQUAL(total_count(all_expected), elements.size());
+
+    for(size_t n_threads : {1, 3}) {
+        auto approximate = density_grid(index, all, resolution, DensityAccuracy::approximate,
+                                        n_threads);
+        BOOST_CHECK_EQUAL(total_count(approximate), elements.size());
+        BOOST_CHECK_CLOSE(total_length(approximate), total_length(all_expected), 25.0);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(DensityGridCells) {
+    auto grid = DensityGrid(Box3D{{0.0, 0.0, 0.0}, {4.0, 2.0, 1.0}}, {4, 2, 1});
+    BOOST_CHECK_EQUAL(grid.n_cells(), 8);
+
+    size_t cell = 0;
+    BOOST_CHECK(grid.find_cell(Point3D{2.5, 0.5, 0.5}, cell));
+    BOOST_CHECK_EQUAL(cell, grid.cell_index(2, 0, 0));
+
+    // The upper faces belong to the last cells.
+    BOOST_CHECK(grid.find_cell(Point3D{4.0, 2.0, 1.0}, cell));
+    BOOST_CHECK_EQUAL(cell, grid.cell_index(3, 1, 0));
+
+    BOOST_CHECK(!grid.find_cell(Point3D{4.5, 0.5, 0.5}, cell));
+
+    grid.counts[cell] = 3;
+    BOOST_CHECK_CLOSE(grid.densities()[cell], 3.0, 1e-6);
+
+    BOOST_CHECK_THROW(DensityGrid(Box3D{{0.0, 0.0, 0.0}, {1.0, 1.0, 1.0}}, {1, 0, 1}),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(DensityGridIndexTree) {
+    auto elements = synthetic_cells(0, 100, 0);
+    check_density_grid(IndexTree<MorphoEntry>(elements), elements);
+}
+
+BOOST_AUTO_TEST_CASE(DensityGridPackedIndexTree) {
+    auto elements = synthetic_cells(0, 100, 1);
+    check_density_grid(PackedIndexTree<MorphoEntry>(elements.begin(), elements.end()), elements);
+}
+
+template <class Storage>
+static void check_multi_index_density_grid(const std::string& output_dir) {
+    auto elements = synthetic_cells(0, 100, 2);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(elements.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry, Storage>(output_dir);
+    builder.insert(elements.begin() + long(range.low), elements.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        using Index = MultiIndexTree<MorphoEntry, UsageRateCache<Storage>>;
+        auto index = Index(output_dir, size_t(1) << 30);
+        check_density_grid(index, elements);
+
+        // A single cell contains every subtree; their number of elements is used.
+        auto grid = density_grid(index, Box3D{{-500.0, -500.0, -500.0}, {600.0, 600.0, 600.0}},
+                                 {1, 1, 1}, DensityAccuracy::approximate);
+        BOOST_CHECK_EQUAL(grid.counts[0], elements.size());
+        BOOST_CHECK(grid.lengths[0] > 0.0);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DensityGridMultiIndex) {
+    check_multi_index_density_grid<NativeStorageT<MorphoEntry>>("tmp-density-grid-c8n2v");
+    check_multi_index_density_grid<MemoryMappedStorageT<MorphoEntry>>("tmp-density-grid-p5j7d");
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,183 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/distributed_analysis.hpp>
+
+#include "synthetic_cells.hpp"
+
+using namespace brain_indexer;
+
+
+/// The bin of `x` found by a linear scan over the upper edges.
+static size_t linear_search_bin(const std::vector<CoordType>& bins, CoordType x) {
+    size_t i = 0;
+    while(i + 1 < bins.size() && x >= bins[i]) {
+        ++i;
+    }
+    return i;
+}
+
+/// The total length and number of elements, over all ranks.
+struct LengthStatistics {
+    inline void operator()(const MorphoEntry& value) {
+        sum += double(characteristic_length(value));
+        ++n_values;
+    }
+
+    inline void reduce(MPI_Comm comm) {
+        MPI_Allreduce(MPI_IN_PLACE, &sum, 1, MPI_DOUBLE, MPI_SUM, comm);
+        MPI_Allreduce(MPI_IN_PLACE, &n_values, 1, mpi::datatype<size_t>(), MPI_SUM, comm);
+    }
+
+    double sum = 0.0;
+    size_t n_values = 0;
+};
+
+
+BOOST_AUTO_TEST_CASE(StreamingHistogramBins) {
+    auto log10 = StreamingHistogram::log10(CoordType(-3), CoordType(2), 4);
+    auto bins = log10.bins();
+    auto searched = StreamingHistogram(bins);
+
+    auto values = std::vector<CoordType>{
+        CoordType(-1.0), CoordType(0.0), CoordType(1e-9), CoordType(1e9),
+        std::numeric_limits<CoordType>::max()
+    };
+
+    // The edges themselves, and their neighbours, are most sensitive to rounding.
+    for(auto edge : bins) {
+        values.push_back(edge);
+        values.push_back(std::nextafter(edge, CoordType(0)));
+        values.push_back(std::nextafter(edge, std::numeric_limits<CoordType>::max()));
+    }
+
+    auto gen = std::mt19937(0);
+    auto exponent = std::uniform_real_distribution<CoordType>(-4.0, 3.0);
+    for(size_t i = 0; i < 1000; ++i) {
+        values.push_back(std::pow(CoordType(10.0), exponent(gen)));
+    }
+
+    auto expected = std::vector<size_t>(bins.size(), 0ul);
+    for(auto x : values) {
+        log10.add(x);
+        searched.add(x);
+        ++expected[linear_search_bin(bins, x)];
+    }
+
+    BOOST_CHECK(log10.counts() == expected);
+    BOOST_CHECK(searched.counts() == expected);
+    BOOST_CHECK_THROW(StreamingHistogram(std::vector<CoordType>{}), std::invalid_argument);
+}
+
+
+BOOST_AUTO_TEST_CASE(StreamingHistogramReduce) {
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+
+    auto bins = std::vector<CoordType>{1.0, 2.0, 3.0};
+    auto data = std::vector<CoordType>(comm_rank + 1, CoordType(1.5));
+    auto counts = histogram(bins, data, MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        auto expected = std::vector<size_t>{0, comm_size * (comm_size + 1) / 2, 0};
+        BOOST_CHECK(counts == expected);
+    } else {
+        BOOST_CHECK(counts.empty());
+    }
+}
+
+
+template <class Storage>
+static void check_reduce_elements(const std::string& output_dir) {
+    auto elements = synthetic_cells(0, 200, 3, 10);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(elements.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry, Storage>(output_dir);
+    builder.insert(elements.begin() + long(range.low), elements.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto length = [](const MorphoEntry& value) { return characteristic_length(value); };
+    auto reducer = make_histogram_reducer(StreamingHistogram::log10(-2, 2, 3), length);
+    auto statistics = LengthStatistics{};
+    auto index_dir = resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key);
+    reduce_elements(Storage(index_dir), MPI_COMM_WORLD, reducer, statistics);
+
+    auto expected = StreamingHistogram::log10(-2, 2, 3);
+    auto expected_sum = 0.0;
+    for(const auto& element : elements) {
+        expected.add(length(element));
+        expected_sum += double(length(element));
+    }
+
+    BOOST_CHECK_EQUAL(statistics.n_values, elements.size());
+    BOOST_CHECK_CLOSE(statistics.sum, expected_sum, 1e-4);
+
+    if(comm_rank == 0) {
+        BOOST_CHECK(reducer.histogram().counts() == expected.counts());
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ReduceElements) {
+    check_reduce_elements<NativeStorageT<MorphoEntry>>("tmp-reduce-elements-h3k8w");
+    check_reduce_elements<MemoryMappedStorageT<MorphoEntry>>("tmp-reduce-elements-q9d2m");
+}
+
+
+BOOST_AUTO_TEST_CASE(ReduceElementsNonContiguousIds) {
+    using Storage = NativeStorageT<MorphoEntry>;
+    auto index_dir = std::string("tmp-reduce-elements-gaps-w5n2c");
+    auto elements = synthetic_cells(0, 30, 5, 10);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+
+    // The subtrees have the ids 0, 2 and 5; e.g. after removing subtrees.
+    auto subtree_ids = std::vector<size_t>{0, 2, 5};
+    if(comm_rank == 0) {
+        std::filesystem::create_directories(index_dir);
+        auto storage = Storage(index_dir);
+        auto boxes = std::vector<IndexedSubtreeBox>{};
+        for(size_t k = 0; k < subtree_ids.size(); ++k) {
+            auto range = util::balanced_chunks(elements.size(), subtree_ids.size(), k);
+            auto subtree = MultiIndexSubTreeT<MorphoEntry>(elements.begin() + long(range.low),
+                                                           elements.begin() + long(range.high));
+            storage.save_subtree(subtree, subtree_ids[k]);
+            boxes.emplace_back(subtree_ids[k], subtree.size(), subtree.bounds());
+        }
+        storage.save_top_tree(MultiIndexTopTreeT(boxes.begin(), boxes.end()));
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto statistics = LengthStatistics{};
+    reduce_elements(Storage(index_dir), MPI_COMM_WORLD, statistics);
+    BOOST_CHECK_EQUAL(statistics.n_values, elements.size());
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(index_dir);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,118 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/distributed_query.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+using namespace brain_indexer;
+
+
+static std::vector<IndexedSphere> random_spheres(size_t n, identifier_t first_id, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(size_t i = 0; i < n; ++i) {
+        auto center = Point3D{pos(gen), pos(gen), pos(gen)};
+        spheres.emplace_back(first_id + identifier_t(i), center, 0.5f);
+    }
+
+    return spheres;
+}
+
+static std::vector<Sphere> random_queries(size_t n, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(-10.0, 110.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.5, 8.0);
+
+    auto queries = std::vector<Sphere>{};
+    for(size_t i = 0; i < n; ++i) {
+        queries.push_back(Sphere{Point3D{pos(gen), pos(gen), pos(gen)}, radius(gen)});
+    }
+
+    return queries;
+}
+
+static std::vector<identifier_t> sorted_ids(const detail::batch_query_result<IndexedSphere>& batch,
+                                            size_t i) {
+    auto ids = std::vector<identifier_t>(batch.values.id.begin() + long(batch.offsets[i]),
+                                         batch.values.id.begin() + long(batch.offsets[i + 1]));
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+
+BOOST_AUTO_TEST_CASE(DistributedMultiIndexQueries) {
+    auto output_dir = std::string("tmp-distributed-query-p2kx7");
+
+    auto comm_rank = mpi::rank(MPI_COMM_WORLD);
+    auto comm_size = mpi::size(MPI_COMM_WORLD);
+
+    auto spheres = random_spheres(2000, identifier_t(comm_rank) * 2000, size_t(comm_rank));
+    auto builder = MultiIndexBulkBuilder<IndexedSphere>(output_dir);
+    builder.insert(spheres.begin(), spheres.end());
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    auto index = DistributedMultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30, MPI_COMM_WORLD);
+    auto reference = MultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+    BOOST_CHECK_EQUAL(index.size(), 2000 * size_t(comm_size));
+
+    // Every subtree has exactly one owner.
+    auto storage = NativeStorageT<IndexedSphere>(output_dir + "/multi_index");
+    auto n_subtrees = storage.load_top_tree().size();
+    auto n_local = index.local_subtrees().size();
+    auto n_owned = size_t(0);
+    MPI_Allreduce(&n_local, &n_owned, 1, MPI_SIZE_T, MPI_SUM, MPI_COMM_WORLD);
+    BOOST_CHECK_EQUAL(n_owned, n_subtrees);
+    for(auto subtree_id : index.local_subtrees()) {
+        BOOST_CHECK_EQUAL(index.owner(subtree_id), comm_rank);
+    }
+
+    // Every rank issues different queries; the last rank none at all.
+    auto n_queries = comm_rank + 1 == comm_size && comm_size > 1 ? size_t(0) : size_t(100);
+    auto queries = random_queries(n_queries, 100 + size_t(comm_rank));
+
+    for(size_t n_threads : {1, 3}) {
+        auto batch = index.find_intersecting_batch<BestEffortGeometry>(queries, n_threads);
+        auto expected = reference.find_intersecting_batch<BestEffortGeometry>(queries);
+
+        BOOST_REQUIRE_EQUAL(batch.offsets.size(), queries.size() + 1);
+        BOOST_CHECK_EQUAL(batch.offsets.back(), expected.offsets.back());
+        for(size_t i = 0; i < queries.size(); ++i) {
+            BOOST_CHECK(sorted_ids(batch, i) == sorted_ids(expected, i));
+        }
+    }
+
+    // Only the owned subtrees are loaded, while `reference` loads all those
+    // touched by the queries of this rank.
+    if(comm_size > 1 && n_queries > 0) {
+        BOOST_CHECK(index.local_index().cached_bytes() < reference.cached_bytes());
+    }
+
+    auto boxes = std::vector<Box3D>{Box3D{Point3D{-5.0, -5.0, -5.0}, Point3D{105.0, 105.0, 105.0}}};
+    auto everything = index.find_intersecting_batch(boxes);
+    BOOST_CHECK_EQUAL(everything.values.id.size(), 2000 * size_t(comm_size));
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -3,6 +3,9 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <mutex>
+#include <stdexcept>
+
 #include <brain_indexer/distributed_sort_tile_recursion.hpp>
 
 using namespace brain_indexer;
@@ -19,8 +22,20 @@ BOOST_AUTO_TEST_CASE(IsValidCommunicatorSize) {
     BOOST_REQUIRE(is_valid_comm_size(20));
     BOOST_REQUIRE(is_valid_comm_size(80));
 
-    BOOST_REQUIRE(!is_valid_comm_size(7));
-    BOOST_REQUIRE(!is_valid_comm_size(13));
+    BOOST_REQUIRE(is_valid_comm_size(7));
+    BOOST_REQUIRE(is_valid_comm_size(13));
+    BOOST_REQUIRE(is_valid_comm_size(77));
+
+    BOOST_REQUIRE(!is_valid_comm_size(0));
+    BOOST_REQUIRE(!is_valid_comm_size(-1));
+}
+
+BOOST_AUTO_TEST_CASE(PrimeFactors) {
+    BOOST_CHECK(prime_factors(1).empty());
+    BOOST_CHECK(prime_factors(2) == std::vector<int>({2}));
+    BOOST_CHECK(prime_factors(12) == std::vector<int>({2, 2, 3}));
+    BOOST_CHECK(prime_factors(77) == std::vector<int>({7, 11}));
+    BOOST_CHECK(prime_factors(97) == std::vector<int>({97}));
 }
 
 BOOST_AUTO_TEST_CASE(FactorizeNumber) {
@@ -62,8 +77,8 @@ BOOST_AUTO_TEST_CASE(FactorizeNumber) {
 }
 
 BOOST_AUTO_TEST_CASE(RankDistribution) {
-    auto test_cases = std::vector<int>{2, 3, 4, 5, 6, 12, 20, 80, 160, 16*72};
-    auto primes = std::vector<int>{2, 3, 5};
+    auto test_cases = std::vector<int>{1, 2, 3, 4, 5, 6, 7, 12, 14, 20, 77, 80, 97, 160, 16*72};
+    auto primes = std::vector<int>{2, 3, 5, 7, 11};
 
     for(auto comm_size : test_cases) {
         auto ranks = rank_distribution(comm_size);
@@ -81,6 +96,65 @@ BOOST_AUTO_TEST_CASE(RankDistribution) {
 
 }
 
+namespace {
+
+/// Records the subtrees it saves; and fails to save `failing_id`.
+struct RecordingStorage {
+    using subtree_type = std::vector<int>;
+
+    void save_subtree(const subtree_type& subtree, size_t subtree_id) const {
+        if(subtree_id == failing_id) {
+            throw std::runtime_error("Failed to write.");
+        }
+
+        auto lock = std::lock_guard<std::mutex>(*mutex);
+        saved->emplace_back(subtree_id, subtree);
+    }
+
+    size_t failing_id = size_t(-1);
+    std::shared_ptr<std::mutex> mutex = std::make_shared<std::mutex>();
+    std::shared_ptr<std::vector<std::pair<size_t, subtree_type>>> saved
+        = std::make_shared<std::vector<std::pair<size_t, subtree_type>>>();
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(AsyncSubtreeWriterSavesAll) {
+    auto storage = RecordingStorage{};
+    {
+        auto writer = AsyncSubtreeWriter<RecordingStorage>(storage);
+        for(size_t k = 0; k < 10; ++k) {
+            writer.save(std::vector<int>(k, int(k)), k);
+        }
+        writer.wait();
+    }
+
+    BOOST_REQUIRE(storage.saved->size() == 10);
+    for(size_t k = 0; k < 10; ++k) {
+        const auto& [id, subtree] = (*storage.saved)[k];
+        BOOST_CHECK(id == k);
+        BOOST_CHECK(subtree == std::vector<int>(k, int(k)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(AsyncSubtreeWriterRethrows) {
+    auto storage = RecordingStorage{};
+    storage.failing_id = 3;
+
+    auto writer = AsyncSubtreeWriter<RecordingStorage>(storage);
+    for(size_t k = 0; k < 3; ++k) {
+        writer.save(std::vector<int>(2, int(k)), k);
+    }
+
+    writer.save(std::vector<int>(2, 3), 3);
+    BOOST_CHECK_THROW(writer.wait(), std::runtime_error);
+
+    // The error is reported once; afterwards, the writer is usable again.
+    writer.save(std::vector<int>(2, 4), 4);
+    writer.wait();
+    BOOST_CHECK(storage.saved->size() == 4);
+}
+
 int main(int argc, char *argv[]) {
     MPI_Init(&argc, &argv);
 
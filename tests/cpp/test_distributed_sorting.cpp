@@ -8,6 +8,8 @@ namespace bt = boost::unit_test;
 #include <brain_indexer/sort_tile_recursion.hpp>
 
 #include <array>
+#include <cmath>
+#include <functional>
 #include <vector>
 #include <random>
 
@@ -119,6 +121,174 @@ BOOST_AUTO_TEST_CASE(DistributedSortingTests) {
 }
 
 
+static void check_weighted_balance(const std::vector<Sortable>& unsorted,
+                                   const std::function<double(const Sortable&)>& weight,
+                                   MPI_Comm comm) {
+    auto comm_size = mpi::size(comm);
+
+    auto sorted = unsorted;
+    using DMS = brain_indexer::DistributedMemorySorter<Sortable, GetValue>;
+    DMS::sort_and_balance(sorted, comm, weight);
+
+    BOOST_REQUIRE(!sorted.empty());
+    BOOST_CHECK(std::is_sorted(sorted.begin(), sorted.end(), GetValue::compare));
+
+    auto n_local = unsorted.size();
+    auto n_total = size_t(0);
+    auto n_sorted = sorted.size();
+    auto n_sorted_total = size_t(0);
+    MPI_Allreduce(&n_local, &n_total, 1, MPI_SIZE_T, MPI_SUM, comm);
+    MPI_Allreduce(&n_sorted, &n_sorted_total, 1, MPI_SIZE_T, MPI_SUM, comm);
+    BOOST_CHECK(n_sorted_total == n_total);
+
+    // The ranks are sorted too.
+    auto bounds = std::array<double, 2>{sorted.front().value, sorted.back().value};
+    auto all_bounds = std::vector<double>(2 * size_t(comm_size));
+    MPI_Allgather(bounds.data(), 2, MPI_DOUBLE, all_bounds.data(), 2, MPI_DOUBLE, comm);
+    BOOST_CHECK(std::is_sorted(all_bounds.begin(), all_bounds.end()));
+
+    auto local_weight = 0.0;
+    auto max_weight = 0.0;
+    for(const auto& v : sorted) {
+        local_weight += weight(v);
+        max_weight = std::max(max_weight, weight(v));
+    }
+
+    auto total_weight = 0.0;
+    MPI_Allreduce(&local_weight, &total_weight, 1, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, &max_weight, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+    auto fair_share = total_weight / comm_size;
+    BOOST_CHECK(std::abs(local_weight - fair_share) <= max_weight + 1e-9 * total_weight);
+
+}
+
+BOOST_AUTO_TEST_CASE(WeightedDistributedSortingTests) {
+    int n_required_ranks = 3;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == comm.invalid_handle()) {
+        return;
+    }
+
+    auto mpi_rank = mpi::rank(*comm);
+    auto unsorted = random_values(100ul * size_t(mpi_rank + 1), mpi_rank);
+
+    // The positive half is denser, e.g. in terms of query cost.
+    check_weighted_balance(unsorted, [](const Sortable& v) {
+        return v.value > 0.0 ? 9.0 : 1.0;
+    }, *comm);
+
+    // Every rank still receives at least one element.
+    check_weighted_balance(unsorted, [](const Sortable& v) {
+        return v.payload == std::array<int, 2>{0, 0} ? 1e6 : 0.0;
+    }, *comm);
+
+    // Falls back to balancing by count.
+    check_weighted_balance(unsorted, [](const Sortable&) { return 0.0; }, *comm);
+
+    auto values = unsorted;
+    using DMS = brain_indexer::DistributedMemorySorter<Sortable, GetValue>;
+    auto negative = [mpi_rank](const Sortable&) { return mpi_rank == 1 ? -1.0 : 1.0; };
+    BOOST_CHECK_THROW(DMS::sort_and_balance(values, *comm, negative), std::invalid_argument);
+}
+
+
+static void check_sort_and_balance_once(const std::vector<Sortable>& unsorted,
+                                        size_t max_message_size,
+                                        MPI_Comm comm) {
+    auto mpi_rank = mpi::rank(comm);
+    auto comm_size = mpi::size(comm);
+
+    auto sorted = unsorted;
+    using DMS = brain_indexer::DistributedMemorySorter<Sortable, GetValue>;
+    DMS::sort_and_balance_once(sorted, comm, max_message_size);
+
+    BOOST_CHECK(std::is_sorted(sorted.begin(), sorted.end(), GetValue::compare));
+
+    auto counts = mpi::exchange_local_counts(unsorted.size(), comm);
+    auto n_total = std::accumulate(counts.begin(), counts.end(), size_t(0));
+    BOOST_CHECK(sorted.size() == util::balanced_chunk_sizes(n_total, size_t(comm_size))[mpi_rank]);
+
+    // Gather everything on every rank, and compare with a serial sort.
+    auto mpi_sortable = mpi::Datatype(mpi::create_contiguous_datatype<Sortable>());
+    auto gather_all = [&](const std::vector<Sortable>& local) {
+        auto local_counts = std::vector<int>(size_t(comm_size));
+        int n_local = int(local.size());
+        MPI_Allgather(&n_local, 1, MPI_INT, local_counts.data(), 1, MPI_INT, comm);
+
+        auto offsets = mpi::offsets_from_counts(local_counts);
+        auto all = std::vector<Sortable>(size_t(offsets.back()));
+        MPI_Allgatherv(local.data(), n_local, *mpi_sortable,
+                       all.data(), local_counts.data(), offsets.data(), *mpi_sortable, comm);
+        return all;
+    };
+
+    auto all_sorted = gather_all(sorted);
+    BOOST_CHECK(std::is_sorted(all_sorted.begin(), all_sorted.end(), GetValue::compare));
+
+    auto by_payload = [](const Sortable& a, const Sortable& b) {
+        return std::make_pair(a.value, a.payload) < std::make_pair(b.value, b.payload);
+    };
+    auto expected = gather_all(unsorted);
+    std::sort(expected.begin(), expected.end(), by_payload);
+    std::sort(all_sorted.begin(), all_sorted.end(), by_payload);
+
+    BOOST_REQUIRE(all_sorted.size() == expected.size());
+    for(size_t i = 0; i < expected.size(); ++i) {
+        BOOST_CHECK(all_sorted[i].value == expected[i].value);
+        BOOST_CHECK(all_sorted[i].payload == expected[i].payload);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(SortAndBalanceOnce) {
+    auto comm = MPI_COMM_WORLD;
+    auto mpi_rank = mpi::rank(comm);
+
+    // Unequal sizes, including an empty rank.
+    auto n_local = mpi_rank == 1 ? 0ul : 97ul * size_t(mpi_rank + 1);
+    auto unsorted = random_values(n_local, mpi_rank);
+    check_sort_and_balance_once(unsorted, size_t(1) << 30, comm);
+
+    // Many messages per bucket.
+    check_sort_and_balance_once(unsorted, 7 * sizeof(Sortable), comm);
+
+    // Many values with equal keys, including negative ones.
+    auto duplicates = unsorted;
+    for(auto& v : duplicates) {
+        v.value = double(v.payload[1] % 3) - 1.0;
+    }
+    check_sort_and_balance_once(duplicates, size_t(1) << 30, comm);
+
+    // Signed zeros compare equal.
+    auto zeros = unsorted;
+    for(auto& v : zeros) {
+        v.value = (v.payload[1] % 2 == 0) ? -0.0 : 0.0;
+    }
+    check_sort_and_balance_once(zeros, size_t(1) << 30, comm);
+
+    // All keys are equal.
+    auto constant = unsorted;
+    for(auto& v : constant) {
+        v.value = 4.0;
+    }
+    check_sort_and_balance_once(constant, size_t(1) << 30, comm);
+}
+
+
+BOOST_AUTO_TEST_CASE(OrderedKeyBits) {
+    using detail::ordered_key_bits;
+
+    BOOST_CHECK_EQUAL(ordered_key_bits(-0.0), ordered_key_bits(0.0));
+    BOOST_CHECK_EQUAL(ordered_key_bits(-0.0f), ordered_key_bits(0.0f));
+
+    auto keys = std::vector<double>{-1e30, -2.5, -1e-30, 0.0, 1e-30, 2.5, 1e30};
+    for(size_t i = 0; i + 1 < keys.size(); ++i) {
+        BOOST_CHECK(ordered_key_bits(keys[i]) < ordered_key_bits(keys[i+1]));
+    }
+}
+
+
 int main(int argc, char *argv[]) {
     MPI_Init(&argc, &argv);
 
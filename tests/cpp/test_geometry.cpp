@@ -746,3 +746,275 @@ BOOST_AUTO_TEST_CASE(CylinderSelectedCases) {
     }
 }
 BOOST_AUTO_TEST_SUITE_END()
+
+
+//////////////////////////////////////////////////////////////////
+// Oriented boxes and convex polytopes
+//////////////////////////////////////////////////////////////////
+BOOST_AUTO_TEST_SUITE(RegionShapes)
+
+/// A box rotated by 45 degrees around the z-axis.
+static OrientedBox rotated_box() {
+    auto s = CoordType(std::sqrt(0.5));
+    auto axes = std::array<Point3D, 3>{
+        Point3D{s, s, 0.0}, Point3D{-s, s, 0.0}, Point3D{0.0, 0.0, 1.0}
+    };
+    return OrientedBox{Point3D{0.0, 0.0, 0.0}, axes, Point3D{1.0, 0.2, 1.0}};
+}
+
+static OrientedBox random_oriented_box(std::mt19937& gen) {
+    auto unif = std::uniform_real_distribution<CoordType>(-1.0, 1.0);
+    auto random_vector = [&]() { return Point3Dx{unif(gen), unif(gen), unif(gen)}; };
+
+    // Gram-Schmidt of random vectors.
+    auto a = random_vector();
+    a = a / a.norm();
+    auto b = random_vector();
+    b = b - a * a.dot(b);
+    b = b / b.norm();
+    auto c = Point3Dx(a.cross(b));
+
+    auto size = std::uniform_real_distribution<CoordType>(0.2, 2.0);
+    return OrientedBox{random_vector(), {a, b, c}, Point3D{size(gen), size(gen), size(gen)}};
+}
+
+BOOST_AUTO_TEST_CASE(OrientedBoxSelectedCases) {
+    auto obb = rotated_box();
+
+    auto bb = obb.bounding_box();
+    auto expected_extent = CoordType(1.2 * std::sqrt(0.5));
+    BOOST_CHECK_CLOSE(bb.max_corner().get<0>(), expected_extent, 1e-4);
+    BOOST_CHECK_CLOSE(bb.min_corner().get<1>(), -expected_extent, 1e-4);
+    BOOST_CHECK_CLOSE(bb.max_corner().get<2>(), 1.0, 1e-4);
+
+    BOOST_CHECK(obb.contains(Point3D{0.65, 0.65, 0.5}));
+    BOOST_CHECK(!obb.contains(Point3D{0.5, -0.4, 0.0}));
+
+    BOOST_CHECK(obb.intersects(Box3D{Point3D{0.6, 0.6, 0.0}, Point3D{0.7, 0.7, 0.5}}));
+    BOOST_CHECK(!obb.intersects(Box3D{Point3D{0.9, 0.9, 0.0}, Point3D{1.0, 1.0, 1.0}}));
+
+    // Inside the bounding box, but not the box itself.
+    auto corner = Box3D{Point3D{0.5, -0.5, 0.0}, Point3D{0.6, -0.4, 0.1}};
+    BOOST_CHECK(bg::intersects(bb, corner));
+    BOOST_CHECK(!obb.intersects(corner));
+    BOOST_CHECK(!geometry_intersects(obb, Box3Dx(corner), BestEffortGeometry{}));
+
+    BOOST_CHECK(obb.intersects(Sphere{Point3D{0.5, -0.4, 0.0}, 0.5}));
+    BOOST_CHECK(!obb.intersects(Sphere{Point3D{0.5, -0.4, 0.0}, 0.4}));
+
+    BOOST_CHECK(obb.intersects(Cylinder{Point3D{2.0, -2.0, 0.0}, Point3D{-2.0, 2.0, 0.0}, 0.0}));
+    BOOST_CHECK(!obb.intersects(Cylinder{Point3D{2.0, 0.0, 0.0}, Point3D{0.0, -2.0, 0.0}, 0.1}));
+
+    BOOST_CHECK(strictly_contains(obb, Box3D{Point3D{0.1, 0.1, 0.0}, Point3D{0.2, 0.2, 0.1}}));
+    BOOST_CHECK(!strictly_contains(obb, Box3D{Point3D{0.1, -0.1, 0.0}, Point3D{0.3, 0.3, 0.1}}));
+}
+
+BOOST_AUTO_TEST_CASE(ConvexPolytopeSelectedCases) {
+    // A frustum of a pyramid, with apex at the origin, looking along the z-axis.
+    auto frustum = ConvexPolytope(std::vector<HalfSpace>{
+        HalfSpace{Point3D{0.0, 0.0, -1.0}, -1.0},
+        HalfSpace{Point3D{0.0, 0.0, 1.0}, 3.0},
+        HalfSpace{Point3D{2.0, 0.0, -1.0}, 0.0},
+        HalfSpace{Point3D{-2.0, 0.0, -1.0}, 0.0},
+        HalfSpace{Point3D{0.0, 2.0, -1.0}, 0.0},
+        HalfSpace{Point3D{0.0, -2.0, -1.0}, 0.0}
+    });
+
+    BOOST_CHECK_EQUAL(frustum.vertices().size(), 8);
+    BOOST_CHECK_EQUAL(frustum.edges().size(), 12);
+    BOOST_CHECK_CLOSE(frustum.bounding_box().max_corner().get<0>(), 1.5, 1e-4);
+    BOOST_CHECK_CLOSE(frustum.bounding_box().min_corner().get<2>(), 1.0, 1e-4);
+
+    BOOST_CHECK(frustum.contains(Point3D{0.0, 0.0, 2.0}));
+    BOOST_CHECK(!frustum.contains(Point3D{1.0, 0.0, 1.5}));
+    BOOST_CHECK_CLOSE(frustum.distance_sq(Point3D{0.0, 0.0, 4.0}), 1.0, 1e-4);
+    BOOST_CHECK_CLOSE(frustum.distance_sq(Point3D{2.5, 2.5, 3.0}), 2.0, 1e-4);
+
+    // Inside the bounding box, but next to a slanted face.
+    auto box = Box3D{Point3D{1.0, 0.0, 1.0}, Point3D{1.4, 0.2, 1.5}};
+    BOOST_CHECK(bg::intersects(frustum.bounding_box(), box));
+    BOOST_CHECK(!frustum.intersects(box));
+    BOOST_CHECK(frustum.intersects(Box3D{Point3D{1.0, 0.0, 2.5}, Point3D{1.4, 0.2, 3.0}}));
+
+    BOOST_CHECK(frustum.intersects(Sphere{Point3D{0.0, 0.0, 4.0}, 1.01}));
+    BOOST_CHECK(!frustum.intersects(Sphere{Point3D{0.0, 0.0, 4.0}, 0.99}));
+
+    BOOST_CHECK(frustum.intersects(Cylinder{Point3D{-5.0, 0.0, 2.0}, Point3D{5.0, 0.0, 2.0}, 0.0}));
+    BOOST_CHECK(frustum.intersects(Cylinder{Point3D{-5.0, 0.0, 0.5}, Point3D{5.0, 0.0, 0.5}, 0.51}));
+    BOOST_CHECK(!frustum.intersects(Cylinder{Point3D{-5.0, 0.0, 0.5}, Point3D{5.0, 0.0, 0.5}, 0.49}));
+
+    BOOST_CHECK(strictly_contains(frustum, Box3D{Point3D{-0.1, -0.1, 1.5}, Point3D{0.1, 0.1, 2.5}}));
+    BOOST_CHECK(!strictly_contains(frustum, box));
+
+    // Three planes meet in a single point; and two opposite ones don't bound anything.
+    BOOST_CHECK_THROW(ConvexPolytope(std::vector<HalfSpace>{
+                          HalfSpace{Point3D{1.0, 0.0, 0.0}, 1.0},
+                          HalfSpace{Point3D{0.0, 1.0, 0.0}, 1.0},
+                          HalfSpace{Point3D{0.0, 0.0, 1.0}, 1.0}}),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(ConvexPolytope(std::vector<HalfSpace>{
+                          HalfSpace{Point3D{1.0, 0.0, 0.0}, 1.0},
+                          HalfSpace{Point3D{-1.0, 0.0, 0.0}, 1.0}}),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(OrientedBoxAgreesWithPolytope) {
+    // Both shapes implement the same tests independently; the oriented box
+    // in its local coordinates, the polytope by its faces and edges.
+    auto gen = std::mt19937(0);
+    auto pos = std::uniform_real_distribution<CoordType>(-3.0, 3.0);
+    auto size = std::uniform_real_distribution<CoordType>(0.05, 1.0);
+
+    size_t n_hits = 0;
+    size_t n_disagree = 0;
+    for(size_t i = 0; i < 100; ++i) {
+        auto obb = random_oriented_box(gen);
+        auto polytope = ConvexPolytope(obb);
+        BOOST_REQUIRE_EQUAL(polytope.vertices().size(), 8);
+
+        for(size_t j = 0; j < 50; ++j) {
+            auto p = Point3D{pos(gen), pos(gen), pos(gen)};
+            auto q = Point3D{pos(gen), pos(gen), pos(gen)};
+            auto r = size(gen);
+
+            auto box = Box3D{Point3Dx(p) - r, Point3Dx(p) + r};
+            auto sphere = Sphere{p, r};
+            auto cylinder = Cylinder{p, Point3Dx(p) + (Point3Dx(q) - p) * CoordType(0.3), r};
+
+            n_disagree += size_t(obb.intersects(box) != polytope.intersects(box));
+            n_disagree += size_t(obb.intersects(sphere) != polytope.intersects(sphere));
+            n_disagree += size_t(obb.intersects(cylinder) != polytope.intersects(cylinder));
+            n_disagree += size_t(obb.contains(p) != polytope.contains(p));
+            n_disagree += size_t(strictly_contains(obb, box) != strictly_contains(polytope, box));
+
+            n_hits += size_t(obb.intersects(box));
+
+            // No point of the box may be inside, unless they intersect.
+            if(!obb.intersects(box)) {
+                for(auto t : {0.0f, 0.5f, 1.0f}) {
+                    auto x = Point3Dx(box.min_corner()) + (Point3Dx(box.max_corner()) - box.min_corner()) * t;
+                    BOOST_CHECK(!obb.contains(x));
+                }
+            }
+        }
+    }
+
+    BOOST_CHECK(n_hits > 100);
+    BOOST_CHECK_EQUAL(n_disagree, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+///
+/// Voxel masks
+///
+BOOST_AUTO_TEST_SUITE(VoxelMasks)
+
+BOOST_AUTO_TEST_CASE(VoxelMaskSelectedCases) {
+    // Two voxels of size (1, 2, 4): (0, 0, 0) and (2, 1, 0).
+    auto shape = VoxelMask::shape_type{3, 2, 1};
+    auto bits = std::vector<std::uint8_t>{1, 0, 0, 0, 0, 1};
+    auto mask = VoxelMask(Point3D{0.0, 0.0, 0.0}, Point3D{1.0, 2.0, 4.0}, shape, bits.data());
+
+    BOOST_CHECK(mask.is_set(0, 0, 0));
+    BOOST_CHECK(!mask.is_set(1, 0, 0));
+    BOOST_CHECK(mask.is_set(2, 1, 0));
+    BOOST_CHECK(bg::equals(mask.bounding_box(), Box3D{Point3D{0.0, 0.0, 0.0}, Point3D{3.0, 4.0, 4.0}}));
+
+    BOOST_CHECK(mask.contains(Point3D{0.5, 1.0, 2.0}));
+    BOOST_CHECK(!mask.contains(Point3D{1.5, 1.0, 2.0}));
+    BOOST_CHECK(!mask.contains(Point3D{-0.5, 1.0, 2.0}));
+    BOOST_CHECK(mask.contains(Point3D{2.5, 3.0, 1.0}));
+
+    BOOST_CHECK_EQUAL(mask.count(Box3D{Point3D{-1.0, -1.0, -1.0}, Point3D{5.0, 5.0, 5.0}}), 2);
+    BOOST_CHECK_EQUAL(mask.count(Box3D{Point3D{1.1, 0.1, 0.1}, Point3D{1.9, 1.9, 3.9}}), 0);
+    BOOST_CHECK(!mask.intersects(Box3D{Point3D{1.1, 0.1, 0.1}, Point3D{1.9, 1.9, 3.9}}));
+
+    BOOST_CHECK(mask.covers(Box3D{Point3D{0.1, 0.1, 0.1}, Point3D{0.9, 1.9, 3.9}}));
+    BOOST_CHECK(!mask.covers(Box3D{Point3D{0.1, 0.1, 0.1}, Point3D{1.9, 1.9, 3.9}}));
+    BOOST_CHECK(!mask.covers(Box3D{Point3D{-0.1, 0.1, 0.1}, Point3D{0.9, 1.9, 3.9}}));
+
+    // The sphere's bounding box touches the set voxel, the sphere doesn't.
+    auto sphere = Sphere{Point3D{1.6, 1.6, 2.0}, 0.5};
+    BOOST_CHECK(mask.intersects(sphere.bounding_box()));
+    BOOST_CHECK(!mask.intersects(sphere));
+    BOOST_CHECK(mask.intersects(Sphere{Point3D{1.9, 2.6, 2.0}, 0.2}));
+
+    BOOST_CHECK(mask.intersects(Cylinder{Point3D{1.5, 1.0, 2.0}, Point3D{2.5, 3.0, 2.0}, 0.1}));
+    BOOST_CHECK(!mask.intersects(Cylinder{Point3D{1.5, 1.0, 2.0}, Point3D{1.5, 3.0, 2.0}, 0.1}));
+
+    BOOST_CHECK_THROW(VoxelMask(Point3D{0.0, 0.0, 0.0}, Point3D{1.0, 0.0, 1.0}, shape, bits.data()),
+                      std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(VoxelMaskAgreesWithVoxels) {
+    // Compares the summed-volume table to testing each voxel.
+    auto gen = std::mt19937(0);
+    auto bit = std::bernoulli_distribution(0.3);
+    auto pos = std::uniform_real_distribution<CoordType>(-1.0, 6.0);
+    auto size = std::uniform_real_distribution<CoordType>(0.05, 1.5);
+
+    auto shape = VoxelMask::shape_type{5, 6, 7};
+    auto bits = std::vector<std::uint8_t>(5 * 6 * 7);
+    std::generate(bits.begin(), bits.end(), [&]() { return std::uint8_t(bit(gen)); });
+
+    auto origin = Point3D{0.5, -0.5, 0.0};
+    auto voxel_size = Point3D{1.0, 0.75, 0.5};
+    auto mask = VoxelMask(origin, voxel_size, shape, bits.data());
+
+    auto voxel_boxes = std::vector<Box3D>{};
+    for(size_t i = 0; i < shape[0]; ++i) {
+        for(size_t j = 0; j < shape[1]; ++j) {
+            for(size_t k = 0; k < shape[2]; ++k) {
+                BOOST_REQUIRE_EQUAL(mask.is_set(i, j, k), bits[(i * shape[1] + j) * shape[2] + k] != 0);
+                if(mask.is_set(i, j, k)) {
+                    auto low = Point3Dx(origin) + Point3Dx(voxel_size) * Point3D{CoordType(i), CoordType(j), CoordType(k)};
+                    voxel_boxes.emplace_back(low, low + voxel_size);
+                }
+            }
+        }
+    }
+
+    // Like the index, only voxels which touch the bounding box are considered;
+    // this matters for cylinders, which are tested as capsules.
+    auto any_voxel = [&voxel_boxes](const auto& shape) {
+        return std::any_of(voxel_boxes.begin(), voxel_boxes.end(), [&shape](const auto& voxel) {
+            return bg::intersects(shape.bounding_box(), voxel) && shape.intersects(voxel);
+        });
+    };
+
+    size_t n_hits = 0;
+    size_t n_covered = 0;
+    for(size_t i = 0; i < 1000; ++i) {
+        auto p = Point3D{pos(gen), pos(gen), pos(gen)};
+        auto q = Point3D{pos(gen), pos(gen), pos(gen)};
+        auto r = size(gen);
+
+        auto box = Box3D{Point3Dx(p) - r, Point3Dx(p) + r};
+        auto sphere = Sphere{p, r};
+        auto cylinder = Cylinder{p, Point3Dx(p) + (Point3Dx(q) - p) * CoordType(0.3), r};
+
+        auto box_hit = std::any_of(voxel_boxes.begin(), voxel_boxes.end(), [&box](const auto& voxel) {
+            return bg::intersects(box, voxel);
+        });
+
+        BOOST_CHECK_EQUAL(mask.intersects(box), box_hit);
+        BOOST_CHECK_EQUAL(mask.intersects(sphere), any_voxel(sphere));
+        BOOST_CHECK_EQUAL(mask.intersects(cylinder), any_voxel(cylinder));
+
+        // Any box covered by the mask is inside some set voxels.
+        if(mask.covers(box)) {
+            n_covered += 1;
+            BOOST_CHECK(mask.contains(box.min_corner()));
+            BOOST_CHECK(mask.contains(p));
+        }
+
+        n_hits += size_t(mask.intersects(sphere));
+    }
+
+    BOOST_CHECK(n_hits > 100);
+    BOOST_CHECK(n_covered > 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
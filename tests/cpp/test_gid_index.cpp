@@ -0,0 +1,162 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+#include <brain_indexer/gid_index.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+#include "synthetic_cells.hpp"
+
+using namespace brain_indexer;
+
+
+/// The soma is `(0, 0)`, the segments are `(section_id, 1 + segment_id)`.
+static std::vector<std::pair<unsigned, unsigned>>
+sorted_segment_ids(const std::vector<MorphoEntry>& entries) {
+    auto ids = std::vector<std::pair<unsigned, unsigned>>{};
+    for(const auto& entry : entries) {
+        const auto* segment = boost::get<Segment>(&entry);
+        if(segment == nullptr) {
+            ids.emplace_back(0u, 0u);
+        } else {
+            ids.emplace_back(segment->section_id(), segment->segment_id() + 1);
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    return ids;
+}
+
+template <class Index>
+static void check_get_by_gid(const Index& index,
+                             const GidIndex& gid_index,
+                             const std::vector<MorphoEntry>& all_cells,
+                             identifier_t n_gids) {
+    BOOST_CHECK_EQUAL(gid_index.n_gids(), n_gids);
+
+    size_t n_split = 0;
+    for(identifier_t gid = 0; gid < n_gids; ++gid) {
+        auto expected = std::vector<MorphoEntry>{};
+        std::copy_if(all_cells.begin(), all_cells.end(), std::back_inserter(expected),
+                     [gid](const MorphoEntry& e) { return element_gid(e) == gid; });
+
+        auto actual = get_by_gid(index, gid_index, gid);
+        BOOST_CHECK(std::all_of(actual.begin(), actual.end(),
+                                [gid](const MorphoEntry& e) { return element_gid(e) == gid; }));
+        BOOST_CHECK(sorted_segment_ids(actual) == sorted_segment_ids(expected));
+
+        n_split += gid_index.subtree_ids(gid).size() > 1;
+    }
+
+    // Some cells span several subtrees.
+    BOOST_CHECK(n_split > 0);
+
+    BOOST_CHECK(get_by_gid(index, gid_index, n_gids + 10).empty());
+}
+
+template <class Storage>
+static void check_gid_index(const std::string& output_dir) {
+    using Index = MultiIndexTree<MorphoEntry, UsageRateCache<Storage>>;
+
+    auto comm_rank = mpi::rank(MPI_COMM_WORLD);
+    auto comm_size = mpi::size(MPI_COMM_WORLD);
+    auto n_cells = identifier_t(50);
+
+    // Every rank knows the cells of all ranks.
+    auto all_cells = std::vector<MorphoEntry>{};
+    for(int rank = 0; rank < comm_size; ++rank) {
+        auto cells = synthetic_cells(identifier_t(rank) * n_cells, n_cells, 0);
+        all_cells.insert(all_cells.end(), cells.begin(), cells.end());
+    }
+    auto n_gids = identifier_t(comm_size) * n_cells;
+
+    auto cells = synthetic_cells(identifier_t(comm_rank) * n_cells, n_cells, 0);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry, Storage>(output_dir);
+    builder.insert(cells.begin(), cells.end());
+    builder.finalize(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        BOOST_CHECK(!has_gid_index(output_dir));
+        BOOST_CHECK_THROW(open_gid_index(output_dir), std::runtime_error);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    write_gid_index<MorphoEntry, Storage>(output_dir, MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        BOOST_CHECK(has_gid_index(output_dir));
+
+        auto index = Index(output_dir, /* mem = */ size_t(1e6));
+        check_get_by_gid(index, open_gid_index(output_dir), all_cells, n_gids);
+
+        // The serial build results in the same index.
+        write_gid_index<MorphoEntry, Storage>(output_dir);
+        check_get_by_gid(index, open_gid_index(output_dir), all_cells, n_gids);
+
+        // Appending invalidates the gid index.
+        append_to_multi_index<MorphoEntry, Storage>(output_dir, synthetic_cells(n_gids, 1, 0));
+        BOOST_CHECK(!has_gid_index(output_dir));
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(GidIndexNativeStorage) {
+    check_gid_index<NativeStorageT<MorphoEntry>>("tmp-gid-index-n2k8f");
+}
+
+BOOST_AUTO_TEST_CASE(GidIndexMemoryMappedStorage) {
+    check_gid_index<MemoryMappedStorageT<MorphoEntry>>("tmp-gid-index-m5x1q");
+}
+
+BOOST_AUTO_TEST_CASE(GidIndexReadWrite) {
+    auto runs = std::vector<GidIndexRun>{
+        {7, GidIndexEntry{2, 10, 4, 6, Box3D{{0, 0, 0}, {1, 1, 1}}}},
+        {3, GidIndexEntry{1, 10, 0, 2, Box3D{{0, 0, 0}, {1, 1, 1}}}},
+        {7, GidIndexEntry{1, 10, 8, 9, Box3D{{0, 0, 0}, {1, 1, 1}}}},
+    };
+    auto gid_index = GidIndex(runs);
+
+    BOOST_CHECK_EQUAL(gid_index.n_gids(), 2);
+    BOOST_CHECK_EQUAL(gid_index.n_entries(), 3);
+    BOOST_CHECK(gid_index.subtree_ids(7) == (std::vector<size_t>{1, 2}));
+    BOOST_CHECK(gid_index.subtree_ids(5).empty());
+
+    if(mpi::rank(MPI_COMM_WORLD) == 0) {
+        auto filename = std::string("tmp-gid-index-k9w3z.bin");
+        gid_index.write(filename);
+
+        auto read_index = GidIndex::read(filename);
+        BOOST_CHECK_EQUAL(read_index.n_gids(), 2);
+        auto [first, last] = read_index.entries(7);
+        BOOST_REQUIRE_EQUAL(last - first, 2);
+        BOOST_CHECK_EQUAL(first[0].subtree_id, 1);
+        BOOST_CHECK_EQUAL(first[1].first, 4);
+
+        util::open_ofstream(filename, std::ios::binary | std::ios::trunc) << "not a gid index";
+        BOOST_CHECK_THROW(GidIndex::read(filename), std::runtime_error);
+
+        std::filesystem::remove(filename);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,162 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <tuple>
+#include <vector>
+
+#include <brain_indexer/level_of_detail.hpp>
+#include <brain_indexer/multi_index.hpp>
+
+#include "synthetic_cells.hpp"
+
+using namespace brain_indexer;
+
+using ElementKey = std::tuple<identifier_t, unsigned, unsigned>;
+
+
+static ElementKey element_key(const MorphoEntry& entry) {
+    if(const auto* segment = boost::get<Segment>(&entry)) {
+        return {segment->gid(), segment->section_id(), segment->segment_id() + 1};
+    }
+
+    return {boost::get<Soma>(entry).gid(), 0, 0};
+}
+
+template <class Elements>
+static std::vector<ElementKey> sorted_keys(const Elements& elements) {
+    auto keys = std::vector<ElementKey>{};
+    std::transform(elements.begin(), elements.end(), std::back_inserter(keys),
+                   [](const MorphoEntry& e) { return element_key(e); });
+    std::sort(keys.begin(), keys.end());
+
+    return keys;
+}
+
+static size_t total_count(const LevelOfDetail<MorphoEntry>& lod) {
+    size_t count = lod.values.size();
+    for(const auto& node : lod.nodes) {
+        count += node.count;
+    }
+
+    return count;
+}
+
+/// The elements are returned as is if there are at most `expected.size() + slack`.
+template <class Index>
+static void check_level_of_detail(const Index& index, size_t n_elements, size_t slack) {
+    auto box = Box3D{{20.0, 20.0, 20.0}, {70.0, 70.0, 70.0}};
+    auto expected = sorted_keys(index.find_intersecting_objs(box));
+
+    // Everything fits: the result is that of `find_intersecting`.
+    auto exact = find_level_of_detail(index, box, expected.size() + slack);
+    BOOST_CHECK(exact.nodes.empty());
+    BOOST_CHECK(sorted_keys(exact.values) == expected);
+
+    // One less doesn't fit.
+    for(size_t max_results : {expected.size() - 1, size_t(200), size_t(20), size_t(1)}) {
+        auto lod = find_level_of_detail(index, box, max_results);
+        BOOST_CHECK(lod.size() <= max_results);
+        BOOST_CHECK(lod.size() > 0);
+        BOOST_CHECK(total_count(lod) >= expected.size());
+
+        for(const auto& node : lod.nodes) {
+            BOOST_CHECK(bg::intersects(node.bounds, box));
+            BOOST_CHECK(bg::covered_by(node.centroid, node.bounds));
+        }
+    }
+
+    BOOST_CHECK_EQUAL(find_level_of_detail(index, box, 0).size(), 0);
+    auto outside = Box3D{{200.0, 200.0, 200.0}, {300.0, 300.0, 300.0}};
+    BOOST_CHECK_EQUAL(find_level_of_detail(index, outside, 10).size(), 0);
+
+    // The summaries of the whole index count every element once, on any level.
+    for(size_t max_results : {size_t(5), size_t(100)}) {
+        auto everything = find_level_of_detail(index, index.bounds(), max_results);
+        BOOST_CHECK(!everything.nodes.empty());
+        BOOST_CHECK(everything.size() <= max_results);
+        BOOST_CHECK_EQUAL(total_count(everything), n_elements);
+    }
+
+    auto sphere = Sphere{{50.0, 50.0, 50.0}, 10.0};
+    auto expected_sphere = sorted_keys(
+        index.template find_intersecting_objs<BestEffortGeometry>(sphere)
+    );
+    auto exact_sphere = find_level_of_detail<BestEffortGeometry>(
+        index, sphere, expected_sphere.size() + slack
+    );
+    BOOST_CHECK(sorted_keys(exact_sphere.values) == expected_sphere);
+}
+
+
+BOOST_AUTO_TEST_CASE(LevelOfDetailIndexTree) {
+    auto elements = synthetic_cells(0, 100, 0);
+    check_level_of_detail(IndexTree<MorphoEntry>(elements), elements.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(LevelOfDetailPackedIndexTree) {
+    auto elements = synthetic_cells(0, 100, 1);
+    check_level_of_detail(PackedIndexTree<MorphoEntry>(elements.begin(), elements.end()),
+                          elements.size(),
+                          0);
+    check_level_of_detail(PackedIndexTree<MorphoEntry>(elements.begin(),
+                                                       elements.end(),
+                                                       PackedLeafFormat::compact),
+                          elements.size(),
+                          0);
+}
+
+template <class Storage>
+static void check_multi_index_level_of_detail(const std::string& output_dir) {
+    auto elements = synthetic_cells(0, 100, 2);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(elements.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry, Storage>(output_dir);
+    builder.insert(elements.begin() + long(range.low), elements.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        using Index = MultiIndexTree<MorphoEntry, UsageRateCache<Storage>>;
+        auto index = Index(output_dir, size_t(1) << 30);
+
+        // A budget of all elements plus one per subtree is always enough.
+        check_level_of_detail(index, elements.size(), elements.size() + 1000);
+
+        // Fewer results than subtrees: only the top tree is summarized.
+        auto top_level = find_level_of_detail(index, index.bounds(), 1);
+        BOOST_CHECK(top_level.values.empty());
+        BOOST_CHECK_EQUAL(top_level.nodes.size(), 1);
+        BOOST_CHECK_EQUAL(top_level.nodes[0].count, elements.size());
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LevelOfDetailMultiIndex) {
+    check_multi_index_level_of_detail<NativeStorageT<MorphoEntry>>("tmp-level-of-detail-q4m8c");
+    check_multi_index_level_of_detail<MemoryMappedStorageT<MorphoEntry>>(
+        "tmp-level-of-detail-z7r2k"
+    );
+    check_multi_index_level_of_detail<CompactMemoryMappedStorageT<MorphoEntry>>(
+        "tmp-level-of-detail-h3v9w"
+    );
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,142 @@
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <brain_indexer/logging.hpp>
+
+using namespace brain_indexer;
+
+
+/// Counts how often it's formatted.
+struct CountedArgument {
+    mutable size_t n_formatted = 0;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const CountedArgument& arg) {
+    ++arg.n_formatted;
+    return os << "counted";
+}
+
+/// Collects the messages it receives; and restores the default callback.
+struct CollectedMessages {
+    CollectedMessages() {
+        register_logging_callback([this](LogSeverity, const std::string& message) {
+            messages.push_back(message);
+        });
+    }
+
+    ~CollectedMessages() {
+        register_logging_callback(&default_logging_callback);
+    }
+
+    std::vector<std::string> messages;
+};
+
+
+BOOST_AUTO_TEST_CASE(LazyFormatting) {
+    auto collected = CollectedMessages{};
+    auto initial_severity = get_global_minimum_log_severity();
+    auto arg = CountedArgument{};
+
+    set_global_minimum_log_severity(LogSeverity::WARN);
+    log_info("skipped: %s %d", arg, 42);
+    log_warn("logged: %s %d", arg, 42);
+    log_error("plain");
+    set_global_minimum_log_severity(initial_severity);
+
+    BOOST_CHECK_EQUAL(arg.n_formatted, 1);
+    BOOST_CHECK(collected.messages == std::vector<std::string>({"logged: counted 42", "plain"}));
+}
+
+
+BOOST_AUTO_TEST_CASE(AsyncLogSinkPassesOnAll) {
+    auto mutex = std::mutex{};
+    auto messages = std::vector<std::string>{};
+    auto sink = AsyncLogSink(
+        [&](LogSeverity, const std::string& message) {
+            auto lock = std::lock_guard<std::mutex>(mutex);
+            messages.push_back(message);
+        },
+        /* capacity = */ 4096
+    );
+
+    size_t n_threads = 4;
+    size_t n_messages = 500;
+    auto threads = std::vector<std::thread>{};
+    for(size_t t = 0; t < n_threads; ++t) {
+        threads.emplace_back([&sink, t, n_messages]() {
+            for(size_t i = 0; i < n_messages; ++i) {
+                sink.push(LogSeverity::INFO, std::to_string(t * n_messages + i));
+            }
+        });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+    sink.flush();
+
+    BOOST_CHECK_EQUAL(sink.n_dropped(), 0);
+    BOOST_REQUIRE_EQUAL(messages.size(), n_threads * n_messages);
+
+    // Every message arrives once; the messages of one thread in order.
+    auto last = std::vector<long>(n_threads, -1);
+    for(const auto& message : messages) {
+        auto k = std::stoul(message);
+        auto t = k / n_messages;
+        BOOST_CHECK(long(k % n_messages) == last[t] + 1);
+        last[t] = long(k % n_messages);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(AsyncLogSinkDropsWhenFull) {
+    auto is_blocked = std::atomic<bool>(true);
+    auto n_received = std::atomic<size_t>(0);
+
+    size_t n_messages = 100;
+    size_t n_dropped = 0;
+    {
+        auto sink = AsyncLogSink(
+            [&](LogSeverity, const std::string&) {
+                while(is_blocked.load()) {
+                    std::this_thread::yield();
+                }
+                ++n_received;
+            },
+            /* capacity = */ 4
+        );
+
+        for(size_t i = 0; i < n_messages; ++i) {
+            sink.push(LogSeverity::WARN, "message");
+        }
+        is_blocked.store(false);
+        sink.flush();
+        n_dropped = sink.n_dropped();
+    }
+
+    BOOST_CHECK(n_dropped > 0);
+    BOOST_CHECK_EQUAL(n_received.load() + n_dropped, n_messages);
+}
+
+
+BOOST_AUTO_TEST_CASE(RegisterAsyncLoggingCallback) {
+    auto messages = std::vector<std::string>{};
+    auto sink = register_async_logging_callback(
+        [&messages](LogSeverity, const std::string& message) { messages.push_back(message); }
+    );
+
+    log_warn("first");
+    log_warn("second: %d", 2);
+    flush_logs();
+
+    BOOST_CHECK(messages == std::vector<std::string>({"first", "second: 2"}));
+    BOOST_CHECK_EQUAL(sink->n_dropped(), 0);
+
+    register_logging_callback(&default_logging_callback);
+}
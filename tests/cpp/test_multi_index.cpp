@@ -3,11 +3,17 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <memory>
 #include <random>
+#include <thread>
 
 #include <brain_indexer/multi_index.hpp>
 #include <brain_indexer/distributed_sorting.hpp>
+#include <brain_indexer/node_shared_cache.hpp>
 
 using namespace brain_indexer;
 
@@ -20,8 +26,11 @@ struct SubtreeState {
 
 
 struct MockRTree {
+    using value_type = size_t;
+
     MockRTree() = default;
     MockRTree(const MockRTree &) = default;
+    MockRTree(MockRTree &&) = default;
 
     MockRTree(std::shared_ptr<SubtreeState> subtree_state, size_t subtree_id)
         : subtree_id(subtree_id),
@@ -112,9 +121,683 @@ BOOST_AUTO_TEST_CASE(MultiIndexLoad) {
 }
 
 
+BOOST_AUTO_TEST_CASE(ShardedCacheLoad) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->n_elements[42ul] = 4ul;
+    subtree_state->n_elements[24ul] = 7ul;
+    subtree_state->n_elements[30ul] = 9ul;
+    subtree_state->n_elements[0ul] = 1ul;
+
+    auto params = UsageRateCacheParams(20ul);
+    auto storage = MockStorage(subtree_state);
+
+    auto cache = ShardedUsageRateCache<MockStorage>(params, storage, /* n_shards = */ 3);
+
+    cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ 0ul);
+    BOOST_TEST((*subtree_state).n_loaded[42ul] == 1ul);
+
+    cache.load_subtree(SubtreeID{24ul, 7ul}, /* query_count */ 10ul);
+    cache.load_subtree(SubtreeID{24ul, 7ul}, /* query_count */ 11ul);
+    BOOST_TEST((*subtree_state).n_loaded[24ul] == 1ul);
+
+    // Handles keep evicted subtrees alive.
+    auto handle = cache.load_subtree(SubtreeID{30ul, 9ul}, /* query_count */ 20ul);
+    BOOST_TEST((*subtree_state).n_loaded[30ul] == 1ul);
+    BOOST_TEST(cache.cached_elements() == 20ul);
+
+    cache.load_subtree(SubtreeID{0ul, 1ul}, /* query_count */ 21ul);
+    BOOST_TEST((*subtree_state).n_evicted[42ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[24ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_evicted[30ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_loaded[0ul] == 1ul);
+    BOOST_TEST(cache.cached_elements() == 17ul);
+}
+
+
+BOOST_AUTO_TEST_CASE(CacheEvictsLowestUsageRates) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t i = 0; i <= 10; ++i) {
+        subtree_state->n_elements[i] = 1ul;
+    }
+
+    auto params = UsageRateCacheParams(10ul);
+    params.max_evict = 3;
+    auto cache = UsageRateCache(params, MockStorage(subtree_state));
+
+    // Older subtrees have lower usage rates, unless they're queried again.
+    for(size_t i = 0; i < 10; ++i) {
+        cache.load_subtree(SubtreeID{i, 1ul}, /* query_count */ i);
+    }
+    for(size_t k = 0; k < 2; ++k) {
+        for(size_t i = 0; i < 5; ++i) {
+            cache.load_subtree(SubtreeID{i, 1ul}, /* query_count */ 10ul);
+        }
+    }
+
+    cache.load_subtree(SubtreeID{10ul, 1ul}, /* query_count */ 11ul);
+    for(size_t i = 0; i <= 10; ++i) {
+        bool is_evicted = i >= 5 && i <= 7;
+        BOOST_TEST((*subtree_state).n_evicted[i] == size_t(is_evicted));
+        BOOST_TEST(cache.is_cached(i) == !is_evicted);
+    }
+}
+
+
+static UsageRateCache<MockStorage>
+make_single_element_cache(std::shared_ptr<SubtreeState> subtree_state,
+                          EvictionPolicyKind eviction_policy) {
+    for(size_t i = 0; i < 10; ++i) {
+        subtree_state->n_elements[i] = 1ul;
+    }
+
+    auto params = UsageRateCacheParams(3ul);
+    params.eviction_policy = eviction_policy;
+    return UsageRateCache(params, MockStorage(std::move(subtree_state)));
+}
+
+
+BOOST_AUTO_TEST_CASE(CacheEvictsLeastRecentlyUsed) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    auto cache = make_single_element_cache(subtree_state, EvictionPolicyKind::lru);
+
+    for(size_t i = 0; i < 3; ++i) {
+        cache.load_subtree(SubtreeID{i, 1ul}, /* query_count */ i);
+    }
+    cache.load_subtree(SubtreeID{0ul, 1ul}, /* query_count */ 3ul);
+
+    cache.load_subtree(SubtreeID{3ul, 1ul}, /* query_count */ 4ul);
+    BOOST_TEST((*subtree_state).n_evicted[1ul] == 1ul);
+
+    cache.load_subtree(SubtreeID{2ul, 1ul}, /* query_count */ 5ul);
+    cache.load_subtree(SubtreeID{4ul, 1ul}, /* query_count */ 6ul);
+    BOOST_TEST((*subtree_state).n_evicted[0ul] == 1ul);
+    BOOST_TEST(cache.is_cached(2ul));
+    BOOST_TEST(cache.is_cached(3ul));
+    BOOST_TEST(cache.is_cached(4ul));
+}
+
+
+BOOST_AUTO_TEST_CASE(CacheEvictsWithClock) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    auto cache = make_single_element_cache(subtree_state, EvictionPolicyKind::clock);
+
+    for(size_t i = 0; i < 3; ++i) {
+        cache.load_subtree(SubtreeID{i, 1ul}, /* query_count */ i);
+    }
+
+    // All subtrees are referenced; the hand clears them and returns to `0`.
+    cache.load_subtree(SubtreeID{3ul, 1ul}, /* query_count */ 3ul);
+    BOOST_TEST((*subtree_state).n_evicted[0ul] == 1ul);
+
+    // `1` was queried again and gets a second chance.
+    cache.load_subtree(SubtreeID{1ul, 1ul}, /* query_count */ 4ul);
+    cache.load_subtree(SubtreeID{4ul, 1ul}, /* query_count */ 5ul);
+    BOOST_TEST((*subtree_state).n_evicted[1ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_evicted[2ul] == 1ul);
+    BOOST_TEST(cache.is_cached(1ul));
+    BOOST_TEST(cache.is_cached(3ul));
+    BOOST_TEST(cache.is_cached(4ul));
+}
+
+
+BOOST_AUTO_TEST_CASE(CostAwarePolicyKeepsExpensiveSubtrees) {
+    auto policy = CostAwareEvictionPolicy{};
+    auto meta_data = EvictionMetaData{};
+    auto victims = std::vector<size_t>{};
+
+    // Cost per byte: 1e-2, 1e-4 and 1e-3.
+    policy.on_load(0ul, 100ul, 1.0, /* query_count */ 0ul);
+    policy.on_load(1ul, 100ul, 0.01, /* query_count */ 1ul);
+    policy.on_load(2ul, 10ul, 0.01, /* query_count */ 2ul);
+
+    policy.select_victims(meta_data, /* query_count */ 3ul, 1ul, victims);
+    BOOST_TEST(victims == std::vector<size_t>{1ul});
+
+    // Without a measurement the cost is the average per byte, 1.02 / 210.
+    policy.on_load(3ul, 100ul, std::nullopt, /* query_count */ 3ul);
+
+    victims.clear();
+    policy.select_victims(meta_data, /* query_count */ 4ul, 2ul, victims);
+    BOOST_TEST(victims == (std::vector<size_t>{2ul, 3ul}));
+}
+
+
+BOOST_AUTO_TEST_CASE(EvictionPolicyFromString) {
+    BOOST_TEST((eviction_policy_from_string("usage_rate") == EvictionPolicyKind::usage_rate));
+    BOOST_TEST((eviction_policy_from_string("lru") == EvictionPolicyKind::lru));
+    BOOST_TEST((eviction_policy_from_string("clock") == EvictionPolicyKind::clock));
+    BOOST_TEST((eviction_policy_from_string("cost_aware") == EvictionPolicyKind::cost_aware));
+    BOOST_CHECK_THROW(eviction_policy_from_string("fifo"), std::invalid_argument);
+
+    auto params = UsageRateCacheParams(3ul);
+    params.eviction_policy = EvictionPolicyKind::lru;
+    auto storage = MockStorage(std::make_shared<SubtreeState>());
+    BOOST_CHECK_THROW(ShardedUsageRateCache<MockStorage>(params, storage), std::invalid_argument);
+}
+
+
+template <class Cache>
+static void check_cached_bytes_budget() {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->n_elements[42ul] = 4ul;
+    subtree_state->n_elements[24ul] = 7ul;
+    subtree_state->n_elements[30ul] = 9ul;
+    subtree_state->n_elements[0ul] = 5ul;
+
+    auto n_bytes = [](size_t n_elements) {
+        return sizeof(MockRTree) + n_elements * sizeof(MockRTree::value_type);
+    };
+
+    // The size of a subtree is estimated before it's loaded. Hence, the
+    // budget has some slack.
+    auto params = UsageRateCacheParams::from_max_cached_bytes(
+        n_bytes(4) + n_bytes(7) + n_bytes(9) + n_bytes(1)
+    );
+    auto cache = Cache(params, MockStorage(subtree_state));
+
+    cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{42ul, 4ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{24ul, 7ul}, /* query_count */ 10ul);
+    cache.load_subtree(SubtreeID{24ul, 7ul}, /* query_count */ 11ul);
+    cache.load_subtree(SubtreeID{30ul, 9ul}, /* query_count */ 20ul);
+    BOOST_TEST(cache.cached_bytes() == n_bytes(4) + n_bytes(7) + n_bytes(9));
+    BOOST_TEST((*subtree_state).n_evicted[42ul] == 0ul);
+
+    cache.load_subtree(SubtreeID{0ul, 5ul}, /* query_count */ 21ul);
+    BOOST_TEST((*subtree_state).n_evicted[42ul] == 1ul);
+    BOOST_TEST((*subtree_state).n_evicted[24ul] == 0ul);
+    BOOST_TEST((*subtree_state).n_evicted[30ul] == 0ul);
+    BOOST_TEST(cache.cached_bytes() == n_bytes(7) + n_bytes(9) + n_bytes(5));
+}
+
+BOOST_AUTO_TEST_CASE(CacheBytesBudget) {
+    check_cached_bytes_budget<UsageRateCache<MockStorage>>();
+    check_cached_bytes_budget<ShardedUsageRateCache<MockStorage>>();
+}
+
+
+BOOST_AUTO_TEST_CASE(CountingAllocatorSubtrees) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(size_t i = 0; i < 1000; ++i) {
+        spheres.emplace_back(identifier_t(i), Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)}, 0.1f);
+    }
+
+    auto tree = MultiIndexSubTreeT<IndexedSphere>(spheres.begin(), spheres.end());
+    auto n_bytes = subtree_resident_bytes(tree);
+
+    // The nodes are at most sparsely filled, and there are inner nodes.
+    BOOST_TEST(n_bytes > spheres.size() * sizeof(IndexedSphere));
+
+    // Copies count their own allocations, moves take them along.
+    auto copy = tree;
+    BOOST_TEST(subtree_resident_bytes(copy) > spheres.size() * sizeof(IndexedSphere));
+    BOOST_TEST(subtree_resident_bytes(tree) == n_bytes);
+
+    auto moved = std::move(copy);
+    BOOST_TEST(subtree_resident_bytes(moved) == subtree_resident_bytes(tree));
+
+    tree.clear();
+    BOOST_TEST(subtree_resident_bytes(tree) == sizeof(tree));
+    BOOST_TEST(subtree_resident_bytes(moved) > spheres.size() * sizeof(IndexedSphere));
+}
+
+
+BOOST_AUTO_TEST_CASE(ArenaAllocatorSubtrees) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(size_t i = 0; i < 10000; ++i) {
+        spheres.emplace_back(identifier_t(i), Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)}, 0.1f);
+    }
+
+    auto tree = MultiIndexArenaSubTreeT<IndexedSphere>(spheres.begin(), spheres.end());
+    auto reference = MultiIndexSubTreeT<IndexedSphere>(spheres.begin(), spheres.end());
+
+    // The nodes are in a few blocks, instead of one allocation each.
+    const auto& arena = tree.get_allocator().arena();
+    BOOST_TEST(arena.n_blocks() < 10);
+    BOOST_TEST(subtree_resident_bytes(tree) > spheres.size() * sizeof(IndexedSphere));
+
+    auto box = Box3D{Point3D{-2.0, -2.0, -2.0}, Point3D{3.0, 3.0, 3.0}};
+    auto n_hits = [&box](const auto& t) {
+        return std::distance(t.qbegin(bgi::intersects(box)), t.qend());
+    };
+    BOOST_TEST(n_hits(tree) == n_hits(reference));
+
+    // Copies get their own arena, moves take it along.
+    auto copy = tree;
+    BOOST_TEST(&copy.get_allocator().arena() != &arena);
+    BOOST_TEST(n_hits(copy) == n_hits(reference));
+
+    auto moved = std::move(copy);
+    BOOST_TEST(subtree_resident_bytes(moved) > spheres.size() * sizeof(IndexedSphere));
+
+    // Loading creates the nodes in the arena of the loaded tree.
+    auto filename = std::string("tmp-arena-subtree-b8w1k.bin");
+    if(mpi::rank(MPI_COMM_WORLD) == 0) {
+        ArenaStorageT<IndexedSphere>::save_tree(tree, filename);
+        auto loaded = ArenaStorageT<IndexedSphere>::load_tree<MultiIndexArenaSubTreeT<IndexedSphere>>(
+            filename
+        );
+
+        BOOST_TEST(loaded.size() == spheres.size());
+        BOOST_TEST(loaded.get_allocator().arena().n_blocks() < 10);
+        BOOST_TEST(n_hits(loaded) == n_hits(reference));
+        std::filesystem::remove(filename);
+    }
+}
+
+
+class PackedMockStorage {
+  public:
+    using toptree_type = MultiIndexTopTreeT;
+    using subtree_type = PackedRTree<IndexedSphere>;
+
+  public:
+    explicit PackedMockStorage(std::shared_ptr<SubtreeState> subtree_state)
+        : subtree_state(std::move(subtree_state)) {}
+
+    subtree_type load_subtree(size_t subtree_id) const {
+        ++subtree_state->n_loaded[subtree_id];
+
+        auto spheres = std::vector<IndexedSphere>{};
+        for(size_t i = 0; i < subtree_state->n_elements[subtree_id]; ++i) {
+            auto x = CoordType(subtree_id);
+            spheres.emplace_back(identifier_t(100 * subtree_id + i), Point3D{x, 0., 0.}, 0.1f);
+        }
+
+        return subtree_type(spheres.begin(), spheres.end());
+    }
+
+  private:
+    std::shared_ptr<SubtreeState> subtree_state;
+};
+
+static size_t packed_subtree_bytes(const PackedRTree<IndexedSphere>& subtree) {
+    return detail::packed_rtree_align(subtree.n_nodes() * sizeof(PackedRTreeNode))
+           + subtree.size() * sizeof(IndexedSphere);
+}
+
+
+BOOST_AUTO_TEST_CASE(NodeSharedCacheSharesSubtrees) {
+    // Every rank runs this test on its own.
+    auto segment_name = "si-test-node-shared-cache-" + std::to_string(mpi::rank(MPI_COMM_WORLD));
+    NodeSharedCache<PackedMockStorage>::remove_segment(segment_name);
+
+    auto subtree_state = std::make_shared<SubtreeState>();
+    subtree_state->n_elements[0ul] = 50ul;
+    subtree_state->n_elements[1ul] = 50ul;
+
+    // Both caches stand in for different processes on the same node.
+    auto storage = PackedMockStorage(subtree_state);
+    auto cache = NodeSharedCache<PackedMockStorage>(segment_name, 1ul << 20, storage);
+    auto other = NodeSharedCache<PackedMockStorage>(segment_name, 1ul << 20, storage);
+
+    auto subtree = cache.load_subtree(SubtreeID{0ul, 50ul}, /* query_count */ 0ul);
+    auto shared = other.load_subtree(SubtreeID{0ul, 50ul}, /* query_count */ 0ul);
+    BOOST_TEST((*subtree_state).n_loaded[0ul] == 1ul);
+    BOOST_TEST(other.is_cached(0ul));
+    BOOST_TEST(!other.is_cached(1ul));
+    BOOST_TEST(shared.begin() != subtree.begin());
+    BOOST_TEST(shared.size() == 50ul);
+
+    auto ids = std::vector<identifier_t>{};
+    shared.query(bgi::intersects(Box3D{{-1., -1., -1.}, {1., 1., 1.}}), iter_ids_getter(ids));
+    std::sort(ids.begin(), ids.end());
+    BOOST_TEST(ids.size() == 50ul);
+    BOOST_TEST(ids.front() == 0ul);
+    BOOST_TEST(ids.back() == 49ul);
+
+    BOOST_TEST(cache.cached_bytes() == packed_subtree_bytes(subtree));
+    BOOST_TEST(other.cached_bytes() == cache.cached_bytes());
+
+    NodeSharedCache<PackedMockStorage>::remove_segment(segment_name);
+}
+
+
+BOOST_AUTO_TEST_CASE(NodeSharedCacheEvictsUnusedSubtrees) {
+    // Every rank runs this test on its own.
+    auto segment_name = "si-test-node-shared-eviction-" + std::to_string(mpi::rank(MPI_COMM_WORLD));
+    NodeSharedCache<PackedMockStorage>::remove_segment(segment_name);
+
+    auto subtree_state = std::make_shared<SubtreeState>();
+    for(size_t i = 0; i < 4; ++i) {
+        subtree_state->n_elements[i] = 50ul;
+    }
+
+    auto storage = PackedMockStorage(subtree_state);
+    auto n_bytes = packed_subtree_bytes(storage.load_subtree(0ul));
+    (*subtree_state).n_loaded[0ul] = 0ul;
+
+    auto cache = NodeSharedCache<PackedMockStorage>(segment_name, 2 * n_bytes, storage);
+
+    // Subtree `0` is the least recently used, but it's still in use.
+    auto pinned = cache.load_subtree(SubtreeID{0ul, 50ul}, /* query_count */ 0ul);
+    cache.load_subtree(SubtreeID{1ul, 50ul}, /* query_count */ 1ul);
+    cache.load_subtree(SubtreeID{2ul, 50ul}, /* query_count */ 2ul);
+    BOOST_TEST(cache.is_cached(0ul));
+    BOOST_TEST(!cache.is_cached(1ul));
+    BOOST_TEST(cache.is_cached(2ul));
+    BOOST_TEST(cache.cached_bytes() == 2 * n_bytes);
+
+    // If all subtrees are in use, the new one isn't shared.
+    auto also_pinned = cache.load_subtree(SubtreeID{2ul, 50ul}, /* query_count */ 3ul);
+    auto unshared = cache.load_subtree(SubtreeID{3ul, 50ul}, /* query_count */ 4ul);
+    BOOST_TEST(!cache.is_cached(3ul));
+    BOOST_TEST(unshared.size() == 50ul);
+
+    pinned = PackedRTree<IndexedSphere>{};
+    cache.load_subtree(SubtreeID{3ul, 50ul}, /* query_count */ 5ul);
+    BOOST_TEST(!cache.is_cached(0ul));
+    BOOST_TEST(cache.is_cached(3ul));
+    BOOST_TEST((*subtree_state).n_loaded[3ul] == 2ul);
+
+    NodeSharedCache<PackedMockStorage>::remove_segment(segment_name);
+}
+
+
+BOOST_AUTO_TEST_CASE(ShardedCacheConcurrentLoad) {
+    auto subtree_state = std::make_shared<SubtreeState>();
+    size_t n_subtrees = 64;
+    for(size_t i = 0; i < n_subtrees; ++i) {
+        subtree_state->n_elements[i] = 1ul;
+    }
+
+    auto params = UsageRateCacheParams(n_subtrees);
+    auto storage = MockStorage(subtree_state);
+    auto cache = ShardedUsageRateCache<MockStorage>(params, storage);
+
+    auto threads = std::vector<std::thread>{};
+    for(size_t k = 0; k < 8; ++k) {
+        threads.emplace_back([&cache, n_subtrees, k]() {
+            for(size_t i = 0; i < n_subtrees; ++i) {
+                auto id = (i + k) % n_subtrees;
+                auto handle = cache.load_subtree(SubtreeID{id, 1ul}, /* query_count */ i);
+                BOOST_REQUIRE(handle != nullptr);
+            }
+        });
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    // The map of `SubtreeState` isn't thread-safe; therefore all entries were
+    // created upfront, and only the values are modified.
+    for(size_t i = 0; i < n_subtrees; ++i) {
+        BOOST_TEST((*subtree_state).n_loaded[i] == 1ul);
+    }
+    BOOST_TEST(cache.cached_elements() == n_subtrees);
+}
+
+
+/// Writes `n_subtrees` subtrees of `n_elements` spheres; subtree `k` covers `[k, k+1)`.
+static NativeStorageT<IndexedSphere> write_sphere_subtrees(const std::string& index_dir,
+                                                           size_t n_subtrees,
+                                                           size_t n_elements) {
+    std::filesystem::create_directories(index_dir);
+    auto storage = NativeStorageT<IndexedSphere>(index_dir);
+    auto boxes = std::vector<IndexedSubtreeBox>{};
+    for(size_t k = 0; k < n_subtrees; ++k) {
+        auto spheres = std::vector<IndexedSphere>{};
+        for(size_t i = 0; i < n_elements; ++i) {
+            auto x = CoordType(k) + CoordType(i) / CoordType(n_elements);
+            spheres.emplace_back(identifier_t(k * n_elements + i), Point3D{x, 0., 0.}, 0.01f);
+        }
+
+        auto subtree = MultiIndexSubTreeT<IndexedSphere>(spheres.begin(), spheres.end());
+        storage.save_subtree(subtree, k);
+        boxes.emplace_back(k, subtree.size(), subtree.bounds());
+    }
+    storage.save_top_tree(MultiIndexTopTreeT(boxes.begin(), boxes.end()));
+
+    return storage;
+}
+
+static Box3D unit_cell(size_t k) {
+    auto x = CoordType(k);
+    return Box3D{{x + 0.1f, -1.f, -1.f}, {x + 0.9f, 1.f, 1.f}};
+}
+
+static std::vector<size_t> sorted(std::vector<size_t> ids) {
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+
+BOOST_AUTO_TEST_CASE(WarmUpFromHotSet) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    using Index = MultiIndexTree<IndexedSphere>;
+    using Cache = UsageRateCacheT<IndexedSphere>;
+    auto index_dir = std::string("tmp-warm-up-c2v8n");
+    auto hot_set_file = index_dir + "-hot-set.json";
+    auto storage = write_sphere_subtrees(index_dir, 8, 50);
+
+    auto hot_set = std::vector<size_t>{};
+    {
+        auto index = Index(storage, Cache(UsageRateCacheParams(1000ul), storage));
+        index.save_hot_set_at_exit(hot_set_file);
+
+        for(size_t k : {2, 5, 2, 6, 5, 2}) {
+            BOOST_CHECK_EQUAL(index.count_intersecting(unit_cell(k)), 41);
+        }
+
+        hot_set = index.hot_set();
+        BOOST_CHECK(sorted(hot_set) == std::vector<size_t>({2, 5, 6}));
+        BOOST_CHECK_EQUAL(hot_set.front(), 2);
+    }
+    BOOST_CHECK(read_hot_set(hot_set_file) == hot_set);
+
+    auto index = Index(storage, Cache(UsageRateCacheParams(1000ul), storage));
+    BOOST_CHECK_EQUAL(index.warm_up(hot_set, 2), 3);
+    BOOST_CHECK(sorted(index.hot_set()) == std::vector<size_t>({2, 5, 6}));
+
+    // Cached subtrees and unknown ids are skipped.
+    BOOST_CHECK_EQUAL(index.warm_up({6, 100, 1}), 1);
+    BOOST_CHECK(sorted(index.hot_set()) == std::vector<size_t>({1, 2, 5, 6}));
+
+    auto regions = std::vector<Box3D>{unit_cell(3), unit_cell(2)};
+    BOOST_CHECK(index.subtrees_intersecting(regions) == std::vector<size_t>({3, 2}));
+
+    std::filesystem::remove(hot_set_file);
+    std::filesystem::remove_all(index_dir);
+}
+
+
+template <class Cache>
+static void check_warm_up_stops_when_full(const std::string& index_dir) {
+    using Index = MultiIndexTree<IndexedSphere, Cache>;
+    auto storage = write_sphere_subtrees(index_dir, 8, 50);
+
+    auto all = std::vector<size_t>{7, 6, 5, 4, 3, 2, 1, 0};
+    for(size_t n_threads : {1, 3}) {
+        // Room for two subtrees, by the number of elements.
+        auto index = Index(storage, Cache(UsageRateCacheParams(120ul), storage));
+        BOOST_CHECK_EQUAL(index.warm_up(all, n_threads), 2);
+        BOOST_CHECK(sorted(index.hot_set()) == std::vector<size_t>({6, 7}));
+    }
+
+    auto one_subtree = Index(storage, Cache(UsageRateCacheParams(50ul), storage));
+    auto subtree_bytes = [&]() {
+        one_subtree.warm_up({0});
+        return one_subtree.cached_bytes();
+    }();
+
+    // Room for three subtrees, by the memory.
+    auto params = UsageRateCacheParams::from_max_cached_bytes(3 * subtree_bytes + 10);
+    auto index = Index(storage, Cache(params, storage));
+    BOOST_CHECK_EQUAL(index.warm_up(all, 2), 3);
+    BOOST_CHECK(index.cached_bytes() <= params.max_cached_bytes);
+
+    std::filesystem::remove_all(index_dir);
+}
+
+BOOST_AUTO_TEST_CASE(WarmUpStopsWhenFull) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    check_warm_up_stops_when_full<UsageRateCacheT<IndexedSphere>>("tmp-warm-up-f7k1p");
+    check_warm_up_stops_when_full<ShardedUsageRateCacheT<IndexedSphere>>("tmp-warm-up-s3m9d");
+}
+
+
+BOOST_AUTO_TEST_CASE(ReadHotSetFromUsageStats) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto filename = std::string("tmp-usage-stats-x4q2z.json");
+    {
+        auto o = util::open_ofstream(filename);
+        o << R"([{"id": 3, "usage_rate": 0.1}, {"id": 7, "usage_rate": 0.9},)"
+          << R"( {"id": 1, "usage_rate": 0.5}])";
+    }
+    BOOST_CHECK(read_hot_set(filename) == std::vector<size_t>({7, 1, 3}));
+
+    write_hot_set(filename, {4, 0, 2});
+    BOOST_CHECK(read_hot_set(filename) == std::vector<size_t>({4, 0, 2}));
+
+    std::filesystem::remove(filename);
+}
+
+
+static size_t n_files(const std::string& dir) {
+    return size_t(std::distance(std::filesystem::directory_iterator(dir),
+                                std::filesystem::directory_iterator{}));
+}
+
+BOOST_AUTO_TEST_CASE(CopyOnWriteSnapshots) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    using Index = MultiIndexTree<IndexedSphere>;
+    auto base_dir = std::string("tmp-snapshot-base-q7m2x");
+    auto v1_dir = std::string("tmp-snapshot-v1-q7m2x");
+    auto v2_dir = std::string("tmp-snapshot-v2-q7m2x");
+
+    write_sphere_subtrees(join_path(base_dir, "multi_index"), 8, 50);
+    auto meta_data = create_basic_meta_data("sphere");
+    meta_data[MetaDataConstants::multi_index_key] = {{"heavy_data_path", "multi_index"}};
+    write_meta_data(default_meta_data_path(base_dir), meta_data);
+
+    // Removes 5 spheres in the unit cell of subtree 2; and all of subtree 3.
+    create_multi_index_snapshot(base_dir, v1_dir);
+    auto n_removed = remove_from_multi_index<IndexedSphere>(v1_dir, [](const auto& sphere) {
+        return (sphere.id >= 100 && sphere.id < 110) || (sphere.id >= 150 && sphere.id < 200);
+    });
+    BOOST_CHECK_EQUAL(n_removed, 60);
+    BOOST_CHECK_EQUAL(n_files(join_path(v1_dir, "multi_index")), 2);
+
+    create_multi_index_snapshot(v1_dir, v2_dir);
+    append_to_multi_index<IndexedSphere>(
+        v2_dir, {IndexedSphere(identifier_t(1000), Point3D{5.5f, 0.f, 0.f}, 0.01f)}
+    );
+    BOOST_CHECK_EQUAL(n_files(join_path(v2_dir, "multi_index")), 2);
+    BOOST_CHECK_EQUAL(detail::multi_index_base_dirs(v2_dir).size(), 2);
+
+    auto base = Index(base_dir, size_t(1) << 30);
+    auto v1 = Index(v1_dir, size_t(1) << 30);
+    auto v2 = Index(v2_dir, size_t(1) << 30);
+    BOOST_CHECK_EQUAL(base.size(), 400);
+    BOOST_CHECK_EQUAL(v1.size(), 340);
+    BOOST_CHECK_EQUAL(v2.size(), 341);
+    for(const auto* index : {&base, &v1, &v2}) {
+        BOOST_CHECK_EQUAL(index->count_intersecting(unit_cell(0)), 41);
+    }
+    BOOST_CHECK_EQUAL(base.count_intersecting(unit_cell(2)), 41);
+    BOOST_CHECK_EQUAL(v2.count_intersecting(unit_cell(2)), 36);
+    BOOST_CHECK_EQUAL(base.count_intersecting(unit_cell(3)), 41);
+    BOOST_CHECK_EQUAL(v2.count_intersecting(unit_cell(3)), 0);
+    BOOST_CHECK_EQUAL(v1.count_intersecting(unit_cell(5)), 41);
+    BOOST_CHECK_EQUAL(v2.count_intersecting(unit_cell(5)), 42);
+
+    // Storages without base directories can't open snapshots.
+    BOOST_CHECK_THROW(open_multi_index_storage<ContainerStorageT<IndexedSphere>>(v1_dir),
+                      std::runtime_error);
+
+    // The caches of all snapshots share the unchanged subtrees.
+    using Storage = NativeStorageT<IndexedSphere>;
+    auto params = UsageRateCacheParams(1000ul);
+    auto base_cache = ShardedUsageRateCacheT<IndexedSphere>(
+        params, open_multi_index_storage<Storage>(base_dir)
+    );
+    auto v2_cache = ShardedUsageRateCacheT<IndexedSphere>(
+        params, open_multi_index_storage<Storage>(v2_dir)
+    );
+    BOOST_CHECK(base_cache.load_subtree(SubtreeID{0ul, 50ul}, 0ul)
+                == v2_cache.load_subtree(SubtreeID{0ul, 50ul}, 0ul));
+    BOOST_CHECK(base_cache.load_subtree(SubtreeID{2ul, 50ul}, 0ul)
+                != v2_cache.load_subtree(SubtreeID{2ul, 40ul}, 0ul));
+
+    for(const auto& dir : {base_dir, v1_dir, v2_dir}) {
+        std::filesystem::remove_all(dir);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SharedSubtreeRegistryLoadsConcurrently) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    using SubTree = MultiIndexSubTreeT<IndexedSphere>;
+    auto& registry = detail::SharedSubtreeRegistry<SubTree>::instance();
+
+    // Every load waits for the other one to start; if loads were serialized
+    // the first would time out alone.
+    auto n_started = std::atomic<size_t>{0};
+    auto overlapped = std::vector<int>(2, 0);
+    auto load = [&](size_t k) {
+        return registry.find_or_load("tmp-registry-j4x8w-" + std::to_string(k), [&, k]() {
+            ++n_started;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while(n_started.load() < 2 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+            }
+            overlapped[k] = n_started.load() == 2;
+            return SubTree{};
+        });
+    };
+
+    auto handles = std::vector<std::shared_ptr<const SubTree>>(2);
+    auto threads = std::vector<std::thread>{};
+    for(size_t k = 0; k < 2; ++k) {
+        threads.emplace_back([&, k]() { handles[k] = load(k); });
+    }
+    for(auto& thread : threads) {
+        thread.join();
+    }
+
+    BOOST_CHECK(overlapped[0] && overlapped[1]);
+    BOOST_CHECK(handles[0] != handles[1]);
+
+    // A live subtree isn't loaded again.
+    auto again = registry.find_or_load("tmp-registry-j4x8w-0", []() -> SubTree {
+        throw std::runtime_error("Loaded a shared subtree twice.");
+    });
+    BOOST_CHECK(again == handles[0]);
+}
+
+
 BOOST_AUTO_TEST_CASE(MultiIndexCompiles) {
     auto synapse_index = MultiIndexTree<Synapse>{};
     auto morpho_index = MultiIndexTree<MorphoEntry>{};
+    auto concurrent_index = ConcurrentMultiIndexTree<MorphoEntry>{};
+    auto arena_index = ArenaMultiIndexTree<MorphoEntry>{};
+
+    static_assert(!supports_concurrent_queries<MultiIndexTree<MorphoEntry>>::value);
+    static_assert(supports_concurrent_queries<ConcurrentMultiIndexTree<MorphoEntry>>::value);
 }
 
 BOOST_AUTO_TEST_CASE(TwoLevelParamsCutoff) {
@@ -0,0 +1,110 @@
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/neuron_ingestion.hpp>
+
+using namespace brain_indexer;
+
+
+// A soma and two sections, the first with three points, the second with two.
+static const std::vector<Point3D> points{{1., 0., 0.}, {2., 0., 0.}, {3., 0., 0.},
+                                         {0., 1., 0.}, {0., 2., 0.}};
+static const std::vector<CoordType> radii{1., 2., 3., 4., 5.};
+static const std::vector<unsigned> section_offsets{0, 3};
+static const std::vector<unsigned> section_types{2, 3};
+
+static MorphologyView make_morphology() {
+    return MorphologyView{Point3D{0., 0., 0.}, 0.5,
+                          points.data(), radii.data(), points.size(),
+                          section_offsets.data(), section_types.data(), section_offsets.size()};
+}
+
+static std::vector<MorphoEntry> ingest(const std::vector<NeuronPlacement>& placements) {
+    auto entries = std::vector<MorphoEntry>{};
+    auto morphologies = std::vector<MorphologyView>{make_morphology()};
+    ingest_neurons(morphologies, placements,
+                   boost::make_function_output_iterator([&entries](const auto& value) {
+                       entries.emplace_back(value);
+                   }));
+
+    return entries;
+}
+
+static bool is_close(const Point3D& a, const Point3D& b) {
+    return Point3Dx(a).dist_sq(b) < 1e-10;
+}
+
+
+BOOST_AUTO_TEST_CASE(IngestTranslatedNeuron) {
+    auto entries = ingest({NeuronPlacement{7, 0, Point3D{10., 20., 30.}}});
+
+    // 1 soma, 2 segments in the first section and 1 in the second.
+    BOOST_REQUIRE_EQUAL(entries.size(), 4);
+
+    const auto& soma = boost::get<Soma>(entries[0]);
+    BOOST_CHECK_EQUAL(soma.gid(), 7);
+    BOOST_CHECK(is_close(soma.centroid, Point3D{10., 20., 30.}));
+    BOOST_CHECK_EQUAL(soma.radius, 0.5);
+
+    const auto& first = boost::get<Segment>(entries[1]);
+    BOOST_CHECK_EQUAL(first.section_id(), 1);
+    BOOST_CHECK_EQUAL(first.segment_id(), 0);
+    BOOST_CHECK(is_close(first.p1, Point3D{11., 20., 30.}));
+    BOOST_CHECK(is_close(first.p2, Point3D{12., 20., 30.}));
+    BOOST_CHECK_EQUAL(first.radius, 1.5);
+    BOOST_CHECK(first.section_type() == SectionType::axon);
+
+    const auto& second = boost::get<Segment>(entries[2]);
+    BOOST_CHECK_EQUAL(second.segment_id(), 1);
+    BOOST_CHECK_EQUAL(second.radius, 2.5);
+
+    const auto& last = boost::get<Segment>(entries[3]);
+    BOOST_CHECK_EQUAL(last.section_id(), 2);
+    BOOST_CHECK_EQUAL(last.segment_id(), 0);
+    BOOST_CHECK(is_close(last.p1, Point3D{10., 21., 30.}));
+    BOOST_CHECK(is_close(last.p2, Point3D{10., 22., 30.}));
+    BOOST_CHECK(last.section_type() == SectionType::basal_dendrite);
+}
+
+
+BOOST_AUTO_TEST_CASE(IngestRotatedNeuron) {
+    // A quarter turn around z, unnormalized: maps x to y and y to -x.
+    auto placement = NeuronPlacement{3, 0, Point3D{1., 1., 1.}, {2.0f, 0.0f, 0.0f, 2.0f}};
+    auto entries = ingest({placement});
+
+    BOOST_REQUIRE_EQUAL(entries.size(), 4);
+
+    // The soma is only shifted.
+    BOOST_CHECK(is_close(boost::get<Soma>(entries[0]).centroid, Point3D{1., 1., 1.}));
+
+    const auto& first = boost::get<Segment>(entries[1]);
+    BOOST_CHECK(is_close(first.p1, Point3D{1., 2., 1.}));
+    BOOST_CHECK(is_close(first.p2, Point3D{1., 3., 1.}));
+
+    const auto& last = boost::get<Segment>(entries[3]);
+    BOOST_CHECK(is_close(last.p1, Point3D{0., 1., 1.}));
+    BOOST_CHECK(is_close(last.p2, Point3D{-1., 1., 1.}));
+}
+
+
+BOOST_AUTO_TEST_CASE(IngestManyNeurons) {
+    auto placements = std::vector<NeuronPlacement>{};
+    for(identifier_t gid = 0; gid < 10; ++gid) {
+        placements.push_back(NeuronPlacement{gid, 0, Point3D{CoordType(gid), 0., 0.}});
+    }
+
+    auto entries = ingest(placements);
+    BOOST_REQUIRE_EQUAL(entries.size(), 40);
+
+    IndexTree<MorphoEntry> index(entries);
+    BOOST_CHECK_EQUAL(index.size(), 40);
+
+    BOOST_CHECK_THROW(ingest({NeuronPlacement{0, 1, Point3D{0., 0., 0.}}}), std::out_of_range);
+    BOOST_CHECK_THROW(ingest({NeuronPlacement{0, 0, Point3D{0., 0., 0.}, {0., 0., 0., 0.}}}),
+                      std::invalid_argument);
+}
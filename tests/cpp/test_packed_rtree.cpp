@@ -0,0 +1,565 @@
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/index_bulk_builder.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/util.hpp>
+
+using namespace brain_indexer;
+
+
+static std::vector<IndexedSphere> random_spheres(size_t n_spheres, std::default_random_engine& gen) {
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.01, 0.5);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    spheres.reserve(n_spheres);
+    for(size_t i = 0; i < n_spheres; ++i) {
+        auto center = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        spheres.emplace_back(identifier_t(i), center, radius_dist(gen));
+    }
+
+    return spheres;
+}
+
+static std::vector<Box3D> random_boxes(size_t n_boxes, std::default_random_engine& gen) {
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-11.0, 11.0);
+    auto length_dist = std::uniform_real_distribution<CoordType>(0.0, 4.0);
+
+    auto boxes = std::vector<Box3D>{};
+    for(size_t i = 0; i < n_boxes; ++i) {
+        auto min_corner = Point3Dx{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto lengths = Point3Dx{length_dist(gen), length_dist(gen), length_dist(gen)};
+        boxes.emplace_back(min_corner, min_corner + lengths);
+    }
+
+    return boxes;
+}
+
+template <class Tree>
+static std::vector<identifier_t> intersecting_ids(const Tree& tree, const Box3D& box) {
+    auto found = std::vector<IndexedSphere>{};
+    tree.query(bgi::intersects(box) && bgi::satisfies([&box](const IndexedSphere& s) {
+                   return s.intersects(box);
+               }),
+               std::back_inserter(found));
+
+    auto ids = std::vector<identifier_t>{};
+    for(const auto& s : found) {
+        ids.push_back(s.id);
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+template <class Tree>
+static void check_against_rtree(const Tree& tree,
+                                const IndexTree<IndexedSphere>& reference,
+                                std::default_random_engine& gen) {
+    for(const auto& box : random_boxes(100, gen)) {
+        auto expected = intersecting_ids(reference, box);
+        BOOST_CHECK(intersecting_ids(tree, box) == expected);
+
+        auto any = tree.query_any(bgi::intersects(box) && bgi::satisfies([&box](const IndexedSphere& s) {
+            return s.intersects(box);
+        }));
+        BOOST_CHECK(any == !expected.empty());
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedRTreeQueries) {
+    auto gen = std::default_random_engine{};
+
+    for(size_t n_spheres : {0ul, 1ul, 16ul, 17ul, 300ul, 5000ul}) {
+        auto spheres = random_spheres(n_spheres, gen);
+        auto reference = IndexTree<IndexedSphere>(spheres);
+        auto tree = PackedRTree<IndexedSphere>(spheres.begin(), spheres.end());
+
+        BOOST_CHECK(tree.size() == n_spheres);
+        if(n_spheres > 0) {
+            BOOST_CHECK(bg::equals(tree.bounds(), reference.bounds()));
+        }
+
+        for(size_t i = 0; i < tree.n_nodes(); ++i) {
+            const auto& node = tree.nodes()[i];
+            BOOST_CHECK(node.n_children > 0);
+            BOOST_CHECK(node.n_children <= PackedRTreeNode::max_children);
+        }
+
+        check_against_rtree(tree, reference, gen);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedRTreeParallelBuild) {
+    auto gen = std::default_random_engine{};
+
+    auto spheres = random_spheres(100000, gen);
+    auto reference = IndexTree<IndexedSphere>(spheres);
+    auto serial = PackedRTree<IndexedSphere>(spheres.begin(), spheres.end());
+    auto tree = PackedRTree<IndexedSphere>(
+        spheres.begin(), spheres.end(), PackedLeafFormat::full, 4
+    );
+
+    BOOST_CHECK(tree.size() == spheres.size());
+    BOOST_CHECK(tree.n_nodes() == serial.n_nodes());
+    check_against_rtree(tree, reference, gen);
+}
+
+
+/// \brief The sum of the overlaps of neighbouring leaves in the same STR column.
+static double column_overlap(const std::vector<IndexedSphere>& spheres,
+                             const SerialSTRParams& params,
+                             const std::vector<size_t>& boundaries) {
+    auto leaf_bounds = [&](size_t k) {
+        Box3D box;
+        bg::assign_inverse(box);
+        for(size_t i = boundaries[k]; i < boundaries[k + 1]; ++i) {
+            bg::expand(box, spheres[i].bounding_box());
+        }
+        return box;
+    };
+
+    double overlap = 0.0;
+    auto n_per_column = params.n_parts_per_dim[2];
+    for(size_t k = 0; k + 1 < params.n_parts(); ++k) {
+        if((k + 1) % n_per_column != 0) {
+            overlap += detail::packed_rtree_split_cost(leaf_bounds(k), leaf_bounds(k + 1)).first;
+        }
+    }
+
+    return overlap;
+}
+
+BOOST_AUTO_TEST_CASE(PackedRTreeLeafRefinement) {
+    auto gen = std::default_random_engine{};
+
+    auto spheres = random_spheres(20000, gen);
+    auto params = detail::packed_rtree_str_params(spheres.size(), PackedRTreeNode::max_children);
+    serial_sort_tile_recursion<IndexedSphere, GetCenterCoordinate<IndexedSphere>>(spheres, params);
+
+    auto str_boundaries = params.partition_boundaries();
+    auto boundaries = str_boundaries;
+    detail::refine_packed_rtree_leaves(spheres, params, boundaries, PackedRTreeNode::max_children, 3);
+
+    BOOST_CHECK(boundaries.front() == 0);
+    BOOST_CHECK(boundaries.back() == spheres.size());
+    for(size_t k = 0; k < params.n_parts(); ++k) {
+        BOOST_CHECK(boundaries[k] < boundaries[k + 1]);
+        BOOST_CHECK(boundaries[k + 1] - boundaries[k] <= PackedRTreeNode::max_children);
+    }
+
+    BOOST_CHECK(boundaries != str_boundaries);
+    BOOST_CHECK(column_overlap(spheres, params, boundaries)
+                < column_overlap(spheres, params, str_boundaries));
+}
+
+
+template <class Tree>
+static void check_bulk_loaded_rtree(const Tree& tree,
+                                    const IndexTree<IndexedSphere>& reference,
+                                    std::default_random_engine& gen) {
+    BOOST_CHECK(tree.size() == reference.size());
+    if(!reference.empty()) {
+        BOOST_CHECK(bg::equals(tree.bounds(), reference.bounds()));
+    }
+
+    for(const auto& box : random_boxes(100, gen)) {
+        BOOST_CHECK(intersecting_ids(tree, box) == intersecting_ids(reference, box));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BulkLoadRTree) {
+    auto gen = std::default_random_engine{};
+
+    for(size_t n_spheres : {0ul, 1ul, 17ul, 5000ul}) {
+        auto spheres = random_spheres(n_spheres, gen);
+        auto reference = IndexTree<IndexedSphere>(spheres);
+
+        for(size_t n_threads : {1ul, 3ul}) {
+            auto tree = IndexTree<IndexedSphere>(random_spheres(10, gen));
+            bulk_load_rtree(tree, spheres, n_threads);
+            check_bulk_loaded_rtree(tree, reference, gen);
+        }
+    }
+
+    // The tree can be modified afterwards.
+    auto spheres = random_spheres(5000, gen);
+    auto tree = IndexTree<IndexedSphere>{};
+    bulk_load_rtree(tree, spheres);
+
+    auto reference = IndexTree<IndexedSphere>(spheres.begin() + 1000, spheres.end());
+    for(size_t i = 0; i < 1000; ++i) {
+        BOOST_CHECK(tree.remove(spheres[i]) == 1);
+    }
+    for(const auto& sphere : random_spheres(1000, gen)) {
+        auto moved = IndexedSphere(sphere.id + 5000, sphere.centroid, sphere.radius);
+        tree.insert(moved);
+        reference.insert(moved);
+    }
+
+    check_bulk_loaded_rtree(tree, reference, gen);
+}
+
+BOOST_AUTO_TEST_CASE(IndexBulkBuilderUsesSTR) {
+    auto gen = std::default_random_engine{};
+
+    auto spheres = random_spheres(5000, gen);
+    auto reference = IndexTree<IndexedSphere>(spheres);
+
+    auto builder = IndexBulkBuilder<IndexTree<IndexedSphere>>{};
+    builder.insert(spheres.begin(), spheres.end());
+    builder.finalize(2);
+    check_bulk_loaded_rtree(builder.index(), reference, gen);
+
+    auto packed_builder = IndexBulkBuilder<PackedIndexTree<IndexedSphere>>{};
+    packed_builder.insert(spheres.begin(), spheres.end());
+    packed_builder.finalize(2);
+    BOOST_CHECK(packed_builder.size() == spheres.size());
+    check_against_rtree(packed_builder.index(), reference, gen);
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedRTreeCompactLeaves) {
+    auto gen = std::default_random_engine{};
+
+    for(size_t n_spheres : {0ul, 1ul, 16ul, 17ul, 300ul, 5000ul}) {
+        auto spheres = random_spheres(n_spheres, gen);
+        auto reference = IndexTree<IndexedSphere>(spheres);
+        auto tree = CompactPackedRTree<IndexedSphere>(spheres.begin(), spheres.end());
+
+        BOOST_CHECK(tree.size() == n_spheres);
+        BOOST_CHECK(tree.leaf_format() == (n_spheres > 0 ? PackedLeafFormat::compact
+                                                          : PackedLeafFormat::full));
+        if(n_spheres > 0) {
+            BOOST_CHECK(bg::equals(tree.bounds(), reference.bounds()));
+        }
+
+        for(size_t i = 0; i < tree.n_nodes(); ++i) {
+            BOOST_CHECK(!tree.nodes()[i].is_leaf);
+        }
+
+        // The quantized boxes must contain the exact ones.
+        for(size_t i = 0; i < tree.n_leaves(); ++i) {
+            const auto& leaf = tree.leaves()[i];
+            BOOST_CHECK(leaf.n_children > 0);
+            BOOST_CHECK(leaf.n_children <= PackedCompactLeaf::max_children);
+            for(size_t k = 0; k < leaf.n_children; ++k) {
+                auto exact_box = bgi::indexable<IndexedSphere>{}(tree.begin()[leaf.first_child + k]);
+                BOOST_CHECK(bg::covered_by(exact_box, leaf.child_box(k)));
+            }
+        }
+
+        check_against_rtree(tree, reference, gen);
+
+        auto query_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+        for(size_t i = 0; i < 20; ++i) {
+            auto center = Point3D{query_dist(gen), query_dist(gen), query_dist(gen)};
+            auto nearest = std::vector<IndexedSphere>{};
+            auto expected = std::vector<IndexedSphere>{};
+            tree.query(bgi::nearest(center, 5), std::back_inserter(nearest));
+            reference.query(bgi::nearest(center, 5), std::back_inserter(expected));
+
+            auto ids = std::vector<identifier_t>{};
+            auto expected_ids = std::vector<identifier_t>{};
+            for(size_t k = 0; k < nearest.size(); ++k) {
+                ids.push_back(nearest[k].id);
+            }
+            for(size_t k = 0; k < expected.size(); ++k) {
+                expected_ids.push_back(expected[k].id);
+            }
+            std::sort(ids.begin(), ids.end());
+            std::sort(expected_ids.begin(), expected_ids.end());
+            BOOST_CHECK(ids == expected_ids);
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedRTreeMapping) {
+    auto gen = std::default_random_engine{};
+    auto spheres = random_spheres(2000, gen);
+    auto reference = IndexTree<IndexedSphere>(spheres);
+
+    auto filename = std::string("tmp-packed-rtree.packed");
+    write_packed_rtree(PackedRTree<IndexedSphere>(spheres.begin(), spheres.end()), filename);
+
+    {
+        auto tree = map_packed_rtree<IndexedSphere>(filename);
+        BOOST_CHECK(tree.size() == spheres.size());
+        check_against_rtree(tree, reference, gen);
+    }
+
+    write_packed_rtree(CompactPackedRTree<IndexedSphere>(spheres.begin(), spheres.end()), filename);
+
+    {
+        auto tree = map_packed_rtree<IndexedSphere>(filename);
+        BOOST_CHECK(tree.leaf_format() == PackedLeafFormat::compact);
+        BOOST_CHECK(tree.size() == spheres.size());
+        check_against_rtree(tree, reference, gen);
+    }
+
+    BOOST_CHECK_THROW(map_packed_rtree<Synapse>(filename), std::runtime_error);
+    BOOST_CHECK_THROW(map_packed_rtree<IndexedSphere>("tmp-packed-rtree.missing"),
+                      std::runtime_error);
+
+    std::filesystem::remove(filename);
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedRTreeTopLevels) {
+    auto gen = std::default_random_engine{};
+    auto spheres = random_spheres(5000, gen);
+    auto tree = PackedRTree<IndexedSphere>(spheres.begin(), spheres.end());
+
+    BOOST_CHECK(detail::packed_rtree_n_top_nodes(tree.nodes(), tree.n_nodes(), 0) == 0);
+    BOOST_CHECK(detail::packed_rtree_n_top_nodes(tree.nodes(), tree.n_nodes(), 1) == 1);
+
+    // The second level consists of the children of the root.
+    auto n_top_two = detail::packed_rtree_n_top_nodes(tree.nodes(), tree.n_nodes(), 2);
+    BOOST_CHECK(n_top_two == 1 + tree.nodes()[0].n_children);
+    BOOST_CHECK(detail::packed_rtree_n_top_nodes(tree.nodes(), tree.n_nodes(), 100)
+                == tree.n_nodes());
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedIndexTreeDumpAndOpen) {
+    auto gen = std::default_random_engine{};
+    auto spheres = random_spheres(2000, gen);
+    auto reference = IndexTree<IndexedSphere>(spheres);
+
+    auto filename = std::string("tmp-packed-index.packed");
+    PackedIndexTree<IndexedSphere>(reference).dump(filename);
+
+    for(size_t n_eager_levels : {0, 1, 3, 100}) {
+        auto index = PackedIndexTree<IndexedSphere>(filename, n_eager_levels);
+        BOOST_CHECK(index.size() == spheres.size());
+        check_against_rtree(index, reference, gen);
+    }
+
+    std::filesystem::remove(filename);
+}
+
+
+template <class Index>
+static std::vector<identifier_t> sorted_intersecting_ids(const Index& index, const Sphere& sphere) {
+    auto ids = std::vector<identifier_t>{};
+    index.template find_intersecting<BestEffortGeometry>(sphere, iter_ids_getter(ids));
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedIndexTreeQueries) {
+    auto gen = std::default_random_engine{};
+    auto spheres = random_spheres(3000, gen);
+
+    auto reference = IndexTree<IndexedSphere>(spheres);
+    auto index = PackedIndexTree<IndexedSphere>(reference);
+    BOOST_CHECK(index.size() == reference.size());
+
+    auto query_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    for(size_t i = 0; i < 100; ++i) {
+        auto center = Point3D{query_dist(gen), query_dist(gen), query_dist(gen)};
+        auto sphere = Sphere{center, CoordType(0.1) * std::abs(query_dist(gen))};
+
+        auto expected = sorted_intersecting_ids(reference, sphere);
+        BOOST_CHECK(sorted_intersecting_ids(index, sphere) == expected);
+        BOOST_CHECK(index.count_intersecting<BestEffortGeometry>(sphere) == expected.size());
+        BOOST_CHECK(index.is_intersecting<BestEffortGeometry>(sphere) == !expected.empty());
+        BOOST_CHECK(index.find_intersecting_objs<BestEffortGeometry>(sphere).size()
+                    == expected.size());
+
+        // Ties are unlikely with random coordinates; therefore, the neighbours are unique.
+        auto nearest = index.find_nearest(center, 5);
+        auto expected_nearest = reference.find_nearest(center, 5);
+        std::sort(nearest.begin(), nearest.end());
+        std::sort(expected_nearest.begin(), expected_nearest.end());
+        BOOST_CHECK(nearest == expected_nearest);
+    }
+
+    BOOST_CHECK(index.find_nearest(Point3D{0.0, 0.0, 0.0}, 0).empty());
+    BOOST_CHECK(index.find_nearest(Point3D{0.0, 0.0, 0.0}, 5000).size() == spheres.size());
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedIndexTreeGidSummaries) {
+    auto gen = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto gid_dist = std::uniform_int_distribution<identifier_t>(0, 50);
+
+    auto synapses = std::vector<Synapse>{};
+    for(size_t i = 0; i < 5000; ++i) {
+        auto point = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        synapses.emplace_back(identifier_t(i), gid_dist(gen), identifier_t(0), point);
+    }
+
+    auto reference = IndexTree<Synapse>(synapses);
+    auto large_box = Box3D{{-20.0, -20.0, -20.0}, {20.0, 20.0, 20.0}};
+
+    for(auto format : {PackedLeafFormat::full, PackedLeafFormat::compact}) {
+        auto index = PackedIndexTree<Synapse>(reference, format);
+        BOOST_CHECK(!index.has_gid_summaries());
+
+        auto without_summaries = index.count_intersecting_agg_gid(large_box);
+        index.build_gid_summaries();
+        BOOST_CHECK(index.has_gid_summaries());
+
+        BOOST_CHECK(without_summaries == reference.count_intersecting_agg_gid(large_box));
+        BOOST_CHECK(index.count_intersecting_agg_gid(large_box) == without_summaries);
+
+        for(const auto& box : random_boxes(50, gen)) {
+            BOOST_CHECK(index.count_intersecting_agg_gid(box)
+                        == reference.count_intersecting_agg_gid(box));
+        }
+
+        for(size_t i = 0; i < 50; ++i) {
+            auto center = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+            auto sphere = Sphere{center, CoordType(0.5) * std::abs(pos_dist(gen))};
+
+            BOOST_CHECK(index.count_intersecting_agg_gid(sphere)
+                        == reference.count_intersecting_agg_gid(sphere));
+            BOOST_CHECK(index.count_intersecting_agg_gid<BestEffortGeometry>(sphere)
+                        == reference.count_intersecting_agg_gid<BestEffortGeometry>(sphere));
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedIndexTreeFromSoA) {
+    auto ids = std::vector<identifier_t>{1, 2, 3};
+    auto centers = std::vector<Point3D>{{0., 0., 0.}, {10., 0., 0.}, {20., 0., 0.}};
+    auto radii = std::vector<CoordType>{2., 2.5, 4.};
+
+    auto soa = util::make_soa_reader<Soma>(ids, centers, radii);
+    auto index = PackedIndexTree<MorphoEntry>(soa.begin(), soa.end());
+
+    BOOST_CHECK(index.size() == 3);
+
+    auto found = std::vector<gid_segm_t>{};
+    index.find_intersecting(Sphere{{15., 0., 0.}, 2.}, iter_gid_segm_getter(found));
+    BOOST_CHECK(found.size() == 1);
+    BOOST_CHECK(found[0].gid == 3);
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedNodeFilterKernels) {
+    auto gen = std::default_random_engine{};
+    // A coarse grid makes touching boxes, i.e. equal coordinates, likely.
+    auto coord_dist = std::uniform_int_distribution<int>(-4, 4);
+    auto random_box = [&]() {
+        auto a = Point3D{CoordType(coord_dist(gen)), CoordType(coord_dist(gen)), CoordType(coord_dist(gen))};
+        auto b = Point3D{CoordType(coord_dist(gen)), CoordType(coord_dist(gen)), CoordType(coord_dist(gen))};
+        return Box3D{brain_indexer::min(a, b), brain_indexer::max(a, b)};
+    };
+
+    auto isas = std::vector<detail::NodeFilterISA>{
+        detail::NodeFilterISA::scalar,
+        detail::NodeFilterISA::avx2,
+        detail::NodeFilterISA::avx512
+    };
+
+    for(size_t i = 0; i < 1000; ++i) {
+        auto node = PackedRTreeNode{};
+        node.n_children = std::uint32_t(1 + i % PackedRTreeNode::max_children);
+        for(size_t k = 0; k < PackedRTreeNode::max_children; ++k) {
+            detail::set_packed_rtree_child_box(node, k, random_box());
+        }
+
+        auto query = random_box();
+
+        std::uint32_t expected = 0;
+        for(std::uint32_t k = 0; k < node.n_children; ++k) {
+            expected |= std::uint32_t(bg::intersects(query, node.child_box(k))) << k;
+        }
+
+        for(auto isa : isas) {
+            if(detail::is_supported(isa)) {
+                auto mask = detail::intersecting_children(
+                    isa, query, node.min_corner, node.max_corner, node.n_children
+                );
+                BOOST_CHECK_EQUAL(mask, expected);
+            }
+        }
+    }
+}
+
+
+template <class Shape>
+static std::uint32_t expected_leaf_mask(const Shape& shape,
+                                        const std::vector<MorphoEntry>& values,
+                                        std::uint32_t mask) {
+    std::uint32_t expected = 0;
+    for(std::uint32_t k = 0; k < values.size(); ++k) {
+        if((mask >> k) & 1u) {
+            expected |= std::uint32_t(geometry_intersects(shape, values[k], BestEffortGeometry{})) << k;
+        }
+    }
+    return expected;
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedLeafFilterKernels) {
+    auto gen = std::default_random_engine{};
+    // A coarse grid makes degenerate cases likely, e.g. parallel or zero
+    // length axes and touching shapes.
+    auto coord_dist = std::uniform_int_distribution<int>(-3, 3);
+    auto fine_dist = std::uniform_real_distribution<CoordType>(-3.0, 3.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.0, 1.5);
+    auto mask_dist = std::uniform_int_distribution<std::uint32_t>(0, 0xffff);
+
+    auto random_point = [&](bool coarse) {
+        if(coarse) {
+            return Point3D{CoordType(coord_dist(gen)), CoordType(coord_dist(gen)), CoordType(coord_dist(gen))};
+        }
+        return Point3D{fine_dist(gen), fine_dist(gen), fine_dist(gen)};
+    };
+
+    auto isas = std::vector<detail::NodeFilterISA>{
+        detail::NodeFilterISA::scalar,
+        detail::NodeFilterISA::avx2,
+        detail::NodeFilterISA::avx512
+    };
+
+    for(size_t i = 0; i < 2000; ++i) {
+        bool coarse = i % 2 == 0;
+
+        auto values = std::vector<MorphoEntry>{};
+        for(size_t k = 0; k < PackedRTreeNode::max_children; ++k) {
+            if(k % 3 == 0) {
+                values.emplace_back(Soma(identifier_t(k), random_point(coarse), radius_dist(gen)));
+            } else {
+                values.emplace_back(Segment(identifier_t(k), 0u, 0u,
+                                            random_point(coarse), random_point(coarse),
+                                            radius_dist(gen)));
+            }
+        }
+
+        auto a = random_point(coarse);
+        auto b = random_point(coarse);
+        auto box = make_query_box(a, b);
+        auto sphere = Sphere{a, radius_dist(gen)};
+        auto cylinder = Cylinder{a, b, radius_dist(gen)};
+        auto mask = mask_dist(gen);
+
+        for(auto isa : isas) {
+            if(!detail::is_supported(isa)) {
+                continue;
+            }
+
+            BOOST_CHECK_EQUAL(detail::best_effort_intersecting_values(isa, box, values.data(), mask),
+                              expected_leaf_mask(box, values, mask));
+            BOOST_CHECK_EQUAL(detail::best_effort_intersecting_values(isa, sphere, values.data(), mask),
+                              expected_leaf_mask(sphere, values, mask));
+            BOOST_CHECK_EQUAL(detail::best_effort_intersecting_values(isa, cylinder, values.data(), mask),
+                              expected_leaf_mask(cylinder, values, mask));
+        }
+    }
+}
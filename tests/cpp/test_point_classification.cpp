@@ -0,0 +1,151 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/point_classification.hpp>
+
+#include "synthetic_cells.hpp"
+
+using namespace brain_indexer;
+
+
+/// Points near the elements, which hit some of them; and others anywhere.
+template <class T>
+static std::vector<Point3Dx> random_points(const std::vector<T>& elements,
+                                           size_t n_points,
+                                           size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(-10.0, 110.0);
+    auto offset = std::uniform_real_distribution<CoordType>(-2.0, 2.0);
+    auto pick = std::uniform_int_distribution<size_t>(0, elements.size() - 1);
+
+    auto points = std::vector<Point3Dx>{};
+    for(size_t i = 0; i < n_points; ++i) {
+        if(i % 2 == 0) {
+            points.push_back(Point3Dx{pos(gen), pos(gen), pos(gen)});
+        } else {
+            auto center = Point3Dx(get_centroid(elements[pick(gen)]));
+            points.push_back(center + Point3Dx{offset(gen), offset(gen), offset(gen)});
+        }
+    }
+
+    return points;
+}
+
+template <class T>
+static std::vector<identifier_t> brute_force_classification(const std::vector<T>& elements,
+                                                            const std::vector<Point3Dx>& points) {
+    auto ids = std::vector<identifier_t>(points.size(), unclassified_point);
+    for(size_t i = 0; i < points.size(); ++i) {
+        for(const auto& element : elements) {
+            if(detail::element_contains(element, points[i])) {
+                ids[i] = std::min(ids[i], detail::get_id_from(element));
+            }
+        }
+    }
+
+    return ids;
+}
+
+template <class Index, class T>
+static void check_classify_points(const Index& index, const std::vector<T>& elements) {
+    auto points = random_points(elements, 3000, 7);
+    auto expected = brute_force_classification(elements, points);
+
+    // Otherwise, the test is vacuous.
+    auto n_classified = std::count_if(expected.begin(), expected.end(), [](identifier_t id) {
+        return id != unclassified_point;
+    });
+    BOOST_CHECK(n_classified > 100);
+    BOOST_CHECK(n_classified < long(points.size()));
+
+    for(size_t n_threads : {1, 3}) {
+        for(size_t block_size : {1, 64}) {
+            auto ids = classify_points(index, points, n_threads, block_size);
+            BOOST_CHECK(ids == expected);
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(ClassifyPointsIndexTree) {
+    auto elements = synthetic_cells(0, 40, 0, 10, 1.0f);
+    check_classify_points(IndexTree<MorphoEntry>(elements), elements);
+}
+
+BOOST_AUTO_TEST_CASE(ClassifyPointsPackedIndexTree) {
+    auto elements = synthetic_cells(0, 40, 1, 10, 1.0f);
+    check_classify_points(PackedIndexTree<MorphoEntry>(elements.begin(), elements.end()),
+                          elements);
+}
+
+BOOST_AUTO_TEST_CASE(ClassifyPointsSpheres) {
+    auto cells = synthetic_cells(0, 40, 2, 10, 1.0f);
+    auto spheres = std::vector<IndexedSphere>{};
+    for(const auto& cell : cells) {
+        auto id = identifier_t(spheres.size());
+        spheres.emplace_back(id, get_centroid(cell), CoordType(1.5));
+    }
+
+    check_classify_points(IndexTree<IndexedSphere>(spheres), spheres);
+}
+
+BOOST_AUTO_TEST_CASE(ClassifyPointsWithoutVolume) {
+    auto points = std::vector<Point3Dx>{{1.0, 2.0, 3.0}, {4.0, 5.0, 6.0}};
+    auto index = IndexTree<IndexedPoint>(std::vector<IndexedPoint>{
+        IndexedPoint(0, points[0], CoordType(0)), IndexedPoint(1, points[1], CoordType(0))
+    });
+
+    auto ids = classify_points(index, points);
+    BOOST_CHECK(ids == std::vector<identifier_t>(2, unclassified_point));
+
+    BOOST_CHECK(classify_points(index, std::vector<Point3Dx>{}).empty());
+    BOOST_CHECK_THROW(classify_points(index, points, 1, 0), std::invalid_argument);
+}
+
+template <class Storage>
+static void check_multi_index_classify_points(const std::string& output_dir) {
+    auto elements = synthetic_cells(0, 40, 3, 10, 1.0f);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(elements.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry, Storage>(output_dir);
+    builder.insert(elements.begin() + long(range.low), elements.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        using Index = MultiIndexTree<MorphoEntry, UsageRateCache<Storage>>;
+        check_classify_points(Index(output_dir, size_t(1) << 30), elements);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ClassifyPointsMultiIndex) {
+    check_multi_index_classify_points<NativeStorageT<MorphoEntry>>("tmp-classify-points-w4x7r");
+    check_multi_index_classify_points<MemoryMappedStorageT<MorphoEntry>>(
+        "tmp-classify-points-b6m1t"
+    );
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
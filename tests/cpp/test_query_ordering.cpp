@@ -1,8 +1,11 @@
 #define BOOST_TEST_MODULE BrainIndexer_UnitTests
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <random>
 #include <vector>
+#include <brain_indexer/index_bulk_builder.hpp>
 #include <brain_indexer/query_ordering.hpp>
 
 using namespace brain_indexer;
@@ -26,4 +29,71 @@ BOOST_AUTO_TEST_CASE(SFCOrderingTest) {
     for(size_t i = 0; i < points.size(); ++i) {
         BOOST_CHECK(counts[i] == 1ul);
     }
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE(RadixSortIsStable) {
+    auto gen = std::mt19937(42);
+    auto dist = std::uniform_int_distribution<std::uint64_t>(0, (std::uint64_t(1) << 40) - 1);
+
+    // Enough pairs for several chunks, and few keys to have many ties.
+    size_t n_pairs = 100000;
+    auto pairs = std::vector<std::pair<std::uint64_t, size_t>>(n_pairs);
+    for(size_t i = 0; i < n_pairs; ++i) {
+        pairs[i] = {dist(gen) % 1000 << 25, i};
+    }
+
+    auto expected = pairs;
+    std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    for(size_t n_threads : {1, 3, 8}) {
+        auto actual = pairs;
+        experimental::detail::radix_sort_by_key(actual, 40, n_threads);
+        BOOST_CHECK(actual == expected);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SFCOrderingThreadsAndBits) {
+    auto gen = std::mt19937(0);
+    auto dist = std::uniform_real_distribution<CoordType>(-100.0, 300.0);
+
+    auto points = std::vector<Point3Dx>(50000);
+    for(auto& p : points) {
+        p = Point3Dx{dist(gen), dist(gen), dist(gen)};
+    }
+
+    for(int n_bits : {1, 10, 21}) {
+        auto order = experimental::space_filling_order(points, n_bits);
+
+        auto sorted = order;
+        std::sort(sorted.begin(), sorted.end());
+        for(size_t i = 0; i < sorted.size(); ++i) {
+            BOOST_REQUIRE(sorted[i] == i);
+        }
+
+        auto threaded = experimental::space_filling_order(points, n_bits, 4);
+        BOOST_CHECK(order == threaded);
+    }
+
+    BOOST_CHECK_THROW(experimental::space_filling_order(points, 0), std::invalid_argument);
+    BOOST_CHECK_THROW(experimental::space_filling_order(points, 22), std::invalid_argument);
+}
+
+
+BOOST_AUTO_TEST_CASE(BulkBuilderSpaceFillingCurve) {
+    auto gen = std::mt19937(1);
+    auto dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+
+    auto builder = IndexBulkBuilder<IndexTree<IndexedSphere>>{};
+    for(identifier_t i = 0; i < 1000; ++i) {
+        builder.insert(IndexedSphere{i, Point3D{dist(gen), dist(gen), dist(gen)}, 0.1f});
+    }
+
+    builder.sort_along_space_filling_curve(21, 2);
+    builder.finalize();
+
+    BOOST_CHECK(builder.size() == 1000);
+    BOOST_CHECK(builder.index().size() == 1000);
+}
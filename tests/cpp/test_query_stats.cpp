@@ -0,0 +1,210 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <filesystem>
+#include <iterator>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/query_stats.hpp>
+
+using namespace brain_indexer;
+
+static_assert(detail::query_stats_enabled, "This test requires building with SI_QUERY_STATS.");
+
+
+/// \brief Spheres of radius 0.4 on the integer grid `[0, n)^3`.
+static std::vector<IndexedSphere> grid_of_spheres(int n) {
+    auto spheres = std::vector<IndexedSphere>{};
+    for(int i = 0; i < n; ++i) {
+        for(int j = 0; j < n; ++j) {
+            for(int k = 0; k < n; ++k) {
+                auto id = identifier_t(spheres.size());
+                spheres.emplace_back(id, Point3D{CoordType(i), CoordType(j), CoordType(k)}, 0.4f);
+            }
+        }
+    }
+
+    return spheres;
+}
+
+
+BOOST_AUTO_TEST_CASE(IndexTreeQueryStats) {
+    auto index = IndexTree<IndexedSphere>(grid_of_spheres(10));
+
+    // The box touches the bounding boxes of 8 spheres, but only 4 spheres.
+    auto box = Box3D{Point3D{2.5f, 2.5f, 2.5f}, Point3D{3.7f, 3.7f, 3.7f}};
+
+    auto stats = QueryStats{};
+    {
+        auto recorder = QueryStatsRecorder(stats);
+        BOOST_CHECK_EQUAL(index.count_intersecting<BestEffortGeometry>(box), 4);
+    }
+
+    BOOST_CHECK_EQUAL(stats.n_queries, 1);
+    BOOST_CHECK_EQUAL(stats.hits, 4);
+    BOOST_CHECK_EQUAL(stats.exact_tests, 8);
+    BOOST_CHECK(stats.leaves_tested > 0);
+    BOOST_CHECK(stats.nodes_visited >= stats.leaves_tested);
+    BOOST_CHECK_EQUAL(stats.subtree_loads, 0);
+
+    auto ids = std::vector<identifier_t>{};
+    index.find_intersecting<BoundingBoxGeometry>(box, iter_ids_getter(ids));
+    BOOST_CHECK_EQUAL(ids.size(), 8);
+
+    auto nearest = index.find_nearest(Point3D{0.0f, 0.0f, 0.0f}, 3);
+    BOOST_CHECK_EQUAL(nearest.size(), 3);
+
+    // The recorder only sees queries while it's alive; the index sees all.
+    BOOST_CHECK_EQUAL(stats.n_queries, 1);
+
+    auto total = index.query_stats();
+    BOOST_CHECK_EQUAL(total.n_queries, 3);
+    BOOST_CHECK_EQUAL(total.hits, 4 + 8 + 3);
+    BOOST_CHECK_EQUAL(total.exact_tests, 8);
+
+    index.reset_query_stats();
+    BOOST_CHECK_EQUAL(index.query_stats().n_queries, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(PackedIndexTreeQueryStats) {
+    auto spheres = grid_of_spheres(10);
+    auto index = PackedIndexTree<IndexedSphere>(spheres.begin(), spheres.end());
+    auto box = Box3D{Point3D{2.5f, 2.5f, 2.5f}, Point3D{3.7f, 3.7f, 3.7f}};
+    auto ids = std::vector<identifier_t>{};
+    index.find_intersecting<BestEffortGeometry>(box, iter_ids_getter(ids));
+    BOOST_CHECK_EQUAL(ids.size(), 4);
+
+    auto stats = index.query_stats();
+    BOOST_CHECK_EQUAL(stats.n_queries, 1);
+    BOOST_CHECK_EQUAL(stats.hits, 4);
+    BOOST_CHECK_EQUAL(stats.exact_tests, 8);
+    BOOST_CHECK(stats.leaves_tested > 0);
+    BOOST_CHECK(stats.nodes_visited > stats.leaves_tested);
+
+    // Nested queries, e.g. in a batch, count once each.
+    auto shapes = std::vector<Box3D>(5, box);
+    index.find_intersecting_batch<BestEffortGeometry>(shapes);
+    BOOST_CHECK_EQUAL(index.query_stats().n_queries, 6);
+    BOOST_CHECK_EQUAL(index.query_stats().hits, 24);
+}
+
+
+template <class Index>
+static void check_region_query_stats(const Index& index) {
+    // A thin slab along the diagonal of the xy-plane.
+    auto s = CoordType(std::sqrt(0.5));
+    auto axes = std::array<Point3D, 3>{
+        Point3D{s, s, 0.0f}, Point3D{-s, s, 0.0f}, Point3D{0.0f, 0.0f, 1.0f}
+    };
+    auto slab = OrientedBox{Point3D{20.0f, 20.0f, 20.0f}, axes, Point3D{30.0f, 1.0f, 30.0f}};
+
+    auto ids = std::vector<identifier_t>{};
+    auto region_stats = QueryStats{};
+    {
+        auto recorder = QueryStatsRecorder(region_stats);
+        index.template find_intersecting<BestEffortGeometry>(slab, iter_ids_getter(ids));
+    }
+
+    auto box_stats = QueryStats{};
+    {
+        auto recorder = QueryStatsRecorder(box_stats);
+        index.template find_intersecting<BestEffortGeometry>(slab.bounding_box(),
+                                                             iter_ids_getter(ids));
+    }
+
+    // Nodes outside of the slab are pruned by the separating-axis test;
+    // hence, their elements aren't tested.
+    BOOST_CHECK(region_stats.hits < box_stats.hits);
+    BOOST_CHECK(2 * region_stats.exact_tests < box_stats.exact_tests);
+    BOOST_CHECK_EQUAL(index.template count_intersecting<BestEffortGeometry>(slab),
+                      region_stats.hits);
+}
+
+BOOST_AUTO_TEST_CASE(RegionQueryStats) {
+    auto spheres = grid_of_spheres(40);
+    check_region_query_stats(IndexTree<IndexedSphere>(spheres));
+    check_region_query_stats(PackedIndexTree<IndexedSphere>(spheres.begin(), spheres.end()));
+}
+
+
+template <class Index>
+static void check_multi_index_query_stats(const Index& index, const Box3D& box) {
+    auto ids = std::vector<identifier_t>{};
+    index.template find_intersecting<BoundingBoxGeometry>(box, iter_ids_getter(ids));
+
+    auto stats = index.query_stats();
+    BOOST_CHECK_EQUAL(stats.n_queries, 1);
+    BOOST_CHECK_EQUAL(stats.hits, ids.size());
+    BOOST_CHECK(stats.subtree_loads > 0);
+    BOOST_CHECK(stats.bytes_read > 0);
+    BOOST_CHECK(stats.load_nanoseconds > 0);
+
+    // The second query hits the cache.
+    index.template find_intersecting<BoundingBoxGeometry>(box, iter_ids_getter(ids));
+    BOOST_CHECK_EQUAL(index.query_stats().n_queries, 2);
+    BOOST_CHECK_EQUAL(index.query_stats().subtree_loads, stats.subtree_loads);
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexQueryStats) {
+    auto output_dir = std::string("tmp-query-stats-mwqej");
+
+    auto spheres = grid_of_spheres(20);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(spheres.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<IndexedSphere>(output_dir);
+    builder.insert(spheres.begin() + range.low, spheres.begin() + range.high);
+    builder.finalize(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        auto box = Box3D{Point3D{-1.0f, -1.0f, -1.0f}, Point3D{30.0f, 30.0f, 30.0f}};
+
+        auto index = MultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+        check_multi_index_query_stats(index, box);
+
+        // Subtrees read in the background count towards the query.
+        auto prefetching = MultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+        prefetching.set_prefetch_depth(2);
+        check_multi_index_query_stats(prefetching, box);
+        BOOST_CHECK_EQUAL(prefetching.query_stats().subtree_loads,
+                          index.query_stats().subtree_loads);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(ReduceQueryStats) {
+    auto stats = QueryStats{};
+    stats.n_queries = 1;
+    stats.hits = mpi::rank(MPI_COMM_WORLD);
+    stats.load_nanoseconds = 10;
+
+    auto total = reduce_query_stats(stats, MPI_COMM_WORLD);
+    auto comm_size = std::uint64_t(mpi::size(MPI_COMM_WORLD));
+
+    BOOST_CHECK_EQUAL(total.n_queries, comm_size);
+    BOOST_CHECK_EQUAL(total.hits, comm_size * (comm_size - 1) / 2);
+    BOOST_CHECK_EQUAL(total.load_nanoseconds, 10 * comm_size);
+    BOOST_CHECK_EQUAL(total.bytes_read, 0);
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
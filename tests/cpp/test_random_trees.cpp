@@ -3,11 +3,15 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <filesystem>
 #include <random>
 #include <vector>
 
 #include <brain_indexer/index.hpp>
 #include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/node_shared_cache.hpp>
+#include <brain_indexer/query_cursor.hpp>
+#include <brain_indexer/synthetic_data.hpp>
 #include <brain_indexer/util.hpp>
 
 using namespace brain_indexer;
@@ -339,6 +343,95 @@ void check_with_all_query_shapes(
 }
 
 
+template<class Element, class Index>
+void check_nearest(const std::vector<Element>& all_elements,
+                   const Index& index,
+                   const std::array<CoordType, 2>& domain,
+                   std::default_random_engine& gen) {
+
+    auto distance_to = [](const Point3D& point) {
+        return [point](const Element& element) {
+            return bg::comparable_distance(point, bgi::indexable<Element>{}(element));
+        };
+    };
+
+    auto spheres = random_shapes<Sphere>(20, domain, {-2.0, 1.0}, gen);
+    for(const auto& sphere : spheres) {
+        auto point = Point3D(sphere.centroid);
+        auto distance = distance_to(point);
+
+        auto expected = std::vector<CoordType>{};
+        for(const auto& element : all_elements) {
+            expected.push_back(distance(element));
+        }
+        std::sort(expected.begin(), expected.end());
+
+        for(size_t k : {size_t(1), size_t(10)}) {
+            auto found = std::vector<Element>{};
+            index.query(bgi::nearest(point, unsigned(k)), std::back_inserter(found));
+
+            auto actual = std::vector<CoordType>{};
+            for(const auto& element : found) {
+                actual.push_back(distance(element));
+            }
+
+            // Ties may be broken differently; but the distances must agree.
+            BOOST_CHECK(actual.size() == k);
+            BOOST_CHECK(std::is_sorted(actual.begin(), actual.end()));
+            BOOST_CHECK(std::equal(actual.begin(), actual.end(), expected.begin()));
+        }
+    }
+}
+
+
+template<class GeometryMode, class Element, class Index, class QueryShape>
+static void check_query_cursor(const Index& index, const QueryShape& query_shape) {
+    auto expected = std::vector<identifier_t>{};
+    auto found = std::vector<Element>{};
+    index.template find_intersecting<GeometryMode>(query_shape, std::back_inserter(found));
+    for(const auto& element : found) {
+        expected.push_back(get_id(element));
+    }
+
+    size_t batch_size = 7;
+    auto cursor = make_query_cursor<GeometryMode>(index, query_shape);
+    auto actual = std::vector<identifier_t>{};
+    auto batch = std::vector<Element>{};
+    while(cursor.next_batch(batch_size, std::back_inserter(batch)) > 0) {
+        BOOST_CHECK(batch.size() <= batch_size);
+        for(const auto& element : batch) {
+            actual.push_back(get_id(element));
+        }
+        batch.clear();
+    }
+
+    BOOST_CHECK(cursor.next_batch(batch_size, std::back_inserter(batch)) == 0);
+
+    std::sort(expected.begin(), expected.end());
+    std::sort(actual.begin(), actual.end());
+    BOOST_CHECK(actual == expected);
+}
+
+
+template<class Element, class Index>
+void check_query_cursors(const Index& index,
+                         const std::array<CoordType, 2>& domain,
+                         std::default_random_engine& gen) {
+    for(const auto& query_shape : random_shapes<Sphere>(10, domain, {-2.0, 1.0}, gen)) {
+        check_query_cursor<BoundingBoxGeometry, Element>(index, query_shape);
+        check_query_cursor<BestEffortGeometry, Element>(index, query_shape);
+    }
+
+    for(const auto& query_shape : random_shapes<Box3D>(10, domain, {-2.0, 1.0}, gen)) {
+        check_query_cursor<BoundingBoxGeometry, Element>(index, query_shape);
+        check_query_cursor<BestEffortGeometry, Element>(index, query_shape);
+    }
+
+    auto everything = Box3D{{-100.0, -100.0, -100.0}, {100.0, 100.0, 100.0}};
+    check_query_cursor<BoundingBoxGeometry, Element>(index, everything);
+}
+
+
 BOOST_AUTO_TEST_CASE(MorphIndexQueries) {
     if(mpi::rank(MPI_COMM_WORLD) != 0) {
         return;
@@ -352,6 +445,26 @@ BOOST_AUTO_TEST_CASE(MorphIndexQueries) {
     auto index = IndexTree<EveryEntry>(elements);
 
     check_with_all_query_shapes(elements, index, domain, gen);
+    check_query_cursors<EveryEntry>(index, domain, gen);
+}
+
+
+BOOST_AUTO_TEST_CASE(ArenaIndexQueries) {
+    auto gen = std::default_random_engine{};
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto elements = random_elements<EveryEntry>(n_elements, domain, 0, gen);
+
+    auto builder = IndexBulkBuilder<ArenaIndexTree<EveryEntry>>{};
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize();
+
+    auto index = builder.index();
+    check_with_all_query_shapes(elements, index, domain, gen);
+
+    auto interleaved = ArenaIndexTree<EveryEntry, util::InterleavedArenaPlacement>(elements);
+    check_with_all_query_shapes(elements, interleaved, domain, gen);
 }
 
 
@@ -383,6 +496,528 @@ BOOST_AUTO_TEST_CASE(MultiIndexQueries) {
     if(mpi_rank == 0) {
         auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
         check_with_all_query_shapes(all_elements, index, domain, gen);
+        check_nearest(all_elements, index, domain, gen);
+        check_query_cursors<EveryEntry>(index, domain, gen);
+
+        // Subtrees inside the query are counted without loading them.
+        auto fresh_index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        auto everything = Box3D{{-100.0, -100.0, -100.0}, {100.0, 100.0, 100.0}};
+        BOOST_CHECK(fresh_index.count_intersecting(everything) == all_elements.size());
+        BOOST_CHECK(fresh_index.is_intersecting(everything));
+        BOOST_CHECK(fresh_index.cached_bytes() == 0);
+
+        auto concurrent_index = ConcurrentMultiIndexTree<EveryEntry>(
+            output_dir, /* mem = */ size_t(1e6)
+        );
+        check_with_all_query_shapes(all_elements, concurrent_index, domain, gen);
+
+        auto prefetching_index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e4));
+        prefetching_index.set_prefetch_depth(2);
+        check_with_all_query_shapes(all_elements, prefetching_index, domain, gen);
+
+        auto prefetching_concurrent_index = ConcurrentMultiIndexTree<EveryEntry>(
+            output_dir, /* mem = */ size_t(1e4)
+        );
+        prefetching_concurrent_index.set_prefetch_depth(2);
+        check_with_all_query_shapes(all_elements, prefetching_concurrent_index, domain, gen);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MemoryMappedMultiIndexQueries) {
+    auto output_dir = "tmp-mmap-ndwiu";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, MemoryMappedStorageT<EveryEntry>>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        auto index = MemoryMappedMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+        check_nearest(all_elements, index, domain, gen);
+        check_query_cursors<EveryEntry>(index, domain, gen);
+
+        auto small_index = MemoryMappedMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e4));
+        small_index.set_prefetch_depth(2);
+        check_with_all_query_shapes(all_elements, small_index, domain, gen);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(WeightedMultiIndexQueries) {
+    auto output_dir = "tmp-weighted-vbrte";
+
+    int n_required_ranks = 3;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(500);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    // Elements with large bounding boxes are hit by more queries.
+    auto weight = [](const EveryEntry& element) {
+        auto length = double(characteristic_length(element));
+        return 1.0 + length * length * length;
+    };
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm, /* n_threads = */ 1, weight);
+
+    MPI_Barrier(*comm);
+    if(mpi_rank == 0) {
+        auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        BOOST_CHECK(index.size() == all_elements.size());
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ContainerMultiIndexQueries) {
+    auto output_dir = "tmp-container-pzmqa";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, ContainerStorageT<EveryEntry>>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    MPI_Barrier(*comm);
+    if(mpi_rank == 0) {
+        // The top-level tree, and one data file and offset table per rank.
+        auto index_dir = std::filesystem::path(output_dir) / "multi_index";
+        auto n_files = std::distance(std::filesystem::directory_iterator(index_dir),
+                                     std::filesystem::directory_iterator{});
+        BOOST_CHECK(n_files == 1 + 2 * n_required_ranks);
+
+        auto index = ContainerMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        BOOST_CHECK(index.size() == all_elements.size());
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        auto small_index = ContainerMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e4));
+        small_index.set_prefetch_depth(2);
+        check_with_all_query_shapes(all_elements, small_index, domain, gen);
+
+        auto storage = ContainerStorageT<EveryEntry>(index_dir.string());
+        BOOST_CHECK_THROW(storage.load_subtree(size_t(-1)), std::runtime_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ArenaMultiIndexQueries) {
+    auto output_dir = "tmp-arena-p3xle";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, ArenaStorageT<EveryEntry>>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    MPI_Barrier(*comm);
+    if(mpi_rank == 0) {
+        auto index = ArenaMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        BOOST_CHECK(index.size() == all_elements.size());
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        // Subtrees are evicted and reloaded, in the background too.
+        auto small_index = ArenaMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e4));
+        small_index.set_prefetch_depth(2);
+        check_with_all_query_shapes(all_elements, small_index, domain, gen);
+    }
+}
+
+#if SI_ZSTD == 1
+BOOST_AUTO_TEST_CASE(CompressedMultiIndexQueries) {
+    auto output_dir = "tmp-compressed-uvkre";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, ZstdStorageT<EveryEntry>>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    MPI_Barrier(*comm);
+    if(mpi_rank == 0) {
+        auto meta_data = read_meta_data(output_dir);
+        BOOST_CHECK(meta_data[MetaDataConstants::multi_index_key]["subtree_compression"] == "zstd");
+
+        // Any `NativeStorage` reads compressed subtrees.
+        auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        BOOST_CHECK(index.size() == all_elements.size());
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        auto prefetching_index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e4));
+        prefetching_index.set_prefetch_depth(2);
+        check_with_all_query_shapes(all_elements, prefetching_index, domain, gen);
+    }
+}
+#endif
+
+template <class Storage, class Index>
+void check_append_to_multi_index(const std::string& output_dir) {
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(500);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, Storage>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    MPI_Barrier(*comm);
+    if(mpi_rank == 0) {
+        auto index_dir = (std::filesystem::path(output_dir) / "multi_index").string();
+        auto n_subtrees = Storage(index_dir).load_top_tree().size();
+
+        // The first batch is small, the second one forces subtrees to split.
+        for(auto n_added : {identifier_t(10), identifier_t(2000)}) {
+            // Every `EveryEntry` offset accounts for three elements.
+            auto id_offset = all_elements.size() / 3;
+            auto added = random_elements<EveryEntry>(n_added, domain, id_offset, gen);
+            append_to_multi_index<EveryEntry, Storage>(output_dir, added, /* max = */ 200);
+            all_elements.insert(all_elements.end(), added.begin(), added.end());
+
+            auto index = Index(output_dir, /* mem = */ size_t(1e6));
+            BOOST_CHECK(index.size() == all_elements.size());
+            check_with_all_query_shapes(all_elements, index, domain, gen);
+        }
+
+        BOOST_CHECK(Storage(index_dir).load_top_tree().size() > n_subtrees);
+        BOOST_CHECK_THROW(
+            append_to_multi_index<EveryEntry>("tmp-non-existent-ozhwa", all_elements),
+            std::runtime_error
+        );
+    }
+    MPI_Barrier(*comm);
+}
+
+BOOST_AUTO_TEST_CASE(AppendToMultiIndex) {
+    check_append_to_multi_index<NativeStorageT<EveryEntry>, MultiIndexTree<EveryEntry>>(
+        "tmp-append-ozhwa"
+    );
+    check_append_to_multi_index<MemoryMappedStorageT<EveryEntry>,
+                                MemoryMappedMultiIndexTree<EveryEntry>>(
+        "tmp-append-mmap-ozhwa"
+    );
+    check_append_to_multi_index<ContainerStorageT<EveryEntry>,
+                                ContainerMultiIndexTree<EveryEntry>>(
+        "tmp-append-container-ozhwa"
+    );
+}
+
+BOOST_AUTO_TEST_CASE(StreamingMultiIndexQueries) {
+    auto output_dir = "tmp-streaming-hqxle";
+    auto mmap_output_dir = "tmp-streaming-mmap-hqxle";
+    auto scratch_dir = "tmp-streaming-scratch-hqxle";
+
+    int n_required_ranks = 3;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    // Several runs per rank, and several rounds of exchanging chunks.
+    auto max_elements_in_memory = size_t(150);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry>(
+        output_dir, scratch_dir, max_elements_in_memory
+    );
+    builder.insert(elements.begin(), elements.end());
+    BOOST_CHECK(builder.local_size() == elements.size());
+    builder.finalize(*comm);
+
+    auto mmap_builder = MultiIndexBulkBuilder<EveryEntry, MemoryMappedStorageT<EveryEntry>>(
+        mmap_output_dir, scratch_dir, max_elements_in_memory
+    );
+    for(const auto& element : elements) {
+        mmap_builder.insert(element);
+    }
+    mmap_builder.finalize(*comm);
+
+    MPI_Barrier(*comm);
+    if(mpi_rank == 0) {
+        BOOST_CHECK(std::filesystem::is_empty(scratch_dir));
+
+        auto index = MultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        BOOST_CHECK(index.size() == all_elements.size());
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+
+        auto mmap_index = MemoryMappedMultiIndexTree<EveryEntry>(
+            mmap_output_dir, /* mem = */ size_t(1e4)
+        );
+        check_with_all_query_shapes(all_elements, mmap_index, domain, gen);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CompactMemoryMappedMultiIndexQueries) {
+    auto output_dir = "tmp-compact-mmap-kqzpe";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, CompactMemoryMappedStorageT<EveryEntry>>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        auto index = CompactMemoryMappedMultiIndexTree<EveryEntry>(output_dir, /* mem = */ size_t(1e6));
+        check_with_all_query_shapes(all_elements, index, domain, gen);
+    }
+}
+
+template <class Index>
+static void check_batch_queries(const Index& index,
+                                const std::vector<Sphere>& shapes,
+                                size_t n_threads) {
+    auto batch = index.template find_intersecting_batch<BestEffortGeometry>(shapes, n_threads);
+    BOOST_REQUIRE(batch.offsets.size() == shapes.size() + 1);
+
+    for(size_t i = 0; i < shapes.size(); ++i) {
+        auto expected = std::vector<identifier_t>{};
+        index.template find_intersecting<BestEffortGeometry>(shapes[i], iter_ids_getter(expected));
+        std::sort(expected.begin(), expected.end());
+
+        auto gids = std::vector<identifier_t>(batch.values.gid.begin() + batch.offsets[i],
+                                              batch.values.gid.begin() + batch.offsets[i + 1]);
+        std::sort(gids.begin(), gids.end());
+        BOOST_CHECK(gids == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiIndexBatchQueries) {
+    auto output_dir = "tmp-batch-hzqme";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+
+    auto elements = std::vector<MorphoEntry>{};
+    for(const auto& soma : random_elements<Soma>(n_elements, domain, 2 * mpi_rank * n_elements, gen)) {
+        elements.push_back(soma);
+    }
+    auto segment_offset = (2 * mpi_rank + 1) * n_elements;
+    for(const auto& segment : random_elements<Segment>(n_elements, domain, segment_offset, gen)) {
+        elements.push_back(segment);
+    }
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    if(mpi_rank == 0) {
+        // The queries are scattered and the cache holds few subtrees.
+        auto shapes = random_shapes<Sphere>(300, domain, {-2.0, 0.0}, gen);
+
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ size_t(1e4));
+        check_batch_queries(index, shapes, /* n_threads = */ 1);
+        check_batch_queries(index, std::vector<Sphere>{}, /* n_threads = */ 1);
+
+        auto concurrent_index = ConcurrentMultiIndexTree<MorphoEntry>(
+            output_dir, /* mem = */ size_t(1e4)
+        );
+        check_batch_queries(concurrent_index, shapes, /* n_threads = */ 4);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(NodeSharedMultiIndexQueries) {
+    auto output_dir = "tmp-node-shared-wmfta";
+
+    int n_required_ranks = 2;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto n_elements = identifier_t(1000);
+    auto domain = std::array<CoordType, 2>{-10.0, 10.0};
+
+    auto mpi_rank = mpi::rank(*comm);
+
+    auto gen = std::default_random_engine{
+      util::integer_cast<std::default_random_engine::result_type>(mpi_rank)
+    };
+    auto elements = random_elements<EveryEntry>(n_elements, domain, mpi_rank * n_elements, gen);
+    auto all_elements = gather_elements(elements, *comm);
+
+    auto builder = MultiIndexBulkBuilder<EveryEntry, MemoryMappedStorageT<EveryEntry>>(output_dir);
+    builder.insert(elements.begin(), elements.end());
+    builder.finalize(*comm);
+
+    auto mpi_type = mpi::Datatype(mpi::create_contiguous_datatype<EveryEntry>());
+    MPI_Bcast((void *) all_elements.data(),
+              util::safe_integer_cast<int>(all_elements.size()), *mpi_type,
+              /* root = */ 0,
+              *comm);
+
+    // Both ranks query the same subtrees concurrently; and the budget is
+    // small enough to require evictions.
+    auto storage = MemoryMappedStorageT<EveryEntry>(
+        resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key)
+    );
+    auto cache = make_node_shared_cache("si-test-node-shared-wmfta", size_t(1e5), storage, *comm);
+    auto index = NodeSharedMultiIndexTree<EveryEntry>(storage, std::move(cache));
+    check_with_all_query_shapes(all_elements, index, domain, gen);
+    BOOST_CHECK(index.cached_bytes() <= size_t(1e5));
+}
+
+BOOST_AUTO_TEST_CASE(SyntheticMultiIndex) {
+    auto output_dir = "tmp-synthetic-pcqzd";
+
+    int n_required_ranks = 3;
+    auto comm = mpi::comm_shrink(MPI_COMM_WORLD, n_required_ranks);
+
+    if(*comm == MPI_COMM_NULL) {
+        return;
+    }
+
+    auto circuit = SyntheticCircuit{};
+    circuit.distribution = SyntheticDistribution::morphology;
+    circuit.domain = Box3D{Point3D{0.0, 0.0, 0.0}, Point3D{100.0, 100.0, 100.0}};
+    circuit.density = 0.005;
+    circuit.sections_per_neuron = 10;
+    circuit.segments_per_section = 10;
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    insert_synthetic_elements<MorphoEntry>(builder, circuit, *comm, /* block_size = */ 333);
+    builder.finalize(*comm);
+
+    if(mpi::rank(*comm) == 0) {
+        auto all_elements = std::vector<MorphoEntry>{};
+        generate_synthetic_segments(circuit, 0, circuit.n_elements(),
+                                    std::back_inserter(all_elements));
+        auto reference = IndexTree<MorphoEntry>(all_elements);
+
+        auto index = MultiIndexTree<MorphoEntry>(output_dir, /* mem = */ size_t(1e6));
+        BOOST_CHECK_EQUAL(index.size(), circuit.n_elements());
+
+        auto box = Box3D{Point3D{20.0, 20.0, 20.0}, Point3D{60.0, 50.0, 70.0}};
+        BOOST_CHECK_EQUAL(index.count_intersecting(box), reference.count_intersecting(box));
     }
 }
 
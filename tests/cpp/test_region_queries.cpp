@@ -0,0 +1,173 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+
+using namespace brain_indexer;
+
+
+static std::vector<IndexedSphere> random_spheres(size_t n, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.1, 1.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(size_t i = 0; i < n; ++i) {
+        auto center = Point3D{pos(gen), pos(gen), pos(gen)};
+        spheres.emplace_back(identifier_t(i), center, radius(gen));
+    }
+
+    return spheres;
+}
+
+/// A column of the given radius along `(1, 1, 1)`, through the center of the domain.
+static OrientedBox column(CoordType radius) {
+    auto s3 = CoordType(1.0 / std::sqrt(3.0));
+    auto s2 = CoordType(1.0 / std::sqrt(2.0));
+    auto s6 = CoordType(1.0 / std::sqrt(6.0));
+
+    auto axes = std::array<Point3D, 3>{
+        Point3D{s3, s3, s3}, Point3D{s2, -s2, 0.0}, Point3D{s6, s6, -2 * s6}
+    };
+    return OrientedBox{Point3D{50.0, 50.0, 50.0}, axes, Point3D{60.0, radius, radius}};
+}
+
+/// A frustum with its apex at the origin, looking along `(1, 1, 1)`.
+static ConvexPolytope frustum() {
+    auto axes = column(1.0).axes;
+    auto u = Point3Dx(axes[0]);
+    auto v = Point3Dx(axes[1]);
+    auto w = Point3Dx(axes[2]);
+
+    // The sides are at 0.2 units from the view direction per unit along it.
+    return ConvexPolytope(std::vector<HalfSpace>{
+        HalfSpace{u * CoordType(-1), -30.0},
+        HalfSpace{u, 140.0},
+        HalfSpace{v - u * CoordType(0.2), 0.0},
+        HalfSpace{v * CoordType(-1) - u * CoordType(0.2), 0.0},
+        HalfSpace{w - u * CoordType(0.2), 0.0},
+        HalfSpace{w * CoordType(-1) - u * CoordType(0.2), 0.0}
+    });
+}
+
+/// A spherical shell of voxels, with thickness `5`, around the center of the domain.
+static VoxelMask shell() {
+    auto n = size_t(25);
+    auto bits = std::vector<std::uint8_t>(n * n * n);
+    for(size_t i = 0; i < n; ++i) {
+        for(size_t j = 0; j < n; ++j) {
+            for(size_t k = 0; k < n; ++k) {
+                auto d = Point3Dx{CoordType(i), CoordType(j), CoordType(k)} - CoordType(n / 2);
+                auto r = d.norm();
+                bits[(i * n + j) * n + k] = std::uint8_t(r >= 8.0 && r < 10.0);
+            }
+        }
+    }
+
+    auto origin = Point3D{-12.5, -12.5, -12.5};
+    return VoxelMask(Point3Dx(origin) * CoordType(2.5) + CoordType(50.0),
+                     Point3D{2.5, 2.5, 2.5},
+                     {n, n, n},
+                     bits.data());
+}
+
+template <class GeometryMode, class ShapeT>
+static std::vector<identifier_t> brute_force_ids(const std::vector<IndexedSphere>& spheres,
+                                                 const ShapeT& shape) {
+    auto ids = std::vector<identifier_t>{};
+    for(const auto& sphere : spheres) {
+        if(geometry_intersects(shape, sphere, GeometryMode{})) {
+            ids.push_back(sphere.id);
+        }
+    }
+
+    return ids;
+}
+
+template <class GeometryMode, class Index, class ShapeT>
+static void check_region_query(const Index& index,
+                               const std::vector<IndexedSphere>& spheres,
+                               const ShapeT& shape) {
+    auto expected = brute_force_ids<GeometryMode>(spheres, shape);
+    BOOST_CHECK(!expected.empty());
+
+    // The region removes most of the elements in its bounding box.
+    auto in_box = brute_force_ids<GeometryMode>(spheres, shape.bounding_box());
+    BOOST_CHECK(2 * expected.size() < in_box.size());
+
+    auto ids = std::vector<identifier_t>{};
+    index.template find_intersecting<GeometryMode>(shape, iter_ids_getter(ids));
+    std::sort(ids.begin(), ids.end());
+    BOOST_CHECK(ids == expected);
+
+    BOOST_CHECK_EQUAL(index.template count_intersecting<GeometryMode>(shape), expected.size());
+    BOOST_CHECK(index.template is_intersecting<GeometryMode>(shape));
+}
+
+template <class Index>
+static void check_region_queries(const Index& index, const std::vector<IndexedSphere>& spheres) {
+    for(auto radius : {CoordType(2.0), CoordType(10.0)}) {
+        check_region_query<BestEffortGeometry>(index, spheres, column(radius));
+        check_region_query<BoundingBoxGeometry>(index, spheres, column(radius));
+        check_region_query<BestEffortGeometry>(index, spheres, ConvexPolytope(column(radius)));
+    }
+
+    check_region_query<BestEffortGeometry>(index, spheres, frustum());
+    check_region_query<BoundingBoxGeometry>(index, spheres, frustum());
+
+    auto mask = shell();
+    check_region_query<BestEffortGeometry>(index, spheres, mask);
+    check_region_query<BoundingBoxGeometry>(index, spheres, mask);
+}
+
+
+BOOST_AUTO_TEST_CASE(RegionQueryIndexTree) {
+    auto spheres = random_spheres(20000, 0);
+
+    check_region_queries(IndexTree<IndexedSphere>(spheres), spheres);
+    check_region_queries(PackedIndexTree<IndexedSphere>(spheres.begin(), spheres.end()), spheres);
+}
+
+BOOST_AUTO_TEST_CASE(RegionQueryMultiIndex) {
+    auto output_dir = std::string("tmp-region-query-q4n7d");
+
+    auto spheres = random_spheres(20000, 1);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(spheres.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<IndexedSphere>(output_dir);
+    builder.insert(spheres.begin() + long(range.low), spheres.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        auto index = MultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+        check_region_queries(index, spheres);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,198 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/remote_storage.hpp>
+
+using namespace brain_indexer;
+
+
+/// Counts the range reads, i.e. the subtrees read from the object store.
+class CountingObjectStore {
+  public:
+    explicit CountingObjectStore(const std::string& root_dir)
+        : store(root_dir) {}
+
+    inline std::optional<std::string> read(const std::string& key) const {
+        return store.read(key);
+    }
+
+    inline std::string read_range(const std::string& key, size_t offset, size_t n_bytes) const {
+        ++(*n_range_reads);
+        return store.read_range(key, offset, n_bytes);
+    }
+
+    inline std::string identity() const {
+        return store.identity();
+    }
+
+    FileObjectStore store;
+    std::shared_ptr<std::atomic<size_t>> n_range_reads = std::make_shared<std::atomic<size_t>>(0);
+};
+
+static std::vector<IndexedSphere> random_spheres(size_t n_spheres, identifier_t first_id) {
+    auto gen = std::mt19937(first_id);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(identifier_t i = 0; i < n_spheres; ++i) {
+        spheres.emplace_back(first_id + i, Point3D{pos(gen), pos(gen), pos(gen)}, 1.0f);
+    }
+
+    return spheres;
+}
+
+static std::vector<Box3D> random_boxes(size_t n_boxes) {
+    auto gen = std::mt19937(42);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 90.0);
+
+    auto boxes = std::vector<Box3D>{};
+    for(size_t i = 0; i < n_boxes; ++i) {
+        auto x = Point3D{pos(gen), pos(gen), pos(gen)};
+        boxes.emplace_back(x, Point3D{x.get<0>() + 10, x.get<1>() + 10, x.get<2>() + 10});
+    }
+
+    return boxes;
+}
+
+template <class Index>
+static std::vector<identifier_t> sorted_matches(const Index& index, const Box3D& box) {
+    auto ids = std::vector<identifier_t>{};
+    index.find_intersecting(box, iter_ids_getter(ids));
+    std::sort(ids.begin(), ids.end());
+
+    return ids;
+}
+
+
+BOOST_AUTO_TEST_CASE(RemoteContainerStorageQueries) {
+    auto output_dir = std::string("tmp-remote-storage-k2w8c");
+    auto cache_dir = std::string("tmp-remote-storage-cache-k2w8c");
+    auto comm_rank = mpi::rank(MPI_COMM_WORLD);
+
+    // The other index has subtrees with the same ids and sizes.
+    auto other_dir = std::string("tmp-remote-storage-other-k2w8c");
+    for(const auto& [dir, first_id] : {std::make_pair(output_dir, identifier_t(0)),
+                                       std::make_pair(other_dir, identifier_t(100000))}) {
+        auto spheres = random_spheres(2000, first_id + identifier_t(comm_rank) * 2000);
+        auto builder = MultiIndexBulkBuilder<IndexedSphere, ContainerStorageT<IndexedSphere>>(
+            dir
+        );
+        builder.insert(spheres.begin(), spheres.end());
+        builder.finalize(MPI_COMM_WORLD);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        using Storage = RemoteContainerStorageT<IndexedSphere, CountingObjectStore>;
+        using Index = MultiIndexTree<IndexedSphere, UsageRateCache<Storage>>;
+
+        auto expected = ContainerMultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+        auto index_dir = resolve_heavy_data_path(output_dir, MetaDataConstants::multi_index_key);
+        auto params = RemoteStorageParams{cache_dir};
+
+        auto store = CountingObjectStore(index_dir);
+        auto index = Index(Storage(store, params), UsageRateCacheParams::from_max_cached_bytes(10000));
+        index.set_prefetch_depth(2);
+        BOOST_CHECK_EQUAL(index.size(), expected.size());
+
+        auto everything = Box3D{{-10.f, -10.f, -10.f}, {110.f, 110.f, 110.f}};
+        auto boxes = random_boxes(50);
+        boxes.push_back(everything);
+        for(const auto& box : boxes) {
+            BOOST_CHECK(sorted_matches(index, box) == sorted_matches(expected, box));
+        }
+
+        // Evicted subtrees are reloaded from the disk cache, in the next process too.
+        auto all = index.subtrees_intersecting({everything});
+        BOOST_CHECK_EQUAL(store.n_range_reads->load(), all.size());
+
+        auto next_store = CountingObjectStore(index_dir);
+        auto next_index = Index(Storage(next_store, params), UsageRateCacheParams(1ul << 30));
+        BOOST_CHECK_EQUAL(next_index.warm_up(all, 3), all.size());
+        BOOST_CHECK_EQUAL(next_store.n_range_reads->load(), 0);
+        for(const auto& box : random_boxes(10)) {
+            BOOST_CHECK(sorted_matches(next_index, box) == sorted_matches(expected, box));
+        }
+
+        // Without a disk cache, every load is a range read.
+        auto uncached_store = CountingObjectStore(index_dir);
+        auto uncached = Storage(uncached_store);
+        uncached.load_subtree(all[0]);
+        uncached.load_subtree(all[0]);
+        BOOST_CHECK_EQUAL(uncached_store.n_range_reads->load(), 2);
+
+        BOOST_CHECK_THROW(uncached.load_subtree(size_t(-1)), std::runtime_error);
+        BOOST_CHECK_THROW(Storage(CountingObjectStore(cache_dir)).load_top_tree(),
+                          std::runtime_error);
+
+        // Indexes sharing a disk cache never see each other's subtrees.
+        auto other_expected = ContainerMultiIndexTree<IndexedSphere>(other_dir, size_t(1) << 30);
+        auto other_index_dir = resolve_heavy_data_path(other_dir, MetaDataConstants::multi_index_key);
+        auto other_store = CountingObjectStore(other_index_dir);
+        auto other = Index(Storage(other_store, params), UsageRateCacheParams(1ul << 30));
+        BOOST_CHECK(sorted_matches(other, everything) == sorted_matches(other_expected, everything));
+        BOOST_CHECK_EQUAL(other_store.n_range_reads->load(),
+                          other.subtrees_intersecting({everything}).size());
+
+        std::filesystem::remove_all(cache_dir);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+        std::filesystem::remove_all(other_dir);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SubtreeDiskCacheEviction) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    auto cache_dir = std::string("tmp-disk-cache-v5n3j");
+    auto bytes = [](char c) { return std::string(100, c); };
+    {
+        auto cache = detail::SubtreeDiskCache(cache_dir, 250);
+        cache.insert(0, bytes('a'));
+        cache.insert(1, bytes('b'));
+
+        // Subtree 0 is used more recently than subtree 1.
+        BOOST_CHECK(cache.find(0, 100) == bytes('a'));
+        cache.insert(2, bytes('c'));
+
+        BOOST_CHECK(!cache.find(1, 100));
+        BOOST_CHECK(cache.find(2, 100) == bytes('c'));
+        BOOST_CHECK_EQUAL(cache.cached_bytes(), 200);
+
+        // A file of the wrong size isn't the subtree.
+        BOOST_CHECK(!cache.find(0, 99));
+    }
+
+    // The files are adopted by the next process; and the oldest are evicted.
+    auto cache = detail::SubtreeDiskCache(cache_dir, 150);
+    BOOST_CHECK_EQUAL(cache.cached_bytes(), 100);
+    BOOST_CHECK_EQUAL(std::distance(std::filesystem::directory_iterator(cache_dir),
+                                    std::filesystem::directory_iterator{}), 1);
+
+    std::filesystem::remove_all(cache_dir);
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,199 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/segment_query.hpp>
+
+using namespace brain_indexer;
+
+using hits_t = std::vector<std::pair<CoordType, identifier_t>>;
+
+
+static std::vector<IndexedSphere> random_spheres(size_t n, identifier_t first_id, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.1, 1.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(size_t i = 0; i < n; ++i) {
+        auto center = Point3D{pos(gen), pos(gen), pos(gen)};
+        spheres.emplace_back(first_id + identifier_t(i), center, radius(gen));
+    }
+
+    return spheres;
+}
+
+/// All hits, sorted by `t`, by testing every element.
+template <class GeometryMode>
+static hits_t brute_force_hits(const std::vector<IndexedSphere>& spheres,
+                               const Point3D& p1,
+                               const Point3D& p2,
+                               CoordType radius) {
+    auto capsule = Cylinder{p1, p2, radius};
+    auto dir = Point3Dx(p2) - p1;
+
+    auto hits = hits_t{};
+    for(const auto& sphere : spheres) {
+        auto box = sphere.bounding_box();
+        auto inflated = Box3D{Point3Dx(box.min_corner()) - radius,
+                              Point3Dx(box.max_corner()) + radius};
+
+        auto t = CoordType(0);
+        if(detail::segment_entry(p1, dir, inflated, t)
+           && geometry_intersects(capsule, sphere, GeometryMode{})) {
+            hits.emplace_back(t, sphere.id);
+        }
+    }
+
+    std::sort(hits.begin(), hits.end());
+    return hits;
+}
+
+static hits_t as_pairs(const std::vector<SegmentHit<IndexedSphere>>& hits) {
+    auto pairs = hits_t{};
+    for(const auto& hit : hits) {
+        pairs.emplace_back(hit.t, hit.value.id);
+    }
+    return pairs;
+}
+
+/// The hits are the first `max_hits` of `expected`, in order.
+static void check_hits(const std::vector<SegmentHit<IndexedSphere>>& found,
+                       const hits_t& expected,
+                       size_t max_hits) {
+    auto pairs = as_pairs(found);
+    BOOST_REQUIRE_EQUAL(pairs.size(), std::min(max_hits, expected.size()));
+
+    for(size_t i = 0; i < pairs.size(); ++i) {
+        BOOST_CHECK_EQUAL(pairs[i].first, expected[i].first);
+        BOOST_CHECK(std::find(expected.begin(), expected.end(), pairs[i]) != expected.end());
+    }
+
+    auto is_sorted = std::is_sorted(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    BOOST_CHECK(is_sorted);
+
+    if(max_hits >= expected.size()) {
+        std::sort(pairs.begin(), pairs.end());
+        BOOST_CHECK(pairs == expected);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SegmentEntry) {
+    auto box = Box3D{Point3D{1.0, 1.0, 1.0}, Point3D{2.0, 2.0, 2.0}};
+    auto t = CoordType(-1);
+
+    BOOST_CHECK(detail::segment_entry(Point3D{0.0, 1.5, 1.5}, Point3D{4.0, 0.0, 0.0}, box, t));
+    BOOST_CHECK_CLOSE(t, 0.25, 1e-4);
+
+    // Starting inside the box.
+    BOOST_CHECK(detail::segment_entry(Point3D{1.5, 1.5, 1.5}, Point3D{4.0, 0.0, 0.0}, box, t));
+    BOOST_CHECK_EQUAL(t, 0.0);
+
+    // Too short, parallel next to it and passing diagonally by the corner.
+    BOOST_CHECK(!detail::segment_entry(Point3D{0.0, 1.5, 1.5}, Point3D{0.5, 0.0, 0.0}, box, t));
+    BOOST_CHECK(!detail::segment_entry(Point3D{0.0, 2.5, 1.5}, Point3D{4.0, 0.0, 0.0}, box, t));
+    BOOST_CHECK(!detail::segment_entry(Point3D{0.0, 4.5, 1.5}, Point3D{4.5, -4.5, 0.0}, box, t));
+}
+
+BOOST_AUTO_TEST_CASE(SegmentQueryIndexTree) {
+    auto spheres = random_spheres(5000, 0, 0);
+    auto index = IndexTree<IndexedSphere>(spheres);
+    auto packed = PackedIndexTree<IndexedSphere>(spheres.begin(), spheres.end());
+
+    // The segment passes through the center of a sphere.
+    auto p1 = Point3Dx(spheres[0].centroid) - Point3D{50.0, 40.0, 30.0};
+    auto p2 = Point3Dx(spheres[0].centroid) + Point3D{60.0, 48.0, 36.0};
+
+    for(auto radius : {CoordType(0), CoordType(0.5), CoordType(2.0)}) {
+        auto expected = brute_force_hits<BestEffortGeometry>(spheres, p1, p2, radius);
+        BOOST_CHECK(!expected.empty());
+
+        check_hits(find_along_segment(index, p1, p2, radius), expected, expected.size());
+        check_hits(find_along_segment(packed, p1, p2, radius), expected, expected.size());
+
+        for(size_t max_hits : {1, 3, 10}) {
+            check_hits(find_along_segment(index, p1, p2, radius, max_hits), expected, max_hits);
+            check_hits(find_along_segment(packed, p1, p2, radius, max_hits), expected, max_hits);
+        }
+
+        auto boxes = brute_force_hits<BoundingBoxGeometry>(spheres, p1, p2, radius);
+        check_hits(find_along_segment<BoundingBoxGeometry>(index, p1, p2, radius),
+                   boxes, boxes.size());
+    }
+
+    // Reversing the segment reverses the order of the hits.
+    auto forward = find_along_segment(index, p1, p2, 1.0f, 1);
+    auto backward = find_along_segment(index, p2, p1, 1.0f);
+    BOOST_REQUIRE(!forward.empty() && !backward.empty());
+    BOOST_CHECK_EQUAL(forward[0].value.id, backward.back().value.id);
+
+    // A segment outside of the index hits nothing.
+    auto empty_index = IndexTree<IndexedSphere>();
+    BOOST_CHECK(find_along_segment(empty_index, p1, p2).empty());
+    BOOST_CHECK(find_along_segment(index, Point3D{200.0, 0.0, 0.0}, Point3D{200.0, 100.0, 0.0}).empty());
+}
+
+BOOST_AUTO_TEST_CASE(SegmentQueryMultiIndex) {
+    auto output_dir = std::string("tmp-segment-query-w8c3e");
+
+    auto spheres = random_spheres(8000, 0, 1);
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(spheres.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<IndexedSphere>(output_dir);
+    builder.insert(spheres.begin() + long(range.low), spheres.begin() + long(range.high));
+    builder.finalize(MPI_COMM_WORLD);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        auto index = MultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+
+        auto p1 = Point3D{0.0, 50.0, -5.0};
+        auto p2 = Point3D{100.0, 40.0, 105.0};
+        for(auto radius : {CoordType(0), CoordType(1.5)}) {
+            auto expected = brute_force_hits<BestEffortGeometry>(spheres, p1, p2, radius);
+            check_hits(find_along_segment(index, p1, p2, radius), expected, expected.size());
+
+            for(size_t max_hits : {1, 4, 25}) {
+                check_hits(find_along_segment(index, p1, p2, radius, max_hits), expected, max_hits);
+            }
+        }
+
+        // The first hit only needs the subtrees at the start of the segment.
+        auto cold = MultiIndexTree<IndexedSphere>(output_dir, size_t(1) << 30);
+        find_along_segment(cold, p1, p2, 1.5f, 1);
+        BOOST_CHECK(cold.cached_bytes() < index.cached_bytes());
+
+        auto tiny_cache = MultiIndexTree<IndexedSphere>(output_dir, 1);
+        auto expected = brute_force_hits<BestEffortGeometry>(spheres, p1, p2, 1.5f);
+        check_hits(find_along_segment(tiny_cache, p1, p2, 1.5f), expected, expected.size());
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -179,6 +179,50 @@ BOOST_AUTO_TEST_CASE(SerialSTRTests) {
     check_bounding_boxes(values, partition_boundaries, str_params, domain);
 }
 
+BOOST_AUTO_TEST_CASE(ParallelSTRTests) {
+    if(mpi::rank(MPI_COMM_WORLD) != 0) {
+        return;
+    }
+
+    // Large enough that the top levels use the parallel merge sort.
+    size_t n_values = 200000ul;
+    std::vector<Value> values;
+    values.reserve(n_values);
+
+    auto domain = std::array<float, 2>{-1.0, 1.0};
+    auto gen = std::default_random_engine{};
+    auto dist = std::uniform_real_distribution<float>(domain[0], domain[1]);
+
+    for(size_t i = 0; i < n_values; ++i) {
+        values.push_back(Value{{dist(gen), dist(gen), dist(gen)}, {0ul, i}});
+    }
+
+    auto str_params = SerialSTRParams{n_values, {5ul, 3ul, 2ul}};
+    auto boundaries = str_params.partition_boundaries();
+
+    auto expected = values;
+    serial_sort_tile_recursion<Value, GetCoordFromValue>(expected, str_params);
+
+    auto part_ids = [&boundaries](const std::vector<Value>& v, size_t k) {
+        auto ids = std::vector<size_t>{};
+        for(size_t i = boundaries[k]; i < boundaries[k + 1]; ++i) {
+            ids.push_back(v[i].payload[1]);
+        }
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    for(size_t n_threads : {1ul, 3ul, 8ul}) {
+        auto actual = values;
+        parallel_sort_tile_recursion<Value, GetCoordFromValue>(actual, str_params, n_threads);
+
+        check_nothing_got_lost(actual, n_values, 0);
+        for(size_t k = 0; k < str_params.n_parts(); ++k) {
+            BOOST_REQUIRE(part_ids(actual, k) == part_ids(expected, k));
+        }
+    }
+}
+
 std::vector<Value> random_values(size_t n_values,
                                  const std::array<float, 2> &domain,
                                  int comm_rank) {
@@ -0,0 +1,118 @@
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+#include <boost/iterator/function_output_iterator.hpp>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/sonata_edges.hpp>
+
+using namespace brain_indexer;
+
+static const std::string edges_filename = "test_sonata_edges.h5";
+static constexpr size_t n_edges = 1000;
+
+
+template <class T>
+static void write_dataset(hid_t group, const std::string& name, const std::vector<T>& values) {
+    hsize_t size = values.size();
+    auto space = detail::Hdf5Handle(H5Screate_simple(1, &size, nullptr), H5Sclose);
+    auto dataset = detail::Hdf5Handle(
+        H5Dcreate2(group, name.c_str(), detail::hdf5_native_type<T>(), space,
+                   H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT),
+        H5Dclose
+    );
+    H5Dwrite(dataset, detail::hdf5_native_type<T>(), H5S_ALL, H5S_ALL, H5P_DEFAULT,
+             values.data());
+}
+
+static void write_edges_file() {
+    auto file = detail::Hdf5Handle(
+        H5Fcreate(edges_filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT), H5Fclose
+    );
+
+    auto edges = detail::Hdf5Handle(
+        H5Gcreate2(file, "edges", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT), H5Gclose
+    );
+    auto population = detail::Hdf5Handle(
+        H5Gcreate2(edges, "pop", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT), H5Gclose
+    );
+    auto attributes = detail::Hdf5Handle(
+        H5Gcreate2(population, "0", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT), H5Gclose
+    );
+
+    std::vector<identifier_t> source_ids(n_edges), target_ids(n_edges);
+    std::vector<CoordType> x(n_edges), y(n_edges), z(n_edges);
+    for(size_t i = 0; i < n_edges; ++i) {
+        source_ids[i] = i % 7;
+        target_ids[i] = i / 10;
+        x[i] = CoordType(i);
+        y[i] = CoordType(2 * i);
+        z[i] = -CoordType(i);
+    }
+
+    write_dataset(population, "source_node_id", source_ids);
+    write_dataset(population, "target_node_id", target_ids);
+    write_dataset(attributes, "afferent_center_x", x);
+    write_dataset(attributes, "afferent_center_y", y);
+    write_dataset(attributes, "afferent_center_z", z);
+}
+
+static void check_synapse(const Synapse& synapse) {
+    auto i = synapse.id;
+    BOOST_CHECK_EQUAL(synapse.pre_gid(), i % 7);
+    BOOST_CHECK_EQUAL(synapse.post_gid(), i / 10);
+    BOOST_CHECK_EQUAL(synapse.centroid.get<0>(), CoordType(i));
+    BOOST_CHECK_EQUAL(synapse.centroid.get<1>(), CoordType(2 * i));
+    BOOST_CHECK_EQUAL(synapse.centroid.get<2>(), -CoordType(i));
+}
+
+
+BOOST_AUTO_TEST_CASE(ReadSonataEdgesInBlocks) {
+    write_edges_file();
+    auto reader = SonataEdgeReader(edges_filename, "pop");
+    BOOST_CHECK_EQUAL(reader.size(), n_edges);
+
+    auto ranges = std::vector<std::pair<size_t, size_t>>{{3, 50}, {100, 100}, {990, 1000}};
+    auto ids = std::vector<identifier_t>{};
+    reader.read(ranges,
+                boost::make_function_output_iterator([&ids](const Synapse& synapse) {
+                    check_synapse(synapse);
+                    ids.push_back(synapse.id);
+                }),
+                /* block_size = */ 16);
+
+    BOOST_REQUIRE_EQUAL(ids.size(), 57);
+    BOOST_CHECK_EQUAL(ids.front(), 3);
+    BOOST_CHECK_EQUAL(ids[46], 49);
+    BOOST_CHECK_EQUAL(ids[47], 990);
+    BOOST_CHECK_EQUAL(ids.back(), 999);
+}
+
+
+BOOST_AUTO_TEST_CASE(InsertSonataEdges) {
+    write_edges_file();
+    auto reader = SonataEdgeReader(edges_filename, "pop");
+
+    IndexTree<Synapse> index;
+    reader.insert_into(index, {{0, n_edges}}, /* block_size = */ 100);
+    BOOST_CHECK_EQUAL(index.size(), n_edges);
+
+    for(const auto& synapse : index) {
+        check_synapse(synapse);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(InvalidSonataEdges) {
+    write_edges_file();
+    auto reader = SonataEdgeReader(edges_filename, "pop");
+
+    IndexTree<Synapse> index;
+    BOOST_CHECK_THROW(reader.insert_into(index, {{0, n_edges + 1}}), std::out_of_range);
+    BOOST_CHECK_THROW(reader.insert_into(index, {{0, 10}}, 0), std::invalid_argument);
+    BOOST_CHECK_THROW(SonataEdgeReader(edges_filename, "missing"), std::runtime_error);
+    BOOST_CHECK_THROW(SonataEdgeReader("missing.h5", "pop"), std::runtime_error);
+}
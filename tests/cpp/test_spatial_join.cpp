@@ -0,0 +1,286 @@
+#define BOOST_TEST_NO_MAIN
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+namespace bt = boost::unit_test;
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/multi_index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
+#include <brain_indexer/spatial_join.hpp>
+
+using namespace brain_indexer;
+
+using id_pairs = std::vector<std::pair<identifier_t, identifier_t>>;
+
+
+static std::vector<MorphoEntry> random_morpho_entries(size_t n, identifier_t first_gid, size_t seed) {
+    auto gen = std::mt19937(seed);
+    auto pos = std::uniform_real_distribution<CoordType>(0.0, 100.0);
+    auto offset = std::uniform_real_distribution<CoordType>(-3.0, 3.0);
+    auto radius = std::uniform_real_distribution<CoordType>(0.1, 1.0);
+
+    auto elements = std::vector<MorphoEntry>{};
+    for(size_t i = 0; i < n; ++i) {
+        auto gid = first_gid + identifier_t(i);
+        auto p1 = Point3D{pos(gen), pos(gen), pos(gen)};
+        if(i % 10 == 0) {
+            elements.emplace_back(Soma(gid, p1, radius(gen)));
+        } else {
+            auto p2 = Point3Dx(p1) + Point3D{offset(gen), offset(gen), offset(gen)};
+            elements.emplace_back(Segment(gid, 0u, 0u, p1, p2, radius(gen)));
+        }
+    }
+
+    return elements;
+}
+
+
+template <class GeometryMode>
+static id_pairs brute_force_join(const std::vector<MorphoEntry>& a,
+                                 const std::vector<MorphoEntry>& b,
+                                 CoordType distance) {
+    auto ids = id_pairs{};
+    for(const auto& x : a) {
+        for(const auto& y : b) {
+            // As in queries, only elements whose boxes are near are tested.
+            if(within_distance(x, y, distance, BoundingBoxGeometry{})
+               && within_distance(x, y, distance, GeometryMode{})) {
+                ids.emplace_back(detail::get_id_from(x), detail::get_id_from(y));
+            }
+        }
+    }
+
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static id_pairs sorted(id_pairs ids) {
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+/// \brief Sorted, with the smaller id first in every pair.
+static id_pairs unordered(id_pairs ids) {
+    for(auto& [a, b] : ids) {
+        if(b < a) {
+            std::swap(a, b);
+        }
+    }
+
+    return sorted(std::move(ids));
+}
+
+
+/** \brief Checks the result of a self-join.
+ *
+ *  The exact test isn't perfectly symmetric due to rounding. Hence, pairs
+ *  which match in both orders must be found, pairs which match in neither
+ *  must not.
+ */
+static void check_self_join(const std::vector<MorphoEntry>& elements,
+                            CoordType distance,
+                            const id_pairs& actual) {
+    auto certain = id_pairs{};
+    auto possible = id_pairs{};
+    for(size_t i = 0; i < elements.size(); ++i) {
+        for(size_t j = i + 1; j < elements.size(); ++j) {
+            const auto& x = elements[i];
+            const auto& y = elements[j];
+            if(!within_distance(x, y, distance, BoundingBoxGeometry{})) {
+                continue;
+            }
+
+            auto xy = within_distance(x, y, distance, BestEffortGeometry{});
+            auto yx = within_distance(y, x, distance, BestEffortGeometry{});
+            auto ids = std::make_pair(detail::get_id_from(x), detail::get_id_from(y));
+            if(xy && yx) {
+                certain.push_back(ids);
+            }
+            if(xy || yx) {
+                possible.push_back(ids);
+            }
+        }
+    }
+
+    auto found = unordered(actual);
+    BOOST_CHECK(!certain.empty());
+    BOOST_CHECK(std::adjacent_find(found.begin(), found.end()) == found.end());
+    BOOST_CHECK(std::includes(found.begin(), found.end(), certain.begin(), certain.end()));
+    BOOST_CHECK(std::includes(possible.begin(), possible.end(), found.begin(), found.end()));
+}
+
+
+BOOST_AUTO_TEST_CASE(WithinDistance) {
+    auto a = Segment(0, 0u, 0u, Point3D{0.0, 0.0, 0.0}, Point3D{10.0, 0.0, 0.0}, 1.0);
+    auto b = Segment(1, 0u, 0u, Point3D{5.0, 3.0, -5.0}, Point3D{5.0, 3.0, 5.0}, 0.5);
+
+    // The axes are 3.0 apart, i.e. the surfaces 1.5.
+    BOOST_CHECK(!within_distance(a, b, 1.4f, BestEffortGeometry{}));
+    BOOST_CHECK(within_distance(a, b, 1.6f, BestEffortGeometry{}));
+
+    // The bounding boxes are 1.5 apart along the y-axis.
+    BOOST_CHECK(!within_distance(a, b, 1.4f, BoundingBoxGeometry{}));
+    BOOST_CHECK(within_distance(a, b, 1.6f, BoundingBoxGeometry{}));
+
+    auto soma = MorphoEntry(Soma(2, Point3D{5.0, -4.0, 0.0}, 1.0));
+    BOOST_CHECK(!within_distance(soma, MorphoEntry(a), 1.9f, BestEffortGeometry{}));
+    BOOST_CHECK(within_distance(soma, MorphoEntry(a), 2.1f, BestEffortGeometry{}));
+}
+
+
+BOOST_AUTO_TEST_CASE(SpatialJoinIndexTree) {
+    auto elements_a = random_morpho_entries(2000, 0, 0);
+    auto elements_b = random_morpho_entries(3000, 10000, 1);
+
+    auto index_a = IndexTree<MorphoEntry>(elements_a);
+    auto index_b = IndexTree<MorphoEntry>(elements_b);
+
+    for(auto distance : {CoordType(0.0), CoordType(0.5), CoordType(2.0)}) {
+        auto expected = brute_force_join<BestEffortGeometry>(elements_a, elements_b, distance);
+        BOOST_CHECK(!expected.empty());
+
+        auto actual = sorted(spatial_join_ids(index_a, index_b, distance));
+        BOOST_CHECK(actual == expected);
+
+        for(size_t n_threads : {2, 4}) {
+            auto parallel = sorted(spatial_join_ids(index_a, index_b, distance, n_threads));
+            BOOST_CHECK(parallel == expected);
+        }
+
+        auto expected_boxes = brute_force_join<BoundingBoxGeometry>(elements_a, elements_b, distance);
+        auto actual_boxes = sorted(
+            spatial_join_ids<BoundingBoxGeometry>(index_a, index_b, distance, 3)
+        );
+        BOOST_CHECK(actual_boxes == expected_boxes);
+        BOOST_CHECK(actual_boxes.size() >= expected.size());
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SpatialJoinSink) {
+    auto elements_a = random_morpho_entries(500, 0, 2);
+    auto elements_b = random_morpho_entries(500, 10000, 3);
+    auto index_a = IndexTree<MorphoEntry>(elements_a);
+    auto index_b = IndexTree<MorphoEntry>(elements_b);
+
+    // The values are passed to the sink, e.g. to also read the segment ids.
+    size_t n_pairs = 0;
+    spatial_join(index_a, index_b, 1.0f, [&n_pairs](const MorphoEntry& a, const MorphoEntry& b) {
+        BOOST_CHECK(within_distance(a, b, 1.0f, BestEffortGeometry{}));
+        ++n_pairs;
+    }, 4);
+
+    BOOST_CHECK_EQUAL(n_pairs, brute_force_join<BestEffortGeometry>(elements_a, elements_b, 1.0f).size());
+
+    auto empty = IndexTree<MorphoEntry>();
+    BOOST_CHECK(spatial_join_ids(index_a, empty, 1.0f).empty());
+    BOOST_CHECK(spatial_join_ids(empty, index_b, 1.0f).empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(SpatialJoinPackedIndexTree) {
+    auto elements_a = random_morpho_entries(2000, 0, 4);
+    auto elements_b = random_morpho_entries(2000, 10000, 5);
+    auto expected = brute_force_join<BestEffortGeometry>(elements_a, elements_b, 1.0f);
+
+    auto index_a = PackedIndexTree<MorphoEntry>(elements_a.begin(), elements_a.end());
+    auto index_b = IndexTree<MorphoEntry>(elements_b);
+    auto compact_b = PackedIndexTree<MorphoEntry>(elements_b.begin(),
+                                                  elements_b.end(),
+                                                  PackedLeafFormat::compact);
+
+    BOOST_CHECK(sorted(spatial_join_ids(index_a, index_b, 1.0f)) == expected);
+    BOOST_CHECK(sorted(spatial_join_ids(index_a, compact_b, 1.0f, 4)) == expected);
+}
+
+
+BOOST_AUTO_TEST_CASE(SelfJoinIndexTree) {
+    auto elements = random_morpho_entries(3000, 0, 8);
+    auto index = IndexTree<MorphoEntry>(elements);
+    auto packed = PackedIndexTree<MorphoEntry>(elements.begin(), elements.end());
+
+    for(auto distance : {CoordType(0.0), CoordType(1.0)}) {
+        check_self_join(elements, distance, self_join_ids(index, distance));
+        check_self_join(elements, distance, self_join_ids(index, distance, 4));
+        check_self_join(elements, distance, self_join_ids(packed, distance, 3));
+    }
+
+    auto expected_boxes = id_pairs{};
+    for(const auto& [a, b] : brute_force_join<BoundingBoxGeometry>(elements, elements, 1.0f)) {
+        if(a < b) {
+            expected_boxes.emplace_back(a, b);
+        }
+    }
+    BOOST_CHECK(unordered(self_join_ids<BoundingBoxGeometry>(index, 1.0f, 2)) == expected_boxes);
+
+    auto empty = IndexTree<MorphoEntry>();
+    BOOST_CHECK(self_join_ids(empty, 1.0f).empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(SpatialJoinMultiIndex) {
+    auto output_dir = std::string("tmp-spatial-join-hu3fd");
+
+    auto elements_a = random_morpho_entries(4000, 0, 6);
+    auto elements_b = random_morpho_entries(1000, 10000, 7);
+
+    auto comm_rank = size_t(mpi::rank(MPI_COMM_WORLD));
+    auto comm_size = size_t(mpi::size(MPI_COMM_WORLD));
+    auto range = util::balanced_chunks(elements_a.size(), comm_size, comm_rank);
+
+    auto builder = MultiIndexBulkBuilder<MorphoEntry>(output_dir);
+    builder.insert(elements_a.begin() + range.low, elements_a.begin() + range.high);
+    builder.finalize(MPI_COMM_WORLD);
+
+    if(comm_rank == 0) {
+        auto expected = brute_force_join<BestEffortGeometry>(elements_a, elements_b, 1.0f);
+        auto index_a = MultiIndexTree<MorphoEntry>(output_dir, size_t(1) << 30);
+        auto index_b = IndexTree<MorphoEntry>(elements_b);
+
+        BOOST_CHECK(sorted(spatial_join_ids(index_a, index_b, 1.0f)) == expected);
+        BOOST_CHECK(sorted(spatial_join_ids(index_a, index_b, 1.0f, 4)) == expected);
+
+        // The multi-index can also be the second argument.
+        auto expected_ba = brute_force_join<BestEffortGeometry>(elements_b, elements_a, 1.0f);
+        BOOST_CHECK(sorted(spatial_join_ids(index_b, index_a, 1.0f)) == expected_ba);
+
+        // Only the subtrees near `index_b` are loaded.
+        auto small_b = IndexTree<MorphoEntry>(
+            std::vector<MorphoEntry>{Soma(20000, Point3D{1.0, 1.0, 1.0}, 1.0)}
+        );
+        auto cold_a = MultiIndexTree<MorphoEntry>(output_dir, size_t(1) << 30);
+        spatial_join_ids(cold_a, small_b, 1.0f);
+        BOOST_CHECK(cold_a.cached_bytes() < index_a.cached_bytes());
+
+        auto expected_aa = brute_force_join<BestEffortGeometry>(elements_a, elements_a, 0.5f);
+        BOOST_CHECK(sorted(spatial_join_ids(index_a, cold_a, 0.5f)) == expected_aa);
+
+        // Pairs across subtrees are found, even if only one subtree fits
+        // into the cache.
+        check_self_join(elements_a, 1.0f, self_join_ids(index_a, 1.0f));
+        check_self_join(elements_a, 1.0f, self_join_ids(index_a, 1.0f, 4));
+
+        auto tiny_cache = MultiIndexTree<MorphoEntry>(output_dir, 1);
+        check_self_join(elements_a, 1.0f, self_join_ids(tiny_cache, 1.0f));
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    if(comm_rank == 0) {
+        std::filesystem::remove_all(output_dir);
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+
+    auto return_code = bt::unit_test_main([](){ return true; }, argc, argv );
+
+    MPI_Finalize();
+    return return_code;
+}
@@ -0,0 +1,127 @@
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/split_morph_index.hpp>
+
+using namespace brain_indexer;
+
+
+static std::vector<MorphoEntry> random_morpho_entries(size_t n_entries,
+                                                      std::default_random_engine& gen) {
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto dir_dist = std::uniform_real_distribution<CoordType>(-1.0, 1.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.01, 0.3);
+
+    auto entries = std::vector<MorphoEntry>{};
+    entries.reserve(n_entries);
+    for(size_t i = 0; i < n_entries; ++i) {
+        auto p1 = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        if(i % 20 == 0) {
+            entries.emplace_back(Soma(identifier_t(i), p1, 5 * radius_dist(gen)));
+        } else {
+            auto p2 = Point3Dx(p1) + Point3Dx{dir_dist(gen), dir_dist(gen), dir_dist(gen)};
+            entries.emplace_back(Segment(identifier_t(i), 1u, 2u, p1, p2, radius_dist(gen)));
+        }
+    }
+
+    return entries;
+}
+
+template <class Index, class Shape>
+static std::vector<identifier_t> sorted_intersecting_ids(const Index& index, const Shape& shape) {
+    auto ids = std::vector<identifier_t>{};
+    index.template find_intersecting<BestEffortGeometry>(shape, iter_ids_getter(ids));
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+static std::vector<identifier_t> sorted_gids(const std::vector<gid_segm_t>& ids) {
+    auto gids = std::vector<identifier_t>{};
+    for(const auto& id : ids) {
+        gids.push_back(id.gid);
+    }
+    std::sort(gids.begin(), gids.end());
+    return gids;
+}
+
+template <class Index>
+static void check_against_morph_index(const Index& index,
+                                      const IndexTree<MorphoEntry>& reference,
+                                      std::default_random_engine& gen) {
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+    auto radius_dist = std::uniform_real_distribution<CoordType>(0.0, 2.0);
+
+    BOOST_CHECK(index.size() == reference.size());
+
+    for(size_t i = 0; i < 100; ++i) {
+        auto center = Point3D{pos_dist(gen), pos_dist(gen), pos_dist(gen)};
+        auto sphere = Sphere{center, radius_dist(gen)};
+        auto box = make_query_box(center, Point3Dx(center) + radius_dist(gen));
+
+        auto expected = sorted_intersecting_ids(reference, sphere);
+        BOOST_CHECK(sorted_intersecting_ids(index, sphere) == expected);
+        BOOST_CHECK(sorted_intersecting_ids(index, box) == sorted_intersecting_ids(reference, box));
+        BOOST_CHECK(index.template count_intersecting<BestEffortGeometry>(sphere) == expected.size());
+        BOOST_CHECK(index.template is_intersecting<BestEffortGeometry>(sphere) == !expected.empty());
+        BOOST_CHECK(index.template find_intersecting_objs<BestEffortGeometry>(sphere).size()
+                    == expected.size());
+        BOOST_CHECK(index.template find_intersecting_np<BestEffortGeometry>(sphere).gid.size()
+                    == expected.size());
+
+        // Ties are unlikely with random coordinates; therefore, the neighbours are unique.
+        BOOST_CHECK(sorted_gids(index.find_nearest(center, 5))
+                    == sorted_gids(reference.find_nearest(center, 5)));
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SplitMorphIndexQueries) {
+    auto gen = std::default_random_engine{};
+    auto entries = random_morpho_entries(3000, gen);
+    auto reference = IndexTree<MorphoEntry>(entries);
+
+    auto index = SplitMorphIndexTree<IndexTree>(reference);
+    BOOST_CHECK(index.somas().size() == 150);
+    BOOST_CHECK(bg::equals(index.bounds(), reference.bounds()));
+    check_against_morph_index(index, reference, gen);
+
+    auto packed_index = SplitMorphIndexTree<PackedIndexTree>(entries.begin(), entries.end());
+    BOOST_CHECK(bg::equals(packed_index.bounds(), reference.bounds()));
+    check_against_morph_index(packed_index, reference, gen);
+}
+
+
+BOOST_AUTO_TEST_CASE(SplitMorphIndexEmpty) {
+    auto index = SplitMorphIndexTree<PackedIndexTree>{};
+
+    BOOST_CHECK(index.empty());
+    BOOST_CHECK(index.count_intersecting(Sphere{{0., 0., 0.}, 1.}) == 0);
+    BOOST_CHECK(index.find_nearest(Point3D{0., 0., 0.}, 3).empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(SplitMorphIndexBatch) {
+    auto gen = std::default_random_engine{};
+    auto entries = random_morpho_entries(2000, gen);
+    auto index = SplitMorphIndexTree<PackedIndexTree>(entries.begin(), entries.end());
+
+    auto spheres = std::vector<Sphere>{};
+    for(size_t i = 0; i < 50; ++i) {
+        spheres.push_back(Sphere{Point3D{CoordType(i % 10) - 5, CoordType(i / 10) - 3, 0.}, 1.5});
+    }
+
+    auto batch = index.find_intersecting_batch<BestEffortGeometry>(spheres, 3);
+    BOOST_REQUIRE(batch.offsets.size() == spheres.size() + 1);
+    for(size_t i = 0; i < spheres.size(); ++i) {
+        auto expected = sorted_intersecting_ids(index, spheres[i]);
+        auto gids = std::vector<identifier_t>(batch.values.gid.begin() + batch.offsets[i],
+                                              batch.values.gid.begin() + batch.offsets[i + 1]);
+        std::sort(gids.begin(), gids.end());
+        BOOST_CHECK(gids == expected);
+    }
+}
@@ -0,0 +1,123 @@
+#define BOOST_TEST_MODULE BrainIndexer_UnitTests
+#include <boost/test/unit_test.hpp>
+
+#include <iterator>
+#include <vector>
+
+#include <brain_indexer/index.hpp>
+#include <brain_indexer/synthetic_data.hpp>
+
+using namespace brain_indexer;
+
+
+static SyntheticCircuit make_circuit(SyntheticDistribution distribution) {
+    auto circuit = SyntheticCircuit{};
+    circuit.distribution = distribution;
+    circuit.domain = Box3D{Point3D{0.0f, 0.0f, 0.0f}, Point3D{100.0f, 100.0f, 50.0f}};
+    circuit.density = 0.01;
+    circuit.sections_per_neuron = 5;
+    circuit.segments_per_section = 7;
+    circuit.n_clusters = 3;
+    circuit.cluster_radius = 5.0f;
+    circuit.seed = 42;
+
+    return circuit;
+}
+
+static const SyntheticDistribution distributions[] = {
+    SyntheticDistribution::uniform,
+    SyntheticDistribution::clustered,
+    SyntheticDistribution::morphology
+};
+
+
+BOOST_AUTO_TEST_CASE(SyntheticSegmentsAreReproducible) {
+    for(auto distribution : distributions) {
+        auto circuit = make_circuit(distribution);
+        auto n_elements = circuit.n_elements();
+        BOOST_REQUIRE_EQUAL(n_elements, 5000);
+
+        std::vector<Segment> all, split;
+        generate_synthetic_segments(circuit, 0, n_elements, std::back_inserter(all));
+
+        // The elements don't depend on how the range is split.
+        for(auto [low, high] : {std::pair<size_t, size_t>{0, 17}, {17, 1001}, {1001, 6000}}) {
+            generate_synthetic_segments(circuit, low, high, std::back_inserter(split));
+        }
+
+        BOOST_REQUIRE_EQUAL(all.size(), n_elements);
+        BOOST_REQUIRE_EQUAL(split.size(), n_elements);
+        for(size_t i = 0; i < n_elements; ++i) {
+            BOOST_CHECK(Point3Dx(all[i].p1) == split[i].p1);
+            BOOST_CHECK(Point3Dx(all[i].p2) == split[i].p2);
+            BOOST_CHECK_EQUAL(all[i].gid(), i / 35);
+            BOOST_CHECK_EQUAL(all[i].section_id(), (i % 35) / 7 + 1);
+            BOOST_CHECK_EQUAL(all[i].segment_id(), i % 7);
+            BOOST_CHECK_CLOSE(Point3Dx(all[i].p1).distance(all[i].p2), circuit.segment_length, 1e-3);
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SyntheticDistributions) {
+    auto count_in_domain = [](const SyntheticCircuit& circuit) {
+        std::vector<Segment> segments;
+        generate_synthetic_segments(circuit, 0, circuit.n_elements(), std::back_inserter(segments));
+
+        size_t count = 0;
+        for(const auto& segment : segments) {
+            count += boost::geometry::within(segment.p1, circuit.domain);
+        }
+        return count;
+    };
+
+    auto uniform = make_circuit(SyntheticDistribution::uniform);
+    BOOST_CHECK_EQUAL(count_in_domain(uniform), uniform.n_elements());
+
+    // Consecutive segments of a morphology are connected.
+    auto morphology = make_circuit(SyntheticDistribution::morphology);
+    std::vector<Segment> segments;
+    generate_synthetic_segments(morphology, 0, 35, std::back_inserter(segments));
+    for(size_t i = 1; i < segments.size(); ++i) {
+        if(segments[i].segment_id() != 0) {
+            BOOST_CHECK(Point3Dx(segments[i - 1].p2) == segments[i].p1);
+        }
+    }
+
+    // Clustered segments are close to one of few centers.
+    auto clustered = make_circuit(SyntheticDistribution::clustered);
+    auto centers = detail::synthetic_cluster_centers(clustered);
+    BOOST_REQUIRE_EQUAL(centers.size(), 3);
+
+    segments.clear();
+    generate_synthetic_segments(clustered, 0, 1000, std::back_inserter(segments));
+    for(const auto& segment : segments) {
+        auto closest = Point3Dx(segment.p1).distance(centers[0]);
+        for(const auto& center : centers) {
+            closest = std::min(closest, Point3Dx(segment.p1).distance(center));
+        }
+
+        BOOST_CHECK_LT(closest, 10 * clustered.cluster_radius);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(SyntheticSynapses) {
+    auto circuit = make_circuit(SyntheticDistribution::morphology);
+
+    std::vector<Synapse> synapses;
+    std::vector<Segment> segments;
+    generate_synthetic_synapses(circuit, 100, 200, std::back_inserter(synapses));
+    generate_synthetic_segments(circuit, 100, 200, std::back_inserter(segments));
+
+    BOOST_REQUIRE_EQUAL(synapses.size(), 100);
+    for(size_t i = 0; i < synapses.size(); ++i) {
+        BOOST_CHECK_EQUAL(synapses[i].id, 100 + i);
+        BOOST_CHECK_EQUAL(synapses[i].post_gid(), segments[i].gid());
+        BOOST_CHECK_LT(synapses[i].pre_gid(), 5000 / 35);
+        BOOST_CHECK(Point3Dx(synapses[i].centroid) == segments[i].p1);
+    }
+
+    IndexTree<Synapse> index(synapses);
+    BOOST_CHECK_EQUAL(index.size(), 100);
+}
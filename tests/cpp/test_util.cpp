@@ -2,8 +2,12 @@
 #include <boost/test/unit_test.hpp>
 namespace bt = boost::unit_test;
 
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <random>
+#include <unordered_map>
+#include <vector>
 
 #include <brain_indexer/util.hpp>
 
@@ -24,3 +28,121 @@ BOOST_AUTO_TEST_CASE(CheckThrowNoSuchFile) {
         }
     }, std::runtime_error);
 }
+
+
+BOOST_AUTO_TEST_CASE(WeightedBalancedChunks) {
+    auto weights = std::vector<size_t>{10, 1, 1, 1, 1, 10};
+
+    auto first = util::balanced_chunks(weights, 2, 0);
+    auto second = util::balanced_chunks(weights, 2, 1);
+    BOOST_CHECK_EQUAL(first.low, 0);
+    BOOST_CHECK_EQUAL(first.high, 3);
+    BOOST_CHECK_EQUAL(second.low, 3);
+    BOOST_CHECK_EQUAL(second.high, 6);
+
+    // The chunks cover every element exactly once, even if some are empty.
+    size_t high = 0;
+    for(size_t k = 0; k < 10; ++k) {
+        auto chunk = util::balanced_chunks(weights, 10, k);
+        BOOST_CHECK_EQUAL(chunk.low, high);
+        BOOST_CHECK(chunk.low <= chunk.high);
+        high = chunk.high;
+    }
+    BOOST_CHECK_EQUAL(high, weights.size());
+
+    auto unweighted = util::balanced_chunks(std::vector<size_t>(5, 0), 2, 1);
+    BOOST_CHECK_EQUAL(unweighted.low, 3);
+    BOOST_CHECK_EQUAL(unweighted.high, 5);
+}
+
+
+BOOST_AUTO_TEST_CASE(FlatCounterMatchesUnorderedMap) {
+    auto gen = std::default_random_engine{};
+    auto key_dist = std::uniform_int_distribution<unsigned long>(0, 1000);
+
+    auto counter = util::FlatCounter<unsigned long>{};
+    auto expected = std::unordered_map<unsigned long, size_t>{};
+    for(size_t i = 0; i < 10000; ++i) {
+        auto key = key_dist(gen);
+        counter.add(key);
+        expected[key] += 1;
+    }
+
+    // The largest key marks empty slots internally.
+    auto max_key = std::numeric_limits<unsigned long>::max();
+    counter.add(max_key, 3);
+    expected[max_key] += 3;
+
+    BOOST_CHECK(counter.size() == expected.size());
+    BOOST_CHECK(counter.to_unordered_map() == expected);
+    BOOST_CHECK(counter.count(max_key) == 3);
+    BOOST_CHECK(counter.count(1001) == 0);
+    BOOST_CHECK(util::FlatCounter<unsigned long>{}.count(0) == 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(MonotonicArenaAllocates) {
+    auto arena = util::MonotonicArena(1024);
+
+    auto a = static_cast<char*>(arena.allocate(3, 1));
+    auto b = static_cast<double*>(arena.allocate(5 * sizeof(double), alignof(double)));
+    BOOST_CHECK(reinterpret_cast<std::uintptr_t>(b) % alignof(double) == 0);
+    BOOST_CHECK(reinterpret_cast<char*>(b) > a);
+    BOOST_CHECK(arena.n_blocks() == 1);
+    BOOST_CHECK(arena.reserved_bytes() == 1024);
+
+    // Filling the block starts a new one, twice as large.
+    arena.allocate(1000, 1);
+    BOOST_CHECK(arena.n_blocks() == 2);
+    BOOST_CHECK(arena.reserved_bytes() == 1024 + 2048);
+
+    // Large requests get a block of their own.
+    auto c = arena.allocate(size_t(1) << 20, 64);
+    BOOST_CHECK(reinterpret_cast<std::uintptr_t>(c) % 64 == 0);
+    BOOST_CHECK(arena.n_blocks() == 3);
+}
+
+
+BOOST_AUTO_TEST_CASE(ArenaAllocatorSharesArena) {
+    auto alloc = util::ArenaAllocator<int>{};
+    auto rebound = util::ArenaAllocator<double>(alloc);
+    BOOST_CHECK(alloc == rebound);
+    BOOST_CHECK(alloc != util::ArenaAllocator<int>{});
+
+    auto values = std::vector<int, util::ArenaAllocator<int>>(alloc);
+    for(int i = 0; i < 1000; ++i) {
+        values.push_back(i);
+    }
+
+    BOOST_CHECK(values.back() == 999);
+    BOOST_CHECK(alloc.allocated_bytes() >= 1000 * sizeof(int));
+    BOOST_CHECK(&rebound.arena() == &alloc.arena());
+}
+
+
+BOOST_AUTO_TEST_CASE(MonotonicArenaPlacement) {
+    auto placements = std::vector<util::ArenaPlacement>{
+        util::HugePageArenaPlacement::value,
+        util::InterleavedArenaPlacement::value,
+        util::ArenaPlacement{util::HugePages::explicit_, false},
+    };
+
+    for(const auto& placement : placements) {
+        auto arena = util::MonotonicArena(1024, placement);
+
+        auto p = static_cast<char*>(arena.allocate(3 * 1000 * 1000, 64));
+        std::fill(p, p + 3 * 1000 * 1000, 'x');
+        BOOST_CHECK(p[3 * 1000 * 1000 - 1] == 'x');
+
+#if defined(__linux__)
+        // Blocks are whole, aligned huge pages.
+        auto huge_page_size = util::MonotonicArena::huge_page_size;
+        BOOST_CHECK(reinterpret_cast<std::uintptr_t>(p) % huge_page_size == 0);
+        BOOST_CHECK(arena.reserved_bytes() % huge_page_size == 0);
+#endif
+    }
+
+    auto alloc = util::ArenaAllocator<int, util::InterleavedArenaPlacement>{};
+    BOOST_CHECK(alloc.arena().placement().interleave_numa_nodes);
+}
+
@@ -1,10 +1,16 @@
 #define BOOST_TEST_MODULE BrainIndexer_UnitTests
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <cstddef>
 #include <filesystem>
+#include <fstream>
 #include <random>
+#include <sstream>
 #include <vector>
+#include <brain_indexer/compression.hpp>
 #include <brain_indexer/index.hpp>
+#include <brain_indexer/packed_rtree.hpp>
 #include <brain_indexer/util.hpp>
 
 // We need unit tests for each kind of tree
@@ -157,6 +163,45 @@ BOOST_AUTO_TEST_CASE(VariantNeuronPieces) {
 }
 
 
+BOOST_AUTO_TEST_CASE(TreesFromSoA) {
+    std::vector<identifier_t> ids{0, 1, 2};
+    std::vector<identifier_t> post{post_gids, post_gids + N_ITEMS};
+    std::vector<identifier_t> pre{pre_gids, pre_gids + N_ITEMS};
+    std::vector<Point3D> points1{centers, centers + N_ITEMS};
+    std::vector<Point3D> points2{centers2, centers2 + N_ITEMS};
+    std::vector<CoordType> radii{radius, radius + N_ITEMS};
+    std::vector<unsigned> section_ids{0, 1, 2};
+    std::vector<unsigned char> types{0, 2, 3};
+
+    {
+        auto soa = util::make_soa_reader<Synapse>(ids, post, pre, points1);
+        IndexTree<Synapse> rtree(soa.begin(), soa.end());
+
+        BOOST_CHECK_EQUAL(rtree.size(), N_ITEMS);
+        auto aggregated_per_gid = rtree.count_intersecting_agg_gid(
+            Box3D{{-1., -1., -1.}, {21., 1., 1.}});
+        BOOST_CHECK(aggregated_per_gid[1] == 1);
+        BOOST_CHECK(aggregated_per_gid[2] == 2);
+    }
+
+    {
+        auto section_types = util::make_converted<SectionType>(types);
+        auto soa = util::make_soa_reader<Segment>(ids, section_ids, section_ids,
+                                                  points1, points2, radii, section_types);
+        IndexTree<MorphoEntry> rtree(soa.begin(), soa.end());
+
+        BOOST_CHECK_EQUAL(rtree.size(), N_ITEMS);
+        TESTS_INTERSECTING_CHECKS(true, false, false, true);
+        TEST_INTERSECTING_IDS({2}, {}, {}, {0});
+
+        for(const auto& entry : rtree) {
+            const auto& segment = boost::get<Segment>(entry);
+            BOOST_CHECK(segment.section_type() == SectionType(types[segment.gid()]));
+        }
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////
 // Advanced features
 //////////////////////////////////////////////////////////////////
@@ -176,6 +221,288 @@ BOOST_AUTO_TEST_CASE(NonOverlapPlacement) {
     BOOST_CHECK(toplace2.centroid.get<0>() > toplace.centroid.get<0>());
 }
 
+BOOST_AUTO_TEST_CASE(BatchPlacement) {
+    auto spheres = util::make_vec<Sphere>(N_ITEMS, centers, radius);
+    IndexTree<Sphere> rtree(spheres);
+
+    // A dense batch: the region has room for about 5 x 5 x 1 spheres.
+    auto region = Box3D{{30., 30., 0.}, {40., 40., 1.}};
+    auto toplace = std::vector<Sphere>(30, Sphere{{0., 0., 0.}, 1.});
+    auto is_placed = rtree.place_batch(region, toplace);
+
+    auto n_placed = size_t(std::count(is_placed.begin(), is_placed.end(), true));
+    BOOST_CHECK(n_placed >= 16);
+    BOOST_CHECK(n_placed < toplace.size());
+    BOOST_CHECK_EQUAL(rtree.size(), spheres.size() + n_placed);
+
+    // No placed sphere overlaps any other element.
+    for(size_t i = 0; i < toplace.size(); ++i) {
+        if(is_placed[i]) {
+            BOOST_CHECK_EQUAL(rtree.count_intersecting<BestEffortGeometry>(toplace[i]), 1);
+        }
+    }
+
+    // The same positions are found one by one.
+    IndexTree<Sphere> one_by_one(spheres);
+    for(size_t i = 0; i < toplace.size(); ++i) {
+        auto sphere = Sphere{{0., 0., 0.}, 1.};
+        BOOST_CHECK_EQUAL(one_by_one.place(region, sphere), is_placed[i]);
+        if(is_placed[i]) {
+            BOOST_CHECK(Point3Dx(sphere.centroid) == toplace[i].centroid);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BatchQueries) {
+    auto spheres = util::make_vec<IndexedSphere>(N_ITEMS, util::identity<>(), centers, radius);
+    IndexTree<IndexedSphere> rtree(spheres);
+
+    auto queries = std::vector<Sphere>{
+        Sphere{tcenter0, tradius},
+        Sphere{tcenter1, tradius},
+        Sphere{tcenter2, tradius}
+    };
+    auto results = rtree.find_intersecting_batch<BestEffortGeometry>(queries);
+
+    BOOST_REQUIRE(results.offsets.size() == queries.size() + 1);
+    BOOST_CHECK(results.offsets[0] == 0);
+    BOOST_CHECK(results.offsets.back() == results.values.id.size());
+
+    for(size_t i = 0; i < queries.size(); ++i) {
+        auto expected = rtree.find_intersecting_np<BestEffortGeometry>(queries[i]);
+        auto actual = std::vector<identifier_t>(
+            results.values.id.begin() + util::integer_cast<std::ptrdiff_t>(results.offsets[i]),
+            results.values.id.begin() + util::integer_cast<std::ptrdiff_t>(results.offsets[i+1])
+        );
+
+        BOOST_CHECK(actual == expected.id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ParallelBatchQueries) {
+    auto rng = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+
+    auto spheres = std::vector<IndexedSphere>{};
+    for(identifier_t i = 0; i < 1000; ++i) {
+        spheres.emplace_back(i, Point3D{pos_dist(rng), pos_dist(rng), pos_dist(rng)}, 0.5f);
+    }
+    IndexTree<IndexedSphere> rtree(spheres);
+
+    auto queries = std::vector<Sphere>{};
+    for(size_t i = 0; i < 200; ++i) {
+        queries.emplace_back(Point3D{pos_dist(rng), pos_dist(rng), pos_dist(rng)}, 2.0f);
+    }
+
+    auto expected = rtree.find_intersecting_batch<BestEffortGeometry>(queries);
+    auto actual = rtree.find_intersecting_batch<BestEffortGeometry>(queries, /* n_threads = */ 4);
+
+    BOOST_CHECK(actual.offsets == expected.offsets);
+    BOOST_CHECK(actual.values.id == expected.values.id);
+}
+
+/// The ids of the elements in `box` with `BoundingBoxGeometry`, tested one by one.
+template <typename T>
+static std::vector<identifier_t> brute_force_box_query(const std::vector<T>& elements,
+                                                       const Box3D& box) {
+    auto is_hit = detail::GeometryIntersects<BoundingBoxGeometry, Box3D>{box};
+    auto ids = std::vector<identifier_t>{};
+    for(const auto& element : elements) {
+        if(is_hit(element)) {
+            ids.push_back(detail::get_id_from(element));
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+template <typename Index, typename T>
+static void check_box_queries(const Index& index, const std::vector<T>& elements) {
+    for(CoordType low : {-3.0, 0.0, 2.0}) {
+        for(CoordType high : {1.0, 4.0, 8.0}) {
+            auto box = Box3D{{low, low, low}, {high, high, high}};
+            auto expected = brute_force_box_query(elements, box);
+
+            auto ids = std::vector<identifier_t>{};
+            index.find_intersecting(box, iter_ids_getter(ids));
+            std::sort(ids.begin(), ids.end());
+
+            BOOST_CHECK(ids == expected);
+            BOOST_CHECK_EQUAL(index.count_intersecting(box), expected.size());
+            BOOST_CHECK_EQUAL(index.is_intersecting(box), !expected.empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BoxQueriesWithBoundingBoxGeometry) {
+    // Elements on a grid, such that some lie on the boundary of the queries.
+    auto morphos = std::vector<MorphoEntry>{};
+    auto points = std::vector<IndexedPoint>{};
+    for(int i = 0; i < 10; ++i) {
+        for(int j = 0; j < 10; ++j) {
+            auto gid = identifier_t(10 * i + j);
+            auto p = Point3D{CoordType(i), CoordType(j), CoordType(i + j) / 2};
+            auto q = Point3D{CoordType(i) + 0.5f, CoordType(j), CoordType(i + j) / 2};
+
+            morphos.emplace_back(Soma(gid, p, 0.5f));
+            morphos.emplace_back(Segment(gid + 100, 0, 0, p, q, 0.5f));
+            points.emplace_back(gid, p);
+        }
+    }
+
+#if SI_QUERY_STATS != 1
+    static_assert(detail::is_decided_by_bounding_box<BoundingBoxGeometry, Box3D, MorphoEntry>());
+#endif
+    static_assert(!detail::is_decided_by_bounding_box<BestEffortGeometry, Box3D, MorphoEntry>());
+    static_assert(!detail::is_decided_by_bounding_box<BoundingBoxGeometry, Sphere, MorphoEntry>());
+    static_assert(!detail::is_decided_by_bounding_box<BoundingBoxGeometry, Box3D, IndexedPoint>());
+
+    check_box_queries(IndexTree<MorphoEntry>(morphos), morphos);
+    check_box_queries(PackedIndexTree<MorphoEntry>(morphos.begin(), morphos.end()), morphos);
+    check_box_queries(IndexTree<IndexedPoint>(points), points);
+}
+
+BOOST_AUTO_TEST_CASE(FieldSelectiveQueries) {
+    auto somas = util::make_vec<Soma>(N_ITEMS, util::identity<>(), centers, radius);
+    IndexTree<MorphoEntry> rtree(somas);
+    rtree.insert(Segment{10ul, 0u, 0u, centers[0], centers2[0], radius[0], SectionType::axon});
+
+    using result_t = detail::query_result<MorphoEntry>;
+    auto query = Box3D{{-20., -20., -20.}, {30., 30., 30.}};
+    auto all = rtree.find_intersecting_np(query);
+
+    auto fields = detail::query_field_mask<MorphoEntry>({"gid", "endpoints"});
+    BOOST_CHECK(fields == (result_t::field::gid | result_t::field::endpoints));
+
+    auto some = rtree.find_intersecting_np(query, fields);
+    BOOST_CHECK(some.gid == all.gid);
+    BOOST_CHECK(some.endpoint2.size() == all.endpoint2.size());
+    BOOST_CHECK(some.section_id.empty());
+    BOOST_CHECK(some.ids.empty());
+    BOOST_CHECK(some.centroid.empty());
+    BOOST_CHECK(some.is_soma.empty());
+
+    auto batch = rtree.find_intersecting_batch(std::vector<Box3D>{query, query}, 1,
+                                               result_t::field::section_type);
+    BOOST_CHECK(batch.values.section_type.size() == 2 * all.section_type.size());
+    BOOST_CHECK(batch.values.gid.empty());
+
+    BOOST_CHECK_THROW(detail::query_field_mask<MorphoEntry>({"id"}), std::invalid_argument);
+    BOOST_CHECK_THROW(detail::query_field_mask<Synapse>({"gid"}), std::invalid_argument);
+}
+
+static std::vector<identifier_t> ids_in_order(const IndexTree<MorphoEntry>& rtree) {
+    auto ids = std::vector<identifier_t>{};
+    std::copy(rtree.begin(), rtree.end(), iter_ids_getter(ids));
+    return ids;
+}
+
+BOOST_AUTO_TEST_CASE(NativeFormat) {
+    auto rng = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+
+    IndexTree<MorphoEntry> rtree;
+    for(identifier_t i = 0; i < 2000; ++i) {
+        auto p1 = Point3D{pos_dist(rng), pos_dist(rng), pos_dist(rng)};
+        auto p2 = Point3D{pos_dist(rng), pos_dist(rng), pos_dist(rng)};
+        if(i % 10 == 0) {
+            rtree.insert(Soma{i, p1, 0.5f});
+        } else {
+            rtree.insert(Segment{i, 1u, 2u, p1, p2, 0.2f, SectionType::axon});
+        }
+    }
+
+    // The nodes are recreated as they were; hence, so is the order of the values.
+    auto ss = std::stringstream{};
+    write_native_rtree(rtree, ss);
+    BOOST_CHECK(is_native_rtree(ss));
+
+    IndexTree<MorphoEntry> rtree_loaded;
+    read_native_rtree(rtree_loaded, ss);
+    BOOST_CHECK(rtree_loaded.size() == rtree.size());
+    BOOST_CHECK(ids_in_order(rtree_loaded) == ids_in_order(rtree));
+
+    auto box = Box3D{{-2., -2., -2.}, {2., 2., 2.}};
+    BOOST_CHECK(rtree_loaded.count_intersecting(box) == rtree.count_intersecting(box));
+
+    // Empty trees.
+    ss = std::stringstream{};
+    write_native_rtree(IndexTree<MorphoEntry>{}, ss);
+    read_native_rtree(rtree_loaded, ss);
+    BOOST_CHECK(rtree_loaded.empty());
+
+    // Trees of a different struct version must be recreated.
+    ss = std::stringstream{};
+    write_native_rtree(rtree, ss);
+    auto bytes = ss.str();
+    bytes[offsetof(detail::NativeRTreeHeader, struct_version)] += 1;
+    ss = std::stringstream{bytes};
+    BOOST_CHECK_THROW(read_native_rtree(rtree_loaded, ss), std::runtime_error);
+
+    // `dump` uses the native format, but indexes stored with Boost
+    // serialization can still be opened.
+    std::string index_path = "native_format_index";
+    rtree.dump(index_path);
+    BOOST_CHECK(ids_in_order(IndexTree<MorphoEntry>(index_path)) == ids_in_order(rtree));
+
+    {
+        auto ofs = std::ofstream(index_path + "/index.spi", std::ios::binary | std::ios::trunc);
+        boost::archive::binary_oarchive oa(ofs);
+        oa << rtree;
+    }
+    BOOST_CHECK(ids_in_order(IndexTree<MorphoEntry>(index_path)) == ids_in_order(rtree));
+
+    std::filesystem::remove_all(index_path);
+}
+
+BOOST_AUTO_TEST_CASE(CompressedFormat) {
+    // Any length; trailing bytes that don't form a whole element included.
+    auto bytes = std::string(4003, '\0');
+    for(size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = char(i % 251);
+    }
+    auto shuffled = detail::shuffle_bytes(bytes, sizeof(CoordType));
+    BOOST_CHECK(shuffled[1] == bytes[sizeof(CoordType)]);
+    BOOST_CHECK(detail::unshuffle_bytes(shuffled, sizeof(CoordType)) == bytes);
+
+    auto rng = std::default_random_engine{};
+    auto pos_dist = std::uniform_real_distribution<CoordType>(-10.0, 10.0);
+
+    IndexTree<MorphoEntry> rtree;
+    for(identifier_t i = 0; i < 2000; ++i) {
+        auto p1 = Point3D{pos_dist(rng), pos_dist(rng), pos_dist(rng)};
+        auto p2 = Point3D{pos_dist(rng), pos_dist(rng), pos_dist(rng)};
+        rtree.insert(Segment{i, 1u, 2u, p1, p2, 0.2f, SectionType::axon});
+    }
+
+    // Without compression, the tree is saved as by `save_rtree`.
+    auto ss = std::stringstream{};
+    save_compressed_rtree<NoCompression>(rtree, ss);
+    BOOST_CHECK(!is_compressed_block(ss));
+
+    IndexTree<MorphoEntry> rtree_loaded;
+    load_compressed_rtree(rtree_loaded, ss);
+    BOOST_CHECK(ids_in_order(rtree_loaded) == ids_in_order(rtree));
+
+#if SI_ZSTD == 1
+    auto raw = std::stringstream{};
+    save_rtree(rtree, raw);
+
+    ss = std::stringstream{};
+    save_compressed_rtree<ZstdCompression>(rtree, ss);
+    BOOST_CHECK(is_compressed_block(ss));
+    BOOST_CHECK(ss.str().size() < raw.str().size());
+
+    load_compressed_rtree(rtree_loaded, ss);
+    BOOST_CHECK(ids_in_order(rtree_loaded) == ids_in_order(rtree));
+
+    auto truncated = ss.str();
+    truncated.resize(truncated.size() / 2);
+    ss = std::stringstream{truncated};
+    BOOST_CHECK_THROW(load_compressed_rtree(rtree_loaded, ss), std::runtime_error);
+#endif
+}
+
 BOOST_AUTO_TEST_CASE(IntegerConversion) {
     // Too small.
     BOOST_CHECK_THROW(util::safe_integer_cast<size_t>(-1),
@@ -152,3 +152,47 @@ def test_sphere_index_builder_add_sphere():
 
     with pytest.raises(RuntimeError):
         builder.add_sphere()
+
+
+def test_synapse_index_builder_from_numpy():
+    import numpy as np
+
+    Builder = IndexResolver.builder_class("synapse", "in_memory")
+
+    n_synapses = 100
+    ids = np.arange(n_synapses)
+    post_gids = ids % 7
+    pre_gids = ids % 3
+    positions = np.random.uniform(-10.0, 10.0, size=(n_synapses, 3)).astype(np.float32)
+
+    index = Builder.from_numpy(ids, post_gids, pre_gids, positions)
+
+    results = index.box_query([-20.0] * 3, [20.0] * 3, fields=["id", "post_gid"])
+    order = np.argsort(results["id"])
+    np.testing.assert_array_equal(results["id"][order], ids)
+    np.testing.assert_array_equal(results["post_gid"][order], post_gids)
+
+
+def test_morphology_index_builder_from_numpy():
+    import numpy as np
+
+    Builder = IndexResolver.builder_class("morphology", "in_memory")
+
+    n_segments = 100
+    gids = np.arange(n_segments) // 10
+    section_ids = np.arange(n_segments) % 10
+    segment_ids = np.zeros(n_segments)
+    endpoints1 = np.random.uniform(-10.0, 10.0, size=(n_segments, 3)).astype(np.float32)
+    endpoints2 = endpoints1 + 1.0
+    radii = np.full(n_segments, 0.5, dtype=np.float32)
+    section_types = np.full(n_segments, 3)
+
+    index = Builder.from_numpy(
+        gids, section_ids, segment_ids, endpoints1, endpoints2, radii, section_types
+    )
+
+    results = index.box_query(
+        [-20.0] * 3, [20.0] * 3, fields=["gid", "section_id", "section_type"]
+    )
+    assert results["gid"].shape[0] == n_segments
+    assert np.all(results["section_type"] == 3)
@@ -1,6 +1,8 @@
 # This file covers correctness of indexes contained in `index.py`.
 
 import numpy as np
+import pytest
+
 import brain_indexer
 
 
@@ -85,3 +87,203 @@ def test_point_index():
 
     check_point_index_boxes(index, centroids)
     check_point_index_spheres(index, centroids)
+
+
+def test_query_stats():
+    n_elements = 100
+    centroids = np.random.uniform(size=(n_elements, 3))
+    ids = np.arange(centroids.shape[0])
+
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, ids)
+    index.box_query(3 * [-1.0], 3 * [2.0], fields="id")
+
+    stats = index.query_stats()
+    expected_keys = [
+        "n_queries", "nodes_visited", "leaves_tested", "exact_tests",
+        "hits", "subtree_loads", "bytes_read", "load_nanoseconds",
+    ]
+    assert sorted(stats.keys()) == sorted(expected_keys)
+
+    index.reset_query_stats()
+    assert all(value == 0 for value in index.query_stats().values())
+
+
+def test_spatial_join():
+    distance = 0.1
+    centroids_a = np.random.uniform(size=(200, 3))
+    centroids_b = np.random.uniform(size=(300, 3))
+    index_a = brain_indexer.PointIndexBuilder.from_numpy(centroids_a, np.arange(200))
+    index_b = brain_indexer.PointIndexBuilder.from_numpy(centroids_b, np.arange(300))
+
+    pairs = index_a.spatial_join(index_b, distance, n_threads=2)
+    assert pairs.shape[1] == 2
+
+    dist = np.linalg.norm(centroids_a[:, None, :] - centroids_b[None, :, :], axis=2)
+    expected = np.argwhere(dist <= distance)
+
+    found = sorted(map(tuple, pairs))
+    assert found == sorted(map(tuple, expected))
+
+
+def test_self_join():
+    distance = 0.1
+    centroids = np.random.uniform(size=(300, 3))
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, np.arange(300))
+
+    pairs = index.self_join(distance, n_threads=2)
+    assert pairs.shape[1] == 2
+
+    dist = np.linalg.norm(centroids[:, None, :] - centroids[None, :, :], axis=2)
+    expected = [(i, j) for i, j in np.argwhere(dist <= distance) if i < j]
+
+    found = sorted((min(i, j), max(i, j)) for i, j in pairs)
+    assert found == sorted(expected)
+
+
+def test_segment_query():
+    radius = 0.05
+    centroids = np.random.uniform(size=(500, 3)).astype(np.float32)
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, np.arange(500))
+
+    p1, p2 = np.array([0.0, 0.1, 0.2]), np.array([1.0, 0.9, 0.7])
+    ids, t = index.segment_query(p1, p2, radius=radius)
+    assert np.all(np.diff(t) >= 0.0)
+
+    d = p2 - p1
+    s = np.clip((centroids - p1) @ d / (d @ d), 0.0, 1.0)
+    dist = np.linalg.norm(centroids - (p1 + s[:, None] * d), axis=1)
+    expected = np.argwhere(dist <= radius)[:, 0]
+    assert sorted(ids) == sorted(expected)
+
+    first_ids, first_t = index.segment_query(p1, p2, radius=radius, max_hits=3)
+    assert len(first_ids) == min(3, len(ids))
+    np.testing.assert_array_equal(first_t, t[:len(first_ids)])
+
+
+def test_box_level_of_detail():
+    centroids = np.random.uniform(size=(5000, 3)).astype(np.float32)
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, np.arange(5000))
+    min_corner, max_corner = np.array([0.1, 0.1, 0.1]), np.array([0.8, 0.8, 0.8])
+
+    expected = index.box_query(min_corner, max_corner, fields="id")
+    lod = index.box_level_of_detail(min_corner, max_corner, len(expected))
+    assert sorted(lod["ids"]) == sorted(expected)
+    assert len(lod["count"]) == 0
+
+    lod = index.box_level_of_detail(min_corner, max_corner, 50)
+    assert len(lod["ids"]) == 0
+    assert 0 < len(lod["count"]) <= 50
+    assert lod["centroid"].shape == (len(lod["count"]), 3)
+    assert np.sum(lod["count"]) >= len(expected)
+    assert np.all(lod["min_corner"] <= lod["centroid"])
+    assert np.all(lod["centroid"] <= lod["max_corner"])
+
+
+def test_density_grid():
+    centroids = np.random.uniform(size=(5000, 3)).astype(np.float32)
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, np.arange(5000))
+    min_corner, max_corner = np.array([0.0, 0.0, 0.0]), np.array([1.0, 1.0, 1.0])
+
+    grid = index.density_grid(min_corner, max_corner, (4, 5, 2), n_threads=2)
+    assert grid["count"].shape == (4, 5, 2)
+
+    cells = np.minimum((centroids * [4, 5, 2]).astype(int), [3, 4, 1])
+    expected = np.zeros((4, 5, 2), dtype=int)
+    np.add.at(expected, tuple(cells.T), 1)
+    np.testing.assert_array_equal(grid["count"], expected)
+
+    approximate = index.density_grid(min_corner, max_corner, (4, 5, 2), approximate=True)
+    assert np.sum(approximate["count"]) == 5000
+
+
+def test_classify_points():
+    centers = np.random.uniform(size=(500, 3)).astype(np.float32)
+    radii = np.full(500, 0.05, dtype=np.float32)
+    index = brain_indexer.SphereIndexBuilder.from_numpy(centers, radii, np.arange(500))
+
+    points = np.random.uniform(size=(2000, 3)).astype(np.float32)
+    ids = index.classify_points(points, n_threads=2)
+
+    dist = np.linalg.norm(points[:, None, :] - centers[None, :, :], axis=2)
+    inside = dist <= radii[None, :]
+    expected = np.where(np.any(inside, axis=1), np.argmax(inside, axis=1), -1)
+
+    # Points on the surface of a sphere are sensitive to rounding.
+    robust = np.all(np.abs(dist - radii[None, :]) > 1e-5, axis=1)
+    np.testing.assert_array_equal(ids[robust], expected[robust])
+    assert np.any(ids >= 0) and np.any(ids == -1)
+
+
+def test_oriented_box_and_polytope_query():
+    centroids = np.random.uniform(size=(2000, 3)).astype(np.float32)
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, np.arange(2000))
+
+    # A box rotated by 45 degrees around the z-axis.
+    s = np.sqrt(0.5)
+    center = np.array([0.5, 0.5, 0.5])
+    axes = np.array([[s, s, 0.0], [-s, s, 0.0], [0.0, 0.0, 1.0]])
+    half_extents = np.array([0.6, 0.1, 0.3])
+
+    local = (centroids - center) @ axes.T
+    expected = np.argwhere(np.all(np.abs(local) <= half_extents, axis=1))[:, 0]
+
+    ids = index.oriented_box_query(center, axes, half_extents, fields="id")
+    assert sorted(ids) == sorted(expected)
+
+    # The same box, as six half-spaces.
+    normals = np.concatenate([axes, -axes])
+    offsets = np.concatenate([
+        axes @ center + half_extents, -(axes @ center) + half_extents
+    ])
+
+    ids = index.polytope_query(normals, offsets, fields="id")
+    assert sorted(ids) == sorted(expected)
+
+
+def test_voxel_mask_query():
+    centroids = np.random.uniform(size=(2000, 3)).astype(np.float32)
+    index = brain_indexer.PointIndexBuilder.from_numpy(centroids, np.arange(2000))
+
+    mask = np.random.uniform(size=(10, 10, 10)) < 0.3
+    origin = np.zeros(3)
+    voxel_size = np.full(3, 0.1)
+
+    voxels = np.clip(np.floor(centroids / voxel_size).astype(int), 0, 9)
+    expected = np.argwhere(mask[voxels[:, 0], voxels[:, 1], voxels[:, 2]])[:, 0]
+
+    ids = index.voxel_mask_query(origin, voxel_size, mask, fields="id")
+    assert sorted(ids) == sorted(expected)
+
+
+def test_query_where():
+    n_synapses = 2000
+    positions = np.random.uniform(size=(n_synapses, 3)).astype(np.float32)
+    post_gids = np.random.randint(0, 20, size=n_synapses)
+    pre_gids = np.random.randint(0, 20, size=n_synapses)
+    index = brain_indexer.SynapseIndexBuilder.from_numpy(
+        np.arange(n_synapses), post_gids, pre_gids, positions
+    )
+
+    corner, opposite_corner = np.array([0.1, 0.2, 0.1]), np.array([0.9, 0.8, 0.7])
+    in_box = np.all(np.logical_and(corner <= positions, positions <= opposite_corner), axis=1)
+
+    where = {"pre_gid": [2, 3, 5], "post_gid": range(4, 12)}
+    expected = np.argwhere(
+        in_box
+        & np.isin(pre_gids, [2, 3, 5])
+        & (4 <= post_gids) & (post_gids < 12)
+    )[:, 0]
+
+    ids = index.box_query(corner, opposite_corner, fields="id", where=where)
+    assert sorted(ids) == sorted(expected)
+
+    result = index.box_query(corner, opposite_corner, fields=["id", "pre_gid"], where=where)
+    assert sorted(result["id"]) == sorted(expected)
+    assert np.all(np.isin(result["pre_gid"], [2, 3, 5]))
+
+    # The section type of synapses is undefined.
+    where = {"section_type": brain_indexer.SectionType.axon}
+    assert len(index.box_query(corner, opposite_corner, fields="id", where=where)) == 0
+
+    with pytest.raises(ValueError):
+        index.box_query(corner, opposite_corner, fields="id", where={"color": 1})
@@ -7,6 +7,7 @@
 # Tests that check the correctness of indexes go elsewhere, e.g.
 # `test_index.py`.
 
+import concurrent.futures
 import itertools
 import os
 import pytest
@@ -558,6 +559,45 @@ def test_index_insert():
             )
 
 
+def test_query_batches():
+    centroids = np.random.uniform(size=(100, 3)).astype(np.float32)
+    radii = np.full(100, 0.01, dtype=np.float32)
+    index = brain_indexer.SphereIndexBuilder.from_numpy(centroids, radii)
+
+    window = [0.0, 0.0, 0.0], [1.0, 1.0, 1.0]
+    expected = np.sort(index.box_query(*window, fields="id"))
+
+    batches = list(index.box_query_batches(*window, batch_size=7, fields="id"))
+    assert all(batch.shape[0] <= 7 for batch in batches)
+    assert np.all(np.sort(np.concatenate(batches)) == expected)
+
+    sphere = [0.5, 0.5, 0.5], 0.3
+    expected = np.sort(index.sphere_query(*sphere, fields="id"))
+    batches = list(index.sphere_query_batches(*sphere, batch_size=3, fields=["id", "radius"]))
+    found = np.concatenate([batch["id"] for batch in batches]) if batches else []
+    assert np.all(np.sort(found) == expected)
+
+
+def test_core_queries_compute_requested_fields_only():
+    centroids = np.random.uniform(size=(100, 3)).astype(np.float32)
+    radii = np.full(100, 0.01, dtype=np.float32)
+    index = brain_indexer.SphereIndexBuilder.from_numpy(centroids, radii)
+    core_index = index._core_index
+
+    window = [0.0, 0.0, 0.0], [1.0, 1.0, 1.0]
+    everything = core_index._find_intersecting_box_np(*window, geometry="best_effort")
+    assert sorted(everything.keys()) == ["centroid", "id", "radius"]
+
+    only_ids = core_index._find_intersecting_box_np(
+        *window, geometry="best_effort", fields=["id"]
+    )
+    assert list(only_ids.keys()) == ["id"]
+    assert np.all(only_ids["id"] == everything["id"])
+
+    with pytest.raises(ValueError):
+        core_index._find_intersecting_box_np(*window, geometry="best_effort", fields=["gid"])
+
+
 def test_is_non_string_iterable():
     assert not is_non_string_iterable("")
     assert not is_non_string_iterable("foo")
@@ -566,3 +606,50 @@ def test_is_non_string_iterable():
     assert is_non_string_iterable(["foo"])
     assert is_non_string_iterable(("foo",))
     assert is_non_string_iterable("foo" for _ in range(3))
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+@pytest.mark.parametrize("element_type", ["synapse", "morphology"])
+def test_multi_index_warm_up(element_type):
+    index, window, _ = circuit_10_config("multi_index", element_type)
+    index.box_query(*window)
+    hot_set = index.hot_set
+    assert len(hot_set) > 0
+
+    with tempfile.TemporaryDirectory(prefix="hot_set") as d:
+        filename = os.path.join(d, "hot_set.json")
+        index.save_hot_set_at_exit(filename)
+        del index
+
+        index, _, _ = circuit_10_config("multi_index", element_type)
+        assert index.hot_set == []
+        assert index.warm_up(filename, n_threads=2) == len(hot_set)
+        assert sorted(index.hot_set) == sorted(hot_set)
+
+        assert index.warm_up(regions=[window]) == 0
+
+
+@pytest.mark.skipif(not os.path.exists(CIRCUIT_10_DIR),
+                    reason="Circuit directory not available")
+def test_multi_index_queried_from_two_threads():
+    index, window, _ = circuit_10_config("multi_index", "morphology")
+    core_index = index._core_index
+
+    rng = np.random.default_rng(0)
+    min_corner, max_corner = np.array(window[0]), np.array(window[1])
+    corners = rng.uniform(min_corner, max_corner, size=(64, 3))
+    boxes = np.stack([corners, corners + 20.0], axis=1).astype(np.float32)
+
+    def query():
+        results = core_index._find_intersecting_box_batch_np(boxes, "bounding_box")
+        return {k: np.asarray(v).tolist() for k, v in results.items()}
+
+    expected = query()
+
+    # The cache of the index is modified by every query; hence, queries from
+    # several Python threads must not run concurrently.
+    with concurrent.futures.ThreadPoolExecutor(max_workers=2) as executor:
+        futures = [executor.submit(query) for _ in range(16)]
+        for future in futures:
+            assert future.result() == expected
@@ -49,3 +49,28 @@ def test_register_logger():
         assert info_message_cpp in log
         assert warn_message_cpp in log
         assert error_message_cpp in log
+
+
+def test_register_asynchronous_logger():
+    messages_cpp = ["pqoeiw", "zmxnvb", "laksjd", "qpwoei", "ruteyw"]
+
+    with tempfile.TemporaryDirectory(prefix="test_si_logging") as d:
+        filename = os.path.join(d, "test_si_logging.log")
+
+        file_logger = logging.getLogger("test_register_asynchronous_logger")
+        file_logger.setLevel(logging.DEBUG)
+        file_logger.addHandler(logging.FileHandler(filename))
+
+        default_logger = brain_indexer.logger
+        brain_indexer.register_logger(file_logger, asynchronous=True)
+        try:
+            brain_indexer.core.tests.write_logs(*messages_cpp)
+            brain_indexer.flush_logs()
+        finally:
+            brain_indexer.register_logger(default_logger)
+
+        with open(filename, "r") as f:
+            log = f.read()
+
+        for message in messages_cpp:
+            assert message in log
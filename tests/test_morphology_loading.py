@@ -96,3 +96,23 @@ def test_sonata_selection():
     assert len(obj_in_region) > 0
     for obj in obj_in_region:
         assert 13 <= obj.centroid[0] <= 22
+
+
+@pytest_skipif(not os.path.exists(Test2Info.SONATA_NODES),
+               reason="Circuit file not available")
+def test_sonata_index_with_reader_threads():
+    gids = range(700, 800)
+    serial = MorphIndexBuilder.from_sonata_file(
+        Test2Info.MORPHOLOGY_DIR, Test2Info.SONATA_NODES, POPULATION, gids
+    )
+    threaded = MorphIndexBuilder.from_sonata_file(
+        Test2Info.MORPHOLOGY_DIR, Test2Info.SONATA_NODES, POPULATION, gids,
+        n_reader_threads=3, max_prefetched=2
+    )
+
+    assert len(threaded) == len(serial)
+
+    min_corner, max_corner = [200, 200, 480], [300, 300, 520]
+    expected = serial.box_query(min_corner, max_corner, fields="ids")
+    actual = threaded.box_query(min_corner, max_corner, fields="ids")
+    assert sorted(map(tuple, expected)) == sorted(map(tuple, actual))
@@ -9,3 +9,13 @@ def test_query_order():
     assert len(set(order)) == points.shape[0]
     assert np.min(order) == 0
     assert np.max(order) == points.shape[0] - 1
+
+
+def test_query_order_threads():
+    points = np.random.uniform(-100.0, 300.0, size=(123, 3))
+    order = brain_indexer.experimental.space_filling_order(points, n_bits=21)
+    threaded = brain_indexer.experimental.space_filling_order(
+        points, n_bits=21, n_threads=4
+    )
+
+    assert np.all(order == threaded)
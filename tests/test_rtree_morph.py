@@ -132,6 +132,37 @@ def test_bulk_neuron_add():
         assert (obj.gid, obj.section_id, obj.segment_id) in EXPECTED_IDS
 
 
+@pytest.mark.parametrize("split_index_class", ["SplitMorphIndex", "PackedSplitMorphIndex"])
+def test_split_morph_index_queries(split_index_class):
+    N = 10 + 6
+    points = np.zeros([N, 3], dtype=np.float32)
+    points[:, 0] = np.concatenate((np.arange(10), np.arange(4, 10)))
+    points[10:, 1] = 1
+    radius = np.full(N, 0.4, dtype=np.float32)
+    types = np.full(N, SectionType.undefined)
+
+    core_index = core.MorphIndex()
+    core_index._add_neuron(1, points, radius, [1, 10], types)
+    split_index = getattr(core, split_index_class)(core_index)
+
+    assert len(split_index) == len(core_index)
+
+    for center in [[0.0, 0.0, 0.0], [5.0, 0.5, 0.0], [8.0, 1.0, 0.0]]:
+        expected = core_index._find_intersecting_np(center, 1.1, "best_effort")
+        actual = split_index._find_intersecting_np(center, 1.1, "best_effort")
+        assert sorted(actual["ids"].tolist()) == sorted(expected["ids"].tolist())
+        assert np.count_nonzero(actual["is_soma"]) == np.count_nonzero(expected["is_soma"])
+
+        expected = core_index._find_nearest(center, 3)
+        actual = split_index._find_nearest(center, 3)
+        assert sorted(actual.tolist()) == sorted(expected.tolist())
+
+    # The split index works behind the usual Python API.
+    index = MorphIndex(split_index)
+    objs = index.box_query([-1.0, -1.0, -1.0], [0.5, 0.5, 0.5], fields="raw_elements")
+    assert any(obj.section_id == 0 for obj in objs)
+
+
 def test_add_neuron_with_soma_and_toString():
     points = [
         [1, 3, 5],
@@ -1,6 +1,7 @@
 import tempfile
 
 import numpy as np
+import pytest
 
 import brain_indexer
 from brain_indexer import core, SphereIndexBuilder
@@ -283,3 +284,50 @@ def test_nearest_random():
             pass
 
     assert n_success >= 2
+
+
+def test_batch_queries():
+    index = arange_sphere_index(n_spheres=10, radius=0.2)
+    core_index = index._core_index
+
+    centers = arange_centroids(4) * 3.0
+    radii = np.full(4, 1.1, dtype=np.float32)
+    results = core_index._find_intersecting_batch_np(centers, radii, "best_effort")
+
+    offsets = results["offsets"]
+    assert offsets.size == centers.shape[0] + 1
+
+    for i in range(centers.shape[0]):
+        expected = core_index._find_intersecting_np(centers[i], radii[i], "best_effort")
+        actual_ids = results["id"][offsets[i]:offsets[i + 1]]
+        assert np.all(np.sort(actual_ids) == np.sort(expected["id"]))
+
+    boxes = np.stack([centers - 1.1, centers + 1.1], axis=1)
+    results = core_index._find_intersecting_box_batch_np(boxes, "bounding_box")
+
+    offsets = results["offsets"]
+    for i in range(boxes.shape[0]):
+        expected = core_index._find_intersecting_box_np(
+            boxes[i, 0], boxes[i, 1], "bounding_box"
+        )
+        actual_ids = results["id"][offsets[i]:offsets[i + 1]]
+        assert np.all(np.sort(actual_ids) == np.sort(expected["id"]))
+
+
+@pytest.mark.parametrize("compact", [False, True])
+def test_packed_index_queries(compact):
+    index = arange_sphere_index(n_spheres=10, radius=0.2)
+    core_index = index._core_index
+    packed_index = core.PackedSphereIndex(core_index, compact=compact)
+
+    assert len(packed_index) == len(core_index)
+
+    centers = arange_centroids(4) * 3.0
+    for center in centers:
+        expected = core_index._find_intersecting_np(center, 1.1, "best_effort")
+        actual = packed_index._find_intersecting_np(center, 1.1, "best_effort")
+        assert np.all(np.sort(actual["id"]) == np.sort(expected["id"]))
+
+        expected = core_index._find_nearest(center, 3)
+        actual = packed_index._find_nearest(center, 3)
+        assert np.all(np.sort(actual) == np.sort(expected))
@@ -3,6 +3,7 @@ import pytest
 from brain_indexer.util import is_strictly_sensible_filename
 from brain_indexer.util import strip_singleton_non_string_iterable
 from brain_indexer.util import factor
+from brain_indexer.util import guided_chunks
 
 
 def test_strictly_sensible_filename():
@@ -44,6 +45,33 @@ def test_strip_singleton_non_string_iterable():
             strip_singleton_non_string_iterable(arg)
 
 
+def test_guided_chunks():
+    for n_jobs in [1, 2, 10, 1000]:
+        for n_workers in [1, 3, 16]:
+            chunks = guided_chunks([1.0] * n_jobs, n_workers)
+
+            assert chunks[0][0] == 0
+            assert chunks[-1][1] == n_jobs
+            for (_, high), (low, _) in zip(chunks[:-1], chunks[1:]):
+                assert high == low
+
+            sizes = [high - low for low, high in chunks]
+            assert all(size >= 1 for size in sizes)
+            assert sizes[0] >= sizes[-1]
+
+
+def test_guided_chunks_weighted():
+    weights = [1.0] * 100
+    weights[10] = 1000.0
+
+    # The heavy job closes its chunk.
+    chunks = guided_chunks(weights, 4)
+    assert [high for low, high in chunks if low <= 10 < high] == [11]
+
+    assert guided_chunks([], 4) == []
+    assert guided_chunks([0.0, 0.0], 4) == guided_chunks([1.0, 1.0], 4)
+
+
 def test_factor():
     # Test if the function correctly returns the two factors of a perfect square
     assert factor(4, dims=2) == (2, 2)